@@ -0,0 +1,100 @@
+#include "CpuPathTracer.h"
+#include "../Headers/Threading.h"
+#include "../Headers/ImageCompare.h"
+
+using namespace DirectX;
+
+static UINT8 ToSrgb8(float Value)
+{
+    Value = Value < 0.f ? 0.f : (Value > 1.f ? 1.f : Value);
+    return (UINT8)(powf(Value, 1.f / 2.2f) * 255.f + 0.5f);
+}
+
+void CpuPathTracer::Initialize(ID3D12Device10* Device, CpuPathTracerData* Data, ID3D12Resource* BackBuffer)
+{
+    CpuTracer::CreateTutorialScene(&Data->TracerScene);
+
+    D3D12_RESOURCE_DESC BackBufferDesc = BackBuffer->GetDesc();
+    Data->TracerSettings.Width = (UINT)BackBufferDesc.Width;
+    Data->TracerSettings.Height = BackBufferDesc.Height;
+    Data->TracerSettings.NumThreads = Threading::GetNumHardwareThreads();
+
+    UINT NumPixels = Data->TracerSettings.Width * Data->TracerSettings.Height;
+    Data->Radiance.resize(NumPixels);
+    Data->Accumulation.assign(NumPixels, XMFLOAT3(0.f, 0.f, 0.f));
+
+    UINT64 UploadSize = 0;
+    Device->GetCopyableFootprints(&BackBufferDesc, 0, 1, 0, &Data->Footprint, nullptr, nullptr, &UploadSize);
+    for (UINT i = 0; i < GlobalResources::MaxBackBuffers; ++i)
+    {
+        D3D::CreateCommittedBuffer(Device, D3D12_HEAP_TYPE_UPLOAD, UploadSize, Data->UploadBuffers[i].GetAddressOf(),
+                                   D3D12_RESOURCE_STATE_GENERIC_READ);
+        NAME_D3D12_OBJECT_INDEXED(Data->UploadBuffers[i], i);
+        Check(Data->UploadBuffers[i]->Map(0, nullptr, (void**)&Data->MappedPixels[i]));
+    }
+}
+
+void CpuPathTracer::UpdateAndRender(CpuPathTracerData& Data,
+                                    Frame* CurrentFrame,
+                                    ID3D12GraphicsCommandList7* CmdList)
+{
+    // Progressive rendering: one wavefront sample per pixel per frame.
+    Data.TracerSettings.SampleIndex = Data.NumAccumulatedSamples++;
+    CpuTracer::RenderWavefront(Data.TracerScene, Data.TracerSettings, &Data.Wavefront, Data.Radiance.data());
+
+    // The frame that last copied out of this frame's buffer is done.
+    UINT8* MappedPixels = Data.MappedPixels[CurrentFrame->Index];
+    Data.LastWritten = CurrentFrame->Index;
+    UINT Width = Data.TracerSettings.Width;
+    float InvNumSamples = 1.f / (float)Data.NumAccumulatedSamples;
+    Threading::ParallelFor(Data.TracerSettings.Height, Data.TracerSettings.NumThreads, 16, [&](UINT Begin, UINT End)
+    {
+        for (UINT Y = Begin; Y < End; ++Y)
+        {
+            UINT32* Row = (UINT32*)(MappedPixels + Data.Footprint.Offset + Y * Data.Footprint.Footprint.RowPitch);
+            for (UINT X = 0; X < Width; ++X)
+            {
+                XMFLOAT3& Accumulated = Data.Accumulation[Y * Width + X];
+                const XMFLOAT3& Sample = Data.Radiance[Y * Width + X];
+                Accumulated = XMFLOAT3(Accumulated.x + Sample.x, Accumulated.y + Sample.y, Accumulated.z + Sample.z);
+
+                // DXGI_FORMAT_R8G8B8A8_UNORM.
+                Row[X] = (UINT32)ToSrgb8(Accumulated.x * InvNumSamples) |
+                    ((UINT32)ToSrgb8(Accumulated.y * InvNumSamples) << 8) |
+                    ((UINT32)ToSrgb8(Accumulated.z * InvNumSamples) << 16) |
+                    0xFF000000;
+            }
+        }
+    });
+
+    ResourceStates::Transition(&CurrentFrame->GraphicsStates, CurrentFrame->BackBuffer.Get(),
+                               D3D12_RESOURCE_STATE_COPY_DEST);
+
+    D3D12_TEXTURE_COPY_LOCATION Destination = {};
+    Destination.pResource = CurrentFrame->BackBuffer.Get();
+    Destination.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+    Destination.SubresourceIndex = 0;
+
+    D3D12_TEXTURE_COPY_LOCATION Source = {};
+    Source.pResource = Data.UploadBuffers[CurrentFrame->Index].Get();
+    Source.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+    Source.PlacedFootprint = Data.Footprint;
+    D3D::FlushBarriers(CmdList, &CurrentFrame->GraphicsStates);
+    CmdList->CopyTextureRegion(&Destination, 0, 0, 0, &Source, nullptr);
+
+    ResourceStates::Transition(&CurrentFrame->GraphicsStates, CurrentFrame->BackBuffer.Get(),
+                               D3D12_RESOURCE_STATE_PRESENT);
+}
+
+bool CpuPathTracer::SaveImage(const CpuPathTracerData& Data, const char* FileName)
+{
+    if (Data.MappedPixels[Data.LastWritten] == nullptr)
+    {
+        return false;
+    }
+
+    return ImageCompare::WriteTga(FileName,
+                                  Data.TracerSettings.Width, Data.TracerSettings.Height,
+                                  (const UINT32*)(Data.MappedPixels[Data.LastWritten] + Data.Footprint.Offset),
+                                  Data.Footprint.Footprint.RowPitch / sizeof(UINT32));
+}
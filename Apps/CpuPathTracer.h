@@ -0,0 +1,31 @@
+#pragma once
+#include "../Headers/Gpu.h"
+#include "../Headers/CpuTracer.h"
+
+namespace CpuPathTracer
+{
+    struct CpuPathTracerData
+    {
+        CpuTracer::Scene TracerScene;
+        CpuTracer::Settings TracerSettings;
+        CpuTracer::WavefrontState Wavefront;
+        std::vector<DirectX::XMFLOAT3> Radiance;
+        std::vector<DirectX::XMFLOAT3> Accumulation;
+        UINT NumAccumulatedSamples = 0;
+
+        // Upload buffers laid out like the back buffer so they can be copied with CopyTextureRegion, one per frame in
+        // flight since every frame writes the whole image.
+        ComPtr<ID3D12Resource> UploadBuffers[GlobalResources::MaxBackBuffers];
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT Footprint;
+        UINT8* MappedPixels[GlobalResources::MaxBackBuffers] = {};
+        UINT LastWritten = 0;
+    };
+
+    void Initialize(ID3D12Device10* Device, CpuPathTracerData* Data, ID3D12Resource* BackBuffer);
+    void UpdateAndRender(CpuPathTracerData& Data,
+                         Frame* CurrentFrame,
+                         ID3D12GraphicsCommandList7* CmdList);
+
+    // Writes the current accumulated image as a TGA, used as reference for ImageDiff.
+    bool SaveImage(const CpuPathTracerData& Data, const char* FileName);
+}
@@ -1,132 +1,152 @@
 ﻿#include "DXRTutorial.h"
+#include <chrono>
 
 using namespace DirectX;
 
-void DXRTutorial::UpdateAndRender(TutorialData& DXRData,
+void DXRTutorial::UpdateAndRender(ID3D12Device10* Device,
+                                  TutorialData& DXRData,
                                   Frame* CurrentFrame,
                                   ID3D12GraphicsCommandList7* CmdList,
+                                  BindlessHeap* Descriptors,
                                   ID3D12Resource* OutTexture,
-                                  UINT Width, UINT Height)
+                                  UINT Width, UINT Height,
+                                  ID3D12Fence* Fence, HANDLE FenceEvent)
 {
-    D3D::Transition(CmdList,
-                    D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-                    OutTexture);
+    ResourceStates::Tracker* Tracker = &CurrentFrame->GraphicsStates;
+    ResourceStates::Transition(Tracker, OutTexture, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
     
-    DXRTutorial::UpdateInstanceDescriptions(DXRData.InstanceDescs.Get(),
-                                            &DXRData.BottomLevelInfos[0],
-                                            DXRData.Rotation);
+    // Compacted BLASes move, the instance descriptions below pick up their new addresses.
+    D3D::UpdateBottomLevelCompaction(Device, CmdList, Tracker, &DXRData.Compaction,
+                                     Fence->GetCompletedValue(), CurrentFrame->FenceValue);
+
+    D3D12_RAYTRACING_INSTANCE_DESC* InstanceDescs = D3D::BeginInstanceDescs(&DXRData.InstanceDescs,
+                                                                            CurrentFrame->FenceValue,
+                                                                            Fence, FenceEvent);
+    UINT NumInstances = DXRTutorial::UpdateInstanceDescriptions(&DXRData, InstanceDescs);
+    ID3D12Resource* InstanceDescBuffer = D3D::EndInstanceDescs(&DXRData.InstanceDescs);
     DXRData.Rotation += 0.005f;
 
-    D3D::UpdateTopLevel(CmdList,
-                        DXRData.BottomLevelInfos, _countof(DXRData.BottomLevelInfos),
+    // Culling changes the instance count, which always rebuilds.
+    TopLevelPolicy::Action TopLevelAction = TopLevelPolicy::Evaluate(&DXRData.TopLevelState,
+                                                                     DXRData.InstanceBounds.data(),
+                                                                     NumInstances);
+    D3D::UpdateTopLevel(CmdList, Tracker, NumInstances,
                         DXRData.TopLevelASScratch.Get(), DXRData.TopLevelAS.Get(),
-                        DXRData.InstanceDescs.Get());
+                        InstanceDescBuffer, TopLevelAction);
 
-    CmdList->SetDescriptorHeaps(1, DXRData.CSUHeap.GetAddressOf()); // Output texture + TLAS descriptors.
+    CmdList->SetDescriptorHeaps(1, Descriptors->Heap.GetAddressOf()); // Output texture + TLAS descriptors.
     CmdList->SetPipelineState1(DXRData.RaytracingStateObject.Get());
     CmdList->SetComputeRootSignature(DXRData.EmptyGlobalRootsig.Get());
 
     // Dispatch.
-    D3D12_DISPATCH_RAYS_DESC DispatchRaysDesc = {};
-    DispatchRaysDesc.Depth = 1;
-    DispatchRaysDesc.Width = Width;
-    DispatchRaysDesc.Height = Height;
-
-    // Raygen shader table.
-    DispatchRaysDesc.RayGenerationShaderRecord.StartAddress = DXRData.ShaderTable->GetGPUVirtualAddress();
-    DispatchRaysDesc.RayGenerationShaderRecord.SizeInBytes = DXRData.ShaderTableEntrySize;
-
-    // Miss shader table.
-    UINT64 NumMissShaders = 2;
-    UINT64 MissShaderOffsetInSBT = 1 * DXRData.ShaderTableEntrySize;
-    DispatchRaysDesc.MissShaderTable.StartAddress = DXRData.ShaderTable->GetGPUVirtualAddress() + MissShaderOffsetInSBT;
-    DispatchRaysDesc.MissShaderTable.StrideInBytes = DXRData.ShaderTableEntrySize;
-    DispatchRaysDesc.MissShaderTable.SizeInBytes = NumMissShaders * DXRData.ShaderTableEntrySize;
-
-    // Hit shader table.
-    UINT64 NumHitShaders = DXRData.BottomLevelInfos[0].NumInstances * 2 + 1;
-    UINT64 HitgroupOffsetInSBT = 3 * DXRData.ShaderTableEntrySize;
-    DispatchRaysDesc.HitGroupTable.StartAddress = DXRData.ShaderTable->GetGPUVirtualAddress() + HitgroupOffsetInSBT;
-    DispatchRaysDesc.HitGroupTable.StrideInBytes = DXRData.ShaderTableEntrySize;
-    DispatchRaysDesc.HitGroupTable.SizeInBytes = NumHitShaders * DXRData.ShaderTableEntrySize;
-
+    D3D12_DISPATCH_RAYS_DESC DispatchRaysDesc;
+    D3D::GetDispatchRaysDesc(DXRData.ShaderTableLayout, DXRData.ShaderTable->GetGPUVirtualAddress(),
+                             Width, Height, &DispatchRaysDesc);
+    D3D::FlushBarriers(CmdList, Tracker);
     CmdList->DispatchRays(&DispatchRaysDesc);
 
-    D3D::Transition(CmdList,
-                    D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE,
-                    OutTexture);
-    D3D::Transition(CmdList,
-                    D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_COPY_DEST,
-                    CurrentFrame->BackBuffer.Get());
-
+    ResourceStates::Transition(Tracker, OutTexture, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    ResourceStates::Transition(Tracker, CurrentFrame->BackBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST);
+    D3D::FlushBarriers(CmdList, Tracker);
     CmdList->CopyResource(CurrentFrame->BackBuffer.Get(), OutTexture);
 
-    D3D::Transition(CmdList,
-                    D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PRESENT,
-                    CurrentFrame->BackBuffer.Get());
+    ResourceStates::Transition(Tracker, CurrentFrame->BackBuffer.Get(), D3D12_RESOURCE_STATE_PRESENT);
 }
 
-void DXRTutorial::InitializeAccelerationStructures(ID3D12Device10* Device, ID3D12GraphicsCommandList7* CmdList, TutorialData* DXRData)
+static const DXRTutorial::Vertex TriangleVertices[3] = {
+    {XMFLOAT3(0, 1, 0)},
+    {XMFLOAT3(0.866f, -0.5f, 0)},
+    {XMFLOAT3(-0.866f, -0.5f, 0)}
+};
+
+static const DXRTutorial::Vertex PlaneVertices[6] = {
+    XMFLOAT3(-100, -1, -2),
+    XMFLOAT3(100, -1, 100),
+    XMFLOAT3(-100, -1, 100),
+
+    XMFLOAT3(-100, -1, -2),
+    XMFLOAT3(100, -1, -2),
+    XMFLOAT3(100, -1, 100)
+};
+
+void DXRTutorial::StreamGeometry(ID3D12Device10* Device, TutorialData* DXRData, GpuMemory* Memory,
+                                 StreamingUploadBuffer* Streaming)
 {
     // Create the triangles vertex buffer.
-    Vertex TriangleVertices[3] = {
-        {XMFLOAT3(0, 1, 0)},
-        {XMFLOAT3(0.866f, -0.5f, 0)},
-        {XMFLOAT3(-0.866f, -0.5f, 0)}
-    };
-    D3D::CreateCommittedBuffer(Device, D3D12_HEAP_TYPE_UPLOAD, sizeof(TriangleVertices), &DXRData->TriangleVertexBuffer,
-                               D3D12_RESOURCE_STATE_GENERIC_READ);
+    D3D::CreatePlacedBuffer(Device, Memory, D3D12_HEAP_TYPE_DEFAULT, sizeof(TriangleVertices),
+                            DXRData->TriangleVertexBuffer.ReleaseAndGetAddressOf());
     NAME_D3D12_OBJECT(DXRData->TriangleVertexBuffer);
-
-    UINT8* MappedVertices = nullptr;
-    Check(DXRData->TriangleVertexBuffer->Map(0, nullptr, (void**)&MappedVertices));
-    memcpy(MappedVertices, TriangleVertices, sizeof(TriangleVertices));
-    DXRData->TriangleVertexBuffer->Unmap(0, nullptr);
+    D3D::StreamBuffer(Streaming, DXRData->TriangleVertexBuffer.Get(), 0, TriangleVertices,
+                      sizeof(TriangleVertices));
 
     // Create the plane's vertex buffer.
-    const Vertex PlaneVertices[6] = {
-        XMFLOAT3(-100, -1, -2),
-        XMFLOAT3(100, -1, 100),
-        XMFLOAT3(-100, -1, 100),
-
-        XMFLOAT3(-100, -1, -2),
-        XMFLOAT3(100, -1, -2),
-        XMFLOAT3(100, -1, 100)
-    };
-    D3D::CreateCommittedBuffer(Device, D3D12_HEAP_TYPE_UPLOAD,
-                               sizeof(PlaneVertices), DXRData->PlaneVertexBuffer.GetAddressOf(),
-                               D3D12_RESOURCE_STATE_GENERIC_READ);
+    D3D::CreatePlacedBuffer(Device, Memory, D3D12_HEAP_TYPE_DEFAULT, sizeof(PlaneVertices),
+                            DXRData->PlaneVertexBuffer.ReleaseAndGetAddressOf());
     NAME_D3D12_OBJECT(DXRData->PlaneVertexBuffer);
+    DXRData->GeometryUploads = D3D::StreamBuffer(Streaming, DXRData->PlaneVertexBuffer.Get(), 0, PlaneVertices,
+                                                 sizeof(PlaneVertices));
+}
+
+void DXRTutorial::InitializeAccelerationStructures(ID3D12Device10* Device, ID3D12GraphicsCommandList7* CmdList,
+                                                   ResourceStates::Tracker* Tracker, TutorialData* DXRData,
+                                                   GpuMemory* Memory, UINT64 BuildFenceValue)
+{
+    // Create acceleration structures, both BLASes in as few batches as the scratch budget allows.
+    D3D12_RAYTRACING_GEOMETRY_DESC GeometryDescs[2];
+    D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS BottomLevelInputs[2];
+    GetBottomLevelInputs(DXRData->TriangleVertexBuffer->GetGPUVirtualAddress(), _countof(TriangleVertices),
+                         &GeometryDescs[0], &BottomLevelInputs[0]);
+    GetBottomLevelInputs(DXRData->PlaneVertexBuffer->GetGPUVirtualAddress(), _countof(PlaneVertices),
+                         &GeometryDescs[1], &BottomLevelInputs[1]);
+
+    // Compacted BLASes have to be built with ALLOW_COMPACTION, which also reports their compacted size.
+    D3D12_GPU_VIRTUAL_ADDRESS CompactedSizes = 0;
+    if (DXRData->CompactBottomLevels)
+    {
+        for (int i = 0; i < _countof(BottomLevelInputs); ++i)
+        {
+            BottomLevelInputs[i].Flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_COMPACTION;
+        }
+        D3D::CreateBottomLevelCompaction(Device, Memory, _countof(BottomLevelInputs), &DXRData->Compaction);
+        CompactedSizes = DXRData->Compaction.CompactedSizes->GetGPUVirtualAddress();
+    }
 
-    MappedVertices = nullptr;
-    Check(DXRData->PlaneVertexBuffer->Map(0, nullptr, (void**)&MappedVertices));
-    memcpy(MappedVertices, PlaneVertices, sizeof(PlaneVertices));
-    DXRData->PlaneVertexBuffer->Unmap(0, nullptr);
+    ComPtr<ID3D12Resource> BottomLevels[2];
+    PlacedAllocation BottomLevelRanges[2];
+    D3D::BuildBottomLevels(Device, CmdList, Tracker, Memory,
+                           BottomLevelInputs, _countof(BottomLevelInputs), BottomLevelScratchBudget,
+                           BottomLevels, BottomLevelRanges,
+                           DXRData->BottomLevelScratch.ReleaseAndGetAddressOf(), &DXRData->BottomLevelScratchRange,
+                           CompactedSizes);
+    NAME_D3D12_OBJECT(BottomLevels[0]);
+    NAME_D3D12_OBJECT(BottomLevels[1]);
+    NAME_D3D12_OBJECT(DXRData->BottomLevelScratch);
 
-    // Create acceleration structures.
     // Triangle BLAS.
-    CreateBottomLevel(Device, CmdList, DXRData->TriangleVertexBuffer.Get(), _countof(TriangleVertices),
-                      DXRData->TriangleBottomLevelASScratch.GetAddressOf(),
-                      DXRData->TriangleBottomLevelAS.GetAddressOf());
-    NAME_D3D12_OBJECT(DXRData->TriangleBottomLevelAS);
-    NAME_D3D12_OBJECT(DXRData->TriangleBottomLevelASScratch);
-
-    DXRData->BottomLevelInfos[0].VertexBuffer = DXRData->TriangleVertexBuffer;
-    DXRData->BottomLevelInfos[0].BottomLevel = DXRData->TriangleBottomLevelAS;
-    DXRData->BottomLevelInfos[0].BottomLevelScratch = DXRData->TriangleBottomLevelASScratch;
+    DXRData->BottomLevelInfos[0].BottomLevel = BottomLevels[0];
+    DXRData->BottomLevelInfos[0].Address = BottomLevels[0]->GetGPUVirtualAddress();
     DXRData->BottomLevelInfos[0].NumInstances = 3;
+    for (int i = 0; i < _countof(TriangleVertices); ++i)
+    {
+        Bvh::Grow(&DXRData->BottomLevelInfos[0].Bounds, TriangleVertices[i].Position);
+    }
 
     // Plane BLAS.
-    CreateBottomLevel(Device, CmdList, DXRData->PlaneVertexBuffer.Get(), _countof(PlaneVertices),
-                                   DXRData->PlaneBottomLevelASScratch.GetAddressOf(),
-                                   DXRData->PlaneBottomLevelAS.GetAddressOf());
-    NAME_D3D12_OBJECT(DXRData->PlaneBottomLevelAS);
-    NAME_D3D12_OBJECT(DXRData->PlaneBottomLevelASScratch);
-
-    DXRData->BottomLevelInfos[1].VertexBuffer = DXRData->PlaneVertexBuffer;
-    DXRData->BottomLevelInfos[1].BottomLevel = DXRData->PlaneBottomLevelAS;
-    DXRData->BottomLevelInfos[1].BottomLevelScratch = DXRData->PlaneBottomLevelASScratch;
+    DXRData->BottomLevelInfos[1].BottomLevel = BottomLevels[1];
+    DXRData->BottomLevelInfos[1].Address = BottomLevels[1]->GetGPUVirtualAddress();
     DXRData->BottomLevelInfos[1].NumInstances = 1;
+    for (int i = 0; i < _countof(PlaneVertices); ++i)
+    {
+        Bvh::Grow(&DXRData->BottomLevelInfos[1].Bounds, PlaneVertices[i].Position);
+    }
+
+    // The copies into right-sized buffers are recorded by UpdateAndRender once the builds completed.
+    if (DXRData->CompactBottomLevels)
+    {
+        D3D::QueueBottomLevelCompaction(CmdList, Tracker, &DXRData->Compaction,
+                                        DXRData->BottomLevelInfos, BottomLevelRanges,
+                                        _countof(DXRData->BottomLevelInfos), BuildFenceValue);
+    }
 
     // Instance descriptions for the 3 triangles and the plane.
     UINT NumInstances = 0;
@@ -135,18 +155,28 @@ void DXRTutorial::InitializeAccelerationStructures(ID3D12Device10* Device, ID3D1
         NumInstances += DXRData->BottomLevelInfos[i].NumInstances;
     }
 
-    CreateInstanceDescriptions(Device,
+    CreateInstanceDescriptions(Device, Memory,
                                DXRData->BottomLevelInfos, NumInstances,
-                               DXRData->InstanceDescs.GetAddressOf());
-    NAME_D3D12_OBJECT(DXRData->InstanceDescs);
-
-    D3D::CreateTopLevel(Device, CmdList, NumInstances, DXRData->InstanceDescs.Get(),
+                               &DXRData->TriangleInstances, &DXRData->InstanceDescs);
+    DXRData->InstanceBounds.resize(NumInstances);
+
+    // SimpleDXR.hlsl shoots camera rays from (0, 0, -2) down +Z, 90 degrees wide and high.
+    DXRData->Camera.Init(XMFLOAT3(0.f, 0.f, -2.f));
+    DXRData->Camera.LookDirection = XMFLOAT3(0.f, 0.f, 1.f);
+    FrustumCulling::Resize(&DXRData->TriangleBounds, DXRData->BottomLevelInfos[0].NumInstances);
+    DXRData->VisibleTriangles.resize(DXRData->BottomLevelInfos[0].NumInstances);
+    OcclusionCulling::AddQuad(&DXRData->Occluders, PlaneVertices[0].Position, PlaneVertices[4].Position,
+                              PlaneVertices[1].Position, PlaneVertices[2].Position);
+    OcclusionCulling::Initialize(&DXRData->OcclusionDepth, OcclusionDepthSize, OcclusionDepthSize);
+
+    D3D::CreateTopLevel(Device, CmdList, Tracker, Memory, NumInstances, DXRData->InstanceDescs.Buffers[0].Get(),
                         DXRData->TopLevelASScratch.GetAddressOf(), DXRData->TopLevelAS.GetAddressOf());
     NAME_D3D12_OBJECT(DXRData->TopLevelASScratch);
     NAME_D3D12_OBJECT(DXRData->TopLevelAS);
 }
 
-void DXRTutorial::InitializeShaderBindings(ID3D12Device10* Device, TutorialData* DXRData, ID3D12Resource* OutputTexture)
+void DXRTutorial::InitializeShaderBindings(ID3D12Device10* Device, TutorialData* DXRData, GpuMemory* Memory,
+                                           BindlessHeap* Descriptors, ID3D12Resource* OutputTexture)
 {
     CreateRootSignatures(Device,
                          DXRData->RaygenShadersLocalRootsig.GetAddressOf(),
@@ -154,72 +184,70 @@ void DXRTutorial::InitializeShaderBindings(ID3D12Device10* Device, TutorialData*
                          DXRData->MissEmptyLocalRootsig.GetAddressOf(),
                          DXRData->EmptyGlobalRootsig.GetAddressOf());
 
-    CreateRtStateObject(Device,
-                        &DXRData->RtShader,
-                        DXRData->RaygenShadersLocalRootsig.Get(),
-                        DXRData->ClosestHitLocalRootsig.Get(),
-                        DXRData->MissEmptyLocalRootsig.Get(),
-                        DXRData->EmptyGlobalRootsig.Get(),
-                        DXRData->RaytracingStateObject.GetAddressOf());
-
-    CreateGPUVisibleCSUHeap(Device, 2, DXRData->CSUHeap.GetAddressOf());
+    // One range for the raygen descriptor table:
+    // 0: The output texture (UAV, RWTexture2D).
+    // 1: The scene representation TLAS (SRV, RaytracingAccelerationStructure).
+    DXRData->RaygenDescriptors = DescriptorAllocator::Allocate(&Descriptors->Allocator, 2);
+    assert(DXRData->RaygenDescriptors != DescriptorAllocator::InvalidHandle);
 
     CreateRaygenShaderDescriptors(Device,
-                                  DXRData->CSUHeap.Get(),
+                                  *Descriptors, DescriptorAllocator::GetIndex(DXRData->RaygenDescriptors),
                                   DXRData->TopLevelAS.Get(), OutputTexture);
 
-    CreateClosestHitShaderUploadResources(Device,
-                                          DXRData->PerFrameUploadResource.GetAddressOf(),
-                                          DXRData->PerInstanceUploadResource.GetAddressOf());
+    CreateClosestHitShaderUploadResources(Device, Memory,
+                                          &DXRData->PerFrameUploadBuffer,
+                                          &DXRData->PerInstanceUploadBuffer);
+
+    // There's no pipeline before this one to keep rendering with.
+    if (!CreatePipeline(Device, *DXRData, *Descriptors, &DXRData->RtShader, &DXRData->PipelineDesc,
+                        DXRData->RaytracingStateObject.GetAddressOf(),
+                        DXRData->ShaderTable.GetAddressOf(), &DXRData->ShaderTableLayout))
+    {
+        __debugbreak();
+    }
+}
 
-    CreateShaderTable(Device, DXRData->RaytracingStateObject.Get(), DXRData->CSUHeap.Get(),
-                      DXRData->PerFrameUploadResource.Get(), DXRData->PerInstanceUploadResource.Get(),
-                      DXRData->ShaderTable.GetAddressOf(), &DXRData->ShaderTableEntrySize);
+bool DXRTutorial::CreatePipeline(ID3D12Device10* Device, const TutorialData& DXRData, const BindlessHeap& Descriptors,
+                                 Shader* Program, RtPipeline::Desc* PipelineDesc,
+                                 ID3D12StateObject** RaytracingStateObject,
+                                 ID3D12Resource** ShaderTable, ShaderBindingTable::Layout* ShaderTableLayout)
+{
+    // Only reads what the shader bindings set up, so a reloaded shader's pipeline can be built on any thread while
+    // the one before renders. False when the shader doesn't match the pipeline, e.g. it renamed an export.
+    return CreateRtStateObject(Device,
+                               Program,
+                               DXRData.RaygenShadersLocalRootsig.Get(),
+                               DXRData.ClosestHitLocalRootsig.Get(),
+                               DXRData.MissEmptyLocalRootsig.Get(),
+                               DXRData.EmptyGlobalRootsig.Get(),
+                               PipelineDesc,
+                               RaytracingStateObject) &&
+           CreateShaderTable(Device, *RaytracingStateObject,
+                             D3D::GetGpuHandle(Descriptors, DescriptorAllocator::GetIndex(DXRData.RaygenDescriptors)),
+                             DXRData.PerFrameUploadBuffer.Address, DXRData.PerInstanceUploadBuffer.Address,
+                             DXRData.BottomLevelInfos[0].NumInstances,
+                             ShaderTable, ShaderTableLayout);
 }
 
-void DXRTutorial::CreateBottomLevel(ID3D12Device10* Device, ID3D12GraphicsCommandList7* CmdList, ID3D12Resource* VB, UINT VertexCount,
-                                    ID3D12Resource** BottomLevelASScratch, ID3D12Resource** BottomLevelAS)
+void DXRTutorial::GetBottomLevelInputs(D3D12_GPU_VIRTUAL_ADDRESS VertexBuffer, UINT VertexCount,
+                                       D3D12_RAYTRACING_GEOMETRY_DESC* GeometryDesc,
+                                       D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS* ASInputs)
 {
-    D3D12_RAYTRACING_GEOMETRY_DESC GeometryDesc = {};
-    GeometryDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
+    *GeometryDesc = {};
+    GeometryDesc->Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
     // Prevent AnyHit shaders from executing on opaque geometry.
-    GeometryDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
-    GeometryDesc.Triangles.VertexBuffer.StartAddress = VB->GetGPUVirtualAddress();
-    GeometryDesc.Triangles.VertexBuffer.StrideInBytes = sizeof(Vertex);
-    GeometryDesc.Triangles.VertexCount = VertexCount;
-    GeometryDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
-
-    D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS ASInputs = {};
-    ASInputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-    ASInputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
-    ASInputs.NumDescs = 1;
-    ASInputs.pGeometryDescs = &GeometryDesc;
-    ASInputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
-
-    // Create the buffers.
-    D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO ASPrebuildInfo = {};
-    Device->GetRaytracingAccelerationStructurePrebuildInfo(&ASInputs, &ASPrebuildInfo);
-
-    D3D::CreateCommittedBuffer(Device, D3D12_HEAP_TYPE_DEFAULT, ASPrebuildInfo.ScratchDataSizeInBytes, BottomLevelASScratch,
-                               D3D12_RESOURCE_STATE_COMMON,
-                               D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-    D3D::CreateCommittedBuffer(Device, D3D12_HEAP_TYPE_DEFAULT, ASPrebuildInfo.ResultDataMaxSizeInBytes, BottomLevelAS,
-                               D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE,
-                               D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-
-    D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC ASDesc = {};
-    ASDesc.Inputs = ASInputs;
-    ASDesc.DestAccelerationStructureData = (*BottomLevelAS)->GetGPUVirtualAddress();
-    ASDesc.ScratchAccelerationStructureData = (*BottomLevelASScratch)->GetGPUVirtualAddress();
-
-    CmdList->BuildRaytracingAccelerationStructure(&ASDesc, 0, nullptr);
-
-    // Wait for TriangleBottomLevelAS to be created (all writes are done).
-    D3D12_RESOURCE_BARRIER UAVBarrier = {};
-    UAVBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-    UAVBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-    UAVBarrier.UAV.pResource = *BottomLevelAS;
-    CmdList->ResourceBarrier(1, &UAVBarrier);
+    GeometryDesc->Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+    GeometryDesc->Triangles.VertexBuffer.StartAddress = VertexBuffer;
+    GeometryDesc->Triangles.VertexBuffer.StrideInBytes = sizeof(Vertex);
+    GeometryDesc->Triangles.VertexCount = VertexCount;
+    GeometryDesc->Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+
+    *ASInputs = {};
+    ASInputs->DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+    ASInputs->Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
+    ASInputs->NumDescs = 1;
+    ASInputs->pGeometryDescs = GeometryDesc;
+    ASInputs->Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
 }
 
 void DXRTutorial::CreateRootSignatures(ID3D12Device10* Device,
@@ -285,276 +313,89 @@ void DXRTutorial::CreateRootSignatures(ID3D12Device10* Device,
     NAME_D3D12_OBJECT(*EmptyGlobalRootsig);
 }
 
-void DXRTutorial::CreateRtStateObject(ID3D12Device10* Device, Shader* Program,
+bool DXRTutorial::CreateRtStateObject(ID3D12Device10* Device, Shader* Program,
                                       ID3D12RootSignature* RaygenShadersLocalRootsig,
                                       ID3D12RootSignature* ClosestHitLocalRootsig,
                                       ID3D12RootSignature* MissEmptyLocalRootsig,
                                       ID3D12RootSignature* EmptyGlobalRootsig,
+                                      RtPipeline::Desc* PipelineDesc,
                                       _Out_ ID3D12StateObject** RaytracingStateObject)
 {
-    const UINT NumSubObjects = 14;
-    UINT SubobjectIndex = 0;
-    D3D12_STATE_SUBOBJECT Subobjects[NumSubObjects];
-
-    const wchar_t* EntryPoints[6] = {
-        MissShaderEntry,
-        ClosestHitShaderEntry,
-        ClosestHitPlaneShaderEntry,
-        RayGenShaderEntry,
-        ShadowClosestHitEntry,
-        ShadowMissEntry
-    };
-    D3D12_EXPORT_DESC ExportDescs[_countof(EntryPoints)] = {};
-    for (int i = 0; i < _countof(EntryPoints); ++i)
+    const void* Bytecode = Program->Blob->GetBufferPointer();
+    UINT64 BytecodeLength = Program->Blob->GetBufferSize();
+
+    RtPipeline::Desc& Pipeline = *PipelineDesc;
+    Pipeline = RtPipeline::Desc();
+    Pipeline.GlobalRootSignature = EmptyGlobalRootsig;
+    Pipeline.MaxPayloadSize = sizeof(float) * 3; // Size of our payload struct (12 bytes, float3 color).
+    Pipeline.MaxAttributeSize = sizeof(float) * 2; // BuiltInTriangleIntersectionAttributes.
+    Pipeline.MaxTraceRecursionDepth = 2;
+
+    RtPipeline::AddLibrary(&Pipeline, Bytecode, BytecodeLength,
+                           {RayGenShaderEntry, MissShaderEntry, ShadowMissEntry, ClosestHitShaderEntry, ShadowClosestHitEntry});
+    RtPipeline::AddHitGroup(&Pipeline, HitGroup, ClosestHitShaderEntry);
+    RtPipeline::AddHitGroup(&Pipeline, HitGroupShadow, ShadowClosestHitEntry);
+    RtPipeline::AssociateLocalRootSignature(&Pipeline, RaygenShadersLocalRootsig, {RayGenShaderEntry});
+    RtPipeline::AssociateLocalRootSignature(&Pipeline, ClosestHitLocalRootsig, {ClosestHitShaderEntry});
+    RtPipeline::AssociateLocalRootSignature(&Pipeline, MissEmptyLocalRootsig, {ShadowClosestHitEntry, ShadowMissEntry});
+
+    // The plane is a separate material: it traces shadow rays, so it uses the raygen descriptor table.
+    RtPipeline::Desc PlaneMaterial;
+    RtPipeline::AddLibrary(&PlaneMaterial, Bytecode, BytecodeLength, {ClosestHitPlaneShaderEntry});
+    RtPipeline::AddHitGroup(&PlaneMaterial, HitGroupPlane, ClosestHitPlaneShaderEntry);
+    RtPipeline::AssociateLocalRootSignature(&PlaneMaterial, RaygenShadersLocalRootsig, {ClosestHitPlaneShaderEntry});
+
+    // Materials are added to the existing state object when the device supports it (tier 1.1),
+    // so only their shaders get compiled. Otherwise everything goes into one state object.
+    D3D12_FEATURE_DATA_D3D12_OPTIONS5 Options5 = {};
+    Check(Device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS5, &Options5, sizeof(Options5)));
+    Pipeline.AllowStateObjectAdditions = Options5.RaytracingTier >= D3D12_RAYTRACING_TIER_1_1;
+
+    if (Pipeline.AllowStateObjectAdditions)
     {
-        ExportDescs[i].Name = EntryPoints[i];
-        ExportDescs[i].ExportToRename = nullptr;
+        ComPtr<ID3D12StateObject> BaseStateObject;
+        return D3D::CreateRtStateObject(Device, Pipeline, BaseStateObject.GetAddressOf()) &&
+               D3D::AddToRtStateObject(Device, &Pipeline, PlaneMaterial, BaseStateObject.Get(), RaytracingStateObject);
     }
-    D3D12_DXIL_LIBRARY_DESC DxilLibraryDesc = {};
-    DxilLibraryDesc.NumExports = _countof(ExportDescs);
-    DxilLibraryDesc.pExports = ExportDescs;
-    DxilLibraryDesc.DXILLibrary.pShaderBytecode = Program->Blob->GetBufferPointer();
-    DxilLibraryDesc.DXILLibrary.BytecodeLength = Program->Blob->GetBufferSize();
-    D3D12_STATE_SUBOBJECT LibraryStateObject = {};
-    LibraryStateObject.Type = D3D12_STATE_SUBOBJECT_TYPE_DXIL_LIBRARY;
-    LibraryStateObject.pDesc = &DxilLibraryDesc;
-    Subobjects[SubobjectIndex++] = LibraryStateObject;
-
-    // Hit group: closest-hit.
-    D3D12_HIT_GROUP_DESC HitGroupDesc = {};
-    HitGroupDesc.Type = D3D12_HIT_GROUP_TYPE_TRIANGLES;
-    HitGroupDesc.HitGroupExport = HitGroup;
-    HitGroupDesc.ClosestHitShaderImport = ClosestHitShaderEntry;
-    // HitGroupDesc.IntersectionShaderImport =;
-    // HitGroupDesc.AnyHitShaderImport = ;
-    D3D12_STATE_SUBOBJECT HitGroupSubobject = {};
-    HitGroupSubobject.Type = D3D12_STATE_SUBOBJECT_TYPE_HIT_GROUP;
-    HitGroupSubobject.pDesc = &HitGroupDesc;
-    Subobjects[SubobjectIndex++] = HitGroupSubobject;
-    
-    // Hit group: Plane closest-hit.
-    D3D12_HIT_GROUP_DESC HitGroupPlaneDesc = {};
-    HitGroupPlaneDesc.Type = D3D12_HIT_GROUP_TYPE_TRIANGLES;
-    HitGroupPlaneDesc.HitGroupExport = HitGroupPlane;
-    HitGroupPlaneDesc.ClosestHitShaderImport = ClosestHitPlaneShaderEntry;
-    // HitGroupPlaneDesc.IntersectionShaderImport =;
-    // HitGroupPlaneDesc.AnyHitShaderImport = ;
-    D3D12_STATE_SUBOBJECT HitGroupPlaneSubobject = {};
-    HitGroupPlaneSubobject.Type = D3D12_STATE_SUBOBJECT_TYPE_HIT_GROUP;
-    HitGroupPlaneSubobject.pDesc = &HitGroupPlaneDesc;
-    Subobjects[SubobjectIndex++] = HitGroupPlaneSubobject;
-    
-    // Hit group: Shadow closest-hit.
-    D3D12_HIT_GROUP_DESC HitGroupShadowDesc = {};
-    HitGroupShadowDesc.Type = D3D12_HIT_GROUP_TYPE_TRIANGLES;
-    HitGroupShadowDesc.HitGroupExport = HitGroupShadow;
-    HitGroupShadowDesc.ClosestHitShaderImport = ShadowClosestHitEntry;
-    // HitGroupShadowDesc.IntersectionShaderImport =;
-    // HitGroupShadowDesc.AnyHitShaderImport = ;
-    D3D12_STATE_SUBOBJECT HitGroupShadowSubobject = {};
-    HitGroupShadowSubobject.Type = D3D12_STATE_SUBOBJECT_TYPE_HIT_GROUP;
-    HitGroupShadowSubobject.pDesc = &HitGroupShadowDesc;
-    Subobjects[SubobjectIndex++] = HitGroupShadowSubobject;
-
-    D3D12_STATE_SUBOBJECT LocalRootsigSubobject = {};
-    LocalRootsigSubobject.Type = D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE;
-    LocalRootsigSubobject.pDesc = &RaygenShadersLocalRootsig;
-    Subobjects[SubobjectIndex] = LocalRootsigSubobject;
-    // Associate the PathTracer.hlsl local root signature to the ray generation shader.
-    D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION RayGenExportsAssociation = {};
-    const wchar_t* RaygenShaderExports[2] = {RayGenShaderEntry, ClosestHitPlaneShaderEntry};
-    RayGenExportsAssociation.pExports = RaygenShaderExports;
-    RayGenExportsAssociation.NumExports = _countof(RaygenShaderExports);
-    RayGenExportsAssociation.pSubobjectToAssociate = &Subobjects[SubobjectIndex++];
-
-    // Ray generation local rootsig subobject.
-    D3D12_STATE_SUBOBJECT ExportsAssociationSubobject = {};
-    ExportsAssociationSubobject.Type = D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
-    ExportsAssociationSubobject.pDesc = &RayGenExportsAssociation;
-    Subobjects[SubobjectIndex++] = ExportsAssociationSubobject;
-
-    // Local root signature for the hit shader.
-    D3D12_STATE_SUBOBJECT ClosestHitLocalRootsigSubobject = {};
-    ClosestHitLocalRootsigSubobject.Type = D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE;
-    ClosestHitLocalRootsigSubobject.pDesc = &ClosestHitLocalRootsig;
-    Subobjects[SubobjectIndex] = ClosestHitLocalRootsigSubobject;
-    // Associate the hit shader local root signature to the hit shader.
-    D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION ClosestHitExportsAssociation = {};
-    const wchar_t* HitShaderExports[1] = {ClosestHitShaderEntry};
-    ClosestHitExportsAssociation.pExports = HitShaderExports;
-    ClosestHitExportsAssociation.NumExports = _countof(HitShaderExports);
-    ClosestHitExportsAssociation.pSubobjectToAssociate = &Subobjects[SubobjectIndex++];
-    D3D12_STATE_SUBOBJECT ClosestHitExportsAssociationSubobject = {};
-    ClosestHitExportsAssociationSubobject.Type = D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
-    ClosestHitExportsAssociationSubobject.pDesc = &ClosestHitExportsAssociation;
-    Subobjects[SubobjectIndex++] = ClosestHitExportsAssociationSubobject;
-
-    // Empty local root signature for shaders that don't bind any descriptors.
-    D3D12_STATE_SUBOBJECT EmptyRootsigSubobject = {};
-    EmptyRootsigSubobject.Type = D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE;
-    EmptyRootsigSubobject.pDesc = &MissEmptyLocalRootsig;
-    Subobjects[SubobjectIndex] = EmptyRootsigSubobject;
-    // Associate the empty local root signature to the miss shader.
-    D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION MissExportsAssociation = {};
-    const wchar_t* EmptyShaderExports[2] = {
-        ShadowClosestHitEntry,
-        ShadowMissEntry
-    };
-    MissExportsAssociation.pExports = EmptyShaderExports;
-    MissExportsAssociation.NumExports = _countof(EmptyShaderExports);
-    MissExportsAssociation.pSubobjectToAssociate = &Subobjects[SubobjectIndex++];
-    D3D12_STATE_SUBOBJECT MissExportsAssociationSubobject = {};
-    MissExportsAssociationSubobject.Type = D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
-    MissExportsAssociationSubobject.pDesc = &MissExportsAssociation;
-    Subobjects[SubobjectIndex++] = MissExportsAssociationSubobject;
-
-    // Attributes and Payload struct shader config.
-    D3D12_RAYTRACING_SHADER_CONFIG RtShaderConfig = {};
-    RtShaderConfig.MaxAttributeSizeInBytes = sizeof(float) * 2; // BuiltInTriangleIntersectionAttributes.
-    RtShaderConfig.MaxPayloadSizeInBytes = sizeof(float) * 3; // Size of our payload struct (12 bytes, float3 color).
-    D3D12_STATE_SUBOBJECT ShaderConfigSubobject = {};
-    ShaderConfigSubobject.Type = D3D12_STATE_SUBOBJECT_TYPE_RAYTRACING_SHADER_CONFIG;
-    ShaderConfigSubobject.pDesc = &RtShaderConfig;
-    Subobjects[SubobjectIndex] = ShaderConfigSubobject;
-
-    // Associate the shader config to ray tracing shaders.
-    D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION RtShaderConfigAssociation = {};
-    RtShaderConfigAssociation.pExports = EntryPoints;
-    RtShaderConfigAssociation.NumExports = _countof(EntryPoints);
-    RtShaderConfigAssociation.pSubobjectToAssociate = &Subobjects[SubobjectIndex++];
-    D3D12_STATE_SUBOBJECT ShaderConfigAssociationSubobject = {};
-    ShaderConfigAssociationSubobject.Type = D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
-    ShaderConfigAssociationSubobject.pDesc = &RtShaderConfigAssociation;
-    Subobjects[SubobjectIndex++] = ShaderConfigAssociationSubobject;
-
-    // Ray tracing pipeline config.
-    D3D12_RAYTRACING_PIPELINE_CONFIG RtPipelineConfig = {};
-    RtPipelineConfig.MaxTraceRecursionDepth = 2;
-    D3D12_STATE_SUBOBJECT RtPipelineConfigSubobject = {};
-    RtPipelineConfigSubobject.Type = D3D12_STATE_SUBOBJECT_TYPE_RAYTRACING_PIPELINE_CONFIG;
-    RtPipelineConfigSubobject.pDesc = &RtPipelineConfig;
-    Subobjects[SubobjectIndex++] = RtPipelineConfigSubobject;
 
-    // Empty global root signature.
-    D3D12_GLOBAL_ROOT_SIGNATURE GlobalRootsig = {};
-    GlobalRootsig.pGlobalRootSignature = EmptyGlobalRootsig;
-    D3D12_STATE_SUBOBJECT GlobalRootsigSubobject = {};
-    GlobalRootsigSubobject.Type = D3D12_STATE_SUBOBJECT_TYPE_GLOBAL_ROOT_SIGNATURE;
-    GlobalRootsigSubobject.pDesc = &GlobalRootsig;
-    Subobjects[SubobjectIndex++] = GlobalRootsigSubobject;
-
-    // Combine the subobjects into the final ray tracing state object.
-    D3D12_STATE_OBJECT_DESC StateObjectDesc = {};
-    StateObjectDesc.NumSubobjects = NumSubObjects;
-    StateObjectDesc.Type = D3D12_STATE_OBJECT_TYPE_RAYTRACING_PIPELINE;
-    StateObjectDesc.pSubobjects = Subobjects;
-    Check(Device->CreateStateObject(&StateObjectDesc, IID_PPV_ARGS(RaytracingStateObject)));
+    RtPipeline::Merge(&Pipeline, PlaneMaterial);
+    return D3D::CreateRtStateObject(Device, Pipeline, RaytracingStateObject);
 }
 
-void DXRTutorial::CreateShaderTable(ID3D12Device10* Device,
-                                    ID3D12StateObject* RaytracingStateObject, ID3D12DescriptorHeap* CSUHeap,
-                                    ID3D12Resource* PerFrameUploadResource, ID3D12Resource* PerInstanceUploadResource,
-                                    ID3D12Resource** ShaderTable, UINT64* ShaderTableEntrySize)
+bool DXRTutorial::CreateShaderTable(ID3D12Device10* Device,
+                                    ID3D12StateObject* RaytracingStateObject,
+                                    D3D12_GPU_DESCRIPTOR_HANDLE RaygenTable,
+                                    D3D12_GPU_VIRTUAL_ADDRESS PerFrameConstants,
+                                    D3D12_GPU_VIRTUAL_ADDRESS PerInstanceConstants,
+                                    UINT NumTriangleInstances,
+                                    ID3D12Resource** ShaderTable, ShaderBindingTable::Layout* ShaderTableLayout)
 {
-    // To figure out the the size of an entry in the SBT, figured out the largest possible entry size.
-    // In our case, the hit group entry is likely to be the biggest entry.
-
-    // It contains a shader ID:
-    UINT64 TableEntrySize = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
+    using namespace ShaderBindingTable;
+    Builder TableBuilder;
 
-    // And 2 CBVs:
-    TableEntrySize += 8; // Add the size of the first CBV.
-    TableEntrySize += 8; // Add the size of the second CBV.
+    // Ray generation: output texture descriptor table, followed in the heap by the TLAS.
+    AddRecord(&TableBuilder, Section::RayGen, RayGenShaderEntry, {DescriptorTable(RaygenTable.ptr)});
 
-    TableEntrySize = AlignTo(TableEntrySize, D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT);
-    *ShaderTableEntrySize = TableEntrySize;
+    // Miss shaders, indexed by the MissShaderIndex of TraceRay.
+    AddRecord(&TableBuilder, Section::Miss, MissShaderEntry);
+    AddRecord(&TableBuilder, Section::Miss, ShadowMissEntry);
 
-    const UINT NumPrograms = 10;
-    UINT64 ShaderTableSize = TableEntrySize * NumPrograms; // One entry per program.
-
-    // We are using an upload heap for simplicity, ideally transfer to a default heap.
-    D3D::CreateCommittedBuffer(Device, D3D12_HEAP_TYPE_UPLOAD,
-                               ShaderTableSize, ShaderTable,
-                               D3D12_RESOURCE_STATE_GENERIC_READ);
-    
-    // Get the shader IDs.
-    ComPtr<ID3D12StateObjectProperties> RtPsoProperties;
-    RaytracingStateObject->QueryInterface(IID_PPV_ARGS(&RtPsoProperties));
-    const void* RaygenShaderId = RtPsoProperties->GetShaderIdentifier(RayGenShaderEntry);
-    const void* MissShaderId = RtPsoProperties->GetShaderIdentifier(MissShaderEntry);
-    const void* ShadowMissShaderId = RtPsoProperties->GetShaderIdentifier(ShadowMissEntry);
-    const void* HitGroupId = RtPsoProperties->GetShaderIdentifier(HitGroup);
-    const void* HitGroupPlaneId = RtPsoProperties->GetShaderIdentifier(HitGroupPlane);
-    const void* HitGroupShadowId = RtPsoProperties->GetShaderIdentifier(HitGroupShadow);
-
-    UINT8* ShaderTableDataStart = nullptr;
-    Check((*ShaderTable)->Map(0, nullptr, (void**)&ShaderTableDataStart));
-
-    // Entry 0: Ray generation shader ID.
-    memcpy(ShaderTableDataStart, RaygenShaderId, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-    // Entry 0 data: output texture descriptor handle. Followed by the descriptor for the TLAS.
-    UINT8* OutputTextureHandleOffset = ShaderTableDataStart + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
-    *(D3D12_GPU_VIRTUAL_ADDRESS*)OutputTextureHandleOffset = CSUHeap->GetGPUDescriptorHandleForHeapStart().ptr;
-
-    // Entry 1: Miss shader ID.
-    UINT8* MissEntry = ShaderTableDataStart + TableEntrySize;
-    memcpy(MissEntry, MissShaderId, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-    
-    // Entry 2: Shadow Miss shader ID.
-    UINT8* ShadowMissEntry = MissEntry + TableEntrySize;
-    memcpy(ShadowMissEntry, ShadowMissShaderId, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-
-    // Entry 3: Instance 0 Closest-hit shader ID.
-    UINT8* Instance0HitGroupEntry = ShadowMissEntry + TableEntrySize;
-    memcpy(Instance0HitGroupEntry, HitGroupId, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-    // Entry 3 data: PerFrame root CBV.
-    UINT8* Instance0PerFrameCBVOffset = Instance0HitGroupEntry + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
-    *(D3D12_GPU_VIRTUAL_ADDRESS*)Instance0PerFrameCBVOffset = PerFrameUploadResource->GetGPUVirtualAddress();
-    // Entry 3 data: PerInstance root CBV.
-    UINT8* Instance0PerInstanceCBVOffset = Instance0PerFrameCBVOffset + sizeof(D3D12_GPU_VIRTUAL_ADDRESS);
-    *(D3D12_GPU_VIRTUAL_ADDRESS*)Instance0PerInstanceCBVOffset = PerInstanceUploadResource->GetGPUVirtualAddress();
-
-    // Entry 4: Instance 0 Shadow Closest-hit shader ID.
-    UINT8* Instance0ShadowHitGroupEntry = Instance0HitGroupEntry + TableEntrySize;
-    memcpy(Instance0ShadowHitGroupEntry, HitGroupShadowId, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-
-    // Entry 5: Instance 1 Closest-hit shader ID.
-    UINT8* Instance1HitGroupEntry = Instance0ShadowHitGroupEntry + TableEntrySize;
-    memcpy(Instance1HitGroupEntry, HitGroupId, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-    // Entry 5 data: PerFrame root CBV.
-    UINT8* Instance1PerFrameCBVOffset = Instance1HitGroupEntry + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
-    *(D3D12_GPU_VIRTUAL_ADDRESS*)Instance1PerFrameCBVOffset = PerFrameUploadResource->GetGPUVirtualAddress();
-    // Entry 5 data: PerInstance root CBV.
-    UINT8* Instance1PerInstanceCBVOffset = Instance1PerFrameCBVOffset + sizeof(D3D12_GPU_VIRTUAL_ADDRESS);
-    *(D3D12_GPU_VIRTUAL_ADDRESS*)Instance1PerInstanceCBVOffset = PerInstanceUploadResource->GetGPUVirtualAddress() + sizeof(PerInstanceData);
-
-    // Entry 6: Instance 1 Shadow Closest-hit shader ID.
-    UINT8* Instance1ShadowHitGroupEntry = Instance1HitGroupEntry + TableEntrySize;
-    memcpy(Instance1ShadowHitGroupEntry, HitGroupShadowId, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-
-    // Entry 7: Instance 2 Closest-hit shader ID.
-    UINT8* Instance2HitGroupEntry = Instance1ShadowHitGroupEntry + TableEntrySize;
-    memcpy(Instance2HitGroupEntry, HitGroupId, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-    // Entry 7 data: PerFrame root CBV.
-    UINT8* Instance2PerFrameCBVOffset = Instance2HitGroupEntry + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
-    *(D3D12_GPU_VIRTUAL_ADDRESS*)Instance2PerFrameCBVOffset = PerFrameUploadResource->GetGPUVirtualAddress();
-    // Entry 7 data: PerInstance root CBV.
-    UINT8* Instance2PerInstanceCBVOffset = Instance2PerFrameCBVOffset + sizeof(D3D12_GPU_VIRTUAL_ADDRESS);
-    *(D3D12_GPU_VIRTUAL_ADDRESS*)Instance2PerInstanceCBVOffset = PerInstanceUploadResource->GetGPUVirtualAddress() + sizeof(PerInstanceData) * 2;
-
-    // Entry 8 Instance 2 Shadow Closest-hit shader ID.
-    UINT8* Instance2ShadowHitGroupEntry = Instance2HitGroupEntry + TableEntrySize;
-    memcpy(Instance2ShadowHitGroupEntry, HitGroupShadowId, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-    
-    // Entry 9: Plane hit shader ID.
-    UINT8* PlaneHitGroupEntry = Instance2ShadowHitGroupEntry + TableEntrySize;
-    memcpy(PlaneHitGroupEntry, HitGroupPlaneId, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+    // Hit groups: a primary and a shadow record per triangle instance (InstanceContributionToHitGroupIndex = InstanceId * 2),
+    // then the plane.
+    for (UINT InstanceId = 0; InstanceId < NumTriangleInstances; ++InstanceId)
+    {
+        AddRecord(&TableBuilder, Section::HitGroup, HitGroup,
+                  {GpuAddress(PerFrameConstants),
+                   GpuAddress(PerInstanceConstants + sizeof(PerInstanceData) * InstanceId)});
+        AddRecord(&TableBuilder, Section::HitGroup, HitGroupShadow);
+    }
+    AddRecord(&TableBuilder, Section::HitGroup, HitGroupPlane, {DescriptorTable(RaygenTable.ptr)});
 
-    (*ShaderTable)->Unmap(0, nullptr);
+    return D3D::CreateShaderTable(Device, RaytracingStateObject, TableBuilder, ShaderTable, ShaderTableLayout);
 }
 
 void DXRTutorial::CreateRaygenShaderDescriptors(ID3D12Device10* Device,
-                                                ID3D12DescriptorHeap* CSUHeap,
+                                                const BindlessHeap& Descriptors, UINT FirstIndex,
                                                 ID3D12Resource* TopLevelAS,
                                                 ID3D12Resource* OutputTexture)
 {
@@ -562,7 +403,7 @@ void DXRTutorial::CreateRaygenShaderDescriptors(ID3D12Device10* Device,
     D3D12_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
     UAVDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
 
-    D3D12_CPU_DESCRIPTOR_HANDLE CPUHandle = CSUHeap->GetCPUDescriptorHandleForHeapStart();
+    D3D12_CPU_DESCRIPTOR_HANDLE CPUHandle = D3D::GetCpuHandle(Descriptors, FirstIndex);
     Device->CreateUnorderedAccessView(OutputTexture, nullptr, &UAVDesc, CPUHandle);
 
     // TLAS (SRV).
@@ -571,30 +412,16 @@ void DXRTutorial::CreateRaygenShaderDescriptors(ID3D12Device10* Device,
     TlasSrvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
     TlasSrvDesc.RaytracingAccelerationStructure.Location = TopLevelAS->GetGPUVirtualAddress();
 
-    CPUHandle.ptr += Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    CPUHandle = D3D::GetCpuHandle(Descriptors, FirstIndex + 1);
     Device->CreateShaderResourceView(nullptr, &TlasSrvDesc, CPUHandle);
 }
 
-void DXRTutorial::CreateGPUVisibleCSUHeap(ID3D12Device10* Device,UINT NumDescriptors, ID3D12DescriptorHeap** CSUHeap)
-{
-    // Contains the descriptors for:
-    // 0: The output texture (UAV, RWTexture2D).
-    // 1: The scene representation TLAS (SRV, RaytracingAccelerationStructure).
-    D3D12_DESCRIPTOR_HEAP_DESC CSUHeapDesc = {};
-    CSUHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-    CSUHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-    CSUHeapDesc.NumDescriptors = NumDescriptors;
-    Check(Device->CreateDescriptorHeap(&CSUHeapDesc, IID_PPV_ARGS(CSUHeap)));
-}
-
-void DXRTutorial::CreateClosestHitShaderUploadResources(ID3D12Device10* Device,
-                                                        ID3D12Resource** PerFrameUploadResource,
-                                                        ID3D12Resource** PerInstanceUploadResource)
+void DXRTutorial::CreateClosestHitShaderUploadResources(ID3D12Device10* Device, GpuMemory* Memory,
+                                                        SmallBuffer* PerFrameUploadBuffer,
+                                                        SmallBuffer* PerInstanceUploadBuffer)
 {
     // Create the per-frame constant buffer.
-    D3D::CreateCommittedBuffer(Device, D3D12_HEAP_TYPE_UPLOAD, sizeof(PerFrameData),
-                               PerFrameUploadResource);
-    NAME_D3D12_OBJECT(*PerFrameUploadResource);
+    D3D::AllocateSmallBuffer(Device, Memory, sizeof(PerFrameData), PerFrameUploadBuffer);
 
     PerFrameData PerFrame = {};
     PerFrame.A[0] = XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f);
@@ -609,16 +436,11 @@ void DXRTutorial::CreateClosestHitShaderUploadResources(ID3D12Device10* Device,
     PerFrame.C[1] = XMFLOAT4(1.0f, 1.0f, 0.0f, 1.0f);
     PerFrame.C[2] = XMFLOAT4(0.0f, 1.0f, 1.0f, 1.0f);
 
-    UINT* MappedPerFrameData = nullptr;
-    Check((*PerFrameUploadResource)->Map(0, nullptr, (void**)&MappedPerFrameData));
-    memcpy(MappedPerFrameData, &PerFrame, sizeof(PerFrameData));
-    (*PerFrameUploadResource)->Unmap(0, nullptr);
+    memcpy(PerFrameUploadBuffer->Mapped, &PerFrame, sizeof(PerFrameData));
 
     // Create the per-instance constant buffer.
     size_t PerInstanceDataSize = 3 * sizeof(PerInstanceData);
-    D3D::CreateCommittedBuffer(Device, D3D12_HEAP_TYPE_UPLOAD, PerInstanceDataSize,
-                               PerInstanceUploadResource);
-    NAME_D3D12_OBJECT(*PerInstanceUploadResource);
+    D3D::AllocateSmallBuffer(Device, Memory, PerInstanceDataSize, PerInstanceUploadBuffer);
 
     PerInstanceData PerInstance[3] = {};
     PerInstance[0].A = XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f);
@@ -633,87 +455,239 @@ void DXRTutorial::CreateClosestHitShaderUploadResources(ID3D12Device10* Device,
     PerInstance[2].B = XMFLOAT4(0.0f, 0.0f, 1.0f, 0.0f);
     PerInstance[2].C = XMFLOAT4(0.0f, 0.0f, 1.0f, 0.0f);
 
-    UINT* MappedPerInstanceData = nullptr;
-    Check((*PerInstanceUploadResource)->Map(0, nullptr, (void**)&MappedPerInstanceData));
-    memcpy(MappedPerInstanceData, &PerInstance, PerInstanceDataSize);
-    (*PerInstanceUploadResource)->Unmap(0, nullptr);
+    memcpy(PerInstanceUploadBuffer->Mapped, &PerInstance, PerInstanceDataSize);
 }
 
-void DXRTutorial::CreateInstanceDescriptions(ID3D12Device10* Device, BottomLevelASInfo* BottomLevelInfos, UINT NumInstances,
-                                             ID3D12Resource** InstanceDescs)
+// One instance at a time with DirectXMath, the per-instance path RunInstanceDescBenchmark writes with.
+static void GetTriangleInstanceDesc(UINT InstanceId, D3D12_GPU_VIRTUAL_ADDRESS BottomLevel, float Rotation,
+                                    D3D12_RAYTRACING_INSTANCE_DESC* InstanceDesc)
 {
-    D3D::CreateCommittedBuffer(Device, D3D12_HEAP_TYPE_UPLOAD,
-                               sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * NumInstances,
-                               InstanceDescs,
-                               D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_FLAG_NONE);
-
-    D3D12_RAYTRACING_INSTANCE_DESC* InstanceDesc;
-    Check((*InstanceDescs)->Map(0, nullptr, (void**)&InstanceDesc));
-
-    // Triangle instance descriptions.
-    for (UINT InstanceId = 0; InstanceId < BottomLevelInfos[0].NumInstances; ++InstanceId)
-    {
-        InstanceDesc[InstanceId].Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
-        // All instances use the same BLAS. They're all triangles with the same vertex buffers.
-        InstanceDesc[InstanceId].AccelerationStructure = BottomLevelInfos[0].BottomLevel->GetGPUVirtualAddress();
-        InstanceDesc[InstanceId].InstanceID = InstanceId;
-        // This value will be exposed to the shader via InstanceID().
-        InstanceDesc[InstanceId].InstanceMask = 0xFF; // Include all instances.
-        // Same contribution to hit-group index, because we don't have per-instance hit-group data.
-        InstanceDesc[InstanceId].InstanceContributionToHitGroupIndex = InstanceId * 2;
-
-        float XOffset = (float)InstanceId;
-        XMMATRIX T = XMMatrixTranslation(XOffset * 2.f, 0.f, 0.f);
-        XMMATRIX S = XMMatrixScaling(0.2f, 0.5f, 0.5f);
-        XMFLOAT3X4 StoredT;
-        XMStoreFloat3x4(&StoredT, XMMatrixIdentity() * T * S);
-        memcpy(InstanceDesc[InstanceId].Transform, &StoredT, sizeof(StoredT));
-    }
-
-    // Plane instance descriptions.
-    InstanceDesc[3].Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
+    InstanceDesc->Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
     // All instances use the same BLAS. They're all triangles with the same vertex buffers.
-    InstanceDesc[3].AccelerationStructure = BottomLevelInfos[1].BottomLevel->GetGPUVirtualAddress();
-    InstanceDesc[3].InstanceID = 0;
+    InstanceDesc->AccelerationStructure = BottomLevel;
+    InstanceDesc->InstanceID = InstanceId;
     // This value will be exposed to the shader via InstanceID().
-    InstanceDesc[3].InstanceMask = 0xFF; // Include all instances.
-    // Same contribution to hit-group index, because we don't have per-instance hit-group data.
-    InstanceDesc[3].InstanceContributionToHitGroupIndex = BottomLevelInfos[0].NumInstances * 2;
+    InstanceDesc->InstanceMask = 0xFF; // Include all instances.
     // 2: There's 2 hit shaders per triangle instance.
+    InstanceDesc->InstanceContributionToHitGroupIndex = InstanceId * 2;
+
+    float XOffset = (float)InstanceId;
+    XMMATRIX T = XMMatrixTranslation(XOffset * 2.f, 0.f, 0.f);
+    XMMATRIX S = XMMatrixScaling(0.2f, 0.5f, 0.5f);
+    XMMATRIX R = XMMatrixRotationY((Rotation * (float)(InstanceId)));
+    XMFLOAT3X4 StoredT;
+    XMStoreFloat3x4(&StoredT, XMMatrixIdentity() * R * T * S);
+    memcpy(InstanceDesc->Transform, &StoredT, sizeof(StoredT));
+}
+
+static void GetPlaneInstanceDesc(UINT NumTriangleInstances, D3D12_GPU_VIRTUAL_ADDRESS BottomLevel,
+                                 D3D12_RAYTRACING_INSTANCE_DESC* InstanceDesc)
+{
+    InstanceDesc->Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
+    InstanceDesc->AccelerationStructure = BottomLevel;
+    InstanceDesc->InstanceID = 0;
+    InstanceDesc->InstanceMask = 0xFF; // Include all instances.
+    // The plane's hit groups come after the triangles'.
+    InstanceDesc->InstanceContributionToHitGroupIndex = NumTriangleInstances * 2;
 
-    float XOffset = (float)0;
-    XMMATRIX T = XMMatrixTranslation(XOffset, 0.f, 0.f);
     XMFLOAT3X4 StoredT;
-    XMStoreFloat3x4(&StoredT, XMMatrixIdentity() * T);
-    memcpy(InstanceDesc[3].Transform, &StoredT, sizeof(StoredT));
+    XMStoreFloat3x4(&StoredT, XMMatrixIdentity());
+    memcpy(InstanceDesc->Transform, &StoredT, sizeof(StoredT));
+}
+
+void DXRTutorial::CreateInstanceDescriptions(ID3D12Device10* Device, GpuMemory* Memory,
+                                             BottomLevelASInfo* BottomLevelInfos, UINT NumInstances,
+                                             InstanceTransforms::Instances* TriangleInstances,
+                                             InstanceDescRing* InstanceDescs)
+{
+    D3D::CreateInstanceDescRing(Device, Memory, NumInstances, InstanceDescs);
+
+    // Triangles are spread along X, squashed, and spin around Y in UpdateInstanceDescriptions.
+    UINT NumTriangleInstances = BottomLevelInfos[0].NumInstances;
+    InstanceTransforms::Resize(TriangleInstances, NumTriangleInstances);
+    for (UINT InstanceId = 0; InstanceId < NumTriangleInstances; ++InstanceId)
+    {
+        TriangleInstances->PositionX[InstanceId] = 0.4f * (float)InstanceId;
+        TriangleInstances->ScaleX[InstanceId] = 0.2f;
+        TriangleInstances->ScaleY[InstanceId] = 0.5f;
+        TriangleInstances->ScaleZ[InstanceId] = 0.5f;
+        // InstanceID() in the shaders. 2: There's 2 hit shaders per triangle instance.
+        TriangleInstances->Tails[InstanceId] = InstanceTransforms::MakeTail(InstanceId, 0xFF, InstanceId * 2,
+                                                                            D3D12_RAYTRACING_INSTANCE_FLAG_NONE,
+                                                                            BottomLevelInfos[0].Address);
+    }
 
-    (*InstanceDescs)->Unmap(0, nullptr);
+    // Every buffer starts with the same descriptions, the TLAS is built from the first one.
+    for (UINT i = 0; i < InstanceDescRing::NumBuffers; ++i)
+    {
+        D3D12_RAYTRACING_INSTANCE_DESC* InstanceDesc = InstanceDescs->MappedDescs[i];
+        InstanceTransforms::Write(*TriangleInstances, 0, NumTriangleInstances,
+                                  (InstanceTransforms::InstanceDesc*)InstanceDesc);
+        GetPlaneInstanceDesc(NumTriangleInstances, BottomLevelInfos[1].Address, &InstanceDesc[NumTriangleInstances]);
+    }
 }
 
-void DXRTutorial::UpdateInstanceDescriptions(ID3D12Resource* InstanceDescs, BottomLevelASInfo* TriangleBottomLevelInfo, float Rotation)
+UINT DXRTutorial::UpdateInstanceDescriptions(TutorialData* DXRData, D3D12_RAYTRACING_INSTANCE_DESC* InstanceDescs)
 {
-    D3D12_RAYTRACING_INSTANCE_DESC* InstanceDesc;
-    Check(InstanceDescs->Map(0, nullptr, (void**)&InstanceDesc));
+    BottomLevelASInfo* TriangleBottomLevelInfo = &DXRData->BottomLevelInfos[0];
+    BottomLevelASInfo* PlaneBottomLevelInfo = &DXRData->BottomLevelInfos[1];
+    InstanceTransforms::Instances* TriangleInstances = &DXRData->TriangleInstances;
+    FrustumCulling::Bounds* TriangleBounds = &DXRData->TriangleBounds;
+    UINT* VisibleTriangles = DXRData->VisibleTriangles.data();
+    UINT NumTriangleInstances = TriangleBottomLevelInfo->NumInstances;
+
+    // The shader's camera has no aspect ratio: both axes span [-1, 1].
+    XMFLOAT4X4 ViewProjection;
+    XMStoreFloat4x4(&ViewProjection, DXRData->Camera.GetViewMatrix() *
+                                     DXRData->Camera.GetProjectionMatrix(XM_PIDIV2, 1.f, 0.01f, 10000.f));
+
+    // The occluders only depend on the camera, they are rasterized on the job system while the instances are being
+    // transformed.
+    JobSystem::Counter OcclusionDepthReady;
+    if (DXRData->OccludeInstances)
+    {
+        JobSystem::Spawn([DXRData, ViewProjection]()
+        {
+            OcclusionCulling::Render(DXRData->Occluders, XMLoadFloat4x4(&ViewProjection), &DXRData->OcclusionDepth,
+                                     DXRData->CullingSettings.NumThreads);
+        }, &OcclusionDepthReady);
+    }
+
+    // Each triangle spins at its own speed. Their BLAS moves when compacted.
+    // Bounds come from the inputs, reading the write-combined descriptions back would be slow.
+    for (UINT InstanceId = 0; InstanceId < NumTriangleInstances; ++InstanceId)
+    {
+        float HalfAngle = 0.5f * DXRData->Rotation * (float)InstanceId;
+        TriangleInstances->RotationY[InstanceId] = sinf(HalfAngle);
+        TriangleInstances->RotationW[InstanceId] = cosf(HalfAngle);
+        TriangleInstances->Tails[InstanceId].AccelerationStructure = TriangleBottomLevelInfo->Address;
+        InstanceTransforms::SetInstanceMask(&TriangleInstances->Tails[InstanceId], FrustumCulling::VisibleInstanceMask);
+
+        float Transform[3][4];
+        InstanceTransforms::GetTransform(*TriangleInstances, InstanceId, Transform);
+        Bvh::AABB Box = TopLevelPolicy::TransformBounds(TriangleBottomLevelInfo->Bounds, Transform);
+        FrustumCulling::SetBounds(TriangleBounds, InstanceId, Box.Min, Box.Max);
+        VisibleTriangles[InstanceId] = InstanceId;
+    }
+
+    UINT NumVisible = NumTriangleInstances;
+    if (DXRData->CullInstances)
+    {
+        FrustumCulling::Frustum CameraFrustum;
+        FrustumCulling::ExtractFrustum(XMLoadFloat4x4(&ViewProjection), &CameraFrustum);
+        NumVisible = FrustumCulling::Cull(CameraFrustum, *TriangleBounds, NumTriangleInstances, VisibleTriangles,
+                                          DXRData->CullingSettings.NumThreads);
+    }
+    if (DXRData->OccludeInstances)
+    {
+        JobSystem::Wait(&OcclusionDepthReady);
+        NumVisible = OcclusionCulling::Cull(DXRData->OcclusionDepth, *TriangleBounds, VisibleTriangles, NumVisible,
+                                            VisibleTriangles, DXRData->CullingSettings.NumThreads);
+    }
+
+    // InstanceDescs is write-combined, both paths stream whole descriptions out.
+    UINT NumTriangleDescs = NumVisible;
+    if ((DXRData->CullInstances || DXRData->OccludeInstances) && DXRData->CullingSettings.KeepCulled)
+    {
+        // Shadow rays still see the culled triangles, camera rays skip them by mask.
+        for (UINT InstanceId = 0; InstanceId < NumTriangleInstances; ++InstanceId)
+        {
+            InstanceTransforms::SetInstanceMask(&TriangleInstances->Tails[InstanceId], FrustumCulling::CulledInstanceMask);
+        }
+        for (UINT i = 0; i < NumVisible; ++i)
+        {
+            InstanceTransforms::SetInstanceMask(&TriangleInstances->Tails[VisibleTriangles[i]],
+                                                FrustumCulling::VisibleInstanceMask);
+        }
+        for (UINT InstanceId = 0; InstanceId < NumTriangleInstances; ++InstanceId)
+        {
+            VisibleTriangles[InstanceId] = InstanceId;
+        }
+        NumTriangleDescs = NumTriangleInstances;
+    }
+    InstanceTransforms::WriteIndexed(*TriangleInstances, VisibleTriangles, NumTriangleDescs,
+                                     (InstanceTransforms::InstanceDesc*)InstanceDescs);
+
+    for (UINT i = 0; i < NumTriangleDescs; ++i)
+    {
+        UINT InstanceId = VisibleTriangles[i];
+        DXRData->InstanceBounds[i].Min = XMFLOAT3(TriangleBounds->MinX[InstanceId], TriangleBounds->MinY[InstanceId],
+                                                  TriangleBounds->MinZ[InstanceId]);
+        DXRData->InstanceBounds[i].Max = XMFLOAT3(TriangleBounds->MaxX[InstanceId], TriangleBounds->MaxY[InstanceId],
+                                                  TriangleBounds->MaxZ[InstanceId]);
+    }
 
-    // Update the triangle instance descriptions.
-    for (UINT InstanceId = 0; InstanceId < TriangleBottomLevelInfo->NumInstances; ++InstanceId)
+    // The plane doesn't move and is never culled, but its BLAS moves when compacted.
+    D3D12_RAYTRACING_INSTANCE_DESC InstanceDesc;
+    GetPlaneInstanceDesc(NumTriangleInstances, PlaneBottomLevelInfo->Address, &InstanceDesc);
+    StreamInstanceDesc(&InstanceDescs[NumTriangleDescs], InstanceDesc);
+    DXRData->InstanceBounds[NumTriangleDescs] = PlaneBottomLevelInfo->Bounds;
+
+    return NumTriangleDescs + 1;
+}
+
+void DXRTutorial::RunInstanceDescBenchmark(ID3D12Device10* Device, GpuMemory* Memory, UINT NumInstances, UINT NumFrames)
+{
+    InstanceDescRing Ring;
+    D3D::CreateInstanceDescRing(Device, Memory, NumInstances, &Ring);
+    std::vector<D3D12_RAYTRACING_INSTANCE_DESC> CachedDescs(NumInstances);
+
+    // The GPU never reads the ring, each frame retires itself on the CPU so BeginInstanceDescs never waits.
+    ComPtr<ID3D12Fence> Fence;
+    Check(Device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&Fence)));
+    UINT64 FenceValue = 0;
+
+    // Cached memory is the baseline, the others write to an upload heap.
+    const char* Names[4] = {"cached memory", "map every frame", "persistently mapped", "persistently mapped + streaming"};
+    for (UINT Variant = 0; Variant < _countof(Names); ++Variant)
     {
-        InstanceDesc[InstanceId].Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
-
-        // All instances use the same BLAS. They're all triangles with the same vertex buffers.
-        InstanceDesc[InstanceId].AccelerationStructure = TriangleBottomLevelInfo->BottomLevel->GetGPUVirtualAddress();
-        InstanceDesc[InstanceId].InstanceID = InstanceId;
-        // This value will be exposed to the shader via InstanceID().
-        InstanceDesc[InstanceId].InstanceMask = 0xFF; // Include all instances.
-        // Same contribution to hit-group index, because we don't have per-instance hit-group data.
-        InstanceDesc[InstanceId].InstanceContributionToHitGroupIndex = InstanceId * 2;
-
-        float XOffset = (float)InstanceId;
-        XMMATRIX T = XMMatrixTranslation(XOffset * 2.f, 0.f, 0.f);
-        XMMATRIX S = XMMatrixScaling(0.2f, 0.5f, 0.5f);
-        XMMATRIX R = XMMatrixRotationY((Rotation * (float)(InstanceId)));
-        XMFLOAT3X4 StoredT;
-        XMStoreFloat3x4(&StoredT, XMMatrixIdentity() * R * T * S);
-        memcpy(InstanceDesc[InstanceId].Transform, &StoredT, sizeof(StoredT));
+        auto Start = std::chrono::high_resolution_clock::now();
+        for (UINT Frame = 1; Frame <= NumFrames; ++Frame)
+        {
+            D3D12_RAYTRACING_INSTANCE_DESC* InstanceDescs = CachedDescs.data();
+            if (Variant == 1)
+            {
+                Check(Ring.Buffers[0]->Map(0, nullptr, (void**)&InstanceDescs));
+            }
+            else if (Variant > 1)
+            {
+                InstanceDescs = D3D::BeginInstanceDescs(&Ring, ++FenceValue, Fence.Get(), nullptr);
+            }
+
+            float Rotation = (float)Frame * 0.005f;
+            D3D12_RAYTRACING_INSTANCE_DESC InstanceDesc;
+            for (UINT InstanceId = 0; InstanceId < NumInstances; ++InstanceId)
+            {
+                if (Variant == 3)
+                {
+                    GetTriangleInstanceDesc(InstanceId, 0, Rotation, &InstanceDesc);
+                    StreamInstanceDesc(&InstanceDescs[InstanceId], InstanceDesc);
+                }
+                else
+                {
+                    GetTriangleInstanceDesc(InstanceId, 0, Rotation, &InstanceDescs[InstanceId]);
+                }
+            }
+
+            if (Variant == 1)
+            {
+                Ring.Buffers[0]->Unmap(0, nullptr);
+            }
+            else if (Variant > 1)
+            {
+                D3D::EndInstanceDescs(&Ring);
+                Check(Fence->Signal(FenceValue));
+            }
+        }
+        auto End = std::chrono::high_resolution_clock::now();
+
+        char Message[256];
+        snprintf(Message, sizeof(Message), "Instance descriptions: %u instances, %s: %.3f ms/frame\n",
+                 NumInstances, Names[Variant],
+                 std::chrono::duration<double, std::milli>(End - Start).count() / NumFrames);
+        OutputDebugStringA(Message);
     }
+
+    // The GPU never saw the ring.
+    D3D::DestroyInstanceDescRing(&Ring);
 }
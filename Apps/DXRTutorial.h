@@ -1,5 +1,6 @@
 ﻿#pragma once
 #include "../Headers/Gpu.h"
+#include "SimpleCamera.h"
 
 namespace DXRTutorial
 {
@@ -12,6 +13,9 @@ namespace DXRTutorial
     static const wchar_t* HitGroupShadow = L"HitGroupShadow";
     static const wchar_t* ShadowClosestHitEntry = L"ShadowClosestHitMain";
     static const wchar_t* ShadowMissEntry = L"ShadowMissMain";
+
+    static const UINT64 BottomLevelScratchBudget = 32 * 1024 * 1024;
+    static const UINT OcclusionDepthSize = 128; // Square like the shader's camera.
     
     struct Vertex
     {
@@ -37,68 +41,108 @@ namespace DXRTutorial
         BottomLevelASInfo BottomLevelInfos[2];
         float Rotation = 0;
         
+        // Default heap, streamed on the copy queue. Both are ready once GeometryUploads is.
         ComPtr<ID3D12Resource> TriangleVertexBuffer;
         ComPtr<ID3D12Resource> PlaneVertexBuffer;
-        ComPtr<ID3D12Resource> TriangleBottomLevelAS;
-        ComPtr<ID3D12Resource> PlaneBottomLevelAS;
+        StreamingUploads::Ticket GeometryUploads = 0;
         ComPtr<ID3D12Resource> TopLevelAS;
-        ComPtr<ID3D12Resource> InstanceDescs;
+        InstanceDescRing InstanceDescs;
+        InstanceTransforms::Instances TriangleInstances;
+
+        // Optional: only the triangles in the camera's frustum go into the TLAS.
+        bool CullInstances = false;
+        FrustumCulling::Settings CullingSettings;
+        SimpleCamera Camera; // Where SimpleDXR.hlsl's camera rays start.
+        FrustumCulling::Bounds TriangleBounds;
+        std::vector<UINT> VisibleTriangles;
+
+        // Optional: neither do the triangles hidden behind the ground plane, rasterized on the CPU.
+        bool OccludeInstances = false;
+        OcclusionCulling::Occluders Occluders;
+        OcclusionCulling::DepthPyramid OcclusionDepth;
+
+        // Opt-in: copy the BLASes into right-sized buffers once their compacted size is known.
+        bool CompactBottomLevels = true;
+        BottomLevelCompactionData Compaction;
+
+        // Decides between updating and rebuilding the TLAS from the world-space instance bounds.
+        TopLevelPolicy::State TopLevelState;
+        std::vector<Bvh::AABB> InstanceBounds;
 
+        RtPipeline::Desc PipelineDesc;
         ComPtr<ID3D12StateObject> RaytracingStateObject;
 
         // Temp buffers.
-        ComPtr<ID3D12Resource> TriangleBottomLevelASScratch;
-        ComPtr<ID3D12Resource> PlaneBottomLevelASScratch;
+        ComPtr<ID3D12Resource> BottomLevelScratch; // Shared by the BLAS build batches, released once they completed.
+        PlacedAllocation BottomLevelScratchRange;
         ComPtr<ID3D12Resource> TopLevelASScratch;
 
         // Shaders and bindings.
         Shader RtShader;
-        ComPtr<ID3D12DescriptorHeap> CSUHeap;
+        DescriptorAllocator::Handle RaygenDescriptors = DescriptorAllocator::InvalidHandle; // Output texture + TLAS.
         ComPtr<ID3D12RootSignature> EmptyGlobalRootsig;
         ComPtr<ID3D12RootSignature> RaygenShadersLocalRootsig;
         ComPtr<ID3D12RootSignature> MissEmptyLocalRootsig;
         ComPtr<ID3D12RootSignature> ClosestHitLocalRootsig;
-        UINT64 ShaderTableEntrySize;
+        ShaderBindingTable::Layout ShaderTableLayout;
         ComPtr<ID3D12Resource> ShaderTable;
-        ComPtr<ID3D12Resource> PerFrameUploadResource;
-        ComPtr<ID3D12Resource> PerInstanceUploadResource;
+        SmallBuffer PerFrameUploadBuffer;
+        SmallBuffer PerInstanceUploadBuffer;
     };
 
-    void UpdateAndRender(TutorialData& DXRData,
+    void UpdateAndRender(ID3D12Device10* Device,
+                         TutorialData& DXRData,
                          Frame* CurrentFrame,
                          ID3D12GraphicsCommandList7* CmdList,
+                         BindlessHeap* Descriptors,
                          ID3D12Resource* OutTexture,
-                         UINT Width, UINT Height);
-    void InitializeAccelerationStructures(ID3D12Device10* Device, ID3D12GraphicsCommandList7* CmdList, TutorialData* DXRData);
-    void InitializeShaderBindings(ID3D12Device10* Device, TutorialData* DXRData, ID3D12Resource* OutputTexture);
-    void CreateBottomLevel(ID3D12Device10* Device, ID3D12GraphicsCommandList7* CmdList, ID3D12Resource* VB, UINT VertexCount,
-                           ID3D12Resource** BottomLevelASScratch, ID3D12Resource** BottomLevelAS);
+                         UINT Width, UINT Height,
+                         ID3D12Fence* Fence, HANDLE FenceEvent);
+    // Queues the vertex buffers on the copy queue. Build the acceleration structures once GeometryUploads has a sync
+    // point, the builds have to wait on it.
+    void StreamGeometry(ID3D12Device10* Device, TutorialData* DXRData, GpuMemory* Memory,
+                        StreamingUploadBuffer* Streaming);
+    void InitializeAccelerationStructures(ID3D12Device10* Device, ID3D12GraphicsCommandList7* CmdList,
+                                          ResourceStates::Tracker* Tracker, TutorialData* DXRData,
+                                          GpuMemory* Memory, UINT64 BuildFenceValue);
+    void InitializeShaderBindings(ID3D12Device10* Device, TutorialData* DXRData, GpuMemory* Memory,
+                                  BindlessHeap* Descriptors, ID3D12Resource* OutputTexture);
+    bool CreatePipeline(ID3D12Device10* Device, const TutorialData& DXRData, const BindlessHeap& Descriptors,
+                        Shader* Program, RtPipeline::Desc* PipelineDesc,
+                        ID3D12StateObject** RaytracingStateObject,
+                        ID3D12Resource** ShaderTable, ShaderBindingTable::Layout* ShaderTableLayout);
+    void GetBottomLevelInputs(D3D12_GPU_VIRTUAL_ADDRESS VertexBuffer, UINT VertexCount,
+                              D3D12_RAYTRACING_GEOMETRY_DESC* GeometryDesc,
+                              D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS* ASInputs);
     void CreateRootSignatures(ID3D12Device10* Device,
                               ID3D12RootSignature** RaygenShadersLocalRootsig,
                               ID3D12RootSignature** ClosestHitLocalRootsig,
                               ID3D12RootSignature** MissEmptyLocalRootsig,
                               ID3D12RootSignature** EmptyGlobalRootsig);
-    void CreateRtStateObject(ID3D12Device10* Device, Shader* Program,
+    bool CreateRtStateObject(ID3D12Device10* Device, Shader* Program,
                              ID3D12RootSignature* RaygenShadersLocalRootsig,
                              ID3D12RootSignature* ClosestHitLocalRootsig,
                              ID3D12RootSignature* MissEmptyLocalRootsig,
                              ID3D12RootSignature* EmptyGlobalRootsig,
+                             RtPipeline::Desc* PipelineDesc,
                              ID3D12StateObject** RaytracingStateObject);
-    void CreateShaderTable(ID3D12Device10* Device,
-                           ID3D12StateObject* RaytracingStateObject, ID3D12DescriptorHeap* CSUHeap,
-                           ID3D12Resource* PerFrameUploadResource, ID3D12Resource* PerInstanceUploadResource,
-                           ID3D12Resource** ShaderTable, UINT64* ShaderTableEntrySize);
+    bool CreateShaderTable(ID3D12Device10* Device,
+                           ID3D12StateObject* RaytracingStateObject,
+                           D3D12_GPU_DESCRIPTOR_HANDLE RaygenTable,
+                           D3D12_GPU_VIRTUAL_ADDRESS PerFrameConstants,
+                           D3D12_GPU_VIRTUAL_ADDRESS PerInstanceConstants,
+                           UINT NumTriangleInstances,
+                           ID3D12Resource** ShaderTable, ShaderBindingTable::Layout* ShaderTableLayout);
     void CreateRaygenShaderDescriptors(ID3D12Device10* Device,
-                                       ID3D12DescriptorHeap* CSUHeap,
+                                       const BindlessHeap& Descriptors, UINT FirstIndex,
                                        ID3D12Resource* TopLevelAS,
                                        ID3D12Resource* OutputTexture);
-    void CreateGPUVisibleCSUHeap(ID3D12Device10* Device, UINT NumDescriptors,
-                                 ID3D12DescriptorHeap** CSUHeap);
-    void CreateClosestHitShaderUploadResources(ID3D12Device10* Device,
-                                               ID3D12Resource** PerFrameUploadResource,
-                                               ID3D12Resource** PerInstanceUploadResource);
-    void CreateInstanceDescriptions(ID3D12Device10* Device, BottomLevelASInfo* BottomLevelInfos, UINT NumInstances,
-                                    ID3D12Resource** InstanceDescs);
-    void UpdateInstanceDescriptions(ID3D12Resource* InstanceDescs, BottomLevelASInfo* TriangleBottomLevelInfo,
-                                    float Rotation);
+    void CreateClosestHitShaderUploadResources(ID3D12Device10* Device, GpuMemory* Memory,
+                                               SmallBuffer* PerFrameUploadBuffer,
+                                               SmallBuffer* PerInstanceUploadBuffer);
+    void CreateInstanceDescriptions(ID3D12Device10* Device, GpuMemory* Memory,
+                                    BottomLevelASInfo* BottomLevelInfos, UINT NumInstances,
+                                    InstanceTransforms::Instances* TriangleInstances, InstanceDescRing* InstanceDescs);
+    UINT UpdateInstanceDescriptions(TutorialData* DXRData, D3D12_RAYTRACING_INSTANCE_DESC* InstanceDescs);
+    void RunInstanceDescBenchmark(ID3D12Device10* Device, GpuMemory* Memory, UINT NumInstances, UINT NumFrames);
 }
@@ -4,10 +4,12 @@ using namespace DirectX;
 
 void HelloBindless::UpdateAndRender(HelloBindlessData& Data,
                                          ID3D12GraphicsCommandList7* CmdList,
+                                         BindlessHeap* Descriptors,
                                          INT Width, INT Height)
 {
-    CmdList->SetDescriptorHeaps(1, Data.CSUHeap.GetAddressOf());
+    CmdList->SetDescriptorHeaps(1, Descriptors->Heap.GetAddressOf());
     CmdList->SetComputeRootSignature(Data.RootSig.Get());
+    CmdList->SetComputeRoot32BitConstant(0, DescriptorAllocator::GetIndex(Data.OutputUAV), 0);
     CmdList->SetPipelineState(Data.PSO.Get());
     CmdList->Dispatch(1,1,1);
 }
@@ -8,13 +8,10 @@ namespace HelloBindless
         Shader BindlessShader;
         ComPtr<ID3D12RootSignature> RootSig;
         ComPtr<ID3D12PipelineState> PSO;
-        ComPtr<ID3D12DescriptorHeap> CSUHeap;
-
-        // Synchronization.
-        ComPtr<ID3D12Fence> Fence;
-        HANDLE FenceEvent;
-        UINT64 FenceValue;
+        DescriptorAllocator::Handle OutputUAV = DescriptorAllocator::InvalidHandle;
+        RenderGraphResources Graph;
     };
 
-    void UpdateAndRender(HelloBindlessData& Data, ID3D12GraphicsCommandList7* CmdList, INT Width, INT Height);
+    void UpdateAndRender(HelloBindlessData& Data, ID3D12GraphicsCommandList7* CmdList, BindlessHeap* Descriptors,
+                         INT Width, INT Height);
 }
@@ -2,9 +2,11 @@
 
 using namespace DirectX;
 
-void MSExperiments::UpdateAndRender(MSExperimentsData& Data,
+void MSExperiments::UpdateAndRender(ID3D12Device10* Device,
+                                     MSExperimentsData& Data,
                                      Frame* CurrentFrame,
-                                     ID3D12GraphicsCommandList7* CmdList,
+                                     CommandListPools* RecordingLists,
+                                     UploadRingBuffer* FrameUploads,
                                      INT Width, INT Height)
 {
     // Time.
@@ -22,32 +24,53 @@ void MSExperiments::UpdateAndRender(MSExperimentsData& Data,
     XMMATRIX World = XMMatrixIdentity();
     XMMATRIX XRotation = XMMatrixRotationX(SinWave);
     XMMATRIX YTranslation = XMMatrixTranslation(0.f, 5.f, 0.f);
-    XMStoreFloat4x4(&Data.SceneConstants->View, XMMatrixTranspose(View));
-    XMStoreFloat4x4(&Data.SceneConstants->ViewProjection, XMMatrixTranspose(View * Projection));
-    XMStoreFloat4x4(&Data.SceneConstants->Model, XMMatrixTranspose(World * XRotation * YTranslation));
-    Data.SceneConstants->CameraPosition = Data.Camera.Position;
+    Constants SceneConstants = {};
+    XMStoreFloat4x4(&SceneConstants.View, XMMatrixTranspose(View));
+    XMStoreFloat4x4(&SceneConstants.ViewProjection, XMMatrixTranspose(View * Projection));
+    XMStoreFloat4x4(&SceneConstants.Model, XMMatrixTranspose(World * XRotation * YTranslation));
+    SceneConstants.CameraPosition = Data.Camera.Position;
 
     // Color.
-    Data.SceneConstants->TestColor = XMFLOAT3(0.f, 0.f, SinWave);
-    
-    // Render.
-    D3D::Transition(CmdList,
-                    D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET,
-                    CurrentFrame->BackBuffer.Get());
+    SceneConstants.TestColor = XMFLOAT3(0.f, 0.f, SinWave);
+
+    // This frame's copy, the previous frames' ones may still be read by the GPU. When the ring is full the frame
+    // is only cleared.
+    UploadAllocation SceneConstantsUpload;
+    bool Allocated = D3D::AllocateUpload(FrameUploads, sizeof(Constants),
+                                         D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, &SceneConstantsUpload);
+    if (Allocated)
+    {
+        memcpy(SceneConstantsUpload.Mapped, &SceneConstants, sizeof(Constants));
+    }
+
+    // The back buffer's first use resolves to a barrier before the recorded lists, its last goes on the frame's
+    // list after them.
+    ResourceStates::Transition(&CurrentFrame->GraphicsStates, CurrentFrame->BackBuffer.Get(),
+                               D3D12_RESOURCE_STATE_RENDER_TARGET);
     D3D12_VIEWPORT Viewport = {0.f, 0.f, (float)Width, (float)Height, D3D12_MIN_DEPTH, D3D12_MAX_DEPTH};
     D3D12_RECT ScissorRect = {0, 0, Width, Height};
 
-    CmdList->SetDescriptorHeaps(1, Data.CSUHeap.GetAddressOf());
-    CmdList->SetGraphicsRootSignature(Data.RootSig.Get());
-    CmdList->SetPipelineState(Data.CubeInstancingPSO.Get());
-    CmdList->ClearRenderTargetView(CurrentFrame->RTVHandle, DirectX::Colors::Black, 1, &ScissorRect);
-    CmdList->OMSetRenderTargets(1, &CurrentFrame->RTVHandle, FALSE, &CurrentFrame->DSVHandle);
-    CmdList->ClearDepthStencilView(CurrentFrame->DSVHandle, D3D12_CLEAR_FLAG_DEPTH, 1.f, 0, 0, nullptr);
-    CmdList->RSSetViewports(1, &Viewport);
-    CmdList->RSSetScissorRects(1, &ScissorRect);
-    CmdList->DispatchMesh(1, 1, 1);
-
-    D3D::Transition(CmdList,
-                    D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT,
-                    CurrentFrame->BackBuffer.Get());
+    // Render: the clear, then the draw.
+    UINT Costs[2] = {1, 1};
+    UINT NumPasses = Allocated ? 2 : 1;
+    D3D::RecordParallel(Device, RecordingLists, CurrentFrame, Costs, NumPasses, Data.NumRecordingThreads, 1,
+                        [&](ID3D12GraphicsCommandList7* CmdList, UINT Pass)
+    {
+        CmdList->OMSetRenderTargets(1, &CurrentFrame->RTVHandle, FALSE, &CurrentFrame->DSVHandle);
+        if (Pass == 0)
+        {
+            CmdList->ClearRenderTargetView(CurrentFrame->RTVHandle, DirectX::Colors::Black, 1, &ScissorRect);
+            CmdList->ClearDepthStencilView(CurrentFrame->DSVHandle, D3D12_CLEAR_FLAG_DEPTH, 1.f, 0, 0, nullptr);
+            return;
+        }
+        CmdList->SetGraphicsRootSignature(Data.RootSig.Get());
+        CmdList->SetGraphicsRootConstantBufferView(0, SceneConstantsUpload.Address);
+        CmdList->SetPipelineState(Data.CubeInstancingPSO.Get());
+        CmdList->RSSetViewports(1, &Viewport);
+        CmdList->RSSetScissorRects(1, &ScissorRect);
+        CmdList->DispatchMesh(1, 1, 1);
+    });
+
+    ResourceStates::Transition(&CurrentFrame->GraphicsStates, CurrentFrame->BackBuffer.Get(),
+                               D3D12_RESOURCE_STATE_PRESENT);
 }
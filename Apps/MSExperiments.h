@@ -13,13 +13,13 @@ namespace MSExperiments
         Shader SimplePS;
         ComPtr<ID3D12RootSignature> RootSig;
         ComPtr<ID3D12PipelineState> CubeInstancingPSO;
-        ComPtr<ID3D12DescriptorHeap> CSUHeap;
-        Constants* SceneConstants;
-        ComPtr<ID3D12Resource> SceneConstantsBuffer;
+        UINT NumRecordingThreads = 1;
     };
 
-    void UpdateAndRender(MSExperimentsData& Data,
+    void UpdateAndRender(ID3D12Device10* Device,
+                         MSExperimentsData& Data,
                          Frame* CurrentFrame,
-                         ID3D12GraphicsCommandList7* CmdList,
+                         CommandListPools* RecordingLists,
+                         UploadRingBuffer* FrameUploads,
                          INT Width, INT Height);
 }
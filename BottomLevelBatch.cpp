@@ -0,0 +1,122 @@
+#include "Headers/BottomLevelBatch.h"
+#include <algorithm>
+#include <chrono>
+#include <queue>
+
+namespace BottomLevelBatch
+{
+    void PlanBuilds(const UINT64* ScratchSizes, UINT NumBuilds, UINT64 ScratchBudget, Plan* OutPlan)
+    {
+        OutPlan->Order.resize(NumBuilds);
+        OutPlan->ScratchOffsets.assign(NumBuilds, 0);
+        OutPlan->Batches.clear();
+        OutPlan->ScratchSize = 0;
+        OutPlan->TotalScratchSize = 0;
+
+        std::vector<UINT> SortedBuilds(NumBuilds);
+        for (UINT i = 0; i < NumBuilds; ++i)
+        {
+            SortedBuilds[i] = i;
+            OutPlan->TotalScratchSize += AlignTo(ScratchSizes[i], ScratchAlignment);
+        }
+        std::stable_sort(SortedBuilds.begin(), SortedBuilds.end(), [ScratchSizes](UINT A, UINT B)
+        {
+            return ScratchSizes[A] > ScratchSizes[B];
+        });
+
+        // Assign builds to batches, the open batch with the most free scratch on top.
+        std::vector<UINT> BatchOfBuild(NumBuilds);
+        std::vector<UINT64> BatchSizes;
+        std::priority_queue<std::pair<UINT64, UINT>> FreeSpace; // (Remaining budget, batch).
+        for (UINT Build : SortedBuilds)
+        {
+            UINT64 Size = AlignTo(ScratchSizes[Build], ScratchAlignment);
+            UINT BatchIndex;
+            if (!FreeSpace.empty() && FreeSpace.top().first >= Size)
+            {
+                std::pair<UINT64, UINT> Roomiest = FreeSpace.top();
+                FreeSpace.pop();
+                BatchIndex = Roomiest.second;
+                FreeSpace.push(std::make_pair(Roomiest.first - Size, BatchIndex));
+            }
+            else
+            {
+                // Oversized builds get a batch of their own and grow the scratch buffer past the budget.
+                BatchIndex = (UINT)BatchSizes.size();
+                BatchSizes.push_back(0);
+                if (Size < ScratchBudget)
+                {
+                    FreeSpace.push(std::make_pair(ScratchBudget - Size, BatchIndex));
+                }
+            }
+
+            OutPlan->ScratchOffsets[Build] = BatchSizes[BatchIndex];
+            BatchSizes[BatchIndex] += Size;
+            BatchOfBuild[Build] = BatchIndex;
+        }
+
+        // Group the build order by batch with a counting sort, keeping the original order within a batch.
+        OutPlan->Batches.resize(BatchSizes.size());
+        for (UINT Build = 0; Build < NumBuilds; ++Build)
+        {
+            ++OutPlan->Batches[BatchOfBuild[Build]].Count;
+        }
+        UINT First = 0;
+        for (size_t b = 0; b < BatchSizes.size(); ++b)
+        {
+            Batch& Current = OutPlan->Batches[b];
+            Current.First = First;
+            Current.ScratchSize = BatchSizes[b];
+            First += Current.Count;
+            OutPlan->ScratchSize = std::max(OutPlan->ScratchSize, Current.ScratchSize);
+        }
+
+        std::vector<UINT> Cursor(BatchSizes.size());
+        for (size_t b = 0; b < BatchSizes.size(); ++b)
+        {
+            Cursor[b] = OutPlan->Batches[b].First;
+        }
+        for (UINT Build = 0; Build < NumBuilds; ++Build)
+        {
+            OutPlan->Order[Cursor[BatchOfBuild[Build]]++] = Build;
+        }
+    }
+
+    void RunBenchmark(UINT NumBuilds, UINT64 ScratchBudget)
+    {
+        // Mostly small meshes with a long tail of large ones, like a typical scene.
+        std::vector<UINT64> ScratchSizes(NumBuilds);
+        UINT32 State = 0x12345678;
+        for (UINT i = 0; i < NumBuilds; ++i)
+        {
+            State = State * 1664525u + 1013904223u;
+            float Random = (float)(State >> 8) / (float)(1 << 24);
+            float Skew = Random * Random * Random * Random;
+            UINT64 NumTriangles = 16 + (UINT64)(Skew * Skew * 50000.f);
+            ScratchSizes[i] = NumTriangles * 32;
+        }
+
+        Plan BuildPlan;
+        auto Start = std::chrono::high_resolution_clock::now();
+        PlanBuilds(ScratchSizes.data(), NumBuilds, ScratchBudget, &BuildPlan);
+        auto End = std::chrono::high_resolution_clock::now();
+        double Milliseconds = std::chrono::duration<double, std::milli>(End - Start).count();
+
+        UINT64 UsedScratch = 0;
+        for (const Batch& Current : BuildPlan.Batches)
+        {
+            UsedScratch += Current.ScratchSize;
+        }
+        double Occupancy = BuildPlan.Batches.empty() ? 0.0 :
+            (double)UsedScratch / ((double)BuildPlan.ScratchSize * BuildPlan.Batches.size());
+
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "BottomLevelBatch: %u builds, %.1f MB budget -> %zu batches, %.1f MB scratch (%.1f MB unbatched), "
+                 "%.1f%% occupancy, planned in %.2f ms\n",
+                 NumBuilds, ScratchBudget / (1024.0 * 1024.0), BuildPlan.Batches.size(),
+                 BuildPlan.ScratchSize / (1024.0 * 1024.0), BuildPlan.TotalScratchSize / (1024.0 * 1024.0),
+                 Occupancy * 100.0, Milliseconds);
+        OutputDebugStringA(Message);
+    }
+}
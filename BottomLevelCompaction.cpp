@@ -0,0 +1,218 @@
+#include "Headers/BottomLevelCompaction.h"
+#include <algorithm>
+
+namespace BottomLevelCompaction
+{
+    UINT Register(Scheduler* InScheduler, UINT64 OriginalSize, UINT64 BuildFenceValue)
+    {
+        Entry NewEntry;
+        NewEntry.FenceValue = BuildFenceValue;
+        NewEntry.OriginalSize = OriginalSize;
+        InScheduler->Entries.push_back(NewEntry);
+        return (UINT)InScheduler->Entries.size() - 1;
+    }
+
+    void Update(Scheduler* InScheduler, UINT64 CompletedFenceValue, UINT64 SubmitFenceValue,
+                const UINT64* CompactedSizes, Step* OutStep)
+    {
+        OutStep->Copies.clear();
+        OutStep->Releases.clear();
+        OutStep->AllocationSize = 0;
+
+        UINT Allocation = (UINT)InScheduler->AllocationSizes.size();
+        for (UINT i = 0; i < (UINT)InScheduler->Entries.size(); ++i)
+        {
+            Entry& Current = InScheduler->Entries[i];
+            if (Current.CurrentState == State::Compacted || Current.FenceValue > CompletedFenceValue)
+            {
+                continue;
+            }
+
+            if (Current.CurrentState == State::WaitingForSize)
+            {
+                // Suballocate the compacted copy from this update's allocation.
+                Current.CompactedSize = CompactedSizes[i];
+                Current.Allocation = Allocation;
+                Current.Offset = OutStep->AllocationSize;
+                Current.FenceValue = SubmitFenceValue;
+                Current.CurrentState = State::Compacting;
+                OutStep->AllocationSize += AlignTo(Current.CompactedSize, Alignment);
+                OutStep->Copies.push_back(i);
+            }
+            else
+            {
+                Current.CurrentState = State::Compacted;
+                OutStep->Releases.push_back(i);
+            }
+        }
+
+        if (OutStep->AllocationSize > 0)
+        {
+            InScheduler->AllocationSizes.push_back(OutStep->AllocationSize);
+        }
+    }
+
+    bool IsDone(const Scheduler& InScheduler)
+    {
+        for (const Entry& Current : InScheduler.Entries)
+        {
+            if (Current.CurrentState != State::Compacted)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void GetMemoryUsage(const Scheduler& InScheduler, UINT64* Before, UINT64* After)
+    {
+        *Before = 0;
+        *After = 0;
+        for (const Entry& Current : InScheduler.Entries)
+        {
+            *Before += Current.OriginalSize;
+            *After += Current.CurrentState == State::Compacted ?
+                AlignTo(Current.CompactedSize, Alignment) : Current.OriginalSize;
+        }
+    }
+
+    static UINT32 NextRandom(UINT32* State)
+    {
+        *State = *State * 1664525u + 1013904223u;
+        return *State >> 8;
+    }
+
+    bool RunTest(UINT NumEntries)
+    {
+        Scheduler TestScheduler;
+        std::vector<UINT64> Sizes;          // Per entry, what the GPU reports once the build completed.
+        std::vector<UINT64> ReportedSizes;  // What's visible to Update, garbage until the build completed.
+        UINT64 Signaled = 0;
+        UINT64 Completed = 0;
+        UINT NumErrors = 0;
+        UINT NumUpdates = 0;
+        UINT NumCopies = 0;
+        UINT32 Random = 7919;
+
+        while (!IsDone(TestScheduler) || TestScheduler.Entries.size() < NumEntries)
+        {
+            // A few builds a frame, each its own submission.
+            UINT NumBuilds = std::min(NextRandom(&Random) % 4, NumEntries - (UINT)TestScheduler.Entries.size());
+            for (UINT i = 0; i < NumBuilds; ++i)
+            {
+                UINT64 OriginalSize = (1 + NextRandom(&Random) % 4096) * Alignment;
+                Register(&TestScheduler, OriginalSize, ++Signaled);
+                Sizes.push_back(1 + NextRandom(&Random) % OriginalSize);
+                ReportedSizes.push_back(~0ull);
+            }
+
+            // The GPU stalls or catches up by several submissions at once.
+            if (NextRandom(&Random) % 3 != 0)
+            {
+                Completed = std::min(Signaled, Completed + NextRandom(&Random) % 6);
+            }
+            for (UINT i = 0; i < (UINT)Sizes.size(); ++i)
+            {
+                bool IsBuilt = TestScheduler.Entries[i].CurrentState != State::WaitingForSize ||
+                               TestScheduler.Entries[i].FenceValue <= Completed;
+                ReportedSizes[i] = IsBuilt ? Sizes[i] : ~0ull;
+            }
+
+            std::vector<Entry> Before = TestScheduler.Entries;
+            Step Current;
+            UINT64 SubmitFenceValue = Signaled + 1;
+            Update(&TestScheduler, Completed, SubmitFenceValue, ReportedSizes.data(), &Current);
+            Signaled += Current.Copies.empty() ? 0 : 1;
+            NumUpdates++;
+            NumCopies += (UINT)Current.Copies.size();
+
+            // Forward only, and only once the entry's fence completed.
+            std::vector<bool> IsCopied(Before.size()), IsReleased(Before.size());
+            for (UINT Index : Current.Copies)
+            {
+                IsCopied[Index] = true;
+            }
+            for (UINT Index : Current.Releases)
+            {
+                IsReleased[Index] = true;
+            }
+            for (UINT i = 0; i < (UINT)Before.size(); ++i)
+            {
+                const Entry& Was = Before[i];
+                const Entry& Is = TestScheduler.Entries[i];
+                bool IsDue = Was.CurrentState != State::Compacted && Was.FenceValue <= Completed;
+                State Expected = !IsDue ? Was.CurrentState :
+                    Was.CurrentState == State::WaitingForSize ? State::Compacting : State::Compacted;
+                NumErrors += Is.CurrentState != Expected ? 1 : 0;
+                NumErrors += IsCopied[i] != (IsDue && Was.CurrentState == State::WaitingForSize) ? 1 : 0;
+                NumErrors += IsReleased[i] != (IsDue && Was.CurrentState == State::Compacting) ? 1 : 0;
+                if (IsCopied[i])
+                {
+                    NumErrors += Is.FenceValue != SubmitFenceValue || Is.CompactedSize != Sizes[i] ? 1 : 0;
+                }
+            }
+
+            // Every copy in the new allocation, aligned and apart from the others.
+            std::vector<std::pair<UINT64, UINT64>> Ranges;
+            UINT64 Total = 0;
+            for (UINT Index : Current.Copies)
+            {
+                const Entry& Copy = TestScheduler.Entries[Index];
+                NumErrors += Copy.Allocation != TestScheduler.AllocationSizes.size() - 1 ? 1 : 0;
+                NumErrors += Copy.Offset % Alignment != 0 ? 1 : 0;
+                NumErrors += Copy.Offset + Copy.CompactedSize > Current.AllocationSize ? 1 : 0;
+                Ranges.push_back({Copy.Offset, Copy.Offset + Copy.CompactedSize});
+                Total += AlignTo(Copy.CompactedSize, Alignment);
+            }
+            std::sort(Ranges.begin(), Ranges.end());
+            for (size_t i = 1; i < Ranges.size(); ++i)
+            {
+                NumErrors += Ranges[i].first < Ranges[i - 1].second ? 1 : 0;
+            }
+            NumErrors += Current.AllocationSize != Total ? 1 : 0;
+            NumErrors += Current.Copies.empty() != (Current.AllocationSize == 0) ? 1 : 0;
+
+            // Compacted entries count at their aligned compacted size, the others at their original size.
+            UINT64 UsedBefore = 0;
+            UINT64 UsedAfter = 0;
+            UINT64 ExpectedAfter = 0;
+            GetMemoryUsage(TestScheduler, &UsedBefore, &UsedAfter);
+            for (UINT i = 0; i < (UINT)Sizes.size(); ++i)
+            {
+                const Entry& Is = TestScheduler.Entries[i];
+                ExpectedAfter += Is.CurrentState == State::Compacted ? AlignTo(Sizes[i], Alignment) : Is.OriginalSize;
+            }
+            NumErrors += UsedAfter != ExpectedAfter ? 1 : 0;
+
+            // The fence always catches up eventually.
+            if (NumUpdates > NumEntries * 16)
+            {
+                NumErrors++; // Stuck.
+                break;
+            }
+        }
+
+        UINT64 ExpectedBefore = 0;
+        UINT64 ExpectedAfter = 0;
+        for (UINT i = 0; i < (UINT)Sizes.size(); ++i)
+        {
+            ExpectedBefore += TestScheduler.Entries[i].OriginalSize;
+            ExpectedAfter += AlignTo(Sizes[i], Alignment);
+        }
+        UINT64 Before = 0;
+        UINT64 After = 0;
+        GetMemoryUsage(TestScheduler, &Before, &After);
+        NumErrors += Before != ExpectedBefore || After != ExpectedAfter ? 1 : 0;
+
+        bool Passed = NumErrors == 0;
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "BottomLevelCompaction: test %s, %u BLASes over %u updates, %u copies into %u allocations, "
+                 "%.1f MB compacted to %.1f MB, %u errors\n",
+                 Passed ? "passed" : "FAILED", (UINT)Sizes.size(), NumUpdates, NumCopies,
+                 (UINT)TestScheduler.AllocationSizes.size(), Before / (1024.0 * 1024.0), After / (1024.0 * 1024.0),
+                 NumErrors);
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+}
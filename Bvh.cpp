@@ -0,0 +1,273 @@
+#include "Headers/Bvh.h"
+#include <float.h>
+
+using namespace DirectX;
+
+namespace Bvh
+{
+    static const UINT NumBins = 12;
+
+    AABB EmptyBox()
+    {
+        AABB Box;
+        Box.Min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+        Box.Max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        return Box;
+    }
+
+    void Grow(AABB* Box, const AABB& Other)
+    {
+        Box->Min.x = Other.Min.x < Box->Min.x ? Other.Min.x : Box->Min.x;
+        Box->Min.y = Other.Min.y < Box->Min.y ? Other.Min.y : Box->Min.y;
+        Box->Min.z = Other.Min.z < Box->Min.z ? Other.Min.z : Box->Min.z;
+        Box->Max.x = Other.Max.x > Box->Max.x ? Other.Max.x : Box->Max.x;
+        Box->Max.y = Other.Max.y > Box->Max.y ? Other.Max.y : Box->Max.y;
+        Box->Max.z = Other.Max.z > Box->Max.z ? Other.Max.z : Box->Max.z;
+    }
+
+    void Grow(AABB* Box, const XMFLOAT3& Point)
+    {
+        Grow(Box, AABB{Point, Point});
+    }
+
+    float SurfaceArea(const AABB& Box)
+    {
+        float X = Box.Max.x - Box.Min.x;
+        float Y = Box.Max.y - Box.Min.y;
+        float Z = Box.Max.z - Box.Min.z;
+        if (X < 0.f || Y < 0.f || Z < 0.f)
+        {
+            return 0.f;
+        }
+        return 2.f * (X * Y + Y * Z + Z * X);
+    }
+
+    static float Centroid(const AABB& Box, UINT Axis)
+    {
+        const float* Min = &Box.Min.x;
+        const float* Max = &Box.Max.x;
+        return (Min[Axis] + Max[Axis]) * 0.5f;
+    }
+
+    static void SetNodeBounds(Node* OutNode, const AABB& Box)
+    {
+        OutNode->Min = Box.Min;
+        OutNode->Max = Box.Max;
+    }
+
+    void Build(const AABB* Bounds, UINT NumPrimitives, Tree* OutTree, UINT MaxLeafSize)
+    {
+        OutTree->Nodes.clear();
+        OutTree->Depth = 0;
+        OutTree->Primitives.resize(NumPrimitives);
+        for (UINT i = 0; i < NumPrimitives; ++i)
+        {
+            OutTree->Primitives[i] = i;
+        }
+
+        if (NumPrimitives == 0)
+        {
+            return;
+        }
+
+        OutTree->Nodes.reserve(2 * NumPrimitives);
+        Node Root = {};
+        Root.LeftOrFirst = 0;
+        Root.Count = NumPrimitives;
+        OutTree->Nodes.push_back(Root);
+
+        std::vector<UINT> Stack;
+        std::vector<UINT> NodeDepths(1, 1); // Per node.
+        Stack.push_back(0);
+        UINT* Primitives = OutTree->Primitives.data();
+
+        while (!Stack.empty())
+        {
+            UINT NodeIndex = Stack.back();
+            Stack.pop_back();
+
+            UINT First = OutTree->Nodes[NodeIndex].LeftOrFirst;
+            UINT Count = OutTree->Nodes[NodeIndex].Count;
+            OutTree->Depth = NodeDepths[NodeIndex] > OutTree->Depth ? NodeDepths[NodeIndex] : OutTree->Depth;
+
+            AABB NodeBox = EmptyBox();
+            AABB CentroidBox = EmptyBox();
+            for (UINT i = First; i < First + Count; ++i)
+            {
+                const AABB& Box = Bounds[Primitives[i]];
+                Grow(&NodeBox, Box);
+                Grow(&CentroidBox, XMFLOAT3(Centroid(Box, 0), Centroid(Box, 1), Centroid(Box, 2)));
+            }
+            SetNodeBounds(&OutTree->Nodes[NodeIndex], NodeBox);
+
+            if (Count <= MaxLeafSize)
+            {
+                continue;
+            }
+
+            // Find the cheapest split plane over all axes with binned SAH.
+            float BestCost = FLT_MAX;
+            UINT BestAxis = 0;
+            UINT BestSplit = 0;
+            for (UINT Axis = 0; Axis < 3; ++Axis)
+            {
+                float Min = (&CentroidBox.Min.x)[Axis];
+                float Extent = (&CentroidBox.Max.x)[Axis] - Min;
+                if (Extent <= 0.f)
+                {
+                    continue;
+                }
+
+                AABB BinBoxes[NumBins];
+                UINT BinCounts[NumBins] = {};
+                for (UINT b = 0; b < NumBins; ++b)
+                {
+                    BinBoxes[b] = EmptyBox();
+                }
+
+                float Scale = NumBins / Extent;
+                for (UINT i = First; i < First + Count; ++i)
+                {
+                    const AABB& Box = Bounds[Primitives[i]];
+                    UINT Bin = (UINT)((Centroid(Box, Axis) - Min) * Scale);
+                    Bin = Bin < NumBins ? Bin : NumBins - 1;
+                    Grow(&BinBoxes[Bin], Box);
+                    BinCounts[Bin]++;
+                }
+
+                // Sweep from the right to get the area and count of every right side.
+                float RightAreas[NumBins - 1];
+                UINT RightCounts[NumBins - 1];
+                AABB RightBox = EmptyBox();
+                UINT RightCount = 0;
+                for (UINT b = NumBins - 1; b > 0; --b)
+                {
+                    Grow(&RightBox, BinBoxes[b]);
+                    RightCount += BinCounts[b];
+                    RightAreas[b - 1] = SurfaceArea(RightBox);
+                    RightCounts[b - 1] = RightCount;
+                }
+
+                AABB LeftBox = EmptyBox();
+                UINT LeftCount = 0;
+                for (UINT b = 0; b < NumBins - 1; ++b)
+                {
+                    Grow(&LeftBox, BinBoxes[b]);
+                    LeftCount += BinCounts[b];
+                    if (LeftCount == 0 || RightCounts[b] == 0)
+                    {
+                        continue;
+                    }
+
+                    float Cost = SurfaceArea(LeftBox) * LeftCount + RightAreas[b] * RightCounts[b];
+                    if (Cost < BestCost)
+                    {
+                        BestCost = Cost;
+                        BestAxis = Axis;
+                        BestSplit = b;
+                    }
+                }
+            }
+
+            // Stay a leaf if splitting isn't cheaper than testing every primitive.
+            float LeafCost = SurfaceArea(NodeBox) * Count;
+            if (BestCost >= LeafCost)
+            {
+                continue;
+            }
+
+            // Partition the primitives around the chosen bin boundary.
+            float Min = (&CentroidBox.Min.x)[BestAxis];
+            float Scale = NumBins / ((&CentroidBox.Max.x)[BestAxis] - Min);
+            UINT i = First;
+            UINT j = First + Count;
+            while (i < j)
+            {
+                UINT Bin = (UINT)((Centroid(Bounds[Primitives[i]], BestAxis) - Min) * Scale);
+                Bin = Bin < NumBins ? Bin : NumBins - 1;
+                if (Bin <= BestSplit)
+                {
+                    ++i;
+                }
+                else
+                {
+                    UINT Temp = Primitives[i];
+                    Primitives[i] = Primitives[--j];
+                    Primitives[j] = Temp;
+                }
+            }
+
+            UINT LeftCount = i - First;
+            if (LeftCount == 0 || LeftCount == Count)
+            {
+                continue;
+            }
+
+            UINT LeftIndex = (UINT)OutTree->Nodes.size();
+            Node Left = {};
+            Left.LeftOrFirst = First;
+            Left.Count = LeftCount;
+            Node Right = {};
+            Right.LeftOrFirst = i;
+            Right.Count = Count - LeftCount;
+            OutTree->Nodes.push_back(Left);
+            OutTree->Nodes.push_back(Right);
+            NodeDepths.push_back(NodeDepths[NodeIndex] + 1);
+            NodeDepths.push_back(NodeDepths[NodeIndex] + 1);
+
+            OutTree->Nodes[NodeIndex].LeftOrFirst = LeftIndex;
+            OutTree->Nodes[NodeIndex].Count = 0;
+
+            Stack.push_back(LeftIndex + 1);
+            Stack.push_back(LeftIndex);
+        }
+    }
+
+    void Refit(Tree* InTree, const AABB* Bounds)
+    {
+        // Children are allocated after their parent, so a reverse sweep visits children first.
+        for (size_t i = InTree->Nodes.size(); i-- > 0;)
+        {
+            Node* CurrentNode = &InTree->Nodes[i];
+            AABB Box = EmptyBox();
+            if (CurrentNode->Count > 0)
+            {
+                for (UINT p = CurrentNode->LeftOrFirst; p < CurrentNode->LeftOrFirst + CurrentNode->Count; ++p)
+                {
+                    Grow(&Box, Bounds[InTree->Primitives[p]]);
+                }
+            }
+            else
+            {
+                const Node& Left = InTree->Nodes[CurrentNode->LeftOrFirst];
+                const Node& Right = InTree->Nodes[CurrentNode->LeftOrFirst + 1];
+                Grow(&Box, AABB{Left.Min, Left.Max});
+                Grow(&Box, AABB{Right.Min, Right.Max});
+            }
+            SetNodeBounds(CurrentNode, Box);
+        }
+    }
+
+    float ComputeSAHCost(const Tree& InTree)
+    {
+        if (InTree.Nodes.empty())
+        {
+            return 0.f;
+        }
+
+        const Node& Root = InTree.Nodes[0];
+        float RootArea = SurfaceArea(AABB{Root.Min, Root.Max});
+        if (RootArea <= 0.f)
+        {
+            return 0.f;
+        }
+
+        float Cost = 0.f;
+        for (const Node& CurrentNode : InTree.Nodes)
+        {
+            float Area = SurfaceArea(AABB{CurrentNode.Min, CurrentNode.Max});
+            Cost += Area * (CurrentNode.Count > 0 ? (float)CurrentNode.Count : 1.f);
+        }
+        return Cost / RootArea;
+    }
+}
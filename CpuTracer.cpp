@@ -0,0 +1,726 @@
+#include "Headers/CpuTracer.h"
+#include "Headers/Threading.h"
+#include <algorithm>
+#include <chrono>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+using namespace DirectX;
+
+namespace CpuTracer
+{
+    static const float Pi = 3.14159265f;
+    static const float RayEpsilon = 1e-3f;
+    static const float RayTMax = 10000.f;
+    static const UINT NoHit = 0xFFFFFFFF;
+    static const UINT RecursiveGrainSize = 256;
+    static const UINT WavefrontGrainSize = 4096;
+    static const UINT RayBatchSize = 256;
+    static const UINT MaxFixedStackSize = 64; // Deeper BVHs traverse with a stack on the heap.
+    static const float MaxTracerError = 1e-5f; // Per channel, between the recursive and wavefront images.
+
+    struct Hit
+    {
+        float T;
+        UINT Triangle;
+    };
+
+    struct Surface
+    {
+        XMFLOAT3 Position;
+        XMFLOAT3 Normal; // Facing the incoming ray.
+        XMFLOAT3 Albedo;
+    };
+
+    // A ray waiting to be appended to a shared queue.
+    struct PendingRay
+    {
+        XMFLOAT3 Origin;
+        XMFLOAT3 Direction;
+        XMFLOAT3 Throughput;
+        UINT PixelIndex;
+        UINT RngState;
+        float TMax;
+    };
+
+    // Rays are appended per batch so the queue counter is only touched once every RayBatchSize rays.
+    struct RayBatch
+    {
+        PendingRay Rays[RayBatchSize];
+        UINT Count = 0;
+    };
+
+    static XMFLOAT3 Add(const XMFLOAT3& A, const XMFLOAT3& B) { return XMFLOAT3(A.x + B.x, A.y + B.y, A.z + B.z); }
+    static XMFLOAT3 Sub(const XMFLOAT3& A, const XMFLOAT3& B) { return XMFLOAT3(A.x - B.x, A.y - B.y, A.z - B.z); }
+    static XMFLOAT3 Mul(const XMFLOAT3& A, const XMFLOAT3& B) { return XMFLOAT3(A.x * B.x, A.y * B.y, A.z * B.z); }
+    static XMFLOAT3 Scale(const XMFLOAT3& A, float S) { return XMFLOAT3(A.x * S, A.y * S, A.z * S); }
+    static float Dot(const XMFLOAT3& A, const XMFLOAT3& B) { return A.x * B.x + A.y * B.y + A.z * B.z; }
+
+    static XMFLOAT3 Cross(const XMFLOAT3& A, const XMFLOAT3& B)
+    {
+        return XMFLOAT3(A.y * B.z - A.z * B.y, A.z * B.x - A.x * B.z, A.x * B.y - A.y * B.x);
+    }
+
+    static XMFLOAT3 Normalize(const XMFLOAT3& A)
+    {
+        return Scale(A, 1.f / sqrtf(Dot(A, A)));
+    }
+
+    // PCG hash.
+    static UINT Hash(UINT Value)
+    {
+        UINT State = Value * 747796405u + 2891336453u;
+        UINT Word = ((State >> ((State >> 28u) + 4u)) ^ State) * 277803737u;
+        return (Word >> 22u) ^ Word;
+    }
+
+    static float NextRandom(UINT* RngState)
+    {
+        *RngState = *RngState * 747796405u + 2891336453u;
+        return (float)(Hash(*RngState) >> 8) * (1.f / 16777216.f);
+    }
+
+    static UINT SeedPath(UINT PixelIndex, UINT SampleIndex)
+    {
+        return Hash(PixelIndex ^ Hash(SampleIndex + 0x9E3779B9u));
+    }
+
+    // Same pinhole camera as RayGenerationMain in SimpleDXR.hlsl.
+    static const XMFLOAT3 CameraOrigin = XMFLOAT3(0.f, 0.f, -2.f);
+
+    static XMFLOAT3 CameraRayDirection(UINT PixelIndex, UINT Width, UINT Height)
+    {
+        float U = (float)(PixelIndex % Width) / (float)Width * 2.f - 1.f;
+        float V = (float)(PixelIndex / Width) / (float)Height * 2.f - 1.f;
+        return Normalize(XMFLOAT3(U, -V, 1.f));
+    }
+
+    static bool IntersectBox(const Bvh::Node& Box, const XMFLOAT3& Origin, const XMFLOAT3& InvDirection, float TMax)
+    {
+        float TX1 = (Box.Min.x - Origin.x) * InvDirection.x;
+        float TX2 = (Box.Max.x - Origin.x) * InvDirection.x;
+        float TMin = TX1 < TX2 ? TX1 : TX2;
+        float TFar = TX1 > TX2 ? TX1 : TX2;
+
+        float TY1 = (Box.Min.y - Origin.y) * InvDirection.y;
+        float TY2 = (Box.Max.y - Origin.y) * InvDirection.y;
+        TMin = fmaxf(TMin, TY1 < TY2 ? TY1 : TY2);
+        TFar = fminf(TFar, TY1 > TY2 ? TY1 : TY2);
+
+        float TZ1 = (Box.Min.z - Origin.z) * InvDirection.z;
+        float TZ2 = (Box.Max.z - Origin.z) * InvDirection.z;
+        TMin = fmaxf(TMin, TZ1 < TZ2 ? TZ1 : TZ2);
+        TFar = fminf(TFar, TZ1 > TZ2 ? TZ1 : TZ2);
+
+        return TFar >= TMin && TFar > 0.f && TMin < TMax;
+    }
+
+    // Moller-Trumbore.
+    static bool IntersectTriangle(const Scene& InScene, UINT Triangle,
+                                  const XMFLOAT3& Origin, const XMFLOAT3& Direction, float TMax, float* OutT)
+    {
+        const XMFLOAT3& V0 = InScene.Positions[Triangle * 3 + 0];
+        XMFLOAT3 Edge1 = Sub(InScene.Positions[Triangle * 3 + 1], V0);
+        XMFLOAT3 Edge2 = Sub(InScene.Positions[Triangle * 3 + 2], V0);
+        XMFLOAT3 P = Cross(Direction, Edge2);
+        float Determinant = Dot(Edge1, P);
+        if (fabsf(Determinant) < 1e-8f)
+        {
+            return false;
+        }
+
+        float InvDeterminant = 1.f / Determinant;
+        XMFLOAT3 ToOrigin = Sub(Origin, V0);
+        float U = Dot(ToOrigin, P) * InvDeterminant;
+        if (U < 0.f || U > 1.f)
+        {
+            return false;
+        }
+
+        XMFLOAT3 Q = Cross(ToOrigin, Edge1);
+        float V = Dot(Direction, Q) * InvDeterminant;
+        if (V < 0.f || U + V > 1.f)
+        {
+            return false;
+        }
+
+        float T = Dot(Edge2, Q) * InvDeterminant;
+        if (T <= 0.f || T >= TMax)
+        {
+            return false;
+        }
+
+        *OutT = T;
+        return true;
+    }
+
+    static bool Trace(const Scene& InScene, const XMFLOAT3& Origin, const XMFLOAT3& Direction,
+                      float TMax, bool AnyHit, Hit* OutHit)
+    {
+        OutHit->T = TMax;
+        OutHit->Triangle = NoHit;
+
+        const std::vector<Bvh::Node>& Nodes = InScene.TriangleBvh.Nodes;
+        if (Nodes.empty())
+        {
+            return false;
+        }
+
+        XMFLOAT3 InvDirection = XMFLOAT3(1.f / Direction.x, 1.f / Direction.y, 1.f / Direction.z);
+
+        // At most one node per level waits on the stack, so the tree's depth is enough. Degenerate trees can be
+        // deeper than the fixed stack.
+        UINT FixedStack[MaxFixedStackSize];
+        std::vector<UINT> DeepStack;
+        UINT* Stack = FixedStack;
+        if (InScene.TriangleBvh.Depth > MaxFixedStackSize)
+        {
+            DeepStack.resize(InScene.TriangleBvh.Depth);
+            Stack = DeepStack.data();
+        }
+        UINT StackSize = 0;
+        Stack[StackSize++] = 0;
+
+        while (StackSize > 0)
+        {
+            const Bvh::Node& CurrentNode = Nodes[Stack[--StackSize]];
+            if (!IntersectBox(CurrentNode, Origin, InvDirection, OutHit->T))
+            {
+                continue;
+            }
+
+            if (CurrentNode.Count > 0)
+            {
+                for (UINT i = CurrentNode.LeftOrFirst; i < CurrentNode.LeftOrFirst + CurrentNode.Count; ++i)
+                {
+                    UINT Triangle = InScene.TriangleBvh.Primitives[i];
+                    float T;
+                    if (IntersectTriangle(InScene, Triangle, Origin, Direction, OutHit->T, &T))
+                    {
+                        OutHit->T = T;
+                        OutHit->Triangle = Triangle;
+                        if (AnyHit)
+                        {
+                            return true;
+                        }
+                    }
+                }
+            }
+            else
+            {
+                Stack[StackSize++] = CurrentNode.LeftOrFirst + 1;
+                Stack[StackSize++] = CurrentNode.LeftOrFirst;
+            }
+        }
+
+        return OutHit->Triangle != NoHit;
+    }
+
+    static Surface GetSurface(const Scene& InScene, const XMFLOAT3& Origin, const XMFLOAT3& Direction, const Hit& InHit)
+    {
+        const XMFLOAT3& V0 = InScene.Positions[InHit.Triangle * 3 + 0];
+        XMFLOAT3 Edge1 = Sub(InScene.Positions[InHit.Triangle * 3 + 1], V0);
+        XMFLOAT3 Edge2 = Sub(InScene.Positions[InHit.Triangle * 3 + 2], V0);
+
+        Surface Result;
+        Result.Position = Add(Origin, Scale(Direction, InHit.T));
+        Result.Normal = Normalize(Cross(Edge1, Edge2));
+        if (Dot(Result.Normal, Direction) > 0.f)
+        {
+            Result.Normal = Scale(Result.Normal, -1.f);
+        }
+        Result.Albedo = InScene.Albedos[InHit.Triangle];
+        return Result;
+    }
+
+    static XMFLOAT3 SampleCosineHemisphere(const XMFLOAT3& Normal, UINT* RngState)
+    {
+        float U1 = NextRandom(RngState);
+        float U2 = NextRandom(RngState);
+        float Radius = sqrtf(U1);
+        float Phi = 2.f * Pi * U2;
+        float X = Radius * cosf(Phi);
+        float Y = Radius * sinf(Phi);
+        float Z = sqrtf(fmaxf(0.f, 1.f - U1));
+
+        // Orthonormal basis around the normal (Duff et al. 2017).
+        float Sign = copysignf(1.f, Normal.z);
+        float A = -1.f / (Sign + Normal.z);
+        float B = Normal.x * Normal.y * A;
+        XMFLOAT3 Tangent = XMFLOAT3(1.f + Sign * Normal.x * Normal.x * A, Sign * B, -Sign * Normal.x);
+        XMFLOAT3 Bitangent = XMFLOAT3(B, Sign + Normal.y * Normal.y * A, -Normal.y);
+        return Normalize(Add(Add(Scale(Tangent, X), Scale(Bitangent, Y)), Scale(Normal, Z)));
+    }
+
+    // Direct light reaching the surface if the shadow ray toward the light is unoccluded.
+    static bool GetLightContribution(const Scene& InScene, const XMFLOAT3& Throughput, const Surface& InSurface,
+                                     XMFLOAT3* OutContribution)
+    {
+        float NoL = Dot(InSurface.Normal, InScene.SunDirection);
+        if (NoL <= 0.f)
+        {
+            return false;
+        }
+        *OutContribution = Scale(Mul(Mul(Throughput, InSurface.Albedo), InScene.SunColor), NoL);
+        return true;
+    }
+
+    void CreateTutorialScene(Scene* OutScene, UINT NumTriangleInstances)
+    {
+        OutScene->Positions.clear();
+        OutScene->Albedos.clear();
+
+        // Same geometry and instance transforms as DXRTutorial::CreateInstanceDescriptions.
+        const XMFLOAT3 TriangleVertices[3] = {
+            XMFLOAT3(0.f, 1.f, 0.f),
+            XMFLOAT3(0.866f, -0.5f, 0.f),
+            XMFLOAT3(-0.866f, -0.5f, 0.f)
+        };
+        const XMFLOAT3 InstanceColors[3] = {
+            XMFLOAT3(1.f, 0.f, 0.f),
+            XMFLOAT3(0.f, 1.f, 0.f),
+            XMFLOAT3(0.f, 0.f, 1.f)
+        };
+        const UINT InstancesPerRow = 16;
+        for (UINT InstanceId = 0; InstanceId < NumTriangleInstances; ++InstanceId)
+        {
+            XMFLOAT3 Offset = XMFLOAT3((float)(InstanceId % InstancesPerRow) * 2.f, 0.f,
+                                       (float)(InstanceId / InstancesPerRow) * 2.f);
+            XMFLOAT3 InstanceScale = XMFLOAT3(0.2f, 0.5f, 0.5f);
+            for (UINT v = 0; v < 3; ++v)
+            {
+                OutScene->Positions.push_back(Mul(Add(TriangleVertices[v], Offset), InstanceScale));
+            }
+            OutScene->Albedos.push_back(InstanceColors[InstanceId % 3]);
+        }
+
+        // Plane.
+        const XMFLOAT3 PlaneVertices[6] = {
+            XMFLOAT3(-100.f, -1.f, -2.f),
+            XMFLOAT3(100.f, -1.f, 100.f),
+            XMFLOAT3(-100.f, -1.f, 100.f),
+
+            XMFLOAT3(-100.f, -1.f, -2.f),
+            XMFLOAT3(100.f, -1.f, -2.f),
+            XMFLOAT3(100.f, -1.f, 100.f)
+        };
+        for (UINT v = 0; v < _countof(PlaneVertices); ++v)
+        {
+            OutScene->Positions.push_back(PlaneVertices[v]);
+        }
+        OutScene->Albedos.push_back(XMFLOAT3(0.8f, 0.8f, 0.8f));
+        OutScene->Albedos.push_back(XMFLOAT3(0.8f, 0.8f, 0.8f));
+
+        OutScene->SunDirection = Normalize(XMFLOAT3(0.f, 0.5f, 0.1f));
+        OutScene->SunColor = XMFLOAT3(1.f, 1.f, 1.f);
+        OutScene->SkyColor = XMFLOAT3(0.5f, 0.5f, 0.9f);
+
+        UINT NumTriangles = (UINT)OutScene->Albedos.size();
+        std::vector<Bvh::AABB> Bounds(NumTriangles);
+        for (UINT i = 0; i < NumTriangles; ++i)
+        {
+            Bounds[i] = Bvh::EmptyBox();
+            for (UINT v = 0; v < 3; ++v)
+            {
+                Bvh::Grow(&Bounds[i], OutScene->Positions[i * 3 + v]);
+            }
+        }
+        Bvh::Build(Bounds.data(), NumTriangles, &OutScene->TriangleBvh);
+    }
+
+    static void TracePath(const Scene& InScene, const Settings& InSettings,
+                          const XMFLOAT3& Origin, const XMFLOAT3& Direction, const XMFLOAT3& Throughput,
+                          UINT Depth, UINT* RngState, XMFLOAT3* Radiance)
+    {
+        Hit ClosestHit;
+        if (!Trace(InScene, Origin, Direction, RayTMax, false, &ClosestHit))
+        {
+            *Radiance = Add(*Radiance, Mul(Throughput, InScene.SkyColor));
+            return;
+        }
+
+        Surface HitSurface = GetSurface(InScene, Origin, Direction, ClosestHit);
+        XMFLOAT3 OffsetPosition = Add(HitSurface.Position, Scale(HitSurface.Normal, RayEpsilon));
+
+        XMFLOAT3 Contribution;
+        if (GetLightContribution(InScene, Throughput, HitSurface, &Contribution))
+        {
+            Hit ShadowHit;
+            if (!Trace(InScene, OffsetPosition, InScene.SunDirection, RayTMax, true, &ShadowHit))
+            {
+                *Radiance = Add(*Radiance, Contribution);
+            }
+        }
+
+        if (Depth == InSettings.MaxBounces)
+        {
+            return;
+        }
+
+        // Cosine sampling cancels the Lambert cosine and pdf, leaving only the albedo.
+        XMFLOAT3 NextDirection = SampleCosineHemisphere(HitSurface.Normal, RngState);
+        TracePath(InScene, InSettings, OffsetPosition, NextDirection, Mul(Throughput, HitSurface.Albedo),
+                  Depth + 1, RngState, Radiance);
+    }
+
+    void RenderRecursive(const Scene& InScene, const Settings& InSettings, XMFLOAT3* OutRadiance)
+    {
+        UINT NumPixels = InSettings.Width * InSettings.Height;
+        Threading::ParallelFor(NumPixels, InSettings.NumThreads, RecursiveGrainSize, [&](UINT Begin, UINT End)
+        {
+            for (UINT PixelIndex = Begin; PixelIndex < End; ++PixelIndex)
+            {
+                UINT RngState = SeedPath(PixelIndex, InSettings.SampleIndex);
+                XMFLOAT3 Radiance = XMFLOAT3(0.f, 0.f, 0.f);
+                TracePath(InScene, InSettings,
+                          CameraOrigin, CameraRayDirection(PixelIndex, InSettings.Width, InSettings.Height),
+                          XMFLOAT3(1.f, 1.f, 1.f), 0, &RngState, &Radiance);
+                OutRadiance[PixelIndex] = Radiance;
+            }
+        });
+    }
+
+    static void ResizeQueue(RayQueue* Queue, UINT Capacity)
+    {
+        if (Queue->PixelIndex.size() < Capacity)
+        {
+            Queue->OriginX.resize(Capacity);
+            Queue->OriginY.resize(Capacity);
+            Queue->OriginZ.resize(Capacity);
+            Queue->DirectionX.resize(Capacity);
+            Queue->DirectionY.resize(Capacity);
+            Queue->DirectionZ.resize(Capacity);
+            Queue->ThroughputR.resize(Capacity);
+            Queue->ThroughputG.resize(Capacity);
+            Queue->ThroughputB.resize(Capacity);
+            Queue->PixelIndex.resize(Capacity);
+            Queue->RngState.resize(Capacity);
+            Queue->HitT.resize(Capacity);
+            Queue->HitTriangle.resize(Capacity);
+        }
+        Queue->Count = 0;
+    }
+
+    static void WriteRay(RayQueue* Queue, UINT Slot, const PendingRay& InRay)
+    {
+        Queue->OriginX[Slot] = InRay.Origin.x;
+        Queue->OriginY[Slot] = InRay.Origin.y;
+        Queue->OriginZ[Slot] = InRay.Origin.z;
+        Queue->DirectionX[Slot] = InRay.Direction.x;
+        Queue->DirectionY[Slot] = InRay.Direction.y;
+        Queue->DirectionZ[Slot] = InRay.Direction.z;
+        Queue->ThroughputR[Slot] = InRay.Throughput.x;
+        Queue->ThroughputG[Slot] = InRay.Throughput.y;
+        Queue->ThroughputB[Slot] = InRay.Throughput.z;
+        Queue->PixelIndex[Slot] = InRay.PixelIndex;
+        Queue->RngState[Slot] = InRay.RngState;
+        Queue->HitT[Slot] = InRay.TMax;
+        Queue->HitTriangle[Slot] = NoHit;
+    }
+
+    static void FlushBatch(RayBatch* Batch, RayQueue* Queue)
+    {
+        UINT First = Queue->Count.fetch_add(Batch->Count);
+        for (UINT i = 0; i < Batch->Count; ++i)
+        {
+            WriteRay(Queue, First + i, Batch->Rays[i]);
+        }
+        Batch->Count = 0;
+    }
+
+    static void PushRay(RayBatch* Batch, RayQueue* Queue, const PendingRay& InRay)
+    {
+        if (Batch->Count == RayBatchSize)
+        {
+            FlushBatch(Batch, Queue);
+        }
+        Batch->Rays[Batch->Count++] = InRay;
+    }
+
+    // Generate: one camera ray per pixel.
+    static void GenerateStage(const Settings& InSettings, RayQueue* Paths, XMFLOAT3* OutRadiance)
+    {
+        UINT NumPixels = InSettings.Width * InSettings.Height;
+        Threading::ParallelFor(NumPixels, InSettings.NumThreads, WavefrontGrainSize, [&](UINT Begin, UINT End)
+        {
+            for (UINT PixelIndex = Begin; PixelIndex < End; ++PixelIndex)
+            {
+                PendingRay CameraRay;
+                CameraRay.Origin = CameraOrigin;
+                CameraRay.Direction = CameraRayDirection(PixelIndex, InSettings.Width, InSettings.Height);
+                CameraRay.Throughput = XMFLOAT3(1.f, 1.f, 1.f);
+                CameraRay.PixelIndex = PixelIndex;
+                CameraRay.RngState = SeedPath(PixelIndex, InSettings.SampleIndex);
+                CameraRay.TMax = RayTMax;
+                WriteRay(Paths, PixelIndex, CameraRay);
+                OutRadiance[PixelIndex] = XMFLOAT3(0.f, 0.f, 0.f);
+            }
+        });
+        Paths->Count = NumPixels;
+    }
+
+    // Extend: closest hit for every ray in the queue.
+    static void ExtendStage(const Scene& InScene, const Settings& InSettings, RayQueue* Paths)
+    {
+        Threading::ParallelFor(Paths->Count.load(), InSettings.NumThreads, WavefrontGrainSize, [&](UINT Begin, UINT End)
+        {
+            for (UINT i = Begin; i < End; ++i)
+            {
+                XMFLOAT3 Origin = XMFLOAT3(Paths->OriginX[i], Paths->OriginY[i], Paths->OriginZ[i]);
+                XMFLOAT3 Direction = XMFLOAT3(Paths->DirectionX[i], Paths->DirectionY[i], Paths->DirectionZ[i]);
+                Hit ClosestHit;
+                Trace(InScene, Origin, Direction, Paths->HitT[i], false, &ClosestHit);
+                Paths->HitT[i] = ClosestHit.T;
+                Paths->HitTriangle[i] = ClosestHit.Triangle;
+            }
+        });
+    }
+
+    // Shade: resolve misses, emit shadow rays toward the light and continuation rays for the next bounce.
+    static void ShadeStage(const Scene& InScene, const Settings& InSettings, UINT Depth,
+                           RayQueue* Paths, RayQueue* NextPaths, RayQueue* ShadowRays, XMFLOAT3* OutRadiance)
+    {
+        Threading::ParallelFor(Paths->Count.load(), InSettings.NumThreads, WavefrontGrainSize, [&](UINT Begin, UINT End)
+        {
+            RayBatch ShadowBatch;
+            RayBatch ContinuationBatch;
+            for (UINT i = Begin; i < End; ++i)
+            {
+                UINT PixelIndex = Paths->PixelIndex[i];
+                XMFLOAT3 Throughput = XMFLOAT3(Paths->ThroughputR[i], Paths->ThroughputG[i], Paths->ThroughputB[i]);
+                if (Paths->HitTriangle[i] == NoHit)
+                {
+                    OutRadiance[PixelIndex] = Add(OutRadiance[PixelIndex], Mul(Throughput, InScene.SkyColor));
+                    continue;
+                }
+
+                XMFLOAT3 Origin = XMFLOAT3(Paths->OriginX[i], Paths->OriginY[i], Paths->OriginZ[i]);
+                XMFLOAT3 Direction = XMFLOAT3(Paths->DirectionX[i], Paths->DirectionY[i], Paths->DirectionZ[i]);
+                Hit ClosestHit = {Paths->HitT[i], Paths->HitTriangle[i]};
+                Surface HitSurface = GetSurface(InScene, Origin, Direction, ClosestHit);
+                XMFLOAT3 OffsetPosition = Add(HitSurface.Position, Scale(HitSurface.Normal, RayEpsilon));
+
+                PendingRay ShadowRay;
+                if (GetLightContribution(InScene, Throughput, HitSurface, &ShadowRay.Throughput))
+                {
+                    ShadowRay.Origin = OffsetPosition;
+                    ShadowRay.Direction = InScene.SunDirection;
+                    ShadowRay.PixelIndex = PixelIndex;
+                    ShadowRay.RngState = 0;
+                    ShadowRay.TMax = RayTMax;
+                    PushRay(&ShadowBatch, ShadowRays, ShadowRay);
+                }
+
+                if (Depth == InSettings.MaxBounces)
+                {
+                    continue;
+                }
+
+                PendingRay Continuation;
+                Continuation.RngState = Paths->RngState[i];
+                Continuation.Origin = OffsetPosition;
+                Continuation.Direction = SampleCosineHemisphere(HitSurface.Normal, &Continuation.RngState);
+                Continuation.Throughput = Mul(Throughput, HitSurface.Albedo);
+                Continuation.PixelIndex = PixelIndex;
+                Continuation.TMax = RayTMax;
+                PushRay(&ContinuationBatch, NextPaths, Continuation);
+            }
+            FlushBatch(&ShadowBatch, ShadowRays);
+            FlushBatch(&ContinuationBatch, NextPaths);
+        });
+    }
+
+    // Connect: any-hit shadow rays, unoccluded ones add their light contribution.
+    static void ConnectStage(const Scene& InScene, const Settings& InSettings, RayQueue* ShadowRays, XMFLOAT3* OutRadiance)
+    {
+        Threading::ParallelFor(ShadowRays->Count.load(), InSettings.NumThreads, WavefrontGrainSize, [&](UINT Begin, UINT End)
+        {
+            for (UINT i = Begin; i < End; ++i)
+            {
+                XMFLOAT3 Origin = XMFLOAT3(ShadowRays->OriginX[i], ShadowRays->OriginY[i], ShadowRays->OriginZ[i]);
+                XMFLOAT3 Direction = XMFLOAT3(ShadowRays->DirectionX[i], ShadowRays->DirectionY[i], ShadowRays->DirectionZ[i]);
+                Hit ShadowHit;
+                if (!Trace(InScene, Origin, Direction, ShadowRays->HitT[i], true, &ShadowHit))
+                {
+                    UINT PixelIndex = ShadowRays->PixelIndex[i];
+                    XMFLOAT3 Contribution = XMFLOAT3(ShadowRays->ThroughputR[i], ShadowRays->ThroughputG[i], ShadowRays->ThroughputB[i]);
+                    OutRadiance[PixelIndex] = Add(OutRadiance[PixelIndex], Contribution);
+                }
+            }
+        });
+    }
+
+    void RenderWavefront(const Scene& InScene, const Settings& InSettings, WavefrontState* State, XMFLOAT3* OutRadiance)
+    {
+        // Every pixel has at most one path and one shadow ray in flight, so queues never grow past the pixel count.
+        UINT NumPixels = InSettings.Width * InSettings.Height;
+        ResizeQueue(&State->Paths[0], NumPixels);
+        ResizeQueue(&State->Paths[1], NumPixels);
+        ResizeQueue(&State->ShadowRays, NumPixels);
+
+        UINT Current = 0;
+        GenerateStage(InSettings, &State->Paths[Current], OutRadiance);
+
+        for (UINT Depth = 0; Depth <= InSettings.MaxBounces && State->Paths[Current].Count > 0; ++Depth)
+        {
+            UINT Next = 1 - Current;
+            State->Paths[Next].Count = 0;
+            State->ShadowRays.Count = 0;
+
+            ExtendStage(InScene, InSettings, &State->Paths[Current]);
+            ShadeStage(InScene, InSettings, Depth, &State->Paths[Current], &State->Paths[Next],
+                       &State->ShadowRays, OutRadiance);
+            ConnectStage(InScene, InSettings, &State->ShadowRays, OutRadiance);
+
+            Current = Next;
+        }
+    }
+
+    bool RunTest(UINT Width, UINT Height)
+    {
+        UINT NumErrors = 0;
+
+        // A row of triangles in a chain shaped BVH, deeper than the fixed traversal stack. Inner node k has inner
+        // node k + 1 on the left, which is visited first, and triangle k on the right, which waits on the stack.
+        // A ray through each triangle has to find it.
+        Scene Deep;
+        const UINT NumDeepTriangles = 3 * MaxFixedStackSize;
+        std::vector<Bvh::AABB> Bounds(NumDeepTriangles);
+        for (UINT i = 0; i < NumDeepTriangles; ++i)
+        {
+            Deep.Positions.push_back(XMFLOAT3((float)i - 0.25f, -0.5f, 0.f));
+            Deep.Positions.push_back(XMFLOAT3((float)i + 0.25f, -0.5f, 0.f));
+            Deep.Positions.push_back(XMFLOAT3((float)i, 0.5f, 0.f));
+            Deep.Albedos.push_back(XMFLOAT3(1.f, 1.f, 1.f));
+            Bounds[i] = Bvh::EmptyBox();
+            for (UINT v = 0; v < 3; ++v)
+            {
+                Bvh::Grow(&Bounds[i], Deep.Positions[i * 3 + v]);
+            }
+            Deep.TriangleBvh.Primitives.push_back(i);
+        }
+        Bvh::Tree* Chain = &Deep.TriangleBvh;
+        Chain->Nodes.resize(2 * NumDeepTriangles - 1);
+        for (UINT k = 0; k + 1 < NumDeepTriangles; ++k)
+        {
+            Bvh::Node* Inner = &Chain->Nodes[k == 0 ? 0 : 2 * k - 1];
+            Inner->LeftOrFirst = 2 * k + 1;
+            Inner->Count = 0;
+            Chain->Nodes[2 * k + 2].LeftOrFirst = k;
+            Chain->Nodes[2 * k + 2].Count = 1;
+        }
+        Chain->Nodes[2 * NumDeepTriangles - 3].LeftOrFirst = NumDeepTriangles - 1;
+        Chain->Nodes[2 * NumDeepTriangles - 3].Count = 1;
+        Chain->Depth = NumDeepTriangles;
+        Bvh::Refit(Chain, Bounds.data());
+
+        for (UINT i = 0; i < NumDeepTriangles; ++i)
+        {
+            Hit DeepHit;
+            bool IsHit = Trace(Deep, XMFLOAT3((float)i, 0.f, -1.f), XMFLOAT3(0.f, 0.f, 1.f), RayTMax, false, &DeepHit);
+            NumErrors += !IsHit || DeepHit.Triangle != i;
+        }
+
+        // Bvh::Build reports the depth of the tree it built. Children come after their parent.
+        Scene Tutorial;
+        CreateTutorialScene(&Tutorial, 64);
+        std::vector<UINT> NodeDepths(Tutorial.TriangleBvh.Nodes.size(), 1);
+        UINT MaxDepth = 0;
+        for (UINT i = 0; i < NodeDepths.size(); ++i)
+        {
+            const Bvh::Node& Current = Tutorial.TriangleBvh.Nodes[i];
+            if (Current.Count == 0)
+            {
+                NodeDepths[Current.LeftOrFirst] = NodeDepths[Current.LeftOrFirst + 1] = NodeDepths[i] + 1;
+            }
+            MaxDepth = std::max(MaxDepth, NodeDepths[i]);
+        }
+        NumErrors += Tutorial.TriangleBvh.Depth != MaxDepth || MaxDepth < 3;
+
+        // The tutorial scene. Each tracer gives the same image at any thread count, bit for bit. The wavefront one
+        // adds the same contributions in another order, which may round differently.
+        CreateTutorialScene(&Tutorial);
+        WavefrontState State;
+        const UINT NumPixels = Width * Height;
+        std::vector<XMFLOAT3> Images[2][2]; // Recursive and wavefront, at each thread count.
+        const UINT ThreadCounts[2] = {1, std::max(Threading::GetNumHardwareThreads(), 8u)};
+        UINT NumImages = 0;
+        for (UINT SampleIndex = 0; SampleIndex < 2; ++SampleIndex)
+        {
+            Settings TestSettings;
+            TestSettings.Width = Width;
+            TestSettings.Height = Height;
+            TestSettings.SampleIndex = SampleIndex;
+            for (UINT t = 0; t < _countof(ThreadCounts); ++t)
+            {
+                TestSettings.NumThreads = ThreadCounts[t];
+                Images[0][t].assign(NumPixels, XMFLOAT3(-1.f, -1.f, -1.f));
+                Images[1][t].assign(NumPixels, XMFLOAT3(-1.f, -1.f, -1.f));
+                RenderRecursive(Tutorial, TestSettings, Images[0][t].data());
+                RenderWavefront(Tutorial, TestSettings, &State, Images[1][t].data());
+                NumImages += 2;
+            }
+
+            for (UINT Tracer = 0; Tracer < 2; ++Tracer)
+            {
+                NumErrors += memcmp(Images[Tracer][0].data(), Images[Tracer][1].data(),
+                                    NumPixels * sizeof(XMFLOAT3)) != 0;
+            }
+            for (UINT p = 0; p < NumPixels; ++p)
+            {
+                const XMFLOAT3& Recursive = Images[0][0][p];
+                const XMFLOAT3& Wavefront = Images[1][0][p];
+                NumErrors += fabsf(Recursive.x - Wavefront.x) > MaxTracerError ||
+                             fabsf(Recursive.y - Wavefront.y) > MaxTracerError ||
+                             fabsf(Recursive.z - Wavefront.z) > MaxTracerError || Recursive.x < 0.f;
+            }
+        }
+
+        bool Passed = NumErrors == 0;
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "CpuTracer: test %s, %u rays through a BVH %u deep, %u %ux%u images at 1 and %u threads, %u errors\n",
+                 Passed ? "passed" : "FAILED", NumDeepTriangles, Chain->Depth, NumImages, Width, Height,
+                 ThreadCounts[1], NumErrors);
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+
+    void RunBenchmark(const Scene& InScene, UINT Width, UINT Height, UINT NumFrames)
+    {
+        std::vector<XMFLOAT3> Radiance(Width * Height);
+        WavefrontState State;
+
+        const UINT ThreadCounts[3] = {1, 4, Threading::GetNumHardwareThreads()};
+        for (UINT i = 0; i < _countof(ThreadCounts); ++i)
+        {
+            Settings BenchmarkSettings;
+            BenchmarkSettings.Width = Width;
+            BenchmarkSettings.Height = Height;
+            BenchmarkSettings.NumThreads = ThreadCounts[i];
+
+            auto Start = std::chrono::high_resolution_clock::now();
+            for (UINT Frame = 0; Frame < NumFrames; ++Frame)
+            {
+                BenchmarkSettings.SampleIndex = Frame;
+                RenderRecursive(InScene, BenchmarkSettings, Radiance.data());
+            }
+            auto Middle = std::chrono::high_resolution_clock::now();
+            for (UINT Frame = 0; Frame < NumFrames; ++Frame)
+            {
+                BenchmarkSettings.SampleIndex = Frame;
+                RenderWavefront(InScene, BenchmarkSettings, &State, Radiance.data());
+            }
+            auto End = std::chrono::high_resolution_clock::now();
+
+            double RecursiveMs = std::chrono::duration<double, std::milli>(Middle - Start).count() / NumFrames;
+            double WavefrontMs = std::chrono::duration<double, std::milli>(End - Middle).count() / NumFrames;
+            char Message[256];
+            snprintf(Message, sizeof(Message),
+                     "CpuTracer %ux%u, %u thread(s): recursive %.2f ms, wavefront %.2f ms (%.2fx)\n",
+                     Width, Height, ThreadCounts[i], RecursiveMs, WavefrontMs, RecursiveMs / WavefrontMs);
+            OutputDebugStringA(Message);
+        }
+    }
+}
@@ -0,0 +1,313 @@
+#include "Headers/DeferredRelease.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+namespace DeferredRelease
+{
+    UINT64 GetNextValue(const Timeline& InTimeline)
+    {
+        return InTimeline.Signaled.load(std::memory_order_acquire) + 1;
+    }
+
+    UINT64 Signal(Timeline* InTimeline)
+    {
+        return InTimeline->Signaled.fetch_add(1, std::memory_order_acq_rel) + 1;
+    }
+
+    void SetCompleted(Timeline* InTimeline, UINT64 CompletedValue)
+    {
+        UINT64 Completed = InTimeline->Completed.load(std::memory_order_relaxed);
+        while (Completed < CompletedValue &&
+               !InTimeline->Completed.compare_exchange_weak(Completed, CompletedValue, std::memory_order_release,
+                                                            std::memory_order_relaxed))
+        {
+        }
+    }
+
+    bool IsCompleted(const Timeline& InTimeline, UINT64 Value)
+    {
+        return Value <= InTimeline.Completed.load(std::memory_order_acquire);
+    }
+
+    UINT AddTimeline(Queue* InQueue, Timeline* InTimeline)
+    {
+        assert(InQueue->NumTimelines < MaxTimelines);
+        InQueue->Timelines[InQueue->NumTimelines] = InTimeline;
+        return InQueue->NumTimelines++;
+    }
+
+    void SetReleaseFunction(Queue* InQueue, UINT Type, ReleaseFunction Release, void* Context)
+    {
+        assert(Type < MaxTypes);
+        InQueue->Releases[Type] = Release;
+        InQueue->Contexts[Type] = Context;
+    }
+
+    void Enqueue(Queue* InQueue, const Item& Release)
+    {
+        assert(Release.Retire.Timeline < InQueue->NumTimelines && InQueue->Releases[Release.Type] != nullptr);
+        Item* Queued = new Item(Release);
+        Queued->Next = InQueue->Incoming.load(std::memory_order_relaxed);
+        while (!InQueue->Incoming.compare_exchange_weak(Queued->Next, Queued, std::memory_order_release,
+                                                        std::memory_order_relaxed))
+        {
+        }
+        InQueue->NumEnqueued.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static bool IsLater(const Item* A, const Item* B)
+    {
+        return A->Retire.Value > B->Retire.Value;
+    }
+
+    static void Release(Queue* InQueue, Item* Released)
+    {
+        InQueue->Releases[Released->Type](InQueue->Contexts[Released->Type], *Released);
+        InQueue->NumReleased++;
+        InQueue->NumPending--;
+        delete Released;
+    }
+
+    // Takes everything enqueued so far off the shared list.
+    static void TakeIncoming(Queue* InQueue)
+    {
+        Item* Incoming = InQueue->Incoming.exchange(nullptr, std::memory_order_acquire);
+        while (Incoming)
+        {
+            Item* Next = Incoming->Next;
+            std::vector<Item*>& Pending = InQueue->Pending[Incoming->Retire.Timeline];
+            Pending.push_back(Incoming);
+            std::push_heap(Pending.begin(), Pending.end(), IsLater);
+            InQueue->NumPending++;
+            Incoming = Next;
+        }
+    }
+
+    UINT Collect(Queue* InQueue)
+    {
+        TakeIncoming(InQueue);
+        UINT NumReleased = 0;
+        for (UINT Index = 0; Index < InQueue->NumTimelines; ++Index)
+        {
+            std::vector<Item*>& Pending = InQueue->Pending[Index];
+            UINT64 Completed = InQueue->Timelines[Index]->Completed.load(std::memory_order_acquire);
+            while (!Pending.empty() && Pending.front()->Retire.Value <= Completed)
+            {
+                std::pop_heap(Pending.begin(), Pending.end(), IsLater);
+                Item* Released = Pending.back();
+                Pending.pop_back();
+                Release(InQueue, Released);
+                NumReleased++;
+            }
+        }
+        return NumReleased;
+    }
+
+    UINT Flush(Queue* InQueue)
+    {
+        TakeIncoming(InQueue);
+        UINT NumReleased = 0;
+        for (UINT Index = 0; Index < InQueue->NumTimelines; ++Index)
+        {
+            for (Item* Released : InQueue->Pending[Index])
+            {
+                Release(InQueue, Released);
+                NumReleased++;
+            }
+            InQueue->Pending[Index].clear();
+        }
+        return NumReleased;
+    }
+
+    static UINT32 NextRandom(UINT32* State)
+    {
+        *State = *State * 1664525u + 1013904223u;
+        return *State >> 8;
+    }
+
+    bool RunTest(UINT NumReleases, UINT NumThreads)
+    {
+        const UINT NumTestTimelines = 4; // The three queues and the frame fence.
+        Timeline Timelines[NumTestTimelines];
+        Queue TestQueue;
+        for (UINT i = 0; i < NumTestTimelines; ++i)
+        {
+            AddTimeline(&TestQueue, &Timelines[i]);
+        }
+
+        // Per release, how often it was released. The release function runs on the collecting thread, which is
+        // also the only one completing values, so a release before its point shows up right there.
+        struct Context
+        {
+            Timeline* Timelines;
+            std::unique_ptr<std::atomic<UINT>[]> TimesReleased;
+            std::atomic<UINT> NumErrors{0};
+        };
+        Context Checked;
+        Checked.Timelines = Timelines;
+        Checked.TimesReleased.reset(new std::atomic<UINT>[NumReleases]);
+        for (UINT i = 0; i < NumReleases; ++i)
+        {
+            Checked.TimesReleased[i].store(0);
+        }
+        auto CheckRelease = [](void* InContext, const Item& Released)
+        {
+            Context* Checking = (Context*)InContext;
+            if (!IsCompleted(Checking->Timelines[Released.Retire.Timeline], Released.Retire.Value) ||
+                Checking->TimesReleased[Released.Values[0]].fetch_add(1) != 0 || Released.Values[1] != Released.Type)
+            {
+                Checking->NumErrors++;
+            }
+        };
+        for (UINT Type = 0; Type < 3; ++Type)
+        {
+            SetReleaseFunction(&TestQueue, Type, CheckRelease, &Checked);
+        }
+
+        // Workers release at the next value, sometimes at one that's done or a few ahead, a frame's share at a time.
+        const UINT ReleasesPerFrame = 256; // Per thread.
+        std::atomic<UINT> CurrentFrame{0};
+        std::atomic<UINT> NumWorkersDone{0};
+        std::vector<std::thread> Workers;
+        for (UINT Thread = 0; Thread < NumThreads; ++Thread)
+        {
+            Workers.emplace_back([&, Thread]()
+            {
+                UINT32 State = 1234 + Thread * 7919u;
+                for (UINT i = Thread, Count = 0; i < NumReleases; i += NumThreads, ++Count)
+                {
+                    while (CurrentFrame.load() < Count / ReleasesPerFrame)
+                    {
+                        std::this_thread::yield();
+                    }
+                    Item Release;
+                    Release.Retire.Timeline = NextRandom(&State) % NumTestTimelines;
+                    UINT64 Next = GetNextValue(Timelines[Release.Retire.Timeline]);
+                    UINT Choice = NextRandom(&State) % 8;
+                    Release.Retire.Value = Choice == 0 ? Next - std::min<UINT64>(Next, 3)
+                                                       : Next + (Choice == 1 ? 2 : 0);
+                    Release.Type = NextRandom(&State) % 3;
+                    Release.Values[0] = i;
+                    Release.Values[1] = Release.Type;
+                    Enqueue(&TestQueue, Release);
+                }
+                NumWorkersDone++;
+            });
+        }
+
+        // The queues signal at random and the GPU catches up a few values behind.
+        UINT32 State = 99;
+        UINT NumFrames = 0;
+        UINT NumHeldBack = 0; // Pending after a collect although their point completed.
+        for (bool Done = false; !Done; ++NumFrames)
+        {
+            Done = NumWorkersDone.load() == NumThreads; // Collect once more after the last enqueue.
+            for (UINT i = 0; i < NumTestTimelines; ++i)
+            {
+                if (NextRandom(&State) % 2 == 0)
+                {
+                    Signal(&Timelines[i]);
+                }
+                UINT64 Signaled = Timelines[i].Signaled.load();
+                UINT64 Lag = Done ? 0 : NextRandom(&State) % 4;
+                SetCompleted(&Timelines[i], Signaled > Lag ? Signaled - Lag : 0);
+            }
+            Collect(&TestQueue);
+            CurrentFrame++;
+            for (UINT i = 0; i < NumTestTimelines; ++i)
+            {
+                const std::vector<Item*>& Pending = TestQueue.Pending[i];
+                if (!Pending.empty() && IsCompleted(Timelines[i], Pending.front()->Retire.Value))
+                {
+                    NumHeldBack++;
+                }
+            }
+
+            // Values ahead of the last signal need a few more.
+            if (Done && TestQueue.NumPending > 0)
+            {
+                for (UINT i = 0; i < NumTestTimelines; ++i)
+                {
+                    Signal(&Timelines[i]);
+                }
+                Done = false;
+            }
+        }
+        for (std::thread& Worker : Workers)
+        {
+            Worker.join();
+        }
+
+        UINT NumErrors = Checked.NumErrors.load() + NumHeldBack;
+        for (UINT i = 0; i < NumReleases; ++i)
+        {
+            if (Checked.TimesReleased[i].load() != 1)
+            {
+                NumErrors++;
+            }
+        }
+        if (TestQueue.NumReleased != NumReleases || TestQueue.NumEnqueued.load() != NumReleases ||
+            Flush(&TestQueue) != 0)
+        {
+            NumErrors++;
+        }
+
+        bool Passed = NumErrors == 0;
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "DeferredRelease: test %s, %u releases from %u threads on %u timelines over %u frames, %u errors\n",
+                 Passed ? "passed" : "FAILED", NumReleases, NumThreads, NumTestTimelines, NumFrames, NumErrors);
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+
+    void RunBenchmark(UINT NumReleases, UINT NumThreads)
+    {
+        Timeline BenchmarkTimeline;
+        Queue BenchmarkQueue;
+        AddTimeline(&BenchmarkQueue, &BenchmarkTimeline);
+        SetReleaseFunction(&BenchmarkQueue, 0, [](void*, const Item&) {}, nullptr);
+
+        // Everyone releasing at once, the worst case for the shared list.
+        auto Start = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> Workers;
+        for (UINT Thread = 0; Thread < NumThreads; ++Thread)
+        {
+            Workers.emplace_back([&, Thread]()
+            {
+                Item Release;
+                for (UINT i = Thread; i < NumReleases; i += NumThreads)
+                {
+                    Release.Retire.Value = i / 1024 + 1;
+                    Enqueue(&BenchmarkQueue, Release);
+                }
+            });
+        }
+        for (std::thread& Worker : Workers)
+        {
+            Worker.join();
+        }
+        auto End = std::chrono::high_resolution_clock::now();
+        double EnqueueSeconds = std::chrono::duration<double>(End - Start).count();
+
+        // A frame's worth at a time.
+        Start = std::chrono::high_resolution_clock::now();
+        UINT NumFrames = 0;
+        for (UINT64 Value = 1; BenchmarkQueue.NumReleased < NumReleases; ++Value, ++NumFrames)
+        {
+            SetCompleted(&BenchmarkTimeline, Value);
+            Collect(&BenchmarkQueue);
+        }
+        End = std::chrono::high_resolution_clock::now();
+        double CollectSeconds = std::chrono::duration<double>(End - Start).count();
+
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "DeferredRelease: %u releases on %u threads, %.1f M queued/s, %.1f M collected/s over %u frames\n",
+                 NumReleases, NumThreads, NumReleases / EnqueueSeconds * 1e-6, NumReleases / CollectSeconds * 1e-6,
+                 NumFrames);
+        OutputDebugStringA(Message);
+    }
+}
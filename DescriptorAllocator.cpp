@@ -0,0 +1,279 @@
+#include "Headers/DescriptorAllocator.h"
+#include "Headers/Threading.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+namespace DescriptorAllocator
+{
+    static UINT GetGeneration(Handle InHandle)
+    {
+        return InHandle >> IndexBits;
+    }
+
+    void Initialize(Heap* InHeap, UINT NumPersistent, UINT NumTransientPerFrame, UINT NumFrames,
+                    SIZE_T CpuStart, UINT64 GpuStart, UINT IncrementSize)
+    {
+        assert(NumPersistent > 0 && NumFrames > 0 && NumFrames <= MaxFrames);
+        assert((UINT64)NumPersistent + (UINT64)NumTransientPerFrame * NumFrames <= MaxDescriptors);
+
+        InHeap->CpuStart = CpuStart;
+        InHeap->GpuStart = GpuStart;
+        InHeap->IncrementSize = IncrementSize;
+        InHeap->NumPersistent = NumPersistent;
+        InHeap->NumTransientPerFrame = NumTransientPerFrame;
+        InHeap->NumFrames = NumFrames;
+
+        HeapAllocator::Initialize(&InHeap->Ranges, NumPersistent, 1);
+        InHeap->Blocks.assign(NumPersistent, HeapAllocator::InvalidBlock);
+        InHeap->Generations.assign(NumPersistent, 1);
+
+        for (UINT Frame = 0; Frame < MaxFrames; ++Frame)
+        {
+            InHeap->TransientCounts[Frame].store(0);
+        }
+        InHeap->CurrentFrame.store(0);
+    }
+
+    Handle Allocate(Heap* InHeap, UINT Count)
+    {
+        assert(Count > 0);
+        std::lock_guard<std::mutex> Guard(InHeap->Lock);
+        HeapAllocator::Allocation Range;
+        if (!HeapAllocator::Allocate(&InHeap->Ranges, Count, &Range))
+        {
+            return InvalidHandle;
+        }
+        UINT Index = (UINT)Range.Offset;
+        InHeap->Blocks[Index] = Range.Block;
+        return ((Handle)InHeap->Generations[Index] << IndexBits) | Index;
+    }
+
+    static bool IsLive(const Heap& InHeap, Handle InHandle)
+    {
+        UINT Index = GetIndex(InHandle);
+        return Index < InHeap.NumPersistent && InHeap.Blocks[Index] != HeapAllocator::InvalidBlock &&
+               InHeap.Generations[Index] == GetGeneration(InHandle);
+    }
+
+    bool Free(Heap* InHeap, Handle InHandle)
+    {
+        std::lock_guard<std::mutex> Guard(InHeap->Lock);
+        if (!IsLive(*InHeap, InHandle))
+        {
+            return false;
+        }
+
+        UINT Index = GetIndex(InHandle);
+        HeapAllocator::Allocation Range;
+        Range.Block = InHeap->Blocks[Index];
+        HeapAllocator::Free(&InHeap->Ranges, Range);
+        InHeap->Blocks[Index] = HeapAllocator::InvalidBlock;
+
+        // Skip 0 when wrapping so InvalidHandle stays invalid.
+        UINT Generation = InHeap->Generations[Index] + 1;
+        InHeap->Generations[Index] = (UINT16)(Generation > GenerationMask ? 1 : Generation);
+        return true;
+    }
+
+    bool IsValid(const Heap& InHeap, Handle InHandle)
+    {
+        std::lock_guard<std::mutex> Guard(InHeap.Lock);
+        return IsLive(InHeap, InHandle);
+    }
+
+    void BeginFrame(Heap* InHeap, UINT FrameIndex)
+    {
+        assert(FrameIndex < InHeap->NumFrames);
+        InHeap->TransientCounts[FrameIndex].store(0, std::memory_order_relaxed);
+        InHeap->CurrentFrame.store(FrameIndex, std::memory_order_release);
+    }
+
+    bool AllocateTransient(Heap* InHeap, UINT Count, UINT* OutIndex)
+    {
+        UINT Frame = InHeap->CurrentFrame.load(std::memory_order_acquire);
+        UINT First = InHeap->TransientCounts[Frame].fetch_add(Count, std::memory_order_relaxed);
+        if (First + Count > InHeap->NumTransientPerFrame)
+        {
+            return false;
+        }
+        *OutIndex = InHeap->NumPersistent + Frame * InHeap->NumTransientPerFrame + First;
+        return true;
+    }
+
+    SIZE_T GetCpuHandle(const Heap& InHeap, UINT Index)
+    {
+        return InHeap.CpuStart + (SIZE_T)Index * InHeap.IncrementSize;
+    }
+
+    UINT64 GetGpuHandle(const Heap& InHeap, UINT Index)
+    {
+        return InHeap.GpuStart + (UINT64)Index * InHeap.IncrementSize;
+    }
+
+    static UINT32 NextRandom(UINT32* State)
+    {
+        *State = *State * 1664525u + 1013904223u;
+        return *State >> 8;
+    }
+
+    bool RunTest(UINT NumOperations, UINT NumThreads)
+    {
+        const UINT NumPersistent = 4096;
+        const UINT NumTransientPerFrame = 1024;
+        const UINT NumFrames = 3;
+        const UINT OperationsPerFrame = 20000;
+        const UINT FakeIncrementSize = 32;
+
+        Heap TestHeap;
+        Initialize(&TestHeap, NumPersistent, NumTransientPerFrame, NumFrames, 0x100000, 0x20000000000ull,
+                   FakeIncrementSize);
+
+        // Which slots are taken, set and cleared by the owners so two threads holding one slot shows up.
+        const UINT NumSlots = NumPersistent + NumTransientPerFrame * NumFrames;
+        std::unique_ptr<std::atomic<UINT8>[]> Owned(new std::atomic<UINT8>[NumSlots]);
+        for (UINT Slot = 0; Slot < NumSlots; ++Slot)
+        {
+            Owned[Slot].store(0);
+        }
+        std::atomic<UINT> NumErrors{0};
+        auto Claim = [&](UINT First, UINT Count, UINT8 Value)
+        {
+            for (UINT Slot = First; Slot < First + Count; ++Slot)
+            {
+                if (Slot >= NumSlots || Owned[Slot].exchange(Value) == Value)
+                {
+                    NumErrors++;
+                }
+            }
+        };
+
+        UINT NumTestFrames = std::max(NumOperations / OperationsPerFrame, 1u);
+        for (UINT FrameNumber = 0; FrameNumber < NumTestFrames; ++FrameNumber)
+        {
+            // The previous use of this region completed.
+            UINT FrameIndex = FrameNumber % NumFrames;
+            BeginFrame(&TestHeap, FrameIndex);
+            UINT RegionStart = NumPersistent + FrameIndex * NumTransientPerFrame;
+            for (UINT Slot = RegionStart; Slot < RegionStart + NumTransientPerFrame; ++Slot)
+            {
+                Owned[Slot].store(0);
+            }
+
+            Threading::ParallelFor(OperationsPerFrame, NumThreads, 2000, [&](UINT Begin, UINT End)
+            {
+                UINT32 State = Begin * 7919u + FrameNumber;
+                std::vector<std::pair<Handle, UINT>> Live;
+                for (UINT Operation = Begin; Operation < End; ++Operation)
+                {
+                    UINT Choice = NextRandom(&State) % 100;
+                    if (Choice < 45)
+                    {
+                        UINT Count = 1 + NextRandom(&State) % 8;
+                        Handle Allocated = Allocate(&TestHeap, Count);
+                        if (Allocated != InvalidHandle)
+                        {
+                            Claim(GetIndex(Allocated), Count, 1);
+                            if (GetCpuHandle(TestHeap, GetIndex(Allocated)) !=
+                                0x100000 + GetIndex(Allocated) * FakeIncrementSize)
+                            {
+                                NumErrors++;
+                            }
+                            Live.push_back({Allocated, Count});
+                        }
+                    }
+                    else if (Choice < 90 && !Live.empty())
+                    {
+                        UINT Index = NextRandom(&State) % (UINT)Live.size();
+                        Handle Freed = Live[Index].first;
+                        Claim(GetIndex(Freed), Live[Index].second, 0);
+                        if (!Free(&TestHeap, Freed) || Free(&TestHeap, Freed) || IsValid(TestHeap, Freed))
+                        {
+                            NumErrors++;
+                        }
+                        Live[Index] = Live.back();
+                        Live.pop_back();
+                    }
+                    else
+                    {
+                        UINT Count = 1 + NextRandom(&State) % 4;
+                        UINT First;
+                        if (AllocateTransient(&TestHeap, Count, &First))
+                        {
+                            if (First < RegionStart || First + Count > RegionStart + NumTransientPerFrame)
+                            {
+                                NumErrors++;
+                            }
+                            Claim(First, Count, 1);
+                        }
+                    }
+                }
+                for (const auto& Current : Live)
+                {
+                    Claim(GetIndex(Current.first), Current.second, 0);
+                    if (!IsValid(TestHeap, Current.first) || !Free(&TestHeap, Current.first))
+                    {
+                        NumErrors++;
+                    }
+                }
+            });
+
+            if (!HeapAllocator::IsEmpty(TestHeap.Ranges) || !HeapAllocator::Validate(TestHeap.Ranges))
+            {
+                NumErrors++;
+            }
+        }
+
+        bool Passed = NumErrors.load() == 0 && Free(&TestHeap, InvalidHandle) == false;
+        char Message[256];
+        snprintf(Message, sizeof(Message), "DescriptorAllocator: test %s, %u operations on %u threads, %u errors\n",
+                 Passed ? "passed" : "FAILED", NumTestFrames * OperationsPerFrame, NumThreads, NumErrors.load());
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+
+    void RunBenchmark(UINT NumOperations, UINT NumThreads)
+    {
+        const UINT NumTransientPerFrame = 65536;
+        Heap BenchmarkHeap;
+        Initialize(&BenchmarkHeap, 65536, NumTransientPerFrame, 2, 0, 0, 32);
+
+        // A resource's lifetime: one view created and released.
+        auto Start = std::chrono::high_resolution_clock::now();
+        Threading::ParallelFor(NumOperations, NumThreads, 4096, [&](UINT Begin, UINT End)
+        {
+            for (UINT i = Begin; i < End; ++i)
+            {
+                Free(&BenchmarkHeap, Allocate(&BenchmarkHeap));
+            }
+        });
+        auto End = std::chrono::high_resolution_clock::now();
+        double PersistentSeconds = std::chrono::duration<double>(End - Start).count();
+
+        // A frame's worth of transient views at a time.
+        Start = std::chrono::high_resolution_clock::now();
+        for (UINT First = 0, FrameIndex = 0; First < NumOperations; First += NumTransientPerFrame, FrameIndex ^= 1)
+        {
+            BeginFrame(&BenchmarkHeap, FrameIndex);
+            Threading::ParallelFor(std::min(NumTransientPerFrame, NumOperations - First), NumThreads, 4096,
+                                   [&](UINT Begin, UINT End)
+            {
+                for (UINT i = Begin; i < End; ++i)
+                {
+                    UINT Index;
+                    AllocateTransient(&BenchmarkHeap, 1, &Index);
+                }
+            });
+        }
+        End = std::chrono::high_resolution_clock::now();
+        double TransientSeconds = std::chrono::duration<double>(End - Start).count();
+
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "DescriptorAllocator: %u operations on %u threads, %.1f M persistent allocate+free/s, "
+                 "%.1f M transient/s\n",
+                 NumOperations, NumThreads, NumOperations / PersistentSeconds * 1e-6,
+                 NumOperations / TransientSeconds * 1e-6);
+        OutputDebugStringA(Message);
+    }
+}
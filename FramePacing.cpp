@@ -0,0 +1,196 @@
+#include "Headers/FramePacing.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace FramePacing
+{
+    Settings Clamp(Settings InSettings)
+    {
+        InSettings.FramesInFlight = std::min(std::max(InSettings.FramesInFlight, MinFramesInFlight), MaxFramesInFlight);
+        InSettings.MaxLatency = std::min(std::max(InSettings.MaxLatency, 1u), InSettings.FramesInFlight);
+        return InSettings;
+    }
+
+    void Reset(Telemetry* InTelemetry)
+    {
+        InTelemetry->InFlight.clear();
+        InTelemetry->NumSamples = 0;
+        InTelemetry->NextSample = 0;
+        InTelemetry->LastStart = -1;
+    }
+
+    void BeginFrame(Telemetry* InTelemetry, UINT64 FenceValue, double Time, double Waited)
+    {
+        assert(InTelemetry->InFlight.empty() || InTelemetry->InFlight.back().FenceValue < FenceValue);
+        PendingFrame Frame;
+        Frame.FenceValue = FenceValue;
+        Frame.Start = Time;
+        Frame.Waited = Waited;
+        Frame.FrameTime = InTelemetry->LastStart < 0 ? 0 : Time - InTelemetry->LastStart;
+        InTelemetry->InFlight.push_back(Frame);
+        InTelemetry->LastStart = Time;
+    }
+
+    void CompleteFrames(Telemetry* InTelemetry, UINT64 CompletedFenceValue, double Time)
+    {
+        while (!InTelemetry->InFlight.empty() && InTelemetry->InFlight.front().FenceValue <= CompletedFenceValue)
+        {
+            const PendingFrame& Frame = InTelemetry->InFlight.front();
+            if (Frame.FrameTime > 0) // The first has nothing to measure from.
+            {
+                Sample& Current = InTelemetry->History[InTelemetry->NextSample];
+                Current.FrameTime = Frame.FrameTime;
+                Current.Latency = Time - Frame.Start;
+                Current.Waited = Frame.Waited;
+                InTelemetry->NextSample = (InTelemetry->NextSample + 1) % HistorySize;
+                InTelemetry->NumSamples = std::min(InTelemetry->NumSamples + 1, HistorySize);
+            }
+            InTelemetry->InFlight.pop_front();
+        }
+    }
+
+    static double GetPercentile(std::vector<double>* Values, double Fraction)
+    {
+        size_t Index = std::min((size_t)(Fraction * Values->size()), Values->size() - 1);
+        std::nth_element(Values->begin(), Values->begin() + Index, Values->end());
+        return (*Values)[Index];
+    }
+
+    Summary Summarize(const Telemetry& InTelemetry)
+    {
+        Summary Result;
+        Result.NumFrames = InTelemetry.NumSamples;
+        if (InTelemetry.NumSamples == 0)
+        {
+            return Result;
+        }
+
+        std::vector<double> FrameTimes(InTelemetry.NumSamples);
+        std::vector<double> Latencies(InTelemetry.NumSamples);
+        double TotalFrameTime = 0;
+        double TotalLatency = 0;
+        double TotalWaited = 0;
+        for (UINT i = 0; i < InTelemetry.NumSamples; ++i)
+        {
+            const Sample& Current = InTelemetry.History[i];
+            FrameTimes[i] = Current.FrameTime;
+            Latencies[i] = Current.Latency;
+            TotalFrameTime += Current.FrameTime;
+            TotalLatency += Current.Latency;
+            TotalWaited += Current.Waited;
+        }
+        Result.FramesPerSecond = InTelemetry.NumSamples / TotalFrameTime;
+        Result.AverageFrameMs = TotalFrameTime * 1000.0 / InTelemetry.NumSamples;
+        Result.AverageLatencyMs = TotalLatency * 1000.0 / InTelemetry.NumSamples;
+        Result.AverageWaitMs = TotalWaited * 1000.0 / InTelemetry.NumSamples;
+        Result.P99FrameMs = GetPercentile(&FrameTimes, 0.99) * 1000.0;
+        Result.P99LatencyMs = GetPercentile(&Latencies, 0.99) * 1000.0;
+        return Result;
+    }
+
+    static void PrintSummary(const char* Label, const Settings& InSettings, const Summary& InSummary)
+    {
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "FramePacing: %s%u frames in flight, max latency %u: %.1f fps, frame %.2f ms (p99 %.2f), "
+                 "latency %.2f ms (p99 %.2f), waited %.2f ms\n",
+                 Label, InSettings.FramesInFlight, InSettings.MaxLatency, InSummary.FramesPerSecond,
+                 InSummary.AverageFrameMs, InSummary.P99FrameMs, InSummary.AverageLatencyMs, InSummary.P99LatencyMs,
+                 InSummary.AverageWaitMs);
+        OutputDebugStringA(Message);
+    }
+
+    void Report(Telemetry* InTelemetry, const Settings& InSettings, double Time, double Interval)
+    {
+        if (Time - InTelemetry->LastReport < Interval || InTelemetry->NumSamples < HistorySize)
+        {
+            return;
+        }
+        InTelemetry->LastReport = Time;
+        PrintSummary("", InSettings, Summarize(*InTelemetry));
+    }
+
+    static UINT32 NextRandom(UINT32* State)
+    {
+        *State = *State * 1664525u + 1013904223u;
+        return *State >> 8;
+    }
+
+    // +-25%, and one frame in 20 twice as long.
+    static double Jitter(UINT32* State, double Milliseconds)
+    {
+        double Scale = 0.75 + (NextRandom(State) % 1000) * 0.0005;
+        if (NextRandom(State) % 20 == 0)
+        {
+            Scale *= 2.0;
+        }
+        return Milliseconds * Scale * 0.001;
+    }
+
+    void RunBenchmark(UINT NumFrames)
+    {
+        struct Scenario
+        {
+            const char* Name;
+            double CpuMs;
+            double GpuMs;
+            double VSyncMs; // 0 presents without waiting for vsync.
+        };
+        const Scenario Scenarios[] = {
+            {"CPU-bound", 12.0, 8.0, 0.0},
+            {"GPU-bound", 8.0, 12.0, 0.0},
+            {"60 Hz vsync", 10.0, 12.0, 1000.0 / 60.0},
+        };
+
+        std::vector<double> GpuDone(NumFrames);
+        std::vector<double> Presented(NumFrames);
+        for (const Scenario& Current : Scenarios)
+        {
+            for (UINT FramesInFlight = MinFramesInFlight; FramesInFlight <= MaxFramesInFlight; ++FramesInFlight)
+            {
+                for (UINT MaxLatency = 1; MaxLatency <= FramesInFlight; ++MaxLatency)
+                {
+                    // A frame starts once its resources are free and few enough presents are queued.
+                    Settings Setting;
+                    Setting.FramesInFlight = FramesInFlight;
+                    Setting.MaxLatency = MaxLatency;
+                    Telemetry Simulated;
+                    UINT32 State = 99;
+                    double Submitted = 0;
+                    for (UINT Frame = 0; Frame < NumFrames; ++Frame)
+                    {
+                        double Start = Submitted;
+                        if (Frame >= FramesInFlight)
+                        {
+                            Start = std::max(Start, GpuDone[Frame - FramesInFlight]);
+                        }
+                        if (Frame >= MaxLatency)
+                        {
+                            Start = std::max(Start, Presented[Frame - MaxLatency]);
+                        }
+                        BeginFrame(&Simulated, Frame + 1, Start, Start - Submitted);
+
+                        Submitted = Start + Jitter(&State, Current.CpuMs);
+                        double GpuStart = std::max(Submitted, Frame > 0 ? GpuDone[Frame - 1] : 0.0);
+                        GpuDone[Frame] = GpuStart + Jitter(&State, Current.GpuMs);
+                        Presented[Frame] = GpuDone[Frame];
+                        if (Current.VSyncMs > 0)
+                        {
+                            // The next vblank after the previous flip.
+                            double Period = Current.VSyncMs * 0.001;
+                            double Earliest = std::max(GpuDone[Frame], Frame > 0 ? Presented[Frame - 1] + Period : 0.0);
+                            Presented[Frame] = std::ceil(Earliest / Period) * Period;
+                        }
+                        CompleteFrames(&Simulated, Frame + 1, Presented[Frame]);
+                    }
+
+                    char Label[64];
+                    snprintf(Label, sizeof(Label), "simulated %s (CPU %.0f ms, GPU %.0f ms), ", Current.Name,
+                             Current.CpuMs, Current.GpuMs);
+                    PrintSummary(Label, Setting, Summarize(Simulated));
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,257 @@
+#include "Headers/FrustumCulling.h"
+#include "Headers/InstanceTransforms.h"
+#include "Headers/Threading.h"
+#include <chrono>
+#include <math.h>
+#include <string.h>
+#include <immintrin.h>
+
+using namespace DirectX;
+
+namespace FrustumCulling
+{
+    void ExtractFrustum(FXMMATRIX ViewProjection, Frustum* OutFrustum)
+    {
+        // Gribb-Hartmann on the columns of a row-vector matrix: Clip = Point * ViewProjection.
+        XMMATRIX Columns = XMMatrixTranspose(ViewProjection);
+        XMVECTOR X = Columns.r[0];
+        XMVECTOR Y = Columns.r[1];
+        XMVECTOR Z = Columns.r[2];
+        XMVECTOR W = Columns.r[3];
+        XMVECTOR Planes[6] = {
+            XMVectorAdd(W, X),      // Left.
+            XMVectorSubtract(W, X), // Right.
+            XMVectorAdd(W, Y),      // Bottom.
+            XMVectorSubtract(W, Y), // Top.
+            Z,                      // Near.
+            XMVectorSubtract(W, Z)  // Far.
+        };
+        for (UINT i = 0; i < 6; ++i)
+        {
+            XMStoreFloat4(&OutFrustum->Planes[i], XMPlaneNormalize(Planes[i]));
+        }
+    }
+
+    void Resize(Bounds* InBounds, UINT NumBounds)
+    {
+        InBounds->MinX.resize(NumBounds);
+        InBounds->MinY.resize(NumBounds);
+        InBounds->MinZ.resize(NumBounds);
+        InBounds->MaxX.resize(NumBounds);
+        InBounds->MaxY.resize(NumBounds);
+        InBounds->MaxZ.resize(NumBounds);
+    }
+
+    void SetBounds(Bounds* InBounds, UINT Index, const XMFLOAT3& Min, const XMFLOAT3& Max)
+    {
+        InBounds->MinX[Index] = Min.x;
+        InBounds->MinY[Index] = Min.y;
+        InBounds->MinZ[Index] = Min.z;
+        InBounds->MaxX[Index] = Max.x;
+        InBounds->MaxY[Index] = Max.y;
+        InBounds->MaxZ[Index] = Max.z;
+    }
+
+    bool IsVisible(const Frustum& InFrustum, const XMFLOAT3& Min, const XMFLOAT3& Max)
+    {
+        // Outside as soon as the corner furthest along a plane's normal is behind it.
+        for (const XMFLOAT4& Plane : InFrustum.Planes)
+        {
+            float Distance = Plane.x * (Plane.x > 0.f ? Max.x : Min.x) +
+                Plane.y * (Plane.y > 0.f ? Max.y : Min.y) +
+                Plane.z * (Plane.z > 0.f ? Max.z : Min.z) + Plane.w;
+            if (Distance < 0.f)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // For each 8-bit visibility mask, the lanes to move to the front.
+    struct CompactionTable
+    {
+        alignas(32) UINT32 Lanes[256][8];
+        UINT8 Counts[256];
+
+        CompactionTable()
+        {
+            for (UINT Mask = 0; Mask < 256; ++Mask)
+            {
+                UINT Count = 0;
+                for (UINT Lane = 0; Lane < 8; ++Lane)
+                {
+                    if (Mask & (1 << Lane))
+                    {
+                        Lanes[Mask][Count++] = Lane;
+                    }
+                }
+                for (UINT Lane = Count; Lane < 8; ++Lane)
+                {
+                    Lanes[Mask][Lane] = 0;
+                }
+                Counts[Mask] = (UINT8)Count;
+            }
+        }
+    };
+
+    static UINT CullRange(const Frustum& InFrustum, const Bounds& InBounds, UINT Begin, UINT End, UINT* OutVisible)
+    {
+        static const CompactionTable Table;
+
+        // The corner tested against each plane only depends on the plane, so pick its arrays once.
+        const float* Corners[6][3];
+        __m256 Planes[6][4];
+        for (UINT p = 0; p < 6; ++p)
+        {
+            const XMFLOAT4& Plane = InFrustum.Planes[p];
+            Corners[p][0] = Plane.x > 0.f ? InBounds.MaxX.data() : InBounds.MinX.data();
+            Corners[p][1] = Plane.y > 0.f ? InBounds.MaxY.data() : InBounds.MinY.data();
+            Corners[p][2] = Plane.z > 0.f ? InBounds.MaxZ.data() : InBounds.MinZ.data();
+            Planes[p][0] = _mm256_set1_ps(Plane.x);
+            Planes[p][1] = _mm256_set1_ps(Plane.y);
+            Planes[p][2] = _mm256_set1_ps(Plane.z);
+            Planes[p][3] = _mm256_set1_ps(Plane.w);
+        }
+
+        UINT NumVisible = 0;
+        UINT Index = Begin;
+        for (; Index + BatchSize <= End; Index += BatchSize)
+        {
+            // The sign bit of any plane distance marks the box outside.
+            __m256 Outside = _mm256_setzero_ps();
+            for (UINT p = 0; p < 6; ++p)
+            {
+                __m256 Distance = _mm256_fmadd_ps(Planes[p][0], _mm256_loadu_ps(Corners[p][0] + Index), Planes[p][3]);
+                Distance = _mm256_fmadd_ps(Planes[p][1], _mm256_loadu_ps(Corners[p][1] + Index), Distance);
+                Distance = _mm256_fmadd_ps(Planes[p][2], _mm256_loadu_ps(Corners[p][2] + Index), Distance);
+                Outside = _mm256_or_ps(Outside, Distance);
+            }
+            UINT Mask = ~(UINT)_mm256_movemask_ps(Outside) & 0xFF;
+
+            // Move the visible lanes' indices to the front and advance by how many there are.
+            __m256i Indices = _mm256_add_epi32(_mm256_set1_epi32((int)Index), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+            __m256i Lanes = _mm256_load_si256((const __m256i*)Table.Lanes[Mask]);
+            _mm256_storeu_si256((__m256i*)(OutVisible + NumVisible), _mm256_permutevar8x32_epi32(Indices, Lanes));
+            NumVisible += Table.Counts[Mask];
+        }
+
+        for (; Index < End; ++Index)
+        {
+            XMFLOAT3 Min(InBounds.MinX[Index], InBounds.MinY[Index], InBounds.MinZ[Index]);
+            XMFLOAT3 Max(InBounds.MaxX[Index], InBounds.MaxY[Index], InBounds.MaxZ[Index]);
+            if (IsVisible(InFrustum, Min, Max))
+            {
+                OutVisible[NumVisible++] = Index;
+            }
+        }
+        return NumVisible;
+    }
+
+    UINT Cull(const Frustum& InFrustum, const Bounds& InBounds, UINT NumBounds, UINT* OutVisible, UINT NumThreads)
+    {
+        if (NumBounds < ParallelThreshold || NumThreads <= 1)
+        {
+            return CullRange(InFrustum, InBounds, 0, NumBounds, OutVisible);
+        }
+
+        // Chunks compact in place, then slide down over the gaps the chunks before them left.
+        UINT NumChunks = (NumBounds + GrainSize - 1) / GrainSize;
+        std::vector<UINT> ChunkCounts(NumChunks);
+        Threading::ParallelFor(NumBounds, NumThreads, GrainSize, [&](UINT Begin, UINT End)
+        {
+            ChunkCounts[Begin / GrainSize] = CullRange(InFrustum, InBounds, Begin, End, OutVisible + Begin);
+        });
+
+        UINT NumVisible = ChunkCounts[0];
+        for (UINT Chunk = 1; Chunk < NumChunks; ++Chunk)
+        {
+            memmove(OutVisible + NumVisible, OutVisible + Chunk * GrainSize, ChunkCounts[Chunk] * sizeof(UINT));
+            NumVisible += ChunkCounts[Chunk];
+        }
+        return NumVisible;
+    }
+
+    static float NextRandom(UINT32* Seed)
+    {
+        *Seed = *Seed * 1664525u + 1013904223u;
+        return (float)(*Seed >> 8) / (float)(1 << 24);
+    }
+
+    void RunBenchmark(UINT NumInstances, UINT NumFrames)
+    {
+        // Unit boxes around a camera at the origin looking down -Z, so roughly a sixth of them are visible.
+        Bounds Boxes;
+        Resize(&Boxes, NumInstances);
+        InstanceTransforms::Instances Instances;
+        InstanceTransforms::Resize(&Instances, NumInstances);
+        UINT32 Seed = 0x2545F491;
+        for (UINT i = 0; i < NumInstances; ++i)
+        {
+            XMFLOAT3 Center((NextRandom(&Seed) - 0.5f) * 1000.f,
+                            (NextRandom(&Seed) - 0.5f) * 1000.f,
+                            (NextRandom(&Seed) - 0.5f) * 1000.f);
+            SetBounds(&Boxes, i, XMFLOAT3(Center.x - 0.5f, Center.y - 0.5f, Center.z - 0.5f),
+                      XMFLOAT3(Center.x + 0.5f, Center.y + 0.5f, Center.z + 0.5f));
+            Instances.PositionX[i] = Center.x;
+            Instances.PositionY[i] = Center.y;
+            Instances.PositionZ[i] = Center.z;
+            Instances.Tails[i] = InstanceTransforms::MakeTail(i, VisibleInstanceMask, 0, 0, 0);
+        }
+
+        XMMATRIX View = XMMatrixLookToRH(XMVectorZero(), XMVectorSet(0.f, 0.f, -1.f, 0.f), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+        XMMATRIX Projection = XMMatrixPerspectiveFovRH(XM_PIDIV2, 16.f / 9.f, 1.f, 1000.f);
+        Frustum CameraFrustum;
+        ExtractFrustum(View * Projection, &CameraFrustum);
+
+        std::vector<UINT> Visible(NumInstances);
+        InstanceTransforms::InstanceDesc* Descs =
+            (InstanceTransforms::InstanceDesc*)_mm_malloc(sizeof(InstanceTransforms::InstanceDesc) * NumInstances, 64);
+
+        // Scalar reference.
+        UINT NumVisible = 0;
+        auto Start = std::chrono::high_resolution_clock::now();
+        for (UINT Frame = 0; Frame < NumFrames; ++Frame)
+        {
+            NumVisible = 0;
+            for (UINT i = 0; i < NumInstances; ++i)
+            {
+                XMFLOAT3 Min(Boxes.MinX[i], Boxes.MinY[i], Boxes.MinZ[i]);
+                XMFLOAT3 Max(Boxes.MaxX[i], Boxes.MaxY[i], Boxes.MaxZ[i]);
+                if (IsVisible(CameraFrustum, Min, Max))
+                {
+                    Visible[NumVisible++] = i;
+                }
+            }
+        }
+        auto End = std::chrono::high_resolution_clock::now();
+        double ScalarMs = std::chrono::duration<double, std::milli>(End - Start).count() / NumFrames;
+
+        const UINT ThreadCounts[2] = {1, Threading::GetNumHardwareThreads()};
+        for (UINT t = 0; t < _countof(ThreadCounts); ++t)
+        {
+            double CullMs = 0.0;
+            double CompactMs = 0.0;
+            for (UINT Frame = 0; Frame < NumFrames; ++Frame)
+            {
+                Start = std::chrono::high_resolution_clock::now();
+                NumVisible = Cull(CameraFrustum, Boxes, NumInstances, Visible.data(), ThreadCounts[t]);
+                auto Middle = std::chrono::high_resolution_clock::now();
+                InstanceTransforms::WriteIndexed(Instances, Visible.data(), NumVisible, Descs, ThreadCounts[t]);
+                End = std::chrono::high_resolution_clock::now();
+                CullMs += std::chrono::duration<double, std::milli>(Middle - Start).count();
+                CompactMs += std::chrono::duration<double, std::milli>(End - Middle).count();
+            }
+
+            char Message[256];
+            snprintf(Message, sizeof(Message),
+                     "FrustumCulling %u instances, %u thread(s): %u visible (%.1f%%), scalar cull %.2f ms, "
+                     "AVX2 cull %.2f ms, compaction %.2f ms\n",
+                     NumInstances, ThreadCounts[t], NumVisible, 100.0 * NumVisible / NumInstances, ScalarMs,
+                     CullMs / NumFrames, CompactMs / NumFrames);
+            OutputDebugStringA(Message);
+        }
+
+        _mm_free(Descs);
+    }
+}
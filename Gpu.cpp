@@ -4,6 +4,8 @@
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 #include "tinygltf/tiny_gltf.h"
 #include "Headers/Gpu.h"
+#include <chrono>
+#include <unordered_map>
 
 namespace D3D
 {
@@ -61,9 +63,11 @@ namespace D3D
 
     void CreateCommandLists(ID3D12Device10* Device, Frame* Frames)
     {
-        for (int i = 0; i < GlobalResources::NumBackBuffers; i++)
+        // For the most frames in flight, whichever number the swap chain has.
+        for (UINT i = 0; i < GlobalResources::MaxBackBuffers; i++)
         {
             Frame* FrameData = &Frames[i];
+            FrameData->Index = i;
 
             // Graphics.
             ID3D12GraphicsCommandList7** GraphicsCmdList = FrameData->GraphicsCmdList.GetAddressOf();
@@ -90,14 +94,31 @@ namespace D3D
                                                 IID_PPV_ARGS(ComputeCmdList)));
             Check((*ComputeCmdList)->Close());
             NAME_D3D12_OBJECT_INDEXED(FrameData->ComputeCmdList, i);
+
+            // Barriers resolved at submission.
+            ID3D12GraphicsCommandList7** BarrierCmdList = FrameData->BarrierCmdList.GetAddressOf();
+            ID3D12CommandAllocator** BarrierAllocator = FrameData->BarrierCmdAlloc.GetAddressOf();
+            Check(Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
+                                                     IID_PPV_ARGS(BarrierAllocator)));
+            NAME_D3D12_OBJECT_INDEXED(FrameData->BarrierCmdAlloc, i);
+            Check(Device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+                                                *BarrierAllocator, nullptr,
+                                                IID_PPV_ARGS(BarrierCmdList)));
+            Check((*BarrierCmdList)->Close());
+            NAME_D3D12_OBJECT_INDEXED(FrameData->BarrierCmdList, i);
         }
     }
 
+    // ResizeBuffers needs the same flags.
+    static const UINT SwapChainFlags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH |
+        DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING |
+        DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+
     void CreateSwapchain(IDXGIFactory7* Factory, ID3D12CommandQueue* GraphicsQueue, WindowInfo* Window,
-                         IDXGISwapChain4** SwapChain)
+                         UINT NumBackBuffers, IDXGISwapChain4** SwapChain)
     {
         DXGI_SWAP_CHAIN_DESC Desc = {};
-        Desc.BufferCount = GlobalResources::NumBackBuffers;
+        Desc.BufferCount = NumBackBuffers;
         Desc.BufferDesc.Width = Window->Width;
         Desc.BufferDesc.Height = Window->Height;
         Desc.BufferDesc.Format = GlobalResources::BackBufferFormat;
@@ -106,32 +127,35 @@ namespace D3D
         Desc.OutputWindow = Window->Hwnd;
         Desc.SampleDesc.Count = 1;
         Desc.Windowed = true;
-        Desc.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH |
-            DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING |
-            DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+        Desc.Flags = SwapChainFlags;
 
         IDXGISwapChain* TempSwapChain = nullptr;
         Check(Factory->CreateSwapChain(GraphicsQueue, &Desc, &TempSwapChain));
         Check(TempSwapChain->QueryInterface(IID_PPV_ARGS(SwapChain)));
         TempSwapChain->Release();
 
-        // Name the backbuffers.
-        for (int i = 0; i < GlobalResources::NumBackBuffers; ++i)
+        // Name the backbuffers, without holding on to them so ResizeBuffers can release them.
+        for (UINT i = 0; i < NumBackBuffers; ++i)
         {
-            ID3D12Resource* BackBuffer;
+            ComPtr<ID3D12Resource> BackBuffer;
             Check((*SwapChain)->GetBuffer(i, IID_PPV_ARGS(&BackBuffer)));
             NAME_D3D12_OBJECT_INDEXED(BackBuffer, i);
         }
     }
 
-    void CreateDepthBuffers(ID3D12Device10* Device, Frame* Frames, WindowInfo* Window)
+    void CreateDepthBuffers(ID3D12Device10* Device, Frame* Frames, UINT NumFrames, WindowInfo* Window)
     {
         D3D12_CLEAR_VALUE DepthClearValue = {};
         DepthClearValue.Format = GlobalResources::DepthBufferFormat;
         DepthClearValue.DepthStencil.Depth = 1.f;
         DepthClearValue.DepthStencil.Stencil = 0;
-        for (int i = 0; i < GlobalResources::NumBackBuffers; ++i)
+        for (UINT i = 0; i < GlobalResources::MaxBackBuffers; ++i)
         {
+            Frames[i].DepthBuffer.Reset();
+            if (i >= NumFrames)
+            {
+                continue;
+            }
             CreateCommitted2DTexture(Device,
                                      Window->Width, Window->Height,
                                      D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL,
@@ -154,10 +178,52 @@ namespace D3D
             Check(HRESULT_FROM_WIN32(GetLastError()));
         }
 
-        for (int i = 0; i < GlobalResources::NumBackBuffers; i++)
+        // Nothing recorded with any frame's resources yet.
+        for (UINT i = 0; i < GlobalResources::MaxBackBuffers; i++)
+        {
+            Frames[i].FenceValue = 0;
+        }
+    }
+
+    void CreateQueueTimelines(ID3D12Device10* Device, Global* Dx)
+    {
+        QueueTimelines* Timelines = &Dx->Timelines;
+        QueueScheduler::Reset(&Timelines->Scheduler);
+        Timelines->Queues[(UINT)QueueScheduler::QueueType::Graphics] = Dx->GraphicsQueue.Get();
+        Timelines->Queues[(UINT)QueueScheduler::QueueType::Compute] = Dx->ComputeQueue.Get();
+        Timelines->Queues[(UINT)QueueScheduler::QueueType::Copy] = Dx->CopyQueue.Get();
+        for (UINT i = 0; i < QueueScheduler::NumQueues; ++i)
+        {
+            Check(Device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&Timelines->Fences[i])));
+            SetNameIndexed(Timelines->Fences[i].Get(), L"QueueTimeline", i);
+        }
+    }
+
+    QueueScheduler::SyncPoint Submit(QueueTimelines* Timelines, QueueScheduler::QueueType Queue,
+                                     ID3D12CommandList* const* CmdLists, UINT NumCmdLists,
+                                     const QueueScheduler::SyncPoint* Dependencies, UINT NumDependencies)
+    {
+        // What's done already needs no wait at all.
+        for (UINT i = 0; i < QueueScheduler::NumQueues; ++i)
         {
-            Frames[i].FenceValue = i;
+            UINT64 CompletedValue = Timelines->Fences[i]->GetCompletedValue();
+            QueueScheduler::SetCompleted(&Timelines->Scheduler, (QueueScheduler::QueueType)i, CompletedValue);
+            DeferredRelease::SetCompleted(&Timelines->Values[i], CompletedValue);
         }
+
+        QueueScheduler::Submission Planned = QueueScheduler::Submit(&Timelines->Scheduler, Queue, Dependencies,
+                                                                    NumDependencies);
+        ID3D12CommandQueue* CmdQueue = Timelines->Queues[(UINT)Queue];
+        for (UINT i = 0; i < Planned.NumWaits; ++i)
+        {
+            Check(CmdQueue->Wait(Timelines->Fences[(UINT)Planned.Waits[i].Queue].Get(), Planned.Waits[i].Value));
+        }
+        CmdQueue->ExecuteCommandLists(NumCmdLists, CmdLists);
+        Check(CmdQueue->Signal(Timelines->Fences[(UINT)Queue].Get(), Planned.Signal.Value));
+        UINT64 Signaled = DeferredRelease::Signal(&Timelines->Values[(UINT)Queue]);
+        assert(Signaled == Planned.Signal.Value);
+        (void)Signaled;
+        return Planned.Signal;
     }
 
     void Transition(ID3D12GraphicsCommandList* CmdList,
@@ -174,21 +240,314 @@ namespace D3D
         CmdList->ResourceBarrier(1, &TransitionBarrier);
     }
 
-    void CreateCommittedBuffer(ID3D12Device10* Device, D3D12_HEAP_TYPE HeapType,
-                               UINT64 Size, ID3D12Resource** Buffer,
-                               D3D12_RESOURCE_STATES InitialState, D3D12_RESOURCE_FLAGS Flags)
+    static void EmitBarriers(ID3D12GraphicsCommandList* CmdList, const ResourceStates::Barrier* Barriers, UINT Count)
+    {
+        std::vector<D3D12_RESOURCE_BARRIER> D3DBarriers(Count);
+        for (UINT i = 0; i < Count; ++i)
+        {
+            D3D12_RESOURCE_BARRIER& D3DBarrier = D3DBarriers[i];
+            D3DBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+            if (Barriers[i].Type == ResourceStates::BarrierType::UAV)
+            {
+                D3DBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+                D3DBarrier.UAV.pResource = (ID3D12Resource*)Barriers[i].Resource;
+            }
+            else if (Barriers[i].Type == ResourceStates::BarrierType::Aliasing)
+            {
+                // Whichever resource used the memory before.
+                D3DBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+                D3DBarrier.Aliasing.pResourceBefore = nullptr;
+                D3DBarrier.Aliasing.pResourceAfter = (ID3D12Resource*)Barriers[i].Resource;
+            }
+            else
+            {
+                D3DBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+                D3DBarrier.Transition.pResource = (ID3D12Resource*)Barriers[i].Resource;
+                D3DBarrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+                D3DBarrier.Transition.StateBefore = (D3D12_RESOURCE_STATES)Barriers[i].Before;
+                D3DBarrier.Transition.StateAfter = (D3D12_RESOURCE_STATES)Barriers[i].After;
+            }
+        }
+        CmdList->ResourceBarrier(Count, D3DBarriers.data());
+    }
+
+    UINT FlushBarriers(ID3D12GraphicsCommandList* CmdList, ResourceStates::Tracker* Tracker)
+    {
+        return ResourceStates::Flush(Tracker, [CmdList](const ResourceStates::Barrier* Barriers, UINT Count)
+        {
+            EmitBarriers(CmdList, Barriers, Count);
+        });
+    }
+
+    QueueScheduler::SyncPoint ExecuteTracked(QueueTimelines* Timelines, Frame* CurrentFrame,
+                                             ResourceStates::GlobalStates* Global,
+                                             const QueueScheduler::SyncPoint* Dependencies, UINT NumDependencies)
+    {
+        ID3D12GraphicsCommandList7* CmdList = CurrentFrame->GraphicsCmdList.Get();
+        ResourceStates::Tracker* Tracker = &CurrentFrame->GraphicsStates;
+        FlushBarriers(CmdList, Tracker);
+        Check(CmdList->Close());
+
+        // The frame's earlier submissions completed, so the barrier list can be reset.
+        std::vector<ID3D12CommandList*> CmdLists;
+        CmdLists.reserve(CurrentFrame->RecordedCmdLists.size() + 2);
+        ResourceStates::Resolve(Tracker, Global, [&](const ResourceStates::Barrier* Barriers, UINT Count)
+        {
+            ID3D12GraphicsCommandList7* BarrierCmdList = CurrentFrame->BarrierCmdList.Get();
+            Check(CurrentFrame->BarrierCmdAlloc->Reset());
+            Check(BarrierCmdList->Reset(CurrentFrame->BarrierCmdAlloc.Get(), nullptr));
+            EmitBarriers(BarrierCmdList, Barriers, Count);
+            Check(BarrierCmdList->Close());
+            CmdLists.push_back(BarrierCmdList);
+        });
+        CmdLists.insert(CmdLists.end(), CurrentFrame->RecordedCmdLists.begin(), CurrentFrame->RecordedCmdLists.end());
+        CmdLists.push_back(CmdList);
+        CurrentFrame->RecordedCmdLists.clear();
+        ResourceStates::Reset(Tracker);
+        return Submit(Timelines, QueueScheduler::QueueType::Graphics, CmdLists.data(), (UINT)CmdLists.size(),
+                      Dependencies, NumDependencies);
+    }
+
+    void CreateCommandListPools(D3D12_COMMAND_LIST_TYPE Type, UINT NumFrames, UINT NumThreads,
+                                CommandListPools* Pools)
     {
+        ParallelRecording::Initialize(&Pools->Pools, NumFrames, NumThreads);
+        Pools->Type = Type;
+    }
 
-        if (HeapType == D3D12_HEAP_TYPE_GPU_UPLOAD)
+    void RecordParallel(ID3D12Device10* Device, CommandListPools* Pools, Frame* CurrentFrame, const UINT* Costs,
+                        UINT NumPasses, UINT NumThreads, UINT MinChunkCost,
+                        const std::function<void(ID3D12GraphicsCommandList7* CmdList, UINT Pass)>& Record)
+    {
+        assert(Pools->Pools.CurrentFrame == CurrentFrame->Index);
+        ParallelRecording::Record(&Pools->Pools, Costs, NumPasses, NumThreads, MinChunkCost, &Pools->Chunks,
+                                  [&](const ParallelRecording::Chunk& InChunk, bool IsNew)
         {
-            D3D12_FEATURE_DATA_D3D12_OPTIONS FeatureSupport{};
-            HRESULT HR = Device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS16, &FeatureSupport, sizeof(FeatureSupport));
-            if (FAILED(HR))
+            // Only this thread touches its pool. Creating lists is free-threaded, resetting an allocator is safe
+            // once the frame that last used it is done.
+            std::vector<CommandListPools::Entry>& Entries = Pools->Entries[CurrentFrame->Index][InChunk.Thread];
+            if (IsNew)
+            {
+                CommandListPools::Entry NewEntry;
+                Check(Device->CreateCommandAllocator(Pools->Type, IID_PPV_ARGS(&NewEntry.CmdAlloc)));
+                Check(Device->CreateCommandList(0, Pools->Type, NewEntry.CmdAlloc.Get(), nullptr,
+                                                IID_PPV_ARGS(&NewEntry.CmdList)));
+                Check(NewEntry.CmdList->Close());
+                SetNameIndexed(NewEntry.CmdList.Get(), L"RecordingCmdList", InChunk.Thread);
+                Entries.push_back(NewEntry);
+            }
+            CommandListPools::Entry& Current = Entries[InChunk.List];
+            Check(Current.CmdAlloc->Reset());
+            Check(Current.CmdList->Reset(Current.CmdAlloc.Get(), nullptr));
+            for (UINT Pass = InChunk.FirstPass; Pass < InChunk.FirstPass + InChunk.NumPasses; ++Pass)
             {
-                HeapType = D3D12_HEAP_TYPE_UPLOAD;         
+                Record(Current.CmdList.Get(), Pass);
             }
+            Check(Current.CmdList->Close());
+        });
+
+        for (const ParallelRecording::Chunk& Recorded : Pools->Chunks)
+        {
+            CurrentFrame->RecordedCmdLists.push_back(
+                Pools->Entries[CurrentFrame->Index][Recorded.Thread][Recorded.List].CmdList.Get());
         }
-        
+    }
+
+    void BeginRenderGraph(RenderGraphResources* Graph)
+    {
+        RenderGraph::Reset(&Graph->Graph);
+        Graph->Descs.clear();
+        Graph->Resources.clear();
+    }
+
+    RenderGraph::ResourceId ImportResource(RenderGraphResources* Graph, ID3D12Resource* Resource,
+                                           D3D12_RESOURCE_STATES InitialState, D3D12_RESOURCE_STATES FinalState)
+    {
+        // Which resource it is doesn't change the topology, the back buffer alternates.
+        RenderGraph::ResourceId Id = RenderGraph::Import(&Graph->Graph, InitialState, FinalState);
+        Graph->Descs.push_back(Resource->GetDesc());
+        Graph->Resources.push_back(Resource);
+        return Id;
+    }
+
+    static UINT64 HashResourceDesc(const D3D12_RESOURCE_DESC& Desc)
+    {
+        const UINT64 Fields[] = {(UINT64)Desc.Dimension, Desc.Alignment, Desc.Width, Desc.Height,
+                                 Desc.DepthOrArraySize, Desc.MipLevels, (UINT64)Desc.Format, Desc.SampleDesc.Count,
+                                 Desc.SampleDesc.Quality, (UINT64)Desc.Layout, (UINT64)Desc.Flags};
+        UINT64 Hash = 14695981039346656037ull; // FNV-1a.
+        for (UINT64 Field : Fields)
+        {
+            Hash = (Hash ^ Field) * 1099511628211ull;
+        }
+        return Hash;
+    }
+
+    RenderGraph::ResourceId CreateTransientResource(ID3D12Device10* Device, RenderGraphResources* Graph,
+                                                    const D3D12_RESOURCE_DESC& Desc)
+    {
+        D3D12_RESOURCE_ALLOCATION_INFO Info = Device->GetResourceAllocationInfo(0, 1, &Desc);
+        RenderGraph::HeapGroup Group = RenderGraph::HeapGroup::Textures;
+        if (Desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+        {
+            Group = RenderGraph::HeapGroup::Buffers;
+        }
+        else if (Desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL))
+        {
+            Group = RenderGraph::HeapGroup::RenderTargets;
+        }
+
+        RenderGraph::ResourceId Id = RenderGraph::CreateTransient(&Graph->Graph, Info.SizeInBytes, Info.Alignment,
+                                                                  Group, HashResourceDesc(Desc));
+        Graph->Descs.push_back(Desc);
+        Graph->Resources.push_back(nullptr);
+        return Id;
+    }
+
+    ID3D12Resource* GetResource(const RenderGraphResources& Graph, RenderGraph::ResourceId Resource)
+    {
+        return Graph.Resources[Resource];
+    }
+
+    static void CreateTransients(ID3D12Device10* Device, RenderGraphResources* Graph, ReleaseQueue* Releases,
+                                 const DeferredRelease::RetirePoint& Retire)
+    {
+        // The frames still in flight may use the old ones.
+        for (UINT Group = 0; Group < (UINT)RenderGraph::HeapGroup::Count; ++Group)
+        {
+            if (Graph->Heaps[Group])
+            {
+                DeferRelease(Releases, Retire, Graph->Heaps[Group].Get());
+            }
+        }
+        for (ComPtr<ID3D12Resource>& Transient : Graph->Transients)
+        {
+            if (Transient)
+            {
+                DeferRelease(Releases, Retire, Transient.Get());
+            }
+        }
+
+        const RenderGraph::CompiledGraph& Compiled = Graph->Compiled;
+        const D3D12_HEAP_FLAGS GroupFlags[] = {D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS,
+                                               D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES,
+                                               D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES};
+        for (UINT Group = 0; Group < (UINT)RenderGraph::HeapGroup::Count; ++Group)
+        {
+            Graph->Heaps[Group].Reset();
+            if (Compiled.HeapSizes[Group] == 0)
+            {
+                continue;
+            }
+            D3D12_HEAP_DESC HeapDesc = {};
+            const UINT64 Granularity = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+            HeapDesc.SizeInBytes = AlignTo(Compiled.HeapSizes[Group], Granularity);
+            HeapDesc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
+            HeapDesc.Alignment = Granularity;
+            HeapDesc.Flags = GroupFlags[Group];
+            Check(Device->CreateHeap(&HeapDesc, IID_PPV_ARGS(&Graph->Heaps[Group])));
+            SetNameIndexed(Graph->Heaps[Group].Get(), L"RenderGraphHeap", Group);
+        }
+
+        // Created where they'll be when the next frame starts using them.
+        const UINT NumResources = (UINT)Compiled.Resources.size();
+        Graph->Transients.clear();
+        Graph->Transients.resize(NumResources);
+        for (UINT Resource = 0; Resource < NumResources; ++Resource)
+        {
+            const RenderGraph::ResourceDesc& Desc = Compiled.Resources[Resource];
+            if (Desc.IsImported || !Compiled.IsUsed[Resource])
+            {
+                continue;
+            }
+            Check(Device->CreatePlacedResource(Graph->Heaps[(UINT)Desc.Group].Get(), Compiled.Offsets[Resource],
+                                               &Graph->Descs[Resource],
+                                               (D3D12_RESOURCE_STATES)Compiled.StartStates[Resource], nullptr,
+                                               IID_PPV_ARGS(&Graph->Transients[Resource])));
+            SetNameIndexed(Graph->Transients[Resource].Get(), L"RenderGraphTransient", Resource);
+        }
+    }
+
+    void ExecuteRenderGraph(ID3D12Device10* Device, ID3D12GraphicsCommandList7* CmdList,
+                            ResourceStates::Tracker* Tracker, RenderGraphResources* Graph,
+                            ReleaseQueue* Releases, const DeferredRelease::RetirePoint& Retire)
+    {
+        if (RenderGraph::Compile(Graph->Graph, &Graph->Compiled))
+        {
+            CreateTransients(Device, Graph, Releases, Retire);
+        }
+
+        // Transients are where the last frame left them, imported resources where the graph expects them.
+        const RenderGraph::CompiledGraph& Compiled = Graph->Compiled;
+        for (UINT Resource = 0; Resource < (UINT)Compiled.Resources.size(); ++Resource)
+        {
+            if (!Compiled.IsUsed[Resource])
+            {
+                continue;
+            }
+            if (Compiled.Resources[Resource].IsImported)
+            {
+                ResourceStates::Transition(Tracker, Graph->Resources[Resource], Compiled.StartStates[Resource]);
+            }
+            else
+            {
+                Graph->Resources[Resource] = Graph->Transients[Resource].Get();
+                ResourceStates::SetKnownState(Tracker, Graph->Resources[Resource], Compiled.StartStates[Resource]);
+            }
+        }
+
+        // The tracker infers the same before-states, and the final barriers are left to the next flush.
+        for (UINT Position = 0; Position <= (UINT)Compiled.Order.size(); ++Position)
+        {
+            for (UINT i = Compiled.FirstBarriers[Position]; i < Compiled.FirstBarriers[Position + 1]; ++i)
+            {
+                const RenderGraph::Barrier& Current = Compiled.Barriers[i];
+                ID3D12Resource* Resource = Graph->Resources[Current.Resource];
+                switch (Current.Type)
+                {
+                case ResourceStates::BarrierType::Transition:
+                    ResourceStates::Transition(Tracker, Resource, Current.After);
+                    break;
+                case ResourceStates::BarrierType::UAV:
+                    ResourceStates::UAVBarrier(Tracker, Resource);
+                    break;
+                case ResourceStates::BarrierType::Aliasing:
+                    ResourceStates::AliasingBarrier(Tracker, Resource);
+                    break;
+                }
+            }
+            if (Position == Compiled.Order.size())
+            {
+                break;
+            }
+
+            FlushBarriers(CmdList, Tracker);
+            const std::function<void()>& Execute = Graph->Graph.Executes[Compiled.Order[Position]];
+            if (Execute)
+            {
+                Execute();
+            }
+        }
+    }
+
+    // GPU upload heaps need resizable BAR and a recent runtime, older runtimes fail the query altogether.
+    static bool IsGpuUploadHeapSupported(ID3D12Device10* Device)
+    {
+        D3D12_FEATURE_DATA_D3D12_OPTIONS16 Options16 = {};
+        HRESULT HR = Device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS16, &Options16, sizeof(Options16));
+        return SUCCEEDED(HR) && Options16.GPUUploadHeapSupported;
+    }
+
+    void CreateCommittedBuffer(ID3D12Device10* Device, D3D12_HEAP_TYPE HeapType,
+                               UINT64 Size, ID3D12Resource** Buffer,
+                               D3D12_RESOURCE_STATES InitialState, D3D12_RESOURCE_FLAGS Flags)
+    {
+        // Without them the buffer falls back to system memory, which the CPU writes the same way.
+        if (HeapType == D3D12_HEAP_TYPE_GPU_UPLOAD && !IsGpuUploadHeapSupported(Device))
+        {
+            HeapType = D3D12_HEAP_TYPE_UPLOAD;
+        }
+
         D3D12_HEAP_PROPERTIES HeapDesc = {};
         HeapDesc.Type = HeapType;
 
@@ -238,37 +597,538 @@ namespace D3D
                                               IID_PPV_ARGS(Texture)));
     }
 
+    void CreateGpuMemory(GpuMemory* Memory)
+    {
+        Memory->DefaultBuffers.Type = D3D12_HEAP_TYPE_DEFAULT;
+        Memory->UploadBuffers.Type = D3D12_HEAP_TYPE_UPLOAD;
+        Memory->ReadbackBuffers.Type = D3D12_HEAP_TYPE_READBACK;
+        Memory->Textures.Type = D3D12_HEAP_TYPE_DEFAULT;
+        Memory->Textures.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES;
+    }
+
+    static HeapPool* GetBufferPool(GpuMemory* Memory, D3D12_HEAP_TYPE HeapType)
+    {
+        switch (HeapType)
+        {
+        case D3D12_HEAP_TYPE_DEFAULT:
+            return &Memory->DefaultBuffers;
+        case D3D12_HEAP_TYPE_UPLOAD:
+            return &Memory->UploadBuffers;
+        case D3D12_HEAP_TYPE_READBACK:
+            return &Memory->ReadbackBuffers;
+        default:
+            assert(!"GPU upload and custom heaps are only committed.");
+            return nullptr;
+        }
+    }
+
+    static void AllocateFromPool(ID3D12Device10* Device, HeapPool* Pool, UINT64 Size, PlacedAllocation* Allocation)
+    {
+        Allocation->Pool = Pool;
+        for (UINT Heap = 0; Heap < Pool->Allocators.size(); ++Heap)
+        {
+            if (HeapAllocator::Allocate(&Pool->Allocators[Heap], Size, &Allocation->Range))
+            {
+                Allocation->Heap = Heap;
+                return;
+            }
+        }
+
+        // Every heap is full.
+        const UINT64 Granularity = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+        D3D12_HEAP_DESC HeapDesc = {};
+        HeapDesc.SizeInBytes = std::max(Pool->HeapSize, AlignTo(Size, Granularity));
+        HeapDesc.Properties.Type = Pool->Type;
+        HeapDesc.Alignment = Granularity;
+        HeapDesc.Flags = Pool->Flags;
+
+        ComPtr<ID3D12Heap> Heap;
+        Check(Device->CreateHeap(&HeapDesc, IID_PPV_ARGS(&Heap)));
+        SetNameIndexed(Heap.Get(), L"PlacedResourceHeap", (UINT)Pool->Heaps.size());
+        Pool->Heaps.push_back(Heap);
+        Pool->Allocators.emplace_back();
+        HeapAllocator::Initialize(&Pool->Allocators.back(), HeapDesc.SizeInBytes, Granularity);
+
+        Allocation->Heap = (UINT)Pool->Heaps.size() - 1;
+        bool Allocated = HeapAllocator::Allocate(&Pool->Allocators.back(), Size, &Allocation->Range);
+        assert(Allocated);
+        (void)Allocated;
+    }
+
+    void CreatePlacedBuffer(ID3D12Device10* Device, GpuMemory* Memory, D3D12_HEAP_TYPE HeapType,
+                            UINT64 Size, ID3D12Resource** Buffer,
+                            D3D12_RESOURCE_STATES InitialState, D3D12_RESOURCE_FLAGS Flags,
+                            PlacedAllocation* Allocation)
+    {
+        PlacedAllocation Placement;
+        AllocateFromPool(Device, GetBufferPool(Memory, HeapType), Size, &Placement);
+
+        D3D12_RESOURCE_DESC ResourceDesc = {};
+        ResourceDesc.Height = 1;
+        ResourceDesc.Width = Size;
+        ResourceDesc.DepthOrArraySize = 1;
+        ResourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+        ResourceDesc.Flags = Flags;
+        ResourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+        ResourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+        ResourceDesc.MipLevels = 1;
+        ResourceDesc.SampleDesc.Count = 1;
+        ResourceDesc.SampleDesc.Quality = 0;
+
+        Check(Device->CreatePlacedResource(Placement.Pool->Heaps[Placement.Heap].Get(), Placement.Range.Offset,
+                                           &ResourceDesc, InitialState, nullptr, IID_PPV_ARGS(Buffer)));
+        if (Allocation)
+        {
+            *Allocation = Placement;
+        }
+    }
+
+    void CreatePlaced2DTexture(ID3D12Device10* Device, GpuMemory* Memory,
+                               UINT64 Width,
+                               UINT Height,
+                               D3D12_RESOURCE_FLAGS Flags,
+                               ID3D12Resource** Texture,
+                               D3D12_RESOURCE_STATES InitialState,
+                               DXGI_FORMAT Format,
+                               UINT16 MipLevels,
+                               PlacedAllocation* Allocation)
+    {
+        assert(!(Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)));
+
+        D3D12_RESOURCE_DESC ResourceDesc = {};
+        ResourceDesc.Height = Height;
+        ResourceDesc.Width = Width;
+        ResourceDesc.DepthOrArraySize = 1;
+        ResourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+        ResourceDesc.Flags = Flags;
+        ResourceDesc.Format = Format;
+        ResourceDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+        ResourceDesc.MipLevels = MipLevels;
+        ResourceDesc.SampleDesc.Count = 1;
+        ResourceDesc.SampleDesc.Quality = 0;
+
+        // Multisampled textures would need 4MB alignment.
+        D3D12_RESOURCE_ALLOCATION_INFO Info = Device->GetResourceAllocationInfo(0, 1, &ResourceDesc);
+        assert(Info.Alignment <= D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+
+        PlacedAllocation Placement;
+        AllocateFromPool(Device, &Memory->Textures, Info.SizeInBytes, &Placement);
+        Check(Device->CreatePlacedResource(Placement.Pool->Heaps[Placement.Heap].Get(), Placement.Range.Offset,
+                                           &ResourceDesc, InitialState, nullptr, IID_PPV_ARGS(Texture)));
+        if (Allocation)
+        {
+            *Allocation = Placement;
+        }
+    }
+
+    void ReleasePlaced(const PlacedAllocation& Allocation)
+    {
+        // Emptied heaps are kept for the next resources.
+        HeapAllocator::Free(&Allocation.Pool->Allocators[Allocation.Heap], Allocation.Range);
+    }
+
+    void AllocateSmallBuffer(ID3D12Device10* Device, GpuMemory* Memory, UINT64 Size, SmallBuffer* Buffer)
+    {
+        assert(Size <= SmallBufferPool::MaxBufferSize);
+        SmallBufferPool* Pool = &Memory->SmallUploadBuffers;
+
+        UINT Page = 0;
+        while (Page < Pool->Allocators.size() && !HeapAllocator::Allocate(&Pool->Allocators[Page], Size, &Buffer->Range))
+        {
+            Page++;
+        }
+        if (Page == Pool->Allocators.size())
+        {
+            ComPtr<ID3D12Resource> NewPage;
+            CreatePlacedBuffer(Device, Memory, D3D12_HEAP_TYPE_UPLOAD, SmallBufferPool::PageSize, &NewPage,
+                               D3D12_RESOURCE_STATE_GENERIC_READ);
+            SetNameIndexed(NewPage.Get(), L"SmallBufferPage", Page);
+            UINT8* Mapped = nullptr;
+            Check(NewPage->Map(0, nullptr, (void**)&Mapped));
+
+            Pool->Pages.push_back(NewPage);
+            Pool->MappedPages.push_back(Mapped);
+            Pool->Allocators.emplace_back();
+            HeapAllocator::Initialize(&Pool->Allocators.back(), SmallBufferPool::PageSize, SmallBufferPool::Alignment);
+            bool Allocated = HeapAllocator::Allocate(&Pool->Allocators.back(), Size, &Buffer->Range);
+            assert(Allocated);
+            (void)Allocated;
+        }
+
+        Buffer->Resource = Pool->Pages[Page].Get();
+        Buffer->Offset = Buffer->Range.Offset;
+        Buffer->Size = Size;
+        Buffer->Address = Buffer->Resource->GetGPUVirtualAddress() + Buffer->Offset;
+        Buffer->Mapped = Pool->MappedPages[Page] + Buffer->Offset;
+        Buffer->Page = Page;
+    }
+
+    void FreeSmallBuffer(GpuMemory* Memory, SmallBuffer* Buffer)
+    {
+        HeapAllocator::Free(&Memory->SmallUploadBuffers.Allocators[Buffer->Page], Buffer->Range);
+        *Buffer = SmallBuffer();
+    }
+
+    void CreateBindlessHeap(ID3D12Device10* Device, UINT NumPersistent, UINT NumTransientPerFrame, UINT NumFrames,
+                            BindlessHeap* Descriptors)
+    {
+        D3D12_DESCRIPTOR_HEAP_DESC HeapDesc = {};
+        HeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+        HeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+        HeapDesc.NumDescriptors = NumPersistent + NumTransientPerFrame * NumFrames;
+        Check(Device->CreateDescriptorHeap(&HeapDesc, IID_PPV_ARGS(Descriptors->Heap.ReleaseAndGetAddressOf())));
+        NAME_D3D12_OBJECT(Descriptors->Heap);
+
+        DescriptorAllocator::Initialize(&Descriptors->Allocator, NumPersistent, NumTransientPerFrame, NumFrames,
+                                        Descriptors->Heap->GetCPUDescriptorHandleForHeapStart().ptr,
+                                        Descriptors->Heap->GetGPUDescriptorHandleForHeapStart().ptr,
+                                        Device->GetDescriptorHandleIncrementSize(HeapDesc.Type));
+    }
+
+    D3D12_CPU_DESCRIPTOR_HANDLE GetCpuHandle(const BindlessHeap& Descriptors, UINT Index)
+    {
+        return {DescriptorAllocator::GetCpuHandle(Descriptors.Allocator, Index)};
+    }
+
+    D3D12_GPU_DESCRIPTOR_HANDLE GetGpuHandle(const BindlessHeap& Descriptors, UINT Index)
+    {
+        return {DescriptorAllocator::GetGpuHandle(Descriptors.Allocator, Index)};
+    }
+
+    void CreateUploadRing(ID3D12Device10* Device, UINT64 Capacity, UploadRingBuffer* Ring)
+    {
+        UploadRing::Initialize(&Ring->Ring, Capacity);
+        CreateCommittedBuffer(Device, D3D12_HEAP_TYPE_GPU_UPLOAD, Capacity, Ring->Buffer.ReleaseAndGetAddressOf(),
+                              D3D12_RESOURCE_STATE_GENERIC_READ);
+        NAME_D3D12_OBJECT(Ring->Buffer);
+        Check(Ring->Buffer->Map(0, nullptr, (void**)&Ring->Mapped));
+        Ring->Address = Ring->Buffer->GetGPUVirtualAddress();
+    }
+
+    bool AllocateUpload(UploadRingBuffer* Ring, UINT64 Size, UINT64 Alignment, UploadAllocation* OutAllocation)
+    {
+        UINT64 Offset;
+        if (!UploadRing::Allocate(&Ring->Ring, Size, Alignment, &Offset))
+        {
+            return false;
+        }
+        OutAllocation->Mapped = Ring->Mapped + Offset;
+        OutAllocation->Address = Ring->Address + Offset;
+        return true;
+    }
+
+    void CreateStreamingUploads(ID3D12Device10* Device, UINT64 Capacity, UINT64 BudgetPerFrame,
+                                StreamingUploadBuffer* Streaming)
+    {
+        StreamingUploads::Initialize(&Streaming->Uploader, Capacity, BudgetPerFrame);
+
+        // The copy queue reads it from system memory, unlike the frame uploads the shaders read.
+        CreateCommittedBuffer(Device, D3D12_HEAP_TYPE_UPLOAD, Capacity, Streaming->Buffer.ReleaseAndGetAddressOf(),
+                              D3D12_RESOURCE_STATE_GENERIC_READ);
+        NAME_D3D12_OBJECT(Streaming->Buffer);
+        Check(Streaming->Buffer->Map(0, nullptr, (void**)&Streaming->Mapped));
+
+        for (UINT i = 0; i < StreamingUploadBuffer::NumCmdAllocs; ++i)
+        {
+            Check(Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+                                                 IID_PPV_ARGS(&Streaming->CmdAllocs[i])));
+            NAME_D3D12_OBJECT_INDEXED(Streaming->CmdAllocs[i], i);
+            Streaming->CmdAllocFenceValues[i] = 0;
+        }
+        Check(Device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, Streaming->CmdAllocs[0].Get(), nullptr,
+                                        IID_PPV_ARGS(&Streaming->CmdList)));
+        Check(Streaming->CmdList->Close());
+        NAME_D3D12_OBJECT(Streaming->CmdList);
+    }
+
+    StreamingUploads::Ticket StreamBuffer(StreamingUploadBuffer* Streaming, ID3D12Resource* Destination,
+                                          UINT64 Offset, const void* Data, UINT64 Size)
+    {
+        StreamingUploadBuffer::Destination Queued;
+        Queued.Resource = Destination;
+        Queued.Offset = Offset;
+        Queued.Data.assign((const UINT8*)Data, (const UINT8*)Data + Size);
+        Streaming->Queued.push_back(std::move(Queued));
+        return StreamingUploads::Enqueue(&Streaming->Uploader, Size, 16);
+    }
+
+    StreamingUploads::Ticket StreamTexture(ID3D12Device10* Device, StreamingUploadBuffer* Streaming,
+                                           ID3D12Resource* Destination, UINT Subresource, const void* Data,
+                                           UINT64 RowPitch)
+    {
+        StreamingUploadBuffer::Destination Queued;
+        Queued.Resource = Destination;
+        Queued.Subresource = Subresource;
+        Queued.IsTexture = true;
+
+        D3D12_RESOURCE_DESC Desc = Destination->GetDesc();
+        UINT64 Size;
+        Device->GetCopyableFootprints(&Desc, Subresource, 1, 0, &Queued.Footprint, &Queued.NumRows,
+                                      &Queued.RowSize, &Size);
+        Queued.NumRows *= Queued.Footprint.Footprint.Depth;
+
+        // Without the source's padding, the staged rows get the footprint's.
+        Queued.Data.resize((size_t)(Queued.RowSize * Queued.NumRows));
+        for (UINT Row = 0; Row < Queued.NumRows; ++Row)
+        {
+            memcpy(&Queued.Data[(size_t)(Row * Queued.RowSize)], (const UINT8*)Data + Row * RowPitch,
+                   (size_t)Queued.RowSize);
+        }
+        Streaming->Queued.push_back(std::move(Queued));
+        return StreamingUploads::Enqueue(&Streaming->Uploader, Size, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+    }
+
+    void SubmitStreamingUploads(QueueTimelines* Timelines, StreamingUploadBuffer* Streaming)
+    {
+        const UINT CopyQueue = (UINT)QueueScheduler::QueueType::Copy;
+        UINT64 CompletedValue = Timelines->Fences[CopyQueue]->GetCompletedValue();
+        StreamingUploads::Retire(&Streaming->Uploader, CompletedValue);
+
+        UINT CmdAlloc = 0;
+        while (CmdAlloc < StreamingUploadBuffer::NumCmdAllocs &&
+               Streaming->CmdAllocFenceValues[CmdAlloc] > CompletedValue)
+        {
+            CmdAlloc++;
+        }
+        Streaming->Staged.clear();
+        if (CmdAlloc == StreamingUploadBuffer::NumCmdAllocs ||
+            StreamingUploads::StageBatch(&Streaming->Uploader, &Streaming->Staged) == 0)
+        {
+            return;
+        }
+
+        ID3D12GraphicsCommandList7* CmdList = Streaming->CmdList.Get();
+        Check(Streaming->CmdAllocs[CmdAlloc]->Reset());
+        Check(CmdList->Reset(Streaming->CmdAllocs[CmdAlloc].Get(), nullptr));
+        for (const StreamingUploads::Staged& Current : Streaming->Staged)
+        {
+            // Staged in the order they were queued.
+            StreamingUploadBuffer::Destination& Queued = Streaming->Queued.front();
+            UINT8* Staging = Streaming->Mapped + Current.Offset;
+            if (Queued.IsTexture)
+            {
+                D3D12_TEXTURE_COPY_LOCATION Source = {};
+                Source.pResource = Streaming->Buffer.Get();
+                Source.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+                Source.PlacedFootprint = Queued.Footprint;
+                Source.PlacedFootprint.Offset = Current.Offset;
+                for (UINT Row = 0; Row < Queued.NumRows; ++Row)
+                {
+                    memcpy(Staging + Row * Queued.Footprint.Footprint.RowPitch,
+                           &Queued.Data[(size_t)(Row * Queued.RowSize)], (size_t)Queued.RowSize);
+                }
+
+                D3D12_TEXTURE_COPY_LOCATION Target = {};
+                Target.pResource = Queued.Resource;
+                Target.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+                Target.SubresourceIndex = Queued.Subresource;
+                CmdList->CopyTextureRegion(&Target, 0, 0, 0, &Source, nullptr);
+            }
+            else
+            {
+                memcpy(Staging, Queued.Data.data(), Queued.Data.size());
+                CmdList->CopyBufferRegion(Queued.Resource, Queued.Offset, Streaming->Buffer.Get(), Current.Offset,
+                                          Current.Size);
+            }
+            Streaming->Queued.pop_front();
+        }
+        Check(CmdList->Close());
+
+        QueueScheduler::SyncPoint Done = Submit(Timelines, QueueScheduler::QueueType::Copy,
+                                                (ID3D12CommandList* const*)&CmdList, 1);
+        StreamingUploads::SubmitBatch(&Streaming->Uploader, Done.Value);
+        Streaming->CmdAllocFenceValues[CmdAlloc] = Done.Value;
+    }
+
+    bool GetStreamingSyncPoint(const StreamingUploadBuffer& Streaming, StreamingUploads::Ticket Ticket,
+                               QueueScheduler::SyncPoint* OutPoint)
+    {
+        UINT64 FenceValue = StreamingUploads::GetFenceValue(Streaming.Uploader, Ticket);
+        if (FenceValue == StreamingUploads::NotSubmitted)
+        {
+            return false;
+        }
+        OutPoint->Queue = QueueScheduler::QueueType::Copy;
+        OutPoint->Value = FenceValue;
+        return true;
+    }
+
     void CreateShaderCompiler(ShaderCompiler* Compiler)
     {
         Check(DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&Compiler->Compiler)));
         Check(DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(&Compiler->Utils)));
     }
 
-    void CompileShader(ShaderCompiler* Compiler, Shader* Program)
+    static bool ReadShaderFile(const std::wstring& Path, std::string* Contents)
     {
-        std::wstring ShaderDirectory = GetSolutionDirectory() + L"Shaders\\";
-        wchar_t ExpandedShaderDirectory[1024] = {};
-        GetFullPathNameW(ShaderDirectory.c_str(), _countof(ExpandedShaderDirectory), ExpandedShaderDirectory, nullptr);
-        std::wstring ShaderFilePath = ShaderDirectory + Program->Filename;
-        
-        // Read the file.
-        UINT32 CodePage = 0;
-        IDxcBlobEncoding* BlobEncoding;
-        Check(Compiler->Utils->LoadFile(ShaderFilePath.c_str(), &CodePage, &BlobEncoding));
+        FILE* File = nullptr;
+        if (_wfopen_s(&File, Path.c_str(), L"rb") != 0 || File == nullptr)
+        {
+            return false;
+        }
+        fseek(File, 0, SEEK_END);
+        long Size = ftell(File);
+        fseek(File, 0, SEEK_SET);
+        Contents->resize(Size > 0 ? Size : 0);
+        bool IsRead = Size <= 0 || fread(&(*Contents)[0], 1, Size, File) == (size_t)Size;
+        fclose(File);
+        return IsRead;
+    }
 
-        IDxcIncludeHandler* IncludeHandler;
-        Compiler->Utils->CreateDefaultIncludeHandler(&IncludeHandler);
+    static std::string GetShaderFilename(const wchar_t* Filename)
+    {
+        std::string Narrowed;
+        for (const wchar_t* Char = Filename; *Char; ++Char)
+        {
+            Narrowed += (char)*Char;
+        }
+        return Narrowed;
+    }
 
-        DxcBuffer SourceBuffer;
-        SourceBuffer.Ptr = BlobEncoding->GetBufferPointer();
-        SourceBuffer.Size = BlobEncoding->GetBufferSize();
+    // The shaders are in one directory, so a file is its name, whatever path it's included or asked for with.
+    static std::string GetIncludeKey(const std::string& Path)
+    {
+        size_t Slash = Path.find_last_of("\\/");
+        std::string Key = Path.substr(Slash == std::string::npos ? 0 : Slash + 1);
+        for (char& Char : Key)
+        {
+            Char = (char)tolower((unsigned char)Char);
+        }
+        return Key;
+    }
+
+    // Includes come from the contents CompileShader hashed, anything it didn't read goes to the default handler.
+    struct HashedIncludeHandler : public IDxcIncludeHandler
+    {
+        IDxcUtils* Utils = nullptr;
+        IDxcIncludeHandler* Default = nullptr;
+        const std::unordered_map<std::string, std::string>* Sources = nullptr; // By GetIncludeKey.
+
+        HRESULT STDMETHODCALLTYPE LoadSource(LPCWSTR Filename, IDxcBlob** IncludeSource) override
+        {
+            auto Found = Sources->find(GetIncludeKey(GetShaderFilename(Filename)));
+            if (Found == Sources->end())
+            {
+                return Default->LoadSource(Filename, IncludeSource);
+            }
+            IDxcBlobEncoding* Blob = nullptr;
+            HRESULT Result = Utils->CreateBlob(Found->second.data(), (UINT32)Found->second.size(), DXC_CP_UTF8,
+                                               &Blob);
+            *IncludeSource = Blob;
+            return Result;
+        }
+
+        // Lives on the stack for one compilation.
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID Id, void** Object) override
+        {
+            if (Id == __uuidof(IDxcIncludeHandler) || Id == __uuidof(IUnknown))
+            {
+                *Object = this;
+                return S_OK;
+            }
+            *Object = nullptr;
+            return E_NOINTERFACE;
+        }
+        ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
+        ULONG STDMETHODCALLTYPE Release() override { return 1; }
+    };
+
+    void OpenShaderCache(const std::wstring& Path, ShaderCacheFile* CacheFile)
+    {
+        CacheFile->Path = Path;
+
+        // Blobs from another compiler, or another build of it, never match.
+        ShaderCompiler Compiler;
+        CreateShaderCompiler(&Compiler);
+        ShaderCache::Hasher Version;
+        ComPtr<IDxcVersionInfo> VersionInfo;
+        if (SUCCEEDED(Compiler.Compiler->QueryInterface(IID_PPV_ARGS(&VersionInfo))))
+        {
+            UINT32 Numbers[3] = {};
+            VersionInfo->GetVersion(&Numbers[0], &Numbers[1]);
+            VersionInfo->GetFlags(&Numbers[2]);
+            ShaderCache::Add(&Version, Numbers, sizeof(Numbers));
+        }
+        ComPtr<IDxcVersionInfo2> CommitInfo;
+        UINT32 CommitCount = 0;
+        char* CommitHash = nullptr;
+        if (SUCCEEDED(Compiler.Compiler->QueryInterface(IID_PPV_ARGS(&CommitInfo))) &&
+            SUCCEEDED(CommitInfo->GetCommitInfo(&CommitCount, &CommitHash)) && CommitHash)
+        {
+            ShaderCache::Add(&Version, &CommitCount, sizeof(CommitCount));
+            ShaderCache::Add(&Version, CommitHash, strlen(CommitHash));
+            CoTaskMemFree(CommitHash);
+        }
+        CacheFile->CompilerVersion = ShaderCache::Finish(Version);
+        Compiler.Compiler->Release();
+        Compiler.Utils->Release();
+
+        LARGE_INTEGER Size = {};
+        CacheFile->File = CreateFileW(Path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                      FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (CacheFile->File != INVALID_HANDLE_VALUE && GetFileSizeEx(CacheFile->File, &Size) && Size.QuadPart > 0)
+        {
+            CacheFile->Mapping = CreateFileMappingW(CacheFile->File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            CacheFile->View = CacheFile->Mapping ? MapViewOfFile(CacheFile->Mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        }
+        if (!ShaderCache::Open(&CacheFile->Cache, CacheFile->View, CacheFile->View ? Size.QuadPart : 0) &&
+            CacheFile->View)
+        {
+            OutputDebugStringA("ShaderCache: ignoring an archive this version didn't write\n");
+        }
+    }
+
+    void CloseShaderCache(ShaderCacheFile* CacheFile)
+    {
+        std::vector<UINT8> Archive;
+        bool HasChanged = ShaderCache::HasChanged(CacheFile->Cache);
+        if (HasChanged)
+        {
+            ShaderCache::Serialize(CacheFile->Cache, &Archive);
+        }
+        if (CacheFile->View)
+        {
+            UnmapViewOfFile(CacheFile->View);
+        }
+        if (CacheFile->Mapping)
+        {
+            CloseHandle(CacheFile->Mapping);
+        }
+        if (CacheFile->File != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(CacheFile->File);
+        }
+        CacheFile->View = nullptr;
+        CacheFile->Mapping = nullptr;
+        CacheFile->File = INVALID_HANDLE_VALUE;
+        ShaderCache::Open(&CacheFile->Cache, nullptr, 0);
+        if (!HasChanged)
+        {
+            return;
+        }
 
-        BOOL IsEncodingKNown;
-        Check(BlobEncoding->GetEncoding(&IsEncodingKNown, &CodePage));
-        SourceBuffer.Encoding = CodePage;
+        // Written next to the archive and moved over it, a run that stops halfway leaves the old one.
+        std::wstring TempPath = CacheFile->Path + L".tmp";
+        FILE* File = nullptr;
+        bool IsWritten = _wfopen_s(&File, TempPath.c_str(), L"wb") == 0 && File != nullptr;
+        if (IsWritten)
+        {
+            IsWritten = fwrite(Archive.data(), 1, Archive.size(), File) == Archive.size();
+            IsWritten = fclose(File) == 0 && IsWritten;
+        }
+        if (!IsWritten || !MoveFileExW(TempPath.c_str(), CacheFile->Path.c_str(), MOVEFILE_REPLACE_EXISTING))
+        {
+            OutputDebugStringA("ShaderCache: couldn't write the archive\n");
+            DeleteFileW(TempPath.c_str());
+        }
+    }
+
+    void CompileShader(ShaderCompiler* Compiler, Shader* Program, ShaderCacheFile* Cache)
+    {
+        std::wstring ShaderDirectory = GetSolutionDirectory() + L"Shaders\\";
 
         // Arguments.
-        const wchar_t* Arguments[] = {
+        std::vector<const wchar_t*> Arguments = {
 #if _DEBUG
             L"-Zi",
             L"-H",
@@ -284,54 +1144,285 @@ namespace D3D
             L"-WX",
             L"-I", ShaderDirectory.c_str() // Additional includes.
         };
+        std::vector<std::wstring> Defines;
+        for (UINT i = 0; i < Program->NumDefines; ++i)
+        {
+            const DxcDefine& Define = Program->Defines[i];
+            Defines.push_back(std::wstring(Define.Name) + L"=" + (Define.Value ? Define.Value : L"1"));
+        }
+        for (const std::wstring& Define : Defines)
+        {
+            Arguments.push_back(L"-D");
+            Arguments.push_back(Define.c_str());
+        }
+
+        // Keyed by the source with everything it includes, the arguments and the compiler's version. The include
+        // directory is keyed relative to the solution, so archives hold wherever it's checked out. Every file is read
+        // once, what's compiled is what was hashed even when an editor saves in between.
+        std::vector<std::string> KeyArguments;
+        for (const wchar_t* Argument : Arguments)
+        {
+            KeyArguments.push_back(Argument == ShaderDirectory.c_str() ? "Shaders\\" : GetShaderFilename(Argument));
+        }
+        std::string Filename = GetShaderFilename(Program->Filename);
+        std::unordered_map<std::string, std::string> Sources;
+        auto Read = [&](const std::string& Included, std::string* Contents)
+        {
+            if (!ReadShaderFile(ShaderDirectory + std::wstring(Included.begin(), Included.end()), Contents))
+            {
+                return false;
+            }
+            Sources[GetIncludeKey(Included)] = *Contents;
+            return true;
+        };
+        auto HashStart = std::chrono::high_resolution_clock::now();
+        ShaderCache::Key Key;
+        bool IsKeyed = ShaderCache::ComputeKey(Filename, Read, KeyArguments,
+                                               Cache ? Cache->CompilerVersion : ShaderCache::Key(), &Key);
+        auto CompileStart = std::chrono::high_resolution_clock::now();
+        if (Cache)
+        {
+            const void* Blob = nullptr;
+            UINT64 Size = 0;
+            bool IsHit = IsKeyed && ShaderCache::Find(&Cache->Cache, Key, &Blob, &Size);
+            double HashSeconds = std::chrono::duration<double>(CompileStart - HashStart).count();
+            Cache->Cache.HashMicroseconds += (UINT64)(HashSeconds * 1e6);
+            if (IsHit)
+            {
+                IDxcBlobEncoding* Pinned;
+                Check(Compiler->Utils->CreateBlobFromPinned(Blob, (UINT32)Size, DXC_CP_ACP, &Pinned));
+                Program->Blob = Pinned;
+                return;
+            }
+        }
+        
+        // An editor may have been saving the file.
+        auto Source = Sources.find(GetIncludeKey(Filename));
+        if (Source == Sources.end())
+        {
+            OutputDebugStringA(("CompileShader: couldn't read " + Filename + "\n").c_str());
+            Program->Blob = nullptr;
+            return;
+        }
+
+        ComPtr<IDxcIncludeHandler> DefaultIncludeHandler;
+        Check(Compiler->Utils->CreateDefaultIncludeHandler(&DefaultIncludeHandler));
+        HashedIncludeHandler IncludeHandler;
+        IncludeHandler.Utils = Compiler->Utils;
+        IncludeHandler.Default = DefaultIncludeHandler.Get();
+        IncludeHandler.Sources = &Sources;
+
+        // The shaders are UTF-8, DXC skips a byte order mark.
+        DxcBuffer SourceBuffer;
+        SourceBuffer.Ptr = Source->second.data();
+        SourceBuffer.Size = Source->second.size();
+        SourceBuffer.Encoding = DXC_CP_UTF8;
 
         IDxcResult* CompilationResult;
         Check(Compiler->Compiler->Compile(
             &SourceBuffer,
-            Arguments, _countof(Arguments),
-            IncludeHandler,
+            Arguments.data(), (UINT32)Arguments.size(),
+            &IncludeHandler,
             IID_PPV_ARGS(&CompilationResult)
         ));
 
-        // Process outputs.
-        for (UINT i = 0; i < CompilationResult->GetNumOutputs(); ++i)
+        // Process outputs.
+        for (UINT i = 0; i < CompilationResult->GetNumOutputs(); ++i)
+        {
+            DXC_OUT_KIND Kind = CompilationResult->GetOutputByIndex(i);
+
+            if (Kind == DXC_OUT_ERRORS)
+            {
+                IDxcBlobUtf8* ErrorBlob;
+                Check(CompilationResult->GetOutput(DXC_OUT_ERRORS, IID_PPV_ARGS(&ErrorBlob), nullptr));
+
+                if (ErrorBlob)
+                {
+                    // Not fatal, whatever compiled before keeps rendering until the shader is fixed.
+                    const char* ErrorString = ErrorBlob->GetStringPointer();
+                    if (strlen(ErrorString))
+                    {
+                        OutputDebugStringA(ErrorString);
+                    }
+                }
+            }
+
+            if (Kind == DXC_OUT_REMARKS)
+            {
+                IDxcBlobUtf8* RemarksBlob;
+                Check(CompilationResult->GetOutput(DXC_OUT_REMARKS, IID_PPV_ARGS(&RemarksBlob), nullptr));
+
+                if (RemarksBlob)
+                {
+                    OutputDebugStringA(RemarksBlob->GetStringPointer());
+                }
+            }
+
+            if (Kind == DXC_OUT_OBJECT)
+            {
+                Check(CompilationResult->GetOutput(DXC_OUT_OBJECT, IID_PPV_ARGS(&Program->Blob), nullptr));
+            }
+        }
+
+        // Failed compilations leave no blob, and aren't cached.
+        HRESULT Status = S_OK;
+        Check(CompilationResult->GetStatus(&Status));
+        if (FAILED(Status) && Program->Blob)
+        {
+            Program->Blob->Release();
+            Program->Blob = nullptr;
+        }
+        if (Cache && IsKeyed && Program->Blob)
+        {
+            auto CompileEnd = std::chrono::high_resolution_clock::now();
+            ShaderCache::Add(&Cache->Cache, Key, Program->Blob->GetBufferPointer(), Program->Blob->GetBufferSize(),
+                             std::chrono::duration<double>(CompileEnd - CompileStart).count());
+        }
+    }
+
+    ShaderCompilation::Future CompileShaderAsync(ShaderCompilation::Service* Service, Shader* Program,
+                                                 ShaderCacheFile* Cache)
+    {
+        // DXC compilers aren't free-threaded, so every compilation creates its own.
+        Program->Blob = nullptr;
+        return ShaderCompilation::Submit(Service, [Program, Cache]()
+        {
+            ShaderCompiler Compiler;
+            CreateShaderCompiler(&Compiler);
+            CompileShader(&Compiler, Program, Cache);
+            Compiler.Compiler->Release();
+            Compiler.Utils->Release();
+            return Program->Blob != nullptr;
+        });
+    }
+
+    ShaderCompilation::Future CreatePipelineAsync(ShaderCompilation::Service* Service,
+                                                  const std::vector<ShaderCompilation::Future>& Shaders,
+                                                  const std::function<bool()>& Create)
+    {
+        // Pipelines can be created on any thread, once their shaders compiled.
+        return ShaderCompilation::Submit(Service, [Shaders, Create]()
+        {
+            bool Compiled = true;
+            for (const ShaderCompilation::Future& Compiling : Shaders)
+            {
+                Compiled &= ShaderCompilation::Wait(Compiling);
+            }
+            return Compiled && Create();
+        });
+    }
+
+    // Keeps a read pending, the notifications land in the watcher's buffer. Files in subdirectories are included too.
+    static void ReadShaderChanges(ShaderWatcher* Watcher)
+    {
+        ResetEvent(Watcher->Overlapped.hEvent);
+        if (!ReadDirectoryChangesW(Watcher->Handle, Watcher->Notifications, sizeof(Watcher->Notifications), TRUE,
+                                   FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE |
+                                   FILE_NOTIFY_CHANGE_SIZE,
+                                   nullptr, &Watcher->Overlapped, nullptr))
+        {
+            OutputDebugStringA("ShaderReload: can't watch the shaders, reloading is off\n");
+            CloseHandle(Watcher->Handle);
+            Watcher->Handle = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    static bool ReadWatchedFile(const ShaderWatcher& Watcher, const std::string& Filename, std::string* Contents)
+    {
+        return ReadShaderFile(Watcher.Directory + std::wstring(Filename.begin(), Filename.end()), Contents);
+    }
+
+    void CreateShaderWatcher(const std::wstring& Directory, ShaderWatcher* Watcher)
+    {
+        Watcher->Directory = Directory;
+        Watcher->Overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        Watcher->Handle = CreateFileW(Directory.c_str(), FILE_LIST_DIRECTORY,
+                                      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                                      FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+        if (Watcher->Handle == INVALID_HANDLE_VALUE || !Watcher->Overlapped.hEvent)
+        {
+            OutputDebugStringA("ShaderReload: can't open the shaders directory, reloading is off\n");
+            return;
+        }
+        ReadShaderChanges(Watcher);
+    }
+
+    void DestroyShaderWatcher(ShaderWatcher* Watcher)
+    {
+        // The pending read writes into the watcher until it's cancelled.
+        if (Watcher->Handle != INVALID_HANDLE_VALUE)
+        {
+            DWORD Size = 0;
+            CancelIoEx(Watcher->Handle, &Watcher->Overlapped);
+            GetOverlappedResult(Watcher->Handle, &Watcher->Overlapped, &Size, TRUE);
+            CloseHandle(Watcher->Handle);
+            Watcher->Handle = INVALID_HANDLE_VALUE;
+        }
+        if (Watcher->Overlapped.hEvent)
+        {
+            CloseHandle(Watcher->Overlapped.hEvent);
+            Watcher->Overlapped.hEvent = nullptr;
+        }
+    }
+
+    void WatchShader(ShaderWatcher* Watcher, const Shader& Program, UINT Owner)
+    {
+        std::string Filename = GetShaderFilename(Program.Filename);
+        ShaderReload::AddShader(&Watcher->Graph, Filename, Owner);
+        ShaderReload::Scan(&Watcher->Graph, Filename, [Watcher](const std::string& Included, std::string* Contents)
         {
-            DXC_OUT_KIND Kind = CompilationResult->GetOutputByIndex(i);
+            return ReadWatchedFile(*Watcher, Included, Contents);
+        });
+    }
 
-            if (Kind == DXC_OUT_ERRORS)
+    bool PollShaderWatcher(ShaderWatcher* Watcher, double Time, std::vector<UINT>* Owners)
+    {
+        DWORD Size = 0;
+        if (Watcher->Handle != INVALID_HANDLE_VALUE &&
+            GetOverlappedResult(Watcher->Handle, &Watcher->Overlapped, &Size, FALSE))
+        {
+            // Nothing when the buffer overflowed, then any file may have changed.
+            if (Size == 0)
             {
-                IDxcBlobUtf8* ErrorBlob;
-                Check(CompilationResult->GetOutput(DXC_OUT_ERRORS, IID_PPV_ARGS(&ErrorBlob), nullptr));
-
-                if (ErrorBlob)
+                for (const auto& Included : Watcher->Graph.Includes)
                 {
-                    const char* ErrorString = ErrorBlob->GetStringPointer();
-                    if (strlen(ErrorString))
-                    {
-                        OutputDebugStringA(ErrorString);
-                        __debugbreak();
-                    }
+                    ShaderReload::AddChange(&Watcher->Changes, Included.first, Time);
                 }
             }
-
-            if (Kind == DXC_OUT_REMARKS)
+            const UINT8* Next = Size > 0 ? (const UINT8*)Watcher->Notifications : nullptr;
+            while (Next)
             {
-                IDxcBlobUtf8* RemarksBlob;
-                Check(CompilationResult->GetOutput(DXC_OUT_REMARKS, IID_PPV_ARGS(&RemarksBlob), nullptr));
-
-                if (RemarksBlob)
+                const FILE_NOTIFY_INFORMATION* Notification = (const FILE_NOTIFY_INFORMATION*)Next;
+                if (Notification->Action != FILE_ACTION_REMOVED &&
+                    Notification->Action != FILE_ACTION_RENAMED_OLD_NAME)
                 {
-                    const char* RemarksString = RemarksBlob->GetStringPointer();
-                    printf(RemarksString);
-                    __debugbreak(); // TODO: Just print remarks, don't break.
+                    std::wstring Filename(Notification->FileName, Notification->FileNameLength / sizeof(wchar_t));
+                    ShaderReload::AddChange(&Watcher->Changes, GetShaderFilename(Filename.c_str()), Time);
                 }
+                Next = Notification->NextEntryOffset ? Next + Notification->NextEntryOffset : nullptr;
             }
+            ReadShaderChanges(Watcher);
+        }
 
-            if (Kind == DXC_OUT_OBJECT)
+        // Only files the graph knows can affect a shader, what they include now is read again.
+        std::vector<std::string> Changed;
+        if (!ShaderReload::TakeChanges(&Watcher->Changes, Time, &Changed))
+        {
+            return false;
+        }
+        for (const std::string& Filename : Changed)
+        {
+            if (Watcher->Graph.Includes.count(Filename))
             {
-                Check(CompilationResult->GetOutput(DXC_OUT_OBJECT, IID_PPV_ARGS(&Program->Blob), nullptr));
+                ShaderReload::Scan(&Watcher->Graph, Filename, [Watcher](const std::string& Included,
+                                                                        std::string* Contents)
+                {
+                    return ReadWatchedFile(*Watcher, Included, Contents);
+                });
             }
         }
+        ShaderReload::GetAffected(Watcher->Graph, Changed, Owners);
+        return !Owners->empty();
     }
 
     void CreateRootSignature(ID3D12Device10* Device, D3D12_ROOT_SIGNATURE_DESC1* Desc, ID3D12RootSignature** RootSignature)
@@ -357,7 +1448,19 @@ namespace D3D
                                           IID_PPV_ARGS(RootSignature)));
     }
 
-    void CreateMeshShaderPSO(ID3D12Device10* Device,
+    // Unlike Check, for what a reloaded shader can get wrong: reports it and lets the caller keep what renders.
+    static bool Succeeded(HRESULT Hr, const char* Call)
+    {
+        if (FAILED(Hr))
+        {
+            char Message[128];
+            snprintf(Message, sizeof(Message), "%s failed, 0x%08X\n", Call, (UINT)Hr);
+            OutputDebugStringA(Message);
+        }
+        return SUCCEEDED(Hr);
+    }
+
+    bool CreateMeshShaderPSO(ID3D12Device10* Device,
                              Shader* MS,
                              Shader* PS,
                              ID3D12RootSignature* RootSig,
@@ -386,24 +1489,24 @@ namespace D3D
         D3D12_PIPELINE_STATE_STREAM_DESC PSStreamDesc = {};
         PSStreamDesc.pPipelineStateSubobjectStream = &PSOStream;
         PSStreamDesc.SizeInBytes = sizeof(PSOStream);
-        Check(Device->CreatePipelineState(&PSStreamDesc, IID_PPV_ARGS(OutPSO)));
-
+        return Succeeded(Device->CreatePipelineState(&PSStreamDesc, IID_PPV_ARGS(OutPSO)), "CreatePipelineState");
     }
 
     void CreateDSVDescriptorHeap(ID3D12Device10* Device, ID3D12DescriptorHeap** DSVHeap, UINT* DSVHeapHandleSize)
     {
         D3D12_DESCRIPTOR_HEAP_DESC Desc = {};
         Desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-        Desc.NumDescriptors = GlobalResources::NumBackBuffers;
+        Desc.NumDescriptors = GlobalResources::MaxBackBuffers;
         Desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
         Check(Device->CreateDescriptorHeap(&Desc, IID_PPV_ARGS(DSVHeap)));
         *DSVHeapHandleSize = Device->GetDescriptorHandleIncrementSize(Desc.Type);
     }
 
-    void CreateDepthBufferDSV(ID3D12Device10* Device, Frame* Frames, ID3D12DescriptorHeap* DSVHeap, UINT DSVHeapHandleSize)
+    void CreateDepthBufferDSV(ID3D12Device10* Device, Frame* Frames, UINT NumFrames, ID3D12DescriptorHeap* DSVHeap,
+                              UINT DSVHeapHandleSize)
     {
        D3D12_CPU_DESCRIPTOR_HANDLE DSVHandle = DSVHeap->GetCPUDescriptorHandleForHeapStart();
-        for (int i = 0; i < GlobalResources::NumBackBuffers; i++)
+        for (UINT i = 0; i < NumFrames; i++)
         {
             Frame* CurrentFrame = &Frames[i];
             D3D12_DEPTH_STENCIL_VIEW_DESC DSVDesc = {};
@@ -420,16 +1523,17 @@ namespace D3D
     {
         D3D12_DESCRIPTOR_HEAP_DESC Desc = {};
         Desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-        Desc.NumDescriptors = GlobalResources::NumBackBuffers;
+        Desc.NumDescriptors = GlobalResources::MaxBackBuffers;
         Desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
         Check(Device->CreateDescriptorHeap(&Desc, IID_PPV_ARGS(RTVHeap)));
         *RTVHeapHandleSize = Device->GetDescriptorHandleIncrementSize(Desc.Type);
     }
 
-    void CreateBackBufferRTV(ID3D12Device10* Device, IDXGISwapChain4* SwapChain, Frame* Frames, ID3D12DescriptorHeap* RTVHeap, UINT RTVHeapHandleSize)
+    void CreateBackBufferRTV(ID3D12Device10* Device, IDXGISwapChain4* SwapChain, Frame* Frames, UINT NumFrames,
+                             ID3D12DescriptorHeap* RTVHeap, UINT RTVHeapHandleSize)
     {
         D3D12_CPU_DESCRIPTOR_HANDLE RTVHandle = RTVHeap->GetCPUDescriptorHandleForHeapStart();
-        for (int i = 0; i < GlobalResources::NumBackBuffers; i++)
+        for (UINT i = 0; i < NumFrames; i++)
         {
             Frame* CurrentFrame = &Frames[i];
             Check(SwapChain->GetBuffer(i, IID_PPV_ARGS(CurrentFrame->BackBuffer.GetAddressOf())));
@@ -439,8 +1543,438 @@ namespace D3D
         }
     }
 
+    void CreateFramePacing(Global* Dx, const FramePacing::Settings& Settings)
+    {
+        Dx->Pacing = FramePacing::Clamp(Settings);
+        Check(Dx->SwapChain->SetMaximumFrameLatency(Dx->Pacing.MaxLatency));
+        Dx->FrameLatencyWaitable = Dx->SwapChain->GetFrameLatencyWaitableObject();
+        FramePacing::Reset(&Dx->PacingTelemetry);
+    }
+
+    void SetFramePacing(Global* Dx, GlobalResources* Data, WindowInfo* Window, const FramePacing::Settings& Settings)
+    {
+        FramePacing::Settings Clamped = FramePacing::Clamp(Settings);
+        if (Clamped.FramesInFlight != Data->NumBackBuffers)
+        {
+            // Nothing may reference the back buffers while they're resized, the frames' depth buffers go with them.
+            WaitForIdle(Dx);
+            for (UINT i = 0; i < Data->NumBackBuffers; ++i)
+            {
+                ResourceStates::Unregister(&Data->States, Data->Frames[i].BackBuffer.Get());
+                Data->Frames[i].BackBuffer.Reset();
+            }
+            Check(Dx->SwapChain->ResizeBuffers(Clamped.FramesInFlight, 0, 0, DXGI_FORMAT_UNKNOWN, SwapChainFlags));
+            Data->NumBackBuffers = Clamped.FramesInFlight;
+
+            ID3D12Device10* Device = Dx->Device.Get();
+            CreateBackBufferRTV(Device, Dx->SwapChain.Get(), Data->Frames, Data->NumBackBuffers, Data->RTVHeap.Get(),
+                                Data->RTVHeapHandleSize);
+            CreateDepthBuffers(Device, Data->Frames, Data->NumBackBuffers, Window);
+            CreateDepthBufferDSV(Device, Data->Frames, Data->NumBackBuffers, Data->DSVHeap.Get(),
+                                 Data->DSVHeapHandleSize);
+            for (UINT i = 0; i < Data->NumBackBuffers; ++i)
+            {
+                NAME_D3D12_OBJECT_INDEXED(Data->Frames[i].BackBuffer, i);
+                ResourceStates::Register(&Data->States, Data->Frames[i].BackBuffer.Get(),
+                                         D3D12_RESOURCE_STATE_PRESENT);
+            }
+        }
+        Check(Dx->SwapChain->SetMaximumFrameLatency(Clamped.MaxLatency));
+        Dx->Pacing = Clamped;
+        FramePacing::Reset(&Dx->PacingTelemetry);
+    }
+
+    void WaitForFence(ID3D12Fence* Fence, UINT64 Value, HANDLE Event)
+    {
+        if (Fence->GetCompletedValue() < Value)
+        {
+            Check(Fence->SetEventOnCompletion(Value, Event));
+            WaitForSingleObject(Event, INFINITE);
+        }
+    }
+
+    void WaitForIdle(Global* Dx)
+    {
+        // The frame fence follows the graphics queue's presents, the timelines whatever the other queues have left.
+        WaitForFence(Dx->Fence.Get(), Dx->FrameTimeline.Signaled.load(), Dx->FenceEvent);
+        for (UINT i = 0; i < QueueScheduler::NumQueues; ++i)
+        {
+            WaitForFence(Dx->Timelines.Fences[i].Get(), Dx->Timelines.Scheduler.Signaled[i], Dx->FenceEvent);
+        }
+        UpdateFrameFence(Dx);
+    }
+
+    UINT64 SignalFrameFence(Global* Dx)
+    {
+        UINT64 Value = DeferredRelease::Signal(&Dx->FrameTimeline);
+        Check(Dx->GraphicsQueue->Signal(Dx->Fence.Get(), Value));
+        return Value;
+    }
+
+    UINT64 UpdateFrameFence(Global* Dx)
+    {
+        UINT64 CompletedValue = Dx->Fence->GetCompletedValue();
+        DeferredRelease::SetCompleted(&Dx->FrameTimeline, CompletedValue);
+        return CompletedValue;
+    }
+
+    static void ReleaseResource(void*, const DeferredRelease::Item& Released)
+    {
+        ((ID3D12Pageable*)Released.Object)->Release();
+    }
+
+    static void FreeDescriptor(void* Context, const DeferredRelease::Item& Released)
+    {
+        bool Freed = DescriptorAllocator::Free(&((BindlessHeap*)Context)->Allocator,
+                                               (DescriptorAllocator::Handle)Released.Values[0]);
+        assert(Freed);
+        (void)Freed;
+    }
+
+    static HeapAllocator::Allocation GetRange(const DeferredRelease::Item& Released)
+    {
+        HeapAllocator::Allocation Range;
+        Range.Offset = Released.Values[1];
+        Range.Size = Released.Values[2];
+        Range.Block = (UINT)Released.Values[3];
+        return Range;
+    }
+
+    static void ReleasePlacedRange(void*, const DeferredRelease::Item& Released)
+    {
+        PlacedAllocation Allocation;
+        Allocation.Pool = (HeapPool*)Released.Object;
+        Allocation.Heap = (UINT)Released.Values[0];
+        Allocation.Range = GetRange(Released);
+        ReleasePlaced(Allocation);
+    }
+
+    static void FreeSmallBufferRange(void* Context, const DeferredRelease::Item& Released)
+    {
+        GpuMemory* Memory = (GpuMemory*)Context;
+        HeapAllocator::Free(&Memory->SmallUploadBuffers.Allocators[(size_t)Released.Values[0]], GetRange(Released));
+    }
+
+    void CreateReleaseQueue(Global* Dx, GlobalResources* Data)
+    {
+        DeferredRelease::Queue* Queue = &Data->Releases.Queue;
+        for (UINT i = 0; i < QueueScheduler::NumQueues; ++i)
+        {
+            DeferredRelease::AddTimeline(Queue, &Dx->Timelines.Values[i]);
+        }
+        UINT FrameTimeline = DeferredRelease::AddTimeline(Queue, &Dx->FrameTimeline);
+        assert(FrameTimeline == ReleaseQueue::FrameTimeline);
+        (void)FrameTimeline;
+
+        DeferredRelease::SetReleaseFunction(Queue, (UINT)ReleaseType::Resource, ReleaseResource, nullptr);
+        DeferredRelease::SetReleaseFunction(Queue, (UINT)ReleaseType::Descriptor, FreeDescriptor, &Data->Descriptors);
+        DeferredRelease::SetReleaseFunction(Queue, (UINT)ReleaseType::Placed, ReleasePlacedRange, nullptr);
+        DeferredRelease::SetReleaseFunction(Queue, (UINT)ReleaseType::SmallBuffer, FreeSmallBufferRange,
+                                            &Data->Memory);
+    }
+
+    DeferredRelease::RetirePoint GetFrameRetirePoint(const Global& Dx)
+    {
+        DeferredRelease::RetirePoint Retire;
+        Retire.Timeline = ReleaseQueue::FrameTimeline;
+        Retire.Value = DeferredRelease::GetNextValue(Dx.FrameTimeline);
+        return Retire;
+    }
+
+    DeferredRelease::RetirePoint GetRetirePoint(const QueueScheduler::SyncPoint& Point)
+    {
+        DeferredRelease::RetirePoint Retire;
+        Retire.Timeline = (UINT)Point.Queue;
+        Retire.Value = Point.Value;
+        return Retire;
+    }
+
+    void DeferRelease(ReleaseQueue* Releases, const DeferredRelease::RetirePoint& Retire, ID3D12Pageable* Object)
+    {
+        DeferredRelease::Item Release;
+        Release.Retire = Retire;
+        Release.Type = (UINT)ReleaseType::Resource;
+        Release.Object = Object;
+        Object->AddRef();
+        DeferredRelease::Enqueue(&Releases->Queue, Release);
+    }
+
+    void DeferFree(ReleaseQueue* Releases, const DeferredRelease::RetirePoint& Retire,
+                   DescriptorAllocator::Handle Descriptor)
+    {
+        DeferredRelease::Item Release;
+        Release.Retire = Retire;
+        Release.Type = (UINT)ReleaseType::Descriptor;
+        Release.Values[0] = Descriptor;
+        DeferredRelease::Enqueue(&Releases->Queue, Release);
+    }
+
+    void DeferReleasePlaced(ReleaseQueue* Releases, const DeferredRelease::RetirePoint& Retire,
+                            const PlacedAllocation& Allocation)
+    {
+        DeferredRelease::Item Release;
+        Release.Retire = Retire;
+        Release.Type = (UINT)ReleaseType::Placed;
+        Release.Object = Allocation.Pool;
+        Release.Values[0] = Allocation.Heap;
+        Release.Values[1] = Allocation.Range.Offset;
+        Release.Values[2] = Allocation.Range.Size;
+        Release.Values[3] = Allocation.Range.Block;
+        DeferredRelease::Enqueue(&Releases->Queue, Release);
+    }
+
+    void DeferFreeSmallBuffer(ReleaseQueue* Releases, const DeferredRelease::RetirePoint& Retire,
+                              SmallBuffer* Buffer)
+    {
+        DeferredRelease::Item Release;
+        Release.Retire = Retire;
+        Release.Type = (UINT)ReleaseType::SmallBuffer;
+        Release.Values[0] = Buffer->Page;
+        Release.Values[1] = Buffer->Range.Offset;
+        Release.Values[2] = Buffer->Range.Size;
+        Release.Values[3] = Buffer->Range.Block;
+        DeferredRelease::Enqueue(&Releases->Queue, Release);
+        *Buffer = SmallBuffer();
+    }
+
+    UINT CollectReleases(Global* Dx, ReleaseQueue* Releases)
+    {
+        UpdateFrameFence(Dx);
+        for (UINT i = 0; i < QueueScheduler::NumQueues; ++i)
+        {
+            DeferredRelease::SetCompleted(&Dx->Timelines.Values[i], Dx->Timelines.Fences[i]->GetCompletedValue());
+        }
+        return DeferredRelease::Collect(&Releases->Queue);
+    }
+
+    void FlushReleases(Global* Dx, ReleaseQueue* Releases)
+    {
+        WaitForIdle(Dx);
+        DeferredRelease::Flush(&Releases->Queue);
+    }
+
+    void BuildBottomLevels(ID3D12Device10* Device, ID3D12GraphicsCommandList7* CmdList,
+                           ResourceStates::Tracker* Tracker, GpuMemory* Memory,
+                           const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS* Inputs, UINT NumBuilds,
+                           UINT64 ScratchBudget,
+                           ComPtr<ID3D12Resource>* BottomLevels, PlacedAllocation* BottomLevelRanges,
+                           ID3D12Resource** Scratch, PlacedAllocation* ScratchRange,
+                           D3D12_GPU_VIRTUAL_ADDRESS CompactedSizes)
+    {
+        std::vector<UINT64> ScratchSizes(NumBuilds);
+        for (UINT i = 0; i < NumBuilds; ++i)
+        {
+            D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO PrebuildInfo = {};
+            Device->GetRaytracingAccelerationStructurePrebuildInfo(&Inputs[i], &PrebuildInfo);
+            ScratchSizes[i] = PrebuildInfo.ScratchDataSizeInBytes;
+
+            CreatePlacedBuffer(Device, Memory, D3D12_HEAP_TYPE_DEFAULT, PrebuildInfo.ResultDataMaxSizeInBytes,
+                               BottomLevels[i].ReleaseAndGetAddressOf(),
+                               D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE,
+                               D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+                               BottomLevelRanges != nullptr ? &BottomLevelRanges[i] : nullptr);
+        }
+
+        BottomLevelBatch::Plan BuildPlan;
+        BottomLevelBatch::PlanBuilds(ScratchSizes.data(), NumBuilds, ScratchBudget, &BuildPlan);
+
+        // One scratch buffer shared by every batch. The caller releases it once the GPU is done.
+        CreatePlacedBuffer(Device, Memory, D3D12_HEAP_TYPE_DEFAULT, BuildPlan.ScratchSize, Scratch,
+                           D3D12_RESOURCE_STATE_COMMON,
+                           D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, ScratchRange);
+        D3D12_GPU_VIRTUAL_ADDRESS ScratchAddress = (*Scratch)->GetGPUVirtualAddress();
+
+        for (const BottomLevelBatch::Batch& CurrentBatch : BuildPlan.Batches)
+        {
+            FlushBarriers(CmdList, Tracker);
+            for (UINT i = CurrentBatch.First; i < CurrentBatch.First + CurrentBatch.Count; ++i)
+            {
+                UINT Build = BuildPlan.Order[i];
+                D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC ASDesc = {};
+                ASDesc.Inputs = Inputs[Build];
+                ASDesc.DestAccelerationStructureData = BottomLevels[Build]->GetGPUVirtualAddress();
+                ASDesc.ScratchAccelerationStructureData = ScratchAddress + BuildPlan.ScratchOffsets[Build];
+                if (CompactedSizes != 0)
+                {
+                    // The inputs must have ALLOW_COMPACTION.
+                    D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC PostbuildInfo = {};
+                    PostbuildInfo.InfoType = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE;
+                    PostbuildInfo.DestBuffer = CompactedSizes +
+                        Build * sizeof(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE_DESC);
+                    CmdList->BuildRaytracingAccelerationStructure(&ASDesc, 1, &PostbuildInfo);
+                }
+                else
+                {
+                    CmdList->BuildRaytracingAccelerationStructure(&ASDesc, 0, nullptr);
+                }
+            }
+
+            // One barrier per batch: it completes the batch's BLASes and lets the next batch reuse the scratch.
+            ResourceStates::UAVBarrier(Tracker);
+        }
+    }
+
+    void CreateBottomLevelCompaction(ID3D12Device10* Device, GpuMemory* Memory, UINT NumBottomLevels,
+                                     BottomLevelCompactionData* Compaction)
+    {
+        Compaction->Memory = Memory;
+        UINT64 Size = NumBottomLevels * sizeof(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE_DESC);
+        CreatePlacedBuffer(Device, Memory, D3D12_HEAP_TYPE_DEFAULT, Size,
+                           Compaction->CompactedSizes.ReleaseAndGetAddressOf(),
+                           D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+                           D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, &Compaction->CompactedSizesRanges[0]);
+        NAME_D3D12_OBJECT(Compaction->CompactedSizes);
+
+        CreatePlacedBuffer(Device, Memory, D3D12_HEAP_TYPE_READBACK, Size,
+                           Compaction->CompactedSizesReadback.ReleaseAndGetAddressOf(),
+                           D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_FLAG_NONE,
+                           &Compaction->CompactedSizesRanges[1]);
+        NAME_D3D12_OBJECT(Compaction->CompactedSizesReadback);
+        Check(Compaction->CompactedSizesReadback->Map(0, nullptr, (void**)&Compaction->MappedCompactedSizes));
+    }
+
+    void QueueBottomLevelCompaction(ID3D12GraphicsCommandList7* CmdList, ResourceStates::Tracker* Tracker,
+                                    BottomLevelCompactionData* Compaction,
+                                    BottomLevelASInfo* BottomLevelInfos, const PlacedAllocation* BottomLevelRanges,
+                                    UINT NumBottomLevels, UINT64 BuildFenceValue)
+    {
+        // The sizes are read back with the builds and only looked at once BuildFenceValue completed.
+        ResourceStates::SetKnownState(Tracker, Compaction->CompactedSizes.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        ResourceStates::Transition(Tracker, Compaction->CompactedSizes.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE);
+        FlushBarriers(CmdList, Tracker);
+        CmdList->CopyResource(Compaction->CompactedSizesReadback.Get(), Compaction->CompactedSizes.Get());
+
+        for (UINT i = 0; i < NumBottomLevels; ++i)
+        {
+            BottomLevelCompaction::Register(&Compaction->Scheduler,
+                                            BottomLevelInfos[i].BottomLevel->GetDesc().Width, BuildFenceValue);
+            Compaction->Infos.push_back(&BottomLevelInfos[i]);
+            Compaction->Originals.push_back(BottomLevelInfos[i].BottomLevel);
+            Compaction->OriginalRanges.push_back(BottomLevelRanges[i]);
+        }
+    }
+
+    bool UpdateBottomLevelCompaction(ID3D12Device10* Device, ID3D12GraphicsCommandList7* CmdList,
+                                     ResourceStates::Tracker* Tracker,
+                                     BottomLevelCompactionData* Compaction,
+                                     UINT64 CompletedFenceValue, UINT64 SubmitFenceValue)
+    {
+        if (Compaction->MappedCompactedSizes == nullptr)
+        {
+            return false;
+        }
+
+        BottomLevelCompaction::Step& CurrentStep = Compaction->CurrentStep;
+        BottomLevelCompaction::Update(&Compaction->Scheduler, CompletedFenceValue, SubmitFenceValue,
+                                      Compaction->MappedCompactedSizes, &CurrentStep);
+
+        if (!CurrentStep.Copies.empty())
+        {
+            ComPtr<ID3D12Resource> Allocation;
+            CreatePlacedBuffer(Device, Compaction->Memory, D3D12_HEAP_TYPE_DEFAULT, CurrentStep.AllocationSize,
+                               Allocation.GetAddressOf(),
+                               D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE,
+                               D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+            NAME_D3D12_OBJECT_INDEXED(Allocation, (UINT)Compaction->Allocations.size());
+            Compaction->Allocations.push_back(Allocation);
+
+            // Redirect the BLASes right away, the originals stay alive until the copies completed.
+            FlushBarriers(CmdList, Tracker);
+            for (UINT Index : CurrentStep.Copies)
+            {
+                const BottomLevelCompaction::Entry& Current = Compaction->Scheduler.Entries[Index];
+                BottomLevelASInfo* Info = Compaction->Infos[Index];
+                D3D12_GPU_VIRTUAL_ADDRESS Destination = Allocation->GetGPUVirtualAddress() + Current.Offset;
+                CmdList->CopyRaytracingAccelerationStructure(Destination, Info->Address,
+                                                             D3D12_RAYTRACING_ACCELERATION_STRUCTURE_COPY_MODE_COMPACT);
+                Info->BottomLevel = Allocation;
+                Info->Address = Destination;
+            }
+
+            // The compacted BLASes are read by the top-level update that follows.
+            ResourceStates::UAVBarrier(Tracker);
+        }
+
+        for (UINT Index : CurrentStep.Releases)
+        {
+            // Released once the copy completed, so no frame in flight still reads the original.
+            Compaction->Originals[Index].Reset();
+            ReleasePlaced(Compaction->OriginalRanges[Index]);
+        }
+
+        if (!CurrentStep.Releases.empty() && BottomLevelCompaction::IsDone(Compaction->Scheduler))
+        {
+            UINT64 Before = 0;
+            UINT64 After = 0;
+            BottomLevelCompaction::GetMemoryUsage(Compaction->Scheduler, &Before, &After);
+            char Message[256];
+            snprintf(Message, sizeof(Message), "BLAS compaction: %u BLASes, %.1f KB -> %.1f KB (%.1f%%)\n",
+                     (UINT)Compaction->Scheduler.Entries.size(), Before / 1024.0, After / 1024.0,
+                     Before > 0 ? 100.0 * After / Before : 100.0);
+            OutputDebugStringA(Message);
+
+            Compaction->CompactedSizesReadback->Unmap(0, nullptr);
+            Compaction->MappedCompactedSizes = nullptr;
+            Compaction->CompactedSizesReadback.Reset();
+            Compaction->CompactedSizes.Reset();
+            ReleasePlaced(Compaction->CompactedSizesRanges[0]);
+            ReleasePlaced(Compaction->CompactedSizesRanges[1]);
+        }
+
+        return !CurrentStep.Copies.empty();
+    }
+
+    void CreateInstanceDescRing(ID3D12Device10* Device, GpuMemory* Memory, UINT Capacity, InstanceDescRing* Ring)
+    {
+        Ring->Capacity = Capacity;
+        Ring->Current = 0;
+        for (UINT i = 0; i < InstanceDescRing::NumBuffers; ++i)
+        {
+            CreatePlacedBuffer(Device, Memory, D3D12_HEAP_TYPE_UPLOAD,
+                               sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * (UINT64)Capacity,
+                               Ring->Buffers[i].ReleaseAndGetAddressOf(),
+                               D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_FLAG_NONE, &Ring->Ranges[i]);
+            NAME_D3D12_OBJECT_INDEXED(Ring->Buffers[i], i);
+
+            // Upload heaps can stay mapped for their whole lifetime.
+            Check(Ring->Buffers[i]->Map(0, nullptr, (void**)&Ring->MappedDescs[i]));
+            Ring->FenceValues[i] = 0;
+        }
+    }
+
+    void DestroyInstanceDescRing(InstanceDescRing* Ring)
+    {
+        for (UINT i = 0; i < InstanceDescRing::NumBuffers; ++i)
+        {
+            Ring->Buffers[i].Reset();
+            Ring->MappedDescs[i] = nullptr;
+            ReleasePlaced(Ring->Ranges[i]);
+            Ring->Ranges[i] = PlacedAllocation();
+        }
+        Ring->Capacity = 0;
+    }
+
+    D3D12_RAYTRACING_INSTANCE_DESC* BeginInstanceDescs(InstanceDescRing* Ring, UINT64 FenceValue,
+                                                       ID3D12Fence* Fence, HANDLE FenceEvent)
+    {
+        // Consecutive frames signal consecutive fence values, so they take turns on the buffers. A skipped value, or
+        // more frames in flight than buffers, can still land on one the GPU is reading.
+        Ring->Current = (UINT)(FenceValue % InstanceDescRing::NumBuffers);
+        WaitForFence(Fence, Ring->FenceValues[Ring->Current], FenceEvent);
+        Ring->FenceValues[Ring->Current] = FenceValue;
+        return Ring->MappedDescs[Ring->Current];
+    }
+
+    ID3D12Resource* EndInstanceDescs(InstanceDescRing* Ring)
+    {
+        // Make the streaming stores visible before the command list referencing the buffer is submitted.
+        _mm_sfence();
+        return Ring->Buffers[Ring->Current].Get();
+    }
+
     void CreateTopLevel(ID3D12Device10* Device, ID3D12GraphicsCommandList7* CmdList,
-                        UINT NumInstances, ID3D12Resource* InstanceDescs,
+                        ResourceStates::Tracker* Tracker,
+                        GpuMemory* Memory, UINT NumInstances, ID3D12Resource* InstanceDescs,
                         ID3D12Resource** TopLevelASScratch, ID3D12Resource** TopLevelAS )
     {
         D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS ASInputs = {};
@@ -452,15 +1986,15 @@ namespace D3D
         D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO PrebuildInfo = {};
         Device->GetRaytracingAccelerationStructurePrebuildInfo(&ASInputs, &PrebuildInfo);
 
-        CreateCommittedBuffer(Device, D3D12_HEAP_TYPE_DEFAULT, PrebuildInfo.ScratchDataSizeInBytes,
-                              TopLevelASScratch,
-                              D3D12_RESOURCE_STATE_COMMON,
-                              D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+        CreatePlacedBuffer(Device, Memory, D3D12_HEAP_TYPE_DEFAULT, PrebuildInfo.ScratchDataSizeInBytes,
+                           TopLevelASScratch,
+                           D3D12_RESOURCE_STATE_COMMON,
+                           D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 
-        CreateCommittedBuffer(Device, D3D12_HEAP_TYPE_DEFAULT, PrebuildInfo.ResultDataMaxSizeInBytes,
-                              TopLevelAS,
-                              D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE,
-                              D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+        CreatePlacedBuffer(Device, Memory, D3D12_HEAP_TYPE_DEFAULT, PrebuildInfo.ResultDataMaxSizeInBytes,
+                           TopLevelAS,
+                           D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE,
+                           D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 
         // Build the TLAS.
         D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC ASDesc = {};
@@ -468,48 +2002,282 @@ namespace D3D
         ASDesc.DestAccelerationStructureData = (*TopLevelAS)->GetGPUVirtualAddress();
         ASDesc.Inputs = ASInputs;
         ASDesc.Inputs.InstanceDescs = InstanceDescs->GetGPUVirtualAddress();
+        FlushBarriers(CmdList, Tracker);
         CmdList->BuildRaytracingAccelerationStructure(&ASDesc, 0, nullptr);
 
         // Wait for TopLevelAS to be created (all writes are done).
-        D3D12_RESOURCE_BARRIER UAVBarrier = {};
-        UAVBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-        UAVBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-        UAVBarrier.UAV.pResource = *TopLevelAS;
-        CmdList->ResourceBarrier(1, &UAVBarrier);
+        ResourceStates::UAVBarrier(Tracker, *TopLevelAS);
     }
     
-    void UpdateTopLevel(ID3D12GraphicsCommandList7* CmdList,
-                        BottomLevelASInfo* BottomLevelInfos, INT NumBottomLevelInfos,
+    void UpdateTopLevel(ID3D12GraphicsCommandList7* CmdList, ResourceStates::Tracker* Tracker, UINT NumInstances,
                         ID3D12Resource* TopLevelASScratch, ID3D12Resource* TopLevelAS,
-                        ID3D12Resource* InstanceDescs)
+                        ID3D12Resource* InstanceDescs, TopLevelPolicy::Action Action)
     {
-        UINT NumInstances = 0;
-        for (INT i = 0; i < NumBottomLevelInfos; ++i)
-        {
-            NumInstances += BottomLevelInfos[i].NumInstances;
-        }
-
+        // NumInstances may be below what the TLAS was created for, e.g. after culling, but a change requires a rebuild.
         D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS ASInputs = {};
         ASInputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
-        ASInputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+        ASInputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
         ASInputs.NumDescs = NumInstances;
         ASInputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
 
-        // Update the TLAS.
+        // Update the TLAS in place, or rebuild it when the update would have degraded it too much.
+        // The scratch buffer was sized for a build, so it fits both.
         D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC ASDesc = {};
         ASDesc.ScratchAccelerationStructureData = TopLevelASScratch->GetGPUVirtualAddress();
         ASDesc.DestAccelerationStructureData = TopLevelAS->GetGPUVirtualAddress();
-        ASDesc.SourceAccelerationStructureData = TopLevelAS->GetGPUVirtualAddress();
+        if (Action == TopLevelPolicy::Action::Update)
+        {
+            ASInputs.Flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+            ASDesc.SourceAccelerationStructureData = TopLevelAS->GetGPUVirtualAddress();
+        }
         ASDesc.Inputs = ASInputs;
         ASDesc.Inputs.InstanceDescs = InstanceDescs->GetGPUVirtualAddress();
+        FlushBarriers(CmdList, Tracker);
         CmdList->BuildRaytracingAccelerationStructure(&ASDesc, 0, nullptr);
 
         // Wait for TopLevelAS to be updated (all writes are done).
-        D3D12_RESOURCE_BARRIER UAVBarrier = {};
-        UAVBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-        UAVBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-        UAVBarrier.UAV.pResource = TopLevelAS;
-        CmdList->ResourceBarrier(1, &UAVBarrier);
+        ResourceStates::UAVBarrier(Tracker, TopLevelAS);
+    }
+
+    // Owns the D3D12 descriptions the state subobjects point to.
+    struct RtStateObjectStream
+    {
+        std::vector<D3D12_STATE_SUBOBJECT> Subobjects;
+        std::vector<std::vector<D3D12_EXPORT_DESC>> LibraryExports;
+        std::vector<D3D12_DXIL_LIBRARY_DESC> Libraries;
+        std::vector<D3D12_HIT_GROUP_DESC> HitGroups;
+        std::vector<D3D12_LOCAL_ROOT_SIGNATURE> LocalRootSignatures;
+        std::vector<std::vector<LPCWSTR>> AssociationExports;
+        std::vector<D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION> Associations;
+        D3D12_RAYTRACING_SHADER_CONFIG ShaderConfig = {};
+        D3D12_RAYTRACING_PIPELINE_CONFIG PipelineConfig = {};
+        D3D12_GLOBAL_ROOT_SIGNATURE GlobalRootSignature = {};
+        D3D12_STATE_OBJECT_CONFIG Config = {};
+    };
+
+    // Content (libraries, hit groups, associations) comes from Content, pipeline-wide state from PipelineState.
+    static void BuildRtStateObjectStream(const RtPipeline::Desc& Content, const RtPipeline::Desc& PipelineState,
+                                         RtStateObjectStream* Stream)
+    {
+        // Subobjects reference each other by address, so nothing may reallocate once filled.
+        size_t NumAssociations = Content.LocalRootSignatures.size();
+        Stream->Subobjects.reserve(Content.Libraries.size() + Content.HitGroups.size() + 2 * NumAssociations + 4);
+        Stream->LibraryExports.reserve(Content.Libraries.size());
+        Stream->Libraries.reserve(Content.Libraries.size());
+        Stream->HitGroups.reserve(Content.HitGroups.size());
+        Stream->LocalRootSignatures.reserve(NumAssociations);
+        Stream->AssociationExports.reserve(NumAssociations);
+        Stream->Associations.reserve(NumAssociations);
+
+        auto AddSubobject = [Stream](D3D12_STATE_SUBOBJECT_TYPE Type, const void* Desc)
+        {
+            D3D12_STATE_SUBOBJECT Subobject = {};
+            Subobject.Type = Type;
+            Subobject.pDesc = Desc;
+            Stream->Subobjects.push_back(Subobject);
+            return &Stream->Subobjects.back();
+        };
+
+        for (const RtPipeline::Library& InLibrary : Content.Libraries)
+        {
+            Stream->LibraryExports.emplace_back();
+            std::vector<D3D12_EXPORT_DESC>& ExportDescs = Stream->LibraryExports.back();
+            for (const std::wstring& Export : InLibrary.Exports)
+            {
+                D3D12_EXPORT_DESC ExportDesc = {};
+                ExportDesc.Name = Export.c_str();
+                ExportDescs.push_back(ExportDesc);
+            }
+
+            D3D12_DXIL_LIBRARY_DESC LibraryDesc = {};
+            LibraryDesc.DXILLibrary.pShaderBytecode = InLibrary.Bytecode;
+            LibraryDesc.DXILLibrary.BytecodeLength = InLibrary.BytecodeLength;
+            LibraryDesc.NumExports = (UINT)ExportDescs.size();
+            LibraryDesc.pExports = ExportDescs.data();
+            Stream->Libraries.push_back(LibraryDesc);
+            AddSubobject(D3D12_STATE_SUBOBJECT_TYPE_DXIL_LIBRARY, &Stream->Libraries.back());
+        }
+
+        for (const RtPipeline::HitGroup& InHitGroup : Content.HitGroups)
+        {
+            D3D12_HIT_GROUP_DESC HitGroupDesc = {};
+            HitGroupDesc.Type = InHitGroup.Type == RtPipeline::HitGroupType::Triangles ?
+                D3D12_HIT_GROUP_TYPE_TRIANGLES : D3D12_HIT_GROUP_TYPE_PROCEDURAL_PRIMITIVE;
+            HitGroupDesc.HitGroupExport = InHitGroup.Name.c_str();
+            HitGroupDesc.ClosestHitShaderImport = InHitGroup.ClosestHit.empty() ? nullptr : InHitGroup.ClosestHit.c_str();
+            HitGroupDesc.AnyHitShaderImport = InHitGroup.AnyHit.empty() ? nullptr : InHitGroup.AnyHit.c_str();
+            HitGroupDesc.IntersectionShaderImport = InHitGroup.Intersection.empty() ? nullptr : InHitGroup.Intersection.c_str();
+            Stream->HitGroups.push_back(HitGroupDesc);
+            AddSubobject(D3D12_STATE_SUBOBJECT_TYPE_HIT_GROUP, &Stream->HitGroups.back());
+        }
+
+        for (const RtPipeline::LocalRootSignatureAssociation& Association : Content.LocalRootSignatures)
+        {
+            D3D12_LOCAL_ROOT_SIGNATURE LocalRootSignature = {};
+            LocalRootSignature.pLocalRootSignature = Association.RootSignature;
+            Stream->LocalRootSignatures.push_back(LocalRootSignature);
+            D3D12_STATE_SUBOBJECT* RootSignatureSubobject =
+                AddSubobject(D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE, &Stream->LocalRootSignatures.back());
+
+            Stream->AssociationExports.emplace_back();
+            std::vector<LPCWSTR>& Exports = Stream->AssociationExports.back();
+            for (const std::wstring& Export : Association.Exports)
+            {
+                Exports.push_back(Export.c_str());
+            }
+
+            D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION ExportsAssociation = {};
+            ExportsAssociation.pSubobjectToAssociate = RootSignatureSubobject;
+            ExportsAssociation.NumExports = (UINT)Exports.size();
+            ExportsAssociation.pExports = Exports.data();
+            Stream->Associations.push_back(ExportsAssociation);
+            AddSubobject(D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION, &Stream->Associations.back());
+        }
+
+        // Unassociated configs and the global root signature apply to every export.
+        Stream->ShaderConfig.MaxPayloadSizeInBytes = PipelineState.MaxPayloadSize;
+        Stream->ShaderConfig.MaxAttributeSizeInBytes = PipelineState.MaxAttributeSize;
+        AddSubobject(D3D12_STATE_SUBOBJECT_TYPE_RAYTRACING_SHADER_CONFIG, &Stream->ShaderConfig);
+
+        Stream->PipelineConfig.MaxTraceRecursionDepth = PipelineState.MaxTraceRecursionDepth;
+        AddSubobject(D3D12_STATE_SUBOBJECT_TYPE_RAYTRACING_PIPELINE_CONFIG, &Stream->PipelineConfig);
+
+        Stream->GlobalRootSignature.pGlobalRootSignature = PipelineState.GlobalRootSignature;
+        AddSubobject(D3D12_STATE_SUBOBJECT_TYPE_GLOBAL_ROOT_SIGNATURE, &Stream->GlobalRootSignature);
+
+        Stream->Config.Flags = PipelineState.AllowStateObjectAdditions ?
+            D3D12_STATE_OBJECT_FLAG_ALLOW_STATE_OBJECT_ADDITIONS : D3D12_STATE_OBJECT_FLAG_NONE;
+        AddSubobject(D3D12_STATE_SUBOBJECT_TYPE_STATE_OBJECT_CONFIG, &Stream->Config);
+    }
+
+    static bool CheckRtPipeline(bool IsValid, const std::vector<std::string>& Errors)
+    {
+        for (const std::string& Error : Errors)
+        {
+            OutputDebugStringA(("RtPipeline: " + Error + "\n").c_str());
+        }
+        return IsValid;
+    }
+
+    bool CreateRtStateObject(ID3D12Device10* Device, const RtPipeline::Desc& PipelineDesc,
+                             ID3D12StateObject** RaytracingStateObject)
+    {
+        std::vector<std::string> Errors;
+        if (!CheckRtPipeline(RtPipeline::Validate(PipelineDesc, &Errors), Errors))
+        {
+            return false;
+        }
+
+        RtStateObjectStream Stream;
+        BuildRtStateObjectStream(PipelineDesc, PipelineDesc, &Stream);
+
+        D3D12_STATE_OBJECT_DESC StateObjectDesc = {};
+        StateObjectDesc.Type = D3D12_STATE_OBJECT_TYPE_RAYTRACING_PIPELINE;
+        StateObjectDesc.NumSubobjects = (UINT)Stream.Subobjects.size();
+        StateObjectDesc.pSubobjects = Stream.Subobjects.data();
+        return Succeeded(Device->CreateStateObject(&StateObjectDesc, IID_PPV_ARGS(RaytracingStateObject)),
+                         "CreateStateObject");
+    }
+
+    bool AddToRtStateObject(ID3D12Device10* Device, RtPipeline::Desc* PipelineDesc, const RtPipeline::Desc& Addition,
+                            ID3D12StateObject* RaytracingStateObject, ID3D12StateObject** NewRaytracingStateObject)
+    {
+        std::vector<std::string> Errors;
+        if (!CheckRtPipeline(RtPipeline::ValidateAddition(*PipelineDesc, Addition, &Errors), Errors))
+        {
+            return false;
+        }
+
+        // Only the new subobjects are compiled, the configs are repeated so they match the existing ones.
+        RtStateObjectStream Stream;
+        BuildRtStateObjectStream(Addition, *PipelineDesc, &Stream);
+
+        D3D12_STATE_OBJECT_DESC StateObjectDesc = {};
+        StateObjectDesc.Type = D3D12_STATE_OBJECT_TYPE_RAYTRACING_PIPELINE;
+        StateObjectDesc.NumSubobjects = (UINT)Stream.Subobjects.size();
+        StateObjectDesc.pSubobjects = Stream.Subobjects.data();
+        if (!Succeeded(Device->AddToStateObject(&StateObjectDesc, RaytracingStateObject,
+                                                IID_PPV_ARGS(NewRaytracingStateObject)), "AddToStateObject"))
+        {
+            return false;
+        }
+
+        RtPipeline::Merge(PipelineDesc, Addition);
+        return true;
+    }
+
+    bool CreateShaderTable(ID3D12Device10* Device, ID3D12StateObject* RaytracingStateObject,
+                           const ShaderBindingTable::Builder& TableBuilder,
+                           ID3D12Resource** ShaderTable, ShaderBindingTable::Layout* OutLayout)
+    {
+        ShaderBindingTable::ComputeLayout(TableBuilder, OutLayout);
+
+        // One identifier lookup per unique export. A reloaded shader may have renamed or removed one.
+        ComPtr<ID3D12StateObjectProperties> RtPsoProperties;
+        Check(RaytracingStateObject->QueryInterface(IID_PPV_ARGS(&RtPsoProperties)));
+        std::vector<const void*> Identifiers(TableBuilder.Exports.size());
+        for (size_t i = 0; i < Identifiers.size(); ++i)
+        {
+            Identifiers[i] = RtPsoProperties->GetShaderIdentifier(TableBuilder.Exports[i]);
+            if (Identifiers[i] == nullptr)
+            {
+                std::wstring Message = std::wstring(L"ShaderBindingTable: no export ") + TableBuilder.Exports[i];
+                OutputDebugStringW((Message + L"\n").c_str());
+                return false;
+            }
+        }
+
+        // Build the image in cached memory, then copy it to the write-combined upload heap in one go.
+        std::vector<UINT8> Image(OutLayout->TotalSize);
+        ShaderBindingTable::Write(TableBuilder, *OutLayout, Identifiers.data(), Image.data());
+
+        // We are using an upload heap for simplicity, ideally transfer to a default heap.
+        CreateCommittedBuffer(Device, D3D12_HEAP_TYPE_UPLOAD,
+                              OutLayout->TotalSize, ShaderTable,
+                              D3D12_RESOURCE_STATE_GENERIC_READ);
+
+        UINT8* ShaderTableDataStart = nullptr;
+        Check((*ShaderTable)->Map(0, nullptr, (void**)&ShaderTableDataStart));
+        memcpy(ShaderTableDataStart, Image.data(), Image.size());
+        (*ShaderTable)->Unmap(0, nullptr);
+        return true;
+    }
+
+    void GetDispatchRaysDesc(const ShaderBindingTable::Layout& TableLayout, D3D12_GPU_VIRTUAL_ADDRESS ShaderTableAddress,
+                             UINT Width, UINT Height, D3D12_DISPATCH_RAYS_DESC* OutDesc, UINT RayGenIndex)
+    {
+        using ShaderBindingTable::Section;
+        const ShaderBindingTable::SectionLayout& RayGen = TableLayout.Sections[(UINT)Section::RayGen];
+        const ShaderBindingTable::SectionLayout& Miss = TableLayout.Sections[(UINT)Section::Miss];
+        const ShaderBindingTable::SectionLayout& HitGroup = TableLayout.Sections[(UINT)Section::HitGroup];
+        const ShaderBindingTable::SectionLayout& Callable = TableLayout.Sections[(UINT)Section::Callable];
+        assert(RayGenIndex < RayGen.NumRecords);
+
+        *OutDesc = {};
+        OutDesc->Width = Width;
+        OutDesc->Height = Height;
+        OutDesc->Depth = 1;
+
+        // The raygen record must start on a table boundary, so selecting one other than the first
+        // requires a stride that is a multiple of the table alignment.
+        assert(RayGenIndex == 0 || RayGen.Stride % ShaderBindingTable::TableAlignment == 0);
+        OutDesc->RayGenerationShaderRecord.StartAddress = ShaderTableAddress + RayGen.Offset + RayGenIndex * RayGen.Stride;
+        OutDesc->RayGenerationShaderRecord.SizeInBytes = RayGen.Stride;
+
+        // Empty sections are left null.
+        auto SetRange = [ShaderTableAddress](const ShaderBindingTable::SectionLayout& InSection,
+                                             D3D12_GPU_VIRTUAL_ADDRESS_RANGE_AND_STRIDE* Range)
+        {
+            if (InSection.NumRecords > 0)
+            {
+                Range->StartAddress = ShaderTableAddress + InSection.Offset;
+                Range->SizeInBytes = InSection.Size;
+                Range->StrideInBytes = InSection.Stride;
+            }
+        };
+        SetRange(Miss, &OutDesc->MissShaderTable);
+        SetRange(HitGroup, &OutDesc->HitGroupTable);
+        SetRange(Callable, &OutDesc->CallableShaderTable);
     }
 
     //// Helper to load UV adjustment for given texture and issue a warning if vertex needs multiple different UV adjustments for its textures 
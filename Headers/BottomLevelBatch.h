@@ -0,0 +1,33 @@
+#pragma once
+#include "Types.h"
+#include <vector>
+
+// Packs bottom-level acceleration structure builds into batches that share one scratch buffer.
+// Builds in a batch run concurrently on disjoint scratch ranges; batches are separated by a single
+// UAV barrier and reuse the same memory. Pure CPU, see D3D::BuildBottomLevels for the GPU side.
+namespace BottomLevelBatch
+{
+    static const UINT64 ScratchAlignment = 256; // D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT
+
+    struct Batch
+    {
+        UINT First = 0; // Into Plan::Order.
+        UINT Count = 0;
+        UINT64 ScratchSize = 0;
+    };
+
+    struct Plan
+    {
+        std::vector<UINT> Order;            // Build indices grouped by batch.
+        std::vector<UINT64> ScratchOffsets; // Per build, relative to the shared scratch buffer.
+        std::vector<Batch> Batches;
+        UINT64 ScratchSize = 0;             // Largest batch. Only exceeds the budget for builds that don't fit alone.
+        UINT64 TotalScratchSize = 0;        // What one scratch buffer per build would have cost.
+    };
+
+    // Worst-fit decreasing: largest builds first, each into the batch with the most room left.
+    void PlanBuilds(const UINT64* ScratchSizes, UINT NumBuilds, UINT64 ScratchBudget, Plan* OutPlan);
+
+    // Plans NumBuilds builds with synthetic sizes and prints the timing and packing efficiency.
+    void RunBenchmark(UINT NumBuilds, UINT64 ScratchBudget);
+}
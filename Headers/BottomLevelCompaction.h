@@ -0,0 +1,61 @@
+#pragma once
+#include "Types.h"
+#include <vector>
+
+// Tracks bottom-level acceleration structures through compaction. Each BLAS goes:
+//   WaitingForSize: built with ALLOW_COMPACTION, the GPU is writing its compacted size.
+//   Compacting:     the size is known, a copy into a right-sized suballocation was recorded.
+//   Compacted:      the copy completed and the original can be released.
+// Driven only by fence values and sizes, no device needed. See D3D::UpdateBottomLevelCompaction for the GPU side.
+namespace BottomLevelCompaction
+{
+    static const UINT64 Alignment = 256; // D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT
+
+    enum class State
+    {
+        WaitingForSize,
+        Compacting,
+        Compacted
+    };
+
+    struct Entry
+    {
+        State CurrentState = State::WaitingForSize;
+        UINT64 FenceValue = 0;     // Of the build while waiting for the size, of the copy while compacting.
+        UINT64 OriginalSize = 0;
+        UINT64 CompactedSize = 0;
+        UINT Allocation = 0;       // Into Scheduler::AllocationSizes.
+        UINT64 Offset = 0;         // Within the allocation.
+    };
+
+    struct Scheduler
+    {
+        std::vector<Entry> Entries;
+        std::vector<UINT64> AllocationSizes; // One per Update that started copies.
+    };
+
+    // What the caller has to do on the GPU for one Update.
+    struct Step
+    {
+        std::vector<UINT> Copies;   // Entries to compact into the new allocation, at their Offset.
+        std::vector<UINT> Releases; // Entries whose original can be freed.
+        UINT64 AllocationSize = 0;  // Size of the new allocation, 0 if there are no copies.
+    };
+
+    UINT Register(Scheduler* InScheduler, UINT64 OriginalSize, UINT64 BuildFenceValue);
+
+    // Advances every entry whose fence completed. CompactedSizes is indexed by entry and only read for entries whose
+    // build finished. The copies are expected to be submitted with SubmitFenceValue.
+    void Update(Scheduler* InScheduler, UINT64 CompletedFenceValue, UINT64 SubmitFenceValue,
+                const UINT64* CompactedSizes, Step* OutStep);
+
+    bool IsDone(const Scheduler& InScheduler);
+
+    // Before: every BLAS at its original size. After: compacted entries at their aligned compacted size.
+    void GetMemoryUsage(const Scheduler& InScheduler, UINT64* Before, UINT64* After);
+
+    // The null backend: BLASes registered over frames against a simulated fence that completes out of step with what
+    // was submitted. Checks that entries only move forward, and only once their fence completed, that every copy
+    // gets an aligned range of its own, and the memory usage before and after.
+    bool RunTest(UINT NumEntries);
+}
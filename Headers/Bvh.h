@@ -0,0 +1,42 @@
+#pragma once
+#include "Types.h"
+#include <DirectXMath.h>
+#include <vector>
+
+namespace Bvh
+{
+    struct AABB
+    {
+        DirectX::XMFLOAT3 Min;
+        DirectX::XMFLOAT3 Max;
+    };
+
+    struct Node
+    {
+        DirectX::XMFLOAT3 Min;
+        UINT LeftOrFirst; // Left child index for inner nodes (right child is LeftOrFirst + 1), first primitive for leaves.
+        DirectX::XMFLOAT3 Max;
+        UINT Count; // Number of primitives in a leaf, 0 for inner nodes.
+    };
+
+    struct Tree
+    {
+        std::vector<Node> Nodes;
+        std::vector<UINT> Primitives; // Indices into the bounds the tree was built from.
+        UINT Depth = 0; // Nodes on the longest path from the root to a leaf, what a traversal stack needs.
+    };
+
+    AABB EmptyBox();
+    void Grow(AABB* Box, const AABB& Other);
+    void Grow(AABB* Box, const DirectX::XMFLOAT3& Point);
+    float SurfaceArea(const AABB& Box);
+
+    // Top-down binned SAH build. Children are always allocated after their parent.
+    void Build(const AABB* Bounds, UINT NumPrimitives, Tree* OutTree, UINT MaxLeafSize = 4);
+
+    // Recomputes node bounds bottom-up for moved primitives while keeping the topology.
+    void Refit(Tree* InTree, const AABB* Bounds);
+
+    // Expected traversal cost of the tree (1 per node visit, 1 per primitive test) relative to its root.
+    float ComputeSAHCost(const Tree& InTree);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "Types.h"
+#include "Bvh.h"
+#include <atomic>
+
+namespace CpuTracer
+{
+    struct Scene
+    {
+        std::vector<DirectX::XMFLOAT3> Positions; // 3 world space vertices per triangle.
+        std::vector<DirectX::XMFLOAT3> Albedos; // One per triangle.
+        Bvh::Tree TriangleBvh;
+        DirectX::XMFLOAT3 SunDirection;
+        DirectX::XMFLOAT3 SunColor;
+        DirectX::XMFLOAT3 SkyColor;
+    };
+
+    struct Settings
+    {
+        UINT Width = 0;
+        UINT Height = 0;
+        UINT MaxBounces = 2;
+        UINT NumThreads = 1;
+        UINT SampleIndex = 0; // Seeds the random sequence. Each render call traces one sample per pixel.
+    };
+
+    // Structure-of-arrays ray queue. Shadow rays reuse it: Throughput holds the light contribution and HitT the ray length.
+    struct RayQueue
+    {
+        std::vector<float> OriginX, OriginY, OriginZ;
+        std::vector<float> DirectionX, DirectionY, DirectionZ;
+        std::vector<float> ThroughputR, ThroughputG, ThroughputB;
+        std::vector<UINT> PixelIndex;
+        std::vector<UINT> RngState;
+        std::vector<float> HitT;
+        std::vector<UINT> HitTriangle;
+        std::atomic<UINT> Count{0};
+    };
+
+    struct WavefrontState
+    {
+        RayQueue Paths[2]; // Rays of the current bounce and rays continuing to the next one.
+        RayQueue ShadowRays;
+    };
+
+    // The DXRTutorial scene (triangle instances above a plane), lit by the same sky and shadow light direction.
+    void CreateTutorialScene(Scene* OutScene, UINT NumTriangleInstances = 3);
+
+    // Megakernel style: every pixel recursively traces its whole path.
+    void RenderRecursive(const Scene& InScene, const Settings& InSettings, DirectX::XMFLOAT3* OutRadiance);
+
+    // Generate, extend, shade and connect run as separate parallel passes over the ray queues.
+    // Produces the same image as RenderRecursive for the same settings, up to the rounding of the additions.
+    void RenderWavefront(const Scene& InScene, const Settings& InSettings, WavefrontState* State,
+                         DirectX::XMFLOAT3* OutRadiance);
+
+    // Each tracer has to give the same image of the tutorial scene at 1 and all hardware threads (at least 8), bit
+    // for bit, and the two within rounding of each other. Rays through a BVH deeper than the fixed traversal stack
+    // have to hit too.
+    bool RunTest(UINT Width, UINT Height);
+
+    // Times both tracers at 1, 4 and all hardware threads and writes the results to the debug output.
+    void RunBenchmark(const Scene& InScene, UINT Width, UINT Height, UINT NumFrames = 4);
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "Types.h"
+#include <atomic>
+#include <vector>
+
+// Releasing what the GPU may still use once a fence says it's done. A timeline is a fence's values: a queue signals
+// each value once, in order, so a value that completed means everything submitted before it did. Anything can be
+// queued for release at a point on a timeline, from any thread, without a lock: a release is one allocation and a
+// compare-exchange onto a list. The thread that collects, once a frame, sorts them per timeline and hands the ones
+// whose point completed to the release function of their type. Pure CPU, see D3D::CreateReleaseQueue for the GPU
+// side.
+namespace DeferredRelease
+{
+    static const UINT MaxTimelines = 8;
+    static const UINT MaxTypes = 8;
+    static const UINT NumValues = 4;
+
+    struct Timeline
+    {
+        std::atomic<UINT64> Signaled{0};  // The last value a queue was asked to signal, from the submitting thread.
+        std::atomic<UINT64> Completed{0}; // The last value seen signaled, only goes up.
+    };
+
+    // What's recorded now is done once the next value is: retire it at GetNextValue.
+    UINT64 GetNextValue(const Timeline& InTimeline);
+    UINT64 Signal(Timeline* InTimeline);
+    void SetCompleted(Timeline* InTimeline, UINT64 CompletedValue);
+    bool IsCompleted(const Timeline& InTimeline, UINT64 Value);
+
+    struct RetirePoint
+    {
+        UINT Timeline = 0; // Index in the queue's timelines.
+        UINT64 Value = 0;
+    };
+
+    struct Item
+    {
+        RetirePoint Retire;
+        UINT Type = 0;                 // Picks the release function.
+        void* Object = nullptr;        // What's released, or what it goes back to.
+        UINT64 Values[NumValues] = {}; // Whatever else the type needs, a handle or a range.
+        Item* Next = nullptr;
+    };
+
+    typedef void (*ReleaseFunction)(void* Context, const Item& Released);
+
+    struct Queue
+    {
+        Timeline* Timelines[MaxTimelines] = {};
+        UINT NumTimelines = 0;
+        ReleaseFunction Releases[MaxTypes] = {};
+        void* Contexts[MaxTypes] = {};
+
+        std::atomic<Item*> Incoming{nullptr};     // Pushed from any thread, newest first.
+        std::vector<Item*> Pending[MaxTimelines]; // Per timeline, min-heaps on the retire value. Collect's only.
+
+        std::atomic<UINT64> NumEnqueued{0};
+        UINT64 NumReleased = 0;
+        size_t NumPending = 0;
+    };
+
+    // Not concurrent with anything else on the queue.
+    UINT AddTimeline(Queue* InQueue, Timeline* InTimeline);
+    void SetReleaseFunction(Queue* InQueue, UINT Type, ReleaseFunction Release, void* Context);
+
+    // Any thread.
+    void Enqueue(Queue* InQueue, const Item& Release);
+
+    // One thread at a time: releases what's retired by now. Returns how many.
+    UINT Collect(Queue* InQueue);
+
+    // Releases everything, once the GPU is idle.
+    UINT Flush(Queue* InQueue);
+
+    // The null backend: threads queue releases at points on simulated timelines while the main thread signals,
+    // completes and collects. Checks that nothing is released before its point completed or twice, that nothing
+    // retired is held back, and that everything is released in the end.
+    bool RunTest(UINT NumReleases, UINT NumThreads);
+
+    // Releases queued per second on NumThreads threads, and collected per second.
+    void RunBenchmark(UINT NumReleases, UINT NumThreads);
+}
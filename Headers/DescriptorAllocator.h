@@ -0,0 +1,72 @@
+#pragma once
+#include "Types.h"
+#include "HeapAllocator.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// Slots of the one shader-visible CBV/SRV/UAV heap that every demo indexes into. The front of the heap is
+// persistent: contiguous ranges handed out as generational handles, so a stale handle is caught instead of
+// silently reading another resource's descriptor. The back is a linear region per frame in flight for transient
+// descriptors, reset when that frame's slot comes around again. Every allocation and free is safe from worker
+// threads. Pure CPU, handles are computed from a base and increment size, see D3D::CreateBindlessHeap.
+namespace DescriptorAllocator
+{
+    static const UINT IndexBits = 20; // Shader-visible heaps top out at 1M descriptors.
+    static const UINT MaxDescriptors = 1 << IndexBits;
+    static const UINT GenerationMask = (1 << (32 - IndexBits)) - 1;
+    static const UINT MaxFrames = 4;
+
+    // Generation in the high bits, heap index in the low ones. Generations start at 1, so 0 is never valid.
+    typedef UINT32 Handle;
+    static const Handle InvalidHandle = 0;
+
+    struct Heap
+    {
+        SIZE_T CpuStart = 0;
+        UINT64 GpuStart = 0;
+        UINT IncrementSize = 0;
+
+        UINT NumPersistent = 0;
+        UINT NumTransientPerFrame = 0;
+        UINT NumFrames = 0;
+
+        // Persistent region.
+        mutable std::mutex Lock;
+        HeapAllocator::Allocator Ranges;   // In descriptors.
+        std::vector<UINT> Blocks;          // Per index, the range starting there, if any.
+        std::vector<UINT16> Generations;   // Per index, bumped when the range starting there is freed.
+
+        // Transient regions, one after the other behind the persistent one.
+        std::atomic<UINT> TransientCounts[MaxFrames];
+        std::atomic<UINT> CurrentFrame{0};
+    };
+
+    inline UINT GetIndex(Handle InHandle)
+    {
+        return InHandle & (MaxDescriptors - 1);
+    }
+
+    void Initialize(Heap* InHeap, UINT NumPersistent, UINT NumTransientPerFrame, UINT NumFrames,
+                    SIZE_T CpuStart, UINT64 GpuStart, UINT IncrementSize);
+
+    // Count contiguous descriptors, InvalidHandle when the persistent region is full. Free once the GPU is done.
+    Handle Allocate(Heap* InHeap, UINT Count = 1);
+    bool Free(Heap* InHeap, Handle InHandle); // False for stale or invalid handles.
+    bool IsValid(const Heap& InHeap, Handle InHandle);
+
+    // Switches to FrameIndex's transient region, whose last frame must have completed. Not concurrent with
+    // AllocateTransient.
+    void BeginFrame(Heap* InHeap, UINT FrameIndex);
+    bool AllocateTransient(Heap* InHeap, UINT Count, UINT* OutIndex);
+
+    SIZE_T GetCpuHandle(const Heap& InHeap, UINT Index);
+    UINT64 GetGpuHandle(const Heap& InHeap, UINT Index);
+
+    // Threads allocating and freeing persistent ranges and transient descriptors on a heap with a fake increment
+    // size, checking that no two live allocations share a slot and that stale handles are rejected.
+    bool RunTest(UINT NumOperations, UINT NumThreads);
+
+    // Persistent allocate+free pairs and transient allocations per second on NumThreads threads.
+    void RunBenchmark(UINT NumOperations, UINT NumThreads);
+}
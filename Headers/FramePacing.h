@@ -0,0 +1,78 @@
+#pragma once
+#include "Types.h"
+#include <deque>
+
+// How far the CPU runs ahead of the display. Frames in flight is how many frames' resources exist, one set per back
+// buffer; the maximum latency is how many presents may be queued before the swap chain's waitable object holds the
+// next frame back. More of either smooths over spikes at the cost of latency. The telemetry measures both sides of
+// that per setting, so it can be picked per machine. Pure CPU, timestamps in seconds from the caller, see
+// D3D::SetFramePacing for the GPU side.
+namespace FramePacing
+{
+    static const UINT MinFramesInFlight = 2;
+    static const UINT MaxFramesInFlight = 4;
+    static const UINT HistorySize = 256; // Frames summarized.
+
+    struct Settings
+    {
+        UINT FramesInFlight = 2;
+        UINT MaxLatency = 1; // Up to FramesInFlight.
+    };
+
+    struct Sample
+    {
+        double FrameTime = 0; // Since the previous frame started.
+        double Latency = 0;   // From the frame starting, when input is read, to its GPU work completing.
+        double Waited = 0;    // Held back by the pacing before starting.
+    };
+
+    struct PendingFrame
+    {
+        UINT64 FenceValue = 0;
+        double Start = 0;
+        double Waited = 0;
+        double FrameTime = 0;
+    };
+
+    struct Telemetry
+    {
+        std::deque<PendingFrame> InFlight; // Started, not seen complete yet.
+        Sample History[HistorySize];       // Completed, a ring.
+        UINT NumSamples = 0;
+        UINT NextSample = 0;
+        double LastStart = -1;
+        double LastReport = 0;
+    };
+
+    struct Summary
+    {
+        UINT NumFrames = 0;
+        double FramesPerSecond = 0;
+        double AverageFrameMs = 0;
+        double P99FrameMs = 0;
+        double AverageLatencyMs = 0;
+        double P99LatencyMs = 0;
+        double AverageWaitMs = 0;
+    };
+
+    // A valid setting, the latency no higher than the frames in flight.
+    Settings Clamp(Settings InSettings);
+
+    // Starts over, e.g. when the settings change.
+    void Reset(Telemetry* InTelemetry);
+
+    // Once the pacing let the frame that will signal FenceValue start.
+    void BeginFrame(Telemetry* InTelemetry, UINT64 FenceValue, double Time, double Waited);
+
+    // Latencies end when the CPU sees the fence, look often to keep them honest.
+    void CompleteFrames(Telemetry* InTelemetry, UINT64 CompletedFenceValue, double Time);
+
+    Summary Summarize(const Telemetry& InTelemetry);
+
+    // Prints the summary with the settings it was measured with, every Interval seconds.
+    void Report(Telemetry* InTelemetry, const Settings& InSettings, double Time, double Interval);
+
+    // Simulated frames with jittered CPU and GPU times, CPU-bound, GPU-bound and under vsync, printing throughput,
+    // latency and waiting for every setting.
+    void RunBenchmark(UINT NumFrames);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "Types.h"
+#include <DirectXMath.h>
+#include <vector>
+
+// Culls instance world bounds against a camera frustum before they go into the TLAS. Bounds are stored as
+// structure of arrays and tested eight at a time with AVX2; survivors are compacted into an index list.
+// Only valid for rays that start at the camera: shadow and GI rays can hit anything, see KeepCulled. Pure CPU.
+namespace FrustumCulling
+{
+    static const UINT BatchSize = 8;
+    static const UINT ParallelThreshold = 64 * 1024;
+    static const UINT GrainSize = 16 * 1024;
+
+    // Instance masks for when culled instances are kept: camera rays trace with PrimaryRayMask and skip them.
+    static const UINT PrimaryRayMask = 0x01;
+    static const UINT VisibleInstanceMask = 0xFF;
+    static const UINT CulledInstanceMask = 0xFF & ~PrimaryRayMask;
+
+    struct Frustum
+    {
+        DirectX::XMFLOAT4 Planes[6]; // Inside when Dot(Plane.xyz, Point) + Plane.w >= 0.
+    };
+
+    struct Bounds
+    {
+        std::vector<float> MinX, MinY, MinZ;
+        std::vector<float> MaxX, MaxY, MaxZ;
+    };
+
+    struct Settings
+    {
+        bool KeepCulled = false; // Keep off-screen instances for shadow/GI rays, masked out of camera rays.
+        UINT NumThreads = 1;
+    };
+
+    // From a row-vector view * projection matrix with D3D depth [0, 1], like SimpleCamera's.
+    void ExtractFrustum(DirectX::FXMMATRIX ViewProjection, Frustum* OutFrustum);
+
+    void Resize(Bounds* InBounds, UINT NumBounds);
+    void SetBounds(Bounds* InBounds, UINT Index, const DirectX::XMFLOAT3& Min, const DirectX::XMFLOAT3& Max);
+
+    // Writes the indices of the boxes touching the frustum to OutVisible, in order, and returns how many there are.
+    // OutVisible needs room for NumBounds indices.
+    UINT Cull(const Frustum& InFrustum, const Bounds& InBounds, UINT NumBounds, UINT* OutVisible,
+              UINT NumThreads = 1);
+
+    // One box at a time, the reference for Cull.
+    bool IsVisible(const Frustum& InFrustum, const DirectX::XMFLOAT3& Min, const DirectX::XMFLOAT3& Max);
+
+    // Culls NumInstances random boxes and compacts the visible ones' instance descriptions, printing the timings.
+    void RunBenchmark(UINT NumInstances, UINT NumFrames);
+}
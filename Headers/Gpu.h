@@ -12,7 +12,29 @@
 #include <DirectXPackedVector.h>
 #include <dxcapi.h>
 #include <vector>
+#include <immintrin.h>
 #include "../Shaders/Shared.h"
+#include "ShaderBindingTable.h"
+#include "RtPipeline.h"
+#include "BottomLevelBatch.h"
+#include "BottomLevelCompaction.h"
+#include "TopLevelPolicy.h"
+#include "InstanceTransforms.h"
+#include "FrustumCulling.h"
+#include "OcclusionCulling.h"
+#include "HeapAllocator.h"
+#include "UploadRing.h"
+#include "DescriptorAllocator.h"
+#include "ResourceStates.h"
+#include "RenderGraph.h"
+#include "QueueScheduler.h"
+#include "StreamingUploads.h"
+#include "FramePacing.h"
+#include "DeferredRelease.h"
+#include "ParallelRecording.h"
+#include "ShaderCompilation.h"
+#include "ShaderCache.h"
+#include "ShaderReload.h"
 #include "d3dx12.h"
 
 using namespace Microsoft::WRL;
@@ -95,6 +117,15 @@ inline void SetNameIndexed(ComPtr<ID3D12Object> object, const wchar_t* name, UIN
 #define NAME_D3D12_OBJECT(x) SetName((x), #x)
 #define NAME_D3D12_OBJECT_INDEXED(x, n) SetNameIndexed((x), L#x, n)
 
+// GPU side of QueueScheduler: a timeline fence per queue, which the other queues wait on instead of the CPU.
+struct QueueTimelines
+{
+    QueueScheduler::Scheduler Scheduler;
+    ID3D12CommandQueue* Queues[QueueScheduler::NumQueues] = {};
+    ComPtr<ID3D12Fence> Fences[QueueScheduler::NumQueues];
+    DeferredRelease::Timeline Values[QueueScheduler::NumQueues]; // Of Fences, for releases from any thread.
+};
+
 struct Global
 {
     // Devices.
@@ -113,14 +144,20 @@ struct Global
     ComPtr<IDXGISwapChain4> SwapChain;
     bool VSync = false;
     UINT NumVSyncIntervals = 1;
+    HANDLE FrameLatencyWaitable = nullptr; // Signaled once fewer than Pacing.MaxLatency presents are queued.
+    FramePacing::Settings Pacing;
+    FramePacing::Telemetry PacingTelemetry;
 
     // Synchronization.
     ComPtr<ID3D12Fence> Fence;
     HANDLE FenceEvent;
+    DeferredRelease::Timeline FrameTimeline; // Of Fence, one value per frame signaled after its Present.
+    QueueTimelines Timelines; // Between the queues, Fence paces the frames.
 };
 
 struct Frame
 {
+    UINT Index; // Of the back buffer, and of the frame's resources kept elsewhere.
     ComPtr<ID3D12Resource> BackBuffer;
     ComPtr<ID3D12Resource> DepthBuffer;
     D3D12_CPU_DESCRIPTOR_HANDLE RTVHandle;
@@ -129,23 +166,183 @@ struct Frame
     ComPtr<ID3D12CommandAllocator> GraphicsCmdAlloc;
     ComPtr<ID3D12GraphicsCommandList7> ComputeCmdList;
     ComPtr<ID3D12CommandAllocator> ComputeCmdAlloc;
-    UINT64 FenceValue;
+    ComPtr<ID3D12GraphicsCommandList7> BarrierCmdList; // The graphics list's resolved barriers, executed before it.
+    ComPtr<ID3D12CommandAllocator> BarrierCmdAlloc;
+    ResourceStates::Tracker GraphicsStates;
+    std::vector<ID3D12CommandList*> RecordedCmdLists; // By RecordParallel, executed before GraphicsCmdList.
+    UINT64 FenceValue; // Signaled once the frame last recorded with these resources is done.
+};
+
+// ID3D12Heaps of one type that resources are placed into, instead of one committed resource (and heap) each.
+struct HeapPool
+{
+    static const UINT64 DefaultHeapSize = 64 * 1024 * 1024;
+    D3D12_HEAP_TYPE Type = D3D12_HEAP_TYPE_DEFAULT;
+    D3D12_HEAP_FLAGS Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS; // Resource heap tier 1 doesn't mix categories.
+    UINT64 HeapSize = DefaultHeapSize; // Larger resources get a heap of their own.
+    std::vector<ComPtr<ID3D12Heap>> Heaps;
+    std::vector<HeapAllocator::Allocator> Allocators; // Per heap, in 64KB granules.
+};
+
+struct PlacedAllocation
+{
+    HeapPool* Pool = nullptr;
+    UINT Heap = 0;
+    HeapAllocator::Allocation Range;
+};
+
+// Upload buffers under 64KB are ranges of larger placed pages, which stay mapped.
+struct SmallBufferPool
+{
+    static const UINT64 PageSize = 1024 * 1024;
+    static const UINT64 MaxBufferSize = 64 * 1024;
+    static const UINT64 Alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT; // Any range can be a CBV.
+    std::vector<ComPtr<ID3D12Resource>> Pages;
+    std::vector<UINT8*> MappedPages;
+    std::vector<HeapAllocator::Allocator> Allocators; // Per page.
+};
+
+struct SmallBuffer
+{
+    ID3D12Resource* Resource = nullptr; // The page, shared with other small buffers.
+    UINT64 Offset = 0;                  // Within Resource.
+    UINT64 Size = 0;
+    D3D12_GPU_VIRTUAL_ADDRESS Address = 0;
+    UINT8* Mapped = nullptr;
+    UINT Page = 0;
+    HeapAllocator::Allocation Range;
+};
+
+struct GpuMemory
+{
+    HeapPool DefaultBuffers;
+    HeapPool UploadBuffers;
+    HeapPool ReadbackBuffers;
+    HeapPool Textures; // Without render targets and depth buffers, which stay committed.
+    SmallBufferPool SmallUploadBuffers;
+};
+
+// GPU side of UploadRing: one persistently mapped buffer, in the GPU upload heap when the device has it.
+struct UploadRingBuffer
+{
+    UploadRing::Ring Ring;
+    ComPtr<ID3D12Resource> Buffer;
+    UINT8* Mapped = nullptr;
+    D3D12_GPU_VIRTUAL_ADDRESS Address = 0;
+};
+
+struct UploadAllocation
+{
+    UINT8* Mapped = nullptr; // Write-combined, write it once and never read it.
+    D3D12_GPU_VIRTUAL_ADDRESS Address = 0;
+};
+
+// GPU side of StreamingUploads: the ring in the upload heap, copied out of on the copy queue. Destinations are in
+// COMMON, which copy queue accesses promote from and decay back to once the batch completed.
+struct StreamingUploadBuffer
+{
+    static const UINT NumCmdAllocs = 4; // Batches in flight, more wait for the next frame.
+
+    struct Destination
+    {
+        ID3D12Resource* Resource = nullptr;
+        UINT64 Offset = 0;       // Buffers.
+        UINT Subresource = 0;    // Textures.
+        bool IsTexture = false;
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT Footprint = {}; // Textures, its offset is the staged one's.
+        UINT NumRows = 0;        // Textures, of all depth slices.
+        UINT64 RowSize = 0;
+        std::vector<UINT8> Data; // Copied when queued, textures row after row.
+    };
+
+    StreamingUploads::Uploader Uploader;
+    std::deque<Destination> Queued; // Per upload not staged yet.
+    std::vector<StreamingUploads::Staged> Staged;
+    ComPtr<ID3D12Resource> Buffer;
+    UINT8* Mapped = nullptr;
+    ComPtr<ID3D12GraphicsCommandList7> CmdList;
+    ComPtr<ID3D12CommandAllocator> CmdAllocs[NumCmdAllocs];
+    UINT64 CmdAllocFenceValues[NumCmdAllocs] = {}; // The copy queue's, of the last batch recorded with each.
+};
+
+// The shader-visible CBV/SRV/UAV heap all demos share, slots handed out by DescriptorAllocator.
+struct BindlessHeap
+{
+    DescriptorAllocator::Heap Allocator;
+    ComPtr<ID3D12DescriptorHeap> Heap;
+};
+
+// GPU side of a RenderGraph: the graph rebuilt every frame, what it compiled to and the resources behind its ids.
+// Transients are placed in heaps of their own, recreated when the topology changes.
+struct RenderGraphResources
+{
+    RenderGraph::Graph Graph;
+    RenderGraph::CompiledGraph Compiled;
+    std::vector<D3D12_RESOURCE_DESC> Descs;    // Per resource, of the transient ones.
+    std::vector<ID3D12Resource*> Resources;    // Per resource, valid while the passes execute.
+    std::vector<ComPtr<ID3D12Resource>> Transients;
+    ComPtr<ID3D12Heap> Heaps[(UINT)RenderGraph::HeapGroup::Count];
+};
+
+// GPU side of ParallelRecording: command lists with an allocator each, per frame in flight and recording thread.
+struct CommandListPools
+{
+    struct Entry
+    {
+        ComPtr<ID3D12CommandAllocator> CmdAlloc;
+        ComPtr<ID3D12GraphicsCommandList7> CmdList;
+    };
+
+    ParallelRecording::Pools Pools;
+    D3D12_COMMAND_LIST_TYPE Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+    std::vector<Entry> Entries[ParallelRecording::MaxFrames][ParallelRecording::MaxThreads];
+    std::vector<ParallelRecording::Chunk> Chunks; // The last recording's.
+};
+
+enum class ReleaseType
+{
+    Resource,
+    Descriptor,
+    Placed,
+    SmallBuffer,
+    Count
+};
+
+// GPU side of DeferredRelease: the queues' timelines by QueueType, then the frame fence's, and what releasing each
+// type takes.
+struct ReleaseQueue
+{
+    static const UINT FrameTimeline = QueueScheduler::NumQueues;
+    DeferredRelease::Queue Queue;
 };
 
 struct GlobalResources
 {
     // Global data.
-    static const INT NumBackBuffers = 2;
+    static const UINT MaxBackBuffers = FramePacing::MaxFramesInFlight;
     static const DXGI_FORMAT BackBufferFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
     static const DXGI_FORMAT DepthBufferFormat = DXGI_FORMAT_D32_FLOAT;
+    static const UINT64 FrameUploadsSize = 4 * 1024 * 1024;
+    static const UINT64 StreamingUploadsSize = 32 * 1024 * 1024;
+    static const UINT64 StreamingBudgetPerFrame = 8 * 1024 * 1024;
+    static const UINT NumPersistentDescriptors = 65536;
+    static const UINT NumTransientDescriptors = 8192; // Per frame in flight.
     ComPtr<ID3D12DescriptorHeap> RTVHeap;
     UINT RTVHeapHandleSize;
     ComPtr<ID3D12DescriptorHeap> DSVHeap;
     UINT DSVHeapHandleSize;
+    GpuMemory Memory; // Before the resources placed in it, so it's released after them.
     ComPtr<ID3D12Resource> OutputTexture;
+    UploadRingBuffer FrameUploads; // Constants and dynamic data, retired by the frame fence.
+    StreamingUploadBuffer Streaming; // Geometry and textures, on the copy queue.
+    BindlessHeap Descriptors;
+    CommandListPools RecordingLists; // Graphics passes recorded on several threads.
+    ReleaseQueue Releases; // Whatever frames in flight or other queues may still use.
+    ResourceStates::GlobalStates States; // Of the resources shared between frames, as of the last submission.
 
-    // Frame data.
-    Frame Frames[NumBackBuffers] = {};
+    // Frame data, one per back buffer.
+    UINT NumBackBuffers = 2; // Dx.Pacing.FramesInFlight.
+    Frame Frames[MaxBackBuffers] = {};
 };
 
 struct ShaderCompiler
@@ -162,16 +359,91 @@ struct Shader
     const wchar_t* Entry;
     const wchar_t* TargetProfile;
     DxcDefine* Defines;
+    UINT NumDefines;
+};
+
+// GPU side of ShaderCache: the archive mapped read-only for the whole run, hits are blobs pinned in the mapping.
+struct ShaderCacheFile
+{
+    std::wstring Path;
+    HANDLE File = INVALID_HANDLE_VALUE;
+    HANDLE Mapping = nullptr;
+    const void* View = nullptr;
+    ShaderCache::Key CompilerVersion;
+    ShaderCache::Cache Cache;
+};
+
+// GPU side of ShaderReload: the Shaders directory watched with a read that's always pending, polled once a frame.
+struct ShaderWatcher
+{
+    std::wstring Directory;
+    HANDLE Handle = INVALID_HANDLE_VALUE;
+    OVERLAPPED Overlapped = {};
+    DWORD Notifications[4096]; // FILE_NOTIFY_INFORMATION, DWORD aligned.
+    ShaderReload::Graph Graph;
+    ShaderReload::Changes Changes;
+};
+
+// What a demo's pipelines are rebuilt into when its shaders change, until they're swapped in.
+struct ReloadedPipelines
+{
+    Shader Shaders[2] = {};
+    ComPtr<ID3D12PipelineState> PSO;
+    ComPtr<ID3D12StateObject> StateObject;
+    ComPtr<ID3D12Resource> ShaderTable;
+    ShaderBindingTable::Layout ShaderTableLayout;
+    RtPipeline::Desc PipelineDesc;
 };
 
 struct BottomLevelASInfo
 {
-    ComPtr<ID3D12Resource> BottomLevel;
-    ComPtr<ID3D12Resource> BottomLevelScratch;
-    ComPtr<ID3D12Resource> VertexBuffer;
+    ComPtr<ID3D12Resource> BottomLevel; // Shared with other BLASes once compacted.
+    D3D12_GPU_VIRTUAL_ADDRESS Address = 0; // Of this BLAS within BottomLevel.
     UINT NumInstances = 1;
+    Bvh::AABB Bounds = Bvh::EmptyBox(); // Object space.
+};
+
+// GPU side of BottomLevelCompaction: the compacted size queries and the right-sized allocations.
+struct BottomLevelCompactionData
+{
+    BottomLevelCompaction::Scheduler Scheduler;
+    std::vector<BottomLevelASInfo*> Infos;             // Per entry, pointed at the compacted copy once recorded.
+    std::vector<ComPtr<ID3D12Resource>> Originals;     // Per entry, released when its copy completed.
+    std::vector<PlacedAllocation> OriginalRanges;      // Per entry, returned along with Originals.
+    std::vector<ComPtr<ID3D12Resource>> Allocations;   // Per Scheduler allocation, placed in Memory.
+    ComPtr<ID3D12Resource> CompactedSizes;             // Postbuild info, one UINT64 per BLAS.
+    ComPtr<ID3D12Resource> CompactedSizesReadback;
+    PlacedAllocation CompactedSizesRanges[2];          // Of CompactedSizes and CompactedSizesReadback.
+    GpuMemory* Memory = nullptr;
+    UINT64* MappedCompactedSizes = nullptr;
+    BottomLevelCompaction::Step CurrentStep;
+};
+
+// Persistently mapped upload buffers for TLAS instance descriptions, one per frame in flight,
+// so the CPU never overwrites descriptions the GPU may still be reading.
+struct InstanceDescRing
+{
+    static const UINT NumBuffers = GlobalResources::MaxBackBuffers;
+    ComPtr<ID3D12Resource> Buffers[NumBuffers]; // Placed in the upload pool.
+    PlacedAllocation Ranges[NumBuffers];
+    D3D12_RAYTRACING_INSTANCE_DESC* MappedDescs[NumBuffers] = {};
+    UINT64 FenceValues[NumBuffers] = {}; // Of the last frame that wrote each buffer.
+    UINT Capacity = 0;
+    UINT Current = 0;
 };
 
+// Writes one instance description to write-combined memory without reading it into the cache.
+// Dest must be 32-byte aligned, which instance descriptions in a buffer always are. Follow a batch with _mm_sfence.
+inline void StreamInstanceDesc(D3D12_RAYTRACING_INSTANCE_DESC* Dest, const D3D12_RAYTRACING_INSTANCE_DESC& Source)
+{
+    static_assert(sizeof(D3D12_RAYTRACING_INSTANCE_DESC) == sizeof(InstanceTransforms::InstanceDesc),
+                  "InstanceTransforms writes D3D12_RAYTRACING_INSTANCE_DESC.");
+    __m256i Low = _mm256_loadu_si256((const __m256i*)&Source);
+    __m256i High = _mm256_loadu_si256((const __m256i*)&Source + 1);
+    _mm256_stream_si256((__m256i*)Dest, Low);
+    _mm256_stream_si256((__m256i*)Dest + 1, High);
+}
+
 struct Material
 {
     std::string Name = "";
@@ -206,17 +478,85 @@ namespace D3D
 
     void CreateDevice(Global* Dx);
     void CreateFences(ID3D12Device10* Device, ID3D12Fence** Fence, HANDLE* FenceEvent, Frame* Frames);
+    void CreateQueueTimelines(ID3D12Device10* Device, Global* Dx);
     void CreateCommandLists(ID3D12Device10* Device, Frame* Frames);
     void CreateSwapchain(IDXGIFactory7* Factory, ID3D12CommandQueue* GraphicsQueue, WindowInfo* Window,
-                         IDXGISwapChain4** SwapChain);
-    void CreateDepthBuffers(ID3D12Device10* Device, Frame* Frames, WindowInfo* Window);
+                         UINT NumBackBuffers, IDXGISwapChain4** SwapChain);
+    void CreateDepthBuffers(ID3D12Device10* Device, Frame* Frames, UINT NumFrames, WindowInfo* Window);
     void CreateDSVDescriptorHeap(ID3D12Device10* Device, ID3D12DescriptorHeap** DSVHeap, UINT* DSVHeapHandleSize);
-    void CreateDepthBufferDSV(ID3D12Device10* Device, Frame* Frames, ID3D12DescriptorHeap* DSVHeap, UINT DSVHeapHandleSize);
+    void CreateDepthBufferDSV(ID3D12Device10* Device, Frame* Frames, UINT NumFrames, ID3D12DescriptorHeap* DSVHeap,
+                              UINT DSVHeapHandleSize);
     void CreateRTVDescriptorHeap(ID3D12Device10* Device, ID3D12DescriptorHeap** RTVHeap, UINT* RTVHeapHandleSize);
-    void CreateBackBufferRTV(ID3D12Device10* Device, IDXGISwapChain4* SwapChain, Frame* Frames, ID3D12DescriptorHeap* RTVHeap, UINT RTVHeapHandleSize);
+    void CreateBackBufferRTV(ID3D12Device10* Device, IDXGISwapChain4* SwapChain, Frame* Frames, UINT NumFrames,
+                             ID3D12DescriptorHeap* RTVHeap, UINT RTVHeapHandleSize);
+
+    // Frame pacing: the swap chain's latency and waitable object, then changing the frames in flight at runtime by
+    // resizing the swap chain and recreating what's per back buffer.
+    void CreateFramePacing(Global* Dx, const FramePacing::Settings& Settings);
+    void SetFramePacing(Global* Dx, GlobalResources* Data, WindowInfo* Window, const FramePacing::Settings& Settings);
+    void WaitForFence(ID3D12Fence* Fence, UINT64 Value, HANDLE Event);
+    void WaitForIdle(Global* Dx);
+
+    // The frame fence's next value on the graphics queue, and what the CPU saw of it.
+    UINT64 SignalFrameFence(Global* Dx);
+    UINT64 UpdateFrameFence(Global* Dx);
+
+    // Releases once the GPU is done, from any thread. Whatever the frame being recorded uses retires at
+    // GetFrameRetirePoint, work on another queue at its sync point. Resources are kept alive with a reference of
+    // their own. Collected once a frame, flushed at exit once idle.
+    void CreateReleaseQueue(Global* Dx, GlobalResources* Data);
+    DeferredRelease::RetirePoint GetFrameRetirePoint(const Global& Dx);
+    DeferredRelease::RetirePoint GetRetirePoint(const QueueScheduler::SyncPoint& Point);
+    void DeferRelease(ReleaseQueue* Releases, const DeferredRelease::RetirePoint& Retire, ID3D12Pageable* Object);
+    void DeferFree(ReleaseQueue* Releases, const DeferredRelease::RetirePoint& Retire,
+                   DescriptorAllocator::Handle Descriptor);
+    void DeferReleasePlaced(ReleaseQueue* Releases, const DeferredRelease::RetirePoint& Retire,
+                            const PlacedAllocation& Allocation);
+    void DeferFreeSmallBuffer(ReleaseQueue* Releases, const DeferredRelease::RetirePoint& Retire,
+                              SmallBuffer* Buffer);
+    UINT CollectReleases(Global* Dx, ReleaseQueue* Releases);
+    void FlushReleases(Global* Dx, ReleaseQueue* Releases);
     void Transition(ID3D12GraphicsCommandList* CmdList,
                     D3D12_RESOURCE_STATES Before, D3D12_RESOURCE_STATES After,
                     ID3D12Resource* Resource, UINT Subresource = 0);
+
+    // Tracked state changes go through ResourceStates, FlushBarriers before any draw, dispatch or copy. The pending
+    // barriers are flushed with the rest when executing, resolved ones in the frame's barrier list first.
+    UINT FlushBarriers(ID3D12GraphicsCommandList* CmdList, ResourceStates::Tracker* Tracker);
+    QueueScheduler::SyncPoint ExecuteTracked(QueueTimelines* Timelines, Frame* CurrentFrame,
+                                             ResourceStates::GlobalStates* Global,
+                                             const QueueScheduler::SyncPoint* Dependencies = nullptr,
+                                             UINT NumDependencies = 0);
+
+    // Once a frame, ParallelRecording::BeginFrame on the pools after the frame's fence was waited for. Record is
+    // called for every pass, concurrently on NumThreads threads, each chunk of passes into a list of its own. The
+    // lists are queued on the frame and ExecuteTracked executes them in order, after the resolved barriers and before
+    // the frame's list. They start without any state, and leave barriers to the frame's list and its tracker.
+    void CreateCommandListPools(D3D12_COMMAND_LIST_TYPE Type, UINT NumFrames, UINT NumThreads,
+                                CommandListPools* Pools);
+    void RecordParallel(ID3D12Device10* Device, CommandListPools* Pools, Frame* CurrentFrame, const UINT* Costs,
+                        UINT NumPasses, UINT NumThreads, UINT MinChunkCost,
+                        const std::function<void(ID3D12GraphicsCommandList7* CmdList, UINT Pass)>& Record);
+
+    // Executes the lists on Queue once the other queues reached Dependencies, waiting on the GPU, and signals the
+    // queue's timeline. The lists in between only wait on a queue when nothing they follow did so already.
+    QueueScheduler::SyncPoint Submit(QueueTimelines* Timelines, QueueScheduler::QueueType Queue,
+                                     ID3D12CommandList* const* CmdLists, UINT NumCmdLists,
+                                     const QueueScheduler::SyncPoint* Dependencies = nullptr,
+                                     UINT NumDependencies = 0);
+
+    // Every frame: begin, import and create the resources, add the passes to Graph->Graph, then execute. The
+    // barriers go through Tracker, imported resources are resolved like any other tracked resource. Transients a new
+    // compile replaces are released once the frames that may use them completed.
+    void BeginRenderGraph(RenderGraphResources* Graph);
+    RenderGraph::ResourceId ImportResource(RenderGraphResources* Graph, ID3D12Resource* Resource,
+                                           D3D12_RESOURCE_STATES InitialState, D3D12_RESOURCE_STATES FinalState);
+    RenderGraph::ResourceId CreateTransientResource(ID3D12Device10* Device, RenderGraphResources* Graph,
+                                                    const D3D12_RESOURCE_DESC& Desc);
+    ID3D12Resource* GetResource(const RenderGraphResources& Graph, RenderGraph::ResourceId Resource);
+    void ExecuteRenderGraph(ID3D12Device10* Device, ID3D12GraphicsCommandList7* CmdList,
+                            ResourceStates::Tracker* Tracker, RenderGraphResources* Graph,
+                            ReleaseQueue* Releases, const DeferredRelease::RetirePoint& Retire);
     void CreateCommittedBuffer(ID3D12Device10* Device, D3D12_HEAP_TYPE HeapType,
                                UINT64 Size,
                                ID3D12Resource** Buffer,
@@ -228,21 +568,110 @@ namespace D3D
                                   DXGI_FORMAT Format = GlobalResources::BackBufferFormat,
                                   UINT16 MipLevels = 1,
                                   D3D12_CLEAR_VALUE* ClearValue = nullptr);
+
+    // Placed resources are suballocated from Memory's heaps. Pass an allocation to get the range back with
+    // ReleasePlaced once the GPU is done with the resource, resources without one live as long as Memory.
+    void CreateGpuMemory(GpuMemory* Memory);
+    void CreatePlacedBuffer(ID3D12Device10* Device, GpuMemory* Memory, D3D12_HEAP_TYPE HeapType,
+                            UINT64 Size,
+                            ID3D12Resource** Buffer,
+                            D3D12_RESOURCE_STATES InitialState = D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_FLAGS Flags = D3D12_RESOURCE_FLAG_NONE,
+                            PlacedAllocation* Allocation = nullptr);
+    void CreatePlaced2DTexture(ID3D12Device10* Device, GpuMemory* Memory, UINT64 Width, UINT Height,
+                               D3D12_RESOURCE_FLAGS Flags,
+                               ID3D12Resource** Texture,
+                               D3D12_RESOURCE_STATES InitialState = D3D12_RESOURCE_STATE_COPY_SOURCE,
+                               DXGI_FORMAT Format = GlobalResources::BackBufferFormat,
+                               UINT16 MipLevels = 1,
+                               PlacedAllocation* Allocation = nullptr);
+    void ReleasePlaced(const PlacedAllocation& Allocation);
+    void AllocateSmallBuffer(ID3D12Device10* Device, GpuMemory* Memory, UINT64 Size, SmallBuffer* Buffer);
+    void FreeSmallBuffer(GpuMemory* Memory, SmallBuffer* Buffer);
+    void CreateUploadRing(ID3D12Device10* Device, UINT64 Capacity, UploadRingBuffer* Ring);
+    bool AllocateUpload(UploadRingBuffer* Ring, UINT64 Size, UINT64 Alignment, UploadAllocation* OutAllocation);
+
+    // Data is copied when queued. Texture data is the subresource's rows RowPitch apart, its depth slices after
+    // each other. SubmitStreamingUploads once per frame, then poll the tickets or have the GPU wait on their sync
+    // points, which are only known once submitted.
+    void CreateStreamingUploads(ID3D12Device10* Device, UINT64 Capacity, UINT64 BudgetPerFrame,
+                                StreamingUploadBuffer* Streaming);
+    StreamingUploads::Ticket StreamBuffer(StreamingUploadBuffer* Streaming, ID3D12Resource* Destination,
+                                          UINT64 Offset, const void* Data, UINT64 Size);
+    StreamingUploads::Ticket StreamTexture(ID3D12Device10* Device, StreamingUploadBuffer* Streaming,
+                                           ID3D12Resource* Destination, UINT Subresource, const void* Data,
+                                           UINT64 RowPitch);
+    void SubmitStreamingUploads(QueueTimelines* Timelines, StreamingUploadBuffer* Streaming);
+    bool GetStreamingSyncPoint(const StreamingUploadBuffer& Streaming, StreamingUploads::Ticket Ticket,
+                               QueueScheduler::SyncPoint* OutPoint);
+    void CreateBindlessHeap(ID3D12Device10* Device, UINT NumPersistent, UINT NumTransientPerFrame, UINT NumFrames,
+                            BindlessHeap* Descriptors);
+    D3D12_CPU_DESCRIPTOR_HANDLE GetCpuHandle(const BindlessHeap& Descriptors, UINT Index);
+    D3D12_GPU_DESCRIPTOR_HANDLE GetGpuHandle(const BindlessHeap& Descriptors, UINT Index);
     void CreateShaderCompiler(ShaderCompiler* Compiler);
-    void CompileShader(ShaderCompiler* Compiler, Shader* Program);
+    void OpenShaderCache(const std::wstring& Path, ShaderCacheFile* CacheFile);
+    void CloseShaderCache(ShaderCacheFile* CacheFile); // Saves what was compiled, blobs from the cache are gone.
+    void CompileShader(ShaderCompiler* Compiler, Shader* Program, ShaderCacheFile* Cache = nullptr);
+    ShaderCompilation::Future CompileShaderAsync(ShaderCompilation::Service* Service, Shader* Program,
+                                                 ShaderCacheFile* Cache = nullptr);
+    ShaderCompilation::Future CreatePipelineAsync(ShaderCompilation::Service* Service,
+                                                  const std::vector<ShaderCompilation::Future>& Shaders,
+                                                  const std::function<bool()>& Create); // False fails the future.
+    void CreateShaderWatcher(const std::wstring& Directory, ShaderWatcher* Watcher);
+    void DestroyShaderWatcher(ShaderWatcher* Watcher);
+    void WatchShader(ShaderWatcher* Watcher, const Shader& Program, UINT Owner);
+
+    // The owners of the shaders that changed, once the files are quiet. Time is in seconds, from any start.
+    bool PollShaderWatcher(ShaderWatcher* Watcher, double Time, std::vector<UINT>* Owners);
     void CreateRootSignature(ID3D12Device10* Device, D3D12_ROOT_SIGNATURE_DESC1* Desc, ID3D12RootSignature** RootSignature);
-    void CreateMeshShaderPSO(ID3D12Device10* Device,
+    bool CreateMeshShaderPSO(ID3D12Device10* Device,
                              Shader* MS,
                              Shader* PS,
                              ID3D12RootSignature* RootSig,
                              ID3D12PipelineState** OutPSO,
                              DXGI_FORMAT BackBufferFormat = GlobalResources::BackBufferFormat,
                              DXGI_FORMAT DepthBufferFormat = GlobalResources::DepthBufferFormat);
+    // The BLASes and the scratch are placed in Memory, ReleasePlaced the scratch's range with the scratch.
+    void BuildBottomLevels(ID3D12Device10* Device, ID3D12GraphicsCommandList7* CmdList,
+                           ResourceStates::Tracker* Tracker, GpuMemory* Memory,
+                           const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS* Inputs, UINT NumBuilds,
+                           UINT64 ScratchBudget,
+                           ComPtr<ID3D12Resource>* BottomLevels, PlacedAllocation* BottomLevelRanges,
+                           ID3D12Resource** Scratch, PlacedAllocation* ScratchRange,
+                           D3D12_GPU_VIRTUAL_ADDRESS CompactedSizes = 0);
+    void CreateBottomLevelCompaction(ID3D12Device10* Device, GpuMemory* Memory, UINT NumBottomLevels,
+                                     BottomLevelCompactionData* Compaction);
+    // Compaction returns BottomLevelRanges, from BuildBottomLevels, once the originals are released.
+    void QueueBottomLevelCompaction(ID3D12GraphicsCommandList7* CmdList, ResourceStates::Tracker* Tracker,
+                                    BottomLevelCompactionData* Compaction,
+                                    BottomLevelASInfo* BottomLevelInfos, const PlacedAllocation* BottomLevelRanges,
+                                    UINT NumBottomLevels, UINT64 BuildFenceValue);
+    bool UpdateBottomLevelCompaction(ID3D12Device10* Device, ID3D12GraphicsCommandList7* CmdList,
+                                     ResourceStates::Tracker* Tracker,
+                                     BottomLevelCompactionData* Compaction,
+                                     UINT64 CompletedFenceValue, UINT64 SubmitFenceValue);
+    void CreateInstanceDescRing(ID3D12Device10* Device, GpuMemory* Memory, UINT Capacity, InstanceDescRing* Ring);
+    void DestroyInstanceDescRing(InstanceDescRing* Ring); // Once the GPU is done with every buffer.
+    // Waits on Fence if the buffer's last frame isn't done yet.
+    D3D12_RAYTRACING_INSTANCE_DESC* BeginInstanceDescs(InstanceDescRing* Ring, UINT64 FenceValue,
+                                                       ID3D12Fence* Fence, HANDLE FenceEvent);
+    ID3D12Resource* EndInstanceDescs(InstanceDescRing* Ring);
     void CreateTopLevel(ID3D12Device10* Device, ID3D12GraphicsCommandList7* CmdList,
-                        UINT NumInstances, ID3D12Resource* InstanceDescs,
+                        ResourceStates::Tracker* Tracker,
+                        GpuMemory* Memory, UINT NumInstances, ID3D12Resource* InstanceDescs,
                         ID3D12Resource** TopLevelASScratch, ID3D12Resource** TopLevelAS);
-    void UpdateTopLevel(ID3D12GraphicsCommandList7* CmdList,
-                        BottomLevelASInfo* BottomLevelInfos, INT NumBottomLevelInfos,
-                        ID3D12Resource* TopLevelASScratch, ID3D12Resource* TopLevelAS, ID3D12Resource* InstanceDescs);
+    void UpdateTopLevel(ID3D12GraphicsCommandList7* CmdList, ResourceStates::Tracker* Tracker, UINT NumInstances,
+                        ID3D12Resource* TopLevelASScratch, ID3D12Resource* TopLevelAS, ID3D12Resource* InstanceDescs,
+                        TopLevelPolicy::Action Action = TopLevelPolicy::Action::Update);
+
+    // These report what's wrong and return false rather than break, a reloaded shader may not match the pipeline.
+    bool CreateRtStateObject(ID3D12Device10* Device, const RtPipeline::Desc& PipelineDesc,
+                             ID3D12StateObject** RaytracingStateObject);
+    bool AddToRtStateObject(ID3D12Device10* Device, RtPipeline::Desc* PipelineDesc, const RtPipeline::Desc& Addition,
+                            ID3D12StateObject* RaytracingStateObject, ID3D12StateObject** NewRaytracingStateObject);
+    bool CreateShaderTable(ID3D12Device10* Device, ID3D12StateObject* RaytracingStateObject,
+                           const ShaderBindingTable::Builder& TableBuilder,
+                           ID3D12Resource** ShaderTable, ShaderBindingTable::Layout* OutLayout);
+    void GetDispatchRaysDesc(const ShaderBindingTable::Layout& TableLayout, D3D12_GPU_VIRTUAL_ADDRESS ShaderTableAddress,
+                             UINT Width, UINT Height, D3D12_DISPATCH_RAYS_DESC* OutDesc, UINT RayGenIndex = 0);
     void LoadModel(const char* FileName, Scene* InScene);
 }
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+#include "Types.h"
+#include <vector>
+
+// Two-level segregated fit (TLSF) over an abstract address range: O(1) allocate and free with immediate
+// coalescing. Sizes and offsets are in bytes but handed out in multiples of the granularity, e.g. 64KB for
+// resources placed in an ID3D12Heap or 256 bytes for constants inside one buffer. Pure CPU, see
+// D3D::CreatePlacedBuffer and D3D::AllocateSmallBuffer for the GPU side.
+namespace HeapAllocator
+{
+    static const UINT SecondLevelBits = 4;
+    static const UINT NumSecondLevels = 1 << SecondLevelBits; // Linear subdivisions of every power of two.
+    static const UINT NumFirstLevels = 48;                    // Up to 2^51 granules.
+    static const UINT InvalidBlock = 0xFFFFFFFF;
+
+    struct Block
+    {
+        UINT64 Offset = 0; // In granules.
+        UINT64 Size = 0;
+        UINT PreviousPhysical = InvalidBlock; // Neighbours in the address range, merged with when both are free.
+        UINT NextPhysical = InvalidBlock;
+        UINT PreviousFree = InvalidBlock;     // Neighbours in the free list of the block's size class.
+        UINT NextFree = InvalidBlock;
+        bool IsFree = false;
+    };
+
+    struct Allocator
+    {
+        UINT64 Granularity = 0;
+        UINT64 Capacity = 0; // In granules.
+        UINT64 UsedSize = 0;
+        UINT NumAllocations = 0;
+
+        std::vector<Block> Blocks;
+        std::vector<UINT> UnusedBlocks; // Records left behind by merges, reused by splits.
+
+        // A set bit in the first level means a non empty second level bitmap, a set bit there a non empty list.
+        UINT64 FirstLevelBitmap = 0;
+        UINT SecondLevelBitmaps[NumFirstLevels] = {};
+        UINT FreeLists[NumFirstLevels][NumSecondLevels];
+    };
+
+    struct Allocation
+    {
+        UINT64 Offset = 0; // In bytes.
+        UINT64 Size = 0;   // Rounded up to the granularity.
+        UINT Block = InvalidBlock;
+    };
+
+    struct Stats
+    {
+        UINT64 UsedSize = 0; // In bytes.
+        UINT64 FreeSize = 0;
+        UINT64 LargestFreeBlock = 0;
+        UINT NumAllocations = 0;
+        UINT NumFreeBlocks = 0;
+        double Fragmentation = 0; // 1 - LargestFreeBlock / FreeSize, 0 when all free space is one block.
+    };
+
+    // Granularity must be a power of two, Size a multiple of it.
+    void Initialize(Allocator* InAllocator, UINT64 Size, UINT64 Granularity);
+
+    // Good fit: the smallest size class that is guaranteed to fit, so the search never walks a list.
+    // Returns false when no free block is large enough.
+    bool Allocate(Allocator* InAllocator, UINT64 Size, Allocation* OutAllocation);
+    void Free(Allocator* InAllocator, const Allocation& InAllocation);
+
+    bool IsEmpty(const Allocator& InAllocator);
+    void GetStats(const Allocator& InAllocator, Stats* OutStats);
+
+    // Walks every block and free list, returns false when an invariant is broken. Linear, for tests.
+    bool Validate(const Allocator& InAllocator);
+
+    // Random allocations and frees checked against a shadow copy of the live ranges. Returns false on the first
+    // overlap, leak or broken invariant.
+    bool RunFuzzTest(UINT NumOperations, UINT32 Seed);
+
+    // Placed-resource and small-buffer churn, printing allocations and frees per second and the fragmentation.
+    void RunBenchmark(UINT NumOperations);
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "Types.h"
+#include <vector>
+
+namespace ImageCompare
+{
+    // 8-bit RGBA, sRGB encoded, tightly packed rows.
+    struct Image
+    {
+        UINT Width = 0;
+        UINT Height = 0;
+        std::vector<UINT32> Pixels;
+    };
+
+    // Per-pixel error in [0, 1], used to write heatmaps.
+    struct ErrorMap
+    {
+        UINT Width = 0;
+        UINT Height = 0;
+        std::vector<float> Values;
+    };
+
+    struct Settings
+    {
+        UINT NumThreads = 1;
+        float PixelsPerDegree = 67.f; // 0.7m from a 24" 4K monitor, the FLIP default.
+    };
+
+    bool ReadImage(const char* FileName, Image* OutImage);
+    bool WriteTga(const char* FileName, UINT Width, UINT Height, const UINT32* Pixels, UINT RowPitchInPixels);
+    bool WriteHeatmap(const char* FileName, const ErrorMap& Map);
+
+    // Peak signal-to-noise ratio over RGB in dB. Returns INFINITY for identical images.
+    double ComputePSNR(const Image& Reference, const Image& Test, const Settings& InSettings);
+
+    // Mean structural similarity of the luma channels over 7x7 windows, in [-1, 1].
+    // The optional map holds 1 - SSIM clamped to [0, 1].
+    double ComputeSSIM(const Image& Reference, const Image& Test, const Settings& InSettings,
+                       ErrorMap* OutMap = nullptr);
+
+    // FLIP-style perceptual error, in [0, 1]: a CSF-prefiltered Hunt-adjusted color difference
+    // weighted by the difference in edge and point features.
+    double ComputeFLIP(const Image& Reference, const Image& Test, const Settings& InSettings,
+                       ErrorMap* OutMap = nullptr);
+
+    // Identical random images score infinite PSNR, SSIM 1 and FLIP 0, with error maps of zero up to SSIM's rounding.
+    // A known offset gives its PSNR exactly, lowers SSIM and raises FLIP. Every metric is the same at 1 and 8 threads.
+    bool RunTest(UINT Width, UINT Height);
+}
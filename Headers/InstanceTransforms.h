@@ -0,0 +1,65 @@
+#pragma once
+#include "Types.h"
+#include <vector>
+
+// Batched generation of TLAS instance descriptions from translation, rotation and scale stored as structure of
+// arrays. Eight instances at a time with AVX2, written straight into the 64-byte D3D12_RAYTRACING_INSTANCE_DESC
+// layout with streaming stores, and spread over threads for large batches. Pure CPU.
+namespace InstanceTransforms
+{
+    static const UINT BatchSize = 8;                 // Instances per AVX2 iteration.
+    static const UINT ParallelThreshold = 16 * 1024; // Fewer instances are written on the calling thread.
+    static const UINT GrainSize = 4 * 1024;
+
+    // Same layout as D3D12_RAYTRACING_INSTANCE_DESC, so this builds without D3D12.
+    struct InstanceDesc
+    {
+        float Transform[3][4];
+        UINT32 InstanceIdAndMask;          // InstanceID : 24, InstanceMask : 8.
+        UINT32 ContributionAndFlags;       // InstanceContributionToHitGroupIndex : 24, Flags : 8.
+        UINT64 AccelerationStructure;
+    };
+
+    // Everything in an instance description but the transform, copied as is.
+    struct InstanceTail
+    {
+        UINT32 InstanceIdAndMask;
+        UINT32 ContributionAndFlags;
+        UINT64 AccelerationStructure;
+    };
+
+    struct Instances
+    {
+        std::vector<float> PositionX, PositionY, PositionZ;
+        std::vector<float> RotationX, RotationY, RotationZ, RotationW; // Unit quaternions.
+        std::vector<float> ScaleX, ScaleY, ScaleZ;
+        std::vector<InstanceTail> Tails;
+    };
+
+    void Resize(Instances* InInstances, UINT NumInstances);
+    InstanceTail MakeTail(UINT InstanceId, UINT InstanceMask, UINT HitGroupContribution, UINT Flags,
+                          UINT64 AccelerationStructure);
+
+    void SetInstanceMask(InstanceTail* Tail, UINT InstanceMask);
+
+    // Row-major 3x4 of translate * rotate * scale, as D3D12 instance descriptions expect.
+    void GetTransform(const Instances& InInstances, UINT Index, float OutTransform[3][4]);
+
+    // Writes instance descriptions [First, First + Count) to Dest[0, Count). Dest must be 32-byte aligned and is
+    // written with streaming stores, so it can be mapped upload memory. Parallel above ParallelThreshold.
+    void Write(const Instances& InInstances, UINT First, UINT Count, InstanceDesc* Dest,
+               UINT NumThreads = 1);
+
+    // Same for the instances Indices[0, Count) lists, packed into Dest[0, Count). Compacts culling results.
+    void WriteIndexed(const Instances& InInstances, const UINT* Indices, UINT Count, InstanceDesc* Dest,
+                      UINT NumThreads = 1);
+
+    // Write and WriteIndexed of NumInstances random instances against GetTransform, within MaxUlps of each column's
+    // scale. Counts with and without a partial batch, from offsets into a batch, serial and parallel, and nothing
+    // written past Count.
+    static const UINT MaxUlps = 4;
+    bool RunTest(UINT NumInstances);
+
+    // Times Write for NumInstances instances against the scalar path at several thread counts.
+    void RunBenchmark(UINT NumInstances, UINT NumFrames);
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "Types.h"
+#include <atomic>
+#include <functional>
+
+// One pool of worker threads for everything that runs in parallel: loading, BVH builds, instance updates, culling and
+// command recording. Each worker, and the thread that started the pool, owns a Chase-Lev deque of jobs. The owner
+// pushes and pops at the bottom without locking, and idle workers steal from the top of other deques. Threads that
+// aren't workers spawn into a shared queue. A job counts down its Counter when it finishes. A job spawned after a
+// counter starts once that counter reaches zero. Waiting on a counter runs other jobs meanwhile, so the waiting
+// thread helps and nested waits can't deadlock. Threading::ParallelFor runs on it.
+namespace JobSystem
+{
+    static const UINT DequeCapacity = 4096; // Per worker, a job spawned onto a full deque runs right away.
+    static const UINT MaxWorkers = 64;
+    static const UINT InvalidWorker = 0xFFFFFFFF;
+
+    struct Job;
+
+    // How many jobs spawned with it didn't finish yet, and the jobs waiting for that to reach zero.
+    struct Counter
+    {
+        std::atomic<UINT> Value{0};
+        std::atomic<Job*> Waiting{nullptr};
+        std::atomic<UINT> NumFinishing{0}; // Jobs still releasing the waiting ones after counting it down.
+    };
+
+    // Push and Pop from the owner only, Steal from any thread.
+    struct Deque
+    {
+        std::atomic<INT64> Top{0};
+        std::atomic<INT64> Bottom{0};
+        std::atomic<Job*> Jobs[DequeCapacity];
+    };
+
+    bool Push(Deque* InDeque, Job* Pushed); // False when full.
+    Job* Pop(Deque* InDeque);
+    Job* Steal(Deque* InDeque);             // nullptr when empty, or when another thread took it first.
+
+    // Starts NumWorkers - 1 threads, the calling thread is worker 0. Optional, the first use starts one per
+    // hardware thread.
+    void Initialize(UINT NumWorkers);
+    UINT GetNumWorkers();
+    UINT GetWorkerIndex(); // InvalidWorker for threads that aren't workers.
+
+    // Done, when given, is counted up now and down once the job finished.
+    void Spawn(const std::function<void()>& Function, Counter* Done = nullptr);
+
+    // Runs once Dependency reaches zero, i.e. after every job spawned with it so far.
+    void SpawnAfter(Counter* Dependency, const std::function<void()>& Function, Counter* Done = nullptr);
+
+    // Runs jobs until Done reaches zero.
+    void Wait(Counter* Done);
+
+    // Body(Begin, End) over [0, Count). A range is split in half whenever the worker running it has nothing queued
+    // for the others to steal. Pieces are never smaller than MinGrainSize, and there are never more than 32 per
+    // worker.
+    void ParallelFor(UINT Count, UINT MinGrainSize, const std::function<void(UINT Begin, UINT End)>& Body);
+
+    // The deques under an owner and thieves, dependency chains and fan-outs, nested parallel-fors and spawns from
+    // threads that aren't workers. Checks that every job runs once, and only after what it depends on.
+    bool RunTest(UINT NumJobs);
+
+    // Spawn overhead, steal latency from an idle worker, and parallel-for scaling with the threads it runs on.
+    void RunBenchmark(UINT NumJobs);
+}
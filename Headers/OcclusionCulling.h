@@ -0,0 +1,75 @@
+#pragma once
+#include "Types.h"
+#include "FrustumCulling.h"
+#include <DirectXMath.h>
+#include <vector>
+
+// Software occlusion culling: a few large occluders are rasterized into a small depth buffer with AVX2, reduced
+// into a hierarchical-Z pyramid, and instance or meshlet bounds are tested against it before they reach the GPU.
+// Rasterization is inner-conservative (only fully covered pixels, at their furthest depth), so nothing visible is
+// ever culled. Results don't depend on the thread count. Pure CPU.
+namespace OcclusionCulling
+{
+    static const UINT BatchSize = 8;    // Pixels or boxes per AVX2 iteration.
+    static const UINT BandHeight = 8;   // Rows rasterized per task, every task walks all occluder triangles.
+    static const UINT GrainSize = 4096; // Boxes tested per task.
+    static const float GuardBand = 2.f; // Occluders are clipped to twice the screen to keep float rasterization exact.
+    static const UINT MaxClippedVertices = 12;
+
+    // World-space convex, planar quads, four vertices each. Triangles repeat their last vertex.
+    struct Occluders
+    {
+        std::vector<DirectX::XMFLOAT3> Vertices;
+    };
+
+    struct DepthPyramid
+    {
+        UINT Width = 0;
+        UINT Height = 0;
+        DirectX::XMFLOAT4X4 ViewProjection; // Of the last Render, the boxes are tested with it.
+        std::vector<float> Depths;       // All levels back to back. Level 0 is the depth buffer, the next ones keep 2x2 maxima.
+        std::vector<UINT> LevelOffsets; // Into Depths, level L is max(Width >> L, 1) wide.
+
+        // Temp.
+        struct Triangle
+        {
+            float EdgeA[3], EdgeB[3], EdgeC[3]; // Inside when A * X + B * Y + C >= 0 at the pixel center.
+            float DepthX, DepthY, DepthC;       // Furthest depth over the pixel.
+            INT MinX, MinY, MaxX, MaxY;
+        };
+        std::vector<Triangle> Triangles;
+    };
+
+    void AddQuad(Occluders* InOccluders, const DirectX::XMFLOAT3& A, const DirectX::XMFLOAT3& B,
+                 const DirectX::XMFLOAT3& C, const DirectX::XMFLOAT3& D);
+    void AddTriangles(Occluders* InOccluders, const DirectX::XMFLOAT3* Vertices, UINT NumVertices);
+    void AddBox(Occluders* InOccluders, const DirectX::XMFLOAT3& Min, const DirectX::XMFLOAT3& Max);
+
+    // Width must be a multiple of BatchSize, both powers of two.
+    void Initialize(DepthPyramid* Pyramid, UINT Width, UINT Height);
+
+    // Rasterizes the occluders seen through a row-vector view * projection matrix with D3D depth [0, 1], then builds
+    // the pyramid. Independent from everything but the camera, so it can run while the frame is being set up.
+    void Render(const Occluders& InOccluders, DirectX::FXMMATRIX ViewProjection, DepthPyramid* Pyramid,
+                UINT NumThreads = 1);
+
+    // Writes the candidates whose box isn't hidden behind the occluders to OutVisible, in order, and returns how many
+    // there are. OutVisible may be Candidates. Boxes crossing the near plane are always visible.
+    UINT Cull(const DepthPyramid& Pyramid, const FrustumCulling::Bounds& InBounds,
+              const UINT* Candidates, UINT NumCandidates, UINT* OutVisible, UINT NumThreads = 1);
+
+    // One box at a time, the reference for Cull.
+    bool IsVisible(const DepthPyramid& Pyramid, const DirectX::XMFLOAT3& Min, const DirectX::XMFLOAT3& Max);
+
+    // A city block grid: NumBuildings large boxes as occluders and NumInstances small boxes scattered between them.
+    void CreateCityScene(UINT NumBuildings, UINT NumInstances, UINT32 Seed,
+                         Occluders* OutOccluders, FrustumCulling::Bounds* OutBounds);
+
+    // Known occluders and boxes fully behind them, in front of them, beside them, straddling their edges or depth and
+    // crossing the near plane, through Cull and IsVisible. Then the city scene's pyramid and Cull output, which have
+    // to be bit-identical at 1, 4 and all hardware threads (at least 8).
+    bool RunTest(UINT NumInstances);
+
+    // Frustum then occlusion culls a street-level walk through the city, printing the culling rate and the timings.
+    void RunBenchmark(UINT NumInstances, UINT NumFrames);
+}
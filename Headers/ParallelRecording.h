@@ -0,0 +1,68 @@
+#pragma once
+#include "Types.h"
+#include <functional>
+#include <vector>
+
+// Recording a frame's passes on several threads. The passes, in the order they execute, are split into contiguous
+// chunks of about the same cost and each chunk is recorded into a command list of its own by whichever thread picks
+// it up; the lists executed in chunk order, in one call, keep the passes' order. Threads take their lists from pools
+// of their own, one per frame in flight, so recording shares nothing and a pool's allocators are reset once the frame
+// that last used it is done. Pure CPU, lists are indices in their pool; see D3D::RecordParallel for the GPU side.
+namespace ParallelRecording
+{
+    static const UINT MaxThreads = 64;
+    static const UINT MaxFrames = 8;
+    static const UINT ChunksPerThread = 2; // A little slack for threads that pick up a slow chunk.
+
+    struct Chunk
+    {
+        UINT FirstPass = 0;
+        UINT NumPasses = 0;
+        UINT Thread = 0; // Whose pool the list is from, once recorded.
+        UINT List = 0;   // In that pool.
+    };
+
+    // One thread's lists for one frame in flight, created when first needed and kept.
+    struct Pool
+    {
+        UINT NumCreated = 0;
+        UINT NumUsed = 0; // This frame.
+    };
+
+    struct Pools
+    {
+        UINT NumFrames = 0;
+        UINT NumThreads = 0;
+        UINT CurrentFrame = 0;
+        Pool Threads[MaxFrames][MaxThreads];
+    };
+
+    void Initialize(Pools* InPools, UINT NumFrames, UINT NumThreads);
+
+    // Once the frame that last recorded with FrameIndex's pools is done, all their lists can be used again.
+    void BeginFrame(Pools* InPools, UINT FrameIndex);
+
+    // The thread's next list this frame, IsNew when it has to be created. Only the thread itself calls it.
+    UINT Acquire(Pools* InPools, UINT Thread, bool* IsNew);
+
+    // Chunks of consecutive passes of about TotalCost / NumChunks each, no more than there are passes.
+    void Split(const UINT* Costs, UINT NumPasses, UINT NumChunks, std::vector<Chunk>* OutChunks);
+
+    // Enough chunks to keep NumThreads busy, none cheaper than MinChunkCost, where recording a list of its own
+    // stops paying off.
+    UINT GetNumChunks(UINT64 TotalCost, UINT NumThreads, UINT MinChunkCost);
+
+    // Splits the passes and records the chunks on NumThreads threads, the calling thread one of them. Record gets
+    // each chunk once its list was acquired, in any order and concurrently; Chunks are in execution order.
+    void Record(Pools* InPools, const UINT* Costs, UINT NumPasses, UINT NumThreads, UINT MinChunkCost,
+                std::vector<Chunk>* Chunks, const std::function<void(const Chunk& InChunk, bool IsNew)>& Record);
+
+    // The null backend: lists that store what's recorded into them at a driver-like cost per command. Records
+    // frames of passes with random numbers of draws on 1 to NumThreads threads, with a GPU a few frames behind,
+    // and checks that the lists executed in order hold the passes' commands in order, and that no list is reused
+    // while the GPU may still read it or taken by two threads.
+    bool RunTest(UINT NumFrames, UINT NumThreads);
+
+    // CPU time recording a frame of NumPasses passes of NumDraws draws in all, per thread count.
+    void RunBenchmark(UINT NumFrames, UINT NumPasses, UINT NumDraws);
+}
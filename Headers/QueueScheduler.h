@@ -0,0 +1,65 @@
+#pragma once
+#include "Types.h"
+#include <deque>
+
+// Cross-queue dependencies between submissions, waited on by the GPU instead of the CPU. Every queue signals its own
+// timeline fence once per submission, and a submission names the points on other queues' timelines it depends on.
+// Only the waits the queue doesn't already follow are planned: points the CPU saw complete, points the queue waited
+// on before and everything those points themselves waited on. Pure CPU, see D3D::Submit for the GPU side.
+namespace QueueScheduler
+{
+    enum class QueueType : UINT8
+    {
+        Graphics,
+        Compute,
+        Copy,
+        Count,
+    };
+    static const UINT NumQueues = (UINT)QueueType::Count;
+
+    // A submission's point on its queue's timeline, done once the queue's fence reached Value. 0 is always done.
+    struct SyncPoint
+    {
+        QueueType Queue = QueueType::Graphics;
+        UINT64 Value = 0;
+    };
+
+    // For each queue, the highest value known to be done before a submission starts.
+    struct Clock
+    {
+        UINT64 Values[NumQueues] = {};
+    };
+
+    struct Submission
+    {
+        SyncPoint Signal;
+        SyncPoint Waits[NumQueues]; // Before executing, on other queues' fences.
+        UINT NumWaits = 0;
+    };
+
+    struct Scheduler
+    {
+        UINT64 Signaled[NumQueues] = {};   // Per queue, the last value handed out.
+        UINT64 Completed[NumQueues] = {};  // Per queue, as last seen by the CPU.
+        Clock Known[NumQueues];            // Per queue, what its next submission follows already.
+        std::deque<Clock> History[NumQueues]; // Per queue, the clocks of its submissions after Completed.
+
+        // Since the last Reset.
+        UINT NumSubmissions = 0;
+        UINT NumDependencies = 0; // On other queues, as asked for.
+        UINT NumWaits = 0;        // Planned.
+    };
+
+    void Reset(Scheduler* InScheduler);
+
+    // What the CPU read from a queue's fence, which only moves forward.
+    void SetCompleted(Scheduler* InScheduler, QueueType Queue, UINT64 CompletedValue);
+
+    // The next submission on Queue, after Dependencies. Points on Queue itself are followed in order anyway.
+    Submission Submit(Scheduler* InScheduler, QueueType Queue, const SyncPoint* Dependencies, UINT NumDependencies);
+
+    // Random submissions with random dependencies against a null backend whose simulated queues run them interleaved
+    // at random, checking that every submission only runs once its dependencies are done and that the queues never
+    // deadlock. Prints the waits planned against one per dependency.
+    bool RunTest(UINT NumSubmissions);
+}
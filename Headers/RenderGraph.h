@@ -0,0 +1,112 @@
+#pragma once
+#include "Types.h"
+#include "ResourceStates.h"
+#include <functional>
+#include <vector>
+
+// A frame's passes declared with the resources they read and write, then compiled into what to run and the barriers
+// in between. Compiling culls the passes nothing needs, orders the rest by their dependencies, longest chains first
+// so dependent passes end up further apart, computes the barriers each pass needs (reads in a row share one
+// transition) and places transient resources whose lifetimes don't overlap in the same memory. The graph is rebuilt
+// every frame but only compiled again when its topology changed. Pure CPU, resources are ids; see
+// D3D::ExecuteRenderGraph for the GPU side.
+namespace RenderGraph
+{
+    typedef UINT ResourceId;
+    static const UINT InvalidId = 0xFFFFFFFF;
+
+    // Resources that can share memory, resource heap tier 1 doesn't mix these.
+    enum class HeapGroup : UINT8
+    {
+        Buffers,
+        Textures,
+        RenderTargets, // And depth buffers. Contents are undefined after aliasing, the first writer clears them.
+        Count,
+    };
+
+    struct ResourceDesc
+    {
+        UINT64 Size = 0;      // In the heap, see GetResourceAllocationInfo. Transient only.
+        UINT64 Alignment = 0;
+        HeapGroup Group = HeapGroup::Buffers;
+        bool IsImported = false; // Lives outside the graph, never culled or aliased.
+        ResourceStates::States InitialState = ResourceStates::Common; // Imported only: when the graph starts.
+        ResourceStates::States FinalState = ResourceStates::Common;   // Imported only: where the graph leaves it.
+        UINT64 Key = 0; // The caller's, e.g. a hash of the D3D description. Part of the topology.
+    };
+
+    struct Access
+    {
+        ResourceId Resource = InvalidId;
+        ResourceStates::States State = ResourceStates::Common;
+        bool IsWrite = false;
+    };
+
+    struct Pass
+    {
+        const char* Name = nullptr;
+        UINT FirstAccess = 0;
+        UINT NumAccesses = 0;
+        bool HasSideEffects = false; // Never culled, e.g. readbacks.
+    };
+
+    struct Graph
+    {
+        std::vector<ResourceDesc> Resources;
+        std::vector<Pass> Passes;
+        std::vector<Access> Accesses;                // Grouped by pass.
+        std::vector<std::function<void()>> Executes; // Per pass, records its work.
+    };
+
+    struct Barrier
+    {
+        ResourceStates::BarrierType Type = ResourceStates::BarrierType::Transition;
+        ResourceId Resource = InvalidId;
+        ResourceStates::States Before = ResourceStates::Common;
+        ResourceStates::States After = ResourceStates::Common;
+    };
+
+    struct CompiledGraph
+    {
+        // The topology it was compiled from.
+        std::vector<ResourceDesc> Resources;
+        std::vector<Pass> Passes;
+        std::vector<Access> Accesses;
+
+        std::vector<UINT> Order;          // Live passes, in execution order.
+        std::vector<UINT> FirstBarriers;  // Per entry of Order, then the final barriers, then the end of Barriers.
+        std::vector<Barrier> Barriers;
+
+        // Per resource.
+        std::vector<UINT8> IsUsed;                         // By a live pass.
+        std::vector<ResourceStates::States> StartStates;   // Transients start where they ended last time.
+        std::vector<UINT64> Offsets;                       // Transient ones, in their group's heap.
+        std::vector<UINT8> IsAliased;                      // Transient ones sharing memory with another.
+
+        UINT64 HeapSizes[(UINT)HeapGroup::Count] = {};
+        UINT64 UnaliasedSize = 0; // What the transients would take without aliasing.
+        UINT NumCulled = 0;
+    };
+
+    void Reset(Graph* InGraph);
+
+    ResourceId Import(Graph* InGraph, ResourceStates::States InitialState, ResourceStates::States FinalState,
+                      UINT64 Key = 0);
+    ResourceId CreateTransient(Graph* InGraph, UINT64 Size, UINT64 Alignment, HeapGroup Group, UINT64 Key = 0);
+
+    // Reads and writes belong to the last pass added. A write keeps earlier writers of the resource alive, it may
+    // only be partial.
+    UINT AddPass(Graph* InGraph, const char* Name, const std::function<void()>& Execute, bool HasSideEffects = false);
+    void Read(Graph* InGraph, ResourceId Resource, ResourceStates::States State);
+    void Write(Graph* InGraph, ResourceId Resource, ResourceStates::States State);
+
+    // Returns false without touching Compiled when it was compiled from the same topology.
+    bool Compile(const Graph& InGraph, CompiledGraph* Compiled);
+
+    // Random graphs, checking the culling, the order against the dependencies, every barrier's before-state, the
+    // states each pass finds its resources in and that resources sharing memory are never alive at the same time.
+    bool RunTest(UINT NumGraphs, UINT NumPasses);
+
+    // Compile times of NumPasses pass graphs, from scratch and when the topology is unchanged.
+    void RunBenchmark(UINT NumGraphs, UINT NumPasses);
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include "Types.h"
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+// Resource state tracking for one command list at a time. Callers only say which state a resource is needed in;
+// the before-states are inferred from earlier uses in the same list, back-to-back transitions of a resource are
+// merged and the pending barriers go out together right before the next draw, dispatch or copy. What a list's
+// first use of a resource needs is only known at submission, when it's resolved against the states the previously
+// submitted lists left the resources in. Whole resources only, no per-subresource states. Pure CPU, resources are
+// opaque keys and barriers are handed to a callback, see D3D::FlushBarriers and D3D::ExecuteTracked.
+namespace ResourceStates
+{
+    // D3D12_RESOURCE_STATES bits, which convert implicitly.
+    typedef UINT States;
+    static const States Common = 0; // Also PRESENT.
+    static const States UnorderedAccess = 0x8;
+    static const States ReadOnly = 0x1 | 0x2 | 0x20 | 0x40 | 0x80 | 0x200 | 0x800 | 0x2000 | 0x1000000; // Combinable.
+    static const UINT InvalidIndex = 0xFFFFFFFF;
+
+    enum class BarrierType : UINT8
+    {
+        Transition,
+        UAV,      // Resource nullptr for all UAV accesses.
+        Aliasing, // Resource becomes the one using its memory.
+    };
+
+    struct Barrier
+    {
+        BarrierType Type = BarrierType::Transition;
+        const void* Resource = nullptr;
+        States Before = Common;
+        States After = Common;
+    };
+
+    typedef std::function<void(const Barrier* Barriers, UINT Count)> EmitFunction;
+
+    inline bool IsReadOnly(States State)
+    {
+        return State != Common && (State & ~ReadOnly) == 0;
+    }
+
+    // Whether a resource in Current can be used as After without a barrier.
+    inline bool Satisfies(States Current, States After)
+    {
+        return Current == After || (IsReadOnly(Current) && IsReadOnly(After) && (Current & After) == After);
+    }
+
+    struct Tracker
+    {
+        std::unordered_map<const void*, UINT> Slots;
+        std::vector<const void*> Resources;  // Per slot.
+        std::vector<States> FirstStates;     // Per slot, what the list needs the resource in when it starts.
+        std::vector<States> CurrentStates;   // Per slot.
+        std::vector<UINT8> IsKnown;          // Per slot, whether the list started with it in FirstStates anyway.
+        std::vector<UINT> PendingIndices;    // Per slot, its transition in Pending, InvalidIndex without one.
+        std::vector<Barrier> Pending;        // Since the last flush.
+        bool HasPendingGlobalUAV = false;
+
+        // Since the last Reset.
+        UINT NumRequests = 0;  // Transitions and UAV barriers asked for.
+        UINT NumBarriers = 0;  // Barriers emitted.
+        UINT NumFlushes = 0;   // Emit calls, one ResourceBarrier call each.
+    };
+
+    // The states registered resources were left in by the lists submitted so far. Belongs to the submitting thread.
+    struct GlobalStates
+    {
+        std::unordered_map<const void*, States> Current;
+    };
+
+    // For the next list recorded with Tracker.
+    void Reset(Tracker* InTracker);
+
+    // Nothing is emitted when the resource already is in After, or, for read states, in a superset of them.
+    void Transition(Tracker* InTracker, const void* Resource, States After);
+    void UAVBarrier(Tracker* InTracker, const void* Resource = nullptr);
+    void AliasingBarrier(Tracker* InTracker, const void* Resource);
+
+    // Before its first use in the list, e.g. right after creating it, no barrier is resolved for it at submission.
+    void SetKnownState(Tracker* InTracker, const void* Resource, States State);
+
+    // Pending barriers in a single Emit call, nothing when there are none. Returns how many were emitted.
+    UINT Flush(Tracker* InTracker, const EmitFunction& Emit);
+
+    // Only registered resources can be used without a known state and are followed from one list to the next.
+    // Unregister before releasing, the key may come back for another resource.
+    void Register(GlobalStates* Global, const void* Resource, States State);
+    void Unregister(GlobalStates* Global, const void* Resource);
+
+    // Once InTracker's list is recorded and flushed: the barriers that take its resources from their global states
+    // to the ones the list starts with, in a single Emit call and to be executed right before the list. The global
+    // states move on to where the list leaves the resources. Returns how many were emitted.
+    UINT Resolve(Tracker* InTracker, GlobalStates* Global, const EmitFunction& Emit);
+
+    // Random transitions against a null backend that counts the emitted barriers and calls and checks every
+    // barrier's before-state against the resource's actual state, and that a flush leaves each resource in the
+    // state last asked for. Prints the ResourceBarrier calls against one per transition.
+    bool RunTest(UINT NumCommandLists, UINT NumResources);
+}
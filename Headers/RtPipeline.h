@@ -0,0 +1,78 @@
+#pragma once
+#include "Types.h"
+#include <string>
+#include <vector>
+
+struct ID3D12RootSignature;
+
+// Declarative description of a ray tracing pipeline state object. Building and validating the
+// description is pure CPU; D3D::CreateRtStateObject and D3D::AddToRtStateObject turn it into subobjects.
+namespace RtPipeline
+{
+    // Mirrors of the D3D12 limits so validation doesn't depend on d3d12.h.
+    static const UINT MaxAttributeSize = 32;         // D3D12_RAYTRACING_MAX_ATTRIBUTE_SIZE_IN_BYTES
+    static const UINT MaxTraceRecursionDepth = 31;   // D3D12_RAYTRACING_MAX_DECLARABLE_TRACE_RECURSION_DEPTH
+
+    struct Library
+    {
+        const void* Bytecode = nullptr;
+        UINT64 BytecodeLength = 0;
+        std::vector<std::wstring> Exports;
+    };
+
+    enum class HitGroupType
+    {
+        Triangles,
+        ProceduralPrimitive
+    };
+
+    struct HitGroup
+    {
+        std::wstring Name;
+        HitGroupType Type = HitGroupType::Triangles;
+        std::wstring ClosestHit;
+        std::wstring AnyHit;
+        std::wstring Intersection;
+    };
+
+    struct LocalRootSignatureAssociation
+    {
+        ID3D12RootSignature* RootSignature = nullptr;
+        std::vector<std::wstring> Exports;
+    };
+
+    struct Desc
+    {
+        std::vector<Library> Libraries;
+        std::vector<HitGroup> HitGroups;
+        std::vector<LocalRootSignatureAssociation> LocalRootSignatures;
+
+        // Pipeline-wide state. Additions inherit it from the state object they extend.
+        ID3D12RootSignature* GlobalRootSignature = nullptr;
+        UINT MaxPayloadSize = 0;
+        UINT MaxAttributeSize = 8; // BuiltInTriangleIntersectionAttributes.
+        UINT MaxTraceRecursionDepth = 1;
+        bool AllowStateObjectAdditions = false;
+    };
+
+    void AddLibrary(Desc* InDesc, const void* Bytecode, UINT64 BytecodeLength,
+                    const std::vector<const wchar_t*>& Exports);
+    void AddHitGroup(Desc* InDesc, const wchar_t* Name, const wchar_t* ClosestHit,
+                     const wchar_t* AnyHit = nullptr, const wchar_t* Intersection = nullptr);
+    void AssociateLocalRootSignature(Desc* InDesc, ID3D12RootSignature* RootSignature,
+                                     const std::vector<const wchar_t*>& Exports);
+
+    // Checks limits, duplicate or dangling exports and conflicting root signature associations.
+    bool Validate(const Desc& InDesc, std::vector<std::string>* OutErrors);
+
+    // Same checks for an addition, which may reference the exports of the pipeline it extends.
+    bool ValidateAddition(const Desc& Existing, const Desc& Addition, std::vector<std::string>* OutErrors);
+
+    // Folds a successfully added description into the one describing the whole state object.
+    void Merge(Desc* Existing, const Desc& Addition);
+
+    // Headless, against placeholder bytecode and root signatures: duplicate exports, hit groups and associations
+    // naming exports that don't exist, exports with two local root signatures, the payload, attribute and recursion
+    // limits, and additions that redefine what the state object has.
+    bool RunTest();
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "Types.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Shader binding table layout and serialization. Pure CPU: the D3D12 side only supplies the
+// shader identifiers and the buffer, see D3D::CreateShaderTable and D3D::GetDispatchRaysDesc.
+namespace ShaderBindingTable
+{
+    // Mirrors of the D3D12 constants so the layout code doesn't depend on d3d12.h.
+    static const UINT ShaderIdentifierSize = 32;   // D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES
+    static const UINT RecordAlignment = 32;        // D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT
+    static const UINT TableAlignment = 64;         // D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT
+    static const UINT MaxRecordSize = 4096;        // D3D12_RAYTRACING_MAX_SHADER_RECORD_STRIDE
+
+    enum class Section
+    {
+        RayGen,
+        Miss,
+        HitGroup,
+        Callable,
+        Count
+    };
+    static const UINT NumSections = (UINT)Section::Count;
+
+    // Local root arguments as they appear in a shader record.
+    enum class ArgumentType
+    {
+        Constants,       // 4-byte values, 4-byte aligned.
+        GpuAddress,      // Root CBV/SRV/UAV, 8-byte aligned.
+        DescriptorTable  // GPU descriptor handle, 8-byte aligned.
+    };
+
+    struct RootArgument
+    {
+        ArgumentType Type = ArgumentType::GpuAddress;
+        UINT64 Value = 0;
+        std::vector<UINT32> Constants;
+    };
+
+    RootArgument GpuAddress(UINT64 Address);
+    RootArgument DescriptorTable(UINT64 GpuDescriptorHandle);
+    RootArgument Constants(const void* Values, UINT NumValues);
+
+    struct Record
+    {
+        UINT ExportIndex; // Into Builder::Exports.
+        std::vector<RootArgument> Arguments;
+    };
+
+    struct Builder
+    {
+        // Unique export names, so every identifier is fetched from the state object once
+        // no matter how many records use it. They point at the keys of ExportIndices, don't copy a Builder.
+        std::vector<const wchar_t*> Exports;
+        std::unordered_map<std::wstring, UINT> ExportIndices; // Into Exports, by name.
+        std::vector<Record> Records[NumSections];
+    };
+
+    // Appends a record and returns its index within the section, e.g. for InstanceContributionToHitGroupIndex.
+    UINT AddRecord(Builder* InBuilder, Section InSection, const wchar_t* ExportName,
+                   std::vector<RootArgument> Arguments = {});
+
+    struct SectionLayout
+    {
+        UINT64 Offset = 0;     // From the start of the table, TableAlignment aligned.
+        UINT64 Stride = 0;     // Largest record in the section rounded up to RecordAlignment.
+        UINT64 Size = 0;       // Stride * NumRecords.
+        UINT NumRecords = 0;
+    };
+
+    struct Layout
+    {
+        SectionLayout Sections[NumSections];
+        UINT64 TotalSize = 0;
+        UINT64 PaddingBytes = 0; // Alignment padding between records and sections.
+    };
+
+    // Size of the identifier plus arguments, before record alignment.
+    UINT64 ComputeRecordSize(const Record& InRecord);
+
+    // Per-section strides, with sections ordered to minimize the padding needed for table alignment.
+    void ComputeLayout(const Builder& InBuilder, Layout* OutLayout);
+
+    // Serializes the table into Destination (Layout.TotalSize bytes), padding is zeroed. Identifiers[i] is the
+    // ShaderIdentifierSize-byte identifier of Builder.Exports[i].
+    void Write(const Builder& InBuilder, const Layout& InLayout, const void* const* Identifiers, UINT8* Destination);
+
+    // Section order and alignment, record strides, the unaligned section moved last, where Write puts the local
+    // arguments, and a table of NumHitGroups hit group records over a few hundred exports, read back record by record.
+    bool RunTest(UINT NumHitGroups);
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "Types.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Compiled shaders kept across runs, addressed by what went into compiling them: the source with everything it
+// includes, transitively, then the entry point, target profile, defines and arguments, and the compiler's version.
+// Editing Shared.h changes the key of every shader that includes it, nothing else needs invalidating. The blobs live
+// in one archive laid out to be used in place, so a warm start maps it and compiles nothing. Pure CPU, an archive is a
+// span of memory; see D3D::OpenShaderCache for mapping it from disk.
+namespace ShaderCache
+{
+    static const UINT32 ArchiveMagic = 0x41435348; // "HSCA"
+    static const UINT32 ArchiveVersion = 1;
+    static const UINT64 BlobAlignment = 16;
+    static const UINT MaxEntries = 1024; // Past this, what a run didn't use is dropped when saving.
+
+    struct Key
+    {
+        UINT64 Low = 0;
+        UINT64 High = 0;
+    };
+
+    // Two independent 64-bit lanes, plenty for a few thousand shaders.
+    struct Hasher
+    {
+        UINT64 Low = 14695981039346656037ull;
+        UINT64 High = 0x9E3779B97F4A7C15ull;
+        UINT64 Size = 0;
+    };
+
+    void Add(Hasher* InHasher, const void* Data, UINT64 Size);
+    Key Finish(const Hasher& InHasher);
+
+    // The files it includes, in order, without resolving them.
+    void GetIncludes(const std::string& Source, std::vector<std::string>* Includes);
+
+    // Hashes Filename's name and contents, then those of everything it includes, each file once. Read returns
+    // false for files it can't read, then so does this. Files gets every file hashed, Filename first.
+    typedef std::function<bool(const std::string& Filename, std::string* Contents)> ReadFunction;
+    bool HashSource(const std::string& Filename, const ReadFunction& Read, Hasher* InHasher,
+                    std::vector<std::string>* Files = nullptr);
+
+    // The key D3D::CompileShader caches a shader under: HashSource, then every argument and the compiler's version.
+    // Arguments mustn't depend on the machine, e.g. include directories are relative to the solution.
+    bool ComputeKey(const std::string& Filename, const ReadFunction& Read, const std::vector<std::string>& Arguments,
+                    const Key& CompilerVersion, Key* OutKey, std::vector<std::string>* Files = nullptr);
+
+    // An archive is the header, the entries sorted by key and the blobs they point to, each aligned.
+    struct ArchiveHeader
+    {
+        UINT32 Magic;
+        UINT32 Version;
+        UINT64 NumEntries;
+    };
+
+    struct ArchiveEntry
+    {
+        Key EntryKey;
+        UINT64 Offset; // From the start of the archive.
+        UINT64 Size;
+        double CompileSeconds; // What a hit saves.
+    };
+
+    struct Cache
+    {
+        // The archive as it was opened, it has to stay where it is until the cache is saved.
+        const UINT8* Archive = nullptr;
+        const ArchiveEntry* Entries = nullptr;
+        UINT64 NumEntries = 0;
+        std::unique_ptr<std::atomic<bool>[]> IsUsed;
+
+        // Compiled since, Added's offsets are into AddedBlobs.
+        std::mutex Lock;
+        std::vector<ArchiveEntry> Added;
+        std::vector<std::vector<UINT8>> AddedBlobs;
+
+        std::atomic<UINT> NumHits{0};
+        std::atomic<UINT> NumMisses{0};
+        std::atomic<UINT64> SavedMicroseconds{0};
+        std::atomic<UINT64> HashMicroseconds{0}; // Finding the keys, what a warm start costs instead.
+    };
+
+    // False, and an empty cache, when Archive isn't one this version wrote.
+    bool Open(Cache* InCache, const void* Archive, UINT64 ArchiveSize);
+
+    // Any thread. Counts a hit or a miss.
+    bool Find(Cache* InCache, const Key& InKey, const void** OutBlob, UINT64* OutSize);
+    void Add(Cache* InCache, const Key& InKey, const void* Blob, UINT64 Size, double CompileSeconds);
+
+    // The archive with what was added, for the next run.
+    bool HasChanged(const Cache& InCache);
+    void Serialize(const Cache& InCache, std::vector<UINT8>* OutArchive);
+
+    void Report(const Cache& InCache);
+
+    // Against a file system in memory and a stub compiler: a cold run that compiles everything, a warm one from its
+    // archive that compiles nothing and finds the same blobs, and edits to a shader, to a header it includes and to
+    // entry points, profiles and defines, each recompiling exactly the shaders they affect. Also include cycles,
+    // archives that are truncated or from another version, and dropping unused entries past MaxEntries.
+    bool RunTest(UINT NumShaders);
+
+    // Hashing sources with their includes, and finding keys in an archive of NumEntries.
+    void RunBenchmark(UINT NumEntries);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "Types.h"
+#include "JobSystem.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Compiling shaders, and creating the pipelines made of them, off the render thread. Every compilation is a job of
+// its own, so a demo's shaders compile side by side on the job system's workers, and submitting one returns a future
+// the frame loop polls without blocking. A selection switches to the requested demo only once all of its futures are
+// ready, the demo before keeps rendering meanwhile. Pure CPU, a compilation is whatever function it's given; see
+// D3D::CompileShaderAsync for the DXC side.
+namespace ShaderCompilation
+{
+    enum class Status : UINT
+    {
+        Pending,
+        Succeeded,
+        Failed,
+    };
+
+    struct Compilation
+    {
+        std::atomic<Status> State{Status::Pending};
+        JobSystem::Counter Done;
+        double Seconds = 0; // Spent compiling, once it isn't pending.
+    };
+    typedef std::shared_ptr<Compilation> Future;
+
+    // Submit from one thread at a time.
+    struct Service
+    {
+        std::vector<Future> Submitted; // Kept so nothing is destroyed while its job may still run.
+        std::atomic<UINT> NumSucceeded{0};
+        std::atomic<UINT> NumFailed{0};
+    };
+
+    // Compile runs once, on a worker, and returns whether it succeeded. It may wait for other futures.
+    Future Submit(Service* InService, const std::function<bool()>& Compile);
+
+    bool IsReady(const Future& InFuture);
+    bool AreReady(const std::vector<Future>& Futures);
+    bool HasSucceeded(const Future& InFuture);
+
+    // Runs other jobs until InFuture is ready, true when it succeeded.
+    bool Wait(const Future& InFuture);
+    void WaitForAll(Service* InService);
+
+    // Sums the time the futures spent compiling, i.e. what compiling them one after the other would have taken.
+    double GetCompileSeconds(const std::vector<Future>& Futures);
+
+    // Which of several demos renders. Requesting one that isn't ready yet starts its compilations through Start,
+    // once, and keeps the current demo until they're all ready.
+    struct Selection
+    {
+        UINT Current = 0;
+        UINT Requested = 0;
+        std::vector<std::vector<Future>> Futures; // Per demo, what it waits for.
+        std::vector<bool> IsStarted;
+    };
+
+    void Initialize(Selection* InSelection, UINT NumDemos, UINT Current);
+    void Request(Selection* InSelection, UINT Demo);
+
+    // Called once per frame, true when the current demo changed.
+    bool Update(Selection* InSelection, const std::function<void(UINT Demo, std::vector<Future>* Futures)>& Start);
+
+    // The stub compiler: compilations that take a few milliseconds and sometimes fail, and pipelines that wait for
+    // theirs. Switches between NumDemos demos frame after frame and checks that every compilation runs once, that no
+    // pipeline is created before its shaders or from a failed one, that a demo only renders once everything it
+    // waits for is ready, and that the frame loop never blocks on a compilation.
+    bool RunTest(UINT NumDemos, UINT ShadersPerDemo);
+
+    // Compiling a set of stub shaders on the render thread against submitting them, per number of shaders.
+    void RunBenchmark(UINT NumShaders);
+}
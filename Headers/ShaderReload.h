@@ -0,0 +1,92 @@
+#pragma once
+#include "Types.h"
+#include "ShaderCache.h"
+#include "ShaderCompilation.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Reloading shaders when their files change. The include graph knows what every file includes, so a change to
+// Shared.h invalidates exactly the shaders that include it, directly or through other files, and a file's edges are
+// read again whenever it changes. Editors save in several writes, changes are taken once the files were quiet for a
+// moment. Who a shader belongs to is up to the caller, e.g. the demo whose pipelines to rebuild: they're rebuilt on
+// the job system while the ones before keep rendering, and swapped in at the start of a frame once all of them were.
+// Pure CPU, changes come in as filenames; see D3D::PollShaderWatcher for watching the Shaders directory on Windows,
+// PollWatch on Linux.
+namespace ShaderReload
+{
+    static const double QuietSeconds = 0.1;
+
+    struct Graph
+    {
+        std::unordered_map<std::string, std::vector<std::string>> Includes; // Per file, what it includes directly.
+        std::vector<std::pair<std::string, UINT>> Shaders;                  // Source file and owner.
+    };
+
+    // Files are matched whatever their case and slashes, like Windows does.
+    std::string GetFileKey(const std::string& Filename);
+
+    // Once per source file and owner. Scan the file to know what it includes.
+    void AddShader(Graph* InGraph, const std::string& Filename, UINT Owner);
+
+    // Reads Filename and what it includes, transitively, and replaces their edges. Files that can't be read have none.
+    void Scan(Graph* InGraph, const std::string& Filename, const ShaderCache::ReadFunction& Read);
+
+    // The owners, sorted and once each, of the shaders whose source or anything it includes is one of Changed.
+    void GetAffected(const Graph& InGraph, const std::vector<std::string>& Changed, std::vector<UINT>* Owners);
+
+    struct Changes
+    {
+        std::vector<std::string> Pending; // File keys, once each.
+        double LastChange = 0;
+    };
+
+    void AddChange(Changes* InChanges, const std::string& Filename, double Time);
+
+    // The files changed since last time, once none changed for QuietSeconds.
+    bool TakeChanges(Changes* InChanges, double Time, std::vector<std::string>* Changed);
+
+#ifdef __linux__
+    // The directory watch D3D::CreateShaderWatcher does with ReadDirectoryChangesW, with inotify: Directory and the
+    // directories below it, new ones included, read without blocking.
+    struct DirectoryWatch
+    {
+        int Descriptor = -1;
+        std::string Directory;                               // Ends with a slash.
+        std::unordered_map<int, std::string> Subdirectories; // Per watch, its path under Directory, "" or "Sub/".
+    };
+
+    // False when inotify or Directory can't be used, then polling finds nothing.
+    bool StartWatch(DirectoryWatch* Watch, const std::string& Directory);
+    void StopWatch(DirectoryWatch* Watch);
+
+    // Adds what was written, created or moved in since the last poll, relative to the directory. Removed files aren't.
+    // When the queue overflowed any file may have changed, then every file InGraph knows is added.
+    void PollWatch(DirectoryWatch* Watch, const Graph& InGraph, double Time, Changes* InChanges);
+#endif
+
+    // Per owner, whether it changed and what its rebuild waits for.
+    struct Reloads
+    {
+        std::vector<bool> IsRequested;
+        std::vector<std::vector<ShaderCompilation::Future>> Futures; // Empty unless rebuilding.
+        UINT NumSwapped = 0;
+        UINT NumFailed = 0;
+    };
+
+    void Initialize(Reloads* InReloads, UINT NumOwners);
+    void Request(Reloads* InReloads, const std::vector<UINT>& Owners);
+
+    // Once a frame, before recording anything. Starts rebuilding what was requested, unless it's rebuilding already,
+    // then it starts again once that's done. Swaps in the rebuilds whose futures all succeeded, the others are
+    // dropped and what renders stays. The old pipelines may still be in flight, Swap retires them.
+    typedef std::function<void(UINT Owner, std::vector<ShaderCompilation::Future>* Futures)> StartFunction;
+    void Update(Reloads* InReloads, const StartFunction& Start, const std::function<void(UINT Owner)>& Swap);
+
+    // Against a file system in memory: the shaders' files and random graphs of NumFiles files with cycles, checked
+    // against brute force over NumRounds of random edits, including edits that add and remove includes, and the
+    // batching of changes that come in several writes. Then a frame loop editing owners while their stub rebuilds
+    // run, some of them failing, that renders the last edit that compiled and never half a rebuild. On Linux, the
+    // watch on a temporary directory too.
+    bool RunTest(UINT NumFiles, UINT NumRounds);
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "Types.h"
+#include <deque>
+#include <vector>
+
+// Uploads of geometry and textures on the copy queue, so the graphics queue only reads default heap resources.
+// Uploads are queued in order and staged into a ring buffer in batches, each batch one submission with its own fence
+// value; a frame's batch stops at the frame's budget so streaming never takes all of the bandwidth. The ring's space
+// comes back once a batch's fence completed. Consumers poll a ticket or wait on the GPU for its batch's fence. Pure
+// CPU, see D3D::StreamBuffer for the GPU side.
+namespace StreamingUploads
+{
+    typedef UINT64 Ticket; // In the order uploads were queued, from 1. Uploads are ready in the same order.
+    static const UINT64 NotSubmitted = ~0ull;
+
+    struct Request
+    {
+        UINT64 Size = 0;
+        UINT64 Alignment = 1;
+    };
+
+    struct Staged
+    {
+        Ticket Id = 0;
+        UINT64 Offset = 0; // In the ring.
+        UINT64 Size = 0;
+    };
+
+    struct Batch
+    {
+        Ticket LastTicket = 0;
+        UINT64 End = 0; // Head once staged.
+        UINT64 FenceValue = 0;
+    };
+
+    struct Uploader
+    {
+        UINT64 Capacity = 0;       // Power of two.
+        UINT64 BudgetPerFrame = 0; // Bytes per batch, unless a single upload is larger.
+        UINT64 Head = 0;           // Bytes staged so far, padding included. Offsets are Head % Capacity.
+        UINT64 Tail = 0;           // Everything before it was copied out by the GPU.
+
+        std::deque<Request> Queued; // Not staged yet, from LastStaged + 1.
+        std::deque<Batch> Batches;  // Submitted and not retired, oldest first.
+        Ticket NextTicket = 1;
+        Ticket LastStaged = 0;
+        Ticket LastSubmitted = 0;
+        Ticket LastReady = 0;
+
+        // Since Initialize.
+        UINT64 NumBytesStaged = 0;
+        UINT NumBatches = 0;
+        UINT NumThrottled = 0; // Batches that stopped at the budget.
+        UINT NumRingFull = 0;  // Batches that stopped at the ring's free space.
+    };
+
+    void Initialize(Uploader* InUploader, UINT64 Capacity, UINT64 BudgetPerFrame);
+
+    // Alignment is a power of two, Size at most the capacity.
+    Ticket Enqueue(Uploader* InUploader, UINT64 Size, UINT64 Alignment);
+
+    // Once per frame: stages the oldest queued uploads until the budget or the ring's free space runs out, appending
+    // where they go to Staged. Returns how many.
+    UINT StageBatch(Uploader* InUploader, std::vector<Staged>* OutStaged);
+
+    // Everything staged since the last call is copied out by the submission signaling FenceValue.
+    void SubmitBatch(Uploader* InUploader, UINT64 FenceValue);
+    void Retire(Uploader* InUploader, UINT64 CompletedFenceValue);
+
+    bool IsReady(const Uploader& InUploader, Ticket Id);
+
+    // The fence value to wait for, 0 once ready and NotSubmitted while it's queued or only staged.
+    UINT64 GetFenceValue(const Uploader& InUploader, Ticket Id);
+
+    // Random uploads over frames with the GPU a few frames behind, checking that staged ranges never overlap the
+    // ones still in flight, the budget and the alignments, and that uploads are ready in order.
+    bool RunTest(UINT NumUploads);
+
+    // MB/s staged into a ring in memory, the copies included, and the batches and throttling it took.
+    void RunBenchmark(UINT NumUploads, UINT64 Capacity, UINT64 BudgetPerFrame);
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include "Types.h"
+#include <functional>
+
+namespace Threading
+{
+    // Number of hardware threads available to the process (at least 1).
+    UINT GetNumHardwareThreads();
+
+    // Splits [0, Count) into chunks of GrainSize and runs Body(Begin, End) on up to NumThreads of the job system's
+    // workers. The calling thread participates, so NumThreads = 1 runs everything inline.
+    void ParallelFor(UINT Count, UINT NumThreads, UINT GrainSize,
+                     const std::function<void(UINT Begin, UINT End)>& Body);
+
+    // The same, Body also gets which thread runs it: 0 for the calling thread, below NumThreads for the others.
+    // For state kept per thread, e.g. command lists.
+    void ParallelForPerThread(UINT Count, UINT NumThreads, UINT GrainSize,
+                              const std::function<void(UINT Thread, UINT Begin, UINT End)>& Body);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "Bvh.h"
+
+// Decides whether a top-level acceleration structure is updated in place or rebuilt. An update keeps the topology
+// of the last build and only refits it, so it degrades as instances move away from where they were built. The
+// policy mirrors that on a CPU BVH: it refits the tree built with the last rebuild and compares its SAH cost to
+// the cost right after the build. Pure CPU, see D3D::UpdateTopLevel for the GPU side.
+namespace TopLevelPolicy
+{
+    enum class Action
+    {
+        Update,
+        Rebuild
+    };
+
+    struct Settings
+    {
+        float MaxDegradation = 0.3f; // Rebuild when the refit cost is 30% above the cost of the last build.
+    };
+
+    struct State
+    {
+        Bvh::Tree Tree;        // Built with the last rebuild, refit since.
+        UINT NumInstances = 0;
+        float BuildCost = 0.f;
+        float Cost = 0.f;      // Of the refit tree, as of the last Evaluate.
+        UINT NumUpdates = 0;   // Since the last rebuild.
+        UINT NumRebuilds = 0;
+    };
+
+    // Takes this frame's world-space instance bounds. Instance count changes always rebuild.
+    Action Evaluate(State* InState, const Bvh::AABB* InstanceBounds, UINT NumInstances,
+                    const Settings& InSettings = Settings());
+
+    // World-space bounds of an object-space box under a row-major 3x4 transform, as in D3D12_RAYTRACING_INSTANCE_DESC.
+    Bvh::AABB TransformBounds(const Bvh::AABB& Box, const float Transform[3][4]);
+
+    // Moves NumInstances boxes for NumFrames frames and compares always updating, always rebuilding and the policy at
+    // a few thresholds, printing the average SAH cost, the number of rebuilds and the time spent evaluating.
+    void RunBenchmark(UINT NumInstances, UINT NumFrames);
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <assert.h>
+#include <stdio.h>
+
+// The few Windows types and functions the pure CPU modules use. Elsewhere they're defined to match, so those modules
+// and their tests build without the Windows SDK.
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <stddef.h>
+#define _countof(Array) (sizeof(Array) / sizeof((Array)[0]))
+
+typedef int INT;
+typedef unsigned int UINT;
+typedef signed char INT8;
+typedef unsigned char UINT8;
+typedef short INT16;
+typedef unsigned short UINT16;
+typedef int INT32;
+typedef unsigned int UINT32;
+typedef long long INT64;
+typedef unsigned long long UINT64;
+typedef size_t SIZE_T;
+
+inline void OutputDebugStringA(const char* Message)
+{
+    fputs(Message, stderr);
+}
+
+inline int fopen_s(FILE** File, const char* FileName, const char* Mode)
+{
+    *File = fopen(FileName, Mode);
+    return *File != nullptr ? 0 : errno;
+}
+#endif
+
+inline UINT32 AlignTo(UINT32 num, UINT32 alignment)
+{
+    assert(alignment > 0);
+    return ((num + alignment - 1) / alignment) * alignment;
+}
+
+inline UINT64 AlignTo(UINT64 num, UINT64 alignment)
+{
+    assert(alignment > 0);
+    return ((num + alignment - 1) / alignment) * alignment;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "Types.h"
+#include <atomic>
+
+// Linear allocator over one persistently mapped upload buffer for data written every frame: constants, structured
+// and instance data. Allocations are bumped off a head that only ever grows and wrap around the buffer; the space
+// of a frame is retired once the GPU passed its fence. Allocate is lock-free so recording threads can share a ring,
+// EndFrame and Retire belong to the thread that submits. Pure CPU, see D3D::CreateUploadRing for the GPU side.
+namespace UploadRing
+{
+    static const UINT MaxFramesInFlight = 8;
+
+    struct Ring
+    {
+        UINT64 Capacity = 0;          // Power of two.
+        std::atomic<UINT64> Head{0};  // Bytes handed out so far, padding included. Offsets are Head % Capacity.
+        std::atomic<UINT64> Tail{0};  // Everything before it was read by the GPU.
+        std::atomic<UINT> NumFailed{0};
+
+        // Submitted frames the GPU may still be reading, oldest first.
+        UINT64 FrameFenceValues[MaxFramesInFlight] = {};
+        UINT64 FrameEnds[MaxFramesInFlight] = {}; // Head when the frame was submitted.
+        UINT FirstFrame = 0;
+        UINT NumFrames = 0;
+    };
+
+    void Initialize(Ring* InRing, UINT64 Capacity);
+
+    // Alignment is a power of two up to the capacity. Allocations never straddle the end of the buffer.
+    // Returns false when the frames in flight hold too much of it.
+    bool Allocate(Ring* InRing, UINT64 Size, UINT64 Alignment, UINT64* OutOffset);
+
+    // Everything allocated since the last call belongs to the frame signaling FenceValue.
+    void EndFrame(Ring* InRing, UINT64 FenceValue);
+    void Retire(Ring* InRing, UINT64 CompletedFenceValue);
+
+    UINT64 GetUsedSize(const Ring& InRing);
+
+    // Constants for NumThreads recording threads over a few frames in flight, printing allocations per second,
+    // against the same ring behind a mutex.
+    void RunBenchmark(UINT NumAllocations, UINT NumThreads);
+}
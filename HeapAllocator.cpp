@@ -0,0 +1,524 @@
+#include "Headers/HeapAllocator.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace HeapAllocator
+{
+    static UINT32 NextRandom(UINT32* State)
+    {
+        *State = *State * 1664525u + 1013904223u;
+        return *State >> 8;
+    }
+
+    // Size class of a block: the power of two, then which of its linear subdivisions.
+    static void GetSizeClass(UINT64 Units, UINT* FirstLevel, UINT* SecondLevel)
+    {
+        if (Units < NumSecondLevels)
+        {
+            *FirstLevel = 0;
+            *SecondLevel = (UINT)Units;
+        }
+        else
+        {
+            UINT Log2 = 63 - (UINT)_lzcnt_u64(Units);
+            *FirstLevel = Log2 - SecondLevelBits + 1;
+            *SecondLevel = (UINT)(Units >> (Log2 - SecondLevelBits)) - NumSecondLevels;
+        }
+    }
+
+    // Rounds up to the next class boundary, every block of that class or above then fits.
+    static UINT64 RoundUpToSizeClass(UINT64 Units)
+    {
+        if (Units >= NumSecondLevels)
+        {
+            UINT Log2 = 63 - (UINT)_lzcnt_u64(Units);
+            UINT64 Step = 1ull << (Log2 - SecondLevelBits);
+            Units = (Units + Step - 1) & ~(Step - 1);
+        }
+        return Units;
+    }
+
+    static UINT64 ToUnits(const Allocator& InAllocator, UINT64 Size)
+    {
+        return std::max<UINT64>((Size + InAllocator.Granularity - 1) / InAllocator.Granularity, 1);
+    }
+
+    static UINT NewBlock(Allocator* InAllocator)
+    {
+        if (!InAllocator->UnusedBlocks.empty())
+        {
+            UINT Index = InAllocator->UnusedBlocks.back();
+            InAllocator->UnusedBlocks.pop_back();
+            InAllocator->Blocks[Index] = Block();
+            return Index;
+        }
+        InAllocator->Blocks.emplace_back();
+        return (UINT)InAllocator->Blocks.size() - 1;
+    }
+
+    static void InsertFree(Allocator* InAllocator, UINT Index)
+    {
+        Block& Current = InAllocator->Blocks[Index];
+        UINT FirstLevel, SecondLevel;
+        GetSizeClass(Current.Size, &FirstLevel, &SecondLevel);
+
+        UINT Head = InAllocator->FreeLists[FirstLevel][SecondLevel];
+        Current.IsFree = true;
+        Current.PreviousFree = InvalidBlock;
+        Current.NextFree = Head;
+        if (Head != InvalidBlock)
+        {
+            InAllocator->Blocks[Head].PreviousFree = Index;
+        }
+        InAllocator->FreeLists[FirstLevel][SecondLevel] = Index;
+        InAllocator->SecondLevelBitmaps[FirstLevel] |= 1u << SecondLevel;
+        InAllocator->FirstLevelBitmap |= 1ull << FirstLevel;
+    }
+
+    static void RemoveFree(Allocator* InAllocator, UINT Index)
+    {
+        Block& Current = InAllocator->Blocks[Index];
+        if (Current.PreviousFree != InvalidBlock)
+        {
+            InAllocator->Blocks[Current.PreviousFree].NextFree = Current.NextFree;
+        }
+        if (Current.NextFree != InvalidBlock)
+        {
+            InAllocator->Blocks[Current.NextFree].PreviousFree = Current.PreviousFree;
+        }
+
+        UINT FirstLevel, SecondLevel;
+        GetSizeClass(Current.Size, &FirstLevel, &SecondLevel);
+        if (InAllocator->FreeLists[FirstLevel][SecondLevel] == Index)
+        {
+            InAllocator->FreeLists[FirstLevel][SecondLevel] = Current.NextFree;
+            if (Current.NextFree == InvalidBlock)
+            {
+                InAllocator->SecondLevelBitmaps[FirstLevel] &= ~(1u << SecondLevel);
+                if (InAllocator->SecondLevelBitmaps[FirstLevel] == 0)
+                {
+                    InAllocator->FirstLevelBitmap &= ~(1ull << FirstLevel);
+                }
+            }
+        }
+        Current.IsFree = false;
+        Current.PreviousFree = InvalidBlock;
+        Current.NextFree = InvalidBlock;
+    }
+
+    static UINT FindFree(const Allocator& InAllocator, UINT64 Units)
+    {
+        UINT FirstLevel, SecondLevel;
+        GetSizeClass(RoundUpToSizeClass(Units), &FirstLevel, &SecondLevel);
+        if (FirstLevel >= NumFirstLevels)
+        {
+            return InvalidBlock;
+        }
+
+        UINT SecondLevelMap = InAllocator.SecondLevelBitmaps[FirstLevel] & (~0u << SecondLevel);
+        if (SecondLevelMap == 0)
+        {
+            UINT64 FirstLevelMap = InAllocator.FirstLevelBitmap & (~0ull << (FirstLevel + 1));
+            if (FirstLevelMap == 0)
+            {
+                return InvalidBlock;
+            }
+            FirstLevel = (UINT)_tzcnt_u64(FirstLevelMap);
+            SecondLevelMap = InAllocator.SecondLevelBitmaps[FirstLevel];
+        }
+        return InAllocator.FreeLists[FirstLevel][_tzcnt_u32(SecondLevelMap)];
+    }
+
+    void Initialize(Allocator* InAllocator, UINT64 Size, UINT64 Granularity)
+    {
+        assert(Granularity > 0 && (Granularity & (Granularity - 1)) == 0);
+        assert(Size >= Granularity && Size % Granularity == 0);
+
+        InAllocator->Granularity = Granularity;
+        InAllocator->Capacity = Size / Granularity;
+        InAllocator->UsedSize = 0;
+        InAllocator->NumAllocations = 0;
+        InAllocator->Blocks.clear();
+        InAllocator->UnusedBlocks.clear();
+        InAllocator->FirstLevelBitmap = 0;
+        for (UINT FirstLevel = 0; FirstLevel < NumFirstLevels; ++FirstLevel)
+        {
+            InAllocator->SecondLevelBitmaps[FirstLevel] = 0;
+            for (UINT SecondLevel = 0; SecondLevel < NumSecondLevels; ++SecondLevel)
+            {
+                InAllocator->FreeLists[FirstLevel][SecondLevel] = InvalidBlock;
+            }
+        }
+
+        UINT Index = NewBlock(InAllocator);
+        InAllocator->Blocks[Index].Size = InAllocator->Capacity;
+        InsertFree(InAllocator, Index);
+    }
+
+    bool Allocate(Allocator* InAllocator, UINT64 Size, Allocation* OutAllocation)
+    {
+        UINT64 Units = ToUnits(*InAllocator, Size);
+        UINT Index = FindFree(*InAllocator, Units);
+        if (Index == InvalidBlock)
+        {
+            return false;
+        }
+        RemoveFree(InAllocator, Index);
+
+        // Give the tail back.
+        if (InAllocator->Blocks[Index].Size > Units)
+        {
+            UINT Remainder = NewBlock(InAllocator);
+            Block& Current = InAllocator->Blocks[Index];
+            Block& Tail = InAllocator->Blocks[Remainder];
+            Tail.Offset = Current.Offset + Units;
+            Tail.Size = Current.Size - Units;
+            Tail.PreviousPhysical = Index;
+            Tail.NextPhysical = Current.NextPhysical;
+            if (Current.NextPhysical != InvalidBlock)
+            {
+                InAllocator->Blocks[Current.NextPhysical].PreviousPhysical = Remainder;
+            }
+            Current.NextPhysical = Remainder;
+            Current.Size = Units;
+            InsertFree(InAllocator, Remainder);
+        }
+
+        InAllocator->UsedSize += Units;
+        InAllocator->NumAllocations++;
+        OutAllocation->Offset = InAllocator->Blocks[Index].Offset * InAllocator->Granularity;
+        OutAllocation->Size = Units * InAllocator->Granularity;
+        OutAllocation->Block = Index;
+        return true;
+    }
+
+    // Folds Next into Index, Next's record is recycled.
+    static void Merge(Allocator* InAllocator, UINT Index, UINT Next)
+    {
+        Block& Current = InAllocator->Blocks[Index];
+        Block& Absorbed = InAllocator->Blocks[Next];
+        Current.Size += Absorbed.Size;
+        Current.NextPhysical = Absorbed.NextPhysical;
+        if (Absorbed.NextPhysical != InvalidBlock)
+        {
+            InAllocator->Blocks[Absorbed.NextPhysical].PreviousPhysical = Index;
+        }
+        Absorbed = Block();
+        InAllocator->UnusedBlocks.push_back(Next);
+    }
+
+    void Free(Allocator* InAllocator, const Allocation& InAllocation)
+    {
+        UINT Index = InAllocation.Block;
+        assert(Index < InAllocator->Blocks.size() && !InAllocator->Blocks[Index].IsFree);
+        InAllocator->UsedSize -= InAllocator->Blocks[Index].Size;
+        InAllocator->NumAllocations--;
+
+        UINT Previous = InAllocator->Blocks[Index].PreviousPhysical;
+        if (Previous != InvalidBlock && InAllocator->Blocks[Previous].IsFree)
+        {
+            RemoveFree(InAllocator, Previous);
+            Merge(InAllocator, Previous, Index);
+            Index = Previous;
+        }
+        UINT Next = InAllocator->Blocks[Index].NextPhysical;
+        if (Next != InvalidBlock && InAllocator->Blocks[Next].IsFree)
+        {
+            RemoveFree(InAllocator, Next);
+            Merge(InAllocator, Index, Next);
+        }
+        InsertFree(InAllocator, Index);
+    }
+
+    bool IsEmpty(const Allocator& InAllocator)
+    {
+        return InAllocator.NumAllocations == 0;
+    }
+
+    void GetStats(const Allocator& InAllocator, Stats* OutStats)
+    {
+        *OutStats = Stats();
+        OutStats->UsedSize = InAllocator.UsedSize * InAllocator.Granularity;
+        OutStats->FreeSize = (InAllocator.Capacity - InAllocator.UsedSize) * InAllocator.Granularity;
+        OutStats->NumAllocations = InAllocator.NumAllocations;
+
+        // The largest block is in the highest non empty list, which is short unless the heap is badly fragmented.
+        if (InAllocator.FirstLevelBitmap != 0)
+        {
+            UINT FirstLevel = 63 - (UINT)_lzcnt_u64(InAllocator.FirstLevelBitmap);
+            UINT SecondLevel = 31 - _lzcnt_u32(InAllocator.SecondLevelBitmaps[FirstLevel]);
+            UINT64 Largest = 0;
+            for (UINT Index = InAllocator.FreeLists[FirstLevel][SecondLevel]; Index != InvalidBlock;
+                 Index = InAllocator.Blocks[Index].NextFree)
+            {
+                Largest = std::max(Largest, InAllocator.Blocks[Index].Size);
+            }
+            OutStats->LargestFreeBlock = Largest * InAllocator.Granularity;
+        }
+        OutStats->Fragmentation = OutStats->FreeSize == 0 ? 0.0 :
+            1.0 - (double)OutStats->LargestFreeBlock / (double)OutStats->FreeSize;
+    }
+
+    bool Validate(const Allocator& InAllocator)
+    {
+        if (InAllocator.Blocks.empty() || InAllocator.Blocks[0].Offset != 0 ||
+            InAllocator.Blocks[0].PreviousPhysical != InvalidBlock)
+        {
+            return false;
+        }
+
+        // The physical chain tiles the whole range, free blocks are never adjacent.
+        UINT64 Offset = 0;
+        UINT64 UsedSize = 0;
+        UINT NumAllocations = 0;
+        UINT NumFree = 0;
+        UINT NumBlocks = 0;
+        UINT Previous = InvalidBlock;
+        for (UINT Index = 0; Index != InvalidBlock; Index = InAllocator.Blocks[Index].NextPhysical)
+        {
+            const Block& Current = InAllocator.Blocks[Index];
+            if (Current.Offset != Offset || Current.Size == 0 || Current.PreviousPhysical != Previous ||
+                ++NumBlocks > InAllocator.Blocks.size())
+            {
+                return false;
+            }
+            if (Current.IsFree)
+            {
+                if (Previous != InvalidBlock && InAllocator.Blocks[Previous].IsFree)
+                {
+                    return false;
+                }
+                NumFree++;
+            }
+            else
+            {
+                UsedSize += Current.Size;
+                NumAllocations++;
+            }
+            Offset += Current.Size;
+            Previous = Index;
+        }
+        if (Offset != InAllocator.Capacity || UsedSize != InAllocator.UsedSize ||
+            NumAllocations != InAllocator.NumAllocations ||
+            NumBlocks + InAllocator.UnusedBlocks.size() != InAllocator.Blocks.size())
+        {
+            return false;
+        }
+
+        // Every free block is in the list of its class, and the bitmaps mirror the lists.
+        UINT NumListed = 0;
+        for (UINT FirstLevel = 0; FirstLevel < NumFirstLevels; ++FirstLevel)
+        {
+            bool HasFirstLevel = (InAllocator.FirstLevelBitmap >> FirstLevel) & 1;
+            if (HasFirstLevel != (InAllocator.SecondLevelBitmaps[FirstLevel] != 0))
+            {
+                return false;
+            }
+            for (UINT SecondLevel = 0; SecondLevel < NumSecondLevels; ++SecondLevel)
+            {
+                UINT Head = InAllocator.FreeLists[FirstLevel][SecondLevel];
+                bool HasSecondLevel = (InAllocator.SecondLevelBitmaps[FirstLevel] >> SecondLevel) & 1;
+                if (HasSecondLevel != (Head != InvalidBlock))
+                {
+                    return false;
+                }
+                UINT PreviousFree = InvalidBlock;
+                for (UINT Index = Head; Index != InvalidBlock; Index = InAllocator.Blocks[Index].NextFree)
+                {
+                    const Block& Current = InAllocator.Blocks[Index];
+                    UINT BlockFirstLevel, BlockSecondLevel;
+                    GetSizeClass(Current.Size, &BlockFirstLevel, &BlockSecondLevel);
+                    if (!Current.IsFree || Current.PreviousFree != PreviousFree || BlockFirstLevel != FirstLevel ||
+                        BlockSecondLevel != SecondLevel || ++NumListed > NumFree)
+                    {
+                        return false;
+                    }
+                    PreviousFree = Index;
+                }
+            }
+        }
+        return NumListed == NumFree;
+    }
+
+    // Log-uniform between MinSize and MaxSize, like real buffer and texture sizes.
+    static UINT64 RandomSize(UINT32* State, UINT64 MinSize, UINT64 MaxSize)
+    {
+        double Random = (double)NextRandom(State) / (double)(1 << 24);
+        return (UINT64)((double)MinSize * pow((double)MaxSize / (double)MinSize, Random));
+    }
+
+    bool RunFuzzTest(UINT NumOperations, UINT32 Seed)
+    {
+        UINT32 State = Seed;
+        Allocator TestAllocator;
+        std::vector<Allocation> Live;
+        std::vector<UINT8> IsLiveBlock;
+        UINT NumFailed = 0;
+        bool Passed = true;
+
+        for (UINT Operation = 0; Operation < NumOperations && Passed; ++Operation)
+        {
+            // Start over now and then with another granularity and capacity, the heap must be empty by then.
+            if (Operation % 100000 == 0)
+            {
+                for (const Allocation& Current : Live)
+                {
+                    Free(&TestAllocator, Current);
+                }
+                Live.clear();
+                Passed = Operation == 0 || (IsEmpty(TestAllocator) && Validate(TestAllocator) &&
+                                            TestAllocator.Blocks[0].IsFree &&
+                                            TestAllocator.Blocks[0].Size == TestAllocator.Capacity);
+
+                UINT64 Granularity = 1ull << (NextRandom(&State) % 17);
+                UINT64 NumGranules = 1 + NextRandom(&State) % 100000;
+                Initialize(&TestAllocator, Granularity * NumGranules, Granularity);
+            }
+
+            // Drift between almost empty and full so both splitting and merging get exercised.
+            UINT32 Phase = (Operation / 5000) % 2;
+            bool ShouldAllocate = Live.empty() || (NextRandom(&State) % 100) < (Phase ? 70u : 30u);
+            if (ShouldAllocate)
+            {
+                UINT64 Capacity = TestAllocator.Capacity * TestAllocator.Granularity;
+                UINT64 Size = RandomSize(&State, 1, std::max<UINT64>(Capacity / 16, 2));
+                Allocation Current;
+                if (Allocate(&TestAllocator, Size, &Current))
+                {
+                    const Block& Allocated = TestAllocator.Blocks[Current.Block];
+                    Passed = Current.Size >= Size && Current.Size - Size < TestAllocator.Granularity * (Size ? 1 : 2) &&
+                             Current.Offset % TestAllocator.Granularity == 0 &&
+                             Current.Offset + Current.Size <= Capacity && !Allocated.IsFree &&
+                             Allocated.Offset * TestAllocator.Granularity == Current.Offset;
+                    Live.push_back(Current);
+                }
+                else
+                {
+                    // Good fit may only miss blocks that are smaller than the request's rounded up size class.
+                    Stats Current;
+                    GetStats(TestAllocator, &Current);
+                    Passed = Current.LargestFreeBlock <
+                             RoundUpToSizeClass(ToUnits(TestAllocator, Size)) * TestAllocator.Granularity;
+                    NumFailed++;
+                }
+            }
+            else
+            {
+                UINT Index = NextRandom(&State) % Live.size();
+                Free(&TestAllocator, Live[Index]);
+                Live[Index] = Live.back();
+                Live.pop_back();
+            }
+
+            // The physical chain tiles the range, so matching live ranges with distinct used blocks means no overlap.
+            if (Passed && Operation % 64 == 0)
+            {
+                Passed = Validate(TestAllocator) && Live.size() == TestAllocator.NumAllocations;
+                IsLiveBlock.assign(TestAllocator.Blocks.size(), 0);
+                for (const Allocation& Current : Live)
+                {
+                    const Block& Allocated = TestAllocator.Blocks[Current.Block];
+                    Passed = Passed && !IsLiveBlock[Current.Block] && !Allocated.IsFree &&
+                             Allocated.Offset * TestAllocator.Granularity == Current.Offset &&
+                             Allocated.Size * TestAllocator.Granularity == Current.Size;
+                    IsLiveBlock[Current.Block] = 1;
+                }
+            }
+        }
+
+        char Message[256];
+        snprintf(Message, sizeof(Message), "HeapAllocator: fuzz test %s, %u operations, %u allocations didn't fit\n",
+                 Passed ? "passed" : "FAILED", NumOperations, NumFailed);
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+
+    static void RunChurn(const char* Name, UINT64 Capacity, UINT64 Granularity, UINT64 MinSize, UINT64 MaxSize,
+                         UINT NumOperations)
+    {
+        Allocator BenchmarkAllocator;
+        Initialize(&BenchmarkAllocator, Capacity, Granularity);
+
+        // Random numbers up front so the timing is only the allocator.
+        UINT32 State = 0x12345678;
+        std::vector<UINT64> Sizes(NumOperations);
+        std::vector<UINT> Victims(NumOperations);
+        for (UINT i = 0; i < NumOperations; ++i)
+        {
+            Sizes[i] = RandomSize(&State, MinSize, MaxSize);
+            Victims[i] = NextRandom(&State);
+        }
+
+        // Fill up to the first failure, then free and allocate in turns at that load.
+        std::vector<Allocation> Live;
+        Allocation Current;
+        UINT Next = 0;
+        while (Allocate(&BenchmarkAllocator, Sizes[Next % NumOperations], &Current))
+        {
+            Live.push_back(Current);
+            Next++;
+        }
+        Stats Filled;
+        GetStats(BenchmarkAllocator, &Filled);
+
+        UINT NumFailed = 0;
+        double Fragmentation = 0;
+        UINT NumSamples = 0;
+        auto Start = std::chrono::high_resolution_clock::now();
+        for (UINT i = 0; i < NumOperations; ++i)
+        {
+            UINT Index = Victims[i] % Live.size();
+            Free(&BenchmarkAllocator, Live[Index]);
+            if (Allocate(&BenchmarkAllocator, Sizes[i], &Live[Index]))
+            {
+                continue;
+            }
+            Live[Index] = Live.back();
+            Live.pop_back();
+            NumFailed++;
+
+            // Keep the load steady instead of draining the heap.
+            if (Allocate(&BenchmarkAllocator, Sizes[(i + 1) % NumOperations], &Current))
+            {
+                Live.push_back(Current);
+            }
+        }
+        auto End = std::chrono::high_resolution_clock::now();
+        double Seconds = std::chrono::duration<double>(End - Start).count();
+
+        // Sampled outside the timing.
+        for (UINT i = 0; i < 1000; ++i)
+        {
+            UINT Index = NextRandom(&State) % Live.size();
+            Free(&BenchmarkAllocator, Live[Index]);
+            if (!Allocate(&BenchmarkAllocator, RandomSize(&State, MinSize, MaxSize), &Live[Index]))
+            {
+                Live[Index] = Live.back();
+                Live.pop_back();
+            }
+            Stats Sample;
+            GetStats(BenchmarkAllocator, &Sample);
+            Fragmentation += Sample.Fragmentation;
+            NumSamples++;
+        }
+
+        char Message[512];
+        snprintf(Message, sizeof(Message),
+                 "HeapAllocator: %s, %llu MB in %llu byte granules, %u pairs: %.1f M allocations+frees/s, "
+                 "first failure at %.1f%% load, %.2f%% failed after, %.1f%% fragmentation, %zu live\n",
+                 Name, Capacity >> 20, Granularity, NumOperations, 2.0 * NumOperations / Seconds * 1e-6,
+                 100.0 * Filled.UsedSize / Capacity, 100.0 * NumFailed / NumOperations,
+                 100.0 * Fragmentation / NumSamples, Live.size());
+        OutputDebugStringA(Message);
+    }
+
+    void RunBenchmark(UINT NumOperations)
+    {
+        // Buffers and textures placed in a 256MB heap.
+        RunChurn("placed resources", 256ull << 20, 64 << 10, 64 << 10, 16ull << 20, NumOperations);
+        // Constants and vertex buffers under 64KB in a 16MB range.
+        RunChurn("small buffers", 16ull << 20, 256, 256, 64 << 10, NumOperations);
+    }
+}
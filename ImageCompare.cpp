@@ -0,0 +1,766 @@
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_PNG
+#define STBI_ONLY_TGA
+#define STBI_ONLY_BMP
+#include "stb/stb_image.h"
+#include "Headers/ImageCompare.h"
+#include "Headers/Threading.h"
+#include <immintrin.h>
+#include <math.h>
+
+namespace ImageCompare
+{
+    static const UINT SSIMRadius = 3;
+    static const UINT RowGrainSize = 16;
+
+    bool ReadImage(const char* FileName, Image* OutImage)
+    {
+        int Width, Height, NumChannels;
+        stbi_uc* Data = stbi_load(FileName, &Width, &Height, &NumChannels, 4);
+        if (Data == nullptr)
+        {
+            return false;
+        }
+
+        OutImage->Width = (UINT)Width;
+        OutImage->Height = (UINT)Height;
+        OutImage->Pixels.resize((size_t)Width * Height);
+        memcpy(OutImage->Pixels.data(), Data, OutImage->Pixels.size() * sizeof(UINT32));
+        stbi_image_free(Data);
+        return true;
+    }
+
+    bool WriteTga(const char* FileName, UINT Width, UINT Height, const UINT32* Pixels, UINT RowPitchInPixels)
+    {
+        FILE* File = nullptr;
+        if (fopen_s(&File, FileName, "wb") != 0 || File == nullptr)
+        {
+            return false;
+        }
+
+        // Uncompressed 32-bit true color, top-left origin.
+        UINT8 Header[18] = {};
+        Header[2] = 2;
+        Header[12] = (UINT8)(Width & 0xFF);
+        Header[13] = (UINT8)(Width >> 8);
+        Header[14] = (UINT8)(Height & 0xFF);
+        Header[15] = (UINT8)(Height >> 8);
+        Header[16] = 32;
+        Header[17] = 0x28;
+        fwrite(Header, sizeof(Header), 1, File);
+
+        // RGBA to BGRA.
+        std::vector<UINT32> Row(Width);
+        for (UINT y = 0; y < Height; ++y)
+        {
+            const UINT32* Source = Pixels + (size_t)y * RowPitchInPixels;
+            for (UINT x = 0; x < Width; ++x)
+            {
+                UINT32 Pixel = Source[x];
+                Row[x] = (Pixel & 0xFF00FF00) | ((Pixel & 0xFF) << 16) | ((Pixel >> 16) & 0xFF);
+            }
+            fwrite(Row.data(), sizeof(UINT32), Width, File);
+        }
+
+        fclose(File);
+        return true;
+    }
+
+    // Magma-like ramp, dark for no error and bright for large errors.
+    static UINT32 Colormap(float Value)
+    {
+        static const float Stops[5][3] = {
+            {0.f, 0.f, 4.f},
+            {80.f, 18.f, 123.f},
+            {182.f, 54.f, 121.f},
+            {251.f, 136.f, 97.f},
+            {252.f, 253.f, 191.f}
+        };
+        Value = Value < 0.f ? 0.f : (Value > 1.f ? 1.f : Value);
+        float Position = Value * 4.f;
+        UINT Stop = Position >= 4.f ? 3 : (UINT)Position;
+        float T = Position - (float)Stop;
+
+        UINT32 Color = 0xFF000000;
+        for (UINT c = 0; c < 3; ++c)
+        {
+            float Channel = Stops[Stop][c] + (Stops[Stop + 1][c] - Stops[Stop][c]) * T;
+            Color |= (UINT32)(Channel + 0.5f) << (8 * c);
+        }
+        return Color;
+    }
+
+    bool WriteHeatmap(const char* FileName, const ErrorMap& Map)
+    {
+        std::vector<UINT32> Pixels(Map.Values.size());
+        for (size_t i = 0; i < Pixels.size(); ++i)
+        {
+            Pixels[i] = Colormap(Map.Values[i]);
+        }
+        return WriteTga(FileName, Map.Width, Map.Height, Pixels.data(), Map.Width);
+    }
+
+    static void InitializeMap(ErrorMap* Map, const Image& InImage)
+    {
+        Map->Width = InImage.Width;
+        Map->Height = InImage.Height;
+        Map->Values.resize((size_t)InImage.Width * InImage.Height);
+    }
+
+    static double SumRows(const std::vector<double>& RowSums)
+    {
+        // Fixed order so the result doesn't depend on the thread count.
+        double Sum = 0.0;
+        for (double RowSum : RowSums)
+        {
+            Sum += RowSum;
+        }
+        return Sum;
+    }
+
+    static UINT64 SquaredErrorRow(const UINT32* A, const UINT32* B, UINT Width)
+    {
+        const __m256i ColorMask = _mm256_set1_epi32(0x00FFFFFF);
+        UINT64 Sum = 0;
+        UINT x = 0;
+        while (x + 8 <= Width)
+        {
+            // Each 32-bit lane gains at most 4 * 255^2 per iteration, flush to 64 bits before it can overflow.
+            __m256i LaneSums = _mm256_setzero_si256();
+            for (UINT i = 0; i < 1024 && x + 8 <= Width; ++i, x += 8)
+            {
+                __m256i PA = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(A + x)), ColorMask);
+                __m256i PB = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(B + x)), ColorMask);
+                __m256i DLo = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(PA)),
+                                               _mm256_cvtepu8_epi16(_mm256_castsi256_si128(PB)));
+                __m256i DHi = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(PA, 1)),
+                                               _mm256_cvtepu8_epi16(_mm256_extracti128_si256(PB, 1)));
+                LaneSums = _mm256_add_epi32(LaneSums, _mm256_madd_epi16(DLo, DLo));
+                LaneSums = _mm256_add_epi32(LaneSums, _mm256_madd_epi16(DHi, DHi));
+            }
+
+            alignas(32) UINT32 Lanes[8];
+            _mm256_store_si256((__m256i*)Lanes, LaneSums);
+            for (UINT i = 0; i < 8; ++i)
+            {
+                Sum += Lanes[i];
+            }
+        }
+
+        for (; x < Width; ++x)
+        {
+            for (UINT c = 0; c < 3; ++c)
+            {
+                INT Difference = (INT)((A[x] >> (8 * c)) & 0xFF) - (INT)((B[x] >> (8 * c)) & 0xFF);
+                Sum += (UINT64)(Difference * Difference);
+            }
+        }
+        return Sum;
+    }
+
+    double ComputePSNR(const Image& Reference, const Image& Test, const Settings& InSettings)
+    {
+        assert(Reference.Width == Test.Width && Reference.Height == Test.Height);
+
+        std::vector<double> RowSums(Reference.Height);
+        Threading::ParallelFor(Reference.Height, InSettings.NumThreads, RowGrainSize, [&](UINT Begin, UINT End)
+        {
+            for (UINT y = Begin; y < End; ++y)
+            {
+                size_t RowStart = (size_t)y * Reference.Width;
+                RowSums[y] = (double)SquaredErrorRow(&Reference.Pixels[RowStart], &Test.Pixels[RowStart], Reference.Width);
+            }
+        });
+
+        double MSE = SumRows(RowSums) / ((double)Reference.Width * Reference.Height * 3.0);
+        if (MSE == 0.0)
+        {
+            return INFINITY;
+        }
+        return 10.0 * log10(255.0 * 255.0 / MSE);
+    }
+
+    // Sums the (2 * Radius + 1)^2 window around every pixel with replicated edges, in place.
+    static void BoxSum(float* Plane, float* Temp, UINT Width, UINT Height, UINT Radius, UINT NumThreads)
+    {
+        // Horizontal.
+        Threading::ParallelFor(Height, NumThreads, RowGrainSize, [&](UINT Begin, UINT End)
+        {
+            std::vector<float> Padded(Width + 2 * Radius);
+            for (UINT y = Begin; y < End; ++y)
+            {
+                const float* Row = Plane + (size_t)y * Width;
+                for (UINT i = 0; i < Width + 2 * Radius; ++i)
+                {
+                    INT Source = (INT)i - (INT)Radius;
+                    Source = Source < 0 ? 0 : (Source >= (INT)Width ? (INT)Width - 1 : Source);
+                    Padded[i] = Row[Source];
+                }
+
+                float* OutRow = Temp + (size_t)y * Width;
+                UINT x = 0;
+                for (; x + 8 <= Width; x += 8)
+                {
+                    __m256 Sum = _mm256_setzero_ps();
+                    for (UINT k = 0; k <= 2 * Radius; ++k)
+                    {
+                        Sum = _mm256_add_ps(Sum, _mm256_loadu_ps(&Padded[x + k]));
+                    }
+                    _mm256_storeu_ps(OutRow + x, Sum);
+                }
+                for (; x < Width; ++x)
+                {
+                    float Sum = 0.f;
+                    for (UINT k = 0; k <= 2 * Radius; ++k)
+                    {
+                        Sum += Padded[x + k];
+                    }
+                    OutRow[x] = Sum;
+                }
+            }
+        });
+
+        // Vertical.
+        Threading::ParallelFor(Height, NumThreads, RowGrainSize, [&](UINT Begin, UINT End)
+        {
+            for (UINT y = Begin; y < End; ++y)
+            {
+                float* OutRow = Plane + (size_t)y * Width;
+                UINT x = 0;
+                for (; x + 8 <= Width; x += 8)
+                {
+                    __m256 Sum = _mm256_setzero_ps();
+                    for (UINT k = 0; k <= 2 * Radius; ++k)
+                    {
+                        INT Row = (INT)y + (INT)k - (INT)Radius;
+                        Row = Row < 0 ? 0 : (Row >= (INT)Height ? (INT)Height - 1 : Row);
+                        Sum = _mm256_add_ps(Sum, _mm256_loadu_ps(Temp + (size_t)Row * Width + x));
+                    }
+                    _mm256_storeu_ps(OutRow + x, Sum);
+                }
+                for (; x < Width; ++x)
+                {
+                    float Sum = 0.f;
+                    for (UINT k = 0; k <= 2 * Radius; ++k)
+                    {
+                        INT Row = (INT)y + (INT)k - (INT)Radius;
+                        Row = Row < 0 ? 0 : (Row >= (INT)Height ? (INT)Height - 1 : Row);
+                        Sum += Temp[(size_t)Row * Width + x];
+                    }
+                    OutRow[x] = Sum;
+                }
+            }
+        });
+    }
+
+    // Rec. 601 luma of 8 RGBA8 pixels.
+    static __m256 LoadLuma8(const UINT32* Pixels)
+    {
+        const __m256i ByteMask = _mm256_set1_epi32(0xFF);
+        __m256i P = _mm256_loadu_si256((const __m256i*)Pixels);
+        __m256 R = _mm256_cvtepi32_ps(_mm256_and_si256(P, ByteMask));
+        __m256 G = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(P, 8), ByteMask));
+        __m256 B = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(P, 16), ByteMask));
+        return _mm256_fmadd_ps(R, _mm256_set1_ps(0.299f),
+                               _mm256_fmadd_ps(G, _mm256_set1_ps(0.587f), _mm256_mul_ps(B, _mm256_set1_ps(0.114f))));
+    }
+
+    static float LoadLuma(UINT32 Pixel)
+    {
+        return 0.299f * (float)(Pixel & 0xFF) + 0.587f * (float)((Pixel >> 8) & 0xFF) + 0.114f * (float)((Pixel >> 16) & 0xFF);
+    }
+
+    double ComputeSSIM(const Image& Reference, const Image& Test, const Settings& InSettings, ErrorMap* OutMap)
+    {
+        assert(Reference.Width == Test.Width && Reference.Height == Test.Height);
+        UINT Width = Reference.Width;
+        UINT Height = Reference.Height;
+        size_t NumPixels = (size_t)Width * Height;
+
+        // Luma of both images and their second moments.
+        std::vector<float> X(NumPixels), Y(NumPixels), XX(NumPixels), YY(NumPixels), XY(NumPixels), Temp(NumPixels);
+        Threading::ParallelFor(Height, InSettings.NumThreads, RowGrainSize, [&](UINT Begin, UINT End)
+        {
+            for (size_t i = (size_t)Begin * Width; i < (size_t)End * Width;)
+            {
+                if (i + 8 <= (size_t)End * Width)
+                {
+                    __m256 LX = LoadLuma8(&Reference.Pixels[i]);
+                    __m256 LY = LoadLuma8(&Test.Pixels[i]);
+                    _mm256_storeu_ps(&X[i], LX);
+                    _mm256_storeu_ps(&Y[i], LY);
+                    _mm256_storeu_ps(&XX[i], _mm256_mul_ps(LX, LX));
+                    _mm256_storeu_ps(&YY[i], _mm256_mul_ps(LY, LY));
+                    _mm256_storeu_ps(&XY[i], _mm256_mul_ps(LX, LY));
+                    i += 8;
+                }
+                else
+                {
+                    X[i] = LoadLuma(Reference.Pixels[i]);
+                    Y[i] = LoadLuma(Test.Pixels[i]);
+                    XX[i] = X[i] * X[i];
+                    YY[i] = Y[i] * Y[i];
+                    XY[i] = X[i] * Y[i];
+                    ++i;
+                }
+            }
+        });
+
+        float* Planes[5] = {X.data(), Y.data(), XX.data(), YY.data(), XY.data()};
+        for (float* Plane : Planes)
+        {
+            BoxSum(Plane, Temp.data(), Width, Height, SSIMRadius, InSettings.NumThreads);
+        }
+
+        if (OutMap)
+        {
+            InitializeMap(OutMap, Reference);
+        }
+
+        const float InvWindowSize = 1.f / (float)((2 * SSIMRadius + 1) * (2 * SSIMRadius + 1));
+        const float C1 = (0.01f * 255.f) * (0.01f * 255.f);
+        const float C2 = (0.03f * 255.f) * (0.03f * 255.f);
+        std::vector<double> RowSums(Height);
+        Threading::ParallelFor(Height, InSettings.NumThreads, RowGrainSize, [&](UINT Begin, UINT End)
+        {
+            const __m256 InvN = _mm256_set1_ps(InvWindowSize);
+            const __m256 Two = _mm256_set1_ps(2.f);
+            const __m256 VC1 = _mm256_set1_ps(C1);
+            const __m256 VC2 = _mm256_set1_ps(C2);
+            for (UINT y = Begin; y < End; ++y)
+            {
+                float* Row = Temp.data() + (size_t)y * Width;
+                UINT x = 0;
+                for (; x + 8 <= Width; x += 8)
+                {
+                    size_t i = (size_t)y * Width + x;
+                    __m256 MuX = _mm256_mul_ps(_mm256_loadu_ps(&X[i]), InvN);
+                    __m256 MuY = _mm256_mul_ps(_mm256_loadu_ps(&Y[i]), InvN);
+                    __m256 MuXY = _mm256_mul_ps(MuX, MuY);
+                    __m256 MuXX = _mm256_mul_ps(MuX, MuX);
+                    __m256 MuYY = _mm256_mul_ps(MuY, MuY);
+                    __m256 SigmaXX = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(&XX[i]), InvN), MuXX);
+                    __m256 SigmaYY = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(&YY[i]), InvN), MuYY);
+                    __m256 SigmaXY = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(&XY[i]), InvN), MuXY);
+                    __m256 Numerator = _mm256_mul_ps(_mm256_fmadd_ps(Two, MuXY, VC1), _mm256_fmadd_ps(Two, SigmaXY, VC2));
+                    __m256 Denominator = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(MuXX, MuYY), VC1),
+                                                       _mm256_add_ps(_mm256_add_ps(SigmaXX, SigmaYY), VC2));
+                    _mm256_storeu_ps(Row + x, _mm256_div_ps(Numerator, Denominator));
+                }
+                for (; x < Width; ++x)
+                {
+                    size_t i = (size_t)y * Width + x;
+                    float MuX = X[i] * InvWindowSize;
+                    float MuY = Y[i] * InvWindowSize;
+                    float SigmaXX = XX[i] * InvWindowSize - MuX * MuX;
+                    float SigmaYY = YY[i] * InvWindowSize - MuY * MuY;
+                    float SigmaXY = XY[i] * InvWindowSize - MuX * MuY;
+                    Row[x] = ((2.f * MuX * MuY + C1) * (2.f * SigmaXY + C2)) /
+                        ((MuX * MuX + MuY * MuY + C1) * (SigmaXX + SigmaYY + C2));
+                }
+
+                double RowSum = 0.0;
+                for (x = 0; x < Width; ++x)
+                {
+                    RowSum += Row[x];
+                    if (OutMap)
+                    {
+                        float Error = 1.f - Row[x];
+                        OutMap->Values[(size_t)y * Width + x] = Error < 0.f ? 0.f : (Error > 1.f ? 1.f : Error);
+                    }
+                }
+                RowSums[y] = RowSum;
+            }
+        });
+
+        return SumRows(RowSums) / (double)NumPixels;
+    }
+
+    // FLIP-style error. The CSF Gaussians are approximated with box filters and the feature detectors
+    // with Sobel/Laplacian stencils, see "FLIP: A Difference Evaluator for Alternating Images" (Andersson et al. 2020).
+    static const float ReferenceWhite[3] = {0.950428545f, 1.f, 1.088900371f}; // D65.
+
+    static void LinearRGBToXYZ(const float* RGB, float* XYZ)
+    {
+        XYZ[0] = 0.4124564f * RGB[0] + 0.3575761f * RGB[1] + 0.1804375f * RGB[2];
+        XYZ[1] = 0.2126729f * RGB[0] + 0.7151522f * RGB[1] + 0.0721750f * RGB[2];
+        XYZ[2] = 0.0193339f * RGB[0] + 0.1191920f * RGB[1] + 0.9503041f * RGB[2];
+    }
+
+    static void XYZToLinearRGB(const float* XYZ, float* RGB)
+    {
+        RGB[0] = 3.2404542f * XYZ[0] - 1.5371385f * XYZ[1] - 0.4985314f * XYZ[2];
+        RGB[1] = -0.9692660f * XYZ[0] + 1.8760108f * XYZ[1] + 0.0415560f * XYZ[2];
+        RGB[2] = 0.0556434f * XYZ[0] - 0.2040259f * XYZ[1] + 1.0572252f * XYZ[2];
+    }
+
+    static float LabF(float T)
+    {
+        const float Delta = 6.f / 29.f;
+        return T > Delta * Delta * Delta ? cbrtf(T) : T / (3.f * Delta * Delta) + 4.f / 29.f;
+    }
+
+    // cbrtf dominates the per-pixel cost, so the Lab transfer function is tabulated over the
+    // range reachable from clamped linear RGB. Linear interpolation keeps the error below 1e-5.
+    static const UINT LabTableSize = 4096;
+    static const float LabTableMax = 1.1f;
+
+    struct LabTable
+    {
+        float Values[LabTableSize + 1];
+
+        LabTable()
+        {
+            for (UINT i = 0; i <= LabTableSize; ++i)
+            {
+                Values[i] = LabF((float)i * LabTableMax / (float)LabTableSize);
+            }
+        }
+    };
+
+    static float FastLabF(float T)
+    {
+        static const LabTable Table;
+        float Position = T * ((float)LabTableSize / LabTableMax);
+        if (Position <= 0.f || Position >= (float)LabTableSize)
+        {
+            return LabF(T);
+        }
+        UINT Index = (UINT)Position;
+        float Fraction = Position - (float)Index;
+        return Table.Values[Index] + (Table.Values[Index + 1] - Table.Values[Index]) * Fraction;
+    }
+
+    // Hunt-adjusted CIELab.
+    static void LinearRGBToHuntLab(const float* RGB, float* Lab)
+    {
+        float XYZ[3];
+        LinearRGBToXYZ(RGB, XYZ);
+        float FX = FastLabF(XYZ[0] / ReferenceWhite[0]);
+        float FY = FastLabF(XYZ[1] / ReferenceWhite[1]);
+        float FZ = FastLabF(XYZ[2] / ReferenceWhite[2]);
+        Lab[0] = 116.f * FY - 16.f;
+        Lab[1] = 0.01f * Lab[0] * 500.f * (FX - FY);
+        Lab[2] = 0.01f * Lab[0] * 200.f * (FY - FZ);
+    }
+
+    static float HyAB(const float* A, const float* B)
+    {
+        float DA = A[1] - B[1];
+        float DB = A[2] - B[2];
+        return fabsf(A[0] - B[0]) + sqrtf(DA * DA + DB * DB);
+    }
+
+    static void BuildSrgbToLinearTable(float* Table)
+    {
+        for (UINT i = 0; i < 256; ++i)
+        {
+            float C = (float)i / 255.f;
+            Table[i] = C <= 0.04045f ? C / 12.92f : powf((C + 0.055f) / 1.055f, 2.4f);
+        }
+    }
+
+    // YCxCz opponent planes and the normalized luminance used by the feature detectors.
+    static void ToOpponentSpace(const Image& InImage, const float* SrgbToLinear, float* Planes[3], float* Luminance, UINT NumThreads)
+    {
+        UINT Width = InImage.Width;
+        Threading::ParallelFor(InImage.Height, NumThreads, RowGrainSize, [&](UINT Begin, UINT End)
+        {
+            for (size_t i = (size_t)Begin * Width; i < (size_t)End * Width; ++i)
+            {
+                UINT32 Pixel = InImage.Pixels[i];
+                float RGB[3] = {SrgbToLinear[Pixel & 0xFF], SrgbToLinear[(Pixel >> 8) & 0xFF], SrgbToLinear[(Pixel >> 16) & 0xFF]};
+                float XYZ[3];
+                LinearRGBToXYZ(RGB, XYZ);
+                float X = XYZ[0] / ReferenceWhite[0];
+                float Y = XYZ[1] / ReferenceWhite[1];
+                float Z = XYZ[2] / ReferenceWhite[2];
+                Planes[0][i] = 116.f * Y - 16.f;
+                Planes[1][i] = 500.f * (X - Y);
+                Planes[2][i] = 200.f * (Y - Z);
+                Luminance[i] = (116.f * FastLabF(Y) - 16.f) / 100.f;
+            }
+        });
+    }
+
+    static void FeatureResponse(const float* Luminance, UINT Width, UINT Height, UINT x, UINT y, float* OutEdge, float* OutPoint)
+    {
+        auto At = [&](INT DX, INT DY)
+        {
+            INT SX = (INT)x + DX;
+            INT SY = (INT)y + DY;
+            SX = SX < 0 ? 0 : (SX >= (INT)Width ? (INT)Width - 1 : SX);
+            SY = SY < 0 ? 0 : (SY >= (INT)Height ? (INT)Height - 1 : SY);
+            return Luminance[(size_t)SY * Width + SX];
+        };
+
+        float GX = (At(1, -1) + 2.f * At(1, 0) + At(1, 1)) - (At(-1, -1) + 2.f * At(-1, 0) + At(-1, 1));
+        float GY = (At(-1, 1) + 2.f * At(0, 1) + At(1, 1)) - (At(-1, -1) + 2.f * At(0, -1) + At(1, -1));
+        *OutEdge = sqrtf(GX * GX + GY * GY) * 0.25f;
+        *OutPoint = fabsf(4.f * At(0, 0) - At(-1, 0) - At(1, 0) - At(0, -1) - At(0, 1)) * 0.25f;
+    }
+
+    static void EdgeAndPoint8(const float* Center, UINT Width, __m256* OutEdge, __m256* OutPoint)
+    {
+        const float* Up = Center - Width;
+        const float* Down = Center + Width;
+        const __m256 Two = _mm256_set1_ps(2.f);
+        const __m256 Quarter = _mm256_set1_ps(0.25f);
+        const __m256 SignMask = _mm256_set1_ps(-0.f);
+
+        __m256 UpLeft = _mm256_loadu_ps(Up - 1), UpMid = _mm256_loadu_ps(Up), UpRight = _mm256_loadu_ps(Up + 1);
+        __m256 Left = _mm256_loadu_ps(Center - 1), Mid = _mm256_loadu_ps(Center), Right = _mm256_loadu_ps(Center + 1);
+        __m256 DownLeft = _mm256_loadu_ps(Down - 1), DownMid = _mm256_loadu_ps(Down), DownRight = _mm256_loadu_ps(Down + 1);
+
+        __m256 GX = _mm256_sub_ps(_mm256_add_ps(_mm256_fmadd_ps(Two, Right, UpRight), DownRight),
+                                  _mm256_add_ps(_mm256_fmadd_ps(Two, Left, UpLeft), DownLeft));
+        __m256 GY = _mm256_sub_ps(_mm256_add_ps(_mm256_fmadd_ps(Two, DownMid, DownLeft), DownRight),
+                                  _mm256_add_ps(_mm256_fmadd_ps(Two, UpMid, UpLeft), UpRight));
+        *OutEdge = _mm256_mul_ps(_mm256_sqrt_ps(_mm256_fmadd_ps(GX, GX, _mm256_mul_ps(GY, GY))), Quarter);
+
+        __m256 Laplacian = _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(4.f), Mid),
+                                         _mm256_add_ps(_mm256_add_ps(Left, Right), _mm256_add_ps(UpMid, DownMid)));
+        *OutPoint = _mm256_mul_ps(_mm256_andnot_ps(SignMask, Laplacian), Quarter);
+    }
+
+    // Largest difference in edge or point response between the two luminance planes, per pixel.
+    static void FeatureDifference(const float* ReferenceLuminance, const float* TestLuminance, UINT Width, UINT Height,
+                                  float* OutDifference, UINT NumThreads)
+    {
+        Threading::ParallelFor(Height, NumThreads, RowGrainSize, [&](UINT Begin, UINT End)
+        {
+            const __m256 SignMask = _mm256_set1_ps(-0.f);
+            for (UINT y = Begin; y < End; ++y)
+            {
+                UINT x = 0;
+                bool Interior = y > 0 && y + 1 < Height;
+                while (x < Width)
+                {
+                    size_t i = (size_t)y * Width + x;
+                    if (Interior && x > 0 && x + 9 <= Width)
+                    {
+                        __m256 ReferenceEdge, ReferencePoint, TestEdge, TestPoint;
+                        EdgeAndPoint8(ReferenceLuminance + i, Width, &ReferenceEdge, &ReferencePoint);
+                        EdgeAndPoint8(TestLuminance + i, Width, &TestEdge, &TestPoint);
+                        __m256 EdgeDifference = _mm256_andnot_ps(SignMask, _mm256_sub_ps(ReferenceEdge, TestEdge));
+                        __m256 PointDifference = _mm256_andnot_ps(SignMask, _mm256_sub_ps(ReferencePoint, TestPoint));
+                        _mm256_storeu_ps(OutDifference + i, _mm256_max_ps(EdgeDifference, PointDifference));
+                        x += 8;
+                    }
+                    else
+                    {
+                        float ReferenceEdge, ReferencePoint, TestEdge, TestPoint;
+                        FeatureResponse(ReferenceLuminance, Width, Height, x, y, &ReferenceEdge, &ReferencePoint);
+                        FeatureResponse(TestLuminance, Width, Height, x, y, &TestEdge, &TestPoint);
+                        OutDifference[i] = fmaxf(fabsf(ReferenceEdge - TestEdge), fabsf(ReferencePoint - TestPoint));
+                        ++x;
+                    }
+                }
+            }
+        });
+    }
+
+    double ComputeFLIP(const Image& Reference, const Image& Test, const Settings& InSettings, ErrorMap* OutMap)
+    {
+        assert(Reference.Width == Test.Width && Reference.Height == Test.Height);
+        UINT Width = Reference.Width;
+        UINT Height = Reference.Height;
+        size_t NumPixels = (size_t)Width * Height;
+
+        float SrgbToLinear[256];
+        BuildSrgbToLinearTable(SrgbToLinear);
+
+        std::vector<float> Storage(NumPixels * 9);
+        float* ReferencePlanes[3] = {&Storage[0], &Storage[NumPixels], &Storage[2 * NumPixels]};
+        float* TestPlanes[3] = {&Storage[3 * NumPixels], &Storage[4 * NumPixels], &Storage[5 * NumPixels]};
+        float* ReferenceLuminance = &Storage[6 * NumPixels];
+        float* TestLuminance = &Storage[7 * NumPixels];
+        float* Temp = &Storage[8 * NumPixels];
+        ToOpponentSpace(Reference, SrgbToLinear, ReferencePlanes, ReferenceLuminance, InSettings.NumThreads);
+        ToOpponentSpace(Test, SrgbToLinear, TestPlanes, TestLuminance, InSettings.NumThreads);
+
+        // Spatial filtering: the chromatic channels are blurred over a wider support than the achromatic one.
+        UINT LumaRadius = (UINT)fmaxf(1.f, roundf(InSettings.PixelsPerDegree / 67.f));
+        UINT ChromaRadius = (UINT)fmaxf(1.f, roundf(3.f * InSettings.PixelsPerDegree / 67.f));
+        for (UINT c = 0; c < 3; ++c)
+        {
+            UINT Radius = c == 0 ? LumaRadius : ChromaRadius;
+            float InvWindowSize = 1.f / (float)((2 * Radius + 1) * (2 * Radius + 1));
+            float* Planes[2] = {ReferencePlanes[c], TestPlanes[c]};
+            for (float* Plane : Planes)
+            {
+                BoxSum(Plane, Temp, Width, Height, Radius, InSettings.NumThreads);
+                for (size_t i = 0; i < NumPixels; ++i)
+                {
+                    Plane[i] *= InvWindowSize;
+                }
+            }
+        }
+
+        // The unfiltered luminance drives the feature detectors, the temporary plane is free again after filtering.
+        float* FeatureDifferences = Temp;
+        FeatureDifference(ReferenceLuminance, TestLuminance, Width, Height, FeatureDifferences, InSettings.NumThreads);
+
+        // Largest Hunt-adjusted HyAB distance between two colors in the sRGB gamut (green vs blue).
+        const float Green[3] = {0.f, 1.f, 0.f};
+        const float Blue[3] = {0.f, 0.f, 1.f};
+        float GreenLab[3], BlueLab[3];
+        LinearRGBToHuntLab(Green, GreenLab);
+        LinearRGBToHuntLab(Blue, BlueLab);
+        const float MaxColorError = powf(HyAB(GreenLab, BlueLab), 0.7f);
+        const float ColorCutoff = 0.4f;
+        const float ColorCutoffRemap = 0.95f;
+
+        if (OutMap)
+        {
+            InitializeMap(OutMap, Reference);
+        }
+
+        std::vector<double> RowSums(Height);
+        Threading::ParallelFor(Height, InSettings.NumThreads, RowGrainSize, [&](UINT Begin, UINT End)
+        {
+            for (UINT y = Begin; y < End; ++y)
+            {
+                double RowSum = 0.0;
+                for (UINT x = 0; x < Width; ++x)
+                {
+                    size_t i = (size_t)y * Width + x;
+                    float Lab[2][3];
+                    float* const* Planes[2] = {ReferencePlanes, TestPlanes};
+                    for (UINT Img = 0; Img < 2; ++Img)
+                    {
+                        float Y = (Planes[Img][0][i] + 16.f) / 116.f;
+                        float XYZ[3] = {
+                            (Planes[Img][1][i] / 500.f + Y) * ReferenceWhite[0],
+                            Y * ReferenceWhite[1],
+                            (Y - Planes[Img][2][i] / 200.f) * ReferenceWhite[2]
+                        };
+                        float RGB[3];
+                        XYZToLinearRGB(XYZ, RGB);
+                        for (UINT c = 0; c < 3; ++c)
+                        {
+                            RGB[c] = RGB[c] < 0.f ? 0.f : (RGB[c] > 1.f ? 1.f : RGB[c]);
+                        }
+                        LinearRGBToHuntLab(RGB, Lab[Img]);
+                    }
+
+                    // Color difference, remapped so small errors are compressed into the lower range.
+                    float ColorError = powf(HyAB(Lab[0], Lab[1]), 0.7f);
+                    if (ColorError < ColorCutoff * MaxColorError)
+                    {
+                        ColorError = ColorCutoffRemap / (ColorCutoff * MaxColorError) * ColorError;
+                    }
+                    else
+                    {
+                        ColorError = ColorCutoffRemap + (ColorError - ColorCutoff * MaxColorError) /
+                            (MaxColorError - ColorCutoff * MaxColorError) * (1.f - ColorCutoffRemap);
+                    }
+
+                    float FeatureError = sqrtf(fminf(1.f, FeatureDifferences[i] / sqrtf(2.f)));
+
+                    float Error = fminf(1.f, ColorError);
+                    if (FeatureError > 0.f)
+                    {
+                        Error = powf(Error, 1.f - FeatureError);
+                    }
+                    RowSum += Error;
+                    if (OutMap)
+                    {
+                        OutMap->Values[i] = Error;
+                    }
+                }
+                RowSums[y] = RowSum;
+            }
+        });
+
+        return SumRows(RowSums) / (double)NumPixels;
+    }
+
+    static UINT32 NextRandom(UINT32* State)
+    {
+        *State = *State * 1664525u + 1013904223u;
+        return *State >> 8;
+    }
+
+    static float GetMaxError(const ErrorMap& Map)
+    {
+        float Max = Map.Values.empty() ? -1.f : 0.f;
+        for (float Value : Map.Values)
+        {
+            Max = Value > Max ? Value : Max;
+        }
+        return Max;
+    }
+
+    bool RunTest(UINT Width, UINT Height)
+    {
+        // Channels stay in [16, 240) so the offset below never clamps.
+        const INT Offset = 5;
+        UINT32 Random = 0x13579BDF;
+        Image Reference;
+        Reference.Width = Width;
+        Reference.Height = Height;
+        Reference.Pixels.resize((size_t)Width * Height);
+        for (UINT32& Pixel : Reference.Pixels)
+        {
+            Pixel = 0xFF000000;
+            for (UINT c = 0; c < 3; ++c)
+            {
+                Pixel |= (16 + NextRandom(&Random) % 224) << (8 * c);
+            }
+        }
+
+        // Every channel Offset brighter or darker, so the mean squared error is Offset^2.
+        Image Perturbed = Reference;
+        for (size_t i = 0; i < Perturbed.Pixels.size(); ++i)
+        {
+            UINT32 Pixel = 0xFF000000;
+            for (UINT c = 0; c < 3; ++c)
+            {
+                INT Channel = (INT)((Reference.Pixels[i] >> (8 * c)) & 0xFF) + (i % 2 == 0 ? Offset : -Offset);
+                Pixel |= (UINT32)Channel << (8 * c);
+            }
+            Perturbed.Pixels[i] = Pixel;
+        }
+        const double ExpectedPSNR = 20.0 * log10(255.0 / Offset);
+
+        UINT NumErrors = 0;
+        double Scores[2][2][3]; // Identical and perturbed, at each thread count: PSNR, SSIM and FLIP.
+        const UINT ThreadCounts[2] = {1, 8};
+        for (UINT t = 0; t < _countof(ThreadCounts); ++t)
+        {
+            Settings TestSettings;
+            TestSettings.NumThreads = ThreadCounts[t];
+            ErrorMap SSIMMap, FLIPMap;
+            Scores[0][t][0] = ComputePSNR(Reference, Reference, TestSettings);
+            Scores[0][t][1] = ComputeSSIM(Reference, Reference, TestSettings, &SSIMMap);
+            Scores[0][t][2] = ComputeFLIP(Reference, Reference, TestSettings, &FLIPMap);
+            // SSIM's float windows leave rounding error.
+            float MaxSSIMError = GetMaxError(SSIMMap);
+            NumErrors += !(MaxSSIMError >= 0.f && MaxSSIMError < 1e-5f) || GetMaxError(FLIPMap) != 0.f;
+
+            Scores[1][t][0] = ComputePSNR(Reference, Perturbed, TestSettings);
+            Scores[1][t][1] = ComputeSSIM(Reference, Perturbed, TestSettings, &SSIMMap);
+            Scores[1][t][2] = ComputeFLIP(Reference, Perturbed, TestSettings, &FLIPMap);
+            NumErrors += !(GetMaxError(SSIMMap) > 1e-3f) || !(GetMaxError(FLIPMap) > 1e-3f);
+        }
+
+        const double* Identical = Scores[0][0];
+        const double* Different = Scores[1][0];
+        NumErrors += !isinf(Identical[0]) || fabs(Identical[1] - 1.0) > 1e-6 || Identical[2] != 0.0;
+        NumErrors += fabs(Different[0] - ExpectedPSNR) > 1e-9;
+        NumErrors += !(Different[1] < 1.0 - 1e-3) || !(Different[2] > 1e-3 && Different[2] <= 1.0);
+        NumErrors += memcmp(Scores[0][0], Scores[0][1], sizeof(Scores[0][0])) != 0;
+        NumErrors += memcmp(Scores[1][0], Scores[1][1], sizeof(Scores[1][0])) != 0;
+
+        bool Passed = NumErrors == 0;
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "ImageCompare: test %s, %ux%u, offset by %d: PSNR %.3f dB (expected %.3f), SSIM %.5f, FLIP %.5f, "
+                 "%u errors\n",
+                 Passed ? "passed" : "FAILED", Width, Height, Offset, Different[0], ExpectedPSNR, Different[1],
+                 Different[2], NumErrors);
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+}
@@ -0,0 +1,395 @@
+#include "Headers/InstanceTransforms.h"
+#include "Headers/Threading.h"
+#include <algorithm>
+#include <chrono>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <immintrin.h>
+
+namespace InstanceTransforms
+{
+    void Resize(Instances* InInstances, UINT NumInstances)
+    {
+        InInstances->PositionX.resize(NumInstances, 0.f);
+        InInstances->PositionY.resize(NumInstances, 0.f);
+        InInstances->PositionZ.resize(NumInstances, 0.f);
+        InInstances->RotationX.resize(NumInstances, 0.f);
+        InInstances->RotationY.resize(NumInstances, 0.f);
+        InInstances->RotationZ.resize(NumInstances, 0.f);
+        InInstances->RotationW.resize(NumInstances, 1.f);
+        InInstances->ScaleX.resize(NumInstances, 1.f);
+        InInstances->ScaleY.resize(NumInstances, 1.f);
+        InInstances->ScaleZ.resize(NumInstances, 1.f);
+        InInstances->Tails.resize(NumInstances, InstanceTail{});
+    }
+
+    InstanceTail MakeTail(UINT InstanceId, UINT InstanceMask, UINT HitGroupContribution, UINT Flags,
+                          UINT64 AccelerationStructure)
+    {
+        InstanceTail Tail;
+        Tail.InstanceIdAndMask = (InstanceId & 0xFFFFFF) | (InstanceMask << 24);
+        Tail.ContributionAndFlags = (HitGroupContribution & 0xFFFFFF) | (Flags << 24);
+        Tail.AccelerationStructure = AccelerationStructure;
+        return Tail;
+    }
+
+    void SetInstanceMask(InstanceTail* Tail, UINT InstanceMask)
+    {
+        Tail->InstanceIdAndMask = (Tail->InstanceIdAndMask & 0xFFFFFF) | (InstanceMask << 24);
+    }
+
+    void GetTransform(const Instances& InInstances, UINT Index, float OutTransform[3][4])
+    {
+        float X = InInstances.RotationX[Index];
+        float Y = InInstances.RotationY[Index];
+        float Z = InInstances.RotationZ[Index];
+        float W = InInstances.RotationW[Index];
+        float Scale[3] = {InInstances.ScaleX[Index], InInstances.ScaleY[Index], InInstances.ScaleZ[Index]};
+
+        float Rotation[3][3] = {
+            {1.f - 2.f * (Y * Y + Z * Z), 2.f * (X * Y - W * Z), 2.f * (X * Z + W * Y)},
+            {2.f * (X * Y + W * Z), 1.f - 2.f * (X * X + Z * Z), 2.f * (Y * Z - W * X)},
+            {2.f * (X * Z - W * Y), 2.f * (Y * Z + W * X), 1.f - 2.f * (X * X + Y * Y)}
+        };
+        for (UINT Row = 0; Row < 3; ++Row)
+        {
+            for (UINT Column = 0; Column < 3; ++Column)
+            {
+                OutTransform[Row][Column] = Rotation[Row][Column] * Scale[Column];
+            }
+        }
+        OutTransform[0][3] = InInstances.PositionX[Index];
+        OutTransform[1][3] = InInstances.PositionY[Index];
+        OutTransform[2][3] = InInstances.PositionZ[Index];
+    }
+
+    // Lane i of A, B, C, D to the low half of Out[i] for i < 4, the high half of Out[i - 4] otherwise.
+    static void Transpose4x8(__m256 A, __m256 B, __m256 C, __m256 D, __m256 Out[4])
+    {
+        __m256 AB0 = _mm256_unpacklo_ps(A, B);
+        __m256 AB1 = _mm256_unpackhi_ps(A, B);
+        __m256 CD0 = _mm256_unpacklo_ps(C, D);
+        __m256 CD1 = _mm256_unpackhi_ps(C, D);
+        Out[0] = _mm256_shuffle_ps(AB0, CD0, _MM_SHUFFLE(1, 0, 1, 0));
+        Out[1] = _mm256_shuffle_ps(AB0, CD0, _MM_SHUFFLE(3, 2, 3, 2));
+        Out[2] = _mm256_shuffle_ps(AB1, CD1, _MM_SHUFFLE(1, 0, 1, 0));
+        Out[3] = _mm256_shuffle_ps(AB1, CD1, _MM_SHUFFLE(3, 2, 3, 2));
+    }
+
+    // Eight consecutive instances from First, or gathered from Indices when it isn't null.
+    static __m256 Load(const std::vector<float>& Values, UINT First, const UINT* Indices)
+    {
+        if (Indices != nullptr)
+        {
+            return _mm256_i32gather_ps(Values.data(), _mm256_loadu_si256((const __m256i*)Indices), 4);
+        }
+        return _mm256_loadu_ps(&Values[First]);
+    }
+
+    static void WriteBatch(const Instances& InInstances, UINT First, const UINT* Indices, InstanceDesc* Dest)
+    {
+        const __m256 One = _mm256_set1_ps(1.f);
+        const __m256 Two = _mm256_set1_ps(2.f);
+
+        __m256 X = Load(InInstances.RotationX, First, Indices);
+        __m256 Y = Load(InInstances.RotationY, First, Indices);
+        __m256 Z = Load(InInstances.RotationZ, First, Indices);
+        __m256 W = Load(InInstances.RotationW, First, Indices);
+        __m256 ScaleX = Load(InInstances.ScaleX, First, Indices);
+        __m256 ScaleY = Load(InInstances.ScaleY, First, Indices);
+        __m256 ScaleZ = Load(InInstances.ScaleZ, First, Indices);
+
+        __m256 X2 = _mm256_mul_ps(X, Two);
+        __m256 Y2 = _mm256_mul_ps(Y, Two);
+        __m256 Z2 = _mm256_mul_ps(Z, Two);
+        __m256 XX = _mm256_mul_ps(X, X2);
+        __m256 YY = _mm256_mul_ps(Y, Y2);
+        __m256 ZZ = _mm256_mul_ps(Z, Z2);
+        __m256 XY = _mm256_mul_ps(X, Y2);
+        __m256 XZ = _mm256_mul_ps(X, Z2);
+        __m256 YZ = _mm256_mul_ps(Y, Z2);
+        __m256 WX = _mm256_mul_ps(W, X2);
+        __m256 WY = _mm256_mul_ps(W, Y2);
+        __m256 WZ = _mm256_mul_ps(W, Z2);
+
+        // Rotation columns scaled per axis, translation in the last column.
+        __m256 M00 = _mm256_mul_ps(_mm256_sub_ps(One, _mm256_add_ps(YY, ZZ)), ScaleX);
+        __m256 M01 = _mm256_mul_ps(_mm256_sub_ps(XY, WZ), ScaleY);
+        __m256 M02 = _mm256_mul_ps(_mm256_add_ps(XZ, WY), ScaleZ);
+        __m256 M03 = Load(InInstances.PositionX, First, Indices);
+        __m256 M10 = _mm256_mul_ps(_mm256_add_ps(XY, WZ), ScaleX);
+        __m256 M11 = _mm256_mul_ps(_mm256_sub_ps(One, _mm256_add_ps(XX, ZZ)), ScaleY);
+        __m256 M12 = _mm256_mul_ps(_mm256_sub_ps(YZ, WX), ScaleZ);
+        __m256 M13 = Load(InInstances.PositionY, First, Indices);
+        __m256 M20 = _mm256_mul_ps(_mm256_sub_ps(XZ, WY), ScaleX);
+        __m256 M21 = _mm256_mul_ps(_mm256_add_ps(YZ, WX), ScaleY);
+        __m256 M22 = _mm256_mul_ps(_mm256_sub_ps(One, _mm256_add_ps(XX, YY)), ScaleZ);
+        __m256 M23 = Load(InInstances.PositionZ, First, Indices);
+
+        __m256 Rows0[4];
+        __m256 Rows1[4];
+        __m256 Rows2[4];
+        Transpose4x8(M00, M01, M02, M03, Rows0);
+        Transpose4x8(M10, M11, M12, M13, Rows1);
+        Transpose4x8(M20, M21, M22, M23, Rows2);
+
+        const InstanceTail* Tails = InInstances.Tails.data();
+        for (UINT i = 0; i < 4; ++i)
+        {
+            UINT Instance = Indices != nullptr ? Indices[i] : First + i;
+            UINT InstanceHigh = Indices != nullptr ? Indices[i + 4] : First + i + 4;
+            // Instance i in the low halves, instance i + 4 in the high halves.
+            __m256 Low = _mm256_permute2f128_ps(Rows0[i], Rows1[i], 0x20);
+            __m256 High = _mm256_permute2f128_ps(Rows0[i], Rows1[i], 0x31);
+            __m128 Tail = _mm_loadu_ps((const float*)&Tails[Instance]);
+            __m128 TailHigh = _mm_loadu_ps((const float*)&Tails[InstanceHigh]);
+            __m256 LowRest = _mm256_insertf128_ps(Rows2[i], Tail, 1);
+            __m256 HighRest = _mm256_permute2f128_ps(Rows2[i], _mm256_castps128_ps256(TailHigh), 0x21);
+
+            float* LowDest = (float*)&Dest[i];
+            float* HighDest = (float*)&Dest[i + 4];
+            _mm256_stream_ps(LowDest, Low);
+            _mm256_stream_ps(LowDest + 8, LowRest);
+            _mm256_stream_ps(HighDest, High);
+            _mm256_stream_ps(HighDest + 8, HighRest);
+        }
+    }
+
+    // Instances [Begin, End), or Indices[Begin, End) when Indices isn't null, to Dest[0, End - Begin).
+    static void WriteRange(const Instances& InInstances, const UINT* Indices, UINT Begin, UINT End, InstanceDesc* Dest)
+    {
+        UINT Index = Begin;
+        for (; Index + BatchSize <= End; Index += BatchSize)
+        {
+            WriteBatch(InInstances, Index, Indices != nullptr ? Indices + Index : nullptr, Dest + (Index - Begin));
+        }
+
+        // Leftovers go through the stack so they are streamed out whole too.
+        for (; Index < End; ++Index)
+        {
+            UINT Instance = Indices != nullptr ? Indices[Index] : Index;
+            InstanceDesc Desc;
+            GetTransform(InInstances, Instance, Desc.Transform);
+            memcpy(&Desc.InstanceIdAndMask, &InInstances.Tails[Instance], sizeof(InstanceTail));
+            float* Source = (float*)&Desc;
+            float* Destination = (float*)&Dest[Index - Begin];
+            _mm256_stream_ps(Destination, _mm256_loadu_ps(Source));
+            _mm256_stream_ps(Destination + 8, _mm256_loadu_ps(Source + 8));
+        }
+    }
+
+    static void WriteParallel(const Instances& InInstances, const UINT* Indices, UINT First, UINT Count,
+                              InstanceDesc* Dest, UINT NumThreads)
+    {
+        static_assert(sizeof(InstanceDesc) == 64, "Instance descriptions are two AVX registers.");
+        static_assert(GrainSize % BatchSize == 0, "Chunks must not split batches.");
+        assert(((size_t)Dest & 31) == 0);
+
+        if (Count < ParallelThreshold || NumThreads <= 1)
+        {
+            WriteRange(InInstances, Indices, First, First + Count, Dest);
+        }
+        else
+        {
+            Threading::ParallelFor(Count, NumThreads, GrainSize, [&](UINT Begin, UINT End)
+            {
+                WriteRange(InInstances, Indices, First + Begin, First + End, Dest + Begin);
+            });
+        }
+
+        // Streaming stores are weakly ordered, make them visible before anything reads Dest.
+        _mm_sfence();
+    }
+
+    void Write(const Instances& InInstances, UINT First, UINT Count, InstanceDesc* Dest, UINT NumThreads)
+    {
+        WriteParallel(InInstances, nullptr, First, Count, Dest, NumThreads);
+    }
+
+    void WriteIndexed(const Instances& InInstances, const UINT* Indices, UINT Count, InstanceDesc* Dest,
+                      UINT NumThreads)
+    {
+        WriteParallel(InInstances, Indices, 0, Count, Dest, NumThreads);
+    }
+
+    static UINT32 NextRandom(UINT32* State)
+    {
+        *State = *State * 1664525u + 1013904223u;
+        return *State >> 8;
+    }
+
+    static float RandomFloat(UINT32* State, float Min, float Max)
+    {
+        return Min + (Max - Min) * (float)NextRandom(State) / (float)(1u << 24);
+    }
+
+    // Counts the instance descriptions in Dest[0, Count) that differ from GetTransform and the tail of the instances
+    // listed by Indices, or of [First, First + Count).
+    static UINT CountMismatches(const Instances& InInstances, UINT First, const UINT* Indices, UINT Count,
+                                const InstanceDesc* Dest)
+    {
+        UINT NumMismatches = 0;
+        for (UINT i = 0; i < Count; ++i)
+        {
+            UINT Instance = Indices != nullptr ? Indices[i] : First + i;
+            float Expected[3][4];
+            GetTransform(InInstances, Instance, Expected);
+            const float Scale[3] = {InInstances.ScaleX[Instance], InInstances.ScaleY[Instance],
+                                    InInstances.ScaleZ[Instance]};
+            bool Matches = memcmp(&Dest[i].InstanceIdAndMask, &InInstances.Tails[Instance], sizeof(InstanceTail)) == 0;
+            for (UINT Row = 0; Row < 3; ++Row)
+            {
+                // Rotated and scaled entries are at most their column's scale, with FMA the rounding may differ.
+                for (UINT Column = 0; Column < 3; ++Column)
+                {
+                    float Tolerance = MaxUlps * FLT_EPSILON * fabsf(Scale[Column]);
+                    Matches &= fabsf(Dest[i].Transform[Row][Column] - Expected[Row][Column]) <= Tolerance;
+                }
+                Matches &= Dest[i].Transform[Row][3] == Expected[Row][3]; // Copied.
+            }
+            NumMismatches += !Matches;
+        }
+        return NumMismatches;
+    }
+
+    bool RunTest(UINT NumInstances)
+    {
+        UINT32 Random = 0x1F2E3D4C;
+        Instances Test;
+        Resize(&Test, NumInstances);
+        for (UINT i = 0; i < NumInstances; ++i)
+        {
+            Test.PositionX[i] = RandomFloat(&Random, -1000.f, 1000.f);
+            Test.PositionY[i] = RandomFloat(&Random, -1000.f, 1000.f);
+            Test.PositionZ[i] = RandomFloat(&Random, -1000.f, 1000.f);
+
+            float Quaternion[4];
+            float Length = 0.f;
+            do
+            {
+                Length = 0.f;
+                for (float& Component : Quaternion)
+                {
+                    Component = RandomFloat(&Random, -1.f, 1.f);
+                    Length += Component * Component;
+                }
+            } while (Length < 0.01f || Length > 1.f);
+            Length = sqrtf(Length);
+            Test.RotationX[i] = Quaternion[0] / Length;
+            Test.RotationY[i] = Quaternion[1] / Length;
+            Test.RotationZ[i] = Quaternion[2] / Length;
+            Test.RotationW[i] = Quaternion[3] / Length;
+
+            Test.ScaleX[i] = RandomFloat(&Random, 0.01f, 100.f);
+            Test.ScaleY[i] = RandomFloat(&Random, 0.01f, 100.f);
+            Test.ScaleZ[i] = RandomFloat(&Random, -100.f, -0.01f); // Mirrored.
+            Test.Tails[i] = MakeTail(NextRandom(&Random), NextRandom(&Random) & 0xFF, NextRandom(&Random),
+                                     NextRandom(&Random) & 0xFF, ((UINT64)NextRandom(&Random) << 32) | i);
+        }
+
+        // Culling results: every other instance, shuffled.
+        std::vector<UINT> Indices;
+        for (UINT i = 0; i < NumInstances; i += 2)
+        {
+            Indices.push_back(i);
+        }
+        for (UINT i = (UINT)Indices.size(); i > 1; --i)
+        {
+            std::swap(Indices[i - 1], Indices[NextRandom(&Random) % i]);
+        }
+
+        // One more description than the largest count, which has to stay untouched.
+        const UINT8 Untouched = 0xCD;
+        InstanceDesc* Dest = (InstanceDesc*)_mm_malloc(sizeof(InstanceDesc) * (NumInstances + 1), 64);
+        InstanceDesc Sentinel;
+        memset(&Sentinel, Untouched, sizeof(Sentinel));
+
+        UINT NumErrors = 0;
+        UINT NumChecked = 0;
+        const UINT Counts[] = {1, BatchSize - 1, BatchSize, BatchSize + 1, 3 * BatchSize + 5, 1001,
+                               ParallelThreshold + 3, NumInstances - 5};
+        const UINT ThreadCounts[] = {1, 4};
+        for (UINT Count : Counts)
+        {
+            for (UINT NumThreads : ThreadCounts)
+            {
+                for (UINT First = 0; First < BatchSize && Count <= NumInstances - First; First += 3)
+                {
+                    memset(Dest, Untouched, sizeof(InstanceDesc) * (NumInstances + 1));
+                    Write(Test, First, Count, Dest, NumThreads);
+                    NumErrors += CountMismatches(Test, First, nullptr, Count, Dest);
+                    NumErrors += memcmp(&Dest[Count], &Sentinel, sizeof(Sentinel)) != 0;
+                    NumChecked += Count;
+                }
+
+                UINT IndexedCount = std::min(Count, (UINT)Indices.size());
+                memset(Dest, Untouched, sizeof(InstanceDesc) * (NumInstances + 1));
+                WriteIndexed(Test, Indices.data(), IndexedCount, Dest, NumThreads);
+                NumErrors += CountMismatches(Test, 0, Indices.data(), IndexedCount, Dest);
+                NumErrors += memcmp(&Dest[IndexedCount], &Sentinel, sizeof(Sentinel)) != 0;
+                NumChecked += IndexedCount;
+            }
+        }
+        _mm_free(Dest);
+
+        bool Passed = NumErrors == 0;
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "InstanceTransforms: test %s, %u descriptions against the scalar path within %u ULPs, %u errors\n",
+                 Passed ? "passed" : "FAILED", NumChecked, MaxUlps, NumErrors);
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+
+    void RunBenchmark(UINT NumInstances, UINT NumFrames)
+    {
+        Instances Benchmark;
+        Resize(&Benchmark, NumInstances);
+        for (UINT i = 0; i < NumInstances; ++i)
+        {
+            float Angle = (float)i * 0.001f;
+            Benchmark.PositionX[i] = (float)(i % 1000);
+            Benchmark.PositionZ[i] = (float)(i / 1000);
+            Benchmark.RotationY[i] = sinf(Angle * 0.5f);
+            Benchmark.RotationW[i] = cosf(Angle * 0.5f);
+            Benchmark.ScaleX[i] = 0.5f;
+            Benchmark.Tails[i] = MakeTail(i, 0xFF, 0, 0, 0);
+        }
+
+        InstanceDesc* Dest = (InstanceDesc*)_mm_malloc(sizeof(InstanceDesc) * NumInstances, 64);
+
+        // Scalar baseline: one transform at a time, stored field by field.
+        auto Start = std::chrono::high_resolution_clock::now();
+        for (UINT Frame = 0; Frame < NumFrames; ++Frame)
+        {
+            for (UINT i = 0; i < NumInstances; ++i)
+            {
+                GetTransform(Benchmark, i, Dest[i].Transform);
+                memcpy(&Dest[i].InstanceIdAndMask, &Benchmark.Tails[i], sizeof(InstanceTail));
+            }
+        }
+        auto End = std::chrono::high_resolution_clock::now();
+        double ScalarMs = std::chrono::duration<double, std::milli>(End - Start).count() / NumFrames;
+
+        const UINT ThreadCounts[3] = {1, 8, Threading::GetNumHardwareThreads()};
+        for (UINT t = 0; t < _countof(ThreadCounts); ++t)
+        {
+            Start = std::chrono::high_resolution_clock::now();
+            for (UINT Frame = 0; Frame < NumFrames; ++Frame)
+            {
+                Write(Benchmark, 0, NumInstances, Dest, ThreadCounts[t]);
+            }
+            End = std::chrono::high_resolution_clock::now();
+            double BatchedMs = std::chrono::duration<double, std::milli>(End - Start).count() / NumFrames;
+
+            char Message[256];
+            snprintf(Message, sizeof(Message),
+                     "InstanceTransforms %u instances, %u thread(s): scalar %.2f ms, AVX2 %.2f ms (%.2fx)\n",
+                     NumInstances, ThreadCounts[t], ScalarMs, BatchedMs, ScalarMs / BatchedMs);
+            OutputDebugStringA(Message);
+        }
+
+        _mm_free(Dest);
+    }
+}
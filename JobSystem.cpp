@@ -0,0 +1,784 @@
+#include "Headers/JobSystem.h"
+#include "Headers/Threading.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace JobSystem
+{
+    struct Job
+    {
+        std::function<void()> Function;
+        Counter* Done = nullptr;
+        Job* Next = nullptr;        // In a counter's waiting list, or a free list.
+        UINT Owner = InvalidWorker; // Whose free list it goes back to.
+    };
+
+    // After Lê et al., "Correct and Efficient Work-Stealing for Weak Memory Models", without growing. Push releases
+    // Bottom itself rather than through a fence, which is free on x86 and what race detectors understand.
+    bool Push(Deque* InDeque, Job* Pushed)
+    {
+        INT64 Bottom = InDeque->Bottom.load(std::memory_order_relaxed);
+        INT64 Top = InDeque->Top.load(std::memory_order_acquire);
+        if (Bottom - Top >= (INT64)DequeCapacity)
+        {
+            return false;
+        }
+        InDeque->Jobs[Bottom & (DequeCapacity - 1)].store(Pushed, std::memory_order_relaxed);
+        InDeque->Bottom.store(Bottom + 1, std::memory_order_release);
+        return true;
+    }
+
+    Job* Pop(Deque* InDeque)
+    {
+        INT64 Bottom = InDeque->Bottom.load(std::memory_order_relaxed) - 1;
+        InDeque->Bottom.store(Bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        INT64 Top = InDeque->Top.load(std::memory_order_relaxed);
+        if (Top > Bottom)
+        {
+            InDeque->Bottom.store(Bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        Job* Popped = InDeque->Jobs[Bottom & (DequeCapacity - 1)].load(std::memory_order_relaxed);
+        if (Top == Bottom)
+        {
+            // The last one, a thief may have taken it.
+            if (!InDeque->Top.compare_exchange_strong(Top, Top + 1, std::memory_order_seq_cst,
+                                                      std::memory_order_relaxed))
+            {
+                Popped = nullptr;
+            }
+            InDeque->Bottom.store(Bottom + 1, std::memory_order_relaxed);
+        }
+        return Popped;
+    }
+
+    Job* Steal(Deque* InDeque)
+    {
+        INT64 Top = InDeque->Top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        INT64 Bottom = InDeque->Bottom.load(std::memory_order_acquire);
+        if (Top >= Bottom)
+        {
+            return nullptr;
+        }
+        Job* Stolen = InDeque->Jobs[Top & (DequeCapacity - 1)].load(std::memory_order_relaxed);
+        if (!InDeque->Top.compare_exchange_strong(Top, Top + 1, std::memory_order_seq_cst,
+                                                  std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        return Stolen;
+    }
+
+    static UINT32 NextRandom(UINT32* State)
+    {
+        *State = *State * 1664525u + 1013904223u;
+        return *State >> 8;
+    }
+
+    struct Worker
+    {
+        Deque Jobs;
+        Job* Free = nullptr;                 // The owner's.
+        std::atomic<Job*> Returned{nullptr}; // Freed on other threads, taken back when Free runs out.
+    };
+
+    struct Scheduler
+    {
+        UINT NumWorkers = 0;
+        std::unique_ptr<Worker> Workers[MaxWorkers];
+        std::vector<std::thread> Threads;
+        std::atomic<bool> Quit{false};
+
+        std::mutex Lock;            // Of Injected, and to sleep on.
+        std::condition_variable Wake;
+        std::deque<Job*> Injected;  // Spawned from threads that aren't workers.
+        std::atomic<UINT> NumInjected{0};
+        std::atomic<UINT> NumSleeping{0};
+
+        ~Scheduler();
+    };
+
+    static Scheduler Pool;
+    static std::once_flag PoolStarted;
+    static thread_local UINT WorkerIndex = InvalidWorker;
+
+    static void FreeJobList(Job* List)
+    {
+        while (List)
+        {
+            Job* Next = List->Next;
+            delete List;
+            List = Next;
+        }
+    }
+
+    Scheduler::~Scheduler()
+    {
+        Quit.store(true);
+        Wake.notify_all();
+        for (std::thread& Thread : Threads)
+        {
+            Thread.join();
+        }
+        for (UINT i = 0; i < NumWorkers; ++i)
+        {
+            FreeJobList(Workers[i]->Free);
+            FreeJobList(Workers[i]->Returned.load());
+        }
+    }
+
+    static Job* AllocateJob()
+    {
+        UINT Index = WorkerIndex;
+        if (Index == InvalidWorker)
+        {
+            return new Job();
+        }
+        Worker* Current = Pool.Workers[Index].get();
+        if (!Current->Free)
+        {
+            Current->Free = Current->Returned.exchange(nullptr, std::memory_order_acquire);
+        }
+        if (!Current->Free)
+        {
+            Job* NewJob = new Job();
+            NewJob->Owner = Index;
+            return NewJob;
+        }
+        Job* Allocated = Current->Free;
+        Current->Free = Allocated->Next;
+        Allocated->Next = nullptr;
+        return Allocated;
+    }
+
+    static void FreeJob(Job* Freed)
+    {
+        Freed->Function = nullptr;
+        Freed->Done = nullptr;
+        if (Freed->Owner == InvalidWorker)
+        {
+            delete Freed;
+        }
+        else if (Freed->Owner == WorkerIndex)
+        {
+            Freed->Next = Pool.Workers[Freed->Owner]->Free;
+            Pool.Workers[Freed->Owner]->Free = Freed;
+        }
+        else
+        {
+            std::atomic<Job*>& Returned = Pool.Workers[Freed->Owner]->Returned;
+            Freed->Next = Returned.load(std::memory_order_relaxed);
+            while (!Returned.compare_exchange_weak(Freed->Next, Freed, std::memory_order_release,
+                                                   std::memory_order_relaxed))
+            {
+            }
+        }
+    }
+
+    static void Run(Job* Running);
+
+    static void Schedule(Job* Scheduled)
+    {
+        UINT Index = WorkerIndex;
+        if (Index != InvalidWorker)
+        {
+            if (!Push(&Pool.Workers[Index]->Jobs, Scheduled))
+            {
+                Run(Scheduled);
+                return;
+            }
+        }
+        else
+        {
+            std::lock_guard<std::mutex> Lock(Pool.Lock);
+            Pool.Injected.push_back(Scheduled);
+            Pool.NumInjected++;
+        }
+        if (Pool.NumSleeping.load() > 0)
+        {
+            Pool.Wake.notify_one();
+        }
+    }
+
+    // The jobs waiting on the counter, once it reached zero. Whoever takes the list schedules it.
+    static void ReleaseWaiting(Counter* Released)
+    {
+        Job* Waiting = Released->Waiting.exchange(nullptr, std::memory_order_acq_rel);
+        while (Waiting)
+        {
+            Job* Next = Waiting->Next;
+            Waiting->Next = nullptr;
+            Schedule(Waiting);
+            Waiting = Next;
+        }
+    }
+
+    static void Run(Job* Running)
+    {
+        Running->Function();
+        Counter* Done = Running->Done;
+        FreeJob(Running);
+        if (Done)
+        {
+            // Held while the waiting jobs are released, a thread waiting on it can't return before.
+            Done->NumFinishing.fetch_add(1);
+            if (Done->Value.fetch_sub(1) == 1)
+            {
+                ReleaseWaiting(Done);
+            }
+            Done->NumFinishing.fetch_sub(1);
+        }
+    }
+
+    // The worker's own jobs newest first, then what other threads spawned, then other workers' oldest.
+    static Job* FindJob(UINT Index, UINT32* RandomState)
+    {
+        if (Index != InvalidWorker)
+        {
+            if (Job* Popped = Pop(&Pool.Workers[Index]->Jobs))
+            {
+                return Popped;
+            }
+        }
+        if (Pool.NumInjected.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard<std::mutex> Lock(Pool.Lock);
+            if (!Pool.Injected.empty())
+            {
+                Job* Injected = Pool.Injected.front();
+                Pool.Injected.pop_front();
+                Pool.NumInjected--;
+                return Injected;
+            }
+        }
+        UINT First = NextRandom(RandomState) % Pool.NumWorkers;
+        for (UINT i = 0; i < Pool.NumWorkers; ++i)
+        {
+            UINT Victim = (First + i) % Pool.NumWorkers;
+            if (Victim != Index)
+            {
+                if (Job* Stolen = Steal(&Pool.Workers[Victim]->Jobs))
+                {
+                    return Stolen;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    static void WorkerLoop(UINT Index)
+    {
+        WorkerIndex = Index;
+        UINT32 RandomState = 7919u * (Index + 1);
+        UINT NumMisses = 0;
+        while (!Pool.Quit.load(std::memory_order_relaxed))
+        {
+            if (Job* Found = FindJob(Index, &RandomState))
+            {
+                Run(Found);
+                NumMisses = 0;
+            }
+            else if (++NumMisses < 64)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                // Until something is spawned, or a millisecond: a wake that's missed only costs the timeout.
+                std::unique_lock<std::mutex> Lock(Pool.Lock);
+                Pool.NumSleeping++;
+                Pool.Wake.wait_for(Lock, std::chrono::milliseconds(1));
+                Pool.NumSleeping--;
+            }
+        }
+    }
+
+    static void Start(UINT NumWorkers)
+    {
+        Pool.NumWorkers = std::max(1u, std::min(NumWorkers, MaxWorkers));
+        for (UINT i = 0; i < Pool.NumWorkers; ++i)
+        {
+            Pool.Workers[i].reset(new Worker());
+        }
+        WorkerIndex = 0;
+        for (UINT i = 1; i < Pool.NumWorkers; ++i)
+        {
+            Pool.Threads.emplace_back(WorkerLoop, i);
+        }
+    }
+
+    static void EnsureStarted()
+    {
+        std::call_once(PoolStarted, []()
+        {
+            Start(Threading::GetNumHardwareThreads());
+        });
+    }
+
+    void Initialize(UINT NumWorkers)
+    {
+        std::call_once(PoolStarted, [&]()
+        {
+            Start(NumWorkers);
+        });
+    }
+
+    UINT GetNumWorkers()
+    {
+        EnsureStarted();
+        return Pool.NumWorkers;
+    }
+
+    UINT GetWorkerIndex()
+    {
+        return WorkerIndex;
+    }
+
+    void Spawn(const std::function<void()>& Function, Counter* Done)
+    {
+        EnsureStarted();
+        Job* Spawned = AllocateJob();
+        Spawned->Function = Function;
+        Spawned->Done = Done;
+        if (Done)
+        {
+            Done->Value.fetch_add(1);
+        }
+        Schedule(Spawned);
+    }
+
+    void SpawnAfter(Counter* Dependency, const std::function<void()>& Function, Counter* Done)
+    {
+        EnsureStarted();
+        Job* Spawned = AllocateJob();
+        Spawned->Function = Function;
+        Spawned->Done = Done;
+        if (Done)
+        {
+            Done->Value.fetch_add(1);
+        }
+
+        // If the dependency reached zero before it was queued, no one else will release it.
+        Spawned->Next = Dependency->Waiting.load(std::memory_order_relaxed);
+        while (!Dependency->Waiting.compare_exchange_weak(Spawned->Next, Spawned))
+        {
+        }
+        if (Dependency->Value.load() == 0)
+        {
+            ReleaseWaiting(Dependency);
+        }
+    }
+
+    void Wait(Counter* Done)
+    {
+        EnsureStarted();
+        UINT Index = WorkerIndex;
+        UINT32 RandomState = 104729u * (Index + 2);
+        while (Done->Value.load() != 0 || Done->NumFinishing.load() != 0)
+        {
+            if (Job* Found = FindJob(Index, &RandomState))
+            {
+                Run(Found);
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    struct RangeTask
+    {
+        const std::function<void(UINT Begin, UINT End)>* Body = nullptr;
+        UINT GrainSize = 1;
+        Counter Done;
+    };
+
+    // Whether anything the thread spawned is still there for the others to take.
+    static bool HasQueuedJobs()
+    {
+        UINT Index = WorkerIndex;
+        if (Index == InvalidWorker)
+        {
+            return Pool.NumInjected.load(std::memory_order_relaxed) > 0;
+        }
+        const Deque& Jobs = Pool.Workers[Index]->Jobs;
+        return Jobs.Bottom.load(std::memory_order_relaxed) > Jobs.Top.load(std::memory_order_relaxed);
+    }
+
+    static void RunRange(RangeTask* Task, UINT Begin, UINT End)
+    {
+        while (Begin < End)
+        {
+            // Lazy binary splitting: the upper half goes up for stealing only while nothing else is.
+            if (End - Begin > Task->GrainSize && !HasQueuedJobs())
+            {
+                UINT Middle = Begin + (End - Begin) / 2;
+                Spawn([=]()
+                {
+                    RunRange(Task, Middle, End);
+                }, &Task->Done);
+                End = Middle;
+                continue;
+            }
+            UINT Step = std::min(Task->GrainSize, End - Begin);
+            (*Task->Body)(Begin, Begin + Step);
+            Begin += Step;
+        }
+    }
+
+    void ParallelFor(UINT Count, UINT MinGrainSize, const std::function<void(UINT Begin, UINT End)>& Body)
+    {
+        if (Count == 0)
+        {
+            return;
+        }
+        UINT NumWorkers = GetNumWorkers();
+        RangeTask Task;
+        Task.Body = &Body;
+        Task.GrainSize = std::max(std::max(MinGrainSize, 1u), (Count + NumWorkers * 32 - 1) / (NumWorkers * 32));
+        if (NumWorkers == 1 || Count <= Task.GrainSize)
+        {
+            Body(0, Count);
+            return;
+        }
+        RunRange(&Task, 0, Count);
+        Wait(&Task.Done);
+    }
+
+    // Owner pushes in bursts and pops some back while thieves steal, every item has to come out exactly once.
+    static UINT TestDeque(UINT NumItems, UINT NumThieves)
+    {
+        std::unique_ptr<Deque> TestDeque(new Deque());
+        std::vector<Job> Items(NumItems);
+        std::unique_ptr<std::atomic<UINT>[]> TimesTaken(new std::atomic<UINT>[NumItems]);
+        for (UINT i = 0; i < NumItems; ++i)
+        {
+            TimesTaken[i].store(0);
+        }
+        auto Take = [&](Job* Taken)
+        {
+            TimesTaken[Taken - Items.data()]++;
+        };
+
+        std::atomic<bool> OwnerDone{false};
+        std::vector<std::thread> Thieves;
+        for (UINT Thief = 0; Thief < NumThieves; ++Thief)
+        {
+            Thieves.emplace_back([&]()
+            {
+                while (!OwnerDone.load() || TestDeque->Top.load() < TestDeque->Bottom.load())
+                {
+                    if (Job* Stolen = Steal(TestDeque.get()))
+                    {
+                        Take(Stolen);
+                    }
+                }
+            });
+        }
+        UINT32 State = 31337;
+        UINT NumPushed = 0;
+        while (NumPushed < NumItems)
+        {
+            UINT Burst = 1 + NextRandom(&State) % 64;
+            for (UINT i = 0; i < Burst && NumPushed < NumItems; ++i)
+            {
+                if (Push(TestDeque.get(), &Items[NumPushed]))
+                {
+                    NumPushed++;
+                }
+            }
+            UINT NumPops = NextRandom(&State) % 64;
+            for (UINT i = 0; i < NumPops; ++i)
+            {
+                if (Job* Popped = Pop(TestDeque.get()))
+                {
+                    Take(Popped);
+                }
+            }
+        }
+        while (Job* Popped = Pop(TestDeque.get()))
+        {
+            Take(Popped);
+        }
+        OwnerDone.store(true);
+        for (std::thread& Thief : Thieves)
+        {
+            Thief.join();
+        }
+
+        UINT NumErrors = 0;
+        for (UINT i = 0; i < NumItems; ++i)
+        {
+            NumErrors += TimesTaken[i].load() != 1 ? 1 : 0;
+        }
+        return NumErrors;
+    }
+
+    bool RunTest(UINT NumJobs)
+    {
+        UINT NumErrors = TestDeque(NumJobs, 3);
+        UINT32 State = 4242;
+
+        // Stages of random width, each spawned after the one before and checking it finished whole.
+        const UINT NumStages = 64;
+        std::unique_ptr<Counter[]> Stages(new Counter[NumStages]);
+        std::unique_ptr<std::atomic<UINT>[]> NumFinished(new std::atomic<UINT>[NumStages]);
+        std::vector<UINT> Widths(NumStages);
+        std::atomic<UINT> NumStageErrors{0};
+        for (UINT Stage = 0; Stage < NumStages; ++Stage)
+        {
+            NumFinished[Stage].store(0);
+            Widths[Stage] = 1 + NextRandom(&State) % (2 * NumJobs / NumStages);
+        }
+        for (UINT Stage = 0; Stage < NumStages; ++Stage)
+        {
+            for (UINT i = 0; i < Widths[Stage]; ++i)
+            {
+                auto StageJob = [&, Stage]()
+                {
+                    if (Stage > 0 && NumFinished[Stage - 1].load() != Widths[Stage - 1])
+                    {
+                        NumStageErrors++;
+                    }
+                    NumFinished[Stage]++;
+                };
+                if (Stage == 0)
+                {
+                    Spawn(StageJob, &Stages[Stage]);
+                }
+                else
+                {
+                    SpawnAfter(&Stages[Stage - 1], StageJob, &Stages[Stage]);
+                }
+            }
+        }
+        Wait(&Stages[NumStages - 1]);
+        for (UINT Stage = 0; Stage < NumStages; ++Stage)
+        {
+            Wait(&Stages[Stage]);
+            NumErrors += NumFinished[Stage].load() != Widths[Stage] ? 1 : 0;
+        }
+        NumErrors += NumStageErrors.load();
+
+        // Parallel-fors of random sizes, every index once, some bodies with parallel-fors and spawns of their own.
+        std::vector<std::atomic<UINT>> Visits(NumJobs);
+        std::atomic<UINT> NumNestedErrors{0};
+        for (UINT Round = 0; Round < 16; ++Round)
+        {
+            UINT Count = NextRandom(&State) % NumJobs;
+            UINT GrainSize = 1 + NextRandom(&State) % 64;
+            for (UINT i = 0; i < Count; ++i)
+            {
+                Visits[i].store(0);
+            }
+            ParallelFor(Count, GrainSize, [&](UINT Begin, UINT End)
+            {
+                for (UINT i = Begin; i < End; ++i)
+                {
+                    Visits[i]++;
+                }
+                if (Begin % 7 == 0)
+                {
+                    std::atomic<UINT> NestedSum{0};
+                    Counter Spawned;
+                    Spawn([&]() { NestedSum += 1000; }, &Spawned);
+                    ParallelFor(100, 1, [&](UINT NestedBegin, UINT NestedEnd)
+                    {
+                        NestedSum += NestedEnd - NestedBegin;
+                    });
+                    Wait(&Spawned);
+                    NumNestedErrors += NestedSum.load() != 1100 ? 1 : 0;
+                }
+            });
+            for (UINT i = 0; i < Count; ++i)
+            {
+                NumErrors += Visits[i].load() != 1 ? 1 : 0;
+            }
+        }
+        NumErrors += NumNestedErrors.load();
+
+        // Threads that aren't workers spawn into the shared queue and help while waiting.
+        std::atomic<UINT> NumRun{0};
+        std::vector<std::thread> Outsiders;
+        for (UINT Thread = 0; Thread < 2; ++Thread)
+        {
+            Outsiders.emplace_back([&]()
+            {
+                Counter Spawned;
+                for (UINT i = 0; i < NumJobs / 4; ++i)
+                {
+                    Spawn([&]() { NumRun++; }, &Spawned);
+                }
+                Wait(&Spawned);
+            });
+        }
+        for (std::thread& Outsider : Outsiders)
+        {
+            Outsider.join();
+        }
+        NumErrors += NumRun.load() != 2 * (NumJobs / 4) ? 1 : 0;
+
+        // ParallelForPerThread's thread indices are taken by one thread at a time.
+        const UINT NumThreads = 8;
+        std::atomic<UINT> Busy[NumThreads];
+        for (std::atomic<UINT>& Flag : Busy)
+        {
+            Flag.store(0);
+        }
+        std::atomic<UINT> NumSharedErrors{0};
+        Threading::ParallelForPerThread(NumJobs, NumThreads, 16, [&](UINT Thread, UINT Begin, UINT End)
+        {
+            if (Thread >= NumThreads || Busy[Thread].exchange(1) != 0)
+            {
+                NumSharedErrors++;
+                return;
+            }
+            volatile UINT Sum = 0;
+            for (UINT i = Begin; i < End; ++i)
+            {
+                Sum = Sum + i;
+            }
+            Busy[Thread].store(0);
+        });
+        NumErrors += NumSharedErrors.load();
+
+        bool Passed = NumErrors == 0;
+        char Message[256];
+        snprintf(Message, sizeof(Message), "JobSystem: test %s, %u jobs on %u workers, %u errors\n",
+                 Passed ? "passed" : "FAILED", NumJobs, GetNumWorkers(), NumErrors);
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+
+    // Some work per index, more towards the end when Skewed.
+    static UINT64 Work(UINT Index, UINT Count, bool Skewed)
+    {
+        UINT NumRounds = Skewed ? 1 + (UINT)(192ull * Index / Count * Index / Count) : 64;
+        UINT64 Hash = Index;
+        for (UINT i = 0; i < NumRounds; ++i)
+        {
+            Hash = (Hash ^ (Hash >> 29)) * 0xBF58476D1CE4E5B9ull;
+        }
+        return Hash;
+    }
+
+    void RunBenchmark(UINT NumJobs)
+    {
+        UINT NumWorkers = GetNumWorkers();
+        char Message[256];
+
+        // Spawning empty jobs and waiting for them, the waiting thread running most itself.
+        Counter Spawned;
+        auto Start = std::chrono::high_resolution_clock::now();
+        for (UINT i = 0; i < NumJobs; ++i)
+        {
+            Spawn([]() {}, &Spawned);
+        }
+        Wait(&Spawned);
+        auto End = std::chrono::high_resolution_clock::now();
+        double SpawnNs = std::chrono::duration<double, std::nano>(End - Start).count() / NumJobs;
+        snprintf(Message, sizeof(Message), "JobSystem: %u workers, %.0f ns to spawn and run an empty job\n",
+                 NumWorkers, SpawnNs);
+        OutputDebugStringA(Message);
+
+        // From a spawn on this thread, which doesn't take it back, to another worker starting it.
+        if (NumWorkers > 1)
+        {
+            const UINT NumSteals = 2000;
+            std::vector<double> Latencies(NumSteals);
+            for (UINT i = 0; i < NumSteals; ++i)
+            {
+                std::atomic<bool> Started{false};
+                std::chrono::high_resolution_clock::time_point StartedAt;
+                Counter Stolen;
+                auto SpawnedAt = std::chrono::high_resolution_clock::now();
+                Spawn([&]()
+                {
+                    StartedAt = std::chrono::high_resolution_clock::now();
+                    Started.store(true);
+                }, &Stolen);
+                while (!Started.load())
+                {
+                    std::this_thread::yield();
+                }
+                Wait(&Stolen);
+                Latencies[i] = std::chrono::duration<double, std::micro>(StartedAt - SpawnedAt).count();
+            }
+            std::sort(Latencies.begin(), Latencies.end());
+            snprintf(Message, sizeof(Message), "JobSystem: steal latency %.1f us median, %.1f us p99\n",
+                     Latencies[NumSteals / 2], Latencies[NumSteals * 99 / 100]);
+            OutputDebugStringA(Message);
+        }
+
+        // Parallel-for scaling on 1 to all workers, then the adaptive split against even chunks per worker, on
+        // even and skewed work.
+        const UINT Count = 1 << 18;
+        std::vector<UINT64> Results(Count);
+        auto Measure = [&](const std::function<void()>& Loop)
+        {
+            auto LoopStart = std::chrono::high_resolution_clock::now();
+            Loop();
+            return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - LoopStart)
+                .count();
+        };
+        double SerialMs = 0;
+        for (UINT NumThreads = 1; ; NumThreads = std::min(NumThreads * 2, NumWorkers))
+        {
+            double Ms = Measure([&]()
+            {
+                Threading::ParallelFor(Count, NumThreads, 256, [&](UINT Begin, UINT End)
+                {
+                    for (UINT i = Begin; i < End; ++i)
+                    {
+                        Results[i] = Work(i, Count, false);
+                    }
+                });
+            });
+            SerialMs = NumThreads == 1 ? Ms : SerialMs;
+            snprintf(Message, sizeof(Message), "JobSystem: parallel-for of %u on %u threads, %.2f ms, %.2fx\n",
+                     Count, NumThreads, Ms, SerialMs / Ms);
+            OutputDebugStringA(Message);
+            if (NumThreads == NumWorkers)
+            {
+                break;
+            }
+        }
+        for (bool Skewed : {false, true})
+        {
+            double EvenMs = Measure([&]()
+            {
+                Threading::ParallelFor(Count, NumWorkers, (Count + NumWorkers - 1) / NumWorkers,
+                                       [&](UINT Begin, UINT End)
+                {
+                    for (UINT i = Begin; i < End; ++i)
+                    {
+                        Results[i] = Work(i, Count, Skewed);
+                    }
+                });
+            });
+            double AdaptiveMs = Measure([&]()
+            {
+                ParallelFor(Count, 64, [&](UINT Begin, UINT End)
+                {
+                    for (UINT i = Begin; i < End; ++i)
+                    {
+                        Results[i] = Work(i, Count, Skewed);
+                    }
+                });
+            });
+            snprintf(Message, sizeof(Message),
+                     "JobSystem: %s work, %.2f ms in a chunk per worker, %.2f ms split adaptively\n",
+                     Skewed ? "skewed" : "even", EvenMs, AdaptiveMs);
+            OutputDebugStringA(Message);
+        }
+    }
+}
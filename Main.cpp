@@ -1,9 +1,14 @@
 ﻿// #include "cuda_runtime.h"
 #include "Headers/Gpu.h"
+#include "Headers/JobSystem.h"
+#include "Headers/Threading.h"
+#include "Apps/CpuPathTracer.h"
 #include "Apps/DXRTutorial.h"
 #include "Apps/HelloBindless.h"
 #include "Apps/MSExperiments.h"
 #include "Apps/MSHelloTriangle.h"
+#include <algorithm>
+#include <chrono>
 
 using namespace DirectX;
 
@@ -85,8 +90,9 @@ int CALLBACK WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
             MSHelloTriangle,
             HelloBindless,
             MSExperiments,
+            CpuPathTracer,
         };
-        Demo CurrentDemo = Demo::MSExperiments;
+        Demo CurrentDemo = Demo::None; // Until the first demo's pipelines are ready.
         
         WindowInfo Window;
         Window.WindowName = "SplunkLab";
@@ -99,23 +105,38 @@ int CALLBACK WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
         Global Dx;
         GlobalResources Data;
         bool IsNvidiaTutorialInitialized = false;
+        bool IsNvidiaTutorialStreaming = false; // Its geometry is queued, the BLAS builds wait for the sync point.
         bool IsMSHelloTriangleInitialized = false;
         bool IsHelloBindlessInitialized = false;
         bool IsMSExperimentsInitialized = false;
+        bool IsCpuPathTracerInitialized = false;
 
-        // TODO: Replace with instancing a compiler everytime we call CompileShader() like DxrPathTracer does to allow multithreading.
-        ShaderCompiler Compiler;
-        D3D::CreateShaderCompiler(&Compiler);
+        // Everything parallel runs on its workers, this thread is the first of them.
+        JobSystem::Initialize(Threading::GetNumHardwareThreads());
 
         D3D::CreateDevice(&Dx);
         NAME_D3D12_OBJECT(Dx.Device);
         ID3D12Device14* Device = Dx.Device.Get();
 
-        D3D::CreateCommitted2DTexture(Device, Window.Width, Window.Height,
-                                      D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-                                      D3D12_HEAP_TYPE_DEFAULT,
-                                      Data.OutputTexture.GetAddressOf());
+        D3D::CreateGpuMemory(&Data.Memory);
+
+        // The pure CPU modules are tested and benchmarked by Tools/SelfTest, what needs the device runs here.
+        if (strstr(lpCmdLine, "--benchmarks") != nullptr)
+        {
+            // What writing the instance descriptions of a large scene costs per frame.
+            DXRTutorial::RunInstanceDescBenchmark(Device, &Data.Memory, 100000, 16);
+        }
+
+        D3D::CreatePlaced2DTexture(Device, &Data.Memory, Window.Width, Window.Height,
+                                   D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+                                   Data.OutputTexture.GetAddressOf());
         NAME_D3D12_OBJECT(Data.OutputTexture);
+        D3D::CreateUploadRing(Device, GlobalResources::FrameUploadsSize, &Data.FrameUploads);
+        D3D::CreateStreamingUploads(Device, GlobalResources::StreamingUploadsSize,
+                                    GlobalResources::StreamingBudgetPerFrame, &Data.Streaming);
+        D3D::CreateBindlessHeap(Device, GlobalResources::NumPersistentDescriptors,
+                                GlobalResources::NumTransientDescriptors, GlobalResources::MaxBackBuffers,
+                                &Data.Descriptors);
         
         D3D12_COMMAND_QUEUE_DESC QueueDesc = {};
         QueueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
@@ -133,24 +154,40 @@ int CALLBACK WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
         
         D3D::CreateFences(Device, Dx.Fence.GetAddressOf(), &Dx.FenceEvent, Data.Frames);
         NAME_D3D12_OBJECT(Dx.Fence);
+        D3D::CreateQueueTimelines(Device, &Dx);
+        D3D::CreateReleaseQueue(&Dx, &Data);
         
         D3D::CreateCommandLists(Device, Data.Frames);
+        D3D::CreateCommandListPools(D3D12_COMMAND_LIST_TYPE_DIRECT, GlobalResources::MaxBackBuffers,
+                                    std::min(Threading::GetNumHardwareThreads(), ParallelRecording::MaxThreads),
+                                    &Data.RecordingLists);
 
-        D3D::CreateSwapchain(Dx.Factory.Get(), Dx.GraphicsQueue.Get(), &Window,
+        D3D::CreateSwapchain(Dx.Factory.Get(), Dx.GraphicsQueue.Get(), &Window, Data.NumBackBuffers,
                              Dx.SwapChain.GetAddressOf());
+        FramePacing::Settings Pacing;
+        Pacing.FramesInFlight = Data.NumBackBuffers;
+        D3D::CreateFramePacing(&Dx, Pacing);
         
         D3D::CreateRTVDescriptorHeap(Device, Data.RTVHeap.GetAddressOf(), &Data.RTVHeapHandleSize);
         NAME_D3D12_OBJECT(Data.RTVHeap);
         
-        D3D::CreateBackBufferRTV(Device, Dx.SwapChain.Get(), Data.Frames,
+        D3D::CreateBackBufferRTV(Device, Dx.SwapChain.Get(), Data.Frames, Data.NumBackBuffers,
                                  Data.RTVHeap.Get(), Data.RTVHeapHandleSize);
 
-        D3D::CreateDepthBuffers(Device, Data.Frames, &Window);
+        D3D::CreateDepthBuffers(Device, Data.Frames, Data.NumBackBuffers, &Window);
         
         D3D::CreateDSVDescriptorHeap(Device, Data.DSVHeap.GetAddressOf(), &Data.DSVHeapHandleSize);
         NAME_D3D12_OBJECT(Data.DSVHeap);
 
-        D3D::CreateDepthBufferDSV(Device, Data.Frames, Data.DSVHeap.Get(), Data.DSVHeapHandleSize);
+        D3D::CreateDepthBufferDSV(Device, Data.Frames, Data.NumBackBuffers, Data.DSVHeap.Get(),
+                                  Data.DSVHeapHandleSize);
+
+        // The resources frames pass on to each other, in the states they were created in.
+        ResourceStates::Register(&Data.States, Data.OutputTexture.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE);
+        for (UINT i = 0; i < Data.NumBackBuffers; ++i)
+        {
+            ResourceStates::Register(&Data.States, Data.Frames[i].BackBuffer.Get(), D3D12_RESOURCE_STATE_PRESENT);
+        }
         
         UINT BackBufferIndex = 0;
 
@@ -163,30 +200,374 @@ int CALLBACK WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
         HelloBindless::HelloBindlessData QCSData = {};
         MSHelloTriangle::MSHelloTriangleData SLData = {};
         MSExperiments::MSExperimentsData MSEData = {};
+        CpuPathTracer::CpuPathTracerData CPTData = {};
+
+        // Shaders compile and pipelines are created on the job system, the demo before renders until they're ready.
+        // What earlier runs compiled comes from the cache instead.
+        ShaderCompilation::Service Compilations;
+        ShaderCacheFile CompiledShaders;
+        D3D::OpenShaderCache(GetSolutionDirectory() + L"ShaderCache.bin", &CompiledShaders);
+
+        // Shaders edited while the app runs compile again, for the demos whose shaders include what changed.
+        ShaderWatcher Watcher;
+        D3D::CreateShaderWatcher(GetSolutionDirectory() + L"Shaders\\", &Watcher);
+        auto StartDemo = [&](UINT Started, std::vector<ShaderCompilation::Future>* Futures)
+        {
+            switch ((Demo)Started)
+            {
+            case Demo::NvidiaTutorial:
+                {
+                    // The pipeline is created with the shader bindings, after the acceleration structures.
+                    DXRData.RtShader.Filename = L"SimpleDXR.hlsl";
+                    DXRData.RtShader.TargetProfile = L"lib_6_3";
+                    DXRData.RtShader.Entry = L"";
+                    D3D::WatchShader(&Watcher, DXRData.RtShader, Started);
+                    Futures->push_back(D3D::CompileShaderAsync(&Compilations, &DXRData.RtShader, &CompiledShaders));
+                }
+                break;
+
+            case Demo::MSHelloTriangle:
+                {
+                    // Simple mesh + pixel shader.
+                    SLData.SimpleMS.Filename = L"SimpleMS.hlsl";
+                    SLData.SimpleMS.TargetProfile = L"ms_6_6";
+                    SLData.SimpleMS.Entry = L"MSMain";
+                    SLData.SimplePS.Filename = L"SimpleMS.hlsl";
+                    SLData.SimplePS.TargetProfile = L"ps_6_6";
+                    SLData.SimplePS.Entry = L"PSMain";
+                    D3D::WatchShader(&Watcher, SLData.SimpleMS, Started); // The pixel shader's file too.
+                    std::vector<ShaderCompilation::Future> Shaders = {
+                        D3D::CompileShaderAsync(&Compilations, &SLData.SimpleMS, &CompiledShaders),
+                        D3D::CompileShaderAsync(&Compilations, &SLData.SimplePS, &CompiledShaders)};
+
+                    D3D12_ROOT_SIGNATURE_DESC1 RootSigDesc = {};
+                    D3D::CreateRootSignature(Device, &RootSigDesc, &SLData.RootSig);
+                    NAME_D3D12_OBJECT(SLData.RootSig);
+
+                    Futures->push_back(D3D::CreatePipelineAsync(&Compilations, Shaders, [&]()
+                    {
+                        if (!D3D::CreateMeshShaderPSO(Device,
+                                                      &SLData.SimpleMS, &SLData.SimplePS,
+                                                      SLData.RootSig.Get(),
+                                                      &SLData.GreenTrianglePSO))
+                        {
+                            return false;
+                        }
+                        NAME_D3D12_OBJECT(SLData.GreenTrianglePSO);
+                        return true;
+                    }));
+                }
+                break;
+
+            case Demo::HelloBindless:
+                {
+                    // Create a compute shader.
+                    QCSData.BindlessShader.Filename = L"SimpleBindless.hlsl";
+                    QCSData.BindlessShader.TargetProfile = L"cs_6_7";
+                    QCSData.BindlessShader.Entry = L"Main";
+                    D3D::WatchShader(&Watcher, QCSData.BindlessShader, Started);
+                    std::vector<ShaderCompilation::Future> Shaders = {
+                        D3D::CompileShaderAsync(&Compilations, &QCSData.BindlessShader, &CompiledShaders)};
+
+                    // Bindless setup: the shader gets the output's heap index as a root constant.
+                    D3D12_ROOT_PARAMETER1 IndicesParam = {};
+                    IndicesParam.ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+                    IndicesParam.ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+                    IndicesParam.Constants.ShaderRegister = 0;
+                    IndicesParam.Constants.Num32BitValues = 1;
+
+                    D3D12_ROOT_SIGNATURE_DESC1 RootSigDesc = {};
+                    RootSigDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_CBV_SRV_UAV_HEAP_DIRECTLY_INDEXED;
+                    RootSigDesc.NumParameters = 1;
+                    RootSigDesc.pParameters = &IndicesParam;
+                    D3D::CreateRootSignature(Device, &RootSigDesc, &QCSData.RootSig);
+                    NAME_D3D12_OBJECT(QCSData.RootSig);
+
+                    Futures->push_back(D3D::CreatePipelineAsync(&Compilations, Shaders, [&]()
+                    {
+                        D3D12_COMPUTE_PIPELINE_STATE_DESC PSODesc = {};
+                        PSODesc.CS.pShaderBytecode = QCSData.BindlessShader.Blob->GetBufferPointer();
+                        PSODesc.CS.BytecodeLength = QCSData.BindlessShader.Blob->GetBufferSize();
+                        PSODesc.pRootSignature = QCSData.RootSig.Get();
+                        if (FAILED(Device->CreateComputePipelineState(&PSODesc, IID_PPV_ARGS(&QCSData.PSO))))
+                        {
+                            return false;
+                        }
+                        NAME_D3D12_OBJECT(QCSData.PSO);
+                        return true;
+                    }));
+                }
+                break;
+
+            case Demo::MSExperiments:
+                {
+                    // Simple mesh + pixel shader.
+                    MSEData.SimpleMS.Filename = L"MSExperiment.hlsl";
+                    MSEData.SimpleMS.TargetProfile = L"ms_6_6";
+                    MSEData.SimpleMS.Entry = L"MSMain";
+                    MSEData.SimplePS.Filename = L"MSExperiment.hlsl";
+                    MSEData.SimplePS.TargetProfile = L"ps_6_6";
+                    MSEData.SimplePS.Entry = L"PSMain";
+                    D3D::WatchShader(&Watcher, MSEData.SimpleMS, Started); // The pixel shader's file too.
+                    std::vector<ShaderCompilation::Future> Shaders = {
+                        D3D::CompileShaderAsync(&Compilations, &MSEData.SimpleMS, &CompiledShaders),
+                        D3D::CompileShaderAsync(&Compilations, &MSEData.SimplePS, &CompiledShaders)};
+
+                    // The scene constants move through the frame upload ring, so they're a root CBV.
+                    D3D12_ROOT_PARAMETER1 SceneConstantsParam = {};
+                    SceneConstantsParam.ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
+                    SceneConstantsParam.ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+                    SceneConstantsParam.Descriptor.ShaderRegister = 0;
+                    SceneConstantsParam.Descriptor.Flags = D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE;
+
+                    D3D12_ROOT_SIGNATURE_DESC1 RootSigDesc = {};
+                    RootSigDesc.NumParameters = 1;
+                    RootSigDesc.pParameters = &SceneConstantsParam;
+                    D3D::CreateRootSignature(Device, &RootSigDesc, &MSEData.RootSig);
+                    NAME_D3D12_OBJECT(MSEData.RootSig);
+
+                    Futures->push_back(D3D::CreatePipelineAsync(&Compilations, Shaders, [&]()
+                    {
+                        if (!D3D::CreateMeshShaderPSO(Device,
+                                                      &MSEData.SimpleMS, &MSEData.SimplePS,
+                                                      MSEData.RootSig.Get(),
+                                                      &MSEData.CubeInstancingPSO))
+                        {
+                            return false;
+                        }
+                        NAME_D3D12_OBJECT(MSEData.CubeInstancingPSO);
+                        return true;
+                    }));
+                }
+                break;
+
+            default:
+                break;
+            }
+        };
+
+        ShaderCompilation::Selection Demos;
+        ShaderCompilation::Initialize(&Demos, (UINT)Demo::CpuPathTracer + 1, (UINT)Demo::None);
+        auto DemoRequested = std::chrono::high_resolution_clock::now();
+        auto RequestDemo = [&](Demo Requested)
+        {
+            ShaderCompilation::Request(&Demos, (UINT)Requested);
+            DemoRequested = std::chrono::high_resolution_clock::now();
+        };
+        RequestDemo(Demo::MSExperiments);
+
+        // A demo whose shaders changed keeps rendering while its pipelines are rebuilt into these. They're swapped in
+        // at the top of a frame, the ones before are released once the frames that used them are done.
+        std::vector<ReloadedPipelines> Reloaded((UINT)Demo::CpuPathTracer + 1);
+        ShaderReload::Reloads Rebuilds;
+        ShaderReload::Initialize(&Rebuilds, (UINT)Demo::CpuPathTracer + 1);
+        auto IsInitialized = [&](UINT Owner)
+        {
+            switch ((Demo)Owner)
+            {
+            case Demo::NvidiaTutorial: return IsNvidiaTutorialInitialized;
+            case Demo::MSHelloTriangle: return IsMSHelloTriangleInitialized;
+            case Demo::HelloBindless: return IsHelloBindlessInitialized;
+            case Demo::MSExperiments: return IsMSExperimentsInitialized;
+            default: return false;
+            }
+        };
+        auto StartReload = [&](UINT Owner, std::vector<ShaderCompilation::Future>* Futures)
+        {
+            // What a failed rebuild compiled is of no use.
+            ReloadedPipelines* Staged = &Reloaded[Owner];
+            for (Shader& Leftover : Staged->Shaders)
+            {
+                if (Leftover.Blob)
+                {
+                    Leftover.Blob->Release();
+                    Leftover.Blob = nullptr;
+                }
+            }
+
+            std::vector<ShaderCompilation::Future> Shaders;
+            switch ((Demo)Owner)
+            {
+            case Demo::NvidiaTutorial:
+                {
+                    Staged->Shaders[0] = DXRData.RtShader;
+                    Shaders.push_back(D3D::CompileShaderAsync(&Compilations, &Staged->Shaders[0], &CompiledShaders));
+                    Futures->push_back(D3D::CreatePipelineAsync(&Compilations, Shaders, [&, Staged]()
+                    {
+                        return DXRTutorial::CreatePipeline(Device, DXRData, Data.Descriptors, &Staged->Shaders[0],
+                                                           &Staged->PipelineDesc, &Staged->StateObject,
+                                                           &Staged->ShaderTable, &Staged->ShaderTableLayout);
+                    }));
+                }
+                break;
+
+            case Demo::MSHelloTriangle:
+            case Demo::MSExperiments:
+                {
+                    bool IsExperiments = (Demo)Owner == Demo::MSExperiments;
+                    Staged->Shaders[0] = IsExperiments ? MSEData.SimpleMS : SLData.SimpleMS;
+                    Staged->Shaders[1] = IsExperiments ? MSEData.SimplePS : SLData.SimplePS;
+                    ID3D12RootSignature* RootSig = IsExperiments ? MSEData.RootSig.Get() : SLData.RootSig.Get();
+                    Shaders.push_back(D3D::CompileShaderAsync(&Compilations, &Staged->Shaders[0], &CompiledShaders));
+                    Shaders.push_back(D3D::CompileShaderAsync(&Compilations, &Staged->Shaders[1], &CompiledShaders));
+                    Futures->push_back(D3D::CreatePipelineAsync(&Compilations, Shaders, [Device, Staged, RootSig]()
+                    {
+                        return D3D::CreateMeshShaderPSO(Device, &Staged->Shaders[0], &Staged->Shaders[1], RootSig,
+                                                        &Staged->PSO);
+                    }));
+                }
+                break;
+
+            case Demo::HelloBindless:
+                {
+                    Staged->Shaders[0] = QCSData.BindlessShader;
+                    Shaders.push_back(D3D::CompileShaderAsync(&Compilations, &Staged->Shaders[0], &CompiledShaders));
+                    ID3D12RootSignature* RootSig = QCSData.RootSig.Get();
+                    Futures->push_back(D3D::CreatePipelineAsync(&Compilations, Shaders, [Device, Staged, RootSig]()
+                    {
+                        D3D12_COMPUTE_PIPELINE_STATE_DESC PSODesc = {};
+                        PSODesc.CS.pShaderBytecode = Staged->Shaders[0].Blob->GetBufferPointer();
+                        PSODesc.CS.BytecodeLength = Staged->Shaders[0].Blob->GetBufferSize();
+                        PSODesc.pRootSignature = RootSig;
+                        return SUCCEEDED(Device->CreateComputePipelineState(&PSODesc, IID_PPV_ARGS(&Staged->PSO)));
+                    }));
+                }
+                break;
+
+            default:
+                break;
+            }
+            Futures->insert(Futures->end(), Shaders.begin(), Shaders.end());
+        };
+        auto SwapReload = [&](UINT Owner)
+        {
+            // The frames in flight keep what they recorded with until they retire.
+            ReloadedPipelines* Staged = &Reloaded[Owner];
+            DeferredRelease::RetirePoint Retire = D3D::GetFrameRetirePoint(Dx);
+            auto SwapObject = [&](auto* Live, auto* Rebuilt)
+            {
+                D3D::DeferRelease(&Data.Releases, Retire, Live->Get());
+                *Live = std::move(*Rebuilt);
+            };
+            auto SwapShader = [](Shader* Live, Shader* Rebuilt)
+            {
+                Live->Blob->Release(); // The pipelines made from it have their own copy.
+                Live->Blob = Rebuilt->Blob;
+                Rebuilt->Blob = nullptr;
+            };
+
+            switch ((Demo)Owner)
+            {
+            case Demo::NvidiaTutorial:
+                SwapShader(&DXRData.RtShader, &Staged->Shaders[0]);
+                SwapObject(&DXRData.RaytracingStateObject, &Staged->StateObject);
+                SwapObject(&DXRData.ShaderTable, &Staged->ShaderTable);
+                DXRData.PipelineDesc = std::move(Staged->PipelineDesc);
+                DXRData.ShaderTableLayout = Staged->ShaderTableLayout;
+                NAME_D3D12_OBJECT(DXRData.ShaderTable);
+                break;
+
+            case Demo::MSHelloTriangle:
+                SwapShader(&SLData.SimpleMS, &Staged->Shaders[0]);
+                SwapShader(&SLData.SimplePS, &Staged->Shaders[1]);
+                SwapObject(&SLData.GreenTrianglePSO, &Staged->PSO);
+                NAME_D3D12_OBJECT(SLData.GreenTrianglePSO);
+                break;
+
+            case Demo::HelloBindless:
+                SwapShader(&QCSData.BindlessShader, &Staged->Shaders[0]);
+                SwapObject(&QCSData.PSO, &Staged->PSO);
+                NAME_D3D12_OBJECT(QCSData.PSO);
+                break;
+
+            case Demo::MSExperiments:
+                SwapShader(&MSEData.SimpleMS, &Staged->Shaders[0]);
+                SwapShader(&MSEData.SimplePS, &Staged->Shaders[1]);
+                SwapObject(&MSEData.CubeInstancingPSO, &Staged->PSO);
+                NAME_D3D12_OBJECT(MSEData.CubeInstancingPSO);
+                break;
+
+            default:
+                break;
+            }
+
+            char Message[128];
+            snprintf(Message, sizeof(Message), "ShaderReload: demo %u reloaded, %.0f ms of compiling\n", Owner,
+                     ShaderCompilation::GetCompileSeconds(Rebuilds.Futures[Owner]) * 1e3);
+            OutputDebugStringA(Message);
+        };
+
+        // What the other queues' work needs the graphics queue to wait for.
+        QueueScheduler::SyncPoint LastGraphicsWork = {};
+
+        auto PacingStart = std::chrono::high_resolution_clock::now();
         
         do {
             // Key down.
             if (WindowMessage.message == WM_KEYDOWN && WindowMessage.wParam == 'N')
             {
-                CurrentDemo = Demo::NvidiaTutorial;
+                RequestDemo(Demo::NvidiaTutorial);
             }
             if (WindowMessage.message == WM_KEYDOWN && WindowMessage.wParam == 'M')
             {
-                CurrentDemo = Demo::MSHelloTriangle;
+                RequestDemo(Demo::MSHelloTriangle);
             }
             if (WindowMessage.message == WM_KEYDOWN && WindowMessage.wParam == 'B')
             {
-                CurrentDemo = Demo::HelloBindless;
+                RequestDemo(Demo::HelloBindless);
             }
             if (WindowMessage.message == WM_KEYDOWN && WindowMessage.wParam == 'E')
             {
-                CurrentDemo = Demo::MSExperiments;
+                RequestDemo(Demo::MSExperiments);
+            }
+            if (WindowMessage.message == WM_KEYDOWN && WindowMessage.wParam == 'P')
+            {
+                RequestDemo(Demo::CpuPathTracer);
+            }
+
+            // Cycle the frames in flight and the presents that may queue up, the telemetry reports each setting.
+            if (WindowMessage.message == WM_KEYDOWN && (WindowMessage.wParam == 'F' || WindowMessage.wParam == 'L'))
+            {
+                FramePacing::Settings NewPacing = Dx.Pacing;
+                if (WindowMessage.wParam == 'F')
+                {
+                    NewPacing.FramesInFlight = NewPacing.FramesInFlight == FramePacing::MaxFramesInFlight
+                        ? FramePacing::MinFramesInFlight
+                        : NewPacing.FramesInFlight + 1;
+                }
+                else
+                {
+                    NewPacing.MaxLatency = NewPacing.MaxLatency % NewPacing.FramesInFlight + 1;
+                }
+                D3D::SetFramePacing(&Dx, &Data, &Window, NewPacing);
+                BackBufferIndex = Dx.SwapChain->GetCurrentBackBufferIndex();
             }
             
             if (WindowMessage.message == WM_KEYDOWN && CurrentDemo == Demo::MSExperiments)
             {
                 MSEData.Camera.OnKeyDown(WindowMessage.wParam);
             }
+
+            // Double the threads recording the passes, up to all of them, the frame pacing telemetry shows the effect.
+            if (WindowMessage.message == WM_KEYDOWN && WindowMessage.wParam == 'T' &&
+                CurrentDemo == Demo::MSExperiments)
+            {
+                UINT MaxThreads = Data.RecordingLists.Pools.NumThreads;
+                MSEData.NumRecordingThreads = MSEData.NumRecordingThreads == MaxThreads
+                    ? 1
+                    : std::min(MSEData.NumRecordingThreads * 2, MaxThreads);
+                char Message[64];
+                snprintf(Message, sizeof(Message), "MSExperiments: recording on %u threads\n",
+                         MSEData.NumRecordingThreads);
+                OutputDebugStringA(Message);
+            }
+            if (WindowMessage.message == WM_KEYDOWN && WindowMessage.wParam == 'R' && CurrentDemo == Demo::CpuPathTracer)
+            {
+                // Reference render for ImageDiff.
+                std::string RenderDirectory = std::string(SOLUTION_DIR) + "Renders\\";
+                CreateDirectoryA(RenderDirectory.c_str(), nullptr);
+                CpuPathTracer::SaveImage(CPTData, (RenderDirectory + "CpuPathTracer.tga").c_str());
+            }
             
             // Key Up.
             if (WindowMessage.message == WM_KEYUP && CurrentDemo == Demo::MSExperiments)
@@ -194,46 +575,108 @@ int CALLBACK WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
                 MSEData.Camera.OnKeyUp(WindowMessage.wParam);
             }
             
+            // Held back until few enough presents are queued, then until the frame that last used this back buffer's
+            // resources is done.
+            auto WaitStart = std::chrono::high_resolution_clock::now();
+            WaitForSingleObjectEx(Dx.FrameLatencyWaitable, 1000, TRUE);
             Frame* CurrentFrame = &Data.Frames[BackBufferIndex];
+            D3D::WaitForFence(Dx.Fence.Get(), CurrentFrame->FenceValue, Dx.FenceEvent);
+            auto FrameStart = std::chrono::high_resolution_clock::now();
+            double PacingTime = std::chrono::duration<double>(FrameStart - PacingStart).count();
+            CurrentFrame->FenceValue = DeferredRelease::GetNextValue(Dx.FrameTimeline);
+            D3D::CollectReleases(&Dx, &Data.Releases);
+            FramePacing::CompleteFrames(&Dx.PacingTelemetry, D3D::UpdateFrameFence(&Dx), PacingTime);
+            FramePacing::BeginFrame(&Dx.PacingTelemetry, CurrentFrame->FenceValue, PacingTime,
+                                    std::chrono::duration<double>(FrameStart - WaitStart).count());
+            FramePacing::Report(&Dx.PacingTelemetry, Dx.Pacing, PacingTime, 5.0);
+
             ID3D12GraphicsCommandList7* CmdList = CurrentFrame->GraphicsCmdList.Get();
             Check(CurrentFrame->GraphicsCmdAlloc->Reset());
             Check(CmdList->Reset(CurrentFrame->GraphicsCmdAlloc.Get(), nullptr));
+            UploadRing::Retire(&Data.FrameUploads.Ring, Dx.Fence->GetCompletedValue());
+            DescriptorAllocator::BeginFrame(&Data.Descriptors.Allocator, BackBufferIndex); // Waited on above.
+            ParallelRecording::BeginFrame(&Data.RecordingLists.Pools, BackBufferIndex);
+
+            // What the frame's graphics work waits for on the other queues, their latest point is enough.
+            QueueScheduler::SyncPoint GraphicsDependencies[QueueScheduler::NumQueues];
+            UINT NumGraphicsDependencies = 0;
+
+            // Edited shaders of the demos that are set up are rebuilt, and swapped in before anything records.
+            std::vector<UINT> ChangedDemos;
+            if (D3D::PollShaderWatcher(&Watcher, PacingTime, &ChangedDemos))
+            {
+                ChangedDemos.erase(std::remove_if(ChangedDemos.begin(), ChangedDemos.end(),
+                                                  [&](UINT Changed) { return !IsInitialized(Changed); }),
+                                   ChangedDemos.end());
+                ShaderReload::Request(&Rebuilds, ChangedDemos);
+            }
+            ShaderReload::Update(&Rebuilds, StartReload, SwapReload);
+
+            // The requested demo takes over once its pipelines are ready.
+            if (ShaderCompilation::Update(&Demos, StartDemo))
+            {
+                CurrentDemo = (Demo)Demos.Current;
+                double Waited = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() -
+                                                              DemoRequested).count();
+                char Message[256];
+                snprintf(Message, sizeof(Message),
+                         "ShaderCompilation: demo %u ready after %.0f ms, %.0f ms of compiling on %u workers\n",
+                         Demos.Current, Waited * 1e3,
+                         ShaderCompilation::GetCompileSeconds(Demos.Futures[Demos.Current]) * 1e3,
+                         JobSystem::GetNumWorkers());
+                OutputDebugStringA(Message);
+                ShaderCache::Report(CompiledShaders.Cache);
+            }
 
             switch (CurrentDemo)
             {
             case Demo::NvidiaTutorial:
                 {
-                    if (!IsNvidiaTutorialInitialized)
+                    if (!IsNvidiaTutorialStreaming)
+                    {
+                        // The uploads go out with each frame's streaming budget, the tutorial renders nothing
+                        // until the last batch has been submitted.
+                        DXRTutorial::StreamGeometry(Device, &DXRData, &Data.Memory, &Data.Streaming);
+                        IsNvidiaTutorialStreaming = true;
+                    }
+
+                    QueueScheduler::SyncPoint GeometryUploaded;
+                    if (!IsNvidiaTutorialInitialized &&
+                        D3D::GetStreamingSyncPoint(Data.Streaming, DXRData.GeometryUploads, &GeometryUploaded))
                     {
-                        DXRTutorial::InitializeAccelerationStructures(Device, CmdList, &DXRData);
+                        // The BLAS builds wait on the GPU for the vertex buffers.
+                        DXRTutorial::InitializeAccelerationStructures(Device, CmdList, &CurrentFrame->GraphicsStates,
+                                                                      &DXRData, &Data.Memory,
+                                                                      CurrentFrame->FenceValue);
                 
-                        // Execute and flush.
-                        CmdList->Close();
-                        UINT64 FenceValueToWaitFor = CurrentFrame->FenceValue++;
-                        Dx.GraphicsQueue->ExecuteCommandLists(1, (ID3D12CommandList* const*)&CmdList);
-                        Check(Dx.GraphicsQueue->Signal(Dx.Fence.Get(), FenceValueToWaitFor));
-                        Check(Dx.Fence->SetEventOnCompletion(FenceValueToWaitFor, Dx.FenceEvent));
-                        WaitForSingleObject(Dx.FenceEvent, INFINITE);
+                        // Execute and flush, the rest of the frame retires at the next value.
+                        D3D::ExecuteTracked(&Dx.Timelines, CurrentFrame, &Data.States, &GeometryUploaded, 1);
+                        D3D::WaitForFence(Dx.Fence.Get(), D3D::SignalFrameFence(&Dx), Dx.FenceEvent);
+                        CurrentFrame->FenceValue = DeferredRelease::GetNextValue(Dx.FrameTimeline);
+                        DXRData.BottomLevelScratch.Reset(); // The BLAS builds are done.
+                        D3D::ReleasePlaced(DXRData.BottomLevelScratchRange);
                 
                         Check(CurrentFrame->GraphicsCmdAlloc->Reset());
                         Check(CmdList->Reset(CurrentFrame->GraphicsCmdAlloc.Get(), nullptr));
                 
-                        DXRData.RtShader.Filename = L"SimpleDXR.hlsl";
-                        DXRData.RtShader.TargetProfile = L"lib_6_3";
-                        DXRData.RtShader.Entry = L"";
-                        D3D::CompileShader(&Compiler, &DXRData.RtShader);
-                
-                        DXRTutorial::InitializeShaderBindings(Device, &DXRData, Data.OutputTexture.Get());
+                        DXRTutorial::InitializeShaderBindings(Device, &DXRData, &Data.Memory, &Data.Descriptors,
+                                                              Data.OutputTexture.Get());
                         NAME_D3D12_OBJECT(DXRData.ShaderTable);
                 
                         IsNvidiaTutorialInitialized = true;
                     }
 
-                    DXRTutorial::UpdateAndRender(DXRData,
-                                                 CurrentFrame,
-                                                 CmdList,
-                                                 Data.OutputTexture.Get(),
-                                                 Window.Width, Window.Height);
+                    if (IsNvidiaTutorialInitialized)
+                    {
+                        DXRTutorial::UpdateAndRender(Device,
+                                                     DXRData,
+                                                     CurrentFrame,
+                                                     CmdList,
+                                                     &Data.Descriptors,
+                                                     Data.OutputTexture.Get(),
+                                                     Window.Width, Window.Height,
+                                                     Dx.Fence.Get(), Dx.FenceEvent);
+                    }
                 }
                 break;
             
@@ -245,26 +688,7 @@ int CALLBACK WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
                         // Scene LoadedScene;
                         // D3D::LoadModel(R"(Models\\cornell_box\\cornell_box.gltf)", &LoadedScene);
 
-                        // Simple mesh + pixel shader.
-                        SLData.SimpleMS.Filename = L"SimpleMS.hlsl";
-                        SLData.SimpleMS.TargetProfile = L"ms_6_6";
-                        SLData.SimpleMS.Entry = L"MSMain";
-                        D3D::CompileShader(&Compiler, &SLData.SimpleMS);
-                        
-                        SLData.SimplePS.Filename = L"SimpleMS.hlsl";
-                        SLData.SimplePS.TargetProfile = L"ps_6_6";
-                        SLData.SimplePS.Entry = L"PSMain";
-                        D3D::CompileShader(&Compiler, &SLData.SimplePS);
-
-                        D3D12_ROOT_SIGNATURE_DESC1 RootSigDesc = {};
-                        D3D::CreateRootSignature(Device, &RootSigDesc, &SLData.RootSig);
-                        NAME_D3D12_OBJECT(SLData.RootSig);
-                        
-                        D3D::CreateMeshShaderPSO(Device,
-                                                 &SLData.SimpleMS, &SLData.SimplePS,
-                                                 SLData.RootSig.Get(),
-                                                 &SLData.GreenTrianglePSO);
-                        NAME_D3D12_OBJECT(SLData.GreenTrianglePSO);
+                        IsMSHelloTriangleInitialized = true;
                     }
                     MSHelloTriangle::UpdateAndRender(SLData, CurrentFrame, CmdList, Window.Width, Window.Height);
                 }
@@ -274,78 +698,65 @@ int CALLBACK WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
                 {
                     if (!IsHelloBindlessInitialized)
                     {
-                        // Create a compute shader.
-                        QCSData.BindlessShader.Filename = L"SimpleBindless.hlsl";
-                        QCSData.BindlessShader.TargetProfile = L"cs_6_7";
-                        QCSData.BindlessShader.Entry = L"Main";
-                        D3D::CompileShader(&Compiler, &QCSData.BindlessShader);
-
-                        // Create the compute synchronization objects specific to this app.
-                        QCSData.FenceEvent = CreateEventEx(nullptr, "QCSData->FenceEvent", FALSE, EVENT_ALL_ACCESS);
-                        Check(Device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&QCSData.Fence)));
-                        NAME_D3D12_OBJECT(QCSData.Fence);
-
-                        // Bindless setup.
-                        D3D12_ROOT_SIGNATURE_DESC1 RootSigDesc = {};
-                        RootSigDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_CBV_SRV_UAV_HEAP_DIRECTLY_INDEXED;
-                        D3D::CreateRootSignature(Device, &RootSigDesc, &QCSData.RootSig);
-                        NAME_D3D12_OBJECT(QCSData.RootSig);
-
-                        D3D12_COMPUTE_PIPELINE_STATE_DESC PSODesc = {};
-                        PSODesc.CS.pShaderBytecode = QCSData.BindlessShader.Blob->GetBufferPointer();
-                        PSODesc.CS.BytecodeLength = QCSData.BindlessShader.Blob->GetBufferSize();
-                        PSODesc.pRootSignature = QCSData.RootSig.Get();
-                        Check(Device->CreateComputePipelineState(&PSODesc, IID_PPV_ARGS(&QCSData.PSO)));
-                        NAME_D3D12_OBJECT(QCSData.PSO);
-                        
-                        D3D12_DESCRIPTOR_HEAP_DESC CSUHeapDesc = {};
-                        CSUHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-                        CSUHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-                        CSUHeapDesc.NumDescriptors = 1;
-                        Device->CreateDescriptorHeap(&CSUHeapDesc, IID_PPV_ARGS(&QCSData.CSUHeap));
-                        NAME_D3D12_OBJECT(QCSData.CSUHeap);
+                        QCSData.OutputUAV = DescriptorAllocator::Allocate(&Data.Descriptors.Allocator);
+                        assert(QCSData.OutputUAV != DescriptorAllocator::InvalidHandle);
 
                         D3D12_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
                         UAVDesc.Format = GlobalResources::BackBufferFormat;
                         UAVDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
-                        Device->CreateUnorderedAccessView(Data.OutputTexture.Get(), nullptr, &UAVDesc, QCSData.CSUHeap->GetCPUDescriptorHandleForHeapStart());
+                        Device->CreateUnorderedAccessView(Data.OutputTexture.Get(), nullptr, &UAVDesc,
+                                                          D3D::GetCpuHandle(Data.Descriptors,
+                                                                            DescriptorAllocator::GetIndex(QCSData.OutputUAV)));
 
                         IsHelloBindlessInitialized = true; 
                     }
 
-                    // Wait before resetting.
-                    Check(QCSData.Fence->SetEventOnCompletion(QCSData.FenceValue, QCSData.FenceEvent));
-                    WaitForSingleObject(QCSData.FenceEvent, INFINITE);
-
-                    // Reset.
+                    // The frame's last compute work is done, the graphics work its fence paces waited for it.
                     ID3D12GraphicsCommandList7* CCmdList = CurrentFrame->ComputeCmdList.Get();
                     Check(CurrentFrame->ComputeCmdAlloc->Reset());
                     Check(CCmdList->Reset(CurrentFrame->ComputeCmdAlloc.Get(), nullptr));
 
-                    D3D::Transition(CmdList,
-                                    D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-                                    Data.OutputTexture.Get());
-                    
-                    // Render.
-                    HelloBindless::UpdateAndRender(QCSData, CCmdList, Window.Width, Window.Height);
-                    
-                    Check(CCmdList->Close());
-                    Dx.ComputeQueue->ExecuteCommandLists(1, (ID3D12CommandList* const*)(&CCmdList));
-                    Dx.ComputeQueue->Signal(QCSData.Fence.Get(), QCSData.FenceValue + 1);
-                    
-                    D3D::Transition(CmdList,
-                                    D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE,  
-                                    Data.OutputTexture.Get());
-                    D3D::Transition(CmdList,
-                                    D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_COPY_DEST,
-                                    CurrentFrame->BackBuffer.Get());
-                    
-                    CmdList->CopyResource(CurrentFrame->BackBuffer.Get(), Data.OutputTexture.Get());
-                    
-                    D3D::Transition(CmdList,
-                                    D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PRESENT,
-                                    CurrentFrame->BackBuffer.Get());
-                        
+                    // The frame as a graph, it's only compiled again when the passes change.
+                    RenderGraphResources* Graph = &QCSData.Graph;
+                    D3D::BeginRenderGraph(Graph);
+                    RenderGraph::ResourceId Output = D3D::ImportResource(Graph, Data.OutputTexture.Get(),
+                                                                         D3D12_RESOURCE_STATE_COPY_SOURCE,
+                                                                         D3D12_RESOURCE_STATE_COPY_SOURCE);
+                    RenderGraph::ResourceId BackBuffer = D3D::ImportResource(Graph, CurrentFrame->BackBuffer.Get(),
+                                                                             D3D12_RESOURCE_STATE_PRESENT,
+                                                                             D3D12_RESOURCE_STATE_PRESENT);
+
+                    // On the compute queue, after the last graphics work that copied out of the output and before
+                    // this frame's. The compute list takes the output to UAV and back itself, so on the graphics queue
+                    // it stays in COPY_SOURCE.
+                    RenderGraph::AddPass(&Graph->Graph, "Bindless", [&]()
+                    {
+                        ID3D12Resource* OutputTexture = D3D::GetResource(*Graph, Output);
+                        D3D::Transition(CCmdList, D3D12_RESOURCE_STATE_COPY_SOURCE,
+                                        D3D12_RESOURCE_STATE_UNORDERED_ACCESS, OutputTexture,
+                                        D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+                        HelloBindless::UpdateAndRender(QCSData, CCmdList, &Data.Descriptors, Window.Width,
+                                                       Window.Height);
+                        D3D::Transition(CCmdList, D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+                                        D3D12_RESOURCE_STATE_COPY_SOURCE, OutputTexture,
+                                        D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+                        Check(CCmdList->Close());
+
+                        GraphicsDependencies[NumGraphicsDependencies++] =
+                            D3D::Submit(&Dx.Timelines, QueueScheduler::QueueType::Compute,
+                                        (ID3D12CommandList* const*)(&CCmdList), 1, &LastGraphicsWork, 1);
+                    });
+                    RenderGraph::Write(&Graph->Graph, Output, D3D12_RESOURCE_STATE_COPY_SOURCE);
+
+                    RenderGraph::AddPass(&Graph->Graph, "Copy to back buffer", [&]()
+                    {
+                        CmdList->CopyResource(D3D::GetResource(*Graph, BackBuffer), D3D::GetResource(*Graph, Output));
+                    });
+                    RenderGraph::Read(&Graph->Graph, Output, D3D12_RESOURCE_STATE_COPY_SOURCE);
+                    RenderGraph::Write(&Graph->Graph, BackBuffer, D3D12_RESOURCE_STATE_COPY_DEST);
+
+                    D3D::ExecuteRenderGraph(Device, CmdList, &CurrentFrame->GraphicsStates, Graph, &Data.Releases,
+                                            D3D::GetFrameRetirePoint(Dx));
                 }
                 break;
                 
@@ -355,52 +766,21 @@ int CALLBACK WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
                     {
                         MSEData.Camera.Init({0.f, 0.f, 15.f});
                         MSEData.Camera.SetMoveSpeed(20.f);
-                        
-                        // Simple mesh + pixel shader.
-                        MSEData.SimpleMS.Filename = L"MSExperiment.hlsl";
-                        MSEData.SimpleMS.TargetProfile = L"ms_6_6";
-                        MSEData.SimpleMS.Entry = L"MSMain";
-                        D3D::CompileShader(&Compiler, &MSEData.SimpleMS);
-                        
-                        MSEData.SimplePS.Filename = L"MSExperiment.hlsl";
-                        MSEData.SimplePS.TargetProfile = L"ps_6_6";
-                        MSEData.SimplePS.Entry = L"PSMain";
-                        D3D::CompileShader(&Compiler, &MSEData.SimplePS);
-
-                        D3D12_ROOT_SIGNATURE_DESC1 RootSigDesc = {};
-                        RootSigDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_CBV_SRV_UAV_HEAP_DIRECTLY_INDEXED;
-                        D3D::CreateRootSignature(Device, &RootSigDesc, &MSEData.RootSig);
-                        NAME_D3D12_OBJECT(MSEData.RootSig);
-                        
-                        D3D::CreateMeshShaderPSO(Device,
-                                                 &MSEData.SimpleMS, &MSEData.SimplePS,
-                                                 MSEData.RootSig.Get(),
-                                                 &MSEData.CubeInstancingPSO);
-                        NAME_D3D12_OBJECT(MSEData.CubeInstancingPSO);
-
-                        D3D12_DESCRIPTOR_HEAP_DESC CSUHeapDesc = {};
-                        CSUHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-                        CSUHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-                        CSUHeapDesc.NumDescriptors = 1;
-                        Device->CreateDescriptorHeap(&CSUHeapDesc, IID_PPV_ARGS(&MSEData.CSUHeap));
-                        NAME_D3D12_OBJECT(MSEData.CSUHeap);
-
-                        // TODO: Confirm that we need unique data per frame.
-                        D3D::CreateCommittedBuffer(Device,
-                                                   D3D12_HEAP_TYPE_GPU_UPLOAD,
-                                                   sizeof(Constants),
-                                                   &MSEData.SceneConstantsBuffer);
-                        NAME_D3D12_OBJECT(MSEData.SceneConstantsBuffer);
-                        Check(MSEData.SceneConstantsBuffer->Map(0, nullptr, (void**)&MSEData.SceneConstants));
-
-                        D3D12_CONSTANT_BUFFER_VIEW_DESC SceneConstantsCbvDesc = {};
-                        SceneConstantsCbvDesc.BufferLocation = MSEData.SceneConstantsBuffer->GetGPUVirtualAddress();
-                        SceneConstantsCbvDesc.SizeInBytes = sizeof(Constants);
-                        Device->CreateConstantBufferView(&SceneConstantsCbvDesc, MSEData.CSUHeap->GetCPUDescriptorHandleForHeapStart());
-
                         IsMSExperimentsInitialized = true;
                     }
-                    MSExperiments::UpdateAndRender(MSEData, CurrentFrame, CmdList, Window.Width, Window.Height);
+                    MSExperiments::UpdateAndRender(Device, MSEData, CurrentFrame, &Data.RecordingLists,
+                                                   &Data.FrameUploads, Window.Width, Window.Height);
+                }
+                break;
+                
+            case Demo::CpuPathTracer:
+                {
+                    if (!IsCpuPathTracerInitialized)
+                    {
+                        CpuPathTracer::Initialize(Device, &CPTData, CurrentFrame->BackBuffer.Get());
+                        IsCpuPathTracerInitialized = true;
+                    }
+                    CpuPathTracer::UpdateAndRender(CPTData, CurrentFrame, CmdList);
                 }
                 break;
                 
@@ -410,8 +790,9 @@ int CALLBACK WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
                 break;
             }
             
-            Check(CmdList->Close());
-            Dx.GraphicsQueue->ExecuteCommandLists(1, (ID3D12CommandList* const*)(&CmdList));
+            D3D::SubmitStreamingUploads(&Dx.Timelines, &Data.Streaming);
+            LastGraphicsWork = D3D::ExecuteTracked(&Dx.Timelines, CurrentFrame, &Data.States, GraphicsDependencies,
+                                                   NumGraphicsDependencies);
 
             HRESULT Hr = Dx.SwapChain->Present(Dx.VSync ? Dx.NumVSyncIntervals : 0,
                                               !Dx.VSync ? DXGI_PRESENT_ALLOW_TEARING : 0);
@@ -420,32 +801,21 @@ int CALLBACK WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
                 Check(Device->GetDeviceRemovedReason()); 
             }
 
-            UINT64 CurrentFenceValue = CurrentFrame->FenceValue;
-            Check(Dx.GraphicsQueue->Signal(Dx.Fence.Get(), CurrentFenceValue));
-
-            // Don't go too fast, make sure the next frame is ready to be rendered
-            // by making sure the graphics queue has completed executing and presenting the current frame.
-            UINT64 CompletedValue = Dx.Fence->GetCompletedValue();
-            if (CompletedValue < CurrentFenceValue)
-            {
-                // Wait.
-                Check(Dx.Fence->SetEventOnCompletion(CurrentFenceValue, Dx.FenceEvent));
-                WaitForSingleObject(Dx.FenceEvent, INFINITE);
-            }
+            // The next frame waits for the one that used its back buffer before, not for this one.
+            UINT64 CurrentFenceValue = D3D::SignalFrameFence(&Dx);
+            assert(CurrentFenceValue == CurrentFrame->FenceValue);
+            UploadRing::EndFrame(&Data.FrameUploads.Ring, CurrentFenceValue);
 
             BackBufferIndex = Dx.SwapChain->GetCurrentBackBufferIndex();
-            UINT64 NextFrameFenceValue = CurrentFenceValue + 1;
-            Data.Frames[BackBufferIndex].FenceValue = NextFrameFenceValue;
 
             WindowMessage = WindowMessageLoop();
         } while (WindowMessage.message != WM_QUIT);
 
+        ShaderCompilation::WaitForAll(&Compilations);
+        D3D::DestroyShaderWatcher(&Watcher);
+        D3D::CloseShaderCache(&CompiledShaders);
+        D3D::FlushReleases(&Dx, &Data.Releases);
         DestroyWindow(&Window, hInstance);
-
-        for (int i = 0; i < GlobalResources::NumBackBuffers; ++i)
-        {
-            Data.Frames[i].BackBuffer->Release();
-        }
     }
 #ifdef _DEBUG
         ComPtr<IDXGIDebug1> dxgiDebug;
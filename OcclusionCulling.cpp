@@ -0,0 +1,792 @@
+#include "Headers/OcclusionCulling.h"
+#include "Headers/Threading.h"
+#include <algorithm>
+#include <chrono>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <immintrin.h>
+
+using namespace DirectX;
+
+namespace OcclusionCulling
+{
+    void AddQuad(Occluders* InOccluders, const XMFLOAT3& A, const XMFLOAT3& B, const XMFLOAT3& C, const XMFLOAT3& D)
+    {
+        InOccluders->Vertices.push_back(A);
+        InOccluders->Vertices.push_back(B);
+        InOccluders->Vertices.push_back(C);
+        InOccluders->Vertices.push_back(D);
+    }
+
+    void AddTriangles(Occluders* InOccluders, const XMFLOAT3* Vertices, UINT NumVertices)
+    {
+        for (UINT i = 0; i + 2 < NumVertices; i += 3)
+        {
+            AddQuad(InOccluders, Vertices[i], Vertices[i + 1], Vertices[i + 2], Vertices[i + 2]);
+        }
+    }
+
+    void AddBox(Occluders* InOccluders, const XMFLOAT3& Min, const XMFLOAT3& Max)
+    {
+        // Corner i takes Max on the axes whose bit is set. Winding doesn't matter.
+        static const UINT Indices[24] = {
+            0, 2, 3, 1, // -X
+            4, 5, 7, 6, // +X
+            0, 1, 5, 4, // -Y
+            2, 6, 7, 3, // +Y
+            0, 4, 6, 2, // -Z
+            1, 3, 7, 5  // +Z
+        };
+        XMFLOAT3 Corners[8];
+        for (UINT i = 0; i < 8; ++i)
+        {
+            Corners[i] = XMFLOAT3(i & 4 ? Max.x : Min.x, i & 2 ? Max.y : Min.y, i & 1 ? Max.z : Min.z);
+        }
+        for (UINT i = 0; i < _countof(Indices); ++i)
+        {
+            InOccluders->Vertices.push_back(Corners[Indices[i]]);
+        }
+    }
+
+    void Initialize(DepthPyramid* Pyramid, UINT Width, UINT Height)
+    {
+        assert(Width % BatchSize == 0);
+        assert((Width & (Width - 1)) == 0 && (Height & (Height - 1)) == 0);
+
+        Pyramid->Width = Width;
+        Pyramid->Height = Height;
+        Pyramid->LevelOffsets.clear();
+        UINT NumDepths = 0;
+        for (UINT LevelWidth = Width, LevelHeight = Height;; LevelWidth = (LevelWidth + 1) / 2, LevelHeight = (LevelHeight + 1) / 2)
+        {
+            Pyramid->LevelOffsets.push_back(NumDepths);
+            NumDepths += LevelWidth * LevelHeight;
+            if (LevelWidth == 1 && LevelHeight == 1)
+            {
+                break;
+            }
+        }
+        Pyramid->Depths.assign(NumDepths, 1.f);
+        XMStoreFloat4x4(&Pyramid->ViewProjection, XMMatrixIdentity());
+    }
+
+    static XMFLOAT4 TransformPoint(const XMFLOAT4X4& M, float X, float Y, float Z)
+    {
+        return XMFLOAT4(X * M.m[0][0] + Y * M.m[1][0] + Z * M.m[2][0] + M.m[3][0],
+                        X * M.m[0][1] + Y * M.m[1][1] + Z * M.m[2][1] + M.m[3][1],
+                        X * M.m[0][2] + Y * M.m[1][2] + Z * M.m[2][2] + M.m[3][2],
+                        X * M.m[0][3] + Y * M.m[1][3] + Z * M.m[2][3] + M.m[3][3]);
+    }
+
+    // Signed distance to the near plane and the guard band, inside when >= 0.
+    static float ClipDistance(const XMFLOAT4& V, UINT Plane)
+    {
+        switch (Plane)
+        {
+        case 0: return V.z;
+        case 1: return GuardBand * V.w - V.x;
+        case 2: return GuardBand * V.w + V.x;
+        case 3: return GuardBand * V.w - V.y;
+        default: return GuardBand * V.w + V.y;
+        }
+    }
+
+    // Sutherland-Hodgman, every plane adds at most one vertex.
+    static UINT ClipPolygon(XMFLOAT4* Polygon, UINT NumVertices)
+    {
+        XMFLOAT4 Clipped[MaxClippedVertices];
+        for (UINT Plane = 0; Plane < 5 && NumVertices > 0; ++Plane)
+        {
+            UINT NumClipped = 0;
+            for (UINT i = 0; i < NumVertices; ++i)
+            {
+                const XMFLOAT4& A = Polygon[i];
+                const XMFLOAT4& B = Polygon[(i + 1) % NumVertices];
+                float DistanceA = ClipDistance(A, Plane);
+                float DistanceB = ClipDistance(B, Plane);
+                if (DistanceA >= 0.f)
+                {
+                    Clipped[NumClipped++] = A;
+                }
+                if ((DistanceA >= 0.f) != (DistanceB >= 0.f))
+                {
+                    float T = DistanceA / (DistanceA - DistanceB);
+                    Clipped[NumClipped++] = XMFLOAT4(A.x + (B.x - A.x) * T, A.y + (B.y - A.y) * T,
+                                                     A.z + (B.z - A.z) * T, A.w + (B.w - A.w) * T);
+                }
+            }
+            memcpy(Polygon, Clipped, NumClipped * sizeof(XMFLOAT4));
+            NumVertices = NumClipped;
+        }
+        return NumVertices;
+    }
+
+    // Only the polygon's outline is pulled in, pixels straddling the edges between its triangles are still covered.
+    static void SetupTriangle(const XMFLOAT3& V0, XMFLOAT3 V1, XMFLOAT3 V2, const bool Outline[3], UINT Width, UINT Height,
+                              std::vector<DepthPyramid::Triangle>* Triangles)
+    {
+        bool IsOutline[3] = {Outline[0], Outline[1], Outline[2]};
+        float Area = (V1.x - V0.x) * (V2.y - V0.y) - (V2.x - V0.x) * (V1.y - V0.y);
+        if (fabsf(Area) < 1e-6f)
+        {
+            return;
+        }
+        if (Area < 0.f)
+        {
+            XMFLOAT3 Swap = V1;
+            V1 = V2;
+            V2 = Swap;
+            Area = -Area;
+            bool SwapOutline = IsOutline[0];
+            IsOutline[0] = IsOutline[2];
+            IsOutline[2] = SwapOutline;
+        }
+
+        DepthPyramid::Triangle Tri;
+        const XMFLOAT3* Vertices[3] = {&V0, &V1, &V2};
+        for (UINT Edge = 0; Edge < 3; ++Edge)
+        {
+            const XMFLOAT3& A = *Vertices[Edge];
+            const XMFLOAT3& B = *Vertices[(Edge + 1) % 3];
+            Tri.EdgeA[Edge] = A.y - B.y;
+            Tri.EdgeB[Edge] = B.x - A.x;
+            // Pull the edge in by half a pixel so only pixels covered all over pass.
+            Tri.EdgeC[Edge] = -(Tri.EdgeA[Edge] * A.x + Tri.EdgeB[Edge] * A.y);
+            if (IsOutline[Edge])
+            {
+                Tri.EdgeC[Edge] -= 0.5f * (fabsf(Tri.EdgeA[Edge]) + fabsf(Tri.EdgeB[Edge]));
+            }
+        }
+
+        // Depth is affine in screen space; push it to its furthest over the pixel.
+        Tri.DepthX = ((V1.z - V0.z) * (V2.y - V0.y) - (V2.z - V0.z) * (V1.y - V0.y)) / Area;
+        Tri.DepthY = ((V2.z - V0.z) * (V1.x - V0.x) - (V1.z - V0.z) * (V2.x - V0.x)) / Area;
+        Tri.DepthC = V0.z - Tri.DepthX * V0.x - Tri.DepthY * V0.y + 0.5f * (fabsf(Tri.DepthX) + fabsf(Tri.DepthY));
+
+        float MinX = std::min(V0.x, std::min(V1.x, V2.x));
+        float MaxX = std::max(V0.x, std::max(V1.x, V2.x));
+        float MinY = std::min(V0.y, std::min(V1.y, V2.y));
+        float MaxY = std::max(V0.y, std::max(V1.y, V2.y));
+        Tri.MinX = (INT)std::max(floorf(MinX), 0.f) & ~(INT)(BatchSize - 1);
+        Tri.MaxX = (INT)std::min(ceilf(MaxX), (float)Width - 1.f);
+        Tri.MinY = (INT)std::max(floorf(MinY), 0.f);
+        Tri.MaxY = (INT)std::min(ceilf(MaxY), (float)Height - 1.f);
+        if (Tri.MinX <= Tri.MaxX && Tri.MinY <= Tri.MaxY)
+        {
+            Triangles->push_back(Tri);
+        }
+    }
+
+    static void RasterizeBand(const DepthPyramid::Triangle& Tri, INT BandBegin, INT BandEnd, UINT Width, float* Depth)
+    {
+        const __m256 LaneOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+        const __m256 Zero = _mm256_setzero_ps();
+        const __m256 One = _mm256_set1_ps(1.f);
+        const __m256 A0 = _mm256_set1_ps(Tri.EdgeA[0]);
+        const __m256 A1 = _mm256_set1_ps(Tri.EdgeA[1]);
+        const __m256 A2 = _mm256_set1_ps(Tri.EdgeA[2]);
+        const __m256 DepthX = _mm256_set1_ps(Tri.DepthX);
+
+        INT MinY = Tri.MinY > BandBegin ? Tri.MinY : BandBegin;
+        INT MaxY = Tri.MaxY < BandEnd - 1 ? Tri.MaxY : BandEnd - 1;
+        for (INT Y = MinY; Y <= MaxY; ++Y)
+        {
+            float PixelY = (float)Y + 0.5f;
+            __m256 Row0 = _mm256_set1_ps(Tri.EdgeB[0] * PixelY + Tri.EdgeC[0]);
+            __m256 Row1 = _mm256_set1_ps(Tri.EdgeB[1] * PixelY + Tri.EdgeC[1]);
+            __m256 Row2 = _mm256_set1_ps(Tri.EdgeB[2] * PixelY + Tri.EdgeC[2]);
+            __m256 RowDepth = _mm256_set1_ps(Tri.DepthY * PixelY + Tri.DepthC);
+            float* DepthRow = Depth + Y * Width;
+
+            for (INT X = Tri.MinX; X <= Tri.MaxX; X += BatchSize)
+            {
+                __m256 PixelX = _mm256_add_ps(_mm256_set1_ps((float)X), LaneOffsets);
+                __m256 Inside = _mm256_and_ps(_mm256_cmp_ps(_mm256_fmadd_ps(A0, PixelX, Row0), Zero, _CMP_GE_OQ),
+                                              _mm256_cmp_ps(_mm256_fmadd_ps(A1, PixelX, Row1), Zero, _CMP_GE_OQ));
+                Inside = _mm256_and_ps(Inside, _mm256_cmp_ps(_mm256_fmadd_ps(A2, PixelX, Row2), Zero, _CMP_GE_OQ));
+                if (_mm256_movemask_ps(Inside) == 0)
+                {
+                    continue;
+                }
+
+                __m256 TriangleDepth = _mm256_min_ps(_mm256_fmadd_ps(DepthX, PixelX, RowDepth), One);
+                __m256 Current = _mm256_loadu_ps(DepthRow + X);
+                _mm256_storeu_ps(DepthRow + X, _mm256_blendv_ps(Current, _mm256_min_ps(Current, TriangleDepth), Inside));
+            }
+        }
+    }
+
+    static void BuildPyramid(DepthPyramid* Pyramid)
+    {
+        UINT SourceWidth = Pyramid->Width;
+        UINT SourceHeight = Pyramid->Height;
+        for (size_t Level = 1; Level < Pyramid->LevelOffsets.size(); ++Level)
+        {
+            const float* Source = Pyramid->Depths.data() + Pyramid->LevelOffsets[Level - 1];
+            float* Dest = Pyramid->Depths.data() + Pyramid->LevelOffsets[Level];
+            UINT Width = (SourceWidth + 1) / 2;
+            UINT Height = (SourceHeight + 1) / 2;
+            for (UINT Y = 0; Y < Height; ++Y)
+            {
+                UINT Y0 = 2 * Y;
+                UINT Y1 = 2 * Y + 1 < SourceHeight ? 2 * Y + 1 : Y0;
+                for (UINT X = 0; X < Width; ++X)
+                {
+                    UINT X0 = 2 * X;
+                    UINT X1 = 2 * X + 1 < SourceWidth ? 2 * X + 1 : X0;
+                    Dest[Y * Width + X] = std::max(std::max(Source[Y0 * SourceWidth + X0], Source[Y0 * SourceWidth + X1]),
+                                                    std::max(Source[Y1 * SourceWidth + X0], Source[Y1 * SourceWidth + X1]));
+                }
+            }
+            SourceWidth = Width;
+            SourceHeight = Height;
+        }
+    }
+
+    void Render(const Occluders& InOccluders, FXMMATRIX ViewProjection, DepthPyramid* Pyramid, UINT NumThreads)
+    {
+        XMStoreFloat4x4(&Pyramid->ViewProjection, ViewProjection);
+        const XMFLOAT4X4& M = Pyramid->ViewProjection;
+        UINT Width = Pyramid->Width;
+        UINT Height = Pyramid->Height;
+
+        // Clip to screen-space triangles with their edge and depth equations. Occluders are few, this stays serial.
+        Pyramid->Triangles.clear();
+        UINT NumVertices = (UINT)InOccluders.Vertices.size();
+        for (UINT i = 0; i + 3 < NumVertices; i += 4)
+        {
+            XMFLOAT4 Polygon[MaxClippedVertices];
+            for (UINT v = 0; v < 4; ++v)
+            {
+                const XMFLOAT3& Vertex = InOccluders.Vertices[i + v];
+                Polygon[v] = TransformPoint(M, Vertex.x, Vertex.y, Vertex.z);
+            }
+            UINT NumClipped = ClipPolygon(Polygon, 4);
+
+            // Repeated vertices, from triangles or clipping, would make a fan edge look like the outline.
+            XMFLOAT3 Screen[MaxClippedVertices];
+            UINT NumScreen = 0;
+            for (UINT v = 0; v < NumClipped; ++v)
+            {
+                float InvW = 1.f / Polygon[v].w;
+                XMFLOAT3 Vertex((Polygon[v].x * InvW * 0.5f + 0.5f) * (float)Width,
+                                (0.5f - Polygon[v].y * InvW * 0.5f) * (float)Height,
+                                Polygon[v].z * InvW);
+                if (NumScreen == 0 || Vertex.x != Screen[NumScreen - 1].x || Vertex.y != Screen[NumScreen - 1].y)
+                {
+                    Screen[NumScreen++] = Vertex;
+                }
+            }
+            while (NumScreen > 1 && Screen[NumScreen - 1].x == Screen[0].x && Screen[NumScreen - 1].y == Screen[0].y)
+            {
+                --NumScreen;
+            }
+
+            for (UINT v = 2; v < NumScreen; ++v)
+            {
+                const bool Outline[3] = {v == 2, true, v + 1 == NumScreen};
+                SetupTriangle(Screen[0], Screen[v - 1], Screen[v], Outline, Width, Height, &Pyramid->Triangles);
+            }
+        }
+
+        // Bands own their rows, so the depth buffer is the same for any thread count.
+        float* Depth = Pyramid->Depths.data();
+        std::fill(Depth, Depth + Width * Height, 1.f);
+        Threading::ParallelFor(Height, NumThreads, BandHeight, [&](UINT Begin, UINT End)
+        {
+            for (const DepthPyramid::Triangle& Tri : Pyramid->Triangles)
+            {
+                if (Tri.MaxY >= (INT)Begin && Tri.MinY < (INT)End)
+                {
+                    RasterizeBand(Tri, (INT)Begin, (INT)End, Width, Depth);
+                }
+            }
+        });
+
+        BuildPyramid(Pyramid);
+    }
+
+    // Boxes are visible unless their nearest depth lies behind the furthest occluder depth over their screen rectangle.
+    static bool IsOccluded(const DepthPyramid& Pyramid, float MinX, float MinY, float MaxX, float MaxY, float MinDepth)
+    {
+        INT Width = (INT)Pyramid.Width;
+        INT Height = (INT)Pyramid.Height;
+        if (MaxX < 0.f || MaxY < 0.f || MinX >= (float)Width || MinY >= (float)Height)
+        {
+            return false; // Off screen, the frustum culler's call.
+        }
+        INT X0 = (INT)std::max(floorf(MinX), 0.f);
+        INT Y0 = (INT)std::max(floorf(MinY), 0.f);
+        INT X1 = (INT)std::min(floorf(MaxX), (float)(Width - 1));
+        INT Y1 = (INT)std::min(floorf(MaxY), (float)(Height - 1));
+
+        // The first level where the rectangle spans at most 2x2 texels.
+        UINT Level = 0;
+        while (Level + 1 < Pyramid.LevelOffsets.size() && ((X1 >> Level) - (X0 >> Level) > 1 || (Y1 >> Level) - (Y0 >> Level) > 1))
+        {
+            ++Level;
+        }
+
+        INT LevelWidth = std::max(Width >> Level, 1);
+        const float* Texels = Pyramid.Depths.data() + Pyramid.LevelOffsets[Level];
+        X0 >>= Level;
+        Y0 >>= Level;
+        X1 >>= Level;
+        Y1 >>= Level;
+        float MaxDepth = std::max(std::max(Texels[Y0 * LevelWidth + X0], Texels[Y0 * LevelWidth + X1]),
+                                   std::max(Texels[Y1 * LevelWidth + X0], Texels[Y1 * LevelWidth + X1]));
+        return MinDepth > MaxDepth;
+    }
+
+    bool IsVisible(const DepthPyramid& Pyramid, const XMFLOAT3& Min, const XMFLOAT3& Max)
+    {
+        // The min corner's clip position, and what going to the max along each axis adds to it.
+        const XMFLOAT4X4& M = Pyramid.ViewProjection;
+        XMFLOAT4 Base = TransformPoint(M, Min.x, Min.y, Min.z);
+        float AlongX[4], AlongY[4], AlongZ[4];
+        for (UINT Column = 0; Column < 4; ++Column)
+        {
+            AlongX[Column] = (Max.x - Min.x) * M.m[0][Column];
+            AlongY[Column] = (Max.y - Min.y) * M.m[1][Column];
+            AlongZ[Column] = (Max.z - Min.z) * M.m[2][Column];
+        }
+
+        float MinX = FLT_MAX, MinY = FLT_MAX, MaxX = -FLT_MAX, MaxY = -FLT_MAX, MinDepth = FLT_MAX;
+        for (UINT Corner = 0; Corner < 8; ++Corner)
+        {
+            float Components[4] = {Base.x, Base.y, Base.z, Base.w};
+            for (UINT Column = 0; Column < 4; ++Column)
+            {
+                Components[Column] += Corner & 1 ? AlongX[Column] : 0.f;
+                Components[Column] += Corner & 2 ? AlongY[Column] : 0.f;
+                Components[Column] += Corner & 4 ? AlongZ[Column] : 0.f;
+            }
+            XMFLOAT4 Clip(Components[0], Components[1], Components[2], Components[3]);
+            if (Clip.z < 0.f || Clip.w <= 0.f)
+            {
+                return true;
+            }
+            float InvW = 1.f / Clip.w;
+            float X = (Clip.x * InvW * 0.5f + 0.5f) * (float)Pyramid.Width;
+            float Y = (0.5f - Clip.y * InvW * 0.5f) * (float)Pyramid.Height;
+            MinX = std::min(MinX, X);
+            MaxX = std::max(MaxX, X);
+            MinY = std::min(MinY, Y);
+            MaxY = std::max(MaxY, Y);
+            MinDepth = std::min(MinDepth, Clip.z * InvW);
+        }
+        return !IsOccluded(Pyramid, MinX, MinY, MaxX, MaxY, MinDepth);
+    }
+
+    static UINT CullRange(const DepthPyramid& Pyramid, const FrustumCulling::Bounds& InBounds,
+                          const UINT* Candidates, UINT Begin, UINT End, UINT* OutVisible)
+    {
+        const XMFLOAT4X4& M = Pyramid.ViewProjection;
+        __m256 Matrix[4][4];
+        for (UINT Row = 0; Row < 4; ++Row)
+        {
+            for (UINT Column = 0; Column < 4; ++Column)
+            {
+                Matrix[Row][Column] = _mm256_set1_ps(M.m[Row][Column]);
+            }
+        }
+        const __m256 Half = _mm256_set1_ps(0.5f);
+        const __m256 One = _mm256_set1_ps(1.f);
+        const __m256 Zero = _mm256_setzero_ps();
+        const __m256 Width = _mm256_set1_ps((float)Pyramid.Width);
+        const __m256 Height = _mm256_set1_ps((float)Pyramid.Height);
+        const __m256 LastX = _mm256_set1_ps((float)(Pyramid.Width - 1));
+        const __m256 LastY = _mm256_set1_ps((float)(Pyramid.Height - 1));
+        const __m256i WidthTexels = _mm256_set1_epi32((int)Pyramid.Width);
+        const __m256i OneTexel = _mm256_set1_epi32(1);
+        const UINT NumLevels = (UINT)Pyramid.LevelOffsets.size();
+
+        UINT NumVisible = 0;
+        UINT Index = Begin;
+        for (; Index + BatchSize <= End; Index += BatchSize)
+        {
+            // Candidates are read before any index is written back, so OutVisible can alias them.
+            __m256i Ids = _mm256_loadu_si256((const __m256i*)(Candidates + Index));
+            __m256 Bounds[2][3] = {
+                {_mm256_i32gather_ps(InBounds.MinX.data(), Ids, 4), _mm256_i32gather_ps(InBounds.MinY.data(), Ids, 4),
+                 _mm256_i32gather_ps(InBounds.MinZ.data(), Ids, 4)},
+                {_mm256_i32gather_ps(InBounds.MaxX.data(), Ids, 4), _mm256_i32gather_ps(InBounds.MaxY.data(), Ids, 4),
+                 _mm256_i32gather_ps(InBounds.MaxZ.data(), Ids, 4)}
+            };
+
+            // Same operations as IsVisible, without FMA, for eight boxes at once.
+            __m256 Base[4], AlongX[4], AlongY[4], AlongZ[4];
+            __m256 ExtentX = _mm256_sub_ps(Bounds[1][0], Bounds[0][0]);
+            __m256 ExtentY = _mm256_sub_ps(Bounds[1][1], Bounds[0][1]);
+            __m256 ExtentZ = _mm256_sub_ps(Bounds[1][2], Bounds[0][2]);
+            for (UINT Column = 0; Column < 4; ++Column)
+            {
+                Base[Column] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(Bounds[0][0], Matrix[0][Column]),
+                                                                         _mm256_mul_ps(Bounds[0][1], Matrix[1][Column])),
+                                                           _mm256_mul_ps(Bounds[0][2], Matrix[2][Column])),
+                                             Matrix[3][Column]);
+                AlongX[Column] = _mm256_mul_ps(ExtentX, Matrix[0][Column]);
+                AlongY[Column] = _mm256_mul_ps(ExtentY, Matrix[1][Column]);
+                AlongZ[Column] = _mm256_mul_ps(ExtentZ, Matrix[2][Column]);
+            }
+
+            __m256 MinX = _mm256_set1_ps(FLT_MAX), MinY = MinX, MinDepth = MinX;
+            __m256 MaxX = _mm256_set1_ps(-FLT_MAX), MaxY = MaxX;
+            __m256 CrossesNear = Zero;
+            for (UINT Corner = 0; Corner < 8; ++Corner)
+            {
+                __m256 Clip[4];
+                for (UINT Column = 0; Column < 4; ++Column)
+                {
+                    Clip[Column] = _mm256_add_ps(Base[Column], Corner & 1 ? AlongX[Column] : Zero);
+                    Clip[Column] = _mm256_add_ps(Clip[Column], Corner & 2 ? AlongY[Column] : Zero);
+                    Clip[Column] = _mm256_add_ps(Clip[Column], Corner & 4 ? AlongZ[Column] : Zero);
+                }
+                CrossesNear = _mm256_or_ps(CrossesNear, _mm256_or_ps(_mm256_cmp_ps(Clip[2], Zero, _CMP_LT_OQ),
+                                                                     _mm256_cmp_ps(Clip[3], Zero, _CMP_LE_OQ)));
+                __m256 InvW = _mm256_div_ps(One, Clip[3]);
+                __m256 ScreenX = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(Clip[0], InvW), Half), Half), Width);
+                __m256 ScreenY = _mm256_mul_ps(_mm256_sub_ps(Half, _mm256_mul_ps(_mm256_mul_ps(Clip[1], InvW), Half)), Height);
+                MinX = _mm256_min_ps(MinX, ScreenX);
+                MaxX = _mm256_max_ps(MaxX, ScreenX);
+                MinY = _mm256_min_ps(MinY, ScreenY);
+                MaxY = _mm256_max_ps(MaxY, ScreenY);
+                MinDepth = _mm256_min_ps(MinDepth, _mm256_mul_ps(Clip[2], InvW));
+            }
+
+            // IsOccluded for eight boxes: off screen boxes are left to the frustum culler.
+            __m256 OffScreen = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(MaxX, Zero, _CMP_LT_OQ),
+                                                         _mm256_cmp_ps(MaxY, Zero, _CMP_LT_OQ)),
+                                            _mm256_or_ps(_mm256_cmp_ps(MinX, Width, _CMP_GE_OQ),
+                                                         _mm256_cmp_ps(MinY, Height, _CMP_GE_OQ)));
+            // Clamped on both sides so that off screen and near crossing boxes still look up valid texels.
+            __m256i X0 = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_floor_ps(MinX), Zero), LastX));
+            __m256i Y0 = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_floor_ps(MinY), Zero), LastY));
+            __m256i X1 = _mm256_cvttps_epi32(_mm256_max_ps(_mm256_min_ps(_mm256_floor_ps(MaxX), LastX), Zero));
+            __m256i Y1 = _mm256_cvttps_epi32(_mm256_max_ps(_mm256_min_ps(_mm256_floor_ps(MaxY), LastY), Zero));
+
+            // Levels only get coarser, so count those where the rectangle still spans more than 2x2 texels.
+            __m256i Level = _mm256_setzero_si256();
+            for (UINT Coarser = 0; Coarser + 1 < NumLevels; ++Coarser)
+            {
+                __m256i Shift = _mm256_set1_epi32((int)Coarser);
+                __m256i SpanX = _mm256_sub_epi32(_mm256_srlv_epi32(X1, Shift), _mm256_srlv_epi32(X0, Shift));
+                __m256i SpanY = _mm256_sub_epi32(_mm256_srlv_epi32(Y1, Shift), _mm256_srlv_epi32(Y0, Shift));
+                __m256i TooWide = _mm256_or_si256(_mm256_cmpgt_epi32(SpanX, OneTexel), _mm256_cmpgt_epi32(SpanY, OneTexel));
+                Level = _mm256_sub_epi32(Level, TooWide);
+            }
+
+            __m256i LevelWidth = _mm256_max_epi32(_mm256_srlv_epi32(WidthTexels, Level), OneTexel);
+            __m256i LevelOffset = _mm256_i32gather_epi32((const int*)Pyramid.LevelOffsets.data(), Level, 4);
+            __m256i Row0 = _mm256_add_epi32(LevelOffset, _mm256_mullo_epi32(_mm256_srlv_epi32(Y0, Level), LevelWidth));
+            __m256i Row1 = _mm256_add_epi32(LevelOffset, _mm256_mullo_epi32(_mm256_srlv_epi32(Y1, Level), LevelWidth));
+            __m256i Column0 = _mm256_srlv_epi32(X0, Level);
+            __m256i Column1 = _mm256_srlv_epi32(X1, Level);
+            const float* Depths = Pyramid.Depths.data();
+            __m256 MaxDepth = _mm256_max_ps(
+                _mm256_max_ps(_mm256_i32gather_ps(Depths, _mm256_add_epi32(Row0, Column0), 4),
+                              _mm256_i32gather_ps(Depths, _mm256_add_epi32(Row0, Column1), 4)),
+                _mm256_max_ps(_mm256_i32gather_ps(Depths, _mm256_add_epi32(Row1, Column0), 4),
+                              _mm256_i32gather_ps(Depths, _mm256_add_epi32(Row1, Column1), 4)));
+
+            __m256 Occluded = _mm256_andnot_ps(_mm256_or_ps(CrossesNear, OffScreen),
+                                               _mm256_cmp_ps(MinDepth, MaxDepth, _CMP_GT_OQ));
+            UINT Visible = ~(UINT)_mm256_movemask_ps(Occluded);
+            alignas(32) UINT32 BatchIds[BatchSize];
+            _mm256_store_si256((__m256i*)BatchIds, Ids);
+            for (UINT Lane = 0; Lane < BatchSize; ++Lane)
+            {
+                OutVisible[NumVisible] = BatchIds[Lane];
+                NumVisible += (Visible >> Lane) & 1;
+            }
+        }
+
+        for (; Index < End; ++Index)
+        {
+            UINT Id = Candidates[Index];
+            XMFLOAT3 Min(InBounds.MinX[Id], InBounds.MinY[Id], InBounds.MinZ[Id]);
+            XMFLOAT3 Max(InBounds.MaxX[Id], InBounds.MaxY[Id], InBounds.MaxZ[Id]);
+            if (IsVisible(Pyramid, Min, Max))
+            {
+                OutVisible[NumVisible++] = Id;
+            }
+        }
+        return NumVisible;
+    }
+
+    UINT Cull(const DepthPyramid& Pyramid, const FrustumCulling::Bounds& InBounds,
+              const UINT* Candidates, UINT NumCandidates, UINT* OutVisible, UINT NumThreads)
+    {
+        if (NumCandidates <= GrainSize || NumThreads <= 1)
+        {
+            return CullRange(Pyramid, InBounds, Candidates, 0, NumCandidates, OutVisible);
+        }
+
+        // Like FrustumCulling::Cull: chunks compact in place, then slide down over the gaps.
+        UINT NumChunks = (NumCandidates + GrainSize - 1) / GrainSize;
+        std::vector<UINT> ChunkCounts(NumChunks);
+        Threading::ParallelFor(NumCandidates, NumThreads, GrainSize, [&](UINT Begin, UINT End)
+        {
+            ChunkCounts[Begin / GrainSize] = CullRange(Pyramid, InBounds, Candidates, Begin, End, OutVisible + Begin);
+        });
+
+        UINT NumVisible = ChunkCounts[0];
+        for (UINT Chunk = 1; Chunk < NumChunks; ++Chunk)
+        {
+            memmove(OutVisible + NumVisible, OutVisible + Chunk * GrainSize, ChunkCounts[Chunk] * sizeof(UINT));
+            NumVisible += ChunkCounts[Chunk];
+        }
+        return NumVisible;
+    }
+
+    static float NextRandom(UINT32* Seed)
+    {
+        *Seed = *Seed * 1664525u + 1013904223u;
+        return (float)(*Seed >> 8) / (float)(1 << 24);
+    }
+
+    static const float BlockSpacing = 20.f;
+    static const float BuildingHalfSize = 6.f;
+
+    void CreateCityScene(UINT NumBuildings, UINT NumInstances, UINT32 Seed,
+                         Occluders* OutOccluders, FrustumCulling::Bounds* OutBounds)
+    {
+        UINT Side = (UINT)ceilf(sqrtf((float)NumBuildings));
+        float Origin = -0.5f * (float)(Side - 1) * BlockSpacing;
+        for (UINT i = 0; i < NumBuildings; ++i)
+        {
+            float CenterX = Origin + (float)(i % Side) * BlockSpacing;
+            float CenterZ = Origin + (float)(i / Side) * BlockSpacing;
+            float Height = 10.f + 30.f * NextRandom(&Seed);
+            AddBox(OutOccluders, XMFLOAT3(CenterX - BuildingHalfSize, 0.f, CenterZ - BuildingHalfSize),
+                   XMFLOAT3(CenterX + BuildingHalfSize, Height, CenterZ + BuildingHalfSize));
+        }
+
+        // Props on the streets and the roofs, some end up inside buildings.
+        float Extent = 0.5f * (float)Side * BlockSpacing;
+        FrustumCulling::Resize(OutBounds, NumInstances);
+        for (UINT i = 0; i < NumInstances; ++i)
+        {
+            XMFLOAT3 Center((NextRandom(&Seed) * 2.f - 1.f) * Extent,
+                            NextRandom(&Seed) * 3.f,
+                            (NextRandom(&Seed) * 2.f - 1.f) * Extent);
+            FrustumCulling::SetBounds(OutBounds, i, XMFLOAT3(Center.x - 0.5f, Center.y, Center.z - 0.5f),
+                                      XMFLOAT3(Center.x + 0.5f, Center.y + 1.f, Center.z + 0.5f));
+        }
+    }
+
+    bool RunTest(UINT NumInstances)
+    {
+        const UINT Width = 256;
+        const UINT Height = 128;
+        UINT NumErrors = 0;
+
+        // A wall 10 in front of the camera, 10 wide and high, and a building to the right of it, behind the wall.
+        Occluders Scene;
+        AddQuad(&Scene, XMFLOAT3(-5.f, -5.f, -10.f), XMFLOAT3(5.f, -5.f, -10.f), XMFLOAT3(5.f, 5.f, -10.f),
+                XMFLOAT3(-5.f, 5.f, -10.f));
+        AddBox(&Scene, XMFLOAT3(14.f, -5.f, -24.f), XMFLOAT3(24.f, 5.f, -20.f));
+        XMMATRIX View = XMMatrixLookToRH(XMVectorSet(0.f, 0.f, 0.f, 0.f), XMVectorSet(0.f, 0.f, -1.f, 0.f),
+                                         XMVectorSet(0.f, 1.f, 0.f, 0.f));
+        XMMATRIX Projection = XMMatrixPerspectiveFovRH(XM_PIDIV2, (float)Width / (float)Height, 0.1f, 1000.f);
+        DepthPyramid Pyramid;
+        Initialize(&Pyramid, Width, Height);
+        Render(Scene, View * Projection, &Pyramid);
+
+        struct Case
+        {
+            const char* Name;
+            XMFLOAT3 Min, Max;
+            bool IsVisible;
+        };
+        const Case Cases[] = {
+            {"behind the wall", XMFLOAT3(-1.f, -1.f, -22.f), XMFLOAT3(1.f, 1.f, -20.f), false},
+            {"just behind the wall", XMFLOAT3(-4.f, -4.f, -10.5f), XMFLOAT3(4.f, 4.f, -10.1f), false},
+            {"in front of the wall", XMFLOAT3(-1.f, -1.f, -6.f), XMFLOAT3(1.f, 1.f, -4.f), true},
+            {"beside the wall", XMFLOAT3(-16.f, -1.f, -22.f), XMFLOAT3(-12.f, 1.f, -20.f), true},
+            {"over the wall's edge", XMFLOAT3(8.f, -1.f, -22.f), XMFLOAT3(12.f, 1.f, -20.f), true},
+            {"through the wall", XMFLOAT3(-1.f, -1.f, -12.f), XMFLOAT3(1.f, 1.f, -8.f), true},
+            {"behind the building", XMFLOAT3(31.f, -2.f, -40.f), XMFLOAT3(34.f, 2.f, -36.f), false},
+            {"over the building", XMFLOAT3(31.f, 14.f, -40.f), XMFLOAT3(34.f, 18.f, -36.f), true},
+            {"crossing the near plane", XMFLOAT3(0.5f, 0.5f, -25.f), XMFLOAT3(1.f, 1.f, 5.f), true},
+        };
+
+        // Every case in every lane of Cull's batches, and in its scalar tail.
+        const UINT NumCases = _countof(Cases);
+        const UINT NumBoxes = NumCases * (BatchSize + 1);
+        FrustumCulling::Bounds Boxes;
+        FrustumCulling::Resize(&Boxes, NumBoxes);
+        std::vector<UINT> Candidates(NumBoxes);
+        for (UINT i = 0; i < NumBoxes; ++i)
+        {
+            Candidates[i] = NumBoxes - 1 - i;
+            const Case& Current = Cases[Candidates[i] % NumCases];
+            FrustumCulling::SetBounds(&Boxes, Candidates[i], Current.Min, Current.Max);
+        }
+        std::vector<UINT> Visible(NumBoxes);
+        UINT NumVisible = Cull(Pyramid, Boxes, Candidates.data(), NumBoxes, Visible.data());
+        for (UINT i = 0, v = 0; i < NumBoxes; ++i)
+        {
+            const Case& Current = Cases[Candidates[i] % NumCases];
+            bool Actual = v < NumVisible && Visible[v] == Candidates[i];
+            v += Actual ? 1 : 0;
+            if (Actual != Current.IsVisible || IsVisible(Pyramid, Current.Min, Current.Max) != Current.IsVisible)
+            {
+                char Message[128];
+                snprintf(Message, sizeof(Message), "OcclusionCulling: box %s is %s\n", Current.Name,
+                         Actual ? "visible" : "culled");
+                OutputDebugStringA(Message);
+                NumErrors++;
+            }
+        }
+
+        // The city, seen down the first street: the thread count must not change a bit of the pyramid or the output.
+        const UINT NumBuildings = 256;
+        Occluders City;
+        FrustumCulling::Bounds CityBoxes;
+        CreateCityScene(NumBuildings, NumInstances, 0x2545F491, &City, &CityBoxes);
+        float Extent = 0.5f * ceilf(sqrtf((float)NumBuildings)) * BlockSpacing;
+        View = XMMatrixLookToRH(XMVectorSet(-Extent + BlockSpacing, 1.7f, -Extent - 5.f, 0.f),
+                                XMVectorSet(0.3f, 0.f, 1.f, 0.f), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+        std::vector<UINT> AllInstances(NumInstances);
+        for (UINT i = 0; i < NumInstances; ++i)
+        {
+            AllInstances[i] = i;
+        }
+
+        // At least 8, the thread count also decides how the work is split.
+        const UINT ThreadCounts[3] = {1, 4, std::max(Threading::GetNumHardwareThreads(), 8u)};
+        std::vector<float> FirstDepths;
+        std::vector<UINT> FirstVisible;
+        UINT NumCityVisible = 0;
+        for (UINT t = 0; t < _countof(ThreadCounts); ++t)
+        {
+            Render(City, View * Projection, &Pyramid, ThreadCounts[t]);
+            std::vector<UINT> CityVisible(NumInstances);
+            NumCityVisible = Cull(Pyramid, CityBoxes, AllInstances.data(), NumInstances, CityVisible.data(),
+                                  ThreadCounts[t]);
+            CityVisible.resize(NumCityVisible);
+            if (t == 0)
+            {
+                FirstDepths = Pyramid.Depths;
+                FirstVisible = CityVisible;
+                NumErrors += NumCityVisible == NumInstances || NumCityVisible == 0 ? 1 : 0; // Nothing to compare.
+            }
+            else
+            {
+                NumErrors += CityVisible != FirstVisible ? 1 : 0;
+                bool SameDepths = FirstDepths.size() == Pyramid.Depths.size() &&
+                    memcmp(FirstDepths.data(), Pyramid.Depths.data(), FirstDepths.size() * sizeof(float)) == 0;
+                NumErrors += SameDepths ? 0 : 1;
+            }
+        }
+
+        bool Passed = NumErrors == 0;
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "OcclusionCulling: test %s, %u known boxes, %u of %u city instances visible at 1, 4 and %u threads, "
+                 "%u errors\n",
+                 Passed ? "passed" : "FAILED", NumBoxes, NumCityVisible, NumInstances, ThreadCounts[2], NumErrors);
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+
+    void RunBenchmark(UINT NumInstances, UINT NumFrames)
+    {
+        const UINT NumBuildings = 256;
+        const UINT Width = 256;
+        const UINT Height = 128;
+        Occluders City;
+        FrustumCulling::Bounds Boxes;
+        CreateCityScene(NumBuildings, NumInstances, 0x2545F491, &City, &Boxes);
+
+        // Walk down the first street, swaying left and right.
+        UINT Side = (UINT)ceilf(sqrtf((float)NumBuildings));
+        float Extent = 0.5f * (float)Side * BlockSpacing;
+        float StreetX = -Extent + BlockSpacing;
+        XMMATRIX Projection = XMMatrixPerspectiveFovRH(XM_PIDIV2, 2.f, 0.1f, 1000.f);
+        std::vector<XMMATRIX> ViewProjections(NumFrames);
+        for (UINT Frame = 0; Frame < NumFrames; ++Frame)
+        {
+            float T = (float)Frame / (float)NumFrames;
+            XMVECTOR Eye = XMVectorSet(StreetX, 1.7f, -Extent - 5.f + T * 2.f * Extent, 0.f);
+            XMVECTOR Direction = XMVectorSet(sinf(T * 6.f) * 0.5f, 0.f, 1.f, 0.f);
+            XMMATRIX View = XMMatrixLookToRH(Eye, Direction, XMVectorSet(0.f, 1.f, 0.f, 0.f));
+            ViewProjections[Frame] = View * Projection;
+        }
+
+        std::vector<UINT> FrustumVisible(NumInstances);
+        std::vector<UINT> Visible(NumInstances);
+        std::vector<UINT> FirstVisible;
+        std::vector<float> FirstDepth;
+        DepthPyramid Pyramid;
+        Initialize(&Pyramid, Width, Height);
+
+        const UINT ThreadCounts[2] = {1, Threading::GetNumHardwareThreads()};
+        for (UINT t = 0; t < _countof(ThreadCounts); ++t)
+        {
+            double RenderMs = 0.0;
+            double CullMs = 0.0;
+            double ScalarMs = 0.0;
+            UINT64 TotalFrustumVisible = 0;
+            UINT64 TotalVisible = 0;
+            UINT NumMismatches = 0;
+            bool Deterministic = true;
+            for (UINT Frame = 0; Frame < NumFrames; ++Frame)
+            {
+                FrustumCulling::Frustum CameraFrustum;
+                FrustumCulling::ExtractFrustum(ViewProjections[Frame], &CameraFrustum);
+                UINT NumFrustumVisible = FrustumCulling::Cull(CameraFrustum, Boxes, NumInstances, FrustumVisible.data(),
+                                                              ThreadCounts[t]);
+
+                auto Start = std::chrono::high_resolution_clock::now();
+                Render(City, ViewProjections[Frame], &Pyramid, ThreadCounts[t]);
+                auto Middle = std::chrono::high_resolution_clock::now();
+                UINT NumVisible = Cull(Pyramid, Boxes, FrustumVisible.data(), NumFrustumVisible, Visible.data(),
+                                       ThreadCounts[t]);
+                auto End = std::chrono::high_resolution_clock::now();
+                RenderMs += std::chrono::duration<double, std::milli>(Middle - Start).count();
+                CullMs += std::chrono::duration<double, std::milli>(End - Middle).count();
+                TotalFrustumVisible += NumFrustumVisible;
+                TotalVisible += NumVisible;
+
+                // The scalar reference has to agree, and the thread count must not matter.
+                Start = std::chrono::high_resolution_clock::now();
+                for (UINT i = 0, v = 0; i < NumFrustumVisible; ++i)
+                {
+                    UINT Id = FrustumVisible[i];
+                    bool Expected = IsVisible(Pyramid, XMFLOAT3(Boxes.MinX[Id], Boxes.MinY[Id], Boxes.MinZ[Id]),
+                                              XMFLOAT3(Boxes.MaxX[Id], Boxes.MaxY[Id], Boxes.MaxZ[Id]));
+                    bool Actual = v < NumVisible && Visible[v] == Id;
+                    v += Actual ? 1 : 0;
+                    NumMismatches += Expected != Actual ? 1 : 0;
+                }
+                ScalarMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - Start).count();
+                if (Frame == 0 && t == 0)
+                {
+                    FirstVisible.assign(Visible.begin(), Visible.begin() + NumVisible);
+                    FirstDepth.assign(Pyramid.Depths.begin(), Pyramid.Depths.begin() + Width * Height);
+                }
+                else if (Frame == 0)
+                {
+                    Deterministic = FirstVisible.size() == NumVisible &&
+                        memcmp(FirstVisible.data(), Visible.data(), NumVisible * sizeof(UINT)) == 0 &&
+                        memcmp(FirstDepth.data(), Pyramid.Depths.data(), FirstDepth.size() * sizeof(float)) == 0;
+                }
+            }
+
+            char Message[320];
+            snprintf(Message, sizeof(Message),
+                     "OcclusionCulling %u instances, %u occluder quads, %ux%u, %u thread(s): "
+                     "%.1f%% in frustum, %.1f%% of those occluded, raster + HiZ %.2f ms, test %.2f ms (scalar %.2f ms), "
+                     "%.2f ms/frame, %u scalar mismatches, %s\n",
+                     NumInstances, (UINT)City.Vertices.size() / 4, Width, Height, ThreadCounts[t],
+                     100.0 * TotalFrustumVisible / ((double)NumInstances * NumFrames),
+                     TotalFrustumVisible > 0 ? 100.0 * (TotalFrustumVisible - TotalVisible) / TotalFrustumVisible : 0.0,
+                     RenderMs / NumFrames, CullMs / NumFrames, ScalarMs / NumFrames, (RenderMs + CullMs) / NumFrames, NumMismatches,
+                     Deterministic ? "deterministic" : "NOT deterministic");
+            OutputDebugStringA(Message);
+        }
+    }
+}
@@ -0,0 +1,328 @@
+#include "Headers/ParallelRecording.h"
+#include "Headers/Threading.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+namespace ParallelRecording
+{
+    void Initialize(Pools* InPools, UINT NumFrames, UINT NumThreads)
+    {
+        assert(NumFrames > 0 && NumFrames <= MaxFrames && NumThreads > 0 && NumThreads <= MaxThreads);
+        *InPools = Pools();
+        InPools->NumFrames = NumFrames;
+        InPools->NumThreads = NumThreads;
+    }
+
+    void BeginFrame(Pools* InPools, UINT FrameIndex)
+    {
+        assert(FrameIndex < InPools->NumFrames);
+        InPools->CurrentFrame = FrameIndex;
+        for (UINT Thread = 0; Thread < InPools->NumThreads; ++Thread)
+        {
+            InPools->Threads[FrameIndex][Thread].NumUsed = 0;
+        }
+    }
+
+    UINT Acquire(Pools* InPools, UINT Thread, bool* IsNew)
+    {
+        assert(Thread < InPools->NumThreads);
+        Pool& ThreadPool = InPools->Threads[InPools->CurrentFrame][Thread];
+        *IsNew = ThreadPool.NumUsed == ThreadPool.NumCreated;
+        if (*IsNew)
+        {
+            ThreadPool.NumCreated++;
+        }
+        return ThreadPool.NumUsed++;
+    }
+
+    void Split(const UINT* Costs, UINT NumPasses, UINT NumChunks, std::vector<Chunk>* OutChunks)
+    {
+        OutChunks->clear();
+        if (NumPasses == 0)
+        {
+            return;
+        }
+        NumChunks = std::max(1u, std::min(NumChunks, NumPasses));
+        UINT64 TotalCost = 0;
+        for (UINT Pass = 0; Pass < NumPasses; ++Pass)
+        {
+            TotalCost += Costs[Pass];
+        }
+
+        // A chunk ends once the passes so far cost the share of the chunks so far, or when every pass left has to
+        // be a chunk of its own.
+        Chunk Current;
+        UINT64 Cost = 0;
+        for (UINT Pass = 0; Pass < NumPasses; ++Pass)
+        {
+            Cost += Costs[Pass];
+            Current.NumPasses++;
+            UINT NumPassesLeft = NumPasses - Pass - 1;
+            UINT NumChunksLeft = NumChunks - (UINT)OutChunks->size() - 1;
+            bool IsShareDone = Cost * NumChunks >= TotalCost * (OutChunks->size() + 1);
+            if (NumPassesLeft == 0 || (NumChunksLeft > 0 && (IsShareDone || NumPassesLeft == NumChunksLeft)))
+            {
+                OutChunks->push_back(Current);
+                Current = Chunk();
+                Current.FirstPass = Pass + 1;
+            }
+        }
+    }
+
+    UINT GetNumChunks(UINT64 TotalCost, UINT NumThreads, UINT MinChunkCost)
+    {
+        UINT64 NumChunks = (UINT64)NumThreads * ChunksPerThread;
+        if (MinChunkCost > 0)
+        {
+            NumChunks = std::min(NumChunks, TotalCost / MinChunkCost);
+        }
+        return (UINT)std::max<UINT64>(NumChunks, 1);
+    }
+
+    void Record(Pools* InPools, const UINT* Costs, UINT NumPasses, UINT NumThreads, UINT MinChunkCost,
+                std::vector<Chunk>* Chunks, const std::function<void(const Chunk& InChunk, bool IsNew)>& RecordChunk)
+    {
+        assert(NumThreads > 0 && NumThreads <= InPools->NumThreads);
+        UINT64 TotalCost = 0;
+        for (UINT Pass = 0; Pass < NumPasses; ++Pass)
+        {
+            TotalCost += Costs[Pass];
+        }
+        Split(Costs, NumPasses, GetNumChunks(TotalCost, NumThreads, MinChunkCost), Chunks);
+
+        // One chunk at a time, so a thread that picked a slow one leaves the rest to the others.
+        Threading::ParallelForPerThread((UINT)Chunks->size(), NumThreads, 1, [&](UINT Thread, UINT Begin, UINT End)
+        {
+            for (UINT Index = Begin; Index < End; ++Index)
+            {
+                Chunk& Current = (*Chunks)[Index];
+                bool IsNew;
+                Current.Thread = Thread;
+                Current.List = Acquire(InPools, Thread, &IsNew);
+                RecordChunk(Current, IsNew);
+            }
+        });
+    }
+
+    static UINT32 NextRandom(UINT32* State)
+    {
+        *State = *State * 1664525u + 1013904223u;
+        return *State >> 8;
+    }
+
+    // What's recorded, and what the GPU may still read.
+    struct NullCommandList
+    {
+        std::vector<UINT64> Commands;
+        UINT64 Encoded = 0;
+        UINT64 LastFrame = 0; // The frame fence value it was last executed with.
+        UINT Owner = 0;       // The thread whose pool it's in.
+    };
+
+    struct NullBackend
+    {
+        std::vector<NullCommandList> Lists[MaxFrames][MaxThreads];
+    };
+
+    // About what a driver spends validating and encoding a draw with its root arguments.
+    static void RecordCommand(NullCommandList* List, UINT64 Command)
+    {
+        UINT64 Hash = Command;
+        for (UINT i = 0; i < 48; ++i)
+        {
+            Hash = (Hash ^ (Hash >> 29)) * 0xBF58476D1CE4E5B9ull;
+        }
+        List->Encoded ^= Hash;
+        List->Commands.push_back(Command);
+    }
+
+    // The pass's state, then its draws.
+    static void RecordPass(NullCommandList* List, UINT Pass, UINT NumDraws)
+    {
+        RecordCommand(List, ((UINT64)Pass << 32) | 0xFFFFFFFF);
+        for (UINT Draw = 0; Draw < NumDraws; ++Draw)
+        {
+            RecordCommand(List, ((UINT64)Pass << 32) | Draw);
+        }
+    }
+
+    // Takes the chunk's list out of its pool, reset, and records its passes.
+    static NullCommandList* RecordNullChunk(NullBackend* Backend, const Pools& InPools, const Chunk& InChunk,
+                                            bool IsNew, const UINT* Costs)
+    {
+        std::vector<NullCommandList>& Lists = Backend->Lists[InPools.CurrentFrame][InChunk.Thread];
+        if (IsNew)
+        {
+            assert(Lists.size() == InChunk.List);
+            Lists.emplace_back();
+            Lists.back().Owner = InChunk.Thread;
+        }
+        NullCommandList* List = &Lists[InChunk.List];
+        List->Commands.clear();
+        for (UINT Pass = InChunk.FirstPass; Pass < InChunk.FirstPass + InChunk.NumPasses; ++Pass)
+        {
+            RecordPass(List, Pass, Costs[Pass]);
+        }
+        return List;
+    }
+
+    bool RunTest(UINT NumFrames, UINT NumThreads)
+    {
+        NumThreads = std::min(NumThreads, MaxThreads);
+        const UINT NumFramesInFlight = 3;
+        const UINT MinChunkCost = 64;
+        Pools TestPools;
+        Initialize(&TestPools, NumFramesInFlight, NumThreads);
+        std::unique_ptr<NullBackend> Backend(new NullBackend());
+
+        std::vector<UINT> Costs; // Draws per pass.
+        std::vector<Chunk> Chunks;
+        std::vector<UINT64> Expected;
+        std::vector<UINT> Reused(NumThreads * 64);
+        UINT NumErrors = 0;
+        UINT64 CompletedFrame = 0;
+        UINT64 NumDraws = 0;
+        UINT NumLists = 0;
+        UINT32 State = 4321;
+        for (UINT64 FrameValue = 1; FrameValue <= NumFrames; ++FrameValue)
+        {
+            // The GPU one to three frames behind, waited for once this frame's pools were last used.
+            UINT64 Lag = 1 + NextRandom(&State) % NumFramesInFlight;
+            CompletedFrame = std::max(CompletedFrame, FrameValue > Lag ? FrameValue - Lag : 0);
+            CompletedFrame = std::max(CompletedFrame, FrameValue > NumFramesInFlight ? FrameValue - NumFramesInFlight
+                                                                                     : 0);
+            BeginFrame(&TestPools, (UINT)(FrameValue % NumFramesInFlight));
+
+            // Mostly small passes, some with thousands of draws, sometimes none.
+            Costs.resize(NextRandom(&State) % 64);
+            Expected.clear();
+            for (UINT Pass = 0; Pass < Costs.size(); ++Pass)
+            {
+                UINT Choice = NextRandom(&State) % 16;
+                Costs[Pass] = Choice == 0 ? 0 : Choice == 1 ? 1000 + NextRandom(&State) % 3000
+                                                            : NextRandom(&State) % 200;
+                Expected.push_back(((UINT64)Pass << 32) | 0xFFFFFFFF);
+                for (UINT Draw = 0; Draw < Costs[Pass]; ++Draw)
+                {
+                    Expected.push_back(((UINT64)Pass << 32) | Draw);
+                }
+                NumDraws += Costs[Pass];
+            }
+
+            UINT NumFrameThreads = 1 + NextRandom(&State) % NumThreads;
+            Record(&TestPools, Costs.data(), (UINT)Costs.size(), NumFrameThreads, MinChunkCost, &Chunks,
+                   [&](const Chunk& InChunk, bool IsNew)
+            {
+                NullCommandList* List = &Backend->Lists[TestPools.CurrentFrame][InChunk.Thread][InChunk.List];
+                if (!IsNew && List->LastFrame > CompletedFrame)
+                {
+                    NumErrors++;
+                }
+                RecordNullChunk(Backend.get(), TestPools, InChunk, IsNew, Costs.data());
+            });
+
+            // Executed in chunk order.
+            size_t Position = 0;
+            UINT NextPass = 0;
+            std::fill(Reused.begin(), Reused.end(), 0);
+            for (const Chunk& Current : Chunks)
+            {
+                NullCommandList& List = Backend->Lists[TestPools.CurrentFrame][Current.Thread][Current.List];
+                if (Current.FirstPass != NextPass || Current.NumPasses == 0 || Current.Thread >= NumFrameThreads ||
+                    List.Owner != Current.Thread || Current.List >= 64 ||
+                    Reused[Current.Thread * 64 + Current.List]++ != 0)
+                {
+                    NumErrors++;
+                }
+                if (Position + List.Commands.size() > Expected.size() ||
+                    !std::equal(List.Commands.begin(), List.Commands.end(), Expected.begin() + Position))
+                {
+                    NumErrors++;
+                }
+                Position += List.Commands.size();
+                NextPass = Current.FirstPass + Current.NumPasses;
+                List.LastFrame = FrameValue;
+            }
+            if (Position != Expected.size() || NextPass != Costs.size() ||
+                Chunks.size() > std::max(1u, NumFrameThreads * ChunksPerThread))
+            {
+                NumErrors++;
+            }
+            NumLists += (UINT)Chunks.size();
+        }
+
+        bool Passed = NumErrors == 0;
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "ParallelRecording: test %s, %u frames, %llu draws in %u lists on up to %u threads, %u errors\n",
+                 Passed ? "passed" : "FAILED", NumFrames, NumDraws, NumLists, NumThreads, NumErrors);
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+
+    void RunBenchmark(UINT NumFrames, UINT NumPasses, UINT NumDraws)
+    {
+        const UINT NumFramesInFlight = 3;
+        const UINT MinChunkCost = 256;
+
+        // Uneven passes: shadow maps and the main view heavy, post-processing light.
+        UINT32 State = 2024;
+        std::vector<UINT> Weights(NumPasses);
+        UINT64 TotalWeight = 0;
+        for (UINT& Weight : Weights)
+        {
+            Weight = NextRandom(&State) % 8 == 0 ? 50 + NextRandom(&State) % 50 : 1 + NextRandom(&State) % 10;
+            TotalWeight += Weight;
+        }
+        std::vector<UINT> Costs(NumPasses);
+        for (UINT Pass = 0; Pass < NumPasses; ++Pass)
+        {
+            Costs[Pass] = (UINT)(Weights[Pass] * NumDraws / TotalWeight);
+        }
+
+        // Doubling up to the hardware threads, at least up to 8.
+        const UINT MaxCount = std::min(std::max(Threading::GetNumHardwareThreads(), 8u), MaxThreads);
+        std::vector<UINT> ThreadCounts;
+        for (UINT Count = 1; Count < MaxCount; Count *= 2)
+        {
+            ThreadCounts.push_back(Count);
+        }
+        ThreadCounts.push_back(MaxCount);
+
+        double SerialMs = 0;
+        std::vector<Chunk> Chunks;
+        for (UINT NumThreads : ThreadCounts)
+        {
+            Pools BenchmarkPools;
+            Initialize(&BenchmarkPools, NumFramesInFlight, NumThreads);
+            std::unique_ptr<NullBackend> Backend(new NullBackend());
+
+            // The first frames create the lists, not measured.
+            std::chrono::high_resolution_clock::time_point Start;
+            for (UINT Frame = 0; Frame < NumFrames + NumFramesInFlight; ++Frame)
+            {
+                if (Frame == NumFramesInFlight)
+                {
+                    Start = std::chrono::high_resolution_clock::now();
+                }
+                BeginFrame(&BenchmarkPools, Frame % NumFramesInFlight);
+                Record(&BenchmarkPools, Costs.data(), NumPasses, NumThreads, MinChunkCost, &Chunks,
+                       [&](const Chunk& InChunk, bool IsNew)
+                {
+                    RecordNullChunk(Backend.get(), BenchmarkPools, InChunk, IsNew, Costs.data());
+                });
+            }
+            auto End = std::chrono::high_resolution_clock::now();
+            double FrameMs = std::chrono::duration<double, std::milli>(End - Start).count() / NumFrames;
+            SerialMs = NumThreads == 1 ? FrameMs : SerialMs;
+
+            char Message[256];
+            snprintf(Message, sizeof(Message),
+                     "ParallelRecording: %u passes, %u draws on %u threads in %u lists, %.3f ms per frame, "
+                     "%.2fx\n",
+                     NumPasses, NumDraws, NumThreads, (UINT)Chunks.size(), FrameMs, SerialMs / FrameMs);
+            OutputDebugStringA(Message);
+        }
+    }
+}
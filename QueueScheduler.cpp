@@ -0,0 +1,236 @@
+#include "Headers/QueueScheduler.h"
+#include <algorithm>
+#include <vector>
+
+namespace QueueScheduler
+{
+    void Reset(Scheduler* InScheduler)
+    {
+        *InScheduler = Scheduler();
+    }
+
+    void SetCompleted(Scheduler* InScheduler, QueueType Queue, UINT64 CompletedValue)
+    {
+        UINT Index = (UINT)Queue;
+        assert(CompletedValue <= InScheduler->Signaled[Index]);
+        std::deque<Clock>& History = InScheduler->History[Index];
+        while (InScheduler->Completed[Index] < CompletedValue)
+        {
+            History.pop_front();
+            InScheduler->Completed[Index]++;
+        }
+    }
+
+    // Only for points that aren't done yet, the ones before are dropped.
+    static const Clock& GetClock(const Scheduler& InScheduler, UINT Queue, UINT64 Value)
+    {
+        assert(Value > InScheduler.Completed[Queue] && Value <= InScheduler.Signaled[Queue]);
+        return InScheduler.History[Queue][(size_t)(Value - InScheduler.Completed[Queue] - 1)];
+    }
+
+    Submission Submit(Scheduler* InScheduler, QueueType Queue, const SyncPoint* Dependencies, UINT NumDependencies)
+    {
+        const UINT Index = (UINT)Queue;
+        Clock& Known = InScheduler->Known[Index];
+
+        // The latest point needed per other queue, unless it's done or followed already.
+        UINT64 Required[NumQueues] = {};
+        for (UINT i = 0; i < NumDependencies; ++i)
+        {
+            UINT Other = (UINT)Dependencies[i].Queue;
+            assert(Dependencies[i].Value <= InScheduler->Signaled[Other]);
+            if (Other != Index && Dependencies[i].Value > 0)
+            {
+                Required[Other] = std::max(Required[Other], Dependencies[i].Value);
+                InScheduler->NumDependencies++;
+            }
+        }
+        for (UINT Other = 0; Other < NumQueues; ++Other)
+        {
+            if (Required[Other] <= std::max(InScheduler->Completed[Other], Known.Values[Other]))
+            {
+                Required[Other] = 0;
+            }
+        }
+
+        // A point another wait follows already doesn't need its own. Clocks only grow along waits, so whatever
+        // covers a dropped point also covers what that point covered.
+        UINT64 Waits[NumQueues] = {};
+        for (UINT Other = 0; Other < NumQueues; ++Other)
+        {
+            Waits[Other] = Required[Other];
+            for (UINT Covering = 0; Covering < NumQueues && Waits[Other] > 0; ++Covering)
+            {
+                if (Covering != Other && Required[Covering] > 0 &&
+                    GetClock(*InScheduler, Covering, Required[Covering]).Values[Other] >= Required[Other])
+                {
+                    Waits[Other] = 0;
+                }
+            }
+        }
+
+        Submission Result;
+        for (UINT Other = 0; Other < NumQueues; ++Other)
+        {
+            if (Waits[Other] == 0)
+            {
+                continue;
+            }
+            const Clock& Followed = GetClock(*InScheduler, Other, Waits[Other]);
+            for (UINT i = 0; i < NumQueues; ++i)
+            {
+                Known.Values[i] = std::max(Known.Values[i], Followed.Values[i]);
+            }
+            Result.Waits[Result.NumWaits].Queue = (QueueType)Other;
+            Result.Waits[Result.NumWaits].Value = Waits[Other];
+            Result.NumWaits++;
+        }
+        InScheduler->NumWaits += Result.NumWaits;
+        InScheduler->NumSubmissions++;
+
+        Result.Signal.Queue = Queue;
+        Result.Signal.Value = ++InScheduler->Signaled[Index];
+        Known.Values[Index] = Result.Signal.Value;
+        InScheduler->History[Index].push_back(Known);
+        return Result;
+    }
+
+    static UINT32 NextRandom(UINT32* State)
+    {
+        *State = *State * 1664525u + 1013904223u;
+        return *State >> 8;
+    }
+
+    bool RunTest(UINT NumSubmissions)
+    {
+        // The null backend: each queue runs its waits and submissions in order, a submission signals the queue's
+        // fence once it ran.
+        struct Operation
+        {
+            bool IsWait = false;
+            SyncPoint Point; // What's waited on, or what's signaled.
+            UINT Submission = 0;
+        };
+        std::deque<Operation> Queues[NumQueues];
+        UINT64 Fences[NumQueues] = {};
+
+        Scheduler TestScheduler;
+        std::vector<SyncPoint> Points;                     // Per submission.
+        std::vector<std::vector<SyncPoint>> Dependencies;  // Per submission.
+        UINT NumErrors = 0;
+        UINT NumNeededWaits = 0; // Dependencies not done when submitted.
+        UINT32 State = 4231;
+
+        auto Step = [&](UINT Queue)
+        {
+            if (Queues[Queue].empty())
+            {
+                return false;
+            }
+            const Operation& Current = Queues[Queue].front();
+            if (Current.IsWait)
+            {
+                if (Fences[(UINT)Current.Point.Queue] < Current.Point.Value)
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                for (const SyncPoint& Dependency : Dependencies[Current.Submission])
+                {
+                    if (Fences[(UINT)Dependency.Queue] < Dependency.Value)
+                    {
+                        NumErrors++;
+                    }
+                }
+                Fences[Queue] = Current.Point.Value;
+            }
+            Queues[Queue].pop_front();
+            return true;
+        };
+
+        for (UINT i = 0; i < NumSubmissions; ++i)
+        {
+            // Mostly recent work, the way a frame's passes depend on each other, sometimes something long done.
+            UINT Queue = NextRandom(&State) % NumQueues;
+            std::vector<SyncPoint> Current;
+            UINT NumCurrent = Points.empty() ? 0 : NextRandom(&State) % 4;
+            for (UINT j = 0; j < NumCurrent; ++j)
+            {
+                UINT Distance = NextRandom(&State) % 8 == 0 ? NextRandom(&State) % 64 : NextRandom(&State) % 6;
+                UINT Dependency = i - 1 - std::min(Distance, i - 1);
+                Current.push_back(Points[Dependency]);
+                if (Fences[(UINT)Points[Dependency].Queue] < Points[Dependency].Value &&
+                    (UINT)Points[Dependency].Queue != Queue)
+                {
+                    NumNeededWaits++;
+                }
+            }
+
+            Submission Planned = Submit(&TestScheduler, (QueueType)Queue, Current.data(), (UINT)Current.size());
+            for (UINT j = 0; j < Planned.NumWaits; ++j)
+            {
+                Operation Wait;
+                Wait.IsWait = true;
+                Wait.Point = Planned.Waits[j];
+                if (Wait.Point.Queue == (QueueType)Queue ||
+                    Wait.Point.Value <= TestScheduler.Completed[(UINT)Wait.Point.Queue])
+                {
+                    NumErrors++; // Waiting on itself or on something the CPU saw done.
+                }
+                Queues[Queue].push_back(Wait);
+            }
+            Operation Execute;
+            Execute.Point = Planned.Signal;
+            Execute.Submission = i;
+            Queues[Queue].push_back(Execute);
+            Points.push_back(Planned.Signal);
+            Dependencies.push_back(Current);
+
+            // The GPU gets ahead or falls behind at random, the CPU looks at the fences now and then.
+            UINT NumSteps = NextRandom(&State) % 4;
+            for (UINT j = 0; j < NumSteps; ++j)
+            {
+                Step(NextRandom(&State) % NumQueues);
+            }
+            if (NextRandom(&State) % 4 == 0)
+            {
+                for (UINT Other = 0; Other < NumQueues; ++Other)
+                {
+                    SetCompleted(&TestScheduler, (QueueType)Other, Fences[Other]);
+                }
+            }
+        }
+
+        // Everything runs to completion, whichever queue goes first.
+        for (bool Progress = true; Progress;)
+        {
+            Progress = false;
+            for (UINT Queue = 0; Queue < NumQueues; ++Queue)
+            {
+                while (Step(Queue))
+                {
+                    Progress = true;
+                }
+            }
+        }
+        for (UINT Queue = 0; Queue < NumQueues; ++Queue)
+        {
+            if (!Queues[Queue].empty() || Fences[Queue] != TestScheduler.Signaled[Queue])
+            {
+                NumErrors++; // Deadlocked.
+            }
+        }
+
+        bool Passed = NumErrors == 0;
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "QueueScheduler: test %s, %u submissions on %u queues, %u cross-queue dependencies (%u not done "
+                 "when submitted), %u GPU waits, %u errors\n",
+                 Passed ? "passed" : "FAILED", NumSubmissions, NumQueues, TestScheduler.NumDependencies,
+                 NumNeededWaits, TestScheduler.NumWaits, NumErrors);
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+}
@@ -0,0 +1,861 @@
+#include "Headers/RenderGraph.h"
+#include <algorithm>
+#include <chrono>
+#include <queue>
+
+namespace RenderGraph
+{
+    using ResourceStates::IsReadOnly;
+    using ResourceStates::Satisfies;
+
+    void Reset(Graph* InGraph)
+    {
+        InGraph->Resources.clear();
+        InGraph->Passes.clear();
+        InGraph->Accesses.clear();
+        InGraph->Executes.clear();
+    }
+
+    ResourceId Import(Graph* InGraph, ResourceStates::States InitialState, ResourceStates::States FinalState,
+                      UINT64 Key)
+    {
+        ResourceDesc Desc;
+        Desc.IsImported = true;
+        Desc.InitialState = InitialState;
+        Desc.FinalState = FinalState;
+        Desc.Key = Key;
+        InGraph->Resources.push_back(Desc);
+        return (ResourceId)InGraph->Resources.size() - 1;
+    }
+
+    ResourceId CreateTransient(Graph* InGraph, UINT64 Size, UINT64 Alignment, HeapGroup Group, UINT64 Key)
+    {
+        assert(Size > 0 && Alignment > 0 && (Alignment & (Alignment - 1)) == 0);
+        ResourceDesc Desc;
+        Desc.Size = Size;
+        Desc.Alignment = Alignment;
+        Desc.Group = Group;
+        Desc.Key = Key;
+        InGraph->Resources.push_back(Desc);
+        return (ResourceId)InGraph->Resources.size() - 1;
+    }
+
+    UINT AddPass(Graph* InGraph, const char* Name, const std::function<void()>& Execute, bool HasSideEffects)
+    {
+        Pass NewPass;
+        NewPass.Name = Name;
+        NewPass.FirstAccess = (UINT)InGraph->Accesses.size();
+        NewPass.HasSideEffects = HasSideEffects;
+        InGraph->Passes.push_back(NewPass);
+        InGraph->Executes.push_back(Execute);
+        return (UINT)InGraph->Passes.size() - 1;
+    }
+
+    static void AddAccess(Graph* InGraph, ResourceId Resource, ResourceStates::States State, bool IsWrite)
+    {
+        assert(!InGraph->Passes.empty() && Resource < InGraph->Resources.size());
+        Pass& Current = InGraph->Passes.back();
+
+        // One access per resource and pass: reads add up, a read and a write are a write in the same state.
+        for (UINT i = Current.FirstAccess; i < Current.FirstAccess + Current.NumAccesses; ++i)
+        {
+            Access& Existing = InGraph->Accesses[i];
+            if (Existing.Resource == Resource)
+            {
+                bool AreReads = !IsWrite && !Existing.IsWrite && IsReadOnly(State) && IsReadOnly(Existing.State);
+                assert(AreReads || State == Existing.State);
+                Existing.State |= AreReads ? State : 0;
+                Existing.IsWrite = Existing.IsWrite || IsWrite;
+                return;
+            }
+        }
+
+        Access NewAccess;
+        NewAccess.Resource = Resource;
+        NewAccess.State = State;
+        NewAccess.IsWrite = IsWrite;
+        InGraph->Accesses.push_back(NewAccess);
+        Current.NumAccesses++;
+    }
+
+    void Read(Graph* InGraph, ResourceId Resource, ResourceStates::States State)
+    {
+        AddAccess(InGraph, Resource, State, false);
+    }
+
+    void Write(Graph* InGraph, ResourceId Resource, ResourceStates::States State)
+    {
+        AddAccess(InGraph, Resource, State, true);
+    }
+
+    static bool IsSameTopology(const Graph& InGraph, const CompiledGraph& Compiled)
+    {
+        if (InGraph.Resources.size() != Compiled.Resources.size() || InGraph.Passes.size() != Compiled.Passes.size() ||
+            InGraph.Accesses.size() != Compiled.Accesses.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < InGraph.Resources.size(); ++i)
+        {
+            const ResourceDesc& A = InGraph.Resources[i];
+            const ResourceDesc& B = Compiled.Resources[i];
+            if (A.Size != B.Size || A.Alignment != B.Alignment || A.Group != B.Group || A.IsImported != B.IsImported ||
+                A.InitialState != B.InitialState || A.FinalState != B.FinalState || A.Key != B.Key)
+            {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < InGraph.Passes.size(); ++i)
+        {
+            const Pass& A = InGraph.Passes[i];
+            const Pass& B = Compiled.Passes[i];
+            if (A.FirstAccess != B.FirstAccess || A.NumAccesses != B.NumAccesses ||
+                A.HasSideEffects != B.HasSideEffects)
+            {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < InGraph.Accesses.size(); ++i)
+        {
+            const Access& A = InGraph.Accesses[i];
+            const Access& B = Compiled.Accesses[i];
+            if (A.Resource != B.Resource || A.State != B.State || A.IsWrite != B.IsWrite)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Back to front: a pass is live when it has side effects or writes something a later live pass uses.
+    static UINT CullPasses(const Graph& InGraph, std::vector<UINT8>* IsLive)
+    {
+        const UINT NumPasses = (UINT)InGraph.Passes.size();
+        std::vector<UINT8> IsNeeded(InGraph.Resources.size());
+        for (size_t i = 0; i < InGraph.Resources.size(); ++i)
+        {
+            IsNeeded[i] = InGraph.Resources[i].IsImported ? 1 : 0;
+        }
+
+        IsLive->assign(NumPasses, 0);
+        UINT NumLive = 0;
+        for (UINT PassIndex = NumPasses; PassIndex-- > 0;)
+        {
+            const Pass& Current = InGraph.Passes[PassIndex];
+            bool Live = Current.HasSideEffects;
+            for (UINT i = Current.FirstAccess; i < Current.FirstAccess + Current.NumAccesses && !Live; ++i)
+            {
+                Live = InGraph.Accesses[i].IsWrite && IsNeeded[InGraph.Accesses[i].Resource];
+            }
+            if (Live)
+            {
+                (*IsLive)[PassIndex] = 1;
+                NumLive++;
+                for (UINT i = Current.FirstAccess; i < Current.FirstAccess + Current.NumAccesses; ++i)
+                {
+                    IsNeeded[InGraph.Accesses[i].Resource] = 1;
+                }
+            }
+        }
+        return NumLive;
+    }
+
+    // Live passes in an order that keeps every dependency: on the last write of what they access, and for writes
+    // also on the reads since. Among the passes that are ready the one heading the longest chain goes first.
+    static void OrderPasses(const Graph& InGraph, const std::vector<UINT8>& IsLive, std::vector<UINT>* Order)
+    {
+        const UINT NumPasses = (UINT)InGraph.Passes.size();
+        const UINT NumResources = (UINT)InGraph.Resources.size();
+
+        // Readers since the last write, as lists threaded through ReaderNodes.
+        std::vector<UINT> LastWriters(NumResources, InvalidId);
+        std::vector<UINT> ReaderHeads(NumResources, InvalidId);
+        std::vector<std::pair<UINT, UINT>> ReaderNodes; // Pass, next node.
+        std::vector<std::pair<UINT, UINT>> Edges;       // From, to. Always forward in declaration order.
+        for (UINT PassIndex = 0; PassIndex < NumPasses; ++PassIndex)
+        {
+            if (!IsLive[PassIndex])
+            {
+                continue;
+            }
+            const Pass& Current = InGraph.Passes[PassIndex];
+            for (UINT i = Current.FirstAccess; i < Current.FirstAccess + Current.NumAccesses; ++i)
+            {
+                const Access& CurrentAccess = InGraph.Accesses[i];
+                ResourceId Resource = CurrentAccess.Resource;
+                if (LastWriters[Resource] != InvalidId)
+                {
+                    Edges.push_back({LastWriters[Resource], PassIndex});
+                }
+                if (CurrentAccess.IsWrite)
+                {
+                    for (UINT Node = ReaderHeads[Resource]; Node != InvalidId; Node = ReaderNodes[Node].second)
+                    {
+                        Edges.push_back({ReaderNodes[Node].first, PassIndex});
+                    }
+                    ReaderHeads[Resource] = InvalidId;
+                    LastWriters[Resource] = PassIndex;
+                }
+                else
+                {
+                    ReaderNodes.push_back({PassIndex, ReaderHeads[Resource]});
+                    ReaderHeads[Resource] = (UINT)ReaderNodes.size() - 1;
+                }
+            }
+        }
+
+        // Successors of each pass.
+        std::vector<UINT> FirstSuccessors(NumPasses + 1, 0);
+        std::vector<UINT> InDegrees(NumPasses, 0);
+        for (const auto& Edge : Edges)
+        {
+            FirstSuccessors[Edge.first + 1]++;
+            InDegrees[Edge.second]++;
+        }
+        for (UINT PassIndex = 0; PassIndex < NumPasses; ++PassIndex)
+        {
+            FirstSuccessors[PassIndex + 1] += FirstSuccessors[PassIndex];
+        }
+        std::vector<UINT> Successors(Edges.size());
+        std::vector<UINT> Cursors(FirstSuccessors.begin(), FirstSuccessors.end() - 1);
+        for (const auto& Edge : Edges)
+        {
+            Successors[Cursors[Edge.first]++] = Edge.second;
+        }
+
+        // Length of the longest chain each pass heads.
+        std::vector<UINT> Depths(NumPasses, 0);
+        for (UINT PassIndex = NumPasses; PassIndex-- > 0;)
+        {
+            UINT Depth = 0;
+            for (UINT i = FirstSuccessors[PassIndex]; i < FirstSuccessors[PassIndex + 1]; ++i)
+            {
+                Depth = std::max(Depth, Depths[Successors[i]]);
+            }
+            Depths[PassIndex] = Depth + 1;
+        }
+
+        // Deepest first, then in declaration order.
+        auto GetPriority = [&](UINT PassIndex)
+        {
+            return ((UINT64)Depths[PassIndex] << 32) | (0xFFFFFFFF - PassIndex);
+        };
+        std::priority_queue<UINT64> Ready;
+        for (UINT PassIndex = 0; PassIndex < NumPasses; ++PassIndex)
+        {
+            if (IsLive[PassIndex] && InDegrees[PassIndex] == 0)
+            {
+                Ready.push(GetPriority(PassIndex));
+            }
+        }
+        Order->clear();
+        while (!Ready.empty())
+        {
+            UINT PassIndex = 0xFFFFFFFF - (UINT)(Ready.top() & 0xFFFFFFFF);
+            Ready.pop();
+            Order->push_back(PassIndex);
+            for (UINT i = FirstSuccessors[PassIndex]; i < FirstSuccessors[PassIndex + 1]; ++i)
+            {
+                if (--InDegrees[Successors[i]] == 0)
+                {
+                    Ready.push(GetPriority(Successors[i]));
+                }
+            }
+        }
+    }
+
+    // Transients whose lifetimes overlap get disjoint memory, the rest go as low in their group's heap as they fit.
+    static void PlaceTransients(CompiledGraph* Compiled, const std::vector<UINT>& FirstUses,
+                                const std::vector<UINT>& LastUses)
+    {
+        const std::vector<ResourceDesc>& Resources = Compiled->Resources;
+        std::vector<ResourceId> Transients;
+        for (ResourceId Resource = 0; Resource < (ResourceId)Resources.size(); ++Resource)
+        {
+            if (Compiled->IsUsed[Resource] && !Resources[Resource].IsImported)
+            {
+                Transients.push_back(Resource);
+            }
+        }
+
+        // Largest first, they're the hardest to fit.
+        std::sort(Transients.begin(), Transients.end(), [&](ResourceId A, ResourceId B)
+        {
+            if (Resources[A].Group != Resources[B].Group)
+            {
+                return Resources[A].Group < Resources[B].Group;
+            }
+            return Resources[A].Size != Resources[B].Size ? Resources[A].Size > Resources[B].Size : A < B;
+        });
+
+        std::vector<ResourceId> Placed; // Of the current group.
+        std::vector<std::pair<UINT64, UINT64>> Conflicts;
+        auto MarkAliased = [&]()
+        {
+            // Sorted by offset, each one against the ones starting before it ends.
+            std::sort(Placed.begin(), Placed.end(), [&](ResourceId A, ResourceId B)
+            {
+                return Compiled->Offsets[A] < Compiled->Offsets[B];
+            });
+            for (size_t i = 0; i < Placed.size(); ++i)
+            {
+                UINT64 End = Compiled->Offsets[Placed[i]] + Resources[Placed[i]].Size;
+                for (size_t j = i + 1; j < Placed.size() && Compiled->Offsets[Placed[j]] < End; ++j)
+                {
+                    Compiled->IsAliased[Placed[i]] = 1;
+                    Compiled->IsAliased[Placed[j]] = 1;
+                }
+            }
+            Placed.clear();
+        };
+
+        for (size_t i = 0; i < Transients.size(); ++i)
+        {
+            ResourceId Resource = Transients[i];
+            const ResourceDesc& Desc = Resources[Resource];
+            if (i > 0 && Resources[Transients[i - 1]].Group != Desc.Group)
+            {
+                MarkAliased();
+            }
+
+            Conflicts.clear();
+            for (ResourceId Other : Placed)
+            {
+                if (FirstUses[Other] <= LastUses[Resource] && FirstUses[Resource] <= LastUses[Other])
+                {
+                    Conflicts.push_back({Compiled->Offsets[Other], Compiled->Offsets[Other] + Resources[Other].Size});
+                }
+            }
+            std::sort(Conflicts.begin(), Conflicts.end());
+
+            UINT64 Offset = 0;
+            for (const auto& Conflict : Conflicts)
+            {
+                if (AlignTo(Offset, Desc.Alignment) + Desc.Size <= Conflict.first)
+                {
+                    break;
+                }
+                Offset = std::max(Offset, Conflict.second);
+            }
+            Offset = AlignTo(Offset, Desc.Alignment);
+
+            Compiled->Offsets[Resource] = Offset;
+            UINT64& HeapSize = Compiled->HeapSizes[(UINT)Desc.Group];
+            HeapSize = std::max(HeapSize, Offset + Desc.Size);
+            Compiled->UnaliasedSize += Desc.Size;
+            Placed.push_back(Resource);
+        }
+        MarkAliased();
+    }
+
+    struct Use
+    {
+        UINT Position = 0; // In the order.
+        ResourceStates::States State = ResourceStates::Common;
+        bool IsWrite = false;
+    };
+
+    bool Compile(const Graph& InGraph, CompiledGraph* Compiled)
+    {
+        if (IsSameTopology(InGraph, *Compiled))
+        {
+            return false;
+        }
+
+        Compiled->Resources = InGraph.Resources;
+        Compiled->Passes = InGraph.Passes;
+        Compiled->Accesses = InGraph.Accesses;
+        const UINT NumPasses = (UINT)InGraph.Passes.size();
+        const UINT NumResources = (UINT)InGraph.Resources.size();
+
+        std::vector<UINT8> IsLive;
+        UINT NumLive = CullPasses(InGraph, &IsLive);
+        Compiled->NumCulled = NumPasses - NumLive;
+        OrderPasses(InGraph, IsLive, &Compiled->Order);
+        assert(Compiled->Order.size() == NumLive);
+
+        // The uses of each resource in execution order.
+        std::vector<UINT> FirstUseIndices(NumResources + 1, 0);
+        for (UINT PassIndex : Compiled->Order)
+        {
+            const Pass& Current = InGraph.Passes[PassIndex];
+            for (UINT i = Current.FirstAccess; i < Current.FirstAccess + Current.NumAccesses; ++i)
+            {
+                FirstUseIndices[InGraph.Accesses[i].Resource + 1]++;
+            }
+        }
+        for (UINT Resource = 0; Resource < NumResources; ++Resource)
+        {
+            FirstUseIndices[Resource + 1] += FirstUseIndices[Resource];
+        }
+        std::vector<Use> Uses(FirstUseIndices[NumResources]);
+        std::vector<UINT> Cursors(FirstUseIndices.begin(), FirstUseIndices.end() - 1);
+        for (UINT Position = 0; Position < NumLive; ++Position)
+        {
+            const Pass& Current = InGraph.Passes[Compiled->Order[Position]];
+            for (UINT i = Current.FirstAccess; i < Current.FirstAccess + Current.NumAccesses; ++i)
+            {
+                const Access& CurrentAccess = InGraph.Accesses[i];
+                Use& NewUse = Uses[Cursors[CurrentAccess.Resource]++];
+                NewUse.Position = Position;
+                NewUse.State = CurrentAccess.State;
+                NewUse.IsWrite = CurrentAccess.IsWrite;
+            }
+        }
+
+        Compiled->IsUsed.assign(NumResources, 0);
+        Compiled->StartStates.assign(NumResources, ResourceStates::Common);
+        Compiled->Offsets.assign(NumResources, 0);
+        Compiled->IsAliased.assign(NumResources, 0);
+        std::fill(std::begin(Compiled->HeapSizes), std::end(Compiled->HeapSizes), 0);
+        Compiled->UnaliasedSize = 0;
+
+        std::vector<UINT> FirstUses(NumResources, InvalidId);
+        std::vector<UINT> LastUses(NumResources, InvalidId);
+        for (UINT Resource = 0; Resource < NumResources; ++Resource)
+        {
+            if (FirstUseIndices[Resource] != FirstUseIndices[Resource + 1])
+            {
+                Compiled->IsUsed[Resource] = 1;
+                FirstUses[Resource] = Uses[FirstUseIndices[Resource]].Position;
+                LastUses[Resource] = Uses[FirstUseIndices[Resource + 1] - 1].Position;
+            }
+        }
+        PlaceTransients(Compiled, FirstUses, LastUses);
+
+        // Barriers in front of the pass at Position, NumLive for the final ones.
+        std::vector<std::pair<UINT, Barrier>> Placed;
+        auto AddBarrier = [&](UINT Position, ResourceStates::BarrierType Type, ResourceId Resource,
+                              ResourceStates::States Before, ResourceStates::States After)
+        {
+            Barrier NewBarrier;
+            NewBarrier.Type = Type;
+            NewBarrier.Resource = Resource;
+            NewBarrier.Before = Before;
+            NewBarrier.After = After;
+            Placed.push_back({Position, NewBarrier});
+        };
+
+        std::vector<Use> Merged;
+        for (UINT Resource = 0; Resource < NumResources; ++Resource)
+        {
+            if (!Compiled->IsUsed[Resource])
+            {
+                continue;
+            }
+
+            // Reads in a row all transition at the first of them, to every state they need.
+            Merged.clear();
+            for (UINT i = FirstUseIndices[Resource]; i < FirstUseIndices[Resource + 1]; ++i)
+            {
+                const Use& Current = Uses[i];
+                if (!Merged.empty() && !Current.IsWrite && !Merged.back().IsWrite &&
+                    IsReadOnly(Current.State) && IsReadOnly(Merged.back().State))
+                {
+                    Merged.back().State |= Current.State;
+                }
+                else
+                {
+                    Merged.push_back(Current);
+                }
+            }
+
+            const ResourceDesc& Desc = InGraph.Resources[Resource];
+            ResourceStates::States Current = Desc.IsImported ? Desc.InitialState : Merged.back().State;
+            Compiled->StartStates[Resource] = Current;
+            if (Compiled->IsAliased[Resource])
+            {
+                AddBarrier(Merged[0].Position, ResourceStates::BarrierType::Aliasing, Resource, 0, 0);
+            }
+
+            for (size_t i = 0; i < Merged.size(); ++i)
+            {
+                const Use& CurrentUse = Merged[i];
+                if (!Satisfies(Current, CurrentUse.State))
+                {
+                    AddBarrier(CurrentUse.Position, ResourceStates::BarrierType::Transition, Resource,
+                               Current, CurrentUse.State);
+                    Current = CurrentUse.State;
+                }
+                else if (i > 0 && Current == ResourceStates::UnorderedAccess &&
+                         (CurrentUse.IsWrite || Merged[i - 1].IsWrite))
+                {
+                    AddBarrier(CurrentUse.Position, ResourceStates::BarrierType::UAV, Resource, 0, 0);
+                }
+            }
+
+            if (Desc.IsImported && Current != Desc.FinalState)
+            {
+                AddBarrier(NumLive, ResourceStates::BarrierType::Transition, Resource, Current, Desc.FinalState);
+            }
+        }
+
+        Compiled->FirstBarriers.assign(NumLive + 2, 0);
+        for (const auto& Current : Placed)
+        {
+            Compiled->FirstBarriers[Current.first + 1]++;
+        }
+        for (UINT Position = 0; Position <= NumLive; ++Position)
+        {
+            Compiled->FirstBarriers[Position + 1] += Compiled->FirstBarriers[Position];
+        }
+        Compiled->Barriers.resize(Placed.size());
+        Cursors.assign(Compiled->FirstBarriers.begin(), Compiled->FirstBarriers.end() - 1);
+        for (const auto& Current : Placed)
+        {
+            Compiled->Barriers[Cursors[Current.first]++] = Current.second;
+        }
+        return true;
+    }
+
+    static UINT32 NextRandom(UINT32* State)
+    {
+        *State = *State * 1664525u + 1013904223u;
+        return *State >> 8;
+    }
+
+    static bool HasAccess(const Graph& InGraph, ResourceId Resource)
+    {
+        const Pass& Current = InGraph.Passes.back();
+        for (UINT i = Current.FirstAccess; i < Current.FirstAccess + Current.NumAccesses; ++i)
+        {
+            if (InGraph.Accesses[i].Resource == Resource)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Frame-like: passes reading a few recent results and writing new ones, some of which nothing reads, a history
+    // buffer carried over from the last frame and the back buffer written at the end.
+    static void BuildRandomGraph(Graph* InGraph, UINT NumPasses, UINT32 Seed)
+    {
+        const ResourceStates::States ReadStates[] = {0x40, 0x80, 0xC0, 0x800, 0x200, ResourceStates::UnorderedAccess};
+        const ResourceStates::States WriteStates[] = {0x4, ResourceStates::UnorderedAccess, 0x400};
+        const UINT64 Granularity = 64 * 1024;
+
+        Reset(InGraph);
+        UINT32 Random = Seed;
+        ResourceId BackBuffer = Import(InGraph, ResourceStates::Common, ResourceStates::Common);
+        ResourceId History = Import(InGraph, 0x40, 0x40);
+        std::vector<ResourceId> Recent = {History};
+
+        for (UINT PassIndex = 0; PassIndex + 1 < NumPasses; ++PassIndex)
+        {
+            AddPass(InGraph, "Random", std::function<void()>(), NextRandom(&Random) % 64 == 0);
+
+            UINT NumReads = NextRandom(&Random) % 4;
+            for (UINT i = 0; i < NumReads; ++i)
+            {
+                UINT Age = NextRandom(&Random) % std::min((UINT)Recent.size(), 8u);
+                ResourceId Resource = Recent[Recent.size() - 1 - Age];
+                ResourceStates::States State = ReadStates[NextRandom(&Random) % _countof(ReadStates)];
+                if (!HasAccess(*InGraph, Resource))
+                {
+                    Read(InGraph, Resource, State);
+                }
+            }
+
+            UINT NumWrites = 1 + NextRandom(&Random) % 2;
+            for (UINT i = 0; i < NumWrites; ++i)
+            {
+                UINT Choice = NextRandom(&Random) % 100;
+                ResourceId Resource;
+                if (Choice < 75)
+                {
+                    HeapGroup Group = (HeapGroup)(NextRandom(&Random) % (UINT)HeapGroup::Count);
+                    Resource = CreateTransient(InGraph, Granularity * (1 + NextRandom(&Random) % 64), Granularity,
+                                               Group);
+                }
+                else if (Choice < 95)
+                {
+                    Resource = Recent[Recent.size() - 1 - NextRandom(&Random) % std::min((UINT)Recent.size(), 8u)];
+                }
+                else
+                {
+                    Resource = History;
+                }
+                if (!HasAccess(*InGraph, Resource))
+                {
+                    Write(InGraph, Resource, WriteStates[NextRandom(&Random) % _countof(WriteStates)]);
+                    Recent.push_back(Resource);
+                }
+            }
+        }
+
+        AddPass(InGraph, "Present", std::function<void()>());
+        Read(InGraph, Recent.back(), 0x800);
+        Write(InGraph, BackBuffer, 0x400);
+    }
+
+    // Checks Compiled against InGraph with a simulation of the states, returns the number of errors.
+    static UINT CheckCompiled(const Graph& InGraph, const CompiledGraph& Compiled)
+    {
+        const UINT NumPasses = (UINT)InGraph.Passes.size();
+        const UINT NumResources = (UINT)InGraph.Resources.size();
+        const UINT NumLive = (UINT)Compiled.Order.size();
+        UINT NumErrors = 0;
+
+        std::vector<UINT> Positions(NumPasses, InvalidId);
+        for (UINT Position = 0; Position < NumLive; ++Position)
+        {
+            Positions[Compiled.Order[Position]] = Position;
+        }
+
+        auto Accesses = [&](UINT PassIndex, ResourceId Resource, bool* IsWrite)
+        {
+            const Pass& Current = InGraph.Passes[PassIndex];
+            for (UINT i = Current.FirstAccess; i < Current.FirstAccess + Current.NumAccesses; ++i)
+            {
+                if (InGraph.Accesses[i].Resource == Resource)
+                {
+                    *IsWrite = InGraph.Accesses[i].IsWrite;
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        // Liveness and order, pass against pass.
+        for (UINT PassIndex = NumPasses; PassIndex-- > 0;)
+        {
+            const Pass& Current = InGraph.Passes[PassIndex];
+            bool Live = Current.HasSideEffects;
+            for (UINT i = Current.FirstAccess; i < Current.FirstAccess + Current.NumAccesses; ++i)
+            {
+                const Access& CurrentAccess = InGraph.Accesses[i];
+                Live = Live || (CurrentAccess.IsWrite && InGraph.Resources[CurrentAccess.Resource].IsImported);
+                for (UINT Later = PassIndex + 1; Later < NumPasses; ++Later)
+                {
+                    bool LaterIsWrite = false;
+                    if (Positions[Later] == InvalidId || !Accesses(Later, CurrentAccess.Resource, &LaterIsWrite))
+                    {
+                        continue;
+                    }
+                    Live = Live || CurrentAccess.IsWrite;
+                    bool IsDependency = CurrentAccess.IsWrite || LaterIsWrite;
+                    if (Positions[PassIndex] != InvalidId && IsDependency && Positions[PassIndex] > Positions[Later])
+                    {
+                        NumErrors++;
+                    }
+                }
+            }
+            if (Live != (Positions[PassIndex] != InvalidId))
+            {
+                NumErrors++;
+            }
+        }
+
+        // Lifetimes of the transients.
+        std::vector<UINT> FirstUses(NumResources, InvalidId);
+        std::vector<UINT> LastUses(NumResources, 0);
+        for (UINT Position = 0; Position < NumLive; ++Position)
+        {
+            const Pass& Current = InGraph.Passes[Compiled.Order[Position]];
+            for (UINT i = Current.FirstAccess; i < Current.FirstAccess + Current.NumAccesses; ++i)
+            {
+                ResourceId Resource = InGraph.Accesses[i].Resource;
+                FirstUses[Resource] = std::min(FirstUses[Resource], Position);
+                LastUses[Resource] = Position;
+            }
+        }
+
+        // Replay the barriers, checking what each pass finds.
+        std::vector<ResourceStates::States> Actual = Compiled.StartStates;
+        std::vector<UINT8> UAVAccesses(NumResources, 0); // Since the last barrier: 1 for reads, 2 for writes.
+        std::vector<UINT> Activations(NumResources, InvalidId);
+        for (UINT Position = 0; Position <= NumLive; ++Position)
+        {
+            for (UINT i = Compiled.FirstBarriers[Position]; i < Compiled.FirstBarriers[Position + 1]; ++i)
+            {
+                const Barrier& Current = Compiled.Barriers[i];
+                if (Current.Type == ResourceStates::BarrierType::Transition)
+                {
+                    if (Actual[Current.Resource] != Current.Before || Current.Before == Current.After)
+                    {
+                        NumErrors++;
+                    }
+                    Actual[Current.Resource] = Current.After;
+                }
+                else if (Current.Type == ResourceStates::BarrierType::Aliasing)
+                {
+                    Activations[Current.Resource] = Position;
+                }
+                UAVAccesses[Current.Resource] = 0;
+            }
+            if (Position == NumLive)
+            {
+                break;
+            }
+
+            const Pass& Current = InGraph.Passes[Compiled.Order[Position]];
+            for (UINT i = Current.FirstAccess; i < Current.FirstAccess + Current.NumAccesses; ++i)
+            {
+                const Access& CurrentAccess = InGraph.Accesses[i];
+                ResourceId Resource = CurrentAccess.Resource;
+                if (!Satisfies(Actual[Resource], CurrentAccess.State))
+                {
+                    NumErrors++;
+                }
+                if (CurrentAccess.State == ResourceStates::UnorderedAccess)
+                {
+                    UINT8& Previous = UAVAccesses[Resource];
+                    if (Previous == 2 || (Previous == 1 && CurrentAccess.IsWrite))
+                    {
+                        NumErrors++;
+                    }
+                    Previous = std::max(Previous, (UINT8)(CurrentAccess.IsWrite ? 2 : 1));
+                }
+                if (Compiled.IsAliased[Resource] && FirstUses[Resource] == Position &&
+                    Activations[Resource] != Position)
+                {
+                    NumErrors++;
+                }
+            }
+        }
+
+        for (UINT Resource = 0; Resource < NumResources; ++Resource)
+        {
+            const ResourceDesc& Desc = InGraph.Resources[Resource];
+            bool IsUsed = FirstUses[Resource] != InvalidId;
+            if (IsUsed != (Compiled.IsUsed[Resource] != 0))
+            {
+                NumErrors++;
+            }
+            if (IsUsed && Actual[Resource] != (Desc.IsImported ? Desc.FinalState : Compiled.StartStates[Resource]))
+            {
+                NumErrors++;
+            }
+        }
+
+        // Memory: aligned, inside the heap, and shared only by lifetimes that don't overlap.
+        for (UINT A = 0; A < NumResources; ++A)
+        {
+            const ResourceDesc& DescA = InGraph.Resources[A];
+            if (DescA.IsImported || FirstUses[A] == InvalidId)
+            {
+                continue;
+            }
+            UINT64 OffsetA = Compiled.Offsets[A];
+            if (OffsetA % DescA.Alignment != 0 || OffsetA + DescA.Size > Compiled.HeapSizes[(UINT)DescA.Group])
+            {
+                NumErrors++;
+            }
+            bool IsAliased = false;
+            for (UINT B = 0; B < NumResources; ++B)
+            {
+                const ResourceDesc& DescB = InGraph.Resources[B];
+                if (B == A || DescB.IsImported || FirstUses[B] == InvalidId || DescB.Group != DescA.Group)
+                {
+                    continue;
+                }
+                UINT64 OffsetB = Compiled.Offsets[B];
+                if (OffsetA < OffsetB + DescB.Size && OffsetB < OffsetA + DescA.Size)
+                {
+                    IsAliased = true;
+                    if (FirstUses[A] <= LastUses[B] && FirstUses[B] <= LastUses[A])
+                    {
+                        NumErrors++;
+                    }
+                }
+            }
+            if (IsAliased != (Compiled.IsAliased[A] != 0))
+            {
+                NumErrors++;
+            }
+        }
+        return NumErrors;
+    }
+
+    bool RunTest(UINT NumGraphs, UINT NumPasses)
+    {
+        UINT NumErrors = 0;
+        UINT64 NumAccesses = 0;
+        UINT64 NumBarriers = 0;
+        UINT64 NumCulled = 0;
+        UINT64 HeapSize = 0;
+        UINT64 UnaliasedSize = 0;
+
+        Graph TestGraph;
+        for (UINT GraphIndex = 0; GraphIndex < NumGraphs; ++GraphIndex)
+        {
+            BuildRandomGraph(&TestGraph, NumPasses, 0x5EED + GraphIndex * 7919u);
+            CompiledGraph Compiled;
+            if (!Compile(TestGraph, &Compiled))
+            {
+                NumErrors++;
+            }
+            NumErrors += CheckCompiled(TestGraph, Compiled);
+
+            // The same topology again is a hit, a different one isn't.
+            if (Compile(TestGraph, &Compiled))
+            {
+                NumErrors++;
+            }
+            TestGraph.Resources[0].Key++;
+            if (!Compile(TestGraph, &Compiled))
+            {
+                NumErrors++;
+            }
+
+            NumAccesses += TestGraph.Accesses.size();
+            NumBarriers += Compiled.Barriers.size();
+            NumCulled += Compiled.NumCulled;
+            for (UINT Group = 0; Group < (UINT)HeapGroup::Count; ++Group)
+            {
+                HeapSize += Compiled.HeapSizes[Group];
+            }
+            UnaliasedSize += Compiled.UnaliasedSize;
+        }
+
+        bool Passed = NumErrors == 0;
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "RenderGraph: test %s, %u graphs of %u passes, %llu accesses, %llu barriers, %llu passes culled, "
+                 "transients in %.1f%% of their memory, %u errors\n",
+                 Passed ? "passed" : "FAILED", NumGraphs, NumPasses, NumAccesses, NumBarriers, NumCulled,
+                 UnaliasedSize > 0 ? 100.0 * HeapSize / UnaliasedSize : 100.0, NumErrors);
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+
+    void RunBenchmark(UINT NumGraphs, UINT NumPasses)
+    {
+        std::vector<Graph> Graphs(NumGraphs);
+        for (UINT GraphIndex = 0; GraphIndex < NumGraphs; ++GraphIndex)
+        {
+            BuildRandomGraph(&Graphs[GraphIndex], NumPasses, 0xBEEF + GraphIndex);
+        }
+
+        std::vector<CompiledGraph> Compiled(NumGraphs);
+        auto Start = std::chrono::high_resolution_clock::now();
+        for (UINT GraphIndex = 0; GraphIndex < NumGraphs; ++GraphIndex)
+        {
+            Compile(Graphs[GraphIndex], &Compiled[GraphIndex]);
+        }
+        auto End = std::chrono::high_resolution_clock::now();
+        double CompileSeconds = std::chrono::duration<double>(End - Start).count();
+
+        // What every frame after the first pays.
+        Start = std::chrono::high_resolution_clock::now();
+        for (UINT GraphIndex = 0; GraphIndex < NumGraphs; ++GraphIndex)
+        {
+            Compile(Graphs[GraphIndex], &Compiled[GraphIndex]);
+        }
+        End = std::chrono::high_resolution_clock::now();
+        double CachedSeconds = std::chrono::duration<double>(End - Start).count();
+
+        UINT64 NumTransients = 0;
+        for (const Graph& Current : Graphs)
+        {
+            NumTransients += Current.Resources.size() - 2;
+        }
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "RenderGraph: %u passes, %llu transients on average, %.3f ms to compile, %.1f us when cached\n",
+                 NumPasses, NumTransients / NumGraphs, CompileSeconds * 1000.0 / NumGraphs,
+                 CachedSeconds * 1e6 / NumGraphs);
+        OutputDebugStringA(Message);
+    }
+}
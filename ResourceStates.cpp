@@ -0,0 +1,463 @@
+#include "Headers/ResourceStates.h"
+#include <algorithm>
+
+namespace ResourceStates
+{
+    void Reset(Tracker* InTracker)
+    {
+        InTracker->Slots.clear();
+        InTracker->Resources.clear();
+        InTracker->FirstStates.clear();
+        InTracker->CurrentStates.clear();
+        InTracker->IsKnown.clear();
+        InTracker->PendingIndices.clear();
+        InTracker->Pending.clear();
+        InTracker->HasPendingGlobalUAV = false;
+        InTracker->NumRequests = 0;
+        InTracker->NumBarriers = 0;
+        InTracker->NumFlushes = 0;
+    }
+
+    // Returns InvalidIndex for resources the list hasn't used yet.
+    static UINT FindSlot(const Tracker& InTracker, const void* Resource)
+    {
+        auto It = InTracker.Slots.find(Resource);
+        return It != InTracker.Slots.end() ? It->second : InvalidIndex;
+    }
+
+    static void AddSlot(Tracker* InTracker, const void* Resource, States State, bool IsKnown)
+    {
+        InTracker->Slots.emplace(Resource, (UINT)InTracker->Resources.size());
+        InTracker->Resources.push_back(Resource);
+        InTracker->FirstStates.push_back(State);
+        InTracker->CurrentStates.push_back(State);
+        InTracker->IsKnown.push_back(IsKnown ? 1 : 0);
+        InTracker->PendingIndices.push_back(InvalidIndex);
+    }
+
+    // Order within one ResourceBarrier call doesn't matter, so the last barrier takes the removed one's place.
+    static void RemovePending(Tracker* InTracker, UINT Index)
+    {
+        UINT LastIndex = (UINT)InTracker->Pending.size() - 1;
+        if (Index != LastIndex)
+        {
+            const Barrier& Last = InTracker->Pending[LastIndex];
+            if (Last.Type == BarrierType::Transition)
+            {
+                InTracker->PendingIndices[InTracker->Slots[Last.Resource]] = Index;
+            }
+            InTracker->Pending[Index] = Last;
+        }
+        InTracker->Pending.pop_back();
+    }
+
+    void Transition(Tracker* InTracker, const void* Resource, States After)
+    {
+        assert(Resource != nullptr);
+        InTracker->NumRequests++;
+
+        UINT Slot = FindSlot(*InTracker, Resource);
+        if (Slot == InvalidIndex)
+        {
+            // The list's first use, resolved at submission.
+            AddSlot(InTracker, Resource, After, false);
+            return;
+        }
+
+        States& Current = InTracker->CurrentStates[Slot];
+        if (Satisfies(Current, After))
+        {
+            return;
+        }
+
+        UINT& PendingIndex = InTracker->PendingIndices[Slot];
+        if (PendingIndex == InvalidIndex)
+        {
+            Barrier NewBarrier;
+            NewBarrier.Resource = Resource;
+            NewBarrier.Before = Current;
+            NewBarrier.After = After;
+            PendingIndex = (UINT)InTracker->Pending.size();
+            InTracker->Pending.push_back(NewBarrier);
+            Current = After;
+            return;
+        }
+
+        // Nothing used the resource since its pending transition: retarget it. Reads asked for in between are all
+        // needed by the next work, so they add up.
+        Barrier& Merged = InTracker->Pending[PendingIndex];
+        Merged.After = IsReadOnly(Merged.After) && IsReadOnly(After) ? Merged.After | After : After;
+        Current = Merged.After;
+        if (Merged.After == Merged.Before)
+        {
+            UINT Index = PendingIndex;
+            PendingIndex = InvalidIndex;
+            RemovePending(InTracker, Index);
+        }
+    }
+
+    void UAVBarrier(Tracker* InTracker, const void* Resource)
+    {
+        InTracker->NumRequests++;
+        if (InTracker->HasPendingGlobalUAV)
+        {
+            return;
+        }
+
+        if (Resource == nullptr)
+        {
+            // Covers the UAV barriers of single resources.
+            for (UINT i = 0; i < (UINT)InTracker->Pending.size();)
+            {
+                if (InTracker->Pending[i].Type == BarrierType::UAV)
+                {
+                    RemovePending(InTracker, i);
+                }
+                else
+                {
+                    ++i;
+                }
+            }
+            InTracker->HasPendingGlobalUAV = true;
+        }
+        else
+        {
+            for (const Barrier& Current : InTracker->Pending)
+            {
+                if (Current.Type == BarrierType::UAV && Current.Resource == Resource)
+                {
+                    return;
+                }
+            }
+        }
+
+        Barrier NewBarrier;
+        NewBarrier.Type = BarrierType::UAV;
+        NewBarrier.Resource = Resource;
+        InTracker->Pending.push_back(NewBarrier);
+    }
+
+    void AliasingBarrier(Tracker* InTracker, const void* Resource)
+    {
+        assert(Resource != nullptr);
+        InTracker->NumRequests++;
+        for (const Barrier& Current : InTracker->Pending)
+        {
+            if (Current.Type == BarrierType::Aliasing && Current.Resource == Resource)
+            {
+                return;
+            }
+        }
+
+        Barrier NewBarrier;
+        NewBarrier.Type = BarrierType::Aliasing;
+        NewBarrier.Resource = Resource;
+        InTracker->Pending.push_back(NewBarrier);
+    }
+
+    void SetKnownState(Tracker* InTracker, const void* Resource, States State)
+    {
+        assert(Resource != nullptr && FindSlot(*InTracker, Resource) == InvalidIndex);
+        AddSlot(InTracker, Resource, State, true);
+    }
+
+    UINT Flush(Tracker* InTracker, const EmitFunction& Emit)
+    {
+        UINT NumPending = (UINT)InTracker->Pending.size();
+        if (NumPending == 0)
+        {
+            return 0;
+        }
+
+        Emit(InTracker->Pending.data(), NumPending);
+        InTracker->NumBarriers += NumPending;
+        InTracker->NumFlushes++;
+
+        for (const Barrier& Current : InTracker->Pending)
+        {
+            if (Current.Type == BarrierType::Transition)
+            {
+                InTracker->PendingIndices[InTracker->Slots[Current.Resource]] = InvalidIndex;
+            }
+        }
+        InTracker->Pending.clear();
+        InTracker->HasPendingGlobalUAV = false;
+        return NumPending;
+    }
+
+    void Register(GlobalStates* Global, const void* Resource, States State)
+    {
+        assert(Resource != nullptr);
+        Global->Current[Resource] = State;
+    }
+
+    void Unregister(GlobalStates* Global, const void* Resource)
+    {
+        Global->Current.erase(Resource);
+    }
+
+    UINT Resolve(Tracker* InTracker, GlobalStates* Global, const EmitFunction& Emit)
+    {
+        assert(InTracker->Pending.empty());
+
+        std::vector<Barrier> Resolved;
+        for (UINT Slot = 0; Slot < (UINT)InTracker->Resources.size(); ++Slot)
+        {
+            const void* Resource = InTracker->Resources[Slot];
+            auto It = Global->Current.find(Resource);
+            if (It == Global->Current.end())
+            {
+                // Unregistered resources are only ever used with a known state.
+                assert(InTracker->IsKnown[Slot]);
+                continue;
+            }
+
+            // The list's later barriers start from exactly its first state, read states included.
+            if (!InTracker->IsKnown[Slot] && It->second != InTracker->FirstStates[Slot])
+            {
+                Barrier NewBarrier;
+                NewBarrier.Resource = Resource;
+                NewBarrier.Before = It->second;
+                NewBarrier.After = InTracker->FirstStates[Slot];
+                Resolved.push_back(NewBarrier);
+            }
+            It->second = InTracker->CurrentStates[Slot];
+        }
+
+        UINT NumResolved = (UINT)Resolved.size();
+        if (NumResolved > 0)
+        {
+            Emit(Resolved.data(), NumResolved);
+            InTracker->NumBarriers += NumResolved;
+            InTracker->NumFlushes++;
+        }
+        return NumResolved;
+    }
+
+    static UINT32 NextRandom(UINT32* State)
+    {
+        *State = *State * 1664525u + 1013904223u;
+        return *State >> 8;
+    }
+
+    // What the null backend replays, in recording order.
+    struct TestCommand
+    {
+        std::vector<Barrier> Barriers;                        // One ResourceBarrier call.
+        std::vector<std::pair<const void*, States>> Expected; // Work that needs these states.
+        const void* KnownResource = nullptr;                  // Just created in KnownState.
+        States KnownState = Common;
+    };
+
+    // A fixed sequence, with the barriers and calls it must come down to.
+    static bool CheckMerging()
+    {
+        UINT8 Keys[3] = {};
+        GlobalStates Global;
+        Register(&Global, &Keys[0], Common);
+        Register(&Global, &Keys[1], 0x800); // COPY_SOURCE.
+
+        Tracker Test;
+        Reset(&Test);
+        UINT NumCalls = 0;
+        UINT NumBarriers = 0;
+        EmitFunction Emit = [&](const Barrier*, UINT Count)
+        {
+            NumCalls++;
+            NumBarriers += Count;
+        };
+
+        // First uses only ever show up at submission.
+        Transition(&Test, &Keys[0], UnorderedAccess);
+        Transition(&Test, &Keys[1], 0x800);
+        bool Passed = Flush(&Test, Emit) == 0;
+
+        // There and back again before any work is no barrier at all, two reads are one.
+        Transition(&Test, &Keys[0], 0x800);
+        Transition(&Test, &Keys[0], UnorderedAccess);
+        Transition(&Test, &Keys[1], 0x40);   // NON_PIXEL_SHADER_RESOURCE.
+        Transition(&Test, &Keys[1], 0x800);
+        Transition(&Test, &Keys[1], 0x40);
+        UAVBarrier(&Test, &Keys[0]);
+        UAVBarrier(&Test, &Keys[0]);
+        Passed = Passed && Test.Pending.size() == 2 && Test.Pending[0].After == (0x40 | 0x800);
+        Passed = Passed && Flush(&Test, Emit) == 2;
+
+        // A barrier for all UAVs covers the ones for single resources.
+        UAVBarrier(&Test, &Keys[0]);
+        UAVBarrier(&Test);
+        UAVBarrier(&Test, &Keys[1]);
+        Passed = Passed && Flush(&Test, Emit) == 1;
+
+        SetKnownState(&Test, &Keys[2], UnorderedAccess);
+        Transition(&Test, &Keys[2], 0x800);
+        Passed = Passed && Flush(&Test, Emit) == 1;
+
+        // Keys[0] starts in COMMON, Keys[1] is already where the list needs it.
+        Passed = Passed && Resolve(&Test, &Global, Emit) == 1;
+        Passed = Passed && Global.Current[&Keys[0]] == UnorderedAccess && Global.Current[&Keys[1]] == (0x40 | 0x800);
+        Passed = Passed && Global.Current.count(&Keys[2]) == 0;
+        return Passed && NumCalls == 4 && NumBarriers == 5;
+    }
+
+    bool RunTest(UINT NumCommandLists, UINT NumResources)
+    {
+        const States TestStates[] = {Common, 0x4, UnorderedAccess, 0x40, 0x80, 0xC0, 0x400, 0x800, 0x400000};
+        const UINT NumTestStates = sizeof(TestStates) / sizeof(TestStates[0]);
+        const UINT NumKnownResources = 8;
+        const UINT OperationsPerList = 200;
+
+        // Registered resources, followed from list to list, then ones created during the list.
+        std::vector<UINT8> Keys(NumResources + NumKnownResources);
+        std::unordered_map<const void*, States> Actual;
+        GlobalStates Global;
+        for (UINT i = 0; i < NumResources; ++i)
+        {
+            Register(&Global, &Keys[i], Common);
+            Actual[&Keys[i]] = Common;
+        }
+
+        UINT NumErrors = CheckMerging() ? 0 : 1;
+        UINT NumCalls = 0;
+        UINT NumBarriers = 0;
+        UINT NumRequests = 0;
+
+        // The null backend: every Emit is one ResourceBarrier call, checked against the actual states.
+        auto Replay = [&](const std::vector<Barrier>& Barriers)
+        {
+            NumCalls++;
+            NumBarriers += (UINT)Barriers.size();
+            for (const Barrier& Current : Barriers)
+            {
+                if (Current.Type != BarrierType::Transition)
+                {
+                    continue;
+                }
+                States& State = Actual[Current.Resource];
+                if (State != Current.Before || Current.Before == Current.After)
+                {
+                    NumErrors++;
+                }
+                State = Current.After;
+            }
+        };
+
+        Tracker List;
+        UINT32 Random = 0x5EED;
+        for (UINT ListIndex = 0; ListIndex < NumCommandLists; ++ListIndex)
+        {
+            Reset(&List);
+            std::vector<TestCommand> Commands;
+            std::unordered_map<const void*, States> Requested;
+            EmitFunction Record = [&](const Barrier* Barriers, UINT Count)
+            {
+                TestCommand Command;
+                Command.Barriers.assign(Barriers, Barriers + Count);
+                Commands.push_back(Command);
+            };
+
+            // A few resources at a time, like a pass.
+            UINT NumUsed = 1 + NextRandom(&Random) % std::min(NumResources, 16u);
+            UINT FirstUsed = NextRandom(&Random) % (NumResources - NumUsed + 1);
+            for (UINT Operation = 0; Operation < OperationsPerList; ++Operation)
+            {
+                UINT Choice = NextRandom(&Random) % 100;
+                const void* Resource = &Keys[FirstUsed + NextRandom(&Random) % NumUsed];
+                if (Choice < 3)
+                {
+                    // A resource created during the list, or the start of another life of one.
+                    const void* Created = &Keys[NumResources + NextRandom(&Random) % NumKnownResources];
+                    if (FindSlot(List, Created) == InvalidIndex)
+                    {
+                        States State = TestStates[NextRandom(&Random) % NumTestStates];
+                        SetKnownState(&List, Created, State);
+                        TestCommand Command;
+                        Command.KnownResource = Created;
+                        Command.KnownState = State;
+                        Commands.push_back(Command);
+                        Requested[Created] = State;
+                    }
+                }
+                else if (Choice < 8)
+                {
+                    const void* Created = &Keys[NumResources + NextRandom(&Random) % NumKnownResources];
+                    if (FindSlot(List, Created) != InvalidIndex)
+                    {
+                        Resource = Created;
+                    }
+                    States State = TestStates[NextRandom(&Random) % NumTestStates];
+                    Transition(&List, Resource, State);
+                    Requested[Resource] = State;
+                }
+                else if (Choice < 70)
+                {
+                    States State = TestStates[NextRandom(&Random) % NumTestStates];
+                    Transition(&List, Resource, State);
+                    Requested[Resource] = State;
+                }
+                else if (Choice < 80)
+                {
+                    UAVBarrier(&List, Choice < 75 ? Resource : nullptr);
+                }
+                else
+                {
+                    // A draw, dispatch or copy using whatever was asked for.
+                    Flush(&List, Record);
+                    TestCommand Command;
+                    Command.Expected.assign(Requested.begin(), Requested.end());
+                    Commands.push_back(Command);
+                    Requested.clear();
+                }
+            }
+            Flush(&List, Record);
+
+            // Submission: the resolved barriers go first, then the list.
+            std::vector<Barrier> Resolved;
+            Resolve(&List, &Global, [&](const Barrier* Barriers, UINT Count)
+            {
+                Resolved.assign(Barriers, Barriers + Count);
+            });
+            if (!Resolved.empty())
+            {
+                Replay(Resolved);
+            }
+            for (const TestCommand& Command : Commands)
+            {
+                if (Command.KnownResource != nullptr)
+                {
+                    Actual[Command.KnownResource] = Command.KnownState;
+                }
+                if (!Command.Barriers.empty())
+                {
+                    Replay(Command.Barriers);
+                }
+                for (const auto& Expected : Command.Expected)
+                {
+                    if (!Satisfies(Actual[Expected.first], Expected.second))
+                    {
+                        NumErrors++;
+                    }
+                }
+            }
+            NumRequests += List.NumRequests;
+
+            // Where the next list picks them up.
+            for (UINT i = 0; i < NumResources; ++i)
+            {
+                if (Global.Current[&Keys[i]] != Actual[&Keys[i]])
+                {
+                    NumErrors++;
+                }
+            }
+        }
+
+        bool Passed = NumErrors == 0;
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "ResourceStates: test %s, %u command lists, %u transitions and UAV barriers asked for, "
+                 "%u barriers in %u ResourceBarrier calls, %u errors\n",
+                 Passed ? "passed" : "FAILED", NumCommandLists, NumRequests, NumBarriers, NumCalls, NumErrors);
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+}
@@ -0,0 +1,390 @@
+#include "Headers/RtPipeline.h"
+#include <unordered_map>
+#include <unordered_set>
+
+namespace RtPipeline
+{
+    void AddLibrary(Desc* InDesc, const void* Bytecode, UINT64 BytecodeLength,
+                    const std::vector<const wchar_t*>& Exports)
+    {
+        Library NewLibrary;
+        NewLibrary.Bytecode = Bytecode;
+        NewLibrary.BytecodeLength = BytecodeLength;
+        for (const wchar_t* Export : Exports)
+        {
+            NewLibrary.Exports.push_back(Export);
+        }
+        InDesc->Libraries.push_back(std::move(NewLibrary));
+    }
+
+    void AddHitGroup(Desc* InDesc, const wchar_t* Name, const wchar_t* ClosestHit,
+                     const wchar_t* AnyHit, const wchar_t* Intersection)
+    {
+        HitGroup NewHitGroup;
+        NewHitGroup.Name = Name;
+        NewHitGroup.Type = Intersection ? HitGroupType::ProceduralPrimitive : HitGroupType::Triangles;
+        NewHitGroup.ClosestHit = ClosestHit ? ClosestHit : L"";
+        NewHitGroup.AnyHit = AnyHit ? AnyHit : L"";
+        NewHitGroup.Intersection = Intersection ? Intersection : L"";
+        InDesc->HitGroups.push_back(std::move(NewHitGroup));
+    }
+
+    void AssociateLocalRootSignature(Desc* InDesc, ID3D12RootSignature* RootSignature,
+                                     const std::vector<const wchar_t*>& Exports)
+    {
+        LocalRootSignatureAssociation Association;
+        Association.RootSignature = RootSignature;
+        for (const wchar_t* Export : Exports)
+        {
+            Association.Exports.push_back(Export);
+        }
+        InDesc->LocalRootSignatures.push_back(std::move(Association));
+    }
+
+    static std::string Narrow(const std::wstring& Name)
+    {
+        // Export names are plain ASCII identifiers.
+        std::string Result;
+        Result.reserve(Name.size());
+        for (wchar_t Character : Name)
+        {
+            Result.push_back(Character < 128 ? (char)Character : '?');
+        }
+        return Result;
+    }
+
+    // Names visible to associations and hit group imports.
+    struct ExportSet
+    {
+        std::unordered_set<std::wstring> Shaders;   // Library exports.
+        std::unordered_set<std::wstring> HitGroups;
+        std::unordered_map<std::wstring, ID3D12RootSignature*> LocalRootSignatures;
+    };
+
+    // Adds the exports of InDesc to Exports, reporting collisions with anything already there.
+    static void CollectExports(const Desc& InDesc, ExportSet* Exports, std::vector<std::string>* OutErrors)
+    {
+        for (size_t l = 0; l < InDesc.Libraries.size(); ++l)
+        {
+            const Library& InLibrary = InDesc.Libraries[l];
+            if (InLibrary.Bytecode == nullptr || InLibrary.BytecodeLength == 0)
+            {
+                OutErrors->push_back("Library " + std::to_string(l) + " has no bytecode");
+            }
+            if (InLibrary.Exports.empty())
+            {
+                OutErrors->push_back("Library " + std::to_string(l) + " exports nothing");
+            }
+            for (const std::wstring& Export : InLibrary.Exports)
+            {
+                if (!Exports->Shaders.insert(Export).second || Exports->HitGroups.count(Export))
+                {
+                    OutErrors->push_back("Duplicate export " + Narrow(Export));
+                }
+            }
+        }
+
+        for (const HitGroup& InHitGroup : InDesc.HitGroups)
+        {
+            if (InHitGroup.Name.empty())
+            {
+                OutErrors->push_back("Hit group without a name");
+            }
+            else if (Exports->Shaders.count(InHitGroup.Name) || !Exports->HitGroups.insert(InHitGroup.Name).second)
+            {
+                OutErrors->push_back("Duplicate export " + Narrow(InHitGroup.Name));
+            }
+        }
+    }
+
+    static void ValidateHitGroups(const Desc& InDesc, const ExportSet& Exports, std::vector<std::string>* OutErrors)
+    {
+        for (const HitGroup& InHitGroup : InDesc.HitGroups)
+        {
+            std::string Name = Narrow(InHitGroup.Name);
+            if (InHitGroup.ClosestHit.empty() && InHitGroup.AnyHit.empty() && InHitGroup.Intersection.empty())
+            {
+                OutErrors->push_back("Hit group " + Name + " has no shaders");
+            }
+            if (InHitGroup.Type == HitGroupType::ProceduralPrimitive && InHitGroup.Intersection.empty())
+            {
+                OutErrors->push_back("Procedural hit group " + Name + " needs an intersection shader");
+            }
+            if (InHitGroup.Type == HitGroupType::Triangles && !InHitGroup.Intersection.empty())
+            {
+                OutErrors->push_back("Triangle hit group " + Name + " can't have an intersection shader");
+            }
+
+            const std::wstring* Imports[3] = {&InHitGroup.ClosestHit, &InHitGroup.AnyHit, &InHitGroup.Intersection};
+            for (const std::wstring* Import : Imports)
+            {
+                if (!Import->empty() && !Exports.Shaders.count(*Import))
+                {
+                    OutErrors->push_back("Hit group " + Name + " imports unknown shader " + Narrow(*Import));
+                }
+            }
+        }
+    }
+
+    static void ValidateAssociations(const Desc& InDesc, ExportSet* Exports, std::vector<std::string>* OutErrors)
+    {
+        for (const LocalRootSignatureAssociation& Association : InDesc.LocalRootSignatures)
+        {
+            if (Association.RootSignature == nullptr)
+            {
+                OutErrors->push_back("Local root signature association without a root signature");
+            }
+            for (const std::wstring& Export : Association.Exports)
+            {
+                if (!Exports->Shaders.count(Export) && !Exports->HitGroups.count(Export))
+                {
+                    OutErrors->push_back("Local root signature associated with unknown export " + Narrow(Export));
+                    continue;
+                }
+
+                auto Inserted = Exports->LocalRootSignatures.insert(std::make_pair(Export, Association.RootSignature));
+                if (!Inserted.second && Inserted.first->second != Association.RootSignature)
+                {
+                    OutErrors->push_back("Conflicting local root signatures for " + Narrow(Export));
+                }
+            }
+        }
+    }
+
+    static void ValidatePipelineState(const Desc& InDesc, std::vector<std::string>* OutErrors)
+    {
+        if (InDesc.GlobalRootSignature == nullptr)
+        {
+            OutErrors->push_back("Missing global root signature");
+        }
+        if (InDesc.MaxPayloadSize == 0 || InDesc.MaxPayloadSize % 4 != 0)
+        {
+            OutErrors->push_back("Payload size must be a non-zero multiple of 4, got " + std::to_string(InDesc.MaxPayloadSize));
+        }
+        if (InDesc.MaxAttributeSize > MaxAttributeSize || InDesc.MaxAttributeSize % 4 != 0)
+        {
+            OutErrors->push_back("Attribute size must be a multiple of 4 up to " + std::to_string(MaxAttributeSize) +
+                                 ", got " + std::to_string(InDesc.MaxAttributeSize));
+        }
+        if (InDesc.MaxTraceRecursionDepth > MaxTraceRecursionDepth)
+        {
+            OutErrors->push_back("Trace recursion depth above " + std::to_string(MaxTraceRecursionDepth));
+        }
+    }
+
+    bool Validate(const Desc& InDesc, std::vector<std::string>* OutErrors)
+    {
+        size_t NumErrors = OutErrors->size();
+        ExportSet Exports;
+        CollectExports(InDesc, &Exports, OutErrors);
+        ValidateHitGroups(InDesc, Exports, OutErrors);
+        ValidateAssociations(InDesc, &Exports, OutErrors);
+        ValidatePipelineState(InDesc, OutErrors);
+        return OutErrors->size() == NumErrors;
+    }
+
+    bool ValidateAddition(const Desc& Existing, const Desc& Addition, std::vector<std::string>* OutErrors)
+    {
+        size_t NumErrors = OutErrors->size();
+        if (!Existing.AllowStateObjectAdditions)
+        {
+            OutErrors->push_back("The existing state object doesn't allow additions");
+        }
+
+        // Pipeline-wide state comes from the existing state object.
+        if (Addition.GlobalRootSignature != nullptr && Addition.GlobalRootSignature != Existing.GlobalRootSignature)
+        {
+            OutErrors->push_back("Additions can't change the global root signature");
+        }
+
+        // The existing exports were validated when they were added, only collisions and references matter here.
+        ExportSet Exports;
+        std::vector<std::string> ExistingErrors;
+        CollectExports(Existing, &Exports, &ExistingErrors);
+        ValidateAssociations(Existing, &Exports, &ExistingErrors);
+
+        CollectExports(Addition, &Exports, OutErrors);
+        ValidateHitGroups(Addition, Exports, OutErrors);
+        ValidateAssociations(Addition, &Exports, OutErrors);
+        return OutErrors->size() == NumErrors;
+    }
+
+    void Merge(Desc* Existing, const Desc& Addition)
+    {
+        Existing->Libraries.insert(Existing->Libraries.end(), Addition.Libraries.begin(), Addition.Libraries.end());
+        Existing->HitGroups.insert(Existing->HitGroups.end(), Addition.HitGroups.begin(), Addition.HitGroups.end());
+        Existing->LocalRootSignatures.insert(Existing->LocalRootSignatures.end(),
+                                             Addition.LocalRootSignatures.begin(), Addition.LocalRootSignatures.end());
+    }
+
+    bool RunTest()
+    {
+        // Only compared, never dereferenced.
+        static const UINT8 Bytecode[4] = {};
+        static UINT8 RootSignatures[3];
+        ID3D12RootSignature* GlobalRootSignature = (ID3D12RootSignature*)&RootSignatures[0];
+        ID3D12RootSignature* RayGenRootSignature = (ID3D12RootSignature*)&RootSignatures[1];
+        ID3D12RootSignature* HitRootSignature = (ID3D12RootSignature*)&RootSignatures[2];
+
+        // The DXRTutorial pipeline, which every case breaks in one way.
+        auto CreateBase = [&]()
+        {
+            Desc Base;
+            AddLibrary(&Base, Bytecode, sizeof(Bytecode), {L"RayGen", L"Miss", L"ClosestHit"});
+            AddHitGroup(&Base, L"HitGroup", L"ClosestHit");
+            AssociateLocalRootSignature(&Base, RayGenRootSignature, {L"RayGen"});
+            AssociateLocalRootSignature(&Base, HitRootSignature, {L"HitGroup"});
+            Base.GlobalRootSignature = GlobalRootSignature;
+            Base.MaxPayloadSize = 16;
+            Base.AllowStateObjectAdditions = true;
+            return Base;
+        };
+
+        // Expected is part of the error the case should report, nullptr when it should pass.
+        UINT NumCases = 0;
+        UINT NumErrors = 0;
+        auto Expect = [&](const char* Case, bool IsValid, const std::vector<std::string>& Errors,
+                          const char* Expected)
+        {
+            bool IsReported = Expected == nullptr;
+            for (const std::string& Error : Errors)
+            {
+                IsReported = IsReported || Error.find(Expected) != std::string::npos;
+            }
+            NumCases++;
+            if (IsValid != (Expected == nullptr) || !IsReported || (IsValid && !Errors.empty()))
+            {
+                NumErrors++;
+                char Message[256];
+                snprintf(Message, sizeof(Message), "RtPipeline: case \"%s\" failed, %zu errors reported\n", Case,
+                         Errors.size());
+                OutputDebugStringA(Message);
+            }
+        };
+        auto ExpectValidate = [&](const char* Case, const Desc& InDesc, const char* Expected)
+        {
+            std::vector<std::string> Errors;
+            bool IsValid = Validate(InDesc, &Errors);
+            Expect(Case, IsValid, Errors, Expected);
+        };
+        auto ExpectAddition = [&](const char* Case, const Desc& Existing, const Desc& Addition, const char* Expected)
+        {
+            std::vector<std::string> Errors;
+            bool IsValid = ValidateAddition(Existing, Addition, &Errors);
+            Expect(Case, IsValid, Errors, Expected);
+        };
+
+        ExpectValidate("valid", CreateBase(), nullptr);
+
+        {
+            Desc Duplicate = CreateBase();
+            AddLibrary(&Duplicate, Bytecode, sizeof(Bytecode), {L"Miss"});
+            ExpectValidate("export in two libraries", Duplicate, "Duplicate export Miss");
+
+            Duplicate = CreateBase();
+            AddHitGroup(&Duplicate, L"RayGen", L"ClosestHit");
+            ExpectValidate("hit group named like a shader", Duplicate, "Duplicate export RayGen");
+
+            Duplicate = CreateBase();
+            AddHitGroup(&Duplicate, L"HitGroup", L"ClosestHit");
+            ExpectValidate("hit group twice", Duplicate, "Duplicate export HitGroup");
+        }
+
+        {
+            Desc Missing = CreateBase();
+            AddHitGroup(&Missing, L"ShadowHitGroup", L"ClosestHit", L"ShadowAnyHit");
+            ExpectValidate("hit group importing a missing export", Missing, "imports unknown shader ShadowAnyHit");
+
+            Missing = CreateBase();
+            AddHitGroup(&Missing, L"ProceduralHitGroup", L"ClosestHit", nullptr, L"Intersection");
+            ExpectValidate("missing intersection shader", Missing, "imports unknown shader Intersection");
+
+            Missing = CreateBase();
+            AssociateLocalRootSignature(&Missing, HitRootSignature, {L"MissingHitGroup"});
+            ExpectValidate("association with a missing export", Missing, "unknown export MissingHitGroup");
+        }
+
+        {
+            Desc Conflicting = CreateBase();
+            AssociateLocalRootSignature(&Conflicting, HitRootSignature, {L"RayGen"});
+            ExpectValidate("export with two local root signatures", Conflicting,
+                           "Conflicting local root signatures for RayGen");
+
+            // The same one twice is fine.
+            Desc Repeated = CreateBase();
+            AssociateLocalRootSignature(&Repeated, RayGenRootSignature, {L"RayGen"});
+            ExpectValidate("export with the same local root signature twice", Repeated, nullptr);
+        }
+
+        {
+            Desc Limits = CreateBase();
+            Limits.MaxPayloadSize = 0;
+            ExpectValidate("no payload", Limits, "Payload size");
+            Limits.MaxPayloadSize = 6;
+            ExpectValidate("unaligned payload", Limits, "Payload size");
+
+            Limits = CreateBase();
+            Limits.MaxAttributeSize = MaxAttributeSize;
+            ExpectValidate("largest attributes", Limits, nullptr);
+            Limits.MaxAttributeSize = MaxAttributeSize + 4;
+            ExpectValidate("attributes too large", Limits, "Attribute size");
+            Limits.MaxAttributeSize = 6;
+            ExpectValidate("unaligned attributes", Limits, "Attribute size");
+
+            Limits = CreateBase();
+            Limits.MaxTraceRecursionDepth = MaxTraceRecursionDepth;
+            ExpectValidate("deepest recursion", Limits, nullptr);
+            Limits.MaxTraceRecursionDepth = MaxTraceRecursionDepth + 1;
+            ExpectValidate("recursion too deep", Limits, "Trace recursion depth");
+
+            Limits = CreateBase();
+            Limits.GlobalRootSignature = nullptr;
+            ExpectValidate("no global root signature", Limits, "Missing global root signature");
+        }
+
+        {
+            // Additions may use what the state object has, but not redefine it.
+            Desc Existing = CreateBase();
+            Desc Addition;
+            AddLibrary(&Addition, Bytecode, sizeof(Bytecode), {L"ShadowMiss"});
+            AddHitGroup(&Addition, L"ShadowHitGroup", L"ClosestHit");
+            AssociateLocalRootSignature(&Addition, HitRootSignature, {L"ShadowHitGroup"});
+            ExpectAddition("valid addition", Existing, Addition, nullptr);
+
+            Desc Redefining;
+            AddLibrary(&Redefining, Bytecode, sizeof(Bytecode), {L"Miss"});
+            ExpectAddition("addition redefining a shader", Existing, Redefining, "Duplicate export Miss");
+
+            Redefining = Desc();
+            AddLibrary(&Redefining, Bytecode, sizeof(Bytecode), {L"ShadowMiss"});
+            AddHitGroup(&Redefining, L"HitGroup", L"ClosestHit");
+            ExpectAddition("addition redefining a hit group", Existing, Redefining, "Duplicate export HitGroup");
+
+            Redefining = Addition;
+            AssociateLocalRootSignature(&Redefining, HitRootSignature, {L"RayGen"});
+            ExpectAddition("addition changing a local root signature", Existing, Redefining,
+                           "Conflicting local root signatures for RayGen");
+
+            Redefining = Addition;
+            Redefining.GlobalRootSignature = HitRootSignature;
+            ExpectAddition("addition changing the global root signature", Existing, Redefining,
+                           "global root signature");
+
+            Desc Sealed = CreateBase();
+            Sealed.AllowStateObjectAdditions = false;
+            ExpectAddition("addition to a state object without additions", Sealed, Addition, "doesn't allow additions");
+
+            // Once merged, what was added is existing too.
+            Merge(&Existing, Addition);
+            ExpectValidate("merged", Existing, nullptr);
+            ExpectAddition("same addition twice", Existing, Addition, "Duplicate export ShadowMiss");
+        }
+
+        bool Passed = NumErrors == 0;
+        char Message[256];
+        snprintf(Message, sizeof(Message), "RtPipeline: test %s, %u cases, %u errors\n",
+                 Passed ? "passed" : "FAILED", NumCases, NumErrors);
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+}
@@ -0,0 +1,357 @@
+#include "Headers/ShaderBindingTable.h"
+#include <chrono>
+#include <string.h>
+#include <wchar.h>
+
+namespace ShaderBindingTable
+{
+    RootArgument GpuAddress(UINT64 Address)
+    {
+        RootArgument Argument;
+        Argument.Type = ArgumentType::GpuAddress;
+        Argument.Value = Address;
+        return Argument;
+    }
+
+    RootArgument DescriptorTable(UINT64 GpuDescriptorHandle)
+    {
+        RootArgument Argument;
+        Argument.Type = ArgumentType::DescriptorTable;
+        Argument.Value = GpuDescriptorHandle;
+        return Argument;
+    }
+
+    RootArgument Constants(const void* Values, UINT NumValues)
+    {
+        RootArgument Argument;
+        Argument.Type = ArgumentType::Constants;
+        Argument.Constants.resize(NumValues);
+        memcpy(Argument.Constants.data(), Values, NumValues * sizeof(UINT32));
+        return Argument;
+    }
+
+    UINT AddRecord(Builder* InBuilder, Section InSection, const wchar_t* ExportName,
+                   std::vector<RootArgument> Arguments)
+    {
+        auto Inserted = InBuilder->ExportIndices.emplace(ExportName, (UINT)InBuilder->Exports.size());
+        UINT ExportIndex = Inserted.first->second;
+        if (Inserted.second)
+        {
+            // The caller's string may be gone by the time the identifiers are fetched, the key isn't.
+            InBuilder->Exports.push_back(Inserted.first->first.c_str());
+        }
+
+        std::vector<Record>& Records = InBuilder->Records[(UINT)InSection];
+        Record NewRecord;
+        NewRecord.ExportIndex = ExportIndex;
+        NewRecord.Arguments = std::move(Arguments);
+        Records.push_back(std::move(NewRecord));
+        return (UINT)Records.size() - 1;
+    }
+
+    static UINT64 ArgumentAlignment(const RootArgument& Argument)
+    {
+        return Argument.Type == ArgumentType::Constants ? sizeof(UINT32) : sizeof(UINT64);
+    }
+
+    static UINT64 ArgumentSize(const RootArgument& Argument)
+    {
+        return Argument.Type == ArgumentType::Constants ? Argument.Constants.size() * sizeof(UINT32) : sizeof(UINT64);
+    }
+
+    UINT64 ComputeRecordSize(const Record& InRecord)
+    {
+        UINT64 Size = ShaderIdentifierSize;
+        for (const RootArgument& Argument : InRecord.Arguments)
+        {
+            Size = AlignTo(Size, ArgumentAlignment(Argument)) + ArgumentSize(Argument);
+        }
+        return Size;
+    }
+
+    void ComputeLayout(const Builder& InBuilder, Layout* OutLayout)
+    {
+        *OutLayout = Layout();
+
+        UINT64 RecordPadding = 0;
+        for (UINT s = 0; s < NumSections; ++s)
+        {
+            SectionLayout& Current = OutLayout->Sections[s];
+            const std::vector<Record>& Records = InBuilder.Records[s];
+            UINT64 UsedBytes = 0;
+            for (const Record& InRecord : Records)
+            {
+                UINT64 RecordSize = ComputeRecordSize(InRecord);
+                UsedBytes += RecordSize;
+                Current.Stride = RecordSize > Current.Stride ? RecordSize : Current.Stride;
+            }
+            Current.Stride = AlignTo(Current.Stride, (UINT64)RecordAlignment);
+            assert(Current.Stride <= MaxRecordSize);
+            Current.NumRecords = (UINT)Records.size();
+            Current.Size = Current.Stride * Current.NumRecords;
+            RecordPadding += Current.Size - UsedBytes;
+        }
+
+        // Strides are multiples of RecordAlignment, so every section either ends on a TableAlignment boundary
+        // or RecordAlignment short of one. Only the latter need padding, unless they come last.
+        UINT Order[NumSections];
+        UINT NumOrdered = 0;
+        INT Unaligned = -1;
+        for (UINT s = 0; s < NumSections; ++s)
+        {
+            if (OutLayout->Sections[s].Size % TableAlignment != 0 && Unaligned == -1)
+            {
+                Unaligned = (INT)s;
+                continue;
+            }
+            Order[NumOrdered++] = s;
+        }
+        if (Unaligned != -1)
+        {
+            Order[NumOrdered++] = (UINT)Unaligned;
+        }
+
+        UINT64 Offset = 0;
+        UINT64 SectionPadding = 0;
+        for (UINT i = 0; i < NumSections; ++i)
+        {
+            SectionLayout& Current = OutLayout->Sections[Order[i]];
+            if (Current.NumRecords == 0)
+            {
+                continue;
+            }
+            UINT64 AlignedOffset = AlignTo(Offset, (UINT64)TableAlignment);
+            SectionPadding += AlignedOffset - Offset;
+            Current.Offset = AlignedOffset;
+            Offset = AlignedOffset + Current.Size;
+        }
+
+        OutLayout->TotalSize = Offset;
+        OutLayout->PaddingBytes = RecordPadding + SectionPadding;
+    }
+
+    void Write(const Builder& InBuilder, const Layout& InLayout, const void* const* Identifiers, UINT8* Destination)
+    {
+        memset(Destination, 0, InLayout.TotalSize);
+        for (UINT s = 0; s < NumSections; ++s)
+        {
+            const SectionLayout& Current = InLayout.Sections[s];
+            const std::vector<Record>& Records = InBuilder.Records[s];
+            assert(Records.size() == Current.NumRecords);
+
+            for (UINT r = 0; r < Current.NumRecords; ++r)
+            {
+                UINT8* RecordStart = Destination + Current.Offset + r * Current.Stride;
+                const Record& InRecord = Records[r];
+                assert(Identifiers[InRecord.ExportIndex] != nullptr);
+                memcpy(RecordStart, Identifiers[InRecord.ExportIndex], ShaderIdentifierSize);
+
+                UINT64 Offset = ShaderIdentifierSize;
+                for (const RootArgument& Argument : InRecord.Arguments)
+                {
+                    UINT64 AlignedOffset = AlignTo(Offset, ArgumentAlignment(Argument));
+                    if (Argument.Type == ArgumentType::Constants)
+                    {
+                        memcpy(RecordStart + AlignedOffset, Argument.Constants.data(), ArgumentSize(Argument));
+                    }
+                    else
+                    {
+                        memcpy(RecordStart + AlignedOffset, &Argument.Value, sizeof(UINT64));
+                    }
+                    Offset = AlignedOffset + ArgumentSize(Argument);
+                }
+            }
+        }
+    }
+
+    // Identifiers whose every byte tells which export and byte it is.
+    static void FillTestIdentifier(UINT Export, UINT8* Identifier)
+    {
+        for (UINT i = 0; i < ShaderIdentifierSize; ++i)
+        {
+            Identifier[i] = (UINT8)(Export * 37 + i + 1);
+        }
+    }
+
+    bool RunTest(UINT NumHitGroups)
+    {
+        UINT NumErrors = 0;
+
+        // Two identifier-only records in every section: 64 bytes each, in section order and without padding.
+        {
+            Builder Aligned;
+            for (UINT s = 0; s < NumSections; ++s)
+            {
+                AddRecord(&Aligned, (Section)s, L"Shader");
+                AddRecord(&Aligned, (Section)s, L"Shader");
+            }
+            Layout Computed;
+            ComputeLayout(Aligned, &Computed);
+            for (UINT s = 0; s < NumSections; ++s)
+            {
+                const SectionLayout& Current = Computed.Sections[s];
+                NumErrors += Current.Offset != s * 2 * RecordAlignment || Current.Stride != RecordAlignment ||
+                             Current.Size != 2 * RecordAlignment || Current.NumRecords != 2;
+            }
+            NumErrors += Computed.TotalSize != NumSections * 2 * RecordAlignment || Computed.PaddingBytes != 0;
+            NumErrors += Aligned.Exports.size() != 1;
+        }
+
+        // Export names only have to live for the AddRecord call, the caller may overwrite them right after.
+        {
+            std::vector<std::wstring> Expected;
+            for (UINT i = 0; i < 64; ++i)
+            {
+                Expected.push_back(L"Temporary" + std::to_wstring(i));
+            }
+            Builder Temporary;
+            for (const std::wstring& Original : Expected)
+            {
+                std::wstring Name = Original;
+                AddRecord(&Temporary, Section::HitGroup, Name.c_str());
+                Name.assign(Name.size(), L'?');
+            }
+            NumErrors += Temporary.Exports.size() != Expected.size();
+            for (UINT i = 0; i < Temporary.Exports.size(); ++i)
+            {
+                NumErrors += Expected[i] != Temporary.Exports[i];
+            }
+        }
+
+        // A 32-byte ray generation section goes last instead of padding the sections after it. A record with an
+        // argument is 40 bytes and takes 64.
+        {
+            Builder Unaligned;
+            AddRecord(&Unaligned, Section::RayGen, L"RayGen");
+            AddRecord(&Unaligned, Section::Miss, L"Miss", {GpuAddress(0x1000)});
+            AddRecord(&Unaligned, Section::HitGroup, L"HitGroup");
+            AddRecord(&Unaligned, Section::HitGroup, L"HitGroup");
+            Layout Computed;
+            ComputeLayout(Unaligned, &Computed);
+            const SectionLayout* Sections = Computed.Sections;
+            NumErrors += Sections[(UINT)Section::Miss].Offset != 0 || Sections[(UINT)Section::Miss].Stride != 64;
+            NumErrors += Sections[(UINT)Section::HitGroup].Offset != 64;
+            NumErrors += Sections[(UINT)Section::RayGen].Offset != 128;
+            NumErrors += Computed.TotalSize != 160 || Computed.PaddingBytes != 64 - 40;
+
+            // With a second one, only the first moves and the other is padded.
+            AddRecord(&Unaligned, Section::Callable, L"Callable");
+            ComputeLayout(Unaligned, &Computed);
+            NumErrors += Sections[(UINT)Section::Callable].Offset != 128;
+            NumErrors += Sections[(UINT)Section::RayGen].Offset != 192;
+            NumErrors += Computed.TotalSize != 224 || Computed.PaddingBytes != 64 - 40 + TableAlignment - 32;
+        }
+
+        // Constants pack right after the identifier, 8-byte arguments are aligned up to the next 8 bytes, and the
+        // rest of the record and the padding between sections are zero.
+        {
+            Builder Arguments;
+            UINT32 Values[3] = {0x11111111, 0x22222222, 0x33333333};
+            AddRecord(&Arguments, Section::RayGen, L"RayGen",
+                      {Constants(Values, 3), GpuAddress(0x1122334455667788), DescriptorTable(0xAABB)});
+            AddRecord(&Arguments, Section::Miss, L"Miss");
+            Layout Computed;
+            ComputeLayout(Arguments, &Computed);
+            NumErrors += Computed.Sections[(UINT)Section::RayGen].Stride != 64;
+
+            UINT8 Identifiers[2][ShaderIdentifierSize];
+            const void* IdentifierPointers[2] = {Identifiers[0], Identifiers[1]};
+            FillTestIdentifier(0, Identifiers[0]);
+            FillTestIdentifier(1, Identifiers[1]);
+            std::vector<UINT8> Table(Computed.TotalSize, 0xCD);
+            Write(Arguments, Computed, IdentifierPointers, Table.data());
+
+            const UINT8* RayGen = Table.data() + Computed.Sections[(UINT)Section::RayGen].Offset;
+            const UINT8* Miss = Table.data() + Computed.Sections[(UINT)Section::Miss].Offset;
+            UINT32 Padding = 0xFFFFFFFF;
+            UINT64 Address = 0;
+            UINT64 Handle = 0;
+            memcpy(&Padding, RayGen + 44, sizeof(Padding));
+            memcpy(&Address, RayGen + 48, sizeof(Address));
+            memcpy(&Handle, RayGen + 56, sizeof(Handle));
+            NumErrors += memcmp(RayGen, Identifiers[0], ShaderIdentifierSize) != 0;
+            NumErrors += memcmp(RayGen + ShaderIdentifierSize, Values, sizeof(Values)) != 0;
+            NumErrors += Padding != 0 || Address != 0x1122334455667788 || Handle != 0xAABB;
+            NumErrors += memcmp(Miss, Identifiers[1], ShaderIdentifierSize) != 0;
+            for (const UINT8* Byte = Miss + ShaderIdentifierSize; Byte < Table.data() + Table.size(); ++Byte)
+            {
+                NumErrors += *Byte != 0;
+            }
+        }
+
+        // A large hit group table. Its export names come from two sets of strings, so the same name has different
+        // pointers. Every record is read back against the identifier of the name it was added with.
+        static const UINT NumExports = 256;
+        std::vector<std::wstring> Names[2];
+        for (UINT i = 0; i < NumExports; ++i)
+        {
+            Names[0].push_back(L"HitGroup" + std::to_wstring(i));
+            Names[1].push_back(Names[0].back());
+        }
+
+        Builder Large;
+        auto Start = std::chrono::high_resolution_clock::now();
+        AddRecord(&Large, Section::RayGen, L"RayGen");
+        AddRecord(&Large, Section::Miss, L"Miss");
+        for (UINT i = 0; i < NumHitGroups; ++i)
+        {
+            UINT32 Value = i;
+            std::vector<RootArgument> RecordArguments = {GpuAddress(0x10000 + i)};
+            if (i % 3 == 0)
+            {
+                RecordArguments.push_back(Constants(&Value, 1));
+            }
+            const wchar_t* Name = Names[i % 2][(i * 7) % NumExports].c_str();
+            NumErrors += AddRecord(&Large, Section::HitGroup, Name, std::move(RecordArguments)) != i;
+        }
+        auto End = std::chrono::high_resolution_clock::now();
+        NumErrors += Large.Exports.size() != NumExports + 2;
+
+        Layout Computed;
+        ComputeLayout(Large, &Computed);
+        const SectionLayout& HitGroups = Computed.Sections[(UINT)Section::HitGroup];
+        NumErrors += HitGroups.Stride != 64 || HitGroups.Size != 64ull * NumHitGroups;
+        NumErrors += HitGroups.Offset % TableAlignment != 0;
+
+        std::vector<UINT8> IdentifierBytes(Large.Exports.size() * ShaderIdentifierSize);
+        std::vector<const void*> Identifiers(Large.Exports.size());
+        for (UINT i = 0; i < Large.Exports.size(); ++i)
+        {
+            FillTestIdentifier(i, &IdentifierBytes[i * ShaderIdentifierSize]);
+            Identifiers[i] = &IdentifierBytes[i * ShaderIdentifierSize];
+        }
+        std::vector<UINT8> Table(Computed.TotalSize);
+        Write(Large, Computed, Identifiers.data(), Table.data());
+
+        for (UINT i = 0; i < NumHitGroups; ++i)
+        {
+            // Brute force over the exports for the one with the record's name.
+            const wchar_t* Name = Names[0][(i * 7) % NumExports].c_str();
+            UINT Export = 0;
+            while (Export < Large.Exports.size() && wcscmp(Large.Exports[Export], Name) != 0)
+            {
+                ++Export;
+            }
+
+            const UINT8* Current = Table.data() + HitGroups.Offset + (UINT64)i * HitGroups.Stride;
+            UINT64 Address = 0;
+            UINT32 Value = 0;
+            memcpy(&Address, Current + ShaderIdentifierSize, sizeof(Address));
+            memcpy(&Value, Current + ShaderIdentifierSize + sizeof(Address), sizeof(Value));
+            NumErrors += Export == Large.Exports.size() ||
+                         memcmp(Current, Identifiers[Export], ShaderIdentifierSize) != 0;
+            NumErrors += Address != 0x10000 + i || Value != (i % 3 == 0 ? i : 0);
+        }
+
+        bool Passed = NumErrors == 0;
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "ShaderBindingTable: test %s, %u hit groups over %u exports added in %.2f ms, %llu byte table, "
+                 "%u errors\n",
+                 Passed ? "passed" : "FAILED", NumHitGroups, NumExports,
+                 std::chrono::duration<double, std::milli>(End - Start).count(),
+                 (unsigned long long)Computed.TotalSize, NumErrors);
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+}
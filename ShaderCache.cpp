@@ -0,0 +1,611 @@
+#include "Headers/ShaderCache.h"
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string.h>
+
+namespace ShaderCache
+{
+    void Add(Hasher* InHasher, const void* Data, UINT64 Size)
+    {
+        const UINT8* Bytes = (const UINT8*)Data;
+        UINT64 Low = InHasher->Low;
+        UINT64 High = InHasher->High;
+        for (UINT64 i = 0; i < Size; ++i)
+        {
+            Low = (Low ^ Bytes[i]) * 1099511628211ull;
+            High = (High + Bytes[i]) * 0xBF58476D1CE4E5B9ull;
+            High ^= High >> 29;
+        }
+        InHasher->Low = Low;
+        InHasher->High = High;
+        InHasher->Size += Size;
+    }
+
+    static UINT64 Mix(UINT64 Value)
+    {
+        Value ^= Value >> 33;
+        Value *= 0xFF51AFD7ED558CCDull;
+        Value ^= Value >> 33;
+        Value *= 0xC4CEB9FE1A85EC53ull;
+        return Value ^ (Value >> 33);
+    }
+
+    Key Finish(const Hasher& InHasher)
+    {
+        Key Finished;
+        Finished.Low = Mix(InHasher.Low ^ InHasher.Size);
+        Finished.High = Mix(InHasher.High + Finished.Low);
+        return Finished;
+    }
+
+    static bool IsLess(const Key& A, const Key& B)
+    {
+        return A.High != B.High ? A.High < B.High : A.Low < B.Low;
+    }
+
+    static bool IsEqual(const Key& A, const Key& B)
+    {
+        return A.High == B.High && A.Low == B.Low;
+    }
+
+    void GetIncludes(const std::string& Source, std::vector<std::string>* Includes)
+    {
+        const char* Whitespace = " \t";
+        size_t Begin = Source.compare(0, 3, "\xEF\xBB\xBF") == 0 ? 3 : 0;
+        while (Begin < Source.size())
+        {
+            size_t End = std::min(Source.find('\n', Begin), Source.size());
+            size_t Next = Source.find_first_not_of(Whitespace, Begin);
+            if (Next < End && Source[Next] == '#')
+            {
+                Next = Source.find_first_not_of(Whitespace, Next + 1);
+                if (Next < End && Source.compare(Next, 7, "include") == 0)
+                {
+                    Next = Source.find_first_not_of(Whitespace, Next + 7);
+                    if (Next < End && (Source[Next] == '"' || Source[Next] == '<'))
+                    {
+                        size_t NameEnd = Source.find(Source[Next] == '"' ? '"' : '>', Next + 1);
+                        if (NameEnd < End)
+                        {
+                            Includes->push_back(Source.substr(Next + 1, NameEnd - Next - 1));
+                        }
+                    }
+                }
+            }
+            Begin = End + 1;
+        }
+    }
+
+    bool HashSource(const std::string& Filename, const ReadFunction& Read, Hasher* InHasher,
+                    std::vector<std::string>* Files)
+    {
+        // Breadth first, so the order is the same every time, and an include cycle ends at the first repeat.
+        std::vector<std::string> Pending = {Filename};
+        std::string Contents;
+        std::vector<std::string> Includes;
+        for (size_t Next = 0; Next < Pending.size(); ++Next)
+        {
+            Contents.clear();
+            if (!Read(Pending[Next], &Contents))
+            {
+                return false;
+            }
+            UINT64 Size = Contents.size();
+            Add(InHasher, Pending[Next].c_str(), Pending[Next].size() + 1);
+            Add(InHasher, &Size, sizeof(Size));
+            Add(InHasher, Contents.data(), Size);
+
+            Includes.clear();
+            GetIncludes(Contents, &Includes);
+            for (const std::string& Include : Includes)
+            {
+                if (std::find(Pending.begin(), Pending.end(), Include) == Pending.end())
+                {
+                    Pending.push_back(Include);
+                }
+            }
+        }
+        if (Files)
+        {
+            *Files = Pending;
+        }
+        return true;
+    }
+
+    bool ComputeKey(const std::string& Filename, const ReadFunction& Read, const std::vector<std::string>& Arguments,
+                    const Key& CompilerVersion, Key* OutKey, std::vector<std::string>* Files)
+    {
+        Hasher Hashing;
+        if (!HashSource(Filename, Read, &Hashing, Files))
+        {
+            return false;
+        }
+        for (const std::string& Argument : Arguments)
+        {
+            Add(&Hashing, Argument.c_str(), Argument.size() + 1);
+        }
+        Add(&Hashing, &CompilerVersion, sizeof(CompilerVersion));
+        *OutKey = Finish(Hashing);
+        return true;
+    }
+
+    bool Open(Cache* InCache, const void* Archive, UINT64 ArchiveSize)
+    {
+        InCache->Archive = nullptr;
+        InCache->Entries = nullptr;
+        InCache->NumEntries = 0;
+
+        const ArchiveHeader* Header = (const ArchiveHeader*)Archive;
+        if (!Archive || ArchiveSize < sizeof(ArchiveHeader) || Header->Magic != ArchiveMagic ||
+            Header->Version != ArchiveVersion ||
+            Header->NumEntries > (ArchiveSize - sizeof(ArchiveHeader)) / sizeof(ArchiveEntry))
+        {
+            return false;
+        }
+        const ArchiveEntry* Entries = (const ArchiveEntry*)(Header + 1);
+        for (UINT64 i = 0; i < Header->NumEntries; ++i)
+        {
+            if (Entries[i].Offset > ArchiveSize || Entries[i].Size > ArchiveSize - Entries[i].Offset ||
+                (i > 0 && !IsLess(Entries[i - 1].EntryKey, Entries[i].EntryKey)))
+            {
+                return false;
+            }
+        }
+
+        InCache->Archive = (const UINT8*)Archive;
+        InCache->Entries = Entries;
+        InCache->NumEntries = Header->NumEntries;
+        InCache->IsUsed.reset(new std::atomic<bool>[Header->NumEntries]);
+        for (UINT64 i = 0; i < Header->NumEntries; ++i)
+        {
+            InCache->IsUsed[i].store(false);
+        }
+        return true;
+    }
+
+    static const ArchiveEntry* FindEntry(const Cache& InCache, const Key& InKey)
+    {
+        const ArchiveEntry* End = InCache.Entries + InCache.NumEntries;
+        const ArchiveEntry* Found = std::lower_bound(InCache.Entries, End, InKey,
+                                                     [](const ArchiveEntry& Entry, const Key& Searched)
+                                                     {
+                                                         return IsLess(Entry.EntryKey, Searched);
+                                                     });
+        return Found != End && IsEqual(Found->EntryKey, InKey) ? Found : nullptr;
+    }
+
+    static void CountHit(Cache* InCache, double CompileSeconds)
+    {
+        InCache->NumHits.fetch_add(1, std::memory_order_relaxed);
+        InCache->SavedMicroseconds.fetch_add((UINT64)(CompileSeconds * 1e6), std::memory_order_relaxed);
+    }
+
+    bool Find(Cache* InCache, const Key& InKey, const void** OutBlob, UINT64* OutSize)
+    {
+        if (const ArchiveEntry* Found = FindEntry(*InCache, InKey))
+        {
+            InCache->IsUsed[Found - InCache->Entries].store(true, std::memory_order_relaxed);
+            *OutBlob = InCache->Archive + Found->Offset;
+            *OutSize = Found->Size;
+            CountHit(InCache, Found->CompileSeconds);
+            return true;
+        }
+
+        // Blobs added this run don't move, AddedBlobs only ever moves the vectors holding them.
+        std::lock_guard<std::mutex> Guard(InCache->Lock);
+        for (size_t i = 0; i < InCache->Added.size(); ++i)
+        {
+            if (IsEqual(InCache->Added[i].EntryKey, InKey))
+            {
+                *OutBlob = InCache->AddedBlobs[i].data();
+                *OutSize = InCache->Added[i].Size;
+                CountHit(InCache, InCache->Added[i].CompileSeconds);
+                return true;
+            }
+        }
+        InCache->NumMisses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void Add(Cache* InCache, const Key& InKey, const void* Blob, UINT64 Size, double CompileSeconds)
+    {
+        std::lock_guard<std::mutex> Guard(InCache->Lock);
+        for (const ArchiveEntry& Added : InCache->Added)
+        {
+            if (IsEqual(Added.EntryKey, InKey))
+            {
+                return; // Compiled twice at the same time.
+            }
+        }
+        ArchiveEntry Added = {};
+        Added.EntryKey = InKey;
+        Added.Size = Size;
+        Added.CompileSeconds = CompileSeconds;
+        InCache->Added.push_back(Added);
+        InCache->AddedBlobs.emplace_back((const UINT8*)Blob, (const UINT8*)Blob + Size);
+    }
+
+    bool HasChanged(const Cache& InCache)
+    {
+        return !InCache.Added.empty() || InCache.NumEntries > MaxEntries;
+    }
+
+    void Serialize(const Cache& InCache, std::vector<UINT8>* OutArchive)
+    {
+        struct Kept
+        {
+            ArchiveEntry Entry;
+            const UINT8* Blob;
+        };
+        std::vector<Kept> Entries;
+        bool IsFull = InCache.NumEntries + InCache.Added.size() > MaxEntries;
+        for (UINT64 i = 0; i < InCache.NumEntries; ++i)
+        {
+            if (!IsFull || InCache.IsUsed[i].load(std::memory_order_relaxed))
+            {
+                Entries.push_back({InCache.Entries[i], InCache.Archive + InCache.Entries[i].Offset});
+            }
+        }
+        for (size_t i = 0; i < InCache.Added.size(); ++i)
+        {
+            if (!FindEntry(InCache, InCache.Added[i].EntryKey))
+            {
+                Entries.push_back({InCache.Added[i], InCache.AddedBlobs[i].data()});
+            }
+        }
+        std::sort(Entries.begin(), Entries.end(), [](const Kept& A, const Kept& B)
+        {
+            return IsLess(A.Entry.EntryKey, B.Entry.EntryKey);
+        });
+
+        UINT64 Offset = AlignTo(sizeof(ArchiveHeader) + Entries.size() * sizeof(ArchiveEntry), BlobAlignment);
+        for (Kept& Entry : Entries)
+        {
+            Entry.Entry.Offset = Offset;
+            Offset = AlignTo(Offset + Entry.Entry.Size, BlobAlignment);
+        }
+        OutArchive->assign(Offset, 0);
+
+        ArchiveHeader Header = {ArchiveMagic, ArchiveVersion, Entries.size()};
+        memcpy(OutArchive->data(), &Header, sizeof(Header));
+        ArchiveEntry* Written = (ArchiveEntry*)(OutArchive->data() + sizeof(Header));
+        for (size_t i = 0; i < Entries.size(); ++i)
+        {
+            Written[i] = Entries[i].Entry;
+            memcpy(OutArchive->data() + Entries[i].Entry.Offset, Entries[i].Blob, Entries[i].Entry.Size);
+        }
+    }
+
+    void Report(const Cache& InCache)
+    {
+        UINT NumHits = InCache.NumHits.load();
+        UINT NumLookups = NumHits + InCache.NumMisses.load();
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "ShaderCache: %u of %u shaders from the cache (%.0f%%), %.0f ms of compiling saved, "
+                 "%.1f ms finding keys\n",
+                 NumHits, NumLookups, NumLookups ? 100.0 * NumHits / NumLookups : 0.0,
+                 InCache.SavedMicroseconds.load() * 1e-3, InCache.HashMicroseconds.load() * 1e-3);
+        OutputDebugStringA(Message);
+    }
+
+    static UINT32 NextRandom(UINT32* State)
+    {
+        *State = *State * 1664525u + 1013904223u;
+        return *State >> 8;
+    }
+
+    struct TestShader
+    {
+        std::string Filename;
+        std::string Entry;
+        std::string Profile;
+        std::string Defines;
+    };
+
+    typedef std::map<std::string, std::string> TestFiles;
+
+    // Keyed like D3D::CompileShader keys them, with the arguments it passes.
+    static bool GetTestKey(const TestFiles& Files, const TestShader& Shader, UINT CompilerVersion, Key* OutKey)
+    {
+        auto Read = [&](const std::string& Filename, std::string* Contents)
+        {
+            auto Found = Files.find(Filename);
+            if (Found != Files.end())
+            {
+                *Contents = Found->second;
+            }
+            return Found != Files.end();
+        };
+        std::vector<std::string> Arguments = {"-E", Shader.Entry, "-T", Shader.Profile, "-I", "Shaders\\"};
+        if (!Shader.Defines.empty())
+        {
+            Arguments.push_back("-D");
+            Arguments.push_back(Shader.Defines);
+        }
+        Key Version;
+        Version.Low = CompilerVersion;
+        return ComputeKey(Shader.Filename, Read, Arguments, Version, OutKey);
+    }
+
+    // Bytecode that changes with anything that went into it.
+    static std::vector<UINT8> StubCompile(const TestFiles& Files, const TestShader& Shader, UINT CompilerVersion)
+    {
+        std::string Output = Shader.Entry + "|" + Shader.Profile + "|" + Shader.Defines + "|" +
+                             std::to_string(CompilerVersion) + "|";
+        auto Read = [&](const std::string& Filename, std::string* Contents)
+        {
+            *Contents = Files.at(Filename);
+            Output += *Contents;
+            return true;
+        };
+        Hasher Unused;
+        HashSource(Shader.Filename, Read, &Unused);
+        return std::vector<UINT8>(Output.begin(), Output.end());
+    }
+
+    // Finds or compiles every shader, returns how many it compiled and how many came out wrong.
+    static UINT CompileAll(Cache* InCache, const TestFiles& Files, const std::vector<TestShader>& Shaders,
+                           UINT CompilerVersion, UINT* NumErrors, std::vector<UINT>* Compiled = nullptr)
+    {
+        UINT NumCompiled = 0;
+        for (UINT i = 0; i < Shaders.size(); ++i)
+        {
+            Key ShaderKey;
+            if (!GetTestKey(Files, Shaders[i], CompilerVersion, &ShaderKey))
+            {
+                (*NumErrors)++;
+                continue;
+            }
+            std::vector<UINT8> Expected = StubCompile(Files, Shaders[i], CompilerVersion);
+            const void* Blob = nullptr;
+            UINT64 Size = 0;
+            if (!Find(InCache, ShaderKey, &Blob, &Size))
+            {
+                NumCompiled++;
+                if (Compiled)
+                {
+                    Compiled->push_back(i);
+                }
+                Add(InCache, ShaderKey, Expected.data(), Expected.size(), 1e-3);
+                continue;
+            }
+            if (Size != Expected.size() || memcmp(Blob, Expected.data(), Size) != 0 ||
+                (UINT64)Blob % BlobAlignment != 0)
+            {
+                (*NumErrors)++;
+            }
+        }
+        return NumCompiled;
+    }
+
+    bool RunTest(UINT NumShaders)
+    {
+        // Shaders include Shared.h directly, through Common.hlsli, both or neither, and the last one a cycle.
+        TestFiles Files;
+        Files["Shared.h"] = "\xEF\xBB\xBF#pragma once\nstruct SceneConstants { float4x4 ViewProj; };\n";
+        Files["Common.hlsli"] = "#pragma once\n  #  include \"Shared.h\"\nfloat3 Shade() { return 1; }\n";
+        Files["A.hlsli"] = "#pragma once\n#include \"B.hlsli\"\n";
+        Files["B.hlsli"] = "#pragma once\n#include <A.hlsli>\n";
+        std::vector<TestShader> Shaders;
+        auto IncludesShared = [](UINT Index) { return Index % 2 == 0 || Index % 3 == 0; };
+        for (UINT i = 0; i < NumShaders; ++i)
+        {
+            std::string Filename = "Shader" + std::to_string(i) + ".hlsl";
+            std::string& Source = Files[Filename];
+            Source += i % 2 == 0 ? "#include \"Shared.h\"\n" : "// #include \"Shared.h\"\n";
+            Source += i % 3 == 0 ? "#include \"Common.hlsli\"\n" : "";
+            Source += i == NumShaders - 1 ? "#include \"A.hlsli\"\n" : "";
+            Source += "void Main() { /* " + std::to_string(i) + " */ }\n";
+            Shaders.push_back({Filename, "MSMain", "ms_6_6", ""});
+            Shaders.push_back({Filename, "PSMain", "ps_6_6", ""});
+        }
+        Shaders.push_back({"Shader1.hlsl", "PSMain", "ps_6_6", "DEBUG_VIEW=1"});
+        UINT NumRequests = (UINT)Shaders.size();
+
+        UINT NumErrors = 0;
+        UINT Version = 1;
+        std::vector<UINT> Compiled;
+
+        // Cold, then warm from the cold run's archive.
+        Cache Cold;
+        NumErrors += Open(&Cold, nullptr, 0) ? 1 : 0;
+        NumErrors += CompileAll(&Cold, Files, Shaders, Version, &NumErrors) == NumRequests ? 0 : 1;
+        NumErrors += CompileAll(&Cold, Files, Shaders, Version, &NumErrors) == 0 ? 0 : 1;
+        std::vector<UINT8> Archive;
+        Serialize(Cold, &Archive);
+
+        Cache Warm;
+        NumErrors += Open(&Warm, Archive.data(), Archive.size()) && Warm.NumEntries == NumRequests ? 0 : 1;
+        NumErrors += CompileAll(&Warm, Files, Shaders, Version, &NumErrors) == 0 ? 0 : 1;
+        NumErrors += HasChanged(Warm) || Warm.NumHits.load() != NumRequests ? 1 : 0;
+
+        // Each edit recompiles exactly what it affects, against the warm archive.
+        auto CheckEdit = [&](const TestFiles& Edited, const std::vector<TestShader>& EditedShaders, UINT EditedVersion,
+                             const std::function<bool(UINT Request)>& IsAffected)
+        {
+            Cache AfterEdit;
+            Open(&AfterEdit, Archive.data(), Archive.size());
+            Compiled.clear();
+            CompileAll(&AfterEdit, Edited, EditedShaders, EditedVersion, &NumErrors, &Compiled);
+            for (UINT i = 0; i < EditedShaders.size(); ++i)
+            {
+                bool IsCompiled = std::find(Compiled.begin(), Compiled.end(), i) != Compiled.end();
+                NumErrors += IsCompiled == IsAffected(i) ? 0 : 1;
+            }
+        };
+
+        TestFiles Edited = Files;
+        Edited["Shared.h"] += "static const float Exposure = 2;\n";
+        CheckEdit(Edited, Shaders, Version, [&](UINT Request)
+        {
+            return Request < NumShaders * 2 ? IncludesShared(Request / 2) : IncludesShared(1);
+        });
+
+        Edited = Files;
+        Edited["Shader1.hlsl"] += "\n";
+        CheckEdit(Edited, Shaders, Version, [&](UINT Request)
+        {
+            return Shaders[Request].Filename == "Shader1.hlsl";
+        });
+
+        Edited = Files;
+        Edited["B.hlsli"] += "// Through the cycle.\n";
+        CheckEdit(Edited, Shaders, Version, [&](UINT Request)
+        {
+            return Shaders[Request].Filename == "Shader" + std::to_string(NumShaders - 1) + ".hlsl";
+        });
+
+        std::vector<TestShader> EditedShaders = Shaders;
+        EditedShaders[0].Entry = "ASMain";
+        EditedShaders[1].Profile = "ps_6_7";
+        EditedShaders.back().Defines = "DEBUG_VIEW=2";
+        CheckEdit(Files, EditedShaders, Version, [&](UINT Request)
+        {
+            return Request == 0 || Request == 1 || Request == NumRequests - 1;
+        });
+
+        CheckEdit(Files, Shaders, Version + 1, [](UINT) { return true; });
+
+        // A missing include can't be keyed, the shader compiles without the cache.
+        Edited = Files;
+        Edited.erase("Common.hlsli");
+        Key Missing;
+        NumErrors += GetTestKey(Edited, Shaders[0], Version, &Missing) ? 1 : 0;
+
+        // Editing an include changes the key of what includes it, directly or not, and only theirs.
+        Key Keys[2][3];
+        Edited = Files;
+        Edited["Common.hlsli"] += "float3 Tint() { return 0; }\n";
+        for (UINT i = 0; i < 3; ++i)
+        {
+            NumErrors += GetTestKey(Files, Shaders[i * 2], Version, &Keys[0][i]) ? 0 : 1;
+            NumErrors += GetTestKey(Edited, Shaders[i * 2], Version, &Keys[1][i]) ? 0 : 1;
+        }
+        NumErrors += IsEqual(Keys[0][0], Keys[1][0]) ? 1 : 0; // Shader0 includes Common.hlsli.
+        NumErrors += IsEqual(Keys[0][1], Keys[1][1]) ? 0 : 1; // Shader1 includes nothing.
+        NumErrors += IsEqual(Keys[0][2], Keys[1][2]) ? 0 : 1; // Shader2 only includes Shared.h.
+        Edited = Files;
+        Edited["Shared.h"] += "\n";
+        NumErrors += GetTestKey(Edited, Shaders[6], Version, &Keys[1][0]) ? 0 : 1;
+        NumErrors += GetTestKey(Files, Shaders[6], Version, &Keys[0][0]) ? 0 : 1;
+        NumErrors += IsEqual(Keys[0][0], Keys[1][0]) ? 1 : 0; // Shader3 includes Shared.h through Common.hlsli.
+
+        // Archives it didn't write are ignored.
+        Cache Rejected;
+        NumErrors += Open(&Rejected, Archive.data(), Archive.size() / 2) ? 1 : 0;
+        NumErrors += Open(&Rejected, Archive.data(), sizeof(ArchiveHeader) - 1) ? 1 : 0;
+        std::vector<UINT8> OtherVersion = Archive;
+        ((ArchiveHeader*)OtherVersion.data())->Version++;
+        NumErrors += Open(&Rejected, OtherVersion.data(), OtherVersion.size()) ? 1 : 0;
+        std::vector<UINT8> Unsorted = Archive;
+        ArchiveEntry* UnsortedEntries = (ArchiveEntry*)(Unsorted.data() + sizeof(ArchiveHeader));
+        std::swap(UnsortedEntries[0], UnsortedEntries[1]);
+        NumErrors += Open(&Rejected, Unsorted.data(), Unsorted.size()) ? 1 : 0;
+        NumErrors += Rejected.NumEntries == 0 && !Find(&Rejected, Missing, nullptr, nullptr) ? 0 : 1;
+
+        // Past MaxEntries, only what a run used is kept.
+        Cache Full;
+        UINT32 State = 7;
+        std::vector<Key> FullKeys;
+        for (UINT i = 0; i < MaxEntries + 100; ++i)
+        {
+            Key Random;
+            Random.Low = ((UINT64)NextRandom(&State) << 32) | NextRandom(&State);
+            Random.High = i;
+            FullKeys.push_back(Random);
+            Add(&Full, Random, &i, sizeof(i), 0);
+        }
+        std::vector<UINT8> FullArchive;
+        Serialize(Full, &FullArchive);
+        Cache Pruned;
+        NumErrors += Open(&Pruned, FullArchive.data(), FullArchive.size()) && HasChanged(Pruned) ? 0 : 1;
+        const void* Blob = nullptr;
+        UINT64 Size = 0;
+        for (UINT i = 0; i < 10; ++i)
+        {
+            UINT Index = i * 97;
+            NumErrors += Find(&Pruned, FullKeys[Index], &Blob, &Size) && Size == sizeof(UINT) &&
+                         *(const UINT*)Blob == Index ? 0 : 1;
+        }
+        Add(&Pruned, Missing, &Size, sizeof(Size), 0);
+        std::vector<UINT8> PrunedArchive;
+        Serialize(Pruned, &PrunedArchive);
+        Cache Reopened;
+        NumErrors += Open(&Reopened, PrunedArchive.data(), PrunedArchive.size()) && Reopened.NumEntries == 11 &&
+                     Find(&Reopened, FullKeys[97], &Blob, &Size) && *(const UINT*)Blob == 97 ? 0 : 1;
+
+        bool Passed = NumErrors == 0;
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "ShaderCache: test %s, %u shaders, %u compiled cold, %u warm, archive of %llu bytes, %u errors\n",
+                 Passed ? "passed" : "FAILED", NumRequests, Cold.NumMisses.load(), Warm.NumMisses.load(),
+                 (UINT64)Archive.size(), NumErrors);
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+
+    void RunBenchmark(UINT NumEntries)
+    {
+        // About the size of Shared.h and a shader, several times over.
+        TestFiles Files;
+        Files["Shared.h"] = std::string(16 * 1024, 'x');
+        Files["Shader.hlsl"] = "#include \"Shared.h\"\n" + std::string(48 * 1024, 'y');
+        auto Read = [&](const std::string& Filename, std::string* Contents)
+        {
+            *Contents = Files.at(Filename);
+            return true;
+        };
+        const UINT NumHashes = 200;
+        auto Start = std::chrono::high_resolution_clock::now();
+        Hasher Hashing;
+        for (UINT i = 0; i < NumHashes; ++i)
+        {
+            HashSource("Shader.hlsl", Read, &Hashing);
+        }
+        auto End = std::chrono::high_resolution_clock::now();
+        double HashSeconds = std::chrono::duration<double>(End - Start).count();
+        double HashedBytes = (double)NumHashes * (Files["Shared.h"].size() + Files["Shader.hlsl"].size());
+        volatile UINT64 Hashed = Finish(Hashing).Low; // Keeps the hashing from being optimized out.
+        (void)Hashed;
+
+        // Blobs of a few kilobytes, looked up at random, a quarter of the keys missing.
+        Cache Building;
+        UINT32 State = 3;
+        std::vector<Key> Keys;
+        std::vector<UINT8> Blob(4096, 0xCD);
+        for (UINT i = 0; i < NumEntries; ++i)
+        {
+            Key Random;
+            Random.Low = ((UINT64)NextRandom(&State) << 32) | NextRandom(&State);
+            Random.High = ((UINT64)NextRandom(&State) << 32) | NextRandom(&State);
+            Keys.push_back(Random);
+            Add(&Building, Random, Blob.data(), Blob.size(), 0);
+        }
+        std::vector<UINT8> Archive;
+        Serialize(Building, &Archive);
+        Cache Benchmarked;
+        Open(&Benchmarked, Archive.data(), Archive.size());
+
+        const UINT NumFinds = 1000000;
+        const void* Found = nullptr;
+        UINT64 Size = 0;
+        Start = std::chrono::high_resolution_clock::now();
+        for (UINT i = 0; i < NumFinds; ++i)
+        {
+            Key Searched = Keys[NextRandom(&State) % NumEntries];
+            Searched.Low += NextRandom(&State) % 4 == 0 ? 1 : 0;
+            Find(&Benchmarked, Searched, &Found, &Size);
+        }
+        End = std::chrono::high_resolution_clock::now();
+        double FindSeconds = std::chrono::duration<double>(End - Start).count();
+
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "ShaderCache: hashing sources at %.0f MB/s, %.0f ns per find in %u entries (%u hits of %u)\n",
+                 HashedBytes / HashSeconds * 1e-6, FindSeconds / NumFinds * 1e9, NumEntries,
+                 Benchmarked.NumHits.load(), NumFinds);
+        OutputDebugStringA(Message);
+    }
+}
@@ -0,0 +1,332 @@
+#include "Headers/ShaderCompilation.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace ShaderCompilation
+{
+    Future Submit(Service* InService, const std::function<bool()>& Compile)
+    {
+        Future Submitted = std::make_shared<Compilation>();
+        InService->Submitted.push_back(Submitted);
+
+        // The service keeps the compilation alive until the job is done with it.
+        Compilation* Compiling = Submitted.get();
+        JobSystem::Spawn([InService, Compiling, Compile]()
+        {
+            auto Start = std::chrono::high_resolution_clock::now();
+            bool Succeeded = Compile();
+            auto End = std::chrono::high_resolution_clock::now();
+            Compiling->Seconds = std::chrono::duration<double>(End - Start).count();
+            (Succeeded ? InService->NumSucceeded : InService->NumFailed).fetch_add(1, std::memory_order_relaxed);
+            Compiling->State.store(Succeeded ? Status::Succeeded : Status::Failed, std::memory_order_release);
+        }, &Compiling->Done);
+        return Submitted;
+    }
+
+    bool IsReady(const Future& InFuture)
+    {
+        return InFuture->State.load(std::memory_order_acquire) != Status::Pending;
+    }
+
+    bool AreReady(const std::vector<Future>& Futures)
+    {
+        for (const Future& Pending : Futures)
+        {
+            if (!IsReady(Pending))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool HasSucceeded(const Future& InFuture)
+    {
+        return InFuture->State.load(std::memory_order_acquire) == Status::Succeeded;
+    }
+
+    bool Wait(const Future& InFuture)
+    {
+        JobSystem::Wait(&InFuture->Done);
+        return HasSucceeded(InFuture);
+    }
+
+    void WaitForAll(Service* InService)
+    {
+        for (const Future& Submitted : InService->Submitted)
+        {
+            JobSystem::Wait(&Submitted->Done);
+        }
+    }
+
+    double GetCompileSeconds(const std::vector<Future>& Futures)
+    {
+        double Seconds = 0;
+        for (const Future& Compiled : Futures)
+        {
+            Seconds += IsReady(Compiled) ? Compiled->Seconds : 0;
+        }
+        return Seconds;
+    }
+
+    void Initialize(Selection* InSelection, UINT NumDemos, UINT Current)
+    {
+        InSelection->Current = Current;
+        InSelection->Requested = Current;
+        InSelection->Futures.assign(NumDemos, std::vector<Future>());
+        InSelection->IsStarted.assign(NumDemos, false);
+        InSelection->IsStarted[Current] = true; // Whatever renders first is ready.
+    }
+
+    void Request(Selection* InSelection, UINT Demo)
+    {
+        assert(Demo < InSelection->Futures.size());
+        InSelection->Requested = Demo;
+    }
+
+    bool Update(Selection* InSelection, const std::function<void(UINT Demo, std::vector<Future>* Futures)>& Start)
+    {
+        UINT Demo = InSelection->Requested;
+        if (Demo == InSelection->Current)
+        {
+            return false;
+        }
+
+        std::vector<Future>& Futures = InSelection->Futures[Demo];
+        if (!InSelection->IsStarted[Demo])
+        {
+            InSelection->IsStarted[Demo] = true;
+            Futures.clear();
+            Start(Demo, &Futures);
+        }
+
+        // With no worker besides this thread nothing compiles unless it helps, one compilation a frame.
+        auto Pending = std::find_if(Futures.begin(), Futures.end(), [](const Future& F) { return !IsReady(F); });
+        if (Pending != Futures.end() && JobSystem::GetNumWorkers() == 1)
+        {
+            Wait(*Pending);
+        }
+        if (!AreReady(Futures))
+        {
+            return false;
+        }
+
+        // A demo that didn't compile compiles again when it's requested next, after the shaders were fixed.
+        for (const Future& Compiled : Futures)
+        {
+            if (!HasSucceeded(Compiled))
+            {
+                InSelection->IsStarted[Demo] = false;
+                InSelection->Requested = InSelection->Current;
+
+                char Message[128];
+                snprintf(Message, sizeof(Message), "ShaderCompilation: demo %u failed to compile, staying on %u\n",
+                         Demo, InSelection->Current);
+                OutputDebugStringA(Message);
+                return false;
+            }
+        }
+        InSelection->Current = Demo;
+        return true;
+    }
+
+    static UINT32 NextRandom(UINT32* State)
+    {
+        *State = *State * 1664525u + 1013904223u;
+        return *State >> 8;
+    }
+
+    // Keeps a core busy like compiling a small shader would.
+    static void StubCompile(UINT Microseconds)
+    {
+        auto End = std::chrono::high_resolution_clock::now() + std::chrono::microseconds(Microseconds);
+        while (std::chrono::high_resolution_clock::now() < End)
+        {
+        }
+    }
+
+    bool RunTest(UINT NumDemos, UINT ShadersPerDemo)
+    {
+        // Demo 0 has nothing to compile, every fourth one has a shader that doesn't compile.
+        auto IsBroken = [](UINT Demo) { return Demo % 4 == 3; };
+        std::unique_ptr<std::atomic<UINT>[]> TimesCompiled(new std::atomic<UINT>[NumDemos * ShadersPerDemo]);
+        std::unique_ptr<std::atomic<UINT>[]> TimesCreated(new std::atomic<UINT>[NumDemos]);
+        for (UINT i = 0; i < NumDemos * ShadersPerDemo; ++i)
+        {
+            TimesCompiled[i].store(0);
+        }
+        for (UINT i = 0; i < NumDemos; ++i)
+        {
+            TimesCreated[i].store(0);
+        }
+        std::vector<UINT> TimesStarted(NumDemos, 0);
+        std::vector<UINT> TimesRejected(NumDemos, 0);
+        std::atomic<UINT> NumErrors{0};
+        std::atomic<bool> IsFrameLoopRunning{true};
+        std::atomic<UINT> NumOnRenderThread{0}; // Compilations the frame loop ran although there are workers.
+
+        Service TestService;
+        auto Start = [&](UINT Demo, std::vector<Future>* Futures)
+        {
+            TimesStarted[Demo]++;
+            if (Demo == 0)
+            {
+                return;
+            }
+            std::vector<Future> Shaders;
+            for (UINT Index = 0; Index < ShadersPerDemo; ++Index)
+            {
+                UINT Shader = Demo * ShadersPerDemo + Index;
+                bool Fails = IsBroken(Demo) && Index == ShadersPerDemo / 2;
+                Shaders.push_back(Submit(&TestService, [&, Shader, Fails]()
+                {
+                    TimesCompiled[Shader]++;
+                    if (IsFrameLoopRunning.load() && JobSystem::GetWorkerIndex() == 0 &&
+                        JobSystem::GetNumWorkers() > 1)
+                    {
+                        NumOnRenderThread++;
+                    }
+                    StubCompile(500 + Shader % 7 * 500);
+                    return !Fails;
+                }));
+            }
+
+            // The pipeline waits for its shaders and isn't created from a failed one.
+            Futures->push_back(Submit(&TestService, [&TimesCreated, &NumErrors, Shaders, Demo]()
+            {
+                bool Compiled = true;
+                for (const Future& Shader : Shaders)
+                {
+                    Compiled &= Wait(Shader);
+                    NumErrors += IsReady(Shader) ? 0 : 1;
+                }
+                if (Compiled)
+                {
+                    TimesCreated[Demo]++;
+                }
+                return Compiled;
+            }));
+            Futures->insert(Futures->end(), Shaders.begin(), Shaders.end());
+        };
+
+        // A frame loop picking another demo now and then, it's done when every demo was rendered or rejected.
+        Selection Demos;
+        Initialize(&Demos, NumDemos, 0);
+        std::vector<bool> IsVisited(NumDemos, false);
+        IsVisited[0] = true;
+        UINT32 State = 1;
+        UINT NumFrames = 0;
+        UINT NumFramesWaiting = 0; // Rendered by the demo before while the requested one compiled.
+        double LongestUpdate = 0;
+        for (; NumFrames < 1000000; ++NumFrames)
+        {
+            if (std::find(IsVisited.begin(), IsVisited.end(), false) == IsVisited.end() &&
+                Demos.Requested == Demos.Current)
+            {
+                break;
+            }
+            if (NextRandom(&State) % 64 == 0)
+            {
+                Request(&Demos, NextRandom(&State) % NumDemos);
+            }
+
+            UINT Requested = Demos.Requested;
+            auto UpdateStart = std::chrono::high_resolution_clock::now();
+            bool Switched = Update(&Demos, Start);
+            auto UpdateEnd = std::chrono::high_resolution_clock::now();
+            LongestUpdate = std::max(LongestUpdate, std::chrono::duration<double>(UpdateEnd - UpdateStart).count());
+
+            if (Switched)
+            {
+                IsVisited[Demos.Current] = true;
+            }
+            else if (Requested != Demos.Current && Demos.Requested == Demos.Current)
+            {
+                IsVisited[Requested] = true;
+                TimesRejected[Requested]++;
+            }
+            else if (Requested != Demos.Current)
+            {
+                NumFramesWaiting++;
+            }
+
+            // What renders has everything it needs.
+            for (const Future& Needed : Demos.Futures[Demos.Current])
+            {
+                NumErrors += HasSucceeded(Needed) ? 0 : 1;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        IsFrameLoopRunning.store(false);
+        WaitForAll(&TestService);
+
+        for (UINT Demo = 0; Demo < NumDemos; ++Demo)
+        {
+            bool Rejected = TimesRejected[Demo] > 0;
+            if (Rejected != IsBroken(Demo) || !IsVisited[Demo] ||
+                TimesCreated[Demo].load() != (IsBroken(Demo) || Demo == 0 ? 0 : 1) ||
+                TimesStarted[Demo] != (Demo == 0 ? 0 : std::max(TimesRejected[Demo], 1u)))
+            {
+                NumErrors++;
+            }
+            for (UINT Index = 0; Index < ShadersPerDemo && Demo > 0; ++Index)
+            {
+                NumErrors += TimesCompiled[Demo * ShadersPerDemo + Index].load() == TimesStarted[Demo] ? 0 : 1;
+            }
+        }
+
+        // Submitting is all the frame does unless it has to compile itself.
+        UINT NumErrorsFound = NumErrors.load() + NumOnRenderThread.load();
+        bool Passed = NumErrorsFound == 0;
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "ShaderCompilation: test %s, %u demos of %u shaders over %u frames, %u while compiling, "
+                 "longest update %.2f ms, %u errors\n",
+                 Passed ? "passed" : "FAILED", NumDemos, ShadersPerDemo, NumFrames, NumFramesWaiting,
+                 LongestUpdate * 1e3, NumErrorsFound);
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+
+    void RunBenchmark(UINT NumShaders)
+    {
+        const UINT Microseconds = 2000;
+        for (UINT Count = 1; Count <= NumShaders; Count *= 2)
+        {
+            // What the demo switch used to do.
+            auto Start = std::chrono::high_resolution_clock::now();
+            for (UINT i = 0; i < Count; ++i)
+            {
+                StubCompile(Microseconds);
+            }
+            auto End = std::chrono::high_resolution_clock::now();
+            double SerialSeconds = std::chrono::duration<double>(End - Start).count();
+
+            Service BenchmarkService;
+            std::vector<Future> Futures;
+            Start = std::chrono::high_resolution_clock::now();
+            for (UINT i = 0; i < Count; ++i)
+            {
+                Futures.push_back(Submit(&BenchmarkService, []()
+                {
+                    StubCompile(Microseconds);
+                    return true;
+                }));
+            }
+            auto Submitted = std::chrono::high_resolution_clock::now();
+            WaitForAll(&BenchmarkService);
+            End = std::chrono::high_resolution_clock::now();
+            double SubmitSeconds = std::chrono::duration<double>(Submitted - Start).count();
+            double ParallelSeconds = std::chrono::duration<double>(End - Start).count();
+
+            char Message[256];
+            snprintf(Message, sizeof(Message),
+                     "ShaderCompilation: %u shaders, %.1f ms on the render thread, %.1f ms on %u workers (%.1fx), "
+                     "%.1f us per submit\n",
+                     Count, SerialSeconds * 1e3, ParallelSeconds * 1e3, JobSystem::GetNumWorkers(),
+                     SerialSeconds / ParallelSeconds, SubmitSeconds / Count * 1e6);
+            OutputDebugStringA(Message);
+        }
+    }
+}
@@ -0,0 +1,637 @@
+#include "Headers/ShaderReload.h"
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <set>
+#include <thread>
+#ifdef __linux__
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ShaderReload
+{
+    std::string GetFileKey(const std::string& Filename)
+    {
+        std::string Key = Filename;
+        for (char& Char : Key)
+        {
+            Char = Char == '\\' ? '/' : (char)tolower((unsigned char)Char);
+        }
+        return Key;
+    }
+
+    void AddShader(Graph* InGraph, const std::string& Filename, UINT Owner)
+    {
+        std::pair<std::string, UINT> Added(GetFileKey(Filename), Owner);
+        if (std::find(InGraph->Shaders.begin(), InGraph->Shaders.end(), Added) == InGraph->Shaders.end())
+        {
+            InGraph->Shaders.push_back(Added);
+        }
+    }
+
+    void Scan(Graph* InGraph, const std::string& Filename, const ShaderCache::ReadFunction& Read)
+    {
+        std::vector<std::string> Pending = {Filename};
+        std::set<std::string> Scanned = {GetFileKey(Filename)};
+        std::string Contents;
+        for (size_t Next = 0; Next < Pending.size(); ++Next)
+        {
+            std::vector<std::string>& Includes = InGraph->Includes[GetFileKey(Pending[Next])];
+            Includes.clear();
+            Contents.clear();
+            if (!Read(Pending[Next], &Contents))
+            {
+                continue;
+            }
+            std::vector<std::string> Included;
+            ShaderCache::GetIncludes(Contents, &Included);
+            for (const std::string& Include : Included)
+            {
+                Includes.push_back(GetFileKey(Include));
+                if (Scanned.insert(Includes.back()).second)
+                {
+                    Pending.push_back(Include);
+                }
+            }
+        }
+    }
+
+    void GetAffected(const Graph& InGraph, const std::vector<std::string>& Changed, std::vector<UINT>* Owners)
+    {
+        Owners->clear();
+        std::set<std::string> IsChanged;
+        for (const std::string& Filename : Changed)
+        {
+            IsChanged.insert(GetFileKey(Filename));
+        }
+
+        // What each source file reaches, once per source file, however many shaders it's the source of.
+        std::map<std::string, bool> IsSourceAffected;
+        std::vector<std::string> Pending;
+        std::set<std::string> Visited;
+        for (const std::pair<std::string, UINT>& Shader : InGraph.Shaders)
+        {
+            auto Found = IsSourceAffected.find(Shader.first);
+            if (Found == IsSourceAffected.end())
+            {
+                bool IsAffected = false;
+                Pending.assign(1, Shader.first);
+                Visited = {Shader.first};
+                while (!Pending.empty() && !IsAffected)
+                {
+                    std::string File = Pending.back();
+                    Pending.pop_back();
+                    IsAffected = IsChanged.count(File) > 0;
+                    auto Includes = InGraph.Includes.find(File);
+                    for (size_t i = 0; Includes != InGraph.Includes.end() && i < Includes->second.size(); ++i)
+                    {
+                        if (Visited.insert(Includes->second[i]).second)
+                        {
+                            Pending.push_back(Includes->second[i]);
+                        }
+                    }
+                }
+                Found = IsSourceAffected.emplace(Shader.first, IsAffected).first;
+            }
+            if (Found->second)
+            {
+                Owners->push_back(Shader.second);
+            }
+        }
+        std::sort(Owners->begin(), Owners->end());
+        Owners->erase(std::unique(Owners->begin(), Owners->end()), Owners->end());
+    }
+
+    void AddChange(Changes* InChanges, const std::string& Filename, double Time)
+    {
+        std::string Key = GetFileKey(Filename);
+        if (std::find(InChanges->Pending.begin(), InChanges->Pending.end(), Key) == InChanges->Pending.end())
+        {
+            InChanges->Pending.push_back(Key);
+        }
+        InChanges->LastChange = std::max(InChanges->LastChange, Time);
+    }
+
+    bool TakeChanges(Changes* InChanges, double Time, std::vector<std::string>* Changed)
+    {
+        if (InChanges->Pending.empty() || Time - InChanges->LastChange < QuietSeconds)
+        {
+            return false;
+        }
+        Changed->swap(InChanges->Pending);
+        InChanges->Pending.clear();
+        return true;
+    }
+
+#ifdef __linux__
+    static const uint32_t WatchedEvents = IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR;
+
+    // Watches Relative and the directories below it. Their files go to Found, if any, a directory that was just
+    // created may have been written before its watch was added.
+    static void WatchDirectories(DirectoryWatch* Watch, const std::string& Relative, double Time, Changes* Found)
+    {
+        std::string Path = Watch->Directory + Relative;
+        int Subdirectory = inotify_add_watch(Watch->Descriptor, Path.c_str(), WatchedEvents);
+        DIR* Listing = Subdirectory >= 0 ? opendir(Path.c_str()) : nullptr;
+        if (!Listing)
+        {
+            return;
+        }
+        Watch->Subdirectories[Subdirectory] = Relative;
+        while (const dirent* Entry = readdir(Listing))
+        {
+            std::string Name = Entry->d_name;
+            struct stat Status;
+            if (Name == "." || Name == ".." || stat((Path + Name).c_str(), &Status) != 0)
+            {
+                continue;
+            }
+            if (S_ISDIR(Status.st_mode))
+            {
+                WatchDirectories(Watch, Relative + Name + "/", Time, Found);
+            }
+            else if (Found)
+            {
+                AddChange(Found, Relative + Name, Time);
+            }
+        }
+        closedir(Listing);
+    }
+
+    bool StartWatch(DirectoryWatch* Watch, const std::string& Directory)
+    {
+        Watch->Directory = Directory.empty() || Directory.back() == '/' ? Directory : Directory + "/";
+        Watch->Descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (Watch->Descriptor >= 0)
+        {
+            WatchDirectories(Watch, "", 0, nullptr);
+        }
+        if (Watch->Subdirectories.empty())
+        {
+            OutputDebugStringA("ShaderReload: can't watch the shaders, reloading is off\n");
+            StopWatch(Watch);
+            return false;
+        }
+        return true;
+    }
+
+    void StopWatch(DirectoryWatch* Watch)
+    {
+        if (Watch->Descriptor >= 0)
+        {
+            close(Watch->Descriptor);
+            Watch->Descriptor = -1;
+        }
+        Watch->Subdirectories.clear();
+    }
+
+    void PollWatch(DirectoryWatch* Watch, const Graph& InGraph, double Time, Changes* InChanges)
+    {
+        alignas(inotify_event) char Events[4096];
+        ssize_t Size;
+        while (Watch->Descriptor >= 0 && (Size = read(Watch->Descriptor, Events, sizeof(Events))) > 0)
+        {
+            for (const char* Next = Events; Next < Events + Size;)
+            {
+                const inotify_event* Event = (const inotify_event*)Next;
+                Next += sizeof(inotify_event) + Event->len;
+                if (Event->mask & IN_Q_OVERFLOW)
+                {
+                    for (const auto& Included : InGraph.Includes)
+                    {
+                        AddChange(InChanges, Included.first, Time);
+                    }
+                    continue;
+                }
+                if (Event->mask & IN_IGNORED)
+                {
+                    Watch->Subdirectories.erase(Event->wd);
+                    continue;
+                }
+                auto Found = Watch->Subdirectories.find(Event->wd);
+                if (Found == Watch->Subdirectories.end() || Event->len == 0)
+                {
+                    continue;
+                }
+                std::string Filename = Found->second + Event->name;
+                if (!(Event->mask & IN_ISDIR))
+                {
+                    AddChange(InChanges, Filename, Time);
+                }
+                else if (Event->mask & (IN_CREATE | IN_MOVED_TO))
+                {
+                    WatchDirectories(Watch, Filename + "/", Time, InChanges);
+                }
+            }
+        }
+    }
+#endif
+
+    void Initialize(Reloads* InReloads, UINT NumOwners)
+    {
+        InReloads->IsRequested.assign(NumOwners, false);
+        InReloads->Futures.assign(NumOwners, std::vector<ShaderCompilation::Future>());
+    }
+
+    void Request(Reloads* InReloads, const std::vector<UINT>& Owners)
+    {
+        for (UINT Owner : Owners)
+        {
+            assert(Owner < InReloads->IsRequested.size());
+            InReloads->IsRequested[Owner] = true;
+        }
+    }
+
+    void Update(Reloads* InReloads, const StartFunction& Start, const std::function<void(UINT Owner)>& Swap)
+    {
+        using namespace ShaderCompilation;
+        for (UINT Owner = 0; Owner < InReloads->Futures.size(); ++Owner)
+        {
+            std::vector<Future>& Futures = InReloads->Futures[Owner];
+            if (Futures.empty() && InReloads->IsRequested[Owner])
+            {
+                InReloads->IsRequested[Owner] = false;
+                Start(Owner, &Futures);
+            }
+            if (Futures.empty())
+            {
+                continue;
+            }
+
+            // With no worker besides this thread nothing compiles unless it helps, one compilation a frame.
+            auto Pending = std::find_if(Futures.begin(), Futures.end(), [](const Future& F) { return !IsReady(F); });
+            if (Pending != Futures.end() && JobSystem::GetNumWorkers() == 1)
+            {
+                Wait(*Pending);
+            }
+            if (!AreReady(Futures))
+            {
+                continue;
+            }
+
+            if (std::all_of(Futures.begin(), Futures.end(), HasSucceeded))
+            {
+                Swap(Owner);
+                InReloads->NumSwapped++;
+            }
+            else
+            {
+                InReloads->NumFailed++;
+                char Message[128];
+                snprintf(Message, sizeof(Message), "ShaderReload: %u failed to compile, keeping its pipelines\n", Owner);
+                OutputDebugStringA(Message);
+            }
+            Futures.clear();
+        }
+    }
+
+    static UINT32 NextRandom(UINT32* State)
+    {
+        *State = *State * 1664525u + 1013904223u;
+        return *State >> 8;
+    }
+
+    // Owners edited every few frames while their stub rebuilds run on the job system, each edit a new version and
+    // some of them broken. The versions swapped in only move forward, and once the edits stop every owner renders its
+    // last one. Returns the errors.
+    static UINT TestReloads(UINT NumOwners, UINT NumFrames)
+    {
+        std::vector<UINT> Edits(NumOwners, 0);            // Its latest version.
+        std::vector<bool> IsBroken(NumOwners, false);     // Whether the latest one compiles.
+        std::vector<UINT> Staged(NumOwners, 0);           // What its rebuild builds, written by the job.
+        std::vector<UINT> Live(NumOwners, 0);             // What renders.
+        std::vector<std::vector<ShaderCompilation::Future>> Building(NumOwners);
+        std::atomic<UINT> NumErrors{0};
+
+        ShaderCompilation::Service TestService;
+        auto Start = [&](UINT Owner, std::vector<ShaderCompilation::Future>* Futures)
+        {
+            NumErrors += ShaderCompilation::AreReady(Building[Owner]) ? 0 : 1; // One rebuild at a time.
+            UINT Version = Edits[Owner];
+            bool Fails = IsBroken[Owner];
+            std::vector<ShaderCompilation::Future> Shaders;
+            for (UINT i = 0; i < 2; ++i)
+            {
+                Shaders.push_back(ShaderCompilation::Submit(&TestService, [Fails, i]()
+                {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100 + i * 300));
+                    return !(Fails && i == 1);
+                }));
+            }
+            UINT* Staging = &Staged[Owner];
+            Futures->push_back(ShaderCompilation::Submit(&TestService, [Shaders, Staging, Version]()
+            {
+                bool Compiled = true;
+                for (const ShaderCompilation::Future& Shader : Shaders)
+                {
+                    Compiled &= ShaderCompilation::Wait(Shader);
+                }
+                if (Compiled)
+                {
+                    *Staging = Version;
+                }
+                return Compiled;
+            }));
+            Futures->insert(Futures->end(), Shaders.begin(), Shaders.end());
+            Building[Owner] = *Futures;
+        };
+        auto Swap = [&](UINT Owner)
+        {
+            NumErrors += ShaderCompilation::AreReady(Building[Owner]) ? 0 : 1;
+            NumErrors += Staged[Owner] > Live[Owner] ? 0 : 1;
+            Live[Owner] = Staged[Owner];
+        };
+
+        Reloads Rebuilds;
+        Initialize(&Rebuilds, NumOwners);
+        UINT32 State = 5;
+        UINT Frame = 0;
+        for (; Frame < NumFrames * 100; ++Frame)
+        {
+            bool IsEditing = Frame < NumFrames;
+            if (IsEditing && NextRandom(&State) % 8 == 0)
+            {
+                UINT Owner = NextRandom(&State) % NumOwners;
+                Edits[Owner]++;
+                IsBroken[Owner] = NextRandom(&State) % 4 == 0;
+                Request(&Rebuilds, {Owner});
+            }
+            if (Frame == NumFrames)
+            {
+                // The broken ones get fixed.
+                for (UINT Owner = 0; Owner < NumOwners; ++Owner)
+                {
+                    if (IsBroken[Owner])
+                    {
+                        Edits[Owner]++;
+                        IsBroken[Owner] = false;
+                        Request(&Rebuilds, {Owner});
+                    }
+                }
+            }
+            Update(&Rebuilds, Start, Swap);
+
+            bool IsQuiet = !IsEditing;
+            for (UINT Owner = 0; Owner < NumOwners; ++Owner)
+            {
+                IsQuiet &= Rebuilds.Futures[Owner].empty() && !Rebuilds.IsRequested[Owner];
+            }
+            if (IsQuiet)
+            {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        ShaderCompilation::WaitForAll(&TestService);
+        for (UINT Owner = 0; Owner < NumOwners; ++Owner)
+        {
+            NumErrors += Live[Owner] == Edits[Owner] ? 0 : 1;
+        }
+        NumErrors += Rebuilds.NumFailed > 0 && Rebuilds.NumSwapped > 0 && Frame < NumFrames * 100 ? 0 : 1;
+        return NumErrors.load();
+    }
+
+#ifdef __linux__
+    // Files written, renamed and removed in a temporary directory, and in a subdirectory made after the watch started,
+    // come out of PollWatch relative to the directory, except the removed ones. Returns the errors.
+    static UINT TestWatch()
+    {
+        char Directory[] = "/tmp/ShaderReloadXXXXXX";
+        if (!mkdtemp(Directory))
+        {
+            return 1;
+        }
+        std::string Root = std::string(Directory) + "/";
+        auto Write = [&](const std::string& Filename)
+        {
+            FILE* File;
+            if (fopen_s(&File, (Root + Filename).c_str(), "wb") == 0)
+            {
+                fputs("#include \"Shared.h\"\n", File);
+                fclose(File);
+            }
+        };
+
+        UINT NumErrors = 0;
+        Graph Files;
+        Changes Watched;
+        DirectoryWatch Watch;
+        auto Expect = [&](std::vector<std::string> Expected)
+        {
+            std::vector<std::string> Taken;
+            PollWatch(&Watch, Files, 1.0, &Watched);
+            TakeChanges(&Watched, 1.0 + QuietSeconds, &Taken);
+            std::sort(Taken.begin(), Taken.end());
+            NumErrors += Taken == Expected ? 0 : 1;
+        };
+
+        Write("Shared.h");
+        NumErrors += StartWatch(&Watch, Directory) ? 0 : 1;
+        Expect({});
+        Write("Shared.h");
+        Expect({"shared.h"});
+
+        // Its file is written before the poll that adds the watch.
+        mkdir((Root + "Include").c_str(), 0755);
+        Write("Include/Lighting.hlsli");
+        Expect({"include/lighting.hlsli"});
+        Write("Include/Lighting.hlsli");
+        Write("SimpleMS.hlsl");
+        Expect({"include/lighting.hlsli", "simplems.hlsl"});
+
+        // Saved through a temporary file, then removed.
+        Write("SimpleDXR.tmp");
+        rename((Root + "SimpleDXR.tmp").c_str(), (Root + "SimpleDXR.hlsl").c_str());
+        Expect({"simpledxr.hlsl", "simpledxr.tmp"});
+        for (const char* Filename : {"Shared.h", "SimpleMS.hlsl", "SimpleDXR.hlsl", "Include/Lighting.hlsli"})
+        {
+            unlink((Root + Filename).c_str());
+        }
+        Expect({});
+
+        StopWatch(&Watch);
+        rmdir((Root + "Include").c_str());
+        rmdir(Directory);
+        return NumErrors;
+    }
+#endif
+
+    typedef std::map<std::string, std::string> TestFiles;
+
+    // Whether Filename reaches one of Changed through the includes in the files themselves, recursively.
+    static bool Reaches(const TestFiles& Files, const std::string& Filename, const std::set<std::string>& Changed,
+                        std::set<std::string>* Visited)
+    {
+        if (!Visited->insert(GetFileKey(Filename)).second)
+        {
+            return false;
+        }
+        if (Changed.count(GetFileKey(Filename)))
+        {
+            return true;
+        }
+        auto Found = Files.find(Filename);
+        std::vector<std::string> Includes;
+        if (Found != Files.end())
+        {
+            ShaderCache::GetIncludes(Found->second, &Includes);
+        }
+        for (const std::string& Include : Includes)
+        {
+            if (Reaches(Files, Include, Changed, Visited))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool RunTest(UINT NumFiles, UINT NumRounds)
+    {
+        UINT NumErrors = 0;
+        TestFiles Files;
+        auto Read = [&](const std::string& Filename, std::string* Contents)
+        {
+            auto Found = Files.find(Filename);
+            if (Found != Files.end())
+            {
+                *Contents = Found->second;
+            }
+            return Found != Files.end();
+        };
+        auto Expect = [&](const Graph& Checked, const std::vector<std::string>& Changed, std::vector<UINT> Expected)
+        {
+            std::vector<UINT> Owners;
+            GetAffected(Checked, Changed, &Owners);
+            NumErrors += Owners == Expected ? 0 : 1;
+        };
+
+        // The shaders as they are, owned by their demos.
+        enum TestDemo : UINT { DXR, HelloTriangle, Bindless, Experiments };
+        Files["Shared.h"] = "\xEF\xBB\xBF#pragma once\nstruct SceneConstants { float4x4 ViewProj; };\n";
+        Files["MSExperiment.hlsl"] = "\xEF\xBB\xBF#include \"Shared.h\"\n[outputtopology(\"triangle\")] void MS();\n";
+        Files["SimpleDXR.hlsl"] = "\xEF\xBB\xBF// #include \"Shared.h\"\n[shader(\"raygeneration\")] void Main() {}\n";
+        Files["SimpleMS.hlsl"] = "void MSMain() {}\nvoid PSMain() {}\n";
+        Files["SimpleBindless.hlsl"] = "[numthreads(8, 8, 1)] void Main() {}\n";
+        Graph Shaders;
+        const char* Sources[] = {"SimpleDXR.hlsl", "SimpleMS.hlsl", "SimpleBindless.hlsl", "MSExperiment.hlsl"};
+        for (UINT Demo = DXR; Demo <= Experiments; ++Demo)
+        {
+            AddShader(&Shaders, Sources[Demo], Demo);
+            AddShader(&Shaders, Sources[Demo], Demo); // Its pixel shader.
+            Scan(&Shaders, Sources[Demo], Read);
+        }
+        NumErrors += Shaders.Shaders.size() == 4 ? 0 : 1;
+        Expect(Shaders, {"Shared.h"}, {Experiments});
+        Expect(Shaders, {"shaders\\..\\Shared.h"}, {});
+        Expect(Shaders, {"SHARED.H"}, {Experiments});
+        Expect(Shaders, {"SimpleMS.hlsl", "Notes.txt"}, {HelloTriangle});
+        Expect(Shaders, {"SimpleDXR.hlsl", "SimpleBindless.hlsl", "Shared.h"}, {DXR, Bindless, Experiments});
+        Expect(Shaders, {}, {});
+
+        // Adding an include is seen once the file that got it is scanned again, and so is removing one.
+        Files["Lighting.hlsli"] = "#include \"Shared.h\"\n";
+        Files["SimpleDXR.hlsl"] += "   #   include <Lighting.hlsli>\n";
+        Scan(&Shaders, "SimpleDXR.hlsl", Read);
+        Expect(Shaders, {"Shared.h"}, {DXR, Experiments});
+        Files["MSExperiment.hlsl"] = "void MSMain() {}\n";
+        Scan(&Shaders, "MSExperiment.hlsl", Read);
+        Expect(Shaders, {"Shared.h"}, {DXR});
+
+        // Includes that don't exist yet, then do.
+        Files["SimpleBindless.hlsl"] += "#include \"Missing.hlsli\"\n";
+        Scan(&Shaders, "SimpleBindless.hlsl", Read);
+        Expect(Shaders, {"Missing.hlsli"}, {Bindless});
+        Files["Missing.hlsli"] = "#include \"Shared.h\"\n";
+        Scan(&Shaders, "Missing.hlsli", Read);
+        Expect(Shaders, {"Shared.h"}, {DXR, Bindless});
+
+        // Random graphs with cycles against following the includes in the files.
+        UINT32 State = 17;
+        for (UINT Round = 0; Round < NumRounds; ++Round)
+        {
+            if (Round % 16 == 0)
+            {
+                Files.clear();
+                Shaders = Graph();
+                for (UINT i = 0; i < NumFiles; ++i)
+                {
+                    Files["File" + std::to_string(i) + ".hlsli"] = "";
+                }
+            }
+
+            // Rewrite a few files' includes, the graph learns about them the way a change notification would.
+            for (UINT Edit = 0; Edit < 1 + NextRandom(&State) % 4; ++Edit)
+            {
+                std::string Filename = "File" + std::to_string(NextRandom(&State) % NumFiles) + ".hlsli";
+                std::string& Contents = Files[Filename];
+                Contents.clear();
+                for (UINT i = NextRandom(&State) % 4; i > 0; --i)
+                {
+                    Contents += "#include \"File" + std::to_string(NextRandom(&State) % NumFiles) + ".hlsli\"\n";
+                }
+                Scan(&Shaders, Filename, Read);
+            }
+            if (Round % 16 == 0)
+            {
+                for (UINT i = 0; i < NumFiles; i += 3)
+                {
+                    std::string Filename = "File" + std::to_string(i) + ".hlsli";
+                    AddShader(&Shaders, Filename, i % 7);
+                    Scan(&Shaders, Filename, Read);
+                }
+            }
+
+            std::vector<std::string> Changed;
+            std::set<std::string> ChangedKeys;
+            for (UINT i = NextRandom(&State) % 3; i > 0; --i)
+            {
+                Changed.push_back("FILE" + std::to_string(NextRandom(&State) % NumFiles) + ".HLSLI");
+                ChangedKeys.insert(GetFileKey(Changed.back()));
+            }
+            std::vector<UINT> Expected;
+            for (const std::pair<std::string, UINT>& Shader : Shaders.Shaders)
+            {
+                std::set<std::string> Visited;
+                std::string Filename = "File" + Shader.first.substr(4);
+                if (Reaches(Files, Filename, ChangedKeys, &Visited) &&
+                    std::find(Expected.begin(), Expected.end(), Shader.second) == Expected.end())
+                {
+                    Expected.push_back(Shader.second);
+                }
+            }
+            std::sort(Expected.begin(), Expected.end());
+            Expect(Shaders, Changed, Expected);
+        }
+
+        // A save in three writes and a rename, taken once, once the file was quiet.
+        Changes Batched;
+        std::vector<std::string> Taken;
+        AddChange(&Batched, "Shared.h", 1.0);
+        AddChange(&Batched, "Shared.h", 1.02);
+        AddChange(&Batched, "Shared.h~RF2c4e.TMP", 1.03);
+        AddChange(&Batched, "shared.h", 1.05);
+        NumErrors += TakeChanges(&Batched, 1.1, &Taken) ? 1 : 0;
+        NumErrors += TakeChanges(&Batched, 1.05 + QuietSeconds, &Taken) && Taken.size() == 2 &&
+                     Taken[0] == "shared.h" ? 0 : 1;
+        NumErrors += TakeChanges(&Batched, 5.0, &Taken) ? 1 : 0;
+        AddChange(&Batched, "SimpleMS.hlsl", 6.0);
+        NumErrors += TakeChanges(&Batched, 7.0, &Taken) && Taken.size() == 1 ? 0 : 1;
+
+        NumErrors += TestReloads(4, 200);
+#ifdef __linux__
+        NumErrors += TestWatch();
+#endif
+
+        bool Passed = NumErrors == 0;
+        char Message[256];
+        snprintf(Message, sizeof(Message), "ShaderReload: test %s, %u rounds over %u files, %u errors\n",
+                 Passed ? "passed" : "FAILED", NumRounds, NumFiles, NumErrors);
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+}
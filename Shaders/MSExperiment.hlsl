@@ -1,6 +1,6 @@
 #include "Shared.h"
 
-// ConstantBuffer<Constants> Globals : register(b0);
+ConstantBuffer<Constants> Globals : register(b0);
 
 struct TriangleVertex
 {
@@ -34,8 +34,6 @@ void MSMain(
     out indices uint3 OutTriangleIndices[2]
     )
 {
-    ConstantBuffer<Constants> Globals = ResourceDescriptorHeap[0];
-    
     uint NumOutputVertices = 4;
     uint NumOutputTriangles = 2; 
     SetMeshOutputCounts(NumOutputVertices, NumOutputTriangles);
@@ -1,7 +1,12 @@
 
+cbuffer Indices : register(b0)
+{
+    uint OutputIndex; // Into the bindless heap.
+};
+
 [numthreads(32, 32, 1)]
 void Main(uint3 DTid : SV_DispatchThreadID)
 {
-    RWTexture2D<float4> MyTexture = ResourceDescriptorHeap[0];
+    RWTexture2D<float4> MyTexture = ResourceDescriptorHeap[OutputIndex];
     MyTexture[DTid.xy] = 1.f;
 }
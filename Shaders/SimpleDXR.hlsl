@@ -50,7 +50,7 @@ void RayGenerationMain()
     Ray.TMax = 10000.f;
 
     RayPayload Payload;
-    uint InstanceInclusionMask = 0xFF;
+    uint InstanceInclusionMask = 0x01; // FrustumCulling::PrimaryRayMask: skips instances kept only for shadows.
     uint RayContributionToHitGroupIndex = 0;
     uint MultiplierForGeometryContributionToHitGroupIndex = 0;
     uint MissShaderIndex = 0;
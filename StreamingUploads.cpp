@@ -0,0 +1,289 @@
+#include "Headers/StreamingUploads.h"
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+
+namespace StreamingUploads
+{
+    void Initialize(Uploader* InUploader, UINT64 Capacity, UINT64 BudgetPerFrame)
+    {
+        assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0 && BudgetPerFrame > 0);
+        *InUploader = Uploader();
+        InUploader->Capacity = Capacity;
+        InUploader->BudgetPerFrame = BudgetPerFrame;
+    }
+
+    Ticket Enqueue(Uploader* InUploader, UINT64 Size, UINT64 Alignment)
+    {
+        assert(Size > 0 && Size <= InUploader->Capacity);
+        assert(Alignment > 0 && (Alignment & (Alignment - 1)) == 0 && Alignment <= InUploader->Capacity);
+        Request NewRequest;
+        NewRequest.Size = Size;
+        NewRequest.Alignment = Alignment;
+        InUploader->Queued.push_back(NewRequest);
+        return InUploader->NextTicket++;
+    }
+
+    UINT StageBatch(Uploader* InUploader, std::vector<Staged>* OutStaged)
+    {
+        const UINT64 Capacity = InUploader->Capacity;
+        if (InUploader->Head == InUploader->Tail)
+        {
+            // Nothing in flight: start over at the beginning, past half the ring an upload larger than the rest
+            // wouldn't fit on either side of the end.
+            InUploader->Head = InUploader->Tail = AlignTo(InUploader->Head, Capacity);
+        }
+
+        UINT64 NumBytes = 0;
+        UINT NumStaged = 0;
+        while (!InUploader->Queued.empty())
+        {
+            const Request& Next = InUploader->Queued.front();
+            if (NumStaged > 0 && NumBytes + Next.Size > InUploader->BudgetPerFrame)
+            {
+                InUploader->NumThrottled++;
+                break;
+            }
+
+            // Never straddles the end of the ring, the capacity is a multiple of any alignment.
+            UINT64 Start = (InUploader->Head + Next.Alignment - 1) & ~(Next.Alignment - 1);
+            UINT64 Offset = Start & (Capacity - 1);
+            if (Offset + Next.Size > Capacity)
+            {
+                Start += Capacity - Offset;
+                Offset = 0;
+            }
+            if (Start + Next.Size - InUploader->Tail > Capacity)
+            {
+                InUploader->NumRingFull++;
+                break;
+            }
+
+            Staged Current;
+            Current.Id = ++InUploader->LastStaged;
+            Current.Offset = Offset;
+            Current.Size = Next.Size;
+            OutStaged->push_back(Current);
+            InUploader->Head = Start + Next.Size;
+            NumBytes += Next.Size;
+            NumStaged++;
+            InUploader->Queued.pop_front();
+        }
+        InUploader->NumBytesStaged += NumBytes;
+        return NumStaged;
+    }
+
+    void SubmitBatch(Uploader* InUploader, UINT64 FenceValue)
+    {
+        assert(InUploader->LastStaged > InUploader->LastSubmitted);
+        assert(InUploader->Batches.empty() || InUploader->Batches.back().FenceValue < FenceValue);
+        Batch Submitted;
+        Submitted.LastTicket = InUploader->LastStaged;
+        Submitted.End = InUploader->Head;
+        Submitted.FenceValue = FenceValue;
+        InUploader->Batches.push_back(Submitted);
+        InUploader->LastSubmitted = InUploader->LastStaged;
+        InUploader->NumBatches++;
+    }
+
+    void Retire(Uploader* InUploader, UINT64 CompletedFenceValue)
+    {
+        while (!InUploader->Batches.empty() && InUploader->Batches.front().FenceValue <= CompletedFenceValue)
+        {
+            InUploader->Tail = InUploader->Batches.front().End;
+            InUploader->LastReady = InUploader->Batches.front().LastTicket;
+            InUploader->Batches.pop_front();
+        }
+    }
+
+    bool IsReady(const Uploader& InUploader, Ticket Id)
+    {
+        return Id <= InUploader.LastReady;
+    }
+
+    UINT64 GetFenceValue(const Uploader& InUploader, Ticket Id)
+    {
+        if (Id <= InUploader.LastReady)
+        {
+            return 0;
+        }
+        if (Id > InUploader.LastSubmitted)
+        {
+            return NotSubmitted;
+        }
+        for (const Batch& Current : InUploader.Batches)
+        {
+            if (Current.LastTicket >= Id)
+            {
+                return Current.FenceValue;
+            }
+        }
+        assert(false);
+        return NotSubmitted;
+    }
+
+    static UINT32 NextRandom(UINT32* State)
+    {
+        *State = *State * 1664525u + 1013904223u;
+        return *State >> 8;
+    }
+
+    // Mostly vertex and index data, sometimes a texture mip.
+    static UINT64 RandomUploadSize(UINT32* State)
+    {
+        return NextRandom(State) % 16 == 0 ? 64 * 1024 + NextRandom(State) % (1024 * 1024)
+                                            : 16 + NextRandom(State) % (16 * 1024);
+    }
+
+    bool RunTest(UINT NumUploads)
+    {
+        const UINT64 Capacity = 2 * 1024 * 1024; // Small enough to fill up behind the largest uploads.
+        const UINT64 BudgetPerFrame = 512 * 1024;
+        Uploader TestUploader;
+        Initialize(&TestUploader, Capacity, BudgetPerFrame);
+
+        struct InFlight
+        {
+            UINT64 Offset;
+            UINT64 Size;
+            UINT64 FenceValue;
+        };
+        std::vector<InFlight> Ranges;
+        std::vector<Request> Requests(1); // Per ticket.
+        std::vector<UINT64> FenceValues(1); // Per ticket, once submitted.
+        std::vector<Staged> Staging;
+        UINT NumErrors = 0;
+        UINT NumQueued = 0;
+        UINT64 FenceValue = 0;
+        UINT64 CompletedFenceValue = 0;
+        UINT32 State = 77;
+
+        for (UINT FrameIndex = 0; TestUploader.LastReady < NumUploads; ++FrameIndex)
+        {
+            // Bursts of requests, as when a level section streams in.
+            UINT NumNew = NextRandom(&State) % 8 == 0 ? NextRandom(&State) % 64 : NextRandom(&State) % 4;
+            for (UINT i = 0; i < NumNew && NumQueued < NumUploads; ++i, ++NumQueued)
+            {
+                Request NewRequest;
+                NewRequest.Size = RandomUploadSize(&State);
+                NewRequest.Alignment = 1ull << (NextRandom(&State) % 10);
+                if (Enqueue(&TestUploader, NewRequest.Size, NewRequest.Alignment) != Requests.size())
+                {
+                    NumErrors++;
+                }
+                Requests.push_back(NewRequest);
+                FenceValues.push_back(NotSubmitted);
+            }
+
+            Staging.clear();
+            UINT NumStaged = StageBatch(&TestUploader, &Staging);
+            UINT64 NumBytes = 0;
+            for (UINT i = 0; i < NumStaged; ++i)
+            {
+                const Staged& Current = Staging[i];
+                const Request& Requested = Requests[(size_t)Current.Id];
+                if (Current.Size != Requested.Size || Current.Offset % Requested.Alignment != 0 ||
+                    Current.Offset + Current.Size > Capacity || (i > 0 && Current.Id != Staging[i - 1].Id + 1))
+                {
+                    NumErrors++;
+                }
+                for (const InFlight& Other : Ranges)
+                {
+                    if (Current.Offset < Other.Offset + Other.Size && Other.Offset < Current.Offset + Current.Size)
+                    {
+                        NumErrors++;
+                    }
+                }
+                NumBytes += Current.Size;
+            }
+            if (NumStaged > 1 && NumBytes > BudgetPerFrame)
+            {
+                NumErrors++;
+            }
+            if (NumStaged > 0)
+            {
+                SubmitBatch(&TestUploader, ++FenceValue);
+                for (UINT i = 0; i < NumStaged; ++i)
+                {
+                    Ranges.push_back({Staging[i].Offset, Staging[i].Size, FenceValue});
+                    FenceValues[(size_t)Staging[i].Id] = FenceValue;
+                }
+            }
+
+            // The copy queue is one to three batches behind, and catches up while nothing new comes in.
+            UINT64 Lag = 1 + NextRandom(&State) % 3;
+            CompletedFenceValue = std::max(CompletedFenceValue, FenceValue > Lag ? FenceValue - Lag : 0);
+            if (NumStaged == 0)
+            {
+                CompletedFenceValue = std::min(CompletedFenceValue + 1, FenceValue);
+            }
+            Retire(&TestUploader, CompletedFenceValue);
+            Ranges.erase(std::remove_if(Ranges.begin(), Ranges.end(), [&](const InFlight& Range)
+            {
+                return Range.FenceValue <= CompletedFenceValue;
+            }), Ranges.end());
+
+            for (Ticket Id = 1; Id < Requests.size(); Id += 1 + NextRandom(&State) % 16)
+            {
+                bool Ready = FenceValues[(size_t)Id] <= CompletedFenceValue;
+                UINT64 Expected = Ready ? 0 : FenceValues[(size_t)Id];
+                if (IsReady(TestUploader, Id) != Ready || GetFenceValue(TestUploader, Id) != Expected)
+                {
+                    NumErrors++;
+                }
+            }
+        }
+
+        bool Passed = NumErrors == 0;
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "StreamingUploads: test %s, %u uploads in %u batches, %u throttled, %u stopped at a full ring, "
+                 "%u errors\n",
+                 Passed ? "passed" : "FAILED", NumUploads, TestUploader.NumBatches, TestUploader.NumThrottled,
+                 TestUploader.NumRingFull, NumErrors);
+        OutputDebugStringA(Message);
+        return Passed;
+    }
+
+    void RunBenchmark(UINT NumUploads, UINT64 Capacity, UINT64 BudgetPerFrame)
+    {
+        Uploader BenchmarkUploader;
+        Initialize(&BenchmarkUploader, Capacity, BudgetPerFrame);
+        std::vector<UINT8> Ring((size_t)Capacity);
+        std::vector<UINT8> Source(1024 * 1024 + 64 * 1024, 0x5A);
+
+        // Everything queued up front, then staged a frame at a time with the copy queue two frames behind.
+        UINT32 State = 12345;
+        for (UINT i = 0; i < NumUploads; ++i)
+        {
+            Enqueue(&BenchmarkUploader, std::min(RandomUploadSize(&State), Capacity), 256);
+        }
+        std::vector<Staged> Staging;
+        UINT NumFrames = 0;
+        auto Start = std::chrono::high_resolution_clock::now();
+        for (UINT64 FenceValue = 1; !BenchmarkUploader.Queued.empty(); ++FenceValue, ++NumFrames)
+        {
+            Retire(&BenchmarkUploader, FenceValue > 2 ? FenceValue - 2 : 0);
+            Staging.clear();
+            if (StageBatch(&BenchmarkUploader, &Staging) > 0)
+            {
+                for (const Staged& Current : Staging)
+                {
+                    memcpy(&Ring[(size_t)Current.Offset], Source.data(), (size_t)Current.Size);
+                }
+                SubmitBatch(&BenchmarkUploader, FenceValue);
+            }
+        }
+        auto End = std::chrono::high_resolution_clock::now();
+        double Seconds = std::chrono::duration<double>(End - Start).count();
+
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "StreamingUploads: %u uploads, %.1f MB in %u frames at %.1f MB per frame, %.0f MB/s staged, "
+                 "%u throttled, %u stopped at a full ring\n",
+                 NumUploads, BenchmarkUploader.NumBytesStaged / (1024.0 * 1024.0), NumFrames,
+                 BudgetPerFrame / (1024.0 * 1024.0), BenchmarkUploader.NumBytesStaged / (1024.0 * 1024.0) / Seconds,
+                 BenchmarkUploader.NumThrottled, BenchmarkUploader.NumRingFull);
+        OutputDebugStringA(Message);
+    }
+}
@@ -0,0 +1,65 @@
+#include "Headers/Threading.h"
+#include "Headers/JobSystem.h"
+#include <atomic>
+#include <thread>
+
+namespace Threading
+{
+    UINT GetNumHardwareThreads()
+    {
+        UINT NumThreads = std::thread::hardware_concurrency();
+        return NumThreads > 0 ? NumThreads : 1;
+    }
+
+    void ParallelFor(UINT Count, UINT NumThreads, UINT GrainSize,
+                     const std::function<void(UINT Begin, UINT End)>& Body)
+    {
+        ParallelForPerThread(Count, NumThreads, GrainSize, [&](UINT, UINT Begin, UINT End)
+        {
+            Body(Begin, End);
+        });
+    }
+
+    void ParallelForPerThread(UINT Count, UINT NumThreads, UINT GrainSize,
+                              const std::function<void(UINT Thread, UINT Begin, UINT End)>& Body)
+    {
+        if (Count == 0)
+        {
+            return;
+        }
+
+        GrainSize = GrainSize > 0 ? GrainSize : 1;
+        UINT NumChunks = (Count + GrainSize - 1) / GrainSize;
+        NumThreads = NumThreads < NumChunks ? NumThreads : NumChunks;
+
+        if (NumThreads <= 1)
+        {
+            Body(0, 0, Count);
+            return;
+        }
+
+        // Threads pull chunks from a shared counter so uneven chunks balance out. They're jobs, run by whichever
+        // workers are free, the calling thread the first and helping with the rest until they're done.
+        std::atomic<UINT> NextChunk(0);
+        auto Worker = [&](UINT Thread)
+        {
+            for (UINT Chunk = NextChunk.fetch_add(1); Chunk < NumChunks; Chunk = NextChunk.fetch_add(1))
+            {
+                UINT Begin = Chunk * GrainSize;
+                UINT End = Begin + GrainSize < Count ? Begin + GrainSize : Count;
+                Body(Thread, Begin, End);
+            }
+        };
+
+        JobSystem::Counter Done;
+        for (UINT i = 1; i < NumThreads; ++i)
+        {
+            JobSystem::Spawn([&, i]()
+            {
+                Worker(i);
+            }, &Done);
+        }
+        Worker(0);
+        JobSystem::Wait(&Done);
+    }
+}
@@ -0,0 +1,154 @@
+#include "../../Headers/ImageCompare.h"
+#include "../../Headers/JobSystem.h"
+#include "../../Headers/Threading.h"
+#include <chrono>
+#include <math.h>
+#include <stdlib.h>
+#include <string>
+
+// Compares a test render against a reference and fails when any metric crosses its threshold.
+// Exit codes: 0 pass, 1 threshold exceeded, 2 bad arguments or unreadable images.
+
+// Default thresholds: a render that differs by a few noisy pixels passes, a visibly different one doesn't.
+static const double DefaultPSNRMin = 40.0;
+static const double DefaultSSIMMin = 0.98;
+static const double DefaultFLIPMax = 0.05;
+
+static void PrintUsage()
+{
+    printf("Usage: ImageDiff <Reference> <Test> [--psnr-min dB] [--ssim-min Value] [--flip-max Value]\n"
+           "                 [--ppd PixelsPerDegree] [--heatmap Prefix] [--threads Count]\n"
+           "       Thresholds default to --psnr-min %.0f --ssim-min %.2f --flip-max %.2f.\n",
+           DefaultPSNRMin, DefaultSSIMMin, DefaultFLIPMax);
+}
+
+int main(int ArgCount, char** Args)
+{
+    if (ArgCount < 3)
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    const char* ReferenceFile = Args[1];
+    const char* TestFile = Args[2];
+    const char* HeatmapPrefix = nullptr;
+    double PSNRMin = DefaultPSNRMin;
+    double SSIMMin = DefaultSSIMMin;
+    double FLIPMax = DefaultFLIPMax;
+    ImageCompare::Settings CompareSettings;
+    CompareSettings.NumThreads = Threading::GetNumHardwareThreads();
+
+    for (INT i = 3; i < ArgCount; ++i)
+    {
+        std::string Option = Args[i];
+        if (i + 1 >= ArgCount)
+        {
+            PrintUsage();
+            return 2;
+        }
+
+        const char* Value = Args[++i];
+        if (Option == "--psnr-min")
+        {
+            PSNRMin = atof(Value);
+        }
+        else if (Option == "--ssim-min")
+        {
+            SSIMMin = atof(Value);
+        }
+        else if (Option == "--flip-max")
+        {
+            FLIPMax = atof(Value);
+        }
+        else if (Option == "--ppd")
+        {
+            CompareSettings.PixelsPerDegree = (float)atof(Value);
+        }
+        else if (Option == "--heatmap")
+        {
+            HeatmapPrefix = Value;
+        }
+        else if (Option == "--threads")
+        {
+            CompareSettings.NumThreads = (UINT)atoi(Value);
+        }
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    // The metrics run on the job system's workers, this thread is the first of them.
+    CompareSettings.NumThreads = CompareSettings.NumThreads > 0 ? CompareSettings.NumThreads : 1;
+    JobSystem::Initialize(CompareSettings.NumThreads);
+
+    ImageCompare::Image Reference, Test;
+    if (!ImageCompare::ReadImage(ReferenceFile, &Reference))
+    {
+        printf("Failed to read %s\n", ReferenceFile);
+        return 2;
+    }
+    if (!ImageCompare::ReadImage(TestFile, &Test))
+    {
+        printf("Failed to read %s\n", TestFile);
+        return 2;
+    }
+    if (Reference.Width != Test.Width || Reference.Height != Test.Height)
+    {
+        printf("Size mismatch: %ux%u vs %ux%u\n", Reference.Width, Reference.Height, Test.Width, Test.Height);
+        return 2;
+    }
+
+    ImageCompare::ErrorMap SSIMMap, FLIPMap;
+    ImageCompare::ErrorMap* SSIMMapPtr = HeatmapPrefix ? &SSIMMap : nullptr;
+    ImageCompare::ErrorMap* FLIPMapPtr = HeatmapPrefix ? &FLIPMap : nullptr;
+
+    auto Start = std::chrono::high_resolution_clock::now();
+    double PSNR = ImageCompare::ComputePSNR(Reference, Test, CompareSettings);
+    auto AfterPSNR = std::chrono::high_resolution_clock::now();
+    double SSIM = ImageCompare::ComputeSSIM(Reference, Test, CompareSettings, SSIMMapPtr);
+    auto AfterSSIM = std::chrono::high_resolution_clock::now();
+    double FLIP = ImageCompare::ComputeFLIP(Reference, Test, CompareSettings, FLIPMapPtr);
+    auto AfterFLIP = std::chrono::high_resolution_clock::now();
+
+    auto Milliseconds = [](std::chrono::high_resolution_clock::time_point From, std::chrono::high_resolution_clock::time_point To)
+    {
+        return std::chrono::duration<double, std::milli>(To - From).count();
+    };
+
+    printf("%ux%u, %u threads\n", Reference.Width, Reference.Height, CompareSettings.NumThreads);
+    printf("PSNR: %8.3f dB (%.2f ms)\n", PSNR, Milliseconds(Start, AfterPSNR));
+    printf("SSIM: %8.5f    (%.2f ms)\n", SSIM, Milliseconds(AfterPSNR, AfterSSIM));
+    printf("FLIP: %8.5f    (%.2f ms)\n", FLIP, Milliseconds(AfterSSIM, AfterFLIP));
+
+    if (HeatmapPrefix)
+    {
+        std::string Prefix = HeatmapPrefix;
+        if (!ImageCompare::WriteHeatmap((Prefix + "SSIM.tga").c_str(), SSIMMap) ||
+            !ImageCompare::WriteHeatmap((Prefix + "FLIP.tga").c_str(), FLIPMap))
+        {
+            printf("Failed to write heatmaps with prefix %s\n", HeatmapPrefix);
+            return 2;
+        }
+    }
+
+    bool Passed = true;
+    if (PSNR < PSNRMin)
+    {
+        printf("FAIL: PSNR %.3f dB below %.3f dB\n", PSNR, PSNRMin);
+        Passed = false;
+    }
+    if (SSIM < SSIMMin)
+    {
+        printf("FAIL: SSIM %.5f below %.5f\n", SSIM, SSIMMin);
+        Passed = false;
+    }
+    if (FLIP > FLIPMax)
+    {
+        printf("FAIL: FLIP %.5f above %.5f\n", FLIP, FLIPMax);
+        Passed = false;
+    }
+    return Passed ? 0 : 1;
+}
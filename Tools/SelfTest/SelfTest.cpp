@@ -0,0 +1,211 @@
+#include "../../Headers/BottomLevelBatch.h"
+#include "../../Headers/BottomLevelCompaction.h"
+#include "../../Headers/CpuTracer.h"
+#include "../../Headers/DeferredRelease.h"
+#include "../../Headers/DescriptorAllocator.h"
+#include "../../Headers/FramePacing.h"
+#include "../../Headers/FrustumCulling.h"
+#include "../../Headers/HeapAllocator.h"
+#include "../../Headers/ImageCompare.h"
+#include "../../Headers/InstanceTransforms.h"
+#include "../../Headers/JobSystem.h"
+#include "../../Headers/OcclusionCulling.h"
+#include "../../Headers/ParallelRecording.h"
+#include "../../Headers/QueueScheduler.h"
+#include "../../Headers/RenderGraph.h"
+#include "../../Headers/ResourceStates.h"
+#include "../../Headers/RtPipeline.h"
+#include "../../Headers/ShaderBindingTable.h"
+#include "../../Headers/ShaderCache.h"
+#include "../../Headers/ShaderCompilation.h"
+#include "../../Headers/ShaderReload.h"
+#include "../../Headers/StreamingUploads.h"
+#include "../../Headers/Threading.h"
+#include "../../Headers/TopLevelPolicy.h"
+#include "../../Headers/UploadRing.h"
+#include <chrono>
+#include <functional>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Runs the tests of the pure CPU modules, and their benchmarks when asked, outside of the demos.
+// The modules report their details with OutputDebugStringA, this prints one line per module.
+// Exit codes: 0 pass, 1 a test failed, 2 bad arguments.
+
+// The sizes the demos run with, see DXRTutorial::BottomLevelScratchBudget and GlobalResources.
+static const UINT64 BottomLevelScratchBudget = 32 * 1024 * 1024;
+static const UINT64 StreamingUploadsSize = 32 * 1024 * 1024;
+static const UINT64 StreamingBudgetPerFrame = 8 * 1024 * 1024;
+static const UINT TracerWidth = 2560 / 4; // A quarter of the window's resolution.
+static const UINT TracerHeight = 1440 / 4;
+
+struct Module
+{
+    const char* Name;
+    std::function<bool()> Test;      // Empty when the module only has benchmarks.
+    std::function<void()> Benchmark; // Empty when the module only has tests.
+};
+
+static void PrintUsage()
+{
+    printf("Usage: SelfTest [--benchmarks] [--threads Count] [Module...]\n"
+           "       Runs the tests of the given modules, or of all of them, and their benchmarks with --benchmarks.\n");
+}
+
+int main(int ArgCount, char** Args)
+{
+    const Module Modules[] = {
+        {"JobSystem",
+         [] { return JobSystem::RunTest(100000); },
+         [] { JobSystem::RunBenchmark(200000); }},
+        {"BottomLevelBatch", nullptr,
+         [] { BottomLevelBatch::RunBenchmark(100000, BottomLevelScratchBudget); }},
+        {"BottomLevelCompaction",
+         [] { return BottomLevelCompaction::RunTest(2000); },
+         nullptr},
+        {"TopLevelPolicy", nullptr,
+         [] { TopLevelPolicy::RunBenchmark(10000, 60); }},
+        {"InstanceTransforms",
+         [] { return InstanceTransforms::RunTest(100003); },
+         [] { InstanceTransforms::RunBenchmark(1000000, 16); }},
+        {"FrustumCulling", nullptr,
+         [] { FrustumCulling::RunBenchmark(1000000, 16); }},
+        {"OcclusionCulling",
+         [] { return OcclusionCulling::RunTest(100000); },
+         [] { OcclusionCulling::RunBenchmark(1000000, 16); }},
+        {"HeapAllocator",
+         [] { return HeapAllocator::RunFuzzTest(1000000, 0x5EED); },
+         [] { HeapAllocator::RunBenchmark(1000000); }},
+        {"StreamingUploads",
+         [] { return StreamingUploads::RunTest(20000); },
+         []
+         {
+             // At the frame budget and without one.
+             StreamingUploads::RunBenchmark(20000, StreamingUploadsSize, StreamingBudgetPerFrame);
+             StreamingUploads::RunBenchmark(20000, StreamingUploadsSize, StreamingUploadsSize);
+         }},
+        {"DescriptorAllocator",
+         [] { return DescriptorAllocator::RunTest(400000, 4); },
+         [] { DescriptorAllocator::RunBenchmark(4000000, 4); }},
+        {"ResourceStates",
+         [] { return ResourceStates::RunTest(20000, 64); },
+         nullptr},
+        {"RenderGraph",
+         [] { return RenderGraph::RunTest(300, 200); },
+         [] { RenderGraph::RunBenchmark(20, 1000); }},
+        {"QueueScheduler",
+         [] { return QueueScheduler::RunTest(100000); },
+         nullptr},
+        {"DeferredRelease",
+         [] { return DeferredRelease::RunTest(200000, 4); },
+         [] { DeferredRelease::RunBenchmark(2000000, 4); }},
+        {"ImageCompare",
+         [] { return ImageCompare::RunTest(203, 117); },
+         nullptr},
+        {"CpuTracer",
+         [] { return CpuTracer::RunTest(TracerWidth / 2, TracerHeight / 2); },
+         []
+         {
+             // The recursive and wavefront tracers on the DXRTutorial scene.
+             CpuTracer::Scene TracerScene;
+             CpuTracer::CreateTutorialScene(&TracerScene);
+             CpuTracer::RunBenchmark(TracerScene, TracerWidth, TracerHeight);
+         }},
+        {"UploadRing", nullptr,
+         [] { UploadRing::RunBenchmark(4000000, 4); }},
+        {"FramePacing", nullptr,
+         [] { FramePacing::RunBenchmark(2000); }},
+        {"ParallelRecording",
+         [] { return ParallelRecording::RunTest(2000, 8); },
+         [] { ParallelRecording::RunBenchmark(200, 64, 20000); }},
+        {"RtPipeline",
+         [] { return RtPipeline::RunTest(); },
+         nullptr},
+        {"ShaderBindingTable",
+         [] { return ShaderBindingTable::RunTest(10000); },
+         nullptr},
+        {"ShaderCompilation",
+         [] { return ShaderCompilation::RunTest(8, 6); },
+         [] { ShaderCompilation::RunBenchmark(32); }},
+        {"ShaderCache",
+         [] { return ShaderCache::RunTest(12); },
+         [] { ShaderCache::RunBenchmark(2000); }},
+        {"ShaderReload",
+         [] { return ShaderReload::RunTest(24, 2000); },
+         nullptr},
+    };
+
+    bool RunBenchmarks = false;
+    UINT NumThreads = Threading::GetNumHardwareThreads();
+    std::vector<std::string> Selected;
+    for (INT i = 1; i < ArgCount; ++i)
+    {
+        std::string Option = Args[i];
+        if (Option == "--benchmarks")
+        {
+            RunBenchmarks = true;
+        }
+        else if (Option == "--threads" && i + 1 < ArgCount)
+        {
+            NumThreads = (UINT)atoi(Args[++i]);
+        }
+        else if (Option.rfind("--", 0) == 0)
+        {
+            PrintUsage();
+            return 2;
+        }
+        else
+        {
+            bool IsModule = false;
+            for (const Module& Candidate : Modules)
+            {
+                IsModule = IsModule || Option == Candidate.Name;
+            }
+            if (!IsModule)
+            {
+                printf("Unknown module %s\n", Args[i]);
+                return 2;
+            }
+            Selected.push_back(Option);
+        }
+    }
+
+    // Everything parallel runs on its workers, this thread is the first of them.
+    JobSystem::Initialize(NumThreads > 0 ? NumThreads : 1);
+
+    UINT NumFailed = 0;
+    for (const Module& Current : Modules)
+    {
+        bool IsSelected = Selected.empty();
+        for (const std::string& Name : Selected)
+        {
+            IsSelected = IsSelected || Name == Current.Name;
+        }
+        if (!IsSelected)
+        {
+            continue;
+        }
+
+        if (Current.Test)
+        {
+            auto Start = std::chrono::high_resolution_clock::now();
+            bool Passed = Current.Test();
+            auto End = std::chrono::high_resolution_clock::now();
+            printf("%-20s test %s, %.0f ms\n", Current.Name, Passed ? "passed" : "FAILED",
+                   std::chrono::duration<double, std::milli>(End - Start).count());
+            NumFailed += Passed ? 0 : 1;
+        }
+        if (Current.Benchmark && RunBenchmarks)
+        {
+            auto Start = std::chrono::high_resolution_clock::now();
+            Current.Benchmark();
+            auto End = std::chrono::high_resolution_clock::now();
+            printf("%-20s benchmark, %.0f ms\n", Current.Name,
+                   std::chrono::duration<double, std::milli>(End - Start).count());
+        }
+    }
+
+    printf("%u failed\n", NumFailed);
+    return NumFailed > 0 ? 1 : 0;
+}
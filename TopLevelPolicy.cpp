@@ -0,0 +1,121 @@
+#include "Headers/TopLevelPolicy.h"
+#include <chrono>
+#include <float.h>
+#include <math.h>
+
+using namespace DirectX;
+
+namespace TopLevelPolicy
+{
+    Action Evaluate(State* InState, const Bvh::AABB* InstanceBounds, UINT NumInstances, const Settings& InSettings)
+    {
+        // An update can't add or remove instances.
+        bool Rebuild = InState->Tree.Nodes.empty() || NumInstances != InState->NumInstances;
+        if (!Rebuild)
+        {
+            Bvh::Refit(&InState->Tree, InstanceBounds);
+            InState->Cost = Bvh::ComputeSAHCost(InState->Tree);
+            Rebuild = InState->Cost > InState->BuildCost * (1.f + InSettings.MaxDegradation);
+        }
+
+        if (Rebuild)
+        {
+            Bvh::Build(InstanceBounds, NumInstances, &InState->Tree, 1);
+            InState->NumInstances = NumInstances;
+            InState->BuildCost = Bvh::ComputeSAHCost(InState->Tree);
+            InState->Cost = InState->BuildCost;
+            InState->NumUpdates = 0;
+            InState->NumRebuilds++;
+            return Action::Rebuild;
+        }
+
+        InState->NumUpdates++;
+        return Action::Update;
+    }
+
+    Bvh::AABB TransformBounds(const Bvh::AABB& Box, const float Transform[3][4])
+    {
+        // Arvo: per output axis, pick the smaller and larger product of each input axis.
+        const float* Min = &Box.Min.x;
+        const float* Max = &Box.Max.x;
+        float OutMin[3];
+        float OutMax[3];
+        for (UINT Row = 0; Row < 3; ++Row)
+        {
+            OutMin[Row] = Transform[Row][3];
+            OutMax[Row] = Transform[Row][3];
+            for (UINT Column = 0; Column < 3; ++Column)
+            {
+                float A = Transform[Row][Column] * Min[Column];
+                float B = Transform[Row][Column] * Max[Column];
+                OutMin[Row] += A < B ? A : B;
+                OutMax[Row] += A < B ? B : A;
+            }
+        }
+
+        Bvh::AABB Result;
+        Result.Min = XMFLOAT3(OutMin[0], OutMin[1], OutMin[2]);
+        Result.Max = XMFLOAT3(OutMax[0], OutMax[1], OutMax[2]);
+        return Result;
+    }
+
+    static float NextRandom(UINT32* Seed)
+    {
+        *Seed = *Seed * 1664525u + 1013904223u;
+        return (float)(*Seed >> 8) / (float)(1 << 24);
+    }
+
+    void RunBenchmark(UINT NumInstances, UINT NumFrames)
+    {
+        // Unit boxes scattered in a cube, drifting with a constant velocity like debris after an explosion.
+        std::vector<XMFLOAT3> Positions(NumInstances);
+        std::vector<XMFLOAT3> Velocities(NumInstances);
+        UINT32 Seed = 0x9E3779B9;
+        float Extent = 4.f * cbrtf((float)NumInstances);
+        for (UINT i = 0; i < NumInstances; ++i)
+        {
+            Positions[i] = XMFLOAT3(NextRandom(&Seed) * Extent, NextRandom(&Seed) * Extent, NextRandom(&Seed) * Extent);
+            Velocities[i] = XMFLOAT3(NextRandom(&Seed) - 0.5f, NextRandom(&Seed) - 0.5f, NextRandom(&Seed) - 0.5f);
+        }
+
+        // Negative thresholds never update, huge ones never rebuild.
+        const float Thresholds[5] = {-1.f, 0.1f, 0.3f, 1.f, FLT_MAX};
+        const char* Names[5] = {"always rebuild", "policy 10%", "policy 30%", "policy 100%", "always update"};
+
+        std::vector<Bvh::AABB> Bounds(NumInstances);
+        for (UINT t = 0; t < _countof(Thresholds); ++t)
+        {
+            State PolicyState;
+            Settings PolicySettings;
+            PolicySettings.MaxDegradation = Thresholds[t];
+
+            double TotalCost = 0.0;
+            double Milliseconds = 0.0;
+            for (UINT Frame = 0; Frame < NumFrames; ++Frame)
+            {
+                float Time = (float)Frame * 0.1f;
+                for (UINT i = 0; i < NumInstances; ++i)
+                {
+                    XMFLOAT3 Center(Positions[i].x + Velocities[i].x * Time,
+                                    Positions[i].y + Velocities[i].y * Time,
+                                    Positions[i].z + Velocities[i].z * Time);
+                    Bounds[i].Min = XMFLOAT3(Center.x - 0.5f, Center.y - 0.5f, Center.z - 0.5f);
+                    Bounds[i].Max = XMFLOAT3(Center.x + 0.5f, Center.y + 0.5f, Center.z + 0.5f);
+                }
+
+                auto Start = std::chrono::high_resolution_clock::now();
+                Evaluate(&PolicyState, Bounds.data(), NumInstances, PolicySettings);
+                auto End = std::chrono::high_resolution_clock::now();
+                Milliseconds += std::chrono::duration<double, std::milli>(End - Start).count();
+                TotalCost += PolicyState.Cost;
+            }
+
+            char Message[256];
+            snprintf(Message, sizeof(Message),
+                     "TopLevelPolicy %u instances, %u frames, %s: average SAH cost %.1f, %u rebuilds, %.3f ms/frame\n",
+                     NumInstances, NumFrames, Names[t], TotalCost / NumFrames, PolicyState.NumRebuilds,
+                     Milliseconds / NumFrames);
+            OutputDebugStringA(Message);
+        }
+    }
+}
@@ -0,0 +1,138 @@
+#include "Headers/UploadRing.h"
+#include "Headers/Threading.h"
+#include <chrono>
+#include <mutex>
+
+namespace UploadRing
+{
+    void Initialize(Ring* InRing, UINT64 Capacity)
+    {
+        assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0);
+        InRing->Capacity = Capacity;
+        InRing->Head.store(0);
+        InRing->Tail.store(0);
+        InRing->NumFailed.store(0);
+        InRing->FirstFrame = 0;
+        InRing->NumFrames = 0;
+    }
+
+    bool Allocate(Ring* InRing, UINT64 Size, UINT64 Alignment, UINT64* OutOffset)
+    {
+        const UINT64 Capacity = InRing->Capacity;
+        assert(Size <= Capacity && Alignment > 0 && (Alignment & (Alignment - 1)) == 0 && Alignment <= Capacity);
+
+        UINT64 Head = InRing->Head.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            UINT64 Start = (Head + Alignment - 1) & ~(Alignment - 1);
+            UINT64 Offset = Start & (Capacity - 1);
+            if (Offset + Size > Capacity)
+            {
+                // Skip the end of the buffer, the capacity is a multiple of any alignment.
+                Start += Capacity - Offset;
+            }
+            UINT64 End = Start + Size;
+
+            // The tail only moves forward, a stale one just fails early.
+            if (End - InRing->Tail.load(std::memory_order_acquire) > Capacity)
+            {
+                InRing->NumFailed.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (InRing->Head.compare_exchange_weak(Head, End, std::memory_order_relaxed))
+            {
+                *OutOffset = Start & (Capacity - 1);
+                return true;
+            }
+        }
+    }
+
+    void EndFrame(Ring* InRing, UINT64 FenceValue)
+    {
+        assert(InRing->NumFrames < MaxFramesInFlight);
+        UINT Index = (InRing->FirstFrame + InRing->NumFrames) % MaxFramesInFlight;
+        InRing->FrameFenceValues[Index] = FenceValue;
+        InRing->FrameEnds[Index] = InRing->Head.load(std::memory_order_relaxed);
+        InRing->NumFrames++;
+    }
+
+    void Retire(Ring* InRing, UINT64 CompletedFenceValue)
+    {
+        while (InRing->NumFrames > 0 && InRing->FrameFenceValues[InRing->FirstFrame] <= CompletedFenceValue)
+        {
+            InRing->Tail.store(InRing->FrameEnds[InRing->FirstFrame], std::memory_order_release);
+            InRing->FirstFrame = (InRing->FirstFrame + 1) % MaxFramesInFlight;
+            InRing->NumFrames--;
+        }
+    }
+
+    UINT64 GetUsedSize(const Ring& InRing)
+    {
+        return InRing.Head.load(std::memory_order_relaxed) - InRing.Tail.load(std::memory_order_relaxed);
+    }
+
+    // Frames of NumAllocations / NumFrames constants, the GPU lagging two frames behind. Returns allocations per second.
+    template <typename AllocateFunction>
+    static double RunFrames(Ring* InRing, UINT NumAllocations, UINT NumThreads, AllocateFunction AllocateConstants)
+    {
+        const UINT NumFrames = 16;
+        const UINT FramesInFlight = 2;
+        const UINT PerFrame = NumAllocations / NumFrames;
+
+        auto Start = std::chrono::high_resolution_clock::now();
+        for (UINT FrameIndex = 0; FrameIndex < NumFrames; ++FrameIndex)
+        {
+            UINT64 FenceValue = FrameIndex + 1;
+            if (FenceValue > FramesInFlight)
+            {
+                Retire(InRing, FenceValue - FramesInFlight);
+            }
+            Threading::ParallelFor(PerFrame, NumThreads, 1024, [&](UINT Begin, UINT End)
+            {
+                for (UINT i = Begin; i < End; ++i)
+                {
+                    // A draw's constants, 64 bytes to 1KB.
+                    UINT64 Offset;
+                    AllocateConstants(64 + (UINT64)((i * 2654435761u) >> 22), &Offset);
+                }
+            });
+            EndFrame(InRing, FenceValue);
+        }
+        auto End = std::chrono::high_resolution_clock::now();
+        return (double)PerFrame * NumFrames / std::chrono::duration<double>(End - Start).count();
+    }
+
+    void RunBenchmark(UINT NumAllocations, UINT NumThreads)
+    {
+        // Large enough for three frames of the worst case, 1KB each.
+        UINT64 Capacity = 1;
+        while (Capacity < 3ull * 1024 * (NumAllocations / 16))
+        {
+            Capacity *= 2;
+        }
+
+        Ring LockFree;
+        Initialize(&LockFree, Capacity);
+        double LockFreeRate = RunFrames(&LockFree, NumAllocations, NumThreads, [&](UINT64 Size, UINT64* Offset)
+        {
+            Allocate(&LockFree, Size, 256, Offset);
+        });
+
+        Ring Locked;
+        Initialize(&Locked, Capacity);
+        std::mutex Lock;
+        double LockedRate = RunFrames(&Locked, NumAllocations, NumThreads, [&](UINT64 Size, UINT64* Offset)
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            Allocate(&Locked, Size, 256, Offset);
+        });
+
+        char Message[256];
+        snprintf(Message, sizeof(Message),
+                 "UploadRing: %u allocations on %u threads, %.1f M/s lock-free, %.1f M/s behind a mutex, "
+                 "%.1f MB ring, %u failed\n",
+                 NumAllocations, NumThreads, LockFreeRate * 1e-6, LockedRate * 1e-6, Capacity / (1024.0 * 1024.0),
+                 LockFree.NumFailed.load() + Locked.NumFailed.load());
+        OutputDebugStringA(Message);
+    }
+}